@@ -0,0 +1,542 @@
+/*
+ * Copyright (C) 2019 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+
+#include <soss/mock/api.hpp>
+#include <soss/Instance.hpp>
+#include <soss/utilities.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <ctime>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+//==============================================================================
+/// Every allocation of the process gets counted, including the ones that are
+/// made inside of soss and its middleware plugins
+std::atomic<uint64_t> allocations(0);
+
+} // anonymous namespace
+
+//==============================================================================
+void* operator new(const std::size_t size)
+{
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  if(void* const ptr = std::malloc(size? size : 1))
+    return ptr;
+
+  throw std::bad_alloc();
+}
+
+//==============================================================================
+void* operator new[](const std::size_t size)
+{
+  return ::operator new(size);
+}
+
+//==============================================================================
+void* operator new(const std::size_t size, const std::nothrow_t&) noexcept
+{
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  return std::malloc(size? size : 1);
+}
+
+//==============================================================================
+void* operator new[](const std::size_t size, const std::nothrow_t& t) noexcept
+{
+  return ::operator new(size, t);
+}
+
+//==============================================================================
+void operator delete(void* const ptr) noexcept
+{
+  std::free(ptr);
+}
+
+//==============================================================================
+void operator delete[](void* const ptr) noexcept
+{
+  std::free(ptr);
+}
+
+//==============================================================================
+void operator delete(void* const ptr, std::size_t) noexcept
+{
+  std::free(ptr);
+}
+
+//==============================================================================
+void operator delete[](void* const ptr, std::size_t) noexcept
+{
+  std::free(ptr);
+}
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+//==============================================================================
+struct Options
+{
+  std::string config = SOSS_BENCHMARK__MOCK_CONFIG;
+  std::string topic_in = "bench_in";
+  std::string topic_out = "bench_out";
+  std::string type = "soss_benchmark/Payload";
+
+  // How many messages get measured, and how many get sent before that
+  std::size_t count = 100000;
+  std::size_t warmup = 1000;
+
+  // Messages per second, or zero to send as fast as the window allows
+  double rate = 0.0;
+
+  // The most messages that may be on their way at once when there is no rate
+  std::size_t window = 100;
+
+  // The shape of each message
+  std::size_t fields = 4;
+  std::size_t array = 0;
+  std::size_t text = 0;
+
+  // The run fails if it does worse than these, unless they are zero
+  double min_rate = 0.0;
+  double max_p99_us = 0.0;
+};
+
+//==============================================================================
+void print_usage()
+{
+  std::cout
+      << "Usage: soss-benchmark [options]\n\n"
+      << "Sends messages into soss with the mock middleware and measures how "
+      << "they come out.\n\n"
+      << "  --config <file>    soss configuration to run, which must route "
+      << "the mock\n"
+      << "                     topic [--in] to the mock topic [--out]\n"
+      << "  --in <topic>       topic that messages get published to "
+      << "(bench_in)\n"
+      << "  --out <topic>      topic that messages are received from "
+      << "(bench_out)\n"
+      << "  --type <type>      message type of the topics "
+      << "(soss_benchmark/Payload)\n"
+      << "  --count <n>        messages to measure (100000)\n"
+      << "  --warmup <n>       messages to send before measuring (1000)\n"
+      << "  --rate <hz>        messages per second, 0 for as fast as "
+      << "possible (0)\n"
+      << "  --window <n>       most messages in flight when there is no rate "
+      << "(100)\n"
+      << "  --fields <n>       double fields in each message (4)\n"
+      << "  --array <n>        elements of a float array in each message (0)\n"
+      << "  --text <n>         bytes of a string in each message (0)\n"
+      << "  --min-rate <hz>    fail if fewer messages per second get through\n"
+      << "  --max-p99 <us>     fail if the 99th percentile latency is higher\n"
+      << std::endl;
+}
+
+//==============================================================================
+bool parse_options(const int argc, char* argv[], Options& options)
+{
+  for(int i=1; i < argc; ++i)
+  {
+    const std::string arg = argv[i];
+    if(arg == "-h" || arg == "--help")
+    {
+      print_usage();
+      std::exit(0);
+    }
+
+    if(i+1 >= argc)
+    {
+      std::cerr << "Missing a value for the option [" << arg << "]"
+                << std::endl;
+      return false;
+    }
+
+    const std::string value = argv[++i];
+    const auto size = [&]() { return std::stoul(value); };
+    const auto real = [&]() { return std::stod(value); };
+
+    try
+    {
+      if(arg == "--config")
+        options.config = value;
+      else if(arg == "--in")
+        options.topic_in = value;
+      else if(arg == "--out")
+        options.topic_out = value;
+      else if(arg == "--type")
+        options.type = value;
+      else if(arg == "--count")
+        options.count = size();
+      else if(arg == "--warmup")
+        options.warmup = size();
+      else if(arg == "--rate")
+        options.rate = real();
+      else if(arg == "--window")
+        options.window = std::max<std::size_t>(1, size());
+      else if(arg == "--fields")
+        options.fields = size();
+      else if(arg == "--array")
+        options.array = size();
+      else if(arg == "--text")
+        options.text = size();
+      else if(arg == "--min-rate")
+        options.min_rate = real();
+      else if(arg == "--max-p99")
+        options.max_p99_us = real();
+      else
+      {
+        std::cerr << "Unknown option [" << arg << "]" << std::endl;
+        return false;
+      }
+    }
+    catch(const std::exception&)
+    {
+      std::cerr << "Invalid value [" << value << "] for the option [" << arg
+                << "]" << std::endl;
+      return false;
+    }
+  }
+
+  if(options.count == 0)
+  {
+    std::cerr << "At least one message must be measured" << std::endl;
+    return false;
+  }
+
+  return true;
+}
+
+//==============================================================================
+soss::Message make_message(const Options& options)
+{
+  soss::Message message;
+  message.type = options.type;
+  message.data["seq"] = soss::Convert<int64_t>::make_soss_field(0);
+  message.data["stamp"] = soss::Convert<int64_t>::make_soss_field(0);
+
+  for(std::size_t i=0; i < options.fields; ++i)
+  {
+    message.data["value_" + std::to_string(i)] =
+        soss::Convert<double>::make_soss_field(static_cast<double>(i) + 0.5);
+  }
+
+  if(options.array > 0)
+  {
+    std::vector<float> samples(options.array);
+    for(std::size_t i=0; i < samples.size(); ++i)
+      samples[i] = static_cast<float>(i)*0.25f;
+
+    message.data["samples"] =
+        soss::Convert<std::vector<float>>::make_soss_field(samples);
+  }
+
+  if(options.text > 0)
+  {
+    message.data["text"] = soss::Convert<std::string>::make_soss_field(
+          std::string(options.text, 'x'));
+  }
+
+  return message;
+}
+
+//==============================================================================
+/// Middlewares that pass integers through text, like websocket, may hand them
+/// back as a different integer type than the one they were sent as
+bool read_integer(
+    const soss::Message& message,
+    const std::string& name,
+    int64_t& value)
+{
+  const auto it = message.data.find(name);
+  if(it == message.data.end())
+    return false;
+
+  if(const int64_t* const i = it->second.cast<int64_t>())
+    value = *i;
+  else if(const uint64_t* const u = it->second.cast<uint64_t>())
+    value = static_cast<int64_t>(*u);
+  else if(const double* const d = it->second.cast<double>())
+    value = static_cast<int64_t>(*d);
+  else
+    return false;
+
+  return true;
+}
+
+//==============================================================================
+int64_t now_ns()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        Clock::now().time_since_epoch()).count();
+}
+
+//==============================================================================
+/// Collects the messages that come out of soss
+class Receiver
+{
+public:
+
+  explicit Receiver(const std::size_t count)
+  {
+    // Reserving up front keeps the receiver from allocating while we measure
+    _latencies.reserve(count);
+  }
+
+  void receive(const soss::Message& message)
+  {
+    const int64_t received = now_ns();
+    int64_t seq = 0;
+    int64_t stamp = 0;
+    if(!read_integer(message, "seq", seq)
+       || !read_integer(message, "stamp", stamp))
+      return;
+
+    std::unique_lock<std::mutex> lock(_mutex);
+    ++_received;
+    _last = Clock::now();
+    if(seq >= _first_measured && _latencies.size() < _latencies.capacity())
+      _latencies.push_back(received - stamp);
+
+    _cv.notify_all();
+  }
+
+  /// Messages with a sequence number below this are not measured
+  void measure_from(const int64_t seq)
+  {
+    std::unique_lock<std::mutex> lock(_mutex);
+    _first_measured = seq;
+    _latencies.clear();
+  }
+
+  /// Wait until at most a number of messages are on their way
+  bool wait_for_window(const std::size_t sent, const std::size_t window,
+                       const std::chrono::milliseconds timeout)
+  {
+    std::unique_lock<std::mutex> lock(_mutex);
+    return _cv.wait_for(lock, timeout, [&]()
+    {
+      return sent < _received + window;
+    });
+  }
+
+  std::size_t received() const
+  {
+    std::unique_lock<std::mutex> lock(_mutex);
+    return _received;
+  }
+
+  Clock::time_point last() const
+  {
+    std::unique_lock<std::mutex> lock(_mutex);
+    return _last;
+  }
+
+  std::vector<int64_t> latencies() const
+  {
+    std::unique_lock<std::mutex> lock(_mutex);
+    return _latencies;
+  }
+
+private:
+
+  mutable std::mutex _mutex;
+  std::condition_variable _cv;
+  std::size_t _received = 0;
+  Clock::time_point _last;
+  int64_t _first_measured = 0;
+  std::vector<int64_t> _latencies;
+
+};
+
+//==============================================================================
+double percentile_us(const std::vector<int64_t>& sorted, const double p)
+{
+  if(sorted.empty())
+    return 0.0;
+
+  const std::size_t index = std::min(
+        sorted.size() - 1,
+        static_cast<std::size_t>(p*static_cast<double>(sorted.size())));
+  return static_cast<double>(sorted[index])*1e-3;
+}
+
+} // anonymous namespace
+
+//==============================================================================
+int main(int argc, char* argv[])
+{
+  using namespace std::chrono_literals;
+
+  Options options;
+  if(!parse_options(argc, argv, options))
+  {
+    print_usage();
+    return 1;
+  }
+
+  soss::InstanceHandle handle = soss::run_instance(options.config);
+  if(!handle)
+  {
+    std::cerr << "Failed to start soss with [" << options.config << "]"
+              << std::endl;
+    return 1;
+  }
+
+  Receiver receiver(options.count);
+  if(!soss::mock::subscribe(
+       options.topic_out,
+       [&](const soss::Message& message) { receiver.receive(message); }))
+  {
+    std::cerr << "The configuration does not route anything to the mock "
+              << "topic [" << options.topic_out << "]" << std::endl;
+    return 1;
+  }
+
+  soss::Message message = make_message(options);
+  int64_t& seq = *message.data["seq"].cast<int64_t>();
+  int64_t& stamp = *message.data["stamp"].cast<int64_t>();
+
+  // Middlewares like websocket need a moment to connect, so we keep probing
+  // until the first message makes it through
+  const auto connect_deadline = Clock::now() + 30s;
+  std::size_t sent = 0;
+  while(receiver.received() == 0)
+  {
+    if(Clock::now() > connect_deadline)
+    {
+      std::cerr << "No messages came through within 30 seconds" << std::endl;
+      handle.quit().wait();
+      return 1;
+    }
+
+    seq = static_cast<int64_t>(sent++);
+    stamp = now_ns();
+    if(!soss::mock::publish_message(options.topic_in, message))
+    {
+      std::cerr << "The configuration does not route the mock topic ["
+                << options.topic_in << "] with the type [" << options.type
+                << "] anywhere" << std::endl;
+      handle.quit().wait();
+      return 1;
+    }
+
+    receiver.wait_for_window(sent, 1, 100ms);
+  }
+
+  const std::size_t total = sent + options.warmup + options.count;
+  const auto period = options.rate > 0.0?
+        std::chrono::duration_cast<Clock::duration>(
+          std::chrono::duration<double>(1.0/options.rate))
+      : Clock::duration(0);
+
+  uint64_t allocations_before = 0;
+  std::clock_t cpu_before = 0;
+  Clock::time_point start;
+  Clock::time_point next_send = Clock::now();
+
+  while(sent < total)
+  {
+    if(sent == total - options.count)
+    {
+      receiver.measure_from(static_cast<int64_t>(sent));
+      allocations_before = allocations.load(std::memory_order_relaxed);
+      cpu_before = std::clock();
+      start = Clock::now();
+    }
+
+    if(period.count() > 0)
+    {
+      std::this_thread::sleep_until(next_send);
+      next_send += period;
+    }
+    else
+    {
+      // Messages that never arrive must not stall the run forever, so the
+      // window gives up on them after a while
+      receiver.wait_for_window(sent, options.window, 100ms);
+    }
+
+    seq = static_cast<int64_t>(sent++);
+    stamp = now_ns();
+    soss::mock::publish_message(options.topic_in, message);
+  }
+
+  // Give the messages that are still on their way a chance to arrive
+  receiver.wait_for_window(sent, 1, 5s);
+
+  const std::clock_t cpu_after = std::clock();
+  const uint64_t allocations_after = allocations.load(std::memory_order_relaxed);
+  std::vector<int64_t> latencies = receiver.latencies();
+  const std::size_t received = latencies.size();
+  const Clock::time_point end = std::max(receiver.last(), start);
+
+  handle.quit().wait();
+
+  std::sort(latencies.begin(), latencies.end());
+  const double seconds = std::chrono::duration<double>(end - start).count();
+  const double throughput =
+      seconds > 0.0? static_cast<double>(received)/seconds : 0.0;
+  const double measured = static_cast<double>(options.count);
+  const double p99 = percentile_us(latencies, 0.99);
+
+  std::cout << std::fixed << std::setprecision(2)
+            << "config:           " << options.config << "\n"
+            << "messages:         " << received << " of " << options.count
+            << " received\n"
+            << "throughput:       " << throughput << " msgs/s\n"
+            << "latency p50:      " << percentile_us(latencies, 0.5) << " us\n"
+            << "latency p99:      " << p99 << " us\n"
+            << "latency p999:     " << percentile_us(latencies, 0.999) << " us\n"
+            << "latency max:      "
+            << (latencies.empty()? 0.0 : latencies.back()*1e-3) << " us\n"
+            << "allocations:      "
+            << static_cast<double>(allocations_after - allocations_before)
+               /measured << " per msg\n"
+            << "cpu:              "
+            << static_cast<double>(cpu_after - cpu_before)
+               /CLOCKS_PER_SEC/measured*1e6 << " us per msg"
+            << std::endl;
+
+  bool passed = true;
+  if(options.min_rate > 0.0 && throughput < options.min_rate)
+  {
+    std::cerr << "The throughput is below the minimum of [" << options.min_rate
+              << "] msgs/s" << std::endl;
+    passed = false;
+  }
+
+  if(options.max_p99_us > 0.0 && p99 > options.max_p99_us)
+  {
+    std::cerr << "The 99th percentile latency is above the maximum of ["
+              << options.max_p99_us << "] us" << std::endl;
+    passed = false;
+  }
+
+  return passed? 0 : 2;
+}
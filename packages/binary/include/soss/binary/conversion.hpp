@@ -0,0 +1,77 @@
+/*
+ * Copyright (C) 2019 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#ifndef SOSS__BINARY__CONVERSION_HPP
+#define SOSS__BINARY__CONVERSION_HPP
+
+#include <soss/binary/export.hpp>
+#include <soss/binary/format.hpp>
+#include <soss/binary/view.hpp>
+#include <soss/Message.hpp>
+
+#include <vector>
+
+namespace soss {
+namespace binary {
+
+//==============================================================================
+/// \brief The number of bytes that encode(~) needs for a message.
+///
+/// \returns 0 if the message cannot be encoded, because one of its fields
+/// holds a type without a FieldTypeTag or because it is too large for the
+/// 32-bit offsets of the format
+std::size_t SOSS_BINARY_API encoded_size(const soss::Message& message);
+
+//==============================================================================
+/// \brief Encode a message into memory that the caller provides, e.g. a
+/// record of a shared memory ring. The memory should be aligned to 8 bytes if
+/// it is going to be read with a MessageView in place.
+///
+/// \returns the number of bytes that were written, or 0 if the message cannot
+/// be encoded or does not fit into the capacity
+std::size_t SOSS_BINARY_API encode(
+    const soss::Message& message,
+    uint8_t* out,
+    std::size_t capacity);
+
+//==============================================================================
+/// \brief Encode a message into a vector, replacing its contents
+bool SOSS_BINARY_API encode(
+    const soss::Message& message,
+    std::vector<uint8_t>& out);
+
+//==============================================================================
+/// \brief Decode a whole message. Every byte that is read gets checked against
+/// the size, so damaged or truncated data is rejected instead of read out of
+/// bounds, and messages that would take more work than the limits allow are
+/// rejected as well. The data does not need to be aligned.
+bool SOSS_BINARY_API decode(
+    const uint8_t* data,
+    std::size_t size,
+    soss::Message& message,
+    const DecodeLimits& limits = DecodeLimits());
+
+//==============================================================================
+/// \brief The schema fingerprint that the block of this message will get, see
+/// BlockHeader::schema. This depends on the type name of the message and the
+/// names and tags of its top-level fields, but not on their values.
+uint64_t SOSS_BINARY_API schema(const soss::Message& message);
+
+} // namespace binary
+} // namespace soss
+
+#endif // SOSS__BINARY__CONVERSION_HPP
@@ -0,0 +1,113 @@
+/*
+ * Copyright (C) 2019 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#ifndef SOSS__BINARY__FORMAT_HPP
+#define SOSS__BINARY__FORMAT_HPP
+
+#include <cstdint>
+
+namespace soss {
+namespace binary {
+
+//==============================================================================
+// The soss binary format
+//
+// An encoded message starts with a Preamble, followed by the block of the
+// message itself. Every block looks the same, whether it is the top-level
+// message or a message nested inside of it:
+//
+//   BlockHeader
+//   FieldEntry[field_count]     sorted by field name
+//   data                        the type name, field names and field values
+//
+// Every offset inside of a block is counted from the start of that block, so
+// a nested block can be read on its own. Nested blocks lie after the field
+// table of their parent, which keeps readers from following a block into
+// itself. Blocks and array values start on multiples of 8 bytes, which lets
+// readers look at the arrays in place as long as the buffer itself is aligned
+// to 8 bytes.
+//
+// The values of the fields are laid out by their FieldTypeTag:
+//
+//   Bool                        1 byte, 0 or 1
+//   Int64, UInt64, Double       8 bytes
+//   String                      the characters, without a terminator
+//   Blob and numeric arrays     the elements, value_size/sizeof(T) of them
+//   Message                     a nested block
+//   StringVector                uint32_t count, uint32_t offsets[count+1]
+//                               relative to the value, then the characters; the
+//                               string i runs from offsets[i] to offsets[i+1]
+//   MessageVector               uint32_t count, uint32_t offsets[count]
+//                               relative to the value, then the nested blocks
+//
+// All numbers use the byte order of the host that wrote them. A reader on a
+// host with a different byte order sees a magic number that does not match,
+// and rejects the message instead of misreading it.
+//==============================================================================
+
+/// "SOSB" in the byte order of the writer
+constexpr uint32_t magic = 0x534f5342;
+
+/// Bumped whenever the layout changes in a way that older readers cannot read
+constexpr uint16_t format_version = 1;
+
+/// Blocks and array values are aligned to this many bytes
+constexpr uint32_t alignment = 8;
+
+//==============================================================================
+struct Preamble
+{
+  uint32_t magic;
+  uint16_t version;
+  uint16_t flags;
+};
+
+//==============================================================================
+struct BlockHeader
+{
+  /// The size of the whole block, including this header
+  uint32_t size;
+  uint32_t field_count;
+  uint32_t type_offset;
+  uint32_t type_length;
+
+  /// Fingerprint of the type name, field names and field tags of the message.
+  /// Two blocks with the same schema have their fields at the same indices.
+  uint64_t schema;
+};
+
+//==============================================================================
+struct FieldEntry
+{
+  uint32_t name_offset;
+  uint16_t name_length;
+
+  /// The soss::FieldTypeTag of the value
+  uint8_t tag;
+  uint8_t reserved;
+  uint32_t value_offset;
+  uint32_t value_size;
+};
+
+static_assert(sizeof(Preamble) == 8, "The preamble must be 8 bytes");
+static_assert(sizeof(BlockHeader) == 24, "A block header must be 24 bytes");
+static_assert(sizeof(FieldEntry) == 16, "A field entry must be 16 bytes");
+
+} // namespace binary
+} // namespace soss
+
+#endif // SOSS__BINARY__FORMAT_HPP
@@ -0,0 +1,247 @@
+/*
+ * Copyright (C) 2019 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#ifndef SOSS__BINARY__VIEW_HPP
+#define SOSS__BINARY__VIEW_HPP
+
+#include <soss/binary/export.hpp>
+#include <soss/binary/format.hpp>
+#include <soss/Message.hpp>
+
+#include <string>
+
+namespace soss {
+namespace binary {
+
+//==============================================================================
+/// Characters inside of an encoded message
+struct StringRef
+{
+  const char* data = nullptr;
+  std::size_t size = 0;
+
+  std::string str() const { return std::string(data, size); }
+
+  bool operator==(const std::string& other) const
+  {
+    return other.size() == size && other.compare(0, size, data, size) == 0;
+  }
+
+  bool operator!=(const std::string& other) const
+  {
+    return !(*this == other);
+  }
+};
+
+//==============================================================================
+/// Elements of an array inside of an encoded message
+template<typename T>
+class ArrayView
+{
+public:
+
+  using const_iterator = const T*;
+
+  ArrayView() = default;
+
+  ArrayView(const T* const data, const std::size_t size)
+    : _data(data),
+      _size(size)
+  {
+    // Do nothing
+  }
+
+  const T* data() const { return _data; }
+  std::size_t size() const { return _size; }
+  bool empty() const { return _size == 0; }
+
+  const_iterator begin() const { return _data; }
+  const_iterator end() const { return _data + _size; }
+
+  const T& operator[](const std::size_t index) const { return _data[index]; }
+
+private:
+
+  const T* _data = nullptr;
+  std::size_t _size = 0;
+
+};
+
+class FieldView;
+
+//==============================================================================
+/// Bounds on the work that decoding a message may take. Nested blocks always
+/// come after the field table of their parent and are smaller than it, so a
+/// damaged buffer cannot make a block contain itself, but the fields of a
+/// block may still all point at one shared nested block. These limits keep
+/// the decoding of such buffers from growing without bounds.
+struct DecodeLimits
+{
+  /// How deep messages may be nested inside of each other
+  std::size_t max_depth = 64;
+
+  /// How many elements may be decoded in total, counting the fields, the
+  /// elements of arrays and vectors, and the characters of strings. A message
+  /// written by encode(~) never has more elements than bytes, so 0 makes the
+  /// size of the encoded message the limit.
+  std::size_t max_elements = 0;
+};
+
+//==============================================================================
+/// MessageView reads an encoded message in place, without decoding it. Fields
+/// can be looked up by name with a binary search, or by index when the schema
+/// of the message is known, and their values are read straight out of the
+/// buffer. The buffer must stay alive and unchanged for as long as the view
+/// and anything that it handed out are in use.
+///
+/// The header and field table of each block are checked when a view of it is
+/// made, and every value is checked when it gets read, so a view never reads
+/// outside of the buffer. Accessors return empty results for anything that is
+/// missing, damaged, or of a different type.
+class SOSS_BINARY_API MessageView
+{
+public:
+
+  /// \brief Construct an invalid view
+  MessageView() = default;
+
+  /// \brief View a whole encoded message, as written by encode(~). The data
+  /// must be aligned to 8 bytes, otherwise the view is invalid.
+  static MessageView parse(const uint8_t* data, std::size_t size);
+
+  bool valid() const { return _block != nullptr; }
+
+  StringRef type() const;
+
+  /// \brief The schema fingerprint of the message, see BlockHeader::schema
+  uint64_t schema() const;
+
+  /// \brief The number of fields
+  std::size_t size() const;
+
+  /// \brief The field at the given index, in the order of the field names
+  FieldView field(std::size_t index) const;
+
+  /// \brief The field with the given name, or an invalid view if there is none
+  FieldView find(const std::string& name) const;
+
+  /// \brief Decode the whole message
+  bool to_message(
+      soss::Message& message,
+      const DecodeLimits& limits = DecodeLimits()) const;
+
+private:
+
+  friend class FieldView;
+
+  struct Budget;
+
+  static MessageView _block_at(const uint8_t* data, std::size_t size);
+
+  bool _to_message(soss::Message& message, Budget& budget) const;
+
+  const uint8_t* _block = nullptr;
+  std::size_t _size = 0;
+
+};
+
+//==============================================================================
+/// FieldView reads one field of an encoded message in place
+class SOSS_BINARY_API FieldView
+{
+public:
+
+  /// \brief Construct an invalid view
+  FieldView() = default;
+
+  bool valid() const { return _block != nullptr; }
+
+  StringRef name() const;
+
+  /// \brief The tag of the value, or FieldTypeTag::Other for an invalid view
+  FieldTypeTag tag() const;
+
+  /// Read a scalar value. These return false if the field holds a different
+  /// type.
+  bool get(bool& value) const;
+  bool get(int64_t& value) const;
+  bool get(uint64_t& value) const;
+  bool get(double& value) const;
+
+  /// \brief The characters of a String field
+  StringRef string() const;
+
+  /// \brief The elements of a numeric array. A Blob can be read as an array of
+  /// uint8_t. This returns an empty view if the field holds anything else.
+  template<typename T>
+  ArrayView<T> array() const
+  {
+    const FieldTypeTag expected =
+        soss::detail::FieldTypeTagOf<std::vector<T>>::value;
+
+    const bool blob = std::is_same<T, uint8_t>::value
+        && tag() == FieldTypeTag::Blob;
+
+    if(expected == FieldTypeTag::Other || (tag() != expected && !blob))
+      return ArrayView<T>();
+
+    const void* data;
+    std::size_t size;
+    if(!_value(data, size, alignof(T)) || size % sizeof(T) != 0)
+      return ArrayView<T>();
+
+    return ArrayView<T>(static_cast<const T*>(data), size/sizeof(T));
+  }
+
+  /// \brief The nested message of a Message field
+  MessageView message() const;
+
+  /// \brief The number of elements of an array, a StringVector or a
+  /// MessageVector
+  std::size_t count() const;
+
+  /// \brief An element of a StringVector field
+  StringRef string_at(std::size_t index) const;
+
+  /// \brief An element of a MessageVector field
+  MessageView message_at(std::size_t index) const;
+
+  /// \brief Decode the value of the field
+  bool to_field(
+      soss::Field& field,
+      const DecodeLimits& limits = DecodeLimits()) const;
+
+private:
+
+  friend class MessageView;
+
+  FieldView(const uint8_t* block, std::size_t size, const FieldEntry* entry);
+
+  bool _to_field(soss::Field& field, MessageView::Budget& budget) const;
+
+  bool _value(const void*& data, std::size_t& size, std::size_t align) const;
+
+  const uint8_t* _block = nullptr;
+  std::size_t _size = 0;
+  const FieldEntry* _entry = nullptr;
+
+};
+
+} // namespace binary
+} // namespace soss
+
+#endif // SOSS__BINARY__VIEW_HPP
@@ -0,0 +1,21 @@
+# - Config file for the binary soss message format package
+
+cmake_minimum_required(VERSION 3.5.1 FATAL_ERROR)
+
+if(soss-binary_CONFIG_INCLUDED)
+  return()
+endif()
+set(soss-binary_CONFIG_INCLUDED TRUE)
+
+if(NOT TARGET soss::soss-binary)
+  include("${CMAKE_CURRENT_LIST_DIR}/soss-binary-target.cmake")
+endif()
+
+if(NOT TARGET soss::binary)
+  add_library(soss::binary INTERFACE IMPORTED)
+  set_target_properties(soss::binary PROPERTIES
+    INTERFACE_LINK_LIBRARIES soss::soss-binary
+  )
+endif()
+
+set(soss-binary_FOUND TRUE)
@@ -0,0 +1,380 @@
+/*
+ * Copyright (C) 2019 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include <soss/binary/conversion.hpp>
+#include <soss/binary/view.hpp>
+
+#include <soss/Blob.hpp>
+
+#include <cstring>
+#include <limits>
+
+namespace soss {
+namespace binary {
+
+namespace {
+
+//==============================================================================
+std::size_t aligned(const std::size_t size)
+{
+  return (size + alignment - 1) & ~static_cast<std::size_t>(alignment - 1);
+}
+
+//==============================================================================
+/// FNV-1a, which is plenty for telling schemas apart
+class Fingerprint
+{
+public:
+
+  void add(const void* const data, const std::size_t size)
+  {
+    const uint8_t* const bytes = static_cast<const uint8_t*>(data);
+    for(std::size_t i=0; i < size; ++i)
+    {
+      _hash ^= bytes[i];
+      _hash *= 0x100000001b3ull;
+    }
+  }
+
+  void add(const std::string& text)
+  {
+    // The length keeps "ab"+"c" apart from "a"+"bc"
+    const uint32_t length = static_cast<uint32_t>(text.size());
+    add(&length, sizeof(length));
+    add(text.data(), text.size());
+  }
+
+  uint64_t value() const { return _hash; }
+
+private:
+
+  uint64_t _hash = 0xcbf29ce484222325ull;
+
+};
+
+//==============================================================================
+/// Lays out one block. When the base pointer is null, nothing gets written and
+/// the writer only measures how much room the block needs, so the same code
+/// takes care of encoded_size(~) and encode(~).
+class BlockWriter
+{
+public:
+
+  BlockWriter(uint8_t* const base)
+    : _base(base)
+  {
+    // Do nothing
+  }
+
+  /// \returns the size of the block, or 0 if it cannot be encoded
+  std::size_t write(const Message& message)
+  {
+    const std::size_t count = message.data.size();
+    _pos = sizeof(BlockHeader) + count*sizeof(FieldEntry);
+
+    BlockHeader header;
+    header.field_count = static_cast<uint32_t>(count);
+    header.type_offset = static_cast<uint32_t>(_pos);
+    header.type_length = static_cast<uint32_t>(message.type.size());
+    _put(message.type.data(), message.type.size());
+
+    Fingerprint schema;
+    schema.add(message.type);
+
+    std::size_t index = 0;
+    for(const auto& entry : message.data)
+    {
+      const std::string& name = entry.first;
+      if(name.size() > std::numeric_limits<uint16_t>::max())
+        return 0;
+
+      FieldEntry field;
+      field.name_offset = static_cast<uint32_t>(_pos);
+      field.name_length = static_cast<uint16_t>(name.size());
+      field.tag = static_cast<uint8_t>(entry.second.type_tag());
+      field.reserved = 0;
+      _put(name.data(), name.size());
+
+      schema.add(name);
+      schema.add(&field.tag, sizeof(field.tag));
+
+      _align();
+      field.value_offset = static_cast<uint32_t>(_pos);
+      if(!_value(entry.second))
+        return 0;
+
+      field.value_size = static_cast<uint32_t>(_pos - field.value_offset);
+      _put_at(sizeof(BlockHeader) + index*sizeof(FieldEntry),
+              &field, sizeof(field));
+      ++index;
+    }
+
+    _align();
+    if(_pos > std::numeric_limits<uint32_t>::max())
+      return 0;
+
+    header.size = static_cast<uint32_t>(_pos);
+    header.schema = schema.value();
+    _put_at(0, &header, sizeof(header));
+
+    return _pos;
+  }
+
+private:
+
+  bool _value(const Field& field)
+  {
+    switch(field.type_tag())
+    {
+      case FieldTypeTag::String:
+      {
+        const std::string& value = *field.cast<std::string>();
+        _put(value.data(), value.size());
+        return true;
+      }
+      case FieldTypeTag::Bool:
+      {
+        const uint8_t value = *field.cast<bool>()? 1 : 0;
+        _put(&value, sizeof(value));
+        return true;
+      }
+      case FieldTypeTag::Int64:
+        return _scalar(*field.cast<int64_t>());
+      case FieldTypeTag::UInt64:
+        return _scalar(*field.cast<uint64_t>());
+      case FieldTypeTag::Double:
+        return _scalar(*field.cast<double>());
+      case FieldTypeTag::Message:
+        return _block(*field.cast<Message>());
+      case FieldTypeTag::StringVector:
+        return _strings(*field.cast<std::vector<std::string>>());
+      case FieldTypeTag::Int64Vector:
+        return _array(*field.cast<std::vector<int64_t>>());
+      case FieldTypeTag::UInt64Vector:
+        return _array(*field.cast<std::vector<uint64_t>>());
+      case FieldTypeTag::DoubleVector:
+        return _array(*field.cast<std::vector<double>>());
+      case FieldTypeTag::MessageVector:
+        return _blocks(*field.cast<std::vector<Message>>());
+      case FieldTypeTag::UInt8Vector:
+        return _array(*field.cast<std::vector<uint8_t>>());
+      case FieldTypeTag::Int8Vector:
+        return _array(*field.cast<std::vector<int8_t>>());
+      case FieldTypeTag::UInt16Vector:
+        return _array(*field.cast<std::vector<uint16_t>>());
+      case FieldTypeTag::Int16Vector:
+        return _array(*field.cast<std::vector<int16_t>>());
+      case FieldTypeTag::UInt32Vector:
+        return _array(*field.cast<std::vector<uint32_t>>());
+      case FieldTypeTag::Int32Vector:
+        return _array(*field.cast<std::vector<int32_t>>());
+      case FieldTypeTag::FloatVector:
+        return _array(*field.cast<std::vector<float>>());
+      case FieldTypeTag::Blob:
+      {
+        const Blob& value = *field.cast<Blob>();
+        _put(value.data(), value.size());
+        return true;
+      }
+      case FieldTypeTag::Other:
+        break;
+    }
+
+    // Only the middleware that made this field knows what is inside of it
+    return false;
+  }
+
+  template<typename T>
+  bool _scalar(const T& value)
+  {
+    _put(&value, sizeof(T));
+    return true;
+  }
+
+  template<typename T>
+  bool _array(const std::vector<T>& values)
+  {
+    _put(values.data(), values.size()*sizeof(T));
+    return true;
+  }
+
+  bool _block(const Message& message)
+  {
+    BlockWriter nested(_base? _base + _pos : nullptr);
+    const std::size_t size = nested.write(message);
+    if(size == 0)
+      return false;
+
+    _pos += size;
+    return true;
+  }
+
+  bool _strings(const std::vector<std::string>& values)
+  {
+    const std::size_t start = _pos;
+    const uint32_t count = static_cast<uint32_t>(values.size());
+    _put(&count, sizeof(count));
+
+    std::size_t table = _pos;
+    _pos += (values.size() + 1)*sizeof(uint32_t);
+
+    for(const std::string& value : values)
+    {
+      const uint32_t offset = static_cast<uint32_t>(_pos - start);
+      _put_at(table, &offset, sizeof(offset));
+      table += sizeof(offset);
+      _put(value.data(), value.size());
+    }
+
+    const uint32_t end = static_cast<uint32_t>(_pos - start);
+    _put_at(table, &end, sizeof(end));
+    return true;
+  }
+
+  bool _blocks(const std::vector<Message>& values)
+  {
+    const std::size_t start = _pos;
+    const uint32_t count = static_cast<uint32_t>(values.size());
+    _put(&count, sizeof(count));
+
+    std::size_t table = _pos;
+    _pos += values.size()*sizeof(uint32_t);
+
+    for(const Message& value : values)
+    {
+      _align();
+      const uint32_t offset = static_cast<uint32_t>(_pos - start);
+      _put_at(table, &offset, sizeof(offset));
+      table += sizeof(offset);
+
+      if(!_block(value))
+        return false;
+    }
+
+    return true;
+  }
+
+  void _put(const void* const data, const std::size_t size)
+  {
+    _put_at(_pos, data, size);
+    _pos += size;
+  }
+
+  void _put_at(
+      const std::size_t pos,
+      const void* const data,
+      const std::size_t size)
+  {
+    if(_base && size > 0)
+      std::memcpy(_base + pos, data, size);
+  }
+
+  void _align()
+  {
+    const std::size_t next = aligned(_pos);
+    if(_base && next > _pos)
+      std::memset(_base + _pos, 0, next - _pos);
+
+    _pos = next;
+  }
+
+  uint8_t* const _base;
+  std::size_t _pos = 0;
+
+};
+
+//==============================================================================
+void write_message(const soss::Message& message, uint8_t* const out)
+{
+  const Preamble preamble{magic, format_version, 0};
+  std::memcpy(out, &preamble, sizeof(preamble));
+  BlockWriter(out + sizeof(Preamble)).write(message);
+}
+
+} // anonymous namespace
+
+//==============================================================================
+std::size_t encoded_size(const soss::Message& message)
+{
+  const std::size_t block = BlockWriter(nullptr).write(message);
+  if(block == 0)
+    return 0;
+
+  return sizeof(Preamble) + block;
+}
+
+//==============================================================================
+std::size_t encode(
+    const soss::Message& message,
+    uint8_t* const out,
+    const std::size_t capacity)
+{
+  const std::size_t size = encoded_size(message);
+  if(size == 0 || size > capacity)
+    return 0;
+
+  write_message(message, out);
+  return size;
+}
+
+//==============================================================================
+bool encode(const soss::Message& message, std::vector<uint8_t>& out)
+{
+  const std::size_t size = encoded_size(message);
+  if(size == 0)
+    return false;
+
+  out.resize(size);
+  write_message(message, out.data());
+  return true;
+}
+
+//==============================================================================
+bool decode(
+    const uint8_t* const data,
+    const std::size_t size,
+    soss::Message& message,
+    const DecodeLimits& limits)
+{
+  if(reinterpret_cast<uintptr_t>(data) % alignment == 0)
+    return MessageView::parse(data, size).to_message(message, limits);
+
+  // Views need aligned data, so unaligned data gets copied first
+  std::vector<uint64_t> copy((size + sizeof(uint64_t) - 1)/sizeof(uint64_t));
+  std::memcpy(copy.data(), data, size);
+  return MessageView::parse(
+        reinterpret_cast<const uint8_t*>(copy.data()), size)
+      .to_message(message, limits);
+}
+
+//==============================================================================
+uint64_t schema(const soss::Message& message)
+{
+  Fingerprint schema;
+  schema.add(message.type);
+  for(const auto& entry : message.data)
+  {
+    const uint8_t tag = static_cast<uint8_t>(entry.second.type_tag());
+    schema.add(entry.first);
+    schema.add(&tag, sizeof(tag));
+  }
+
+  return schema.value();
+}
+
+} // namespace binary
+} // namespace soss
@@ -0,0 +1,618 @@
+/*
+ * Copyright (C) 2019 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include <soss/binary/view.hpp>
+
+#include <soss/Blob.hpp>
+
+#include <algorithm>
+#include <cstring>
+
+namespace soss {
+namespace binary {
+
+namespace {
+
+//==============================================================================
+bool is_aligned(const void* const data, const std::size_t align)
+{
+  return reinterpret_cast<uintptr_t>(data) % align == 0;
+}
+
+//==============================================================================
+/// Whether [offset, offset+length) lies inside of a block of the given size
+bool inside(
+    const uint64_t offset,
+    const uint64_t length,
+    const std::size_t size)
+{
+  return offset <= size && length <= size - offset;
+}
+
+//==============================================================================
+/// The offset where the field table of a valid block ends. The values of the
+/// block, and in particular its nested blocks, come after it.
+std::size_t table_end(const uint8_t* const block)
+{
+  const BlockHeader& header = *reinterpret_cast<const BlockHeader*>(block);
+  return sizeof(BlockHeader)
+      + std::size_t(header.field_count)*sizeof(FieldEntry);
+}
+
+//==============================================================================
+uint32_t read_u32(const uint8_t* const data)
+{
+  uint32_t value;
+  std::memcpy(&value, data, sizeof(value));
+  return value;
+}
+
+//==============================================================================
+int compare(const StringRef& a, const std::string& b)
+{
+  const int result = std::memcmp(a.data, b.data(), std::min(a.size, b.size()));
+  if(result != 0)
+    return result;
+
+  if(a.size == b.size())
+    return 0;
+
+  return a.size < b.size()? -1 : 1;
+}
+
+//==============================================================================
+template<typename T, typename Budget>
+bool array_to_field(
+    const FieldView& view,
+    soss::Field& field,
+    Budget& budget)
+{
+  const ArrayView<T> values = view.array<T>();
+  if(values.size() != view.count() || !budget.spend(values.size()))
+    return false;
+
+  field.set(std::vector<T>(values.begin(), values.end()));
+  return true;
+}
+
+//==============================================================================
+template<typename T>
+bool scalar_to_field(const FieldView& view, soss::Field& field)
+{
+  T value;
+  if(!view.get(value))
+    return false;
+
+  field.set(std::move(value));
+  return true;
+}
+
+//==============================================================================
+template<typename T>
+bool get_scalar(
+    const FieldView& view,
+    const FieldTypeTag expected,
+    const uint8_t* const data,
+    const std::size_t size,
+    T& value)
+{
+  if(view.tag() != expected || size != sizeof(T))
+    return false;
+
+  std::memcpy(&value, data, sizeof(T));
+  return true;
+}
+
+} // anonymous namespace
+
+//==============================================================================
+/// What is left of the DecodeLimits while a message is being decoded
+struct MessageView::Budget
+{
+  Budget(const DecodeLimits& limits, const std::size_t size)
+    : depth(limits.max_depth),
+      elements(limits.max_elements > 0? limits.max_elements : size)
+  {
+    // Do nothing
+  }
+
+  bool spend(const std::size_t count)
+  {
+    if(count > elements)
+      return false;
+
+    elements -= count;
+    return true;
+  }
+
+  bool enter()
+  {
+    if(depth == 0)
+      return false;
+
+    --depth;
+    return true;
+  }
+
+  void leave()
+  {
+    ++depth;
+  }
+
+  std::size_t depth;
+  std::size_t elements;
+};
+
+//==============================================================================
+MessageView MessageView::parse(const uint8_t* const data, const std::size_t size)
+{
+  if(!data || !is_aligned(data, alignment) || size < sizeof(Preamble))
+    return MessageView();
+
+  Preamble preamble;
+  std::memcpy(&preamble, data, sizeof(preamble));
+  if(preamble.magic != magic || preamble.version != format_version)
+    return MessageView();
+
+  return _block_at(data + sizeof(Preamble), size - sizeof(Preamble));
+}
+
+//==============================================================================
+MessageView MessageView::_block_at(
+    const uint8_t* const data,
+    const std::size_t size)
+{
+  if(!is_aligned(data, alignment) || size < sizeof(BlockHeader))
+    return MessageView();
+
+  const BlockHeader& header = *reinterpret_cast<const BlockHeader*>(data);
+  if(header.size > size
+     || header.size < sizeof(BlockHeader)
+     || !inside(sizeof(BlockHeader),
+                uint64_t(header.field_count)*sizeof(FieldEntry), header.size)
+     || !inside(header.type_offset, header.type_length, header.size))
+  {
+    return MessageView();
+  }
+
+  MessageView view;
+  view._block = data;
+  view._size = header.size;
+  return view;
+}
+
+//==============================================================================
+StringRef MessageView::type() const
+{
+  StringRef type;
+  if(!valid())
+    return type;
+
+  const BlockHeader& header = *reinterpret_cast<const BlockHeader*>(_block);
+  type.data = reinterpret_cast<const char*>(_block + header.type_offset);
+  type.size = header.type_length;
+  return type;
+}
+
+//==============================================================================
+uint64_t MessageView::schema() const
+{
+  return valid()? reinterpret_cast<const BlockHeader*>(_block)->schema : 0;
+}
+
+//==============================================================================
+std::size_t MessageView::size() const
+{
+  return valid()? reinterpret_cast<const BlockHeader*>(_block)->field_count : 0;
+}
+
+//==============================================================================
+FieldView MessageView::field(const std::size_t index) const
+{
+  if(index >= size())
+    return FieldView();
+
+  const FieldEntry* const entry = reinterpret_cast<const FieldEntry*>(
+        _block + sizeof(BlockHeader)) + index;
+
+  if(!inside(entry->name_offset, entry->name_length, _size)
+     || !inside(entry->value_offset, entry->value_size, _size))
+  {
+    return FieldView();
+  }
+
+  return FieldView(_block, _size, entry);
+}
+
+//==============================================================================
+FieldView MessageView::find(const std::string& name) const
+{
+  // The fields are sorted by name, the same way that soss::FieldMap sorts them
+  std::size_t low = 0;
+  std::size_t high = size();
+  while(low < high)
+  {
+    const std::size_t middle = low + (high - low)/2;
+    const FieldView candidate = field(middle);
+    if(!candidate.valid())
+      return FieldView();
+
+    const int result = compare(candidate.name(), name);
+    if(result == 0)
+      return candidate;
+
+    if(result < 0)
+      low = middle + 1;
+    else
+      high = middle;
+  }
+
+  return FieldView();
+}
+
+//==============================================================================
+bool MessageView::to_message(
+    soss::Message& message,
+    const DecodeLimits& limits) const
+{
+  Budget budget(limits, _size);
+  return _to_message(message, budget);
+}
+
+//==============================================================================
+bool MessageView::_to_message(soss::Message& message, Budget& budget) const
+{
+  if(!valid())
+    return false;
+
+  const std::size_t count = size();
+  if(!budget.spend(count))
+    return false;
+
+  message.type = type().str();
+  message.data.clear();
+  message.data.reserve(count);
+  for(std::size_t i=0; i < count; ++i)
+  {
+    const FieldView view = field(i);
+    if(!view.valid())
+      return false;
+
+    // The fields come in order, so each of them is simply appended
+    if(!view._to_field(message.data[view.name().str()], budget))
+      return false;
+  }
+
+  return true;
+}
+
+//==============================================================================
+FieldView::FieldView(
+    const uint8_t* const block,
+    const std::size_t size,
+    const FieldEntry* const entry)
+  : _block(block),
+    _size(size),
+    _entry(entry)
+{
+  // Do nothing
+}
+
+//==============================================================================
+StringRef FieldView::name() const
+{
+  StringRef name;
+  if(!valid())
+    return name;
+
+  name.data = reinterpret_cast<const char*>(_block + _entry->name_offset);
+  name.size = _entry->name_length;
+  return name;
+}
+
+//==============================================================================
+FieldTypeTag FieldView::tag() const
+{
+  if(!valid() || _entry->tag > static_cast<uint8_t>(FieldTypeTag::Blob))
+    return FieldTypeTag::Other;
+
+  return static_cast<FieldTypeTag>(_entry->tag);
+}
+
+//==============================================================================
+bool FieldView::get(bool& value) const
+{
+  if(tag() != FieldTypeTag::Bool || _entry->value_size != 1)
+    return false;
+
+  value = _block[_entry->value_offset] != 0;
+  return true;
+}
+
+//==============================================================================
+bool FieldView::get(int64_t& value) const
+{
+  return valid() && get_scalar(*this, FieldTypeTag::Int64,
+                               _block + _entry->value_offset,
+                               _entry->value_size, value);
+}
+
+//==============================================================================
+bool FieldView::get(uint64_t& value) const
+{
+  return valid() && get_scalar(*this, FieldTypeTag::UInt64,
+                               _block + _entry->value_offset,
+                               _entry->value_size, value);
+}
+
+//==============================================================================
+bool FieldView::get(double& value) const
+{
+  return valid() && get_scalar(*this, FieldTypeTag::Double,
+                               _block + _entry->value_offset,
+                               _entry->value_size, value);
+}
+
+//==============================================================================
+StringRef FieldView::string() const
+{
+  StringRef value;
+  if(tag() != FieldTypeTag::String)
+    return value;
+
+  value.data = reinterpret_cast<const char*>(_block + _entry->value_offset);
+  value.size = _entry->value_size;
+  return value;
+}
+
+//==============================================================================
+MessageView FieldView::message() const
+{
+  // A nested block must come after the field table of its parent, so that it
+  // is always smaller than its parent and can never contain it
+  if(tag() != FieldTypeTag::Message
+     || _entry->value_offset < table_end(_block)
+     || _entry->value_size >= _size)
+  {
+    return MessageView();
+  }
+
+  return MessageView::_block_at(
+        _block + _entry->value_offset, _entry->value_size);
+}
+
+//==============================================================================
+std::size_t FieldView::count() const
+{
+  const std::size_t size = valid()? _entry->value_size : 0;
+  switch(tag())
+  {
+    case FieldTypeTag::StringVector:
+    case FieldTypeTag::MessageVector:
+      return size < sizeof(uint32_t)?
+            0 : read_u32(_block + _entry->value_offset);
+    case FieldTypeTag::UInt8Vector:
+    case FieldTypeTag::Int8Vector:
+    case FieldTypeTag::Blob:
+      return size;
+    case FieldTypeTag::UInt16Vector:
+    case FieldTypeTag::Int16Vector:
+      return size/sizeof(uint16_t);
+    case FieldTypeTag::UInt32Vector:
+    case FieldTypeTag::Int32Vector:
+    case FieldTypeTag::FloatVector:
+      return size/sizeof(uint32_t);
+    case FieldTypeTag::Int64Vector:
+    case FieldTypeTag::UInt64Vector:
+    case FieldTypeTag::DoubleVector:
+      return size/sizeof(uint64_t);
+    default:
+      return 0;
+  }
+}
+
+//==============================================================================
+StringRef FieldView::string_at(const std::size_t index) const
+{
+  StringRef value;
+  if(tag() != FieldTypeTag::StringVector || index >= count())
+    return value;
+
+  const uint8_t* const data = _block + _entry->value_offset;
+  const std::size_t size = _entry->value_size;
+  const std::size_t table = sizeof(uint32_t) + index*sizeof(uint32_t);
+  if(!inside(table, 2*sizeof(uint32_t), size))
+    return value;
+
+  const uint32_t begin = read_u32(data + table);
+  const uint32_t end = read_u32(data + table + sizeof(uint32_t));
+  if(begin > end || end > size)
+    return value;
+
+  value.data = reinterpret_cast<const char*>(data + begin);
+  value.size = end - begin;
+  return value;
+}
+
+//==============================================================================
+MessageView FieldView::message_at(const std::size_t index) const
+{
+  if(tag() != FieldTypeTag::MessageVector || index >= count())
+    return MessageView();
+
+  const uint8_t* const data = _block + _entry->value_offset;
+  const std::size_t size = _entry->value_size;
+  const std::size_t table = sizeof(uint32_t) + index*sizeof(uint32_t);
+  if(!inside(table, sizeof(uint32_t), size))
+    return MessageView();
+
+  // The elements come after the offset table of the vector, and the vector
+  // comes after the field table of the block, so that every element is
+  // smaller than the block that holds it
+  const uint32_t offset = read_u32(data + table);
+  const std::size_t offsets_end = sizeof(uint32_t) + count()*sizeof(uint32_t);
+  if(offset > size
+     || offset < offsets_end
+     || _entry->value_offset < table_end(_block))
+  {
+    return MessageView();
+  }
+
+  return MessageView::_block_at(data + offset, size - offset);
+}
+
+//==============================================================================
+bool FieldView::_value(
+    const void*& data,
+    std::size_t& size,
+    const std::size_t align) const
+{
+  if(!valid())
+    return false;
+
+  data = _block + _entry->value_offset;
+  size = _entry->value_size;
+  return is_aligned(data, align);
+}
+
+//==============================================================================
+bool FieldView::to_field(
+    soss::Field& field,
+    const DecodeLimits& limits) const
+{
+  MessageView::Budget budget(limits, _size);
+  return _to_field(field, budget);
+}
+
+//==============================================================================
+bool FieldView::_to_field(
+    soss::Field& field,
+    MessageView::Budget& budget) const
+{
+  switch(tag())
+  {
+    case FieldTypeTag::String:
+    {
+      const StringRef value = string();
+      if(!budget.spend(value.size))
+        return false;
+
+      field.set(value.str());
+      return true;
+    }
+    case FieldTypeTag::Bool:
+      return scalar_to_field<bool>(*this, field);
+    case FieldTypeTag::Int64:
+      return scalar_to_field<int64_t>(*this, field);
+    case FieldTypeTag::UInt64:
+      return scalar_to_field<uint64_t>(*this, field);
+    case FieldTypeTag::Double:
+      return scalar_to_field<double>(*this, field);
+    case FieldTypeTag::Message:
+    {
+      soss::Message value;
+      if(!budget.enter())
+        return false;
+
+      const bool decoded = message()._to_message(value, budget);
+      budget.leave();
+      if(!decoded)
+        return false;
+
+      field.set(std::move(value));
+      return true;
+    }
+    case FieldTypeTag::StringVector:
+    {
+      const std::size_t elements = count();
+      if(elements > _entry->value_size || !budget.spend(elements))
+        return false;
+
+      std::vector<std::string> values;
+      values.reserve(elements);
+      for(std::size_t i=0; i < elements; ++i)
+      {
+        const StringRef value = string_at(i);
+        if(!value.data || !budget.spend(value.size))
+          return false;
+
+        values.push_back(value.str());
+      }
+
+      field.set(std::move(values));
+      return true;
+    }
+    case FieldTypeTag::Int64Vector:
+      return array_to_field<int64_t>(*this, field, budget);
+    case FieldTypeTag::UInt64Vector:
+      return array_to_field<uint64_t>(*this, field, budget);
+    case FieldTypeTag::DoubleVector:
+      return array_to_field<double>(*this, field, budget);
+    case FieldTypeTag::MessageVector:
+    {
+      const std::size_t elements = count();
+      if(elements > _entry->value_size || !budget.spend(elements)
+         || !budget.enter())
+      {
+        return false;
+      }
+
+      std::vector<soss::Message> values(elements);
+      bool decoded = true;
+      for(std::size_t i=0; i < elements && decoded; ++i)
+        decoded = message_at(i)._to_message(values[i], budget);
+
+      budget.leave();
+      if(!decoded)
+        return false;
+
+      field.set(std::move(values));
+      return true;
+    }
+    case FieldTypeTag::UInt8Vector:
+      return array_to_field<uint8_t>(*this, field, budget);
+    case FieldTypeTag::Int8Vector:
+      return array_to_field<int8_t>(*this, field, budget);
+    case FieldTypeTag::UInt16Vector:
+      return array_to_field<uint16_t>(*this, field, budget);
+    case FieldTypeTag::Int16Vector:
+      return array_to_field<int16_t>(*this, field, budget);
+    case FieldTypeTag::UInt32Vector:
+      return array_to_field<uint32_t>(*this, field, budget);
+    case FieldTypeTag::Int32Vector:
+      return array_to_field<int32_t>(*this, field, budget);
+    case FieldTypeTag::FloatVector:
+      return array_to_field<float>(*this, field, budget);
+    case FieldTypeTag::Blob:
+    {
+      // The buffer may go away after decoding, so the blob gets its own copy
+      const ArrayView<uint8_t> bytes = array<uint8_t>();
+      if(bytes.size() != _entry->value_size || !budget.spend(bytes.size()))
+        return false;
+
+      field.set(Blob(std::vector<uint8_t>(bytes.begin(), bytes.end())));
+      return true;
+    }
+    case FieldTypeTag::Other:
+      break;
+  }
+
+  return false;
+}
+
+} // namespace binary
+} // namespace soss
@@ -0,0 +1,299 @@
+/*
+ * Copyright (C) 2019 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include <catch2/catch.hpp>
+
+#include <soss/binary/conversion.hpp>
+#include <soss/binary/view.hpp>
+
+#include <soss/Blob.hpp>
+
+#include <cstring>
+
+using namespace soss::binary;
+
+namespace {
+
+//==============================================================================
+template<typename T>
+const T& value_of(const soss::Message& message, const std::string& name)
+{
+  const auto it = message.data.find(name);
+  REQUIRE(it != message.data.end());
+  const T* const value = it->second.cast<T>();
+  REQUIRE(value);
+  return *value;
+}
+
+//==============================================================================
+soss::Message point(const double x)
+{
+  soss::Message message;
+  message.type = "test/Point";
+  message.data["x"] = soss::make_field<double>(x);
+  return message;
+}
+
+//==============================================================================
+/// A message with a field of every FieldTypeTag but Other
+soss::Message every_tag()
+{
+  soss::Message message;
+  message.type = "test/Everything";
+  message.data["string"] = soss::make_field<std::string>("hello");
+  message.data["bool"] = soss::make_field<bool>(true);
+  message.data["int64"] = soss::make_field<int64_t>(-42);
+  message.data["uint64"] = soss::make_field<uint64_t>(1ull << 63);
+  message.data["double"] = soss::make_field<double>(0.1);
+  message.data["message"] = soss::make_field<soss::Message>(point(1.5));
+  message.data["strings"] = soss::make_field<std::vector<std::string>>(
+        std::vector<std::string>{"", "a", "bc"});
+  message.data["int64s"] = soss::make_field<std::vector<int64_t>>(
+        std::vector<int64_t>{-1, 0, 1});
+  message.data["uint64s"] = soss::make_field<std::vector<uint64_t>>(
+        std::vector<uint64_t>{0, 1ull << 40});
+  message.data["doubles"] = soss::make_field<std::vector<double>>(
+        std::vector<double>{-0.5, 1e300});
+  message.data["messages"] = soss::make_field<std::vector<soss::Message>>(
+        std::vector<soss::Message>{point(1.0), point(2.0), point(3.0)});
+  message.data["uint8s"] = soss::make_field<std::vector<uint8_t>>(
+        std::vector<uint8_t>{0, 255});
+  message.data["int8s"] = soss::make_field<std::vector<int8_t>>(
+        std::vector<int8_t>{-128, 127});
+  message.data["uint16s"] = soss::make_field<std::vector<uint16_t>>(
+        std::vector<uint16_t>{1, 65535});
+  message.data["int16s"] = soss::make_field<std::vector<int16_t>>(
+        std::vector<int16_t>{-32768, 3});
+  message.data["uint32s"] = soss::make_field<std::vector<uint32_t>>(
+        std::vector<uint32_t>{7, 4000000000u});
+  message.data["int32s"] = soss::make_field<std::vector<int32_t>>(
+        std::vector<int32_t>{-7, 2000000000});
+  message.data["floats"] = soss::make_field<std::vector<float>>(
+        std::vector<float>{0.25f, -1e30f});
+  message.data["blob"] = soss::make_field<soss::Blob>(
+        soss::Blob(std::vector<uint8_t>{1, 2, 3, 4, 5}));
+  message.data["empty"] = soss::make_field<std::vector<float>>();
+  return message;
+}
+
+} // anonymous namespace
+
+TEST_CASE("Every field type survives a round trip", "[binary]")
+{
+  const soss::Message original = every_tag();
+  std::vector<uint8_t> bytes;
+  REQUIRE(encode(original, bytes));
+  CHECK(bytes.size() == encoded_size(original));
+  CHECK(bytes.size() % alignment == 0);
+
+  soss::Message decoded;
+  REQUIRE(decode(bytes.data(), bytes.size(), decoded));
+  CHECK(decoded.type == original.type);
+  REQUIRE(decoded.data.size() == original.data.size());
+
+  // Every field keeps its exact type
+  for(const auto& field : original.data)
+  {
+    const auto it = decoded.data.find(field.first);
+    REQUIRE(it != decoded.data.end());
+    CHECK(it->second.type_tag() == field.second.type_tag());
+  }
+
+  CHECK(value_of<std::string>(decoded, "string") == "hello");
+  CHECK(value_of<bool>(decoded, "bool"));
+  CHECK(value_of<int64_t>(decoded, "int64") == -42);
+  CHECK(value_of<uint64_t>(decoded, "uint64") == 1ull << 63);
+  CHECK(value_of<double>(decoded, "double") == 0.1);
+  CHECK(value_of<double>(
+          value_of<soss::Message>(decoded, "message"), "x") == 1.5);
+  CHECK(value_of<std::vector<std::string>>(decoded, "strings")
+        == std::vector<std::string>({"", "a", "bc"}));
+  CHECK(value_of<std::vector<int64_t>>(decoded, "int64s")
+        == std::vector<int64_t>({-1, 0, 1}));
+  CHECK(value_of<std::vector<uint64_t>>(decoded, "uint64s")
+        == std::vector<uint64_t>({0, 1ull << 40}));
+  CHECK(value_of<std::vector<double>>(decoded, "doubles")
+        == std::vector<double>({-0.5, 1e300}));
+  CHECK(value_of<std::vector<uint8_t>>(decoded, "uint8s")
+        == std::vector<uint8_t>({0, 255}));
+  CHECK(value_of<std::vector<int8_t>>(decoded, "int8s")
+        == std::vector<int8_t>({-128, 127}));
+  CHECK(value_of<std::vector<uint16_t>>(decoded, "uint16s")
+        == std::vector<uint16_t>({1, 65535}));
+  CHECK(value_of<std::vector<int16_t>>(decoded, "int16s")
+        == std::vector<int16_t>({-32768, 3}));
+  CHECK(value_of<std::vector<uint32_t>>(decoded, "uint32s")
+        == std::vector<uint32_t>({7, 4000000000u}));
+  CHECK(value_of<std::vector<int32_t>>(decoded, "int32s")
+        == std::vector<int32_t>({-7, 2000000000}));
+  CHECK(value_of<std::vector<float>>(decoded, "floats")
+        == std::vector<float>({0.25f, -1e30f}));
+  CHECK(value_of<std::vector<float>>(decoded, "empty").empty());
+
+  const auto& messages =
+      value_of<std::vector<soss::Message>>(decoded, "messages");
+  REQUIRE(messages.size() == 3);
+  for(std::size_t i=0; i < messages.size(); ++i)
+    CHECK(value_of<double>(messages[i], "x") == double(i + 1));
+
+  const soss::Blob& blob = value_of<soss::Blob>(decoded, "blob");
+  CHECK(std::vector<uint8_t>(blob.begin(), blob.end())
+        == std::vector<uint8_t>({1, 2, 3, 4, 5}));
+}
+
+TEST_CASE("Views read fields in place", "[binary]")
+{
+  std::vector<uint8_t> bytes;
+  REQUIRE(encode(every_tag(), bytes));
+
+  const MessageView view = MessageView::parse(bytes.data(), bytes.size());
+  REQUIRE(view.valid());
+  CHECK(view.type() == "test/Everything");
+  CHECK(view.size() == every_tag().data.size());
+
+  int64_t int64 = 0;
+  CHECK(view.find("int64").get(int64));
+  CHECK(int64 == -42);
+
+  // Reading a field as the wrong type fails instead of reinterpreting it
+  double wrong = 0.0;
+  CHECK_FALSE(view.find("int64").get(wrong));
+  CHECK(view.find("string").array<float>().empty());
+
+  CHECK(view.find("string").string() == "hello");
+  CHECK(view.find("strings").count() == 3);
+  CHECK(view.find("strings").string_at(2) == "bc");
+  CHECK(view.find("floats").array<float>()[1] == -1e30f);
+  CHECK(view.find("blob").array<uint8_t>().size() == 5);
+
+  double x = 0.0;
+  CHECK(view.find("messages").message_at(1).find("x").get(x));
+  CHECK(x == 2.0);
+  CHECK(view.find("message").message().find("x").get(x));
+  CHECK(x == 1.5);
+
+  CHECK_FALSE(view.find("missing").valid());
+  CHECK_FALSE(view.field(view.size()).valid());
+}
+
+TEST_CASE("The schema fingerprint follows names and tags", "[binary]")
+{
+  std::vector<uint8_t> bytes;
+  REQUIRE(encode(every_tag(), bytes));
+  const MessageView view = MessageView::parse(bytes.data(), bytes.size());
+  CHECK(view.schema() == schema(every_tag()));
+
+  // The values do not matter
+  soss::Message other_values = every_tag();
+  other_values.data["int64"] = soss::make_field<int64_t>(7);
+  CHECK(schema(other_values) == schema(every_tag()));
+
+  // The type name, the field names and the field tags do
+  soss::Message other_type = every_tag();
+  other_type.type = "test/Other";
+  CHECK(schema(other_type) != schema(every_tag()));
+
+  soss::Message other_tag = every_tag();
+  other_tag.data["int64"] = soss::make_field<uint64_t>(7);
+  CHECK(schema(other_tag) != schema(every_tag()));
+
+  soss::Message other_name = every_tag();
+  other_name.data["int65"] = soss::make_field<int64_t>(-42);
+  other_name.data.erase(other_name.data.find("int64"));
+  CHECK(schema(other_name) != schema(every_tag()));
+}
+
+TEST_CASE("Foreign and corrupt data is rejected", "[binary]")
+{
+  std::vector<uint8_t> bytes;
+  REQUIRE(encode(every_tag(), bytes));
+  soss::Message decoded;
+
+  SECTION("Another byte order")
+  {
+    std::reverse(bytes.begin(), bytes.begin() + sizeof(uint32_t));
+    CHECK_FALSE(decode(bytes.data(), bytes.size(), decoded));
+  }
+
+  SECTION("A newer format")
+  {
+    Preamble preamble;
+    std::memcpy(&preamble, bytes.data(), sizeof(preamble));
+    ++preamble.version;
+    std::memcpy(bytes.data(), &preamble, sizeof(preamble));
+    CHECK_FALSE(decode(bytes.data(), bytes.size(), decoded));
+  }
+
+  SECTION("A block that claims to be larger than the data")
+  {
+    BlockHeader header;
+    std::memcpy(&header, bytes.data() + sizeof(Preamble), sizeof(header));
+    header.size = static_cast<uint32_t>(bytes.size());
+    std::memcpy(bytes.data() + sizeof(Preamble), &header, sizeof(header));
+    CHECK_FALSE(decode(bytes.data(), bytes.size(), decoded));
+  }
+
+  SECTION("An unknown field tag")
+  {
+    FieldEntry entry;
+    uint8_t* const table =
+        bytes.data() + sizeof(Preamble) + sizeof(BlockHeader);
+    std::memcpy(&entry, table, sizeof(entry));
+    entry.tag = 200;
+    std::memcpy(table, &entry, sizeof(entry));
+    CHECK_FALSE(decode(bytes.data(), bytes.size(), decoded));
+  }
+
+  SECTION("Truncated data")
+  {
+    for(std::size_t size = 0; size < bytes.size(); size += 3)
+      CHECK_FALSE(decode(bytes.data(), size, decoded));
+  }
+}
+
+TEST_CASE("Unaligned data gets decoded too", "[binary]")
+{
+  std::vector<uint8_t> bytes;
+  REQUIRE(encode(every_tag(), bytes));
+
+  std::vector<uint8_t> shifted(bytes.size() + 1);
+  std::memcpy(shifted.data() + 1, bytes.data(), bytes.size());
+
+  // Views need aligned data, but decode(~) copies it when it is not
+  CHECK_FALSE(MessageView::parse(shifted.data() + 1, bytes.size()).valid());
+
+  soss::Message decoded;
+  REQUIRE(decode(shifted.data() + 1, bytes.size(), decoded));
+  CHECK(value_of<std::string>(decoded, "string") == "hello");
+}
+
+TEST_CASE("Messages that cannot be encoded are refused", "[binary]")
+{
+  struct Unknown { int value; };
+
+  soss::Message message = every_tag();
+  message.data["unknown"] = soss::make_field<Unknown>(Unknown{1});
+  CHECK(encoded_size(message) == 0);
+
+  std::vector<uint8_t> bytes;
+  CHECK_FALSE(encode(message, bytes));
+
+  // Nothing gets written past the capacity
+  const soss::Message fine = every_tag();
+  std::vector<uint8_t> small(encoded_size(fine) - 1, 0xAB);
+  CHECK(encode(fine, small.data(), small.size()) == 0);
+}
@@ -0,0 +1,256 @@
+/*
+ * Copyright (C) 2019 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include <catch2/catch.hpp>
+
+#include <soss/binary/conversion.hpp>
+#include <soss/binary/view.hpp>
+
+#include <chrono>
+#include <cstring>
+#include <random>
+
+using namespace soss::binary;
+
+namespace {
+
+//==============================================================================
+/// Views need data that is aligned to 8 bytes
+struct Buffer
+{
+  Buffer(const std::vector<uint8_t>& bytes)
+    : words((bytes.size() + sizeof(uint64_t) - 1)/sizeof(uint64_t)),
+      size(bytes.size())
+  {
+    std::memcpy(words.data(), bytes.data(), bytes.size());
+  }
+
+  uint8_t* data()
+  {
+    return reinterpret_cast<uint8_t*>(words.data());
+  }
+
+  std::vector<uint64_t> words;
+  std::size_t size;
+};
+
+//==============================================================================
+FieldEntry* entry(uint8_t* const block, const std::size_t index)
+{
+  return reinterpret_cast<FieldEntry*>(block + sizeof(BlockHeader)) + index;
+}
+
+//==============================================================================
+std::vector<uint8_t> encoded(const soss::Message& message)
+{
+  std::vector<uint8_t> bytes;
+  REQUIRE(encode(message, bytes));
+  return bytes;
+}
+
+//==============================================================================
+soss::Message nested(const std::size_t depth)
+{
+  soss::Message message;
+  message.type = "test/Nested";
+  message.data["depth"] = soss::make_field<uint64_t>(depth);
+  if(depth > 0)
+    message.data["inner"] = soss::make_field<soss::Message>(nested(depth-1));
+
+  return message;
+}
+
+//==============================================================================
+/// A chain of blocks whose fields "a" and "b" both hold the next block
+soss::Message chain(const std::size_t length)
+{
+  soss::Message message;
+  message.type = "test/Chain";
+  if(length == 0)
+    return message;
+
+  soss::Message empty;
+  empty.type = "test/Chain";
+  message.data["a"] = soss::make_field<soss::Message>(chain(length-1));
+  message.data["b"] = soss::make_field<soss::Message>(empty);
+  return message;
+}
+
+//==============================================================================
+/// Point field "b" of every block of a chain at the block of field "a"
+void share_blocks(uint8_t* const block, const std::size_t length)
+{
+  if(length == 0)
+    return;
+
+  FieldEntry* const a = entry(block, 0);
+  FieldEntry* const b = entry(block, 1);
+  b->value_offset = a->value_offset;
+  b->value_size = a->value_size;
+  share_blocks(block + a->value_offset, length-1);
+}
+
+//==============================================================================
+soss::Message sample()
+{
+  soss::Message inner;
+  inner.type = "test/Inner";
+  inner.data["name"] = soss::make_field<std::string>("inner");
+
+  soss::Message message;
+  message.type = "test/Sample";
+  message.data["flag"] = soss::make_field<bool>(true);
+  message.data["count"] = soss::make_field<int64_t>(-7);
+  message.data["inner"] = soss::make_field<soss::Message>(inner);
+  message.data["names"] = soss::make_field<std::vector<std::string>>(
+        std::vector<std::string>{"a", "bc", "def"});
+  message.data["values"] = soss::make_field<std::vector<float>>(
+        std::vector<float>{1.0f, 2.5f, -3.0f});
+  message.data["inners"] = soss::make_field<std::vector<soss::Message>>(
+        std::vector<soss::Message>{inner, inner});
+  return message;
+}
+
+} // anonymous namespace
+
+TEST_CASE("A block that contains itself is rejected", "[binary]")
+{
+  soss::Message message;
+  message.type = "test/Outer";
+  message.data["inner"] = soss::make_field<soss::Message>(nested(0));
+
+  Buffer buffer(encoded(message));
+  uint8_t* const block = buffer.data() + sizeof(Preamble);
+  FieldEntry* const inner = entry(block, 0);
+
+  // Point the nested block back at its parent
+  inner->value_offset = 0;
+  inner->value_size = reinterpret_cast<BlockHeader*>(block)->size;
+
+  const MessageView view = MessageView::parse(buffer.data(), buffer.size);
+  REQUIRE(view.valid());
+  CHECK_FALSE(view.find("inner").message().valid());
+
+  soss::Message output;
+  CHECK_FALSE(decode(buffer.data(), buffer.size, output));
+}
+
+TEST_CASE("Elements of a vector that overlap its offsets are rejected",
+          "[binary]")
+{
+  soss::Message message;
+  message.type = "test/Outer";
+  message.data["inners"] = soss::make_field<std::vector<soss::Message>>(
+        std::vector<soss::Message>{nested(0)});
+
+  Buffer buffer(encoded(message));
+  uint8_t* const block = buffer.data() + sizeof(Preamble);
+  uint8_t* const value = block + entry(block, 0)->value_offset;
+
+  // Point the first element at the count of the vector
+  const uint32_t offset = 0;
+  std::memcpy(value + sizeof(uint32_t), &offset, sizeof(offset));
+
+  const MessageView view = MessageView::parse(buffer.data(), buffer.size);
+  CHECK_FALSE(view.find("inners").message_at(0).valid());
+
+  soss::Message output;
+  CHECK_FALSE(decode(buffer.data(), buffer.size, output));
+}
+
+TEST_CASE("Shared nested blocks are decoded within the budget", "[binary]")
+{
+  const std::size_t length = 40;
+  Buffer buffer(encoded(chain(length)));
+  soss::Message output;
+  CHECK(decode(buffer.data(), buffer.size, output));
+
+  // Without a budget, decoding this would visit 2^40 blocks
+  share_blocks(buffer.data() + sizeof(Preamble), length);
+  const auto start = std::chrono::steady_clock::now();
+  CHECK_FALSE(decode(buffer.data(), buffer.size, output));
+  CHECK(std::chrono::steady_clock::now() - start < std::chrono::seconds(5));
+
+  DecodeLimits limits;
+  limits.max_elements = 1000;
+  CHECK_FALSE(decode(buffer.data(), buffer.size, output, limits));
+}
+
+TEST_CASE("Messages that nest too deep are rejected", "[binary]")
+{
+  const std::vector<uint8_t> shallow = encoded(nested(10));
+  const std::vector<uint8_t> deep = encoded(nested(100));
+
+  soss::Message output;
+  CHECK(decode(shallow.data(), shallow.size(), output));
+  CHECK_FALSE(decode(deep.data(), deep.size(), output));
+
+  DecodeLimits limits;
+  limits.max_depth = 100;
+  REQUIRE(decode(deep.data(), deep.size(), output, limits));
+  CHECK(encoded(output) == deep);
+
+  limits.max_depth = 9;
+  CHECK_FALSE(decode(shallow.data(), shallow.size(), output, limits));
+}
+
+TEST_CASE("Damaged messages never get read out of bounds", "[binary]")
+{
+  const std::vector<uint8_t> original = encoded(sample());
+  soss::Message output;
+  REQUIRE(decode(original.data(), original.size(), output));
+  CHECK(encoded(output) == original);
+
+  // Every truncation is rejected
+  for(std::size_t size = 0; size < original.size(); ++size)
+  {
+    Buffer buffer(original);
+    CHECK_FALSE(decode(buffer.data(), size, output));
+  }
+
+  // Random damage may or may not be detected, but it must not crash or hang.
+  // Run this under a sanitizer to catch reads out of bounds.
+  std::mt19937 random(5489u);
+  std::uniform_int_distribution<std::size_t> position(0, original.size()-1);
+  std::uniform_int_distribution<int> byte(0, 255);
+  std::uniform_int_distribution<int> damage(1, 8);
+  for(std::size_t round = 0; round < 20000; ++round)
+  {
+    std::vector<uint8_t> bytes = original;
+    const int changes = damage(random);
+    for(int i=0; i < changes; ++i)
+      bytes[position(random)] = static_cast<uint8_t>(byte(random));
+
+    Buffer buffer(bytes);
+    decode(buffer.data(), buffer.size, output);
+
+    const MessageView view = MessageView::parse(buffer.data(), buffer.size);
+    for(std::size_t i=0; i < view.size(); ++i)
+    {
+      const FieldView field = view.field(i);
+      field.name();
+      field.string();
+      field.array<float>();
+      field.message().type();
+      for(std::size_t j=0; j < std::min<std::size_t>(field.count(), 4); ++j)
+      {
+        field.string_at(j);
+        field.message_at(j).find("name").string();
+      }
+    }
+  }
+}
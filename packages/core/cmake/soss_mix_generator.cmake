@@ -474,6 +474,23 @@ function(_soss_configure_mix_package)
     )
   endforeach()
 
+  # One .mix for the whole package, so that middlewares which need several of
+  # its types only have to read one file and open the library once. The
+  # per-type files above are kept for middlewares that look types up one by
+  # one.
+  set(plugin_library_directory ../../..)
+  set(_package_plugin_library_gen_template "${CMAKE_BINARY_DIR}/soss/${_ARG_IDL_TYPE}/${middleware}/${package}.pkg.mix.gen")
+  configure_file(
+    ${SOSS_TEMPLATE_DIR}/plugin_library.mix.in
+    ${_package_plugin_library_gen_template}
+    @ONLY
+  )
+
+  file(GENERATE
+    OUTPUT ${mix_build_dir}/${middleware}/pkg/${package}.mix
+    INPUT ${_package_plugin_library_gen_template}
+  )
+
   install(
     DIRECTORY ${mix_build_dir}
     DESTINATION ${CMAKE_INSTALL_LIBDIR}
@@ -0,0 +1,129 @@
+/*
+ * Copyright (C) 2019 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#ifndef SOSS__BLOB_HPP
+#define SOSS__BLOB_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+namespace soss {
+
+//==============================================================================
+/// Blob is an immutable block of bytes that is shared by every copy of it. It
+/// is meant for large opaque payloads, like the data of an image or a
+/// compressed point cloud, which would otherwise be deep-copied each time the
+/// soss::Message or Field that holds them gets copied.
+///
+/// A Blob may either own its bytes or point into a buffer that belongs to some
+/// other object, e.g. the native message of a middleware. In that case it
+/// shares ownership of that object, so the bytes stay valid for as long as any
+/// copy of the Blob exists. Either way, the bytes must never be modified once
+/// they have been given to a Blob.
+///
+/// Blobs are opt-in. Middlewares only produce them for the fields that they
+/// map through soss::BlobConvert, and they convert byte arrays into
+/// std::vector<uint8_t> fields otherwise.
+class Blob
+{
+public:
+
+  using value_type = uint8_t;
+  using size_type = std::size_t;
+  using const_iterator = const uint8_t*;
+
+  /// \brief Construct an empty blob
+  Blob()
+    : _data(nullptr),
+      _size(0)
+  {
+    // Do nothing
+  }
+
+  /// \brief Take ownership of the bytes of a vector without copying them
+  explicit Blob(std::vector<uint8_t>&& bytes)
+  {
+    const auto owner =
+        std::make_shared<const std::vector<uint8_t>>(std::move(bytes));
+    _data = owner->data();
+    _size = owner->size();
+    _owner = owner;
+  }
+
+  /// \brief Copy the given bytes into a new blob
+  Blob(const uint8_t* const data, const std::size_t size)
+    : Blob(std::vector<uint8_t>(data, data + size))
+  {
+    // Do nothing
+  }
+
+  /// \brief Refer to bytes that belong to another object without copying them.
+  /// The blob shares ownership of the owner, so the bytes must remain valid
+  /// and unchanged for as long as the owner is alive.
+  Blob(
+      std::shared_ptr<const void> owner,
+      const uint8_t* const data,
+      const std::size_t size)
+    : _owner(std::move(owner)),
+      _data(data),
+      _size(size)
+  {
+    // Do nothing
+  }
+
+  const uint8_t* data() const { return _data; }
+  std::size_t size() const { return _size; }
+  bool empty() const { return _size == 0; }
+
+  const_iterator begin() const { return _data; }
+  const_iterator end() const { return _data + _size; }
+
+  uint8_t operator[](const std::size_t index) const { return _data[index]; }
+
+  /// \brief Copy the bytes of this blob into a vector
+  std::vector<uint8_t> to_vector() const
+  {
+    return std::vector<uint8_t>(begin(), end());
+  }
+
+  /// \brief True if both blobs contain the same bytes
+  bool operator==(const Blob& other) const
+  {
+    return _size == other._size
+        && (_data == other._data || _size == 0
+            || std::memcmp(_data, other._data, _size) == 0);
+  }
+
+  bool operator!=(const Blob& other) const
+  {
+    return !(*this == other);
+  }
+
+private:
+
+  std::shared_ptr<const void> _owner;
+  const uint8_t* _data;
+  std::size_t _size;
+
+};
+
+} // namespace soss
+
+#endif // SOSS__BLOB_HPP
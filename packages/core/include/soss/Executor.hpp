@@ -0,0 +1,99 @@
+/*
+ * Copyright (C) 2019 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+
+#ifndef SOSS__EXECUTOR_HPP
+#define SOSS__EXECUTOR_HPP
+
+#include <soss/ThreadSettings.hpp>
+
+#include <soss/core/export.hpp>
+
+#include <chrono>
+#include <functional>
+#include <memory>
+
+namespace soss {
+
+//==============================================================================
+/// Executor runs tasks on a fixed set of worker threads. Each worker has a
+/// queue of its own, and workers that run out of tasks steal from the queues
+/// of the others, so a task that gets posted from a worker usually stays on
+/// that worker while an idle worker can still pick it up.
+///
+/// A soss instance whose config-file has an [executor] entry spins its systems
+/// and drains its topic queues on the executor of the process instead of on
+/// threads of its own. Middlewares can opt in the same way by posting their
+/// work to Executor::shared() when it is not null.
+///
+/// Tasks should not block for long, since a blocked task holds on to one of
+/// the workers of every instance in the process.
+class SOSS_CORE_API Executor
+{
+public:
+
+  using Task = std::function<void()>;
+
+  /// \brief Start an executor.
+  ///
+  /// \param[in] threads
+  ///   The number of workers. Zero picks one worker per CPU.
+  ///
+  /// \param[in] settings
+  ///   The ThreadSettings of the workers. Workers that are not named by the
+  ///   settings are called soss-exec-<n>.
+  Executor(std::size_t threads = 0, const ThreadSettings& settings = {});
+
+  /// \brief Run a task on one of the workers as soon as one is free.
+  void post(Task task);
+
+  /// \brief Run a task on one of the workers once the delay has passed. The
+  /// delay is measured by a timer that may run up to 10ms late.
+  void post_after(std::chrono::milliseconds delay, Task task);
+
+  /// \brief The number of workers
+  std::size_t size() const;
+
+  /// \brief True if the calling thread is one of the workers of this executor
+  bool on_worker() const;
+
+  /// \brief Get the executor that the soss instances of this process share,
+  /// or start it if none is running yet. The arguments only matter to the
+  /// call that starts it. The executor stops once every shared pointer to it
+  /// has been released.
+  static std::shared_ptr<Executor> shared(
+      std::size_t threads, const ThreadSettings& settings = {});
+
+  /// \brief Get the executor that the soss instances of this process share,
+  /// or a nullptr if none of them have opted in to one.
+  static std::shared_ptr<Executor> shared();
+
+  Executor(const Executor&) = delete;
+  Executor& operator=(const Executor&) = delete;
+
+  /// \brief Stop the workers. Tasks that have not started by then are
+  /// discarded.
+  ~Executor();
+
+  class Implementation;
+private:
+  std::shared_ptr<Implementation> _pimpl;
+};
+
+} // namespace soss
+
+#endif // SOSS__EXECUTOR_HPP
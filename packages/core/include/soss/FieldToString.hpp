@@ -35,6 +35,14 @@ public:
   /// Convert a field to a string.
   std::string to_string(const soss::Message::const_iterator& field_it) const;
 
+  /// Append the string of a field to a buffer that the caller provides. This
+  /// gives the same text as to_string(~), but nothing gets allocated once the
+  /// buffer has grown large enough, so the buffer can be reused for every
+  /// message.
+  void append(
+      const soss::Message::const_iterator& field_it,
+      std::string& output) const;
+
   /// If an unknown conversion is requested, this string will get passed along
   /// to the UnknownFieldToStringCast exception that gets thrown.
   ///
@@ -65,6 +65,24 @@ public:
   /// with wait_for() or wait().
   InstanceHandle& quit();
 
+  /// \brief Change the topics and services of the running instance to match a
+  /// new configuration, without restarting it.
+  ///
+  /// Only the topics and services that have been added, removed or changed get
+  /// touched, while the rest keep running and the middlewares stay connected
+  /// the whole time. The [systems] must stay the same, because changing them
+  /// requires a restart. The middlewares get asked for any new subscriptions,
+  /// publishers and service proxies from the thread that calls this.
+  ///
+  /// \returns true if the whole new configuration is in place. Topics and
+  /// services that could not be configured are left out until the next
+  /// reconfiguration.
+  bool reconfigure(const YAML::Node& config_node);
+
+  /// \brief Reconfigure the running instance from a config-file. See
+  /// reconfigure(const YAML::Node&).
+  bool reconfigure(const std::string& config_file_path);
+
   /// \brief The destructor will call quit() and then wait(), because the soss
   /// instance cannot run without the handle active.
   ~InstanceHandle();
@@ -20,13 +20,95 @@
 
 
 #include <soss/core/export.hpp>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
 #include <functional>
 #include <map>
 #include <memory>
+#include <stdexcept>
 #include <string>
+#include <tuple>
+#include <typeinfo>
+#include <utility>
+#include <vector>
 
 namespace soss {
 
+class Message;
+
+//==============================================================================
+/// A small integer tag for each of the field types that middlewares commonly
+/// exchange through soss. Code that needs to handle each of these types can
+/// switch on Field::type_tag() instead of comparing the names of types. Every
+/// other type gets the tag Other.
+enum class FieldTypeTag : uint8_t
+{
+  Other = 0,
+  String,
+  Bool,
+  Int64,
+  UInt64,
+  Double,
+  Message,
+  StringVector,
+  Int64Vector,
+  UInt64Vector,
+  DoubleVector,
+  MessageVector,
+
+  // Arrays of primitives that are narrower than 64 bits
+  UInt8Vector,
+  Int8Vector,
+  UInt16Vector,
+  Int16Vector,
+  UInt32Vector,
+  Int32Vector,
+  FloatVector,
+
+  // An immutable block of bytes that is shared between copies, see soss::Blob
+  Blob
+};
+
+namespace detail {
+
+//==============================================================================
+/// Values whose type fits into this many bytes are stored inside of the Field
+/// itself instead of on the heap. This is large enough for any primitive type,
+/// std::vector, and (on common standard libraries) std::string.
+constexpr std::size_t FieldInlineCapacity = sizeof(std::string);
+constexpr std::size_t FieldInlineAlignment = alignof(std::max_align_t);
+
+//==============================================================================
+/// The type-erased operations of a Field. Each type that gets stored in a Field
+/// has exactly one static instance of this table, see Message-impl.hpp.
+struct FieldVTable
+{
+  /// The type that is being stored
+  const std::type_info* type;
+
+  /// The tag of the type that is being stored
+  FieldTypeTag tag;
+
+  /// True if the value is stored inside of the Field's buffer
+  bool is_inline;
+
+  /// True if the value is stored inline and can be copied with memcpy
+  bool is_trivial;
+
+  /// Copy-construct the value pointed to by `from` into the storage `to`
+  void (*copy)(const void* from, void* to);
+
+  /// Move the value out of the storage `from` into the storage `to`. The
+  /// storage `from` will no longer hold a value afterwards.
+  void (*move)(void* from, void* to);
+
+  /// Destroy the value held by the storage
+  void (*destroy)(void* storage);
+};
+
+} // namespace detail
+
 //==============================================================================
 class SOSS_CORE_API Field
 {
@@ -35,9 +117,9 @@ public:
   /// \brief Construct an empty field
   Field();
   Field(const Field& other);
-  Field(Field&& other);
+  Field(Field&& other) noexcept;
   Field& operator=(const Field& other);
-  Field& operator=(Field&& other);
+  Field& operator=(Field&& other) noexcept;
 
   /// \brief Set this field to type T. Any previous data in this field will be
   /// lost.
@@ -59,24 +141,48 @@ public:
   /// \brief Get the type of this field
   std::string type() const;
 
+  /// \brief Get the tag of the type of this field. This is much cheaper than
+  /// type(), so it should be preferred for dispatching on the field type.
+  /// Empty fields have the tag FieldTypeTag::Other.
+  FieldTypeTag type_tag() const
+  {
+    return _vtable? _vtable->tag : FieldTypeTag::Other;
+  }
+
+  /// \brief Check whether this field holds the same value as another field.
+  /// Only the values of the tagged field types can be compared, so this is
+  /// always false when either field has the tag FieldTypeTag::Other.
+  bool equals(const Field& other) const;
+
   /// \brief Destructor
   ~Field();
 
 private:
 
-  /// \brief Implementation of Field::set() function
-  void _set(const std::type_info& type, void* data,
-            std::function<void*(const void*)> &&copier,
-            std::function<void(void*)>&& deleter);
-
   /// \brief Implementation of Field::cast() function
   void* _cast(const std::type_info& type);
 
   /// \brief Implementation of Field::cast() const function.
   const void* _cast(const std::type_info& type) const;
 
-  class Implementation;
-  std::unique_ptr<Implementation> _pimpl;
+  /// \brief Get a pointer to the value that is held by this field
+  void* _data();
+
+  /// \brief Destroy the value of this field, leaving it empty
+  void _reset();
+
+  /// \brief Copy the value of another field into this empty field
+  void _copy_from(const Field& other);
+
+  /// \brief Move the value of another field into this empty field
+  void _move_from(Field& other) noexcept;
+
+  /// \brief Either holds the value itself or a pointer to it on the heap
+  alignas(detail::FieldInlineAlignment)
+  unsigned char _storage[detail::FieldInlineCapacity];
+
+  /// \brief Operations for the type of the value, or nullptr if empty
+  const detail::FieldVTable* _vtable;
 };
 
 //==============================================================================
@@ -91,6 +197,150 @@ Field make_field(Args&&... data)
   return field;
 }
 
+//==============================================================================
+/// FieldMap stores the fields of a message contiguously, sorted by field name.
+/// It provides the subset of the std::map interface that soss uses, so fields
+/// can still be looked up by name and iterated over in alphabetical order, but
+/// a whole message only needs one allocation for its fields instead of one
+/// tree node per field.
+///
+/// Messages are normally filled in alphabetical order (by the generated
+/// converters and by soss::json), in which case every insertion is simply an
+/// append. Note that, unlike std::map, inserting a field invalidates the
+/// iterators and references to other fields of the same message.
+class FieldMap
+{
+public:
+
+  using key_type = std::string;
+  using mapped_type = Field;
+  using value_type = std::pair<std::string, Field>;
+  using Storage = std::vector<value_type>;
+  using size_type = Storage::size_type;
+  using iterator = Storage::iterator;
+  using const_iterator = Storage::const_iterator;
+
+  iterator begin() { return _fields.begin(); }
+  const_iterator begin() const { return _fields.begin(); }
+  const_iterator cbegin() const { return _fields.cbegin(); }
+
+  iterator end() { return _fields.end(); }
+  const_iterator end() const { return _fields.end(); }
+  const_iterator cend() const { return _fields.cend(); }
+
+  bool empty() const { return _fields.empty(); }
+  size_type size() const { return _fields.size(); }
+  void clear() { _fields.clear(); }
+
+  /// \brief Allocate room for the given number of fields ahead of time. Types
+  /// that know their schema should call this before adding their fields.
+  void reserve(const size_type count) { _fields.reserve(count); }
+
+  iterator find(const std::string& key)
+  {
+    const iterator it = _lower_bound(key);
+    return (it != end() && it->first == key)? it : end();
+  }
+
+  const_iterator find(const std::string& key) const
+  {
+    return const_cast<FieldMap&>(*this).find(key);
+  }
+
+  size_type count(const std::string& key) const
+  {
+    return find(key) == end()? 0 : 1;
+  }
+
+  Field& at(const std::string& key)
+  {
+    const iterator it = find(key);
+    if(it == end())
+      throw std::out_of_range("soss::FieldMap has no field named " + key);
+
+    return it->second;
+  }
+
+  const Field& at(const std::string& key) const
+  {
+    return const_cast<FieldMap&>(*this).at(key);
+  }
+
+  Field& operator[](const std::string& key)
+  {
+    return emplace(key).first->second;
+  }
+
+  template<typename... Args>
+  std::pair<iterator, bool> emplace(const std::string& key, Args&&... args)
+  {
+    const iterator it = _lower_bound(key);
+    if(it != end() && it->first == key)
+      return std::make_pair(it, false);
+
+    return std::make_pair(
+          _fields.emplace(
+            it, std::piecewise_construct, std::forward_as_tuple(key),
+            std::forward_as_tuple(std::forward<Args>(args)...)),
+          true);
+  }
+
+  std::pair<iterator, bool> insert(value_type value)
+  {
+    return emplace(value.first, std::move(value.second));
+  }
+
+  iterator erase(const_iterator position)
+  {
+    return _fields.erase(position);
+  }
+
+  size_type erase(const std::string& key)
+  {
+    const iterator it = find(key);
+    if(it == end())
+      return 0;
+
+    _fields.erase(it);
+    return 1;
+  }
+
+private:
+
+  iterator _lower_bound(const std::string& key)
+  {
+    // Fast path for the common case of fields being added in order
+    if(_fields.empty() || _fields.back().first < key)
+      return _fields.end();
+
+    return std::lower_bound(
+          _fields.begin(), _fields.end(), key,
+          [](const value_type& field, const std::string& k)
+    {
+      return field.first < k;
+    });
+  }
+
+  Storage _fields;
+};
+
+//==============================================================================
+/// NativeMessage is the base class for the native representation of a message
+/// that a middleware may attach to the soss::Message it produces. Sinks that
+/// know how to serialize a particular kind of NativeMessage straight into their
+/// wire format can dynamic_cast to it and skip the fields of the soss::Message
+/// entirely, e.g. soss::json::NativeJson.
+///
+/// A NativeMessage is shared between every copy of the soss::Message that it is
+/// attached to, so it must never be modified after it has been attached.
+class SOSS_CORE_API NativeMessage
+{
+public:
+
+  virtual ~NativeMessage();
+
+};
+
 //==============================================================================
 class Message
 {
@@ -105,7 +355,7 @@ public:
   /// The string that uniquely defines this message type
   std::string type;
 
-  using FieldMap = std::map<std::string, Field>;
+  using FieldMap = soss::FieldMap;
   using iterator = FieldMap::iterator;
   using const_iterator = FieldMap::const_iterator;
 
@@ -114,8 +364,22 @@ public:
   /// functions for converting to/from this type.
   FieldMap data;
 
+  /// The native message that this was converted from, if the middleware that
+  /// produced this message chose to attach it. When this is set, data may be
+  /// left empty by middlewares that were configured to skip the conversion,
+  /// see NativeMessage.
+  std::shared_ptr<const NativeMessage> native;
+
 };
 
+//==============================================================================
+/// \brief Estimate how many bytes of memory a message holds, including the
+/// storage of its fields and of every nested message. This is meant for
+/// accounting the memory that soss holds on to, so it only needs to be close,
+/// not exact. A soss::Blob is counted in full even though it may be shared
+/// with other messages, and the native message is not counted at all.
+SOSS_CORE_API std::size_t memory_footprint(const Message& message);
+
 } // namespace soss
 
 #include <soss/detail/Message-impl.hpp>
@@ -0,0 +1,102 @@
+/*
+ * Copyright (C) 2019 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#ifndef SOSS__MESSAGEENVELOPE_HPP
+#define SOSS__MESSAGEENVELOPE_HPP
+
+#include <soss/Message.hpp>
+
+#include <functional>
+#include <memory>
+#include <string>
+
+namespace soss {
+
+//==============================================================================
+/// MessageEnvelope carries one immutable message through every publisher of a
+/// topic route. Publishers that share a wire format can cache the result of
+/// encoding the message on the envelope, so a message that fans out to N sinks
+/// only gets encoded once per distinct format instead of once per sink.
+///
+/// An envelope that was constructed from a `const Message&` only borrows that
+/// message, so it must not be used after the TopicPublisher::publish(~) call
+/// that received it has returned. A publisher that needs the message for
+/// longer should call retain(), which shares a single copy between every
+/// publisher that asks for one. Cached encodings are reference-counted and may
+/// be kept for as long as needed.
+class SOSS_CORE_API MessageEnvelope
+{
+public:
+
+  /// Signature of a function that encodes a message into some wire format
+  using Encoder = std::function<std::shared_ptr<const void>(const Message&)>;
+
+  /// \brief Borrow a message without copying it
+  explicit MessageEnvelope(const Message& message);
+
+  /// \brief Share ownership of a message
+  explicit MessageEnvelope(std::shared_ptr<const Message> message);
+
+  /// \brief Get the message inside of this envelope
+  const Message& message() const;
+
+  /// \brief Get a reference-counted handle to the message that remains valid
+  /// after the envelope is gone. A borrowed message is copied the first time
+  /// this is called and that copy is shared with any later callers.
+  std::shared_ptr<const Message> retain() const;
+
+  /// \brief Get the encoding of this message for the wire format named by
+  /// format. The encoder is only called if no other publisher has already
+  /// encoded this message into that format.
+  ///
+  /// \param[in] format
+  ///   A name that uniquely identifies the wire format, e.g.
+  ///   "websocket/rosbridge_v2.0". Every encoder that is given for the same
+  ///   format name must produce the same type T.
+  template<typename T>
+  std::shared_ptr<const T> encoding(
+      const std::string& format,
+      const std::function<std::shared_ptr<const T>(const Message&)>& encoder)
+      const
+  {
+    return std::static_pointer_cast<const T>(
+          _encoding(format, [&](const Message& message)
+    {
+      return std::shared_ptr<const void>(encoder(message));
+    }));
+  }
+
+  // MessageEnvelopes are shared by reference, so they should not be copied
+  MessageEnvelope(const MessageEnvelope&) = delete;
+  MessageEnvelope& operator=(const MessageEnvelope&) = delete;
+
+  ~MessageEnvelope();
+
+private:
+
+  /// \brief Implementation of MessageEnvelope::encoding()
+  std::shared_ptr<const void> _encoding(
+      const std::string& format,
+      const Encoder& encoder) const;
+
+  class Implementation;
+  std::unique_ptr<Implementation> _pimpl;
+};
+
+} // namespace soss
+
+#endif // SOSS__MESSAGEENVELOPE_HPP
@@ -0,0 +1,234 @@
+/*
+ * Copyright (C) 2019 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#ifndef SOSS__METRICS_HPP
+#define SOSS__METRICS_HPP
+
+#include <soss/core/export.hpp>
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace soss {
+
+//==============================================================================
+/// ChannelMetrics accumulates the measurements of a single topic, service or
+/// connection.
+/// Every function of this class is thread-safe and lock-free, so it can be
+/// called from the hot path of any middleware.
+class SOSS_CORE_API ChannelMetrics
+{
+public:
+
+  /// \brief Count a message (or service request) that passed through the
+  /// channel.
+  void count_message();
+
+  /// \brief Count the number of bytes that a middleware sent or received on
+  /// the wire for this channel.
+  void count_bytes(std::size_t bytes);
+
+  /// \brief Count a message that was discarded instead of being delivered.
+  void count_drop();
+
+  /// \brief Set the number of messages that are currently waiting in the
+  /// queue of this channel.
+  void set_queue_depth(std::size_t depth);
+
+  /// \brief Set the number of bytes that are currently waiting to be written
+  /// to the wire for this channel. These bytes also count towards the memory
+  /// of the channel and of the process.
+  void set_buffered_bytes(std::size_t bytes);
+
+  /// \brief Account for memory that soss is holding on to on behalf of this
+  /// channel, e.g. the messages that are waiting in its queue.
+  ///
+  /// \returns false, without accounting anything, if the bytes would take the
+  /// process over its Metrics::memory_budget(). The caller should then drop
+  /// or hold back whatever it wanted to keep.
+  bool reserve_memory(std::size_t bytes);
+
+  /// \brief Return memory that was accounted by reserve_memory().
+  void release_memory(std::size_t bytes);
+
+  /// \brief Record how long it took to deliver a message to every publisher
+  /// of a topic, or how long it took for a service request to be answered.
+  void record_latency(std::chrono::nanoseconds duration);
+
+  /// \brief Record how long a middleware spent converting a message between
+  /// its own representation and a soss::Message.
+  void record_conversion(std::chrono::nanoseconds duration);
+
+  ChannelMetrics(const ChannelMetrics&) = delete;
+  ChannelMetrics& operator=(const ChannelMetrics&) = delete;
+
+  ~ChannelMetrics();
+
+  class Implementation;
+private:
+
+  ChannelMetrics();
+  friend class Metrics;
+
+  std::unique_ptr<Implementation> _pimpl;
+};
+
+//==============================================================================
+/// Metrics is the process-wide registry of ChannelMetrics. A channel is
+/// created the first time it is requested, and lives for the rest of the
+/// process, so the references that are returned may be cached freely.
+///
+/// Looking up a channel requires a lock, so middlewares should look up their
+/// channels while they are being configured, rather than once per message.
+class SOSS_CORE_API Metrics
+{
+public:
+
+  /// \brief Get the metrics of the topic with the given name.
+  static ChannelMetrics& topic(const std::string& name);
+
+  /// \brief Get the metrics of the service with the given name.
+  static ChannelMetrics& service(const std::string& name);
+
+  /// \brief Get the metrics of a connection that a middleware holds to one of
+  /// its remote peers.
+  ///
+  /// Connections come and go, so unlike topics and services, the metrics of a
+  /// connection are only kept until release_connection() gets called for it.
+  static ChannelMetrics& connection(const std::string& name);
+
+  /// \brief Remove the metrics of a connection that has closed. Any reference
+  /// that was returned by connection() for this name becomes invalid.
+  static void release_connection(const std::string& name);
+
+  /// \brief Get the metrics of the route that a topic takes into one of the
+  /// systems it gets published to. Only the latency of these gets rendered,
+  /// which runs from the Ingress of each message until the publisher of that
+  /// system is done with it.
+  static ChannelMetrics& route(
+      const std::string& topic,
+      const std::string& destination);
+
+  /// \brief Record how long one phase of the startup took for the given
+  /// component, e.g. loading the extension of a middleware, or configuring a
+  /// system. Recording the same phase and component again replaces the old
+  /// value.
+  static void record_startup(
+      const std::string& phase,
+      const std::string& component,
+      std::chrono::nanoseconds duration);
+
+  /// \brief Record the state of a worker thread of soss, as seen by the
+  /// watchdog: the CPU time that its work has taken, how long it has been
+  /// stuck on its current piece of work (zero unless it counts as stalled),
+  /// and how many times it has stalled. Recording the same thread again
+  /// replaces the old values.
+  static void record_thread(
+      const std::string& thread,
+      std::chrono::nanoseconds cpu_time,
+      std::chrono::nanoseconds stalled,
+      std::size_t stalls);
+
+  /// \brief Remove the metrics of a thread that has finished.
+  static void release_thread(const std::string& thread);
+
+  /// \brief Limit the memory that may be accounted through
+  /// ChannelMetrics::reserve_memory() and ChannelMetrics::set_buffered_bytes()
+  /// across the whole process. A budget of zero means there is no limit.
+  static void set_memory_budget(std::size_t bytes);
+
+  static std::size_t memory_budget();
+
+  /// \brief The bytes of memory that are accounted to every channel together
+  static std::size_t memory_bytes();
+
+  /// \brief Check whether the process has used up its memory budget. Channels
+  /// that cannot refuse their memory, like the send buffers of a connection,
+  /// should shed their load while this is true.
+  static bool over_memory_budget();
+
+  /// \brief Render every metric in the Prometheus text exposition format.
+  static std::string to_prometheus();
+
+  /// \brief Atomically replace the contents of the given file with
+  /// to_prometheus(). This is compatible with the textfile collector of the
+  /// Prometheus node exporter.
+  ///
+  /// \returns false if the file could not be written.
+  static bool write_prometheus(const std::string& filename);
+
+};
+
+//==============================================================================
+/// Ingress marks the moment when a middleware took a message off of its wire,
+/// so that the metrics can include the time spent converting the message, and
+/// not only the time spent routing it. The mark is kept on the thread and not
+/// in the message, so the contents of messages never change.
+///
+/// A middleware opens a Scope right before it starts to decode or convert an
+/// incoming message, and keeps it open while it hands the message to its
+/// SubscriptionCallback:
+///
+/// \code
+/// const soss::Ingress::Scope ingress;
+/// convert_to_soss(native, message);
+/// callback(message);
+/// \endcode
+///
+/// Until some route asks for these measurements, opening a Scope costs a single
+/// atomic load.
+class SOSS_CORE_API Ingress
+{
+public:
+
+  using Clock = std::chrono::steady_clock;
+
+  /// Marks the time it was opened as the ingress of every message that this
+  /// thread hands to soss while it stays open
+  class SOSS_CORE_API Scope
+  {
+  public:
+
+    Scope();
+
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+
+    ~Scope();
+
+  private:
+
+    bool _active;
+  };
+
+  /// \brief The ingress of the message that this thread is handing to soss,
+  /// or the current time if its middleware did not open a Scope.
+  static Clock::time_point time();
+
+  /// \brief Turn the marking of ingress times on or off for the process. This
+  /// is turned on when an instance of soss exports its metrics.
+  static void set_enabled(bool enabled);
+
+  static bool enabled();
+
+};
+
+} // namespace soss
+
+#endif // SOSS__METRICS_HPP
@@ -22,6 +22,8 @@
 #include <soss/core/export.hpp>
 
 #include <memory>
+#include <string>
+#include <vector>
 
 namespace soss {
 
@@ -48,6 +50,14 @@ public:
 
   bool load() const;
 
+  /// \brief Read and load each of the given .mix files. The work is spread
+  /// across a few threads, since middlewares often need one extension for
+  /// every message type that they use. Every file is attempted, even if some
+  /// of the others fail.
+  ///
+  /// \returns false if any of the files could not be read or loaded.
+  static bool load_files(const std::vector<std::string>& filenames);
+
   ~MiddlewareInterfaceExtension();
 
 private:
@@ -144,6 +144,27 @@ public:
       const std::string& srv_type,
       std::vector<std::string>* checked_paths = nullptr) const;
 
+  /// \brief Find the mix file that provides information for every message and
+  /// service type of a package, e.g. package_name for package_name/Type.
+  ///
+  /// Extension generators like soss_rosidl_mix install one of these for each
+  /// package, at <package>.mix in a pkg subdirectory, next to the mix files of
+  /// the individual types.
+  ///
+  /// \param[in] type
+  ///   A message or service type. Everything up to its first slash will be
+  ///   used for <type> in the search scheme.
+  ///
+  /// \param[out] checked_paths
+  ///   If given a non-nullptr, this will be filled with a list of paths that
+  ///   were searched. This may be useful for debugging purposes.
+  ///
+  /// \returns the full path to the .mix file if found. If not found, or if the
+  /// type does not name a package, this will be an empty string.
+  std::string find_package_mix(
+      const std::string& type,
+      std::vector<std::string>* checked_paths = nullptr) const;
+
   /// \brief Find a mix file that provides some kind of information besides a
   /// message or a service.
   ///
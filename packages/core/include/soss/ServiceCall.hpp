@@ -0,0 +1,151 @@
+/*
+ * Copyright (C) 2019 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#ifndef SOSS__SERVICECALL_HPP
+#define SOSS__SERVICECALL_HPP
+
+#include <soss/Executor.hpp>
+#include <soss/SystemHandle.hpp>
+
+#include <soss/core/export.hpp>
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace soss {
+
+//==============================================================================
+/// ServiceCall is the asynchronous result of a request to a ServiceProvider.
+/// Instead of implementing a ServiceClient and keeping track of what each
+/// call_handle stands for, a middleware or a tool can call a provider through
+/// ServiceCall::call(~) and attach what should happen with the response.
+///
+/// Nothing ever waits for a ServiceCall. Its continuations run once the
+/// provider answers, either on the thread that delivers the answer, or on an
+/// Executor of their choice. Calls can be chained with then_call(~), and
+/// concurrent calls can be joined with when_all(~), so a sequence of service
+/// calls through soss does not hold on to any thread while it is in flight.
+class SOSS_CORE_API ServiceCall
+{
+public:
+
+  /// The outcome of a service call
+  struct Result
+  {
+    /// True if the provider answered the request
+    bool succeeded = false;
+
+    /// The response of the provider, if it answered
+    Message response;
+
+    /// Why the call failed, if it did
+    std::string error;
+  };
+
+  /// Signature of what should happen once a call has finished
+  using Continuation = std::function<void(const Result& result)>;
+
+  /// Signature of a step of a chain, which gets the result of the previous
+  /// call and makes the next one
+  using Next = std::function<ServiceCall(const Result& result)>;
+
+  /// Signature of what should happen once every call of a group has finished.
+  /// The results are in the same order as the calls.
+  using JoinedContinuation =
+      std::function<void(const std::vector<Result>& results)>;
+
+  /// \brief Send a request to a provider.
+  ///
+  /// \param[in] provider
+  ///   The provider to call. It is kept alive until the call finishes. A null
+  ///   provider makes a call that has already failed.
+  ///
+  /// \param[in] request
+  ///   The request message
+  static ServiceCall call(
+      std::shared_ptr<ServiceProvider> provider,
+      const Message& request);
+
+  /// \brief Make a call that has already finished with this result, e.g. to
+  /// end a chain early from a step of then_call(~).
+  static ServiceCall finished(Result result);
+
+  /// \brief Do something with the result of the call once it has finished.
+  /// If it has already finished, the continuation runs right away.
+  ///
+  /// \param[in] continuation
+  ///   What to do with the result
+  ///
+  /// \param[in] executor
+  ///   The executor to run the continuation on. When this is null, the
+  ///   continuation runs on the thread that finishes the call, which is
+  ///   usually a thread of the middleware that answered, so it must not block.
+  void then(
+      Continuation continuation,
+      std::shared_ptr<Executor> executor = nullptr) const;
+
+  /// \brief Make another call once this one has finished.
+  ///
+  /// \param[in] next
+  ///   Makes the next call from the result of this one
+  ///
+  /// \param[in] executor
+  ///   The executor to run next on, like for then(~)
+  ///
+  /// \returns a call that finishes with the result of the call made by next
+  ServiceCall then_call(
+      Next next,
+      std::shared_ptr<Executor> executor = nullptr) const;
+
+  /// \brief Do something once every one of a group of calls has finished.
+  ///
+  /// \param[in] calls
+  ///   The calls to wait for. They keep going concurrently.
+  ///
+  /// \param[in] continuation
+  ///   What to do with their results
+  ///
+  /// \param[in] executor
+  ///   The executor to run the continuation on, like for then(~)
+  static void when_all(
+      const std::vector<ServiceCall>& calls,
+      JoinedContinuation continuation,
+      std::shared_ptr<Executor> executor = nullptr);
+
+  /// \brief True once the call has finished
+  bool ready() const;
+
+  /// \brief Give up on the call. It finishes with an error right away, and
+  /// the provider gets told through ServiceProvider::cancel_service_call(~).
+  /// A chained call cancels whichever of its calls is in flight. Nothing
+  /// happens if the call has already finished.
+  void cancel() const;
+
+  class Implementation;
+private:
+
+  ServiceCall(std::shared_ptr<Implementation> impl);
+
+  std::shared_ptr<Implementation> _pimpl;
+
+};
+
+} // namespace soss
+
+#endif // SOSS__SERVICECALL_HPP
@@ -22,6 +22,8 @@
 #include <stdexcept>
 #include <soss/core/export.hpp>
 
+#include <vector>
+
 namespace soss {
 
 //==============================================================================
@@ -34,9 +36,10 @@ public:
   /// \param[in] template_string
   ///   A string that describes the desired template. Varying components of the
   ///   string must be wrapped in curly braces {}. Currently only
-  ///   {message.<field>} variables are supported. Those components of the
-  ///   string will be replaced by the value of the requested field when
-  ///   compute_string() is called.
+  ///   {message.<field>} variables are supported, where <field> may also be
+  ///   a path through nested messages, e.g. {message.header.frame_id}. Those
+  ///   components of the string will be replaced by the value of the
+  ///   requested field when compute_string() is called.
   ///
   /// \param[in] usage_details
   ///   A string that describes how this StringTemplate is being used. Ideally
@@ -53,6 +56,31 @@ public:
   /// Compute the desired output string given the input message.
   std::string compute_string(const soss::Message& message) const;
 
+  /// Compute the desired output string into a buffer that the caller
+  /// provides, replacing its contents. Nothing gets allocated once the buffer
+  /// has grown large enough, so reusing one buffer (e.g. a thread_local one)
+  /// for every message avoids allocating in steady state.
+  void compute_string(
+      const soss::Message& message,
+      std::string& output) const;
+
+  /// Compute a compact key for the values that this template substitutes from
+  /// the input message, without converting any of them into strings. Messages
+  /// that give the same key always give the same compute_string(), so the key
+  /// can be used to cache whatever gets derived from that string. See
+  /// StringTemplateCache.
+  ///
+  /// \param[in] message
+  ///   The message to read the substituted fields from.
+  ///
+  /// \param[out] key
+  ///   The key will be written into this string.
+  ///
+  /// \returns a hash of the key
+  std::size_t compute_key(
+      const soss::Message& message,
+      std::string& key) const;
+
   /// Mutable reference to the usage details for this StringTemplate
   std::string& usage_details();
 
@@ -69,6 +97,125 @@ private:
 
 };
 
+//==============================================================================
+/// StringTemplateCache remembers a value for every distinct string that a
+/// StringTemplate computes, e.g. the publisher of each topic that a topic
+/// template expands into. Lookups use StringTemplate::compute_key(~) with an
+/// open-addressing table, so a message whose key was seen before does not need
+/// to have its string computed at all.
+///
+/// This class is not thread-safe.
+template<typename Value>
+class StringTemplateCache
+{
+public:
+
+  /// \param[in] string_template
+  ///   The template whose strings are being cached. It must outlive the cache.
+  StringTemplateCache(const StringTemplate& string_template)
+    : _template(string_template),
+      _size(0)
+  {
+    _slots.resize(16);
+  }
+
+  /// \brief Get the value that was cached for the string of this message. If
+  /// nothing has been cached for it yet, make(string) will be called to
+  /// produce the value.
+  ///
+  /// Different keys may compute the same string, so make(~) should look up
+  /// any value that it might have already produced for that string.
+  ///
+  /// The reference that is returned is only valid until the next call to
+  /// get(~).
+  template<typename Make>
+  Value& get(const soss::Message& message, Make&& make)
+  {
+    // The key goes into a buffer that is reused, so looking up a key that
+    // was seen before does not allocate anything
+    const std::size_t hash = _template.compute_key(message, _key);
+
+    std::size_t index = hash & (_slots.size() - 1);
+    while(_slots[index].used)
+    {
+      Slot& slot = _slots[index];
+      if(slot.hash == hash && slot.key == _key)
+        return slot.value;
+
+      index = (index + 1) & (_slots.size() - 1);
+    }
+
+    _template.compute_string(message, _string);
+    Value value = make(static_cast<const std::string&>(_string));
+
+    // Keep the table at most half full so that probes stay short
+    if(2*(_size + 1) > _slots.size())
+    {
+      _grow();
+      index = hash & (_slots.size() - 1);
+      while(_slots[index].used)
+        index = (index + 1) & (_slots.size() - 1);
+    }
+
+    Slot& slot = _slots[index];
+    slot.used = true;
+    slot.hash = hash;
+    slot.key = _key;
+    slot.value = std::move(value);
+    ++_size;
+    return slot.value;
+  }
+
+  /// \brief The number of distinct keys that have been cached
+  std::size_t size() const
+  {
+    return _size;
+  }
+
+  /// \brief Forget every value that has been cached
+  void clear()
+  {
+    _slots.assign(16, Slot());
+    _size = 0;
+  }
+
+private:
+
+  struct Slot
+  {
+    bool used = false;
+    std::size_t hash = 0;
+    std::string key;
+    Value value;
+  };
+
+  void _grow()
+  {
+    std::vector<Slot> old_slots(2*_slots.size());
+    std::swap(old_slots, _slots);
+    for(Slot& old : old_slots)
+    {
+      if(!old.used)
+        continue;
+
+      std::size_t index = old.hash & (_slots.size() - 1);
+      while(_slots[index].used)
+        index = (index + 1) & (_slots.size() - 1);
+
+      _slots[index] = std::move(old);
+    }
+  }
+
+  const StringTemplate& _template;
+  std::vector<Slot> _slots;
+  std::size_t _size;
+
+  // Buffers for the key and the string of the message being looked up
+  std::string _key;
+  std::string _string;
+
+};
+
 //==============================================================================
 class InvalidTemplateFormat : public std::runtime_error
 {
@@ -19,13 +19,19 @@
 #define SOSS__SYSTEMHANDLE_HPP
 
 #include <soss/Message.hpp>
+#include <soss/MessageEnvelope.hpp>
 #include <soss/detail/SystemHandle-head.hpp>
 
 #include <yaml-cpp/yaml.h>
 
+#include <chrono>
+#include <iostream>
 #include <set>
 #include <string>
 #include <functional>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
 namespace soss {
 
@@ -96,6 +102,25 @@ public:
   /// \returns true if the system handle is still working
   virtual bool spin_once() = 0;
 
+  /// \brief Block until this system handle has work for spin_once() to do,
+  /// until wake_up() is called, or until max_wait has elapsed, whichever
+  /// comes first.
+  ///
+  /// soss calls this between consecutive calls to spin_once(). The default
+  /// implementation returns immediately, which leaves it up to spin_once() to
+  /// pace itself.
+  virtual void wait_for_work(std::chrono::nanoseconds /*max_wait*/) { }
+
+  /// \brief Interrupt any ongoing call to wait_for_work(), e.g. because soss
+  /// is shutting down. This may be called from any thread.
+  virtual void wake_up() { }
+
+  /// \brief A self-driven system handle does all of its work on threads that
+  /// it manages by itself. soss will call spin_once() on it exactly once to
+  /// start it up, and afterwards it will only monitor okay() without
+  /// dedicating a thread to it.
+  virtual bool self_driven() const { return false; }
+
   // SystemHandle objects should not be copied or moved
   SystemHandle(const SystemHandle&) = delete;
   SystemHandle& operator=(const SystemHandle&) = delete;
@@ -110,7 +135,73 @@ class TopicSubscriberSystem : public virtual SystemHandle
 {
 public:
 
-  using SubscriptionCallback = std::function<void(const Message& message)>;
+  /// The callback that a subscription triggers for each incoming message.
+  ///
+  /// It can be called with a Message that the subscription will not use again,
+  /// passed as an rvalue. soss takes advantage of that on topics with exactly
+  /// one destination, handing the message to TopicPublisher::publish_owned(~)
+  /// so that its contents can be moved into the native message of the sink
+  /// instead of copied.
+  class SubscriptionCallback
+  {
+  public:
+
+    using SharedCallback = std::function<void(const Message& message)>;
+    using OwnedCallback = std::function<void(Message&& message)>;
+
+    /// \brief Construct an empty callback
+    SubscriptionCallback() = default;
+
+    /// \brief Construct a callback from anything that can receive a
+    /// const Message&
+    template<
+        typename Callback,
+        typename = typename std::enable_if<
+          std::is_convertible<Callback, SharedCallback>::value
+          && !std::is_same<
+            typename std::decay<Callback>::type,
+            SubscriptionCallback>::value>::type>
+    SubscriptionCallback(Callback&& callback)
+      : _shared(std::forward<Callback>(callback))
+    {
+      // Do nothing
+    }
+
+    /// \brief Construct a callback that does something different when it is
+    /// given ownership of the message.
+    SubscriptionCallback(SharedCallback shared, OwnedCallback owned)
+      : _shared(std::move(shared)),
+        _owned(std::move(owned))
+    {
+      // Do nothing
+    }
+
+    /// \brief Deliver a message that the caller will keep using
+    void operator()(const Message& message) const
+    {
+      _shared(message);
+    }
+
+    /// \brief Deliver a message that the caller no longer needs
+    void operator()(Message&& message) const
+    {
+      if(_owned)
+        _owned(std::move(message));
+      else
+        _shared(message);
+    }
+
+    explicit operator bool() const
+    {
+      return static_cast<bool>(_shared);
+    }
+
+  private:
+
+    SharedCallback _shared;
+    OwnedCallback _owned;
+
+  };
 
   /// \brief Have this node subscribe to a topic
   ///
@@ -133,6 +224,28 @@ public:
       const std::string& message_type,
       SubscriptionCallback callback,
       const YAML::Node& configuration) = 0;
+
+  /// \brief Stop a subscription that soss no longer uses, because its topic
+  /// was removed or changed while soss was running.
+  ///
+  /// soss has already stopped routing the messages of the subscription when
+  /// it calls this, so anything that still arrives on it gets dropped. The
+  /// default does nothing and returns false, in which case soss reuses the
+  /// subscription if the topic comes back later.
+  ///
+  /// The arguments are the same ones that were given to subscribe(~).
+  ///
+  /// \returns true if the subscription was stopped
+  virtual bool unsubscribe(
+      const std::string& topic_name,
+      const std::string& message_type,
+      const YAML::Node& configuration)
+  {
+    (void)topic_name;
+    (void)message_type;
+    (void)configuration;
+    return false;
+  }
 };
 
 //==============================================================================
@@ -152,6 +265,61 @@ public:
   ///   Message that's being published
   virtual bool publish(const Message& message) = 0;
 
+  /// \brief Publish a message that nothing else will use afterwards.
+  ///
+  /// soss uses this instead of publish(const Message&) when a topic is routed
+  /// to only one publisher and the subscription was done with the message.
+  /// Publishers can override it to move strings and arrays out of the message
+  /// instead of copying them. The default implementation simply publishes the
+  /// message.
+  ///
+  /// \param[in] message
+  ///   Message that's being published. Its contents may be left in any valid
+  ///   state.
+  virtual bool publish_owned(Message&& message)
+  {
+    return publish(message);
+  }
+
+  /// \brief Publish a message that is being shared with the other publishers
+  /// of its route.
+  ///
+  /// soss uses this instead of publish(const Message&) whenever a topic is
+  /// routed to more than one publisher. Publishers can override it to cache
+  /// their wire encoding on the envelope so that it gets reused by every other
+  /// publisher that uses the same wire format. The default implementation
+  /// simply publishes the message inside of the envelope.
+  ///
+  /// \param[in] envelope
+  ///   Envelope of the message that's being published. See MessageEnvelope
+  ///   for how long its contents may be used.
+  virtual bool publish_envelope(const MessageEnvelope& envelope)
+  {
+    return publish(envelope.message());
+  }
+
+  /// \brief Publish several messages of the topic at once, in order.
+  ///
+  /// soss uses this on queued topics that are configured with a [batch] size
+  /// greater than one and that are routed to only this publisher. Publishers
+  /// can override it to share the per-message overhead of their middleware
+  /// between the messages, e.g. by taking a lock only once. The default
+  /// implementation publishes each message on its own.
+  ///
+  /// \param[in] messages
+  ///   Messages that are being published, oldest first
+  ///
+  /// \returns true if every message was published
+  virtual bool publish_batch(
+      const std::vector<std::shared_ptr<const Message>>& messages)
+  {
+    bool success = true;
+    for(const std::shared_ptr<const Message>& message : messages)
+      success &= publish(*message);
+
+    return success;
+  }
+
   virtual ~TopicPublisher() = default;
 };
 
@@ -215,6 +383,30 @@ public:
       std::shared_ptr<void> call_handle,
       const Message& response) = 0;
 
+  /// \brief Find out that a service request failed and will never receive a
+  /// response, e.g. because the provider did not answer within the timeout of
+  /// the service.
+  ///
+  /// ServiceClientNode implementers should override this to tell their own
+  /// client about the failure, so that it can give up on the request right
+  /// away and release anything it was holding for it. By default the request
+  /// is simply dropped.
+  ///
+  /// \param[in] call_handle
+  ///   The handle that was given to the call by this ServiceClientNode
+  ///
+  /// \param[in] error
+  ///   A description of why the request failed
+  ///
+  virtual void receive_error(
+      std::shared_ptr<void> call_handle,
+      const std::string& error)
+  {
+    (void)call_handle;
+    std::cerr << "[soss] A service request failed, but its client cannot be "
+              << "told about it: " << error << std::endl;
+  }
+
   virtual ~ServiceClient() = default;
 };
 
@@ -253,6 +445,28 @@ public:
       const std::string& service_type,
       RequestCallback callback,
       const YAML::Node& configuration) = 0;
+
+  /// \brief Remove a client proxy that soss no longer uses, because its
+  /// service was removed or changed while soss was running.
+  ///
+  /// soss already answers any request that still arrives on the proxy with an
+  /// error when it calls this. The default does nothing and returns false, in
+  /// which case soss reuses the proxy if the service comes back later.
+  ///
+  /// The arguments are the same ones that were given to
+  /// create_client_proxy(~).
+  ///
+  /// \returns true if the proxy was removed
+  virtual bool release_client_proxy(
+      const std::string& service_name,
+      const std::string& service_type,
+      const YAML::Node& configuration)
+  {
+    (void)service_name;
+    (void)service_type;
+    (void)configuration;
+    return false;
+  }
 };
 
 //==============================================================================
@@ -283,6 +497,21 @@ public:
       ServiceClient& client,
       std::shared_ptr<void> call_handle) = 0;
 
+  /// \brief Give up on a call that has not finished yet
+  ///
+  /// soss calls this when a request has timed out, after it has already told
+  /// the client that the request failed. The provider may release whatever it
+  /// was holding for the call. It may still call client.receive_response(~)
+  /// afterwards, but that response will be ignored. The default does nothing.
+  ///
+  /// \param[in] call_handle
+  ///   The handle that was given to call_service(~) for this call
+  ///
+  virtual void cancel_service_call(const std::shared_ptr<void>& call_handle)
+  {
+    (void)call_handle;
+  }
+
   virtual ~ServiceProvider() = default;
 };
 
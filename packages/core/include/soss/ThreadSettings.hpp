@@ -0,0 +1,110 @@
+/*
+ * Copyright (C) 2019 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+
+#ifndef SOSS__THREADSETTINGS_HPP
+#define SOSS__THREADSETTINGS_HPP
+
+#include <soss/core/export.hpp>
+
+#include <yaml-cpp/yaml.h>
+
+#include <string>
+#include <vector>
+
+namespace soss {
+
+//==============================================================================
+/// The key of the system configuration that holds the ThreadSettings of the
+/// system, e.g.
+///
+///   systems:
+///     ros2: { type: ros2, thread: { cpus: [2], policy: fifo, priority: 80 } }
+///     ws: { type: websocket_server, thread: { cpus: "4-7", name: bridge } }
+///
+/// soss applies these settings to the thread that spins the system, and
+/// middlewares that run threads of their own should apply them to those
+/// threads too.
+extern SOSS_CORE_API const std::string YamlThreadKey;
+
+//==============================================================================
+/// ThreadSettings describe where and how the threads of a system get to run.
+/// Anything that is left at its default stays the way the thread inherited it.
+class SOSS_CORE_API ThreadSettings
+{
+public:
+
+  enum class Policy
+  {
+    /// Leave the scheduling policy and priority alone
+    Inherit,
+
+    /// The default time-sharing policy of the operating system
+    Other,
+
+    /// First-in first-out real-time scheduling with the given priority
+    Fifo,
+
+    /// Round-robin real-time scheduling with the given priority
+    RoundRobin
+  };
+
+  /// The CPUs that the threads may run on. Empty means any CPU.
+  std::vector<int> cpus;
+
+  Policy policy = Policy::Inherit;
+
+  /// The static priority of the real-time policies, 1 to 99 on Linux
+  int priority = 0;
+
+  /// The name that the threads get in tools like top and gdb. Names longer
+  /// than the operating system allows get truncated.
+  std::string name;
+
+  /// \brief Read the settings from the [thread] entry of the configuration of
+  /// a system. An empty node leaves the settings alone.
+  ///
+  /// The node may have these entries:
+  /// - cpus: a CPU, a list of CPUs, or a string like "0-3,6"
+  /// - policy: other, fifo or round_robin
+  /// - priority: the priority for the fifo and round_robin policies
+  /// - name: the name of the threads
+  ///
+  /// \param[in] context
+  ///   Names what the settings are for in the error messages
+  ///
+  /// \returns false and prints the reason if the node cannot be parsed.
+  bool parse(const YAML::Node& node, const std::string& context);
+
+  /// \brief Apply the settings to the thread that calls this function.
+  ///
+  /// \param[in] default_name
+  ///   The name to give the thread if these settings do not name it. Leave
+  ///   this empty to keep the name that the thread has.
+  ///
+  /// \returns false and prints the reason if some of the settings could not be
+  /// applied, for example because the process is not allowed to use real-time
+  /// scheduling. Whatever could be applied stays applied.
+  bool apply(const std::string& default_name = "") const;
+
+  /// \brief True if applying these settings would not change anything
+  bool empty() const;
+};
+
+} // namespace soss
+
+#endif // SOSS__THREADSETTINGS_HPP
@@ -0,0 +1,83 @@
+/*
+ * Copyright (C) 2019 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+
+#ifndef SOSS__TRACE_HPP
+#define SOSS__TRACE_HPP
+
+/// \file
+/// Static tracepoints on the hot path of messages and service calls.
+///
+/// When soss-core is built with the SOSS_ENABLE_TRACEPOINTS option, every
+/// SOSS_TRACE(event, args...) becomes a USDT probe named soss:event. LTTng
+/// (through its userspace probes), perf, bpftrace and SystemTap can all attach
+/// to these, e.g.
+///
+/// \code
+/// $ bpftrace -e 'usdt:/opt/soss/lib/libsoss-core.so:soss:topic_ingress
+///     { printf("%s\n", str(arg0)); }'
+/// \endcode
+///
+/// A probe is a single nop until a tracer attaches to it, and its arguments
+/// only cost as much as putting them into registers. Without the option, the
+/// macro compiles to nothing, and its arguments are never evaluated. Every
+/// probe takes at least one argument.
+///
+/// The arguments of a probe must be integers or pointers. Strings are passed
+/// as `const char*`, and messages and calls are identified by their address,
+/// so a tracer can follow one message across the probes.
+///
+/// The probes are:
+///  - topic_ingress(topic, message): soss received a message on a topic route
+///  - topic_egress(topic, destination, message): a publisher of the route is
+///    done with the message
+///  - convert_to_soss_begin/end(type, message): a middleware converts a message
+///    of its own into a soss::Message
+///  - convert_from_soss_begin/end(type, message): a middleware converts a
+///    soss::Message into a message of its own
+///  - service_call(service, call) and service_response(service, call, ok): a
+///    request was passed to a provider, and its response or failure came back
+///
+/// Middlewares may add probes of their own, e.g. the websocket middleware has
+/// encode_begin/end(topic, message) and websocket_send(connection name, bytes).
+
+#ifdef SOSS_TRACEPOINTS
+
+#include <sys/sdt.h>
+
+#define SOSS_TRACE(...) STAP_PROBEV(soss, __VA_ARGS__)
+
+#else
+
+namespace soss {
+namespace detail {
+
+// Only ever named inside of sizeof, so it needs no definition
+template<typename... Args>
+char trace_arguments(const Args&...);
+
+} // namespace detail
+} // namespace soss
+
+// The arguments are still named, without being evaluated, so that variables
+// which only exist for the tracepoints do not count as unused.
+#define SOSS_TRACE(event, ...) \
+  do { (void)sizeof(soss::detail::trace_arguments(__VA_ARGS__)); } while(false)
+
+#endif // SOSS_TRACEPOINTS
+
+#endif // SOSS__TRACE_HPP
@@ -19,7 +19,10 @@
 #define SOSS__DETAIL__MESSAGEIMPL_HPP
 
 #include <soss/Message.hpp>
+#include <soss/Blob.hpp>
 
+#include <cstddef>
+#include <new>
 #include <type_traits>
 
 namespace soss {
@@ -30,20 +33,215 @@ namespace detail {
 template<typename T>
 using Raw_t = std::remove_cv_t<std::remove_reference_t<T>>;
 
+//==============================================================================
+template<typename T>
+struct FieldTypeTagOf
+{
+  static constexpr FieldTypeTag value = FieldTypeTag::Other;
+};
+
+#define SOSS_FIELD_TYPE_TAG(T, Tag) \
+  template<> struct FieldTypeTagOf<T> \
+  { static constexpr FieldTypeTag value = FieldTypeTag::Tag; }
+
+SOSS_FIELD_TYPE_TAG(std::string, String);
+SOSS_FIELD_TYPE_TAG(bool, Bool);
+SOSS_FIELD_TYPE_TAG(int64_t, Int64);
+SOSS_FIELD_TYPE_TAG(uint64_t, UInt64);
+SOSS_FIELD_TYPE_TAG(double, Double);
+SOSS_FIELD_TYPE_TAG(soss::Message, Message);
+SOSS_FIELD_TYPE_TAG(std::vector<std::string>, StringVector);
+SOSS_FIELD_TYPE_TAG(std::vector<int64_t>, Int64Vector);
+SOSS_FIELD_TYPE_TAG(std::vector<uint64_t>, UInt64Vector);
+SOSS_FIELD_TYPE_TAG(std::vector<double>, DoubleVector);
+SOSS_FIELD_TYPE_TAG(std::vector<soss::Message>, MessageVector);
+SOSS_FIELD_TYPE_TAG(std::vector<uint8_t>, UInt8Vector);
+SOSS_FIELD_TYPE_TAG(std::vector<int8_t>, Int8Vector);
+SOSS_FIELD_TYPE_TAG(std::vector<uint16_t>, UInt16Vector);
+SOSS_FIELD_TYPE_TAG(std::vector<int16_t>, Int16Vector);
+SOSS_FIELD_TYPE_TAG(std::vector<uint32_t>, UInt32Vector);
+SOSS_FIELD_TYPE_TAG(std::vector<int32_t>, Int32Vector);
+SOSS_FIELD_TYPE_TAG(std::vector<float>, FloatVector);
+SOSS_FIELD_TYPE_TAG(soss::Blob, Blob);
+
+#undef SOSS_FIELD_TYPE_TAG
+
+//==============================================================================
+/// Values that are too large to be stored inside of a Field live on the heap.
+/// Nested messages need one of these blocks for every level of nesting, and
+/// messages are built and torn down constantly while they are being routed, so
+/// each thread keeps some of the blocks that it frees and hands them out again
+/// to the next value of the same type, instead of going back to the allocator.
+template<typename T>
+class FieldBlockCache
+{
+public:
+
+  /// The most freed blocks that each thread will hold on to for this type
+  static constexpr std::size_t Capacity = 64;
+
+  static void* allocate()
+  {
+    if(!bypass())
+    {
+      FieldBlockCache& cache = instance();
+      if(cache._size > 0)
+        return cache._blocks[--cache._size];
+    }
+
+    return ::operator new(sizeof(T));
+  }
+
+  static void deallocate(void* const block)
+  {
+    if(!bypass())
+    {
+      FieldBlockCache& cache = instance();
+      if(cache._size < Capacity)
+      {
+        cache._blocks[cache._size++] = block;
+        return;
+      }
+    }
+
+    ::operator delete(block);
+  }
+
+  ~FieldBlockCache()
+  {
+    // Fields that get destroyed after this cache, e.g. by other thread-local
+    // or static objects, go straight back to the allocator
+    destroyed() = true;
+    for(std::size_t i=0; i < _size; ++i)
+      ::operator delete(_blocks[i]);
+  }
+
+private:
+
+  FieldBlockCache() = default;
+
+  static FieldBlockCache& instance()
+  {
+    static thread_local FieldBlockCache cache;
+    return cache;
+  }
+
+  static bool& destroyed()
+  {
+    static thread_local bool flag = false;
+    return flag;
+  }
+
+  static bool bypass()
+  {
+    // operator new only guarantees the alignment of std::max_align_t
+    return alignof(T) > alignof(std::max_align_t) || destroyed();
+  }
+
+  void* _blocks[Capacity];
+  std::size_t _size = 0;
+};
+
+//==============================================================================
+template<typename T>
+struct FieldStorage
+{
+  static constexpr bool is_inline =
+      sizeof(T) <= FieldInlineCapacity
+      && alignof(T) <= FieldInlineAlignment
+      && std::is_nothrow_move_constructible<T>::value;
+
+  static constexpr bool is_trivial =
+      is_inline && std::is_trivially_copyable<T>::value;
+
+  static T* get(void* storage)
+  {
+    if(is_inline)
+      return static_cast<T*>(storage);
+
+    return *static_cast<T**>(storage);
+  }
+
+  template<typename... Args>
+  static void construct(void* storage, Args&&... args)
+  {
+    if(is_inline)
+    {
+      new (storage) T(std::forward<Args>(args)...);
+      return;
+    }
+
+    void* const block = FieldBlockCache<T>::allocate();
+    try
+    {
+      *static_cast<T**>(storage) = new (block) T(std::forward<Args>(args)...);
+    }
+    catch(...)
+    {
+      FieldBlockCache<T>::deallocate(block);
+      throw;
+    }
+  }
+
+  static void copy(const void* from, void* to)
+  {
+    construct(to, *static_cast<const T*>(from));
+  }
+
+  static void move(void* from, void* to)
+  {
+    if(is_inline)
+    {
+      T* const value = get(from);
+      new (to) T(std::move(*value));
+      value->~T();
+    }
+    else
+    {
+      // A value on the heap can simply change owners
+      *static_cast<T**>(to) = *static_cast<T**>(from);
+    }
+  }
+
+  static void destroy(void* storage)
+  {
+    T* const value = get(storage);
+    value->~T();
+    if(!is_inline)
+      FieldBlockCache<T>::deallocate(value);
+  }
+
+  static const FieldVTable vtable;
+};
+
+//==============================================================================
+template<typename T>
+const FieldVTable FieldStorage<T>::vtable = {
+  &typeid(T),
+  FieldTypeTagOf<T>::value,
+  FieldStorage<T>::is_inline,
+  FieldStorage<T>::is_trivial,
+  &FieldStorage<T>::copy,
+  &FieldStorage<T>::move,
+  &FieldStorage<T>::destroy
+};
+
 } // namespace detail
 
 //==============================================================================
 template<typename T>
 void Field::set(T&& data)
 {
-  _set(typeid(detail::Raw_t<T>),
-       new detail::Raw_t<T>(std::forward<T>(data)),
-       [](const void* other) -> void*
-          {
-            return new detail::Raw_t<T>(
-                  *static_cast<const detail::Raw_t<T>*>(other));
-          },
-       [](void* expired){ delete static_cast<detail::Raw_t<T>*>(expired); });
+  using Storage = detail::FieldStorage<detail::Raw_t<T>>;
+
+  // Construct the new value before destroying the old one, in case the new
+  // value is being copied out of this very field.
+  Field replacement;
+  Storage::construct(replacement._storage, std::forward<T>(data));
+  replacement._vtable = &Storage::vtable;
+
+  _reset();
+  _move_from(replacement);
 }
 
 //==============================================================================
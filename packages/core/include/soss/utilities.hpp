@@ -21,7 +21,14 @@
 #include <soss/Message.hpp>
 
 #include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <memory>
 #include <mutex>
+#include <stdexcept>
 #include <type_traits>
 #include <vector>
 
@@ -68,6 +75,153 @@ void vector_push_back(std::array<T, N>& /*array*/, Arg&& /*arg*/)
   // exists to satisfy the compiler.
 }
 
+//==============================================================================
+namespace detail {
+
+/// \brief Elements that were cut from the tail of a container. They are kept
+/// per thread and per initializer, so that the next container which grows on
+/// the same thread can take them back, with their fields and buffers still in
+/// place, instead of initializing new elements.
+template<typename Type>
+class SpareElements
+{
+public:
+
+  using Initializer = Type(*)();
+
+  /// The most elements that get kept for each initializer
+  static constexpr std::size_t Limit = 1024;
+
+  static void keep(const Initializer initialize, Type&& element)
+  {
+    std::vector<Type>& spares = _spares(initialize);
+    if(spares.size() < Limit)
+      spares.emplace_back(std::move(element));
+  }
+
+  static Type take(const Initializer initialize)
+  {
+    std::vector<Type>& spares = _spares(initialize);
+    if(spares.empty())
+      return (*initialize)();
+
+    Type element = std::move(spares.back());
+    spares.pop_back();
+    return element;
+  }
+
+private:
+
+  static std::vector<Type>& _spares(const Initializer initialize)
+  {
+    // There are only as many initializers as there are element types that get
+    // converted on this thread, so a linear search is enough.
+    static thread_local std::vector<
+        std::pair<Initializer, std::vector<Type>>> lists;
+
+    for(auto& entry : lists)
+    {
+      if(entry.first == initialize)
+        return entry.second;
+    }
+
+    lists.emplace_back(initialize, std::vector<Type>());
+    return lists.back().second;
+  }
+};
+
+} // namespace detail
+
+//==============================================================================
+/// \brief Shrink a container to the given size, handing the elements that get
+/// cut to vector_grow(~) so they can be reused.
+template<typename Container>
+void vector_shrink(
+    Container& vector,
+    const std::size_t size,
+    typename Container::value_type(*initialize)())
+{
+  using Spares = detail::SpareElements<typename Container::value_type>;
+
+  // Keep the elements in reverse, so they come back in their original order
+  for(std::size_t i = vector.size(); i > size; --i)
+    Spares::keep(initialize, std::move(vector[i-1]));
+
+  vector.resize(size);
+}
+
+template<typename T, std::size_t N>
+void vector_shrink(
+    std::array<T, N>& /*array*/,
+    std::size_t /*size*/,
+    T(* /*unused*/ )())
+{
+  // Do nothing. Arrays don't need to be resized.
+}
+
+//==============================================================================
+/// \brief Get an element to append to a container, reusing one that was cut
+/// by vector_shrink(~) if there is one.
+template<typename Type>
+Type vector_grow(Type(*initialize)())
+{
+  return detail::SpareElements<Type>::take(initialize);
+}
+
+//==============================================================================
+/// \brief Sequences of these element types are stored in a soss::Message as a
+/// std::vector of the same element type, instead of having each element
+/// widened to 64 bits. Booleans are still widened, because std::vector<bool>
+/// cannot be copied as a block of memory.
+template<typename ElementType>
+struct is_packed_element
+  : std::integral_constant<bool,
+      std::is_arithmetic<ElementType>::value
+      && !std::is_same<ElementType, bool>::value> { };
+
+//==============================================================================
+/// \brief Copy a contiguous array of numbers into another one, converting each
+/// element if the types differ. The loop has no dependencies between elements,
+/// so the compiler is free to vectorize the widening or narrowing.
+template<typename FromType, typename ToType>
+void copy_packed(const FromType* from, const std::size_t size, ToType* to)
+{
+  for(std::size_t i=0; i < size; ++i)
+    to[i] = static_cast<ToType>(from[i]);
+}
+
+//==============================================================================
+/// \brief Arrays of the same type are copied as one block of memory
+template<typename Type>
+void copy_packed(const Type* from, const std::size_t size, Type* to)
+{
+  if(size > 0)
+    std::memcpy(to, from, size*sizeof(Type));
+}
+
+//==============================================================================
+/// \brief True if the container stores its elements in one contiguous block of
+/// memory that can be reached through data()
+template<typename Container, typename = void>
+struct has_contiguous_data : std::false_type { };
+
+template<typename Container>
+struct has_contiguous_data<Container, typename std::enable_if<
+    std::is_pointer<decltype(std::declval<const Container&>().data())>::value
+    >::type> : std::true_type { };
+
+//==============================================================================
+/// \brief True if a sequence of FromContainer can be converted into a
+/// ToContainer with copy_packed(~) instead of converting each element on its
+/// own.
+template<typename FromContainer, typename ToContainer>
+struct is_packed_copy
+  : std::integral_constant<bool,
+      is_packed_element<typename FromContainer::value_type>::value
+      && is_packed_element<typename ToContainer::value_type>::value
+      && has_contiguous_data<FromContainer>::value
+      && has_contiguous_data<ToContainer>::value> { };
+
 //==============================================================================
 /// \brief Convenience function for converting a bounded vector of
 /// soss::Messages into a bounded vector of middleware-specific messages.
@@ -87,10 +241,50 @@ struct convert_bounded_vector
       ToContainer& to,
       void(*convert)(const FromType& from, ToType& to),
       ToType(*initialize)() = []() { return ToType(); })
+  {
+    convert_impl(from, to, convert, initialize,
+                 is_packed_copy<FromContainer, ToContainer>());
+  }
+
+private:
+
+  /// Contiguous arrays of numbers are copied in bulk. The conversion of each
+  /// number is only a cast, so the element functions are not needed.
+  template<typename FromType, typename ToType,
+           typename FromContainer, typename ToContainer>
+  static void convert_impl(
+      const FromContainer& from,
+      ToContainer& to,
+      void(* /*unused*/ )(const FromType& from, ToType& to),
+      ToType(* /*unused*/ )(),
+      std::true_type /*packed*/)
+  {
+    const std::size_t N = std::min(from.size(), UpperBound);
+    vector_resize(to, N);
+    copy_packed(from.data(), std::min(N, static_cast<std::size_t>(to.size())),
+                to.data());
+  }
+
+  template<typename FromType, typename ToType,
+           typename FromContainer, typename ToContainer>
+  static void convert_impl(
+      const FromContainer& from,
+      ToContainer& to,
+      void(*convert)(const FromType& from, ToType& to),
+      ToType(*initialize)(),
+      std::false_type /*packed*/)
   {
     // TODO(MXG): Should we emit a warning when the incoming data exceeds the
     // upper bound?
+    //
+    // The elements that are already in the container get converted in place,
+    // so only the tail ever needs to be grown or cut. Cut elements are kept
+    // for the next container that grows, so a sequence whose length changes
+    // between messages does not keep initializing new elements either.
     const std::size_t N = std::min(from.size(), UpperBound);
+    if(to.size() > N)
+      vector_shrink(to, N, initialize);
+
     vector_reserve(to, N);
     for(std::size_t i=0; i < N; ++i)
     {
@@ -101,14 +295,43 @@ struct convert_bounded_vector
       }
       else
       {
-        ToType to_msg = (*initialize)();
+        ToType to_msg = vector_grow(initialize);
         (*convert)(from_msg, to_msg);
         vector_push_back(to, std::move(to_msg));
       }
     }
+  }
 
+public:
+
+  /// \brief Same as convert(~), except each element gets moved out of the
+  /// container that it comes from.
+  template<typename FromType, typename ToType,
+           typename FromContainer, typename ToContainer>
+  static void move_convert(
+      FromContainer& from,
+      ToContainer& to,
+      void(*move)(FromType&& from, ToType& to),
+      ToType(*initialize)() = []() { return ToType(); })
+  {
+    const std::size_t N = std::min(from.size(), UpperBound);
     if(to.size() > N)
-      vector_resize(to, N);
+      vector_shrink(to, N, initialize);
+
+    vector_reserve(to, N);
+    for(std::size_t i=0; i < N; ++i)
+    {
+      if(i < to.size())
+      {
+        (*move)(std::move(from[i]), to[i]);
+      }
+      else
+      {
+        ToType to_msg = vector_grow(initialize);
+        (*move)(std::move(from[i]), to_msg);
+        vector_push_back(to, std::move(to_msg));
+      }
+    }
   }
 };
 
@@ -137,6 +360,17 @@ struct convert_bounded_vector<bool, UpperBound>
     for(std::size_t i=0; i < N; ++i)
       to[i] = static_cast<typename ToContainer::value_type>(from[i]);
   }
+
+  /// \brief There is nothing to gain from moving bools, so this is the same as
+  /// convert(~)
+  template<typename FromContainer, typename ToContainer, typename MoveFunction>
+  static void move_convert(
+      FromContainer& from,
+      ToContainer& to,
+      MoveFunction /*unused*/)
+  {
+    convert(from, to, nullptr);
+  }
 };
 
 //==============================================================================
@@ -151,13 +385,14 @@ struct Convert
 {
   using native_type = Type;
   using soss_type = native_type;
-  using field_iterator = std::map<std::string, Field>::iterator;
-  using const_field_iterator = std::map<std::string, Field>::const_iterator;
+  using field_iterator = Message::iterator;
+  using const_field_iterator = Message::const_iterator;
 
   static constexpr bool type_is_primitive =
          std::is_arithmetic<Type>::value
       || std::is_same<std::string, Type>::value
-      || std::is_same<std::basic_string<char16_t>, Type>::value;
+      || std::is_same<std::basic_string<char16_t>, Type>::value
+      || std::is_same<Blob, Type>::value;
 
   /// \brief Create an instance of the generic soss version of this type
   ///
@@ -211,6 +446,26 @@ struct Convert
     to = *from->second.cast<soss_type>();
   }
 
+  /// \brief Move the contents of a generic soss data structure that is no
+  /// longer needed into a native middleware data structure. Converters that do
+  /// not provide this will be used through from_soss(~) instead.
+  static void move_from_soss(soss_type&& from, native_type& to)
+  {
+    static_assert(type_is_primitive,
+      "The soss::Convert struct should be specialized for non-primitive types");
+    to = std::move(from);
+  }
+
+  /// \brief Move the contents of a generic soss message field that is no
+  /// longer needed into a native middleware data structure. Converters that do
+  /// not provide this will be used through from_soss_field(~) instead.
+  static void move_from_soss_field(const field_iterator& from, native_type& to)
+  {
+    static_assert(type_is_primitive,
+      "The soss::Convert struct should be specialized for non-primitive types");
+    to = std::move(*from->second.cast<soss_type>());
+  }
+
   /// \brief Move data from a native middleware data structure to a generic soss
   /// data structure.
   static void to_soss(const native_type& from, soss_type& to)
@@ -228,6 +483,95 @@ struct Convert
   }
 };
 
+//==============================================================================
+namespace detail {
+
+template<typename ConvertType, typename = void>
+struct has_move_from_soss : std::false_type { };
+
+template<typename ConvertType>
+struct has_move_from_soss<ConvertType,
+    decltype(void(&ConvertType::move_from_soss))> : std::true_type { };
+
+template<typename ConvertType, typename = void>
+struct has_move_from_soss_field : std::false_type { };
+
+template<typename ConvertType>
+struct has_move_from_soss_field<ConvertType,
+    decltype(void(&ConvertType::move_from_soss_field))> : std::true_type { };
+
+template<typename ConvertType>
+void move_from_soss(
+    typename ConvertType::soss_type& from,
+    typename ConvertType::native_type& to,
+    std::true_type)
+{
+  ConvertType::move_from_soss(std::move(from), to);
+}
+
+template<typename ConvertType>
+void move_from_soss(
+    typename ConvertType::soss_type& from,
+    typename ConvertType::native_type& to,
+    std::false_type)
+{
+  ConvertType::from_soss(from, to);
+}
+
+template<typename ConvertType>
+void move_from_soss_field(
+    const Message::iterator& from,
+    typename ConvertType::native_type& to,
+    std::true_type)
+{
+  ConvertType::move_from_soss_field(from, to);
+}
+
+template<typename ConvertType>
+void move_from_soss_field(
+    const Message::iterator& from,
+    typename ConvertType::native_type& to,
+    std::false_type)
+{
+  ConvertType::from_soss_field(from, to);
+}
+
+/// Used by message converters that do not know how to move a soss::Message
+template<typename Type, void (*from_soss)(const soss::Message& from, Type& to)>
+void move_by_copy(soss::Message&& from, Type& to)
+{
+  (*from_soss)(from, to);
+}
+
+} // namespace detail
+
+//==============================================================================
+/// \brief Move the contents of a generic soss data structure into a native
+/// middleware data structure, using ConvertType::move_from_soss(~) if it is
+/// available, or else ConvertType::from_soss(~).
+template<typename ConvertType>
+void move_from_soss(
+    typename ConvertType::soss_type&& from,
+    typename ConvertType::native_type& to)
+{
+  detail::move_from_soss<ConvertType>(
+        from, to, detail::has_move_from_soss<ConvertType>());
+}
+
+//==============================================================================
+/// \brief Move the contents of a field into a native middleware data
+/// structure, using ConvertType::move_from_soss_field(~) if it is available, or
+/// else ConvertType::from_soss_field(~). The field may be left in any valid
+/// state.
+template<typename ConvertType>
+void move_from_soss_field(
+    const Message::iterator& from,
+    typename ConvertType::native_type& to)
+{
+  detail::move_from_soss_field<ConvertType>(
+        from, to, detail::has_move_from_soss_field<ConvertType>());
+}
+
 //==============================================================================
 /// \brief A class that ensures that low-precision data values will be stored as
 /// their higher precision equivalents in the soss::Message, and that low
@@ -242,8 +586,8 @@ struct LowPrecisionConvert
 {
   using native_type = LowPrecision;
   using soss_type = HighPrecision;
-  using field_iterator = std::map<std::string, Field>::iterator;
-  using const_field_iterator = std::map<std::string, Field>::const_iterator;
+  using field_iterator = Message::iterator;
+  using const_field_iterator = Message::const_iterator;
 
   static constexpr bool type_is_primitive =
          std::is_arithmetic<HighPrecision>::value
@@ -336,17 +680,24 @@ SOSS_CONVERT_LOW_PRECISION(uint64_t, bool);
 ///
 /// Make sure that this template specialization is put into the root soss
 /// namespace.
+///
+/// A fifth function, which moves the contents of a soss::Message that is no
+/// longer needed into the native type, can optionally be given. Otherwise the
+/// message gets copied by convert_from_soss_fnc whenever it could have been
+/// moved.
 template<
     typename Type,
     Message (*_initialize_message)(),
     void (*_from_soss)(const soss::Message& from, Type& to),
-    void (*_to_soss)(const Type& from, soss::Message& to)>
+    void (*_to_soss)(const Type& from, soss::Message& to),
+    void (*_move_from_soss)(soss::Message&& from, Type& to) =
+        &detail::move_by_copy<Type, _from_soss>>
 struct MessageConvert
 {
   using native_type = Type;
   using soss_type = Message;
-  using field_iterator = std::map<std::string, Field>::iterator;
-  using const_field_iterator = std::map<std::string, Field>::const_iterator;
+  using field_iterator = Message::iterator;
+  using const_field_iterator = Message::const_iterator;
 
   static constexpr bool type_is_primitive = false;
 
@@ -382,6 +733,18 @@ struct MessageConvert
     from_soss(*from->second.cast<soss::Message>(), to);
   }
 
+  // Documentation inherited from Convert
+  static void move_from_soss(soss_type&& from, native_type& to)
+  {
+    (*_move_from_soss)(std::move(from), to);
+  }
+
+  // Documentation inherited from Convert
+  static void move_from_soss_field(const field_iterator& from, native_type& to)
+  {
+    move_from_soss(std::move(*from->second.cast<soss::Message>()), to);
+  }
+
   // Documentation inherited from Convert
   static void to_soss(const native_type& from, soss_type& to)
   {
@@ -405,8 +768,8 @@ struct ContainerConvert
 {
   using native_type = NativeType;
   using soss_type = SossType;
-  using field_iterator = std::map<std::string, Field>::iterator;
-  using const_field_iterator = std::map<std::string, Field>::const_iterator;
+  using field_iterator = Message::iterator;
+  using const_field_iterator = Message::const_iterator;
 
   static constexpr bool type_is_primitive =
       Convert<ElementType>::type_is_primitive;
@@ -445,6 +808,18 @@ struct ContainerConvert
     from_soss(*from->second.cast<soss_type>(), to);
   }
 
+  // Documentation inherited from Convert
+  static void move_from_soss(soss_type&& from, native_type& to)
+  {
+    move_impl(from, to, std::is_same<native_type, soss_type>());
+  }
+
+  // Documentation inherited from Convert
+  static void move_from_soss_field(const field_iterator& from, native_type& to)
+  {
+    move_from_soss(std::move(*from->second.cast<soss_type>()), to);
+  }
+
   static void to_soss(const native_type& from, soss_type& to)
   {
     ContainerConversionImpl::convert(
@@ -458,40 +833,312 @@ struct ContainerConvert
   {
     to_soss(from, *to->second.cast<soss_type>());
   }
+
+private:
+
+  /// A native container of the same type can take the whole buffer
+  static void move_impl(soss_type& from, native_type& to, std::true_type)
+  {
+    to = std::move(from);
+  }
+
+  static void move_impl(soss_type& from, native_type& to, std::false_type)
+  {
+    ContainerConversionImpl::move_convert(
+          from, to, &soss::move_from_soss<Convert<ElementType>>);
+  }
 };
 
+//==============================================================================
+/// \brief Convenience functions for converting packed arrays of numbers into
+/// a bounded container of native numbers.
+///
+/// This is effectively a set of functions, but we wrap it in a struct so that
+/// it can be used as a template argument.
+template<std::size_t UpperBound>
+struct convert_packed_vector
+{
+  template<typename FromType, typename ToContainer>
+  static void convert(
+      const FromType* from,
+      const std::size_t size,
+      ToContainer& to)
+  {
+    const std::size_t N = std::min(size, UpperBound);
+    vector_resize(to, N);
+    copy_packed(from, std::min(N, static_cast<std::size_t>(to.size())),
+                to.data());
+  }
+
+  /// \brief Convert a field that holds an array of any numeric type. Fields
+  /// that were created by other middlewares (or by older versions of soss)
+  /// might hold widened arrays, so those get narrowed.
+  template<typename ToContainer>
+  static void from_field(const Field& field, ToContainer& to)
+  {
+    switch(field.type_tag())
+    {
+#define SOSS_CONVERT_PACKED_CASE(Tag, Type) \
+      case FieldTypeTag::Tag: \
+      { \
+        const std::vector<Type>& from = *field.cast<std::vector<Type>>(); \
+        convert(from.data(), from.size(), to); \
+        return; \
+      }
+
+      SOSS_CONVERT_PACKED_CASE(UInt8Vector, uint8_t)
+      SOSS_CONVERT_PACKED_CASE(Int8Vector, int8_t)
+      SOSS_CONVERT_PACKED_CASE(UInt16Vector, uint16_t)
+      SOSS_CONVERT_PACKED_CASE(Int16Vector, int16_t)
+      SOSS_CONVERT_PACKED_CASE(UInt32Vector, uint32_t)
+      SOSS_CONVERT_PACKED_CASE(Int32Vector, int32_t)
+      SOSS_CONVERT_PACKED_CASE(UInt64Vector, uint64_t)
+      SOSS_CONVERT_PACKED_CASE(Int64Vector, int64_t)
+      SOSS_CONVERT_PACKED_CASE(FloatVector, float)
+      SOSS_CONVERT_PACKED_CASE(DoubleVector, double)
+
+#undef SOSS_CONVERT_PACKED_CASE
+
+      case FieldTypeTag::Blob:
+      {
+        const Blob& from = *field.cast<Blob>();
+        convert(from.data(), from.size(), to);
+        return;
+      }
+
+      default:
+        break;
+    }
+
+    throw std::runtime_error(
+          "[soss::Convert] Cannot convert a field of type [" + field.type()
+          + "] into an array of numbers");
+  }
+};
+
+//==============================================================================
+/// \brief Converts sequences of primitive numbers by copying them as packed
+/// arrays of their native width. This keeps large payloads, like the data of
+/// an image, at their original size and lets them be copied with memcpy.
+template<
+    typename ElementType,
+    typename NativeType,
+    std::size_t UpperBound>
+struct PackedContainerConvert
+{
+  using native_type = NativeType;
+  using soss_type = std::vector<ElementType>;
+  using field_iterator = Message::iterator;
+  using const_field_iterator = Message::const_iterator;
+
+  static constexpr bool type_is_primitive = true;
+
+  // Documentation inherited from Convert
+  template<typename... Args>
+  static soss_type make_soss(Args&&... args)
+  {
+    return soss_type(std::forward<Args>(args)...);
+  }
+
+  // Documentation inherited from Convert
+  template<typename... Args>
+  static Field make_soss_field(Args&&... args)
+  {
+    return soss::make_field<soss_type>(make_soss(std::forward<Args>(args)...));
+  }
+
+  // Documentation inherited from Convert
+  static void add_field(soss::Message& msg, const std::string& name)
+  {
+    msg.data[name] = make_soss_field();
+  }
+
+  // Documentation inherited from Convert
+  static void from_soss(const soss_type& from, native_type& to)
+  {
+    convert_packed_vector<UpperBound>::convert(from.data(), from.size(), to);
+  }
+
+  // Documentation inherited from Convert
+  static void from_soss_field(const const_field_iterator& from, native_type& to)
+  {
+    convert_packed_vector<UpperBound>::from_field(from->second, to);
+  }
+
+  // Documentation inherited from Convert
+  static void move_from_soss(soss_type&& from, native_type& to)
+  {
+    move_impl(from, to, std::is_same<native_type, soss_type>());
+  }
+
+  // Documentation inherited from Convert
+  static void move_from_soss_field(const field_iterator& from, native_type& to)
+  {
+    // Fields that hold widened arrays still need to be narrowed
+    if(soss_type* const packed = from->second.cast<soss_type>())
+      move_from_soss(std::move(*packed), to);
+    else
+      from_soss_field(from, to);
+  }
+
+  // Documentation inherited from Convert
+  static void to_soss(const native_type& from, soss_type& to)
+  {
+    to.resize(from.size());
+    copy_packed(from.data(), from.size(), to.data());
+  }
+
+  // Documentation inherited from Convert
+  static void to_soss_field(const native_type& from, field_iterator to)
+  {
+    soss::Field& field = to->second;
+    if(field.type_tag() != detail::FieldTypeTagOf<soss_type>::value)
+      field = make_soss_field();
+
+    to_soss(from, *field.cast<soss_type>());
+  }
+
+private:
+
+  /// A std::vector of the same type can take the whole buffer
+  static void move_impl(soss_type& from, native_type& to, std::true_type)
+  {
+    to = std::move(from);
+  }
+
+  static void move_impl(soss_type& from, native_type& to, std::false_type)
+  {
+    from_soss(from, to);
+  }
+};
+
+//==============================================================================
+/// \brief Picks the conversion of a sequence based on its element type
+template<
+    typename ElementType,
+    typename NativeType,
+    std::size_t UpperBound>
+using SequenceConvert = typename std::conditional<
+    is_packed_element<ElementType>::value,
+    PackedContainerConvert<ElementType, NativeType, UpperBound>,
+    ContainerConvert<
+      ElementType,
+      NativeType,
+      std::vector<typename Convert<ElementType>::soss_type>,
+      soss::convert_bounded_vector<ElementType, UpperBound>>>::type;
+
 //==============================================================================
 template<typename ElementType, typename Allocator>
 struct Convert<std::vector<ElementType, Allocator>>
-    : ContainerConvert<
+    : SequenceConvert<
     ElementType,
     std::vector<typename Convert<ElementType>::native_type, Allocator>,
-    std::vector<typename Convert<ElementType>::soss_type>,
-    soss::convert_bounded_vector<ElementType, std::numeric_limits<
-          typename std::vector<ElementType, Allocator>::size_type>::max()>> { };
+    std::numeric_limits<
+      typename std::vector<ElementType, Allocator>::size_type>::max()> { };
 
 //==============================================================================
 template<typename ElementType, std::size_t N>
 struct Convert<std::array<ElementType, N>>
-    : ContainerConvert<
+    : SequenceConvert<
     ElementType,
     std::array<typename Convert<ElementType>::native_type, N>,
-    std::vector<typename Convert<ElementType>::soss_type>,
-    soss::convert_bounded_vector<ElementType, N>> { };
+    N> { };
+
+//==============================================================================
+/// \brief Converts a native sequence of bytes into a soss::Blob field. The
+/// bytes are copied once when the soss::Message is created, and after that
+/// every copy of the message shares them.
+///
+/// Middlewares can use this instead of the default Convert<std::vector<uint8_t>>
+/// for fields that carry large opaque payloads, like the data of an image:
+///
+/// \code
+/// template<>
+/// struct Convert<native::Image::_data_type>
+///   : BlobConvert<native::Image::_data_type> { };
+/// \endcode
+///
+/// Fields that hold arrays of numbers instead of a Blob are still accepted by
+/// from_soss_field(~).
+template<
+    typename NativeType,
+    std::size_t UpperBound = std::numeric_limits<std::size_t>::max()>
+struct BlobConvert
+{
+  using native_type = NativeType;
+  using soss_type = Blob;
+  using field_iterator = Message::iterator;
+  using const_field_iterator = Message::const_iterator;
+
+  static_assert(sizeof(typename NativeType::value_type) == 1,
+    "soss::BlobConvert can only be used on sequences of bytes");
+
+  static constexpr bool type_is_primitive = true;
+
+  // Documentation inherited from Convert
+  template<typename... Args>
+  static soss_type make_soss(Args&&... args)
+  {
+    return soss_type(std::forward<Args>(args)...);
+  }
+
+  // Documentation inherited from Convert
+  template<typename... Args>
+  static Field make_soss_field(Args&&... args)
+  {
+    return soss::make_field<soss_type>(make_soss(std::forward<Args>(args)...));
+  }
+
+  // Documentation inherited from Convert
+  static void add_field(soss::Message& msg, const std::string& name)
+  {
+    msg.data[name] = make_soss_field();
+  }
+
+  // Documentation inherited from Convert
+  static void from_soss(const soss_type& from, native_type& to)
+  {
+    convert_packed_vector<UpperBound>::convert(from.data(), from.size(), to);
+  }
+
+  // Documentation inherited from Convert
+  static void from_soss_field(const const_field_iterator& from, native_type& to)
+  {
+    convert_packed_vector<UpperBound>::from_field(from->second, to);
+  }
+
+  // Documentation inherited from Convert
+  static void to_soss(const native_type& from, soss_type& to)
+  {
+    to = Blob(reinterpret_cast<const uint8_t*>(from.data()), from.size());
+  }
+
+  // Documentation inherited from Convert
+  static void to_soss_field(const native_type& from, field_iterator to)
+  {
+    to->second.set(make_soss(
+          reinterpret_cast<const uint8_t*>(from.data()), from.size()));
+  }
+};
 
 //==============================================================================
 /// \brief A thread-safe repository for resources to avoid unnecessary
 /// allocations
+///
+/// Every function may be called from any thread. The lock of the pool is only
+/// held to move a single resource in or out of it, never while a new resource
+/// is being initialized.
 template<typename Resource, Resource(*initializerT)()>
 class ResourcePool
 {
 public:
 
   ResourcePool(const std::size_t initial_depth = 1)
+    : _storage(std::make_shared<Storage>())
   {
-    _queue.reserve(initial_depth);
+    _storage->queue.reserve(initial_depth);
     for(std::size_t i=0; i < initial_depth; ++i)
-      _queue.emplace_back((_initializer)());
+      _storage->queue.emplace_back((_initializer)());
   }
 
   void setInitializer(std::function<Resource()> initializer)
@@ -501,28 +1148,106 @@ public:
 
   Resource pop()
   {
-    if(_queue.empty())
     {
-      return (_initializer)();
+      std::unique_lock<std::mutex> lock(_storage->mutex);
+      _storage->count_pop();
+      if(!_storage->queue.empty())
+      {
+        Resource r = std::move(_storage->queue.back());
+        _storage->queue.pop_back();
+        return r;
+      }
     }
 
-    std::unique_lock<std::mutex> lock(_mutex);
-    Resource r = std::move(_queue.back());
-    _queue.pop_back();
-    return r;
+    return (_initializer)();
   }
 
   void recycle(Resource&& r)
   {
-    std::unique_lock<std::mutex> lock(_mutex);
-    _queue.emplace_back(std::move(r));
+    _storage->recycle(std::move(r));
   }
 
+  /// \brief Pop a resource that gets recycled automatically once the last
+  /// copy of the returned pointer is released. This lets each concurrent user
+  /// of the pool hold a resource of its own. The pointer may safely outlive
+  /// the pool, in which case the resource is simply destroyed.
+  std::shared_ptr<Resource> lease()
+  {
+    // The resource lives in the same allocation as the reference count, so a
+    // lease costs one small allocation, while the contents of the resource
+    // (e.g. the fields of a soss::Message) get reused.
+    const auto entry = std::make_shared<Lease>(pop(), _storage);
+    return std::shared_ptr<Resource>(entry, &entry->resource);
+  }
+
+  /// \brief The largest number of resources that have been out of the pool at
+  /// the same time. A pool whose initial depth is at least this high never
+  /// needs to initialize a new resource.
+  std::size_t high_water_mark() const
+  {
+    return _storage->high_water_mark.load(std::memory_order_relaxed);
+  }
+
+  /// \brief The number of resources that are currently waiting in the pool
+  std::size_t available() const
+  {
+    std::unique_lock<std::mutex> lock(_storage->mutex);
+    return _storage->queue.size();
+  }
+
+  ResourcePool(const ResourcePool&) = delete;
+  ResourcePool& operator=(const ResourcePool&) = delete;
 
 private:
 
-  std::vector<Resource> _queue;
-  std::mutex _mutex;
+  struct Storage
+  {
+    void recycle(Resource&& r)
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      queue.emplace_back(std::move(r));
+
+      // Resources that did not come from this pool may be given to it too
+      if(outstanding > 0)
+        --outstanding;
+    }
+
+    /// Must be called while holding the mutex
+    void count_pop()
+    {
+      ++outstanding;
+      if(high_water_mark.load(std::memory_order_relaxed) < outstanding)
+        high_water_mark.store(outstanding, std::memory_order_relaxed);
+    }
+
+    std::vector<Resource> queue;
+    mutable std::mutex mutex;
+
+    // The number of resources that are out of the pool
+    std::size_t outstanding = 0;
+    std::atomic_size_t high_water_mark{0};
+  };
+
+  struct Lease
+  {
+    Lease(Resource&& r, const std::shared_ptr<Storage>& s)
+      : resource(std::move(r)),
+        storage(s)
+    {
+      // Do nothing
+    }
+
+    ~Lease()
+    {
+      if(const auto s = storage.lock())
+        s->recycle(std::move(resource));
+    }
+
+    Resource resource;
+    std::weak_ptr<Storage> storage;
+  };
+
+  std::shared_ptr<Storage> _storage;
   std::function<Resource()> _initializer = initializerT;
 
 };
@@ -17,10 +17,21 @@
 
 #include "Search-impl.hpp"
 #include "Config.hpp"
+#include "SharedSystems.hpp"
+#include "TimerWheel.hpp"
+#include "Watchdog.hpp"
 
 #include <soss/MiddlewareInterfaceExtension.hpp>
-
+#include <soss/Metrics.hpp>
+#include <soss/Trace.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <future>
 #include <iostream>
+#include <memory>
 
 namespace soss {
 namespace internal {
@@ -93,17 +104,17 @@ std::unique_ptr<ServiceRoute> parse_service_route(const YAML::Node& node)
               << std::endl;
     valid = false;
   }
-
-  if(!server.IsScalar() || server.as<std::string>().empty())
-  {
-    std::cerr << "config-file service route [server] entry must be a scalar "
-              << "string! Only one middleware can be the server on a route!"
-              << std::endl;
-    valid = false;
-  }
   else
   {
-    route->server = server.as<std::string>();
+    valid &= scalar_or_list_node_to_set(
+          server, route->servers, "server", "service");
+    route->servers.erase(std::string());
+    if(route->servers.empty())
+    {
+      std::cerr << "config-file service route [server] entry must name at "
+                << "least one middleware!" << std::endl;
+      valid = false;
+    }
   }
 
   valid &= scalar_or_list_node_to_set(
@@ -177,6 +188,7 @@ bool add_topic_or_service_config(
 {
   bool valid = true;
   ConfigType config;
+  config.definition = YAML::Dump(node);
 
   const YAML::Node& type = node["type"];
   if(!type)
@@ -275,218 +287,1345 @@ bool add_topic_or_service_config(
 }
 
 //==============================================================================
-bool add_topic_config(
-    const std::string& name,
+/// Read an amount of memory, which is either a plain number of bytes or a
+/// number followed by a unit, like 512KiB or 64MB
+bool parse_memory_size(
+    const std::string& description,
     const YAML::Node& node,
-    const std::map<std::string, TopicRoute>& topic_routes,
-    std::map<std::string, TopicConfig>& topic_configs)
+    std::size_t& bytes)
 {
-  return add_topic_or_service_config<TopicConfig, TopicRoute>(
-        "topic", name, node, topic_routes, topic_configs,
-        [](TopicConfig& c, std::string s){ c.message_type = std::move(s); },
-        [](TopicConfig& c, TopicRoute r){ c.route = std::move(r); },
-        [](const YAML::Node& node){ return parse_topic_route(node); });
+  const std::string text = node.as<std::string>();
+  std::size_t end = 0;
+  double value = -1.0;
+  try
+  {
+    value = std::stod(text, &end);
+  }
+  catch(const std::exception&)
+  {
+    // The value will be reported as invalid below
+  }
+
+  std::string unit = text.substr(end);
+  unit.erase(0, unit.find_first_not_of(' '));
+
+  const std::map<std::string, double> units = {
+    {"", 1.0}, {"B", 1.0},
+    {"KB", 1e3}, {"MB", 1e6}, {"GB", 1e9},
+    {"KiB", 1024.0}, {"MiB", 1024.0*1024.0}, {"GiB", 1024.0*1024.0*1024.0}
+  };
+
+  const auto it = units.find(unit);
+  if(value < 0.0 || it == units.end())
+  {
+    std::cerr << "The " << description << " must be a number of bytes, "
+              << "optionally followed by one of the units B, KB, MB, GB, KiB, "
+              << "MiB or GiB, but it is [" << text << "]" << std::endl;
+    return false;
+  }
+
+  bytes = static_cast<std::size_t>(value*it->second);
+  return true;
 }
 
 //==============================================================================
-bool add_service_config(
+bool parse_topic_queue(
     const std::string& name,
     const YAML::Node& node,
-    const std::map<std::string, ServiceRoute>& service_routes,
-    std::map<std::string, ServiceConfig>& service_configs)
+    TopicQueueConfig& queue)
 {
-  return add_topic_or_service_config<ServiceConfig, ServiceRoute>(
-        "service", name, node, service_routes, service_configs,
-        [](ServiceConfig& c, std::string s){ c.service_type = std::move(s); },
-        [](ServiceConfig& c, ServiceRoute r){ c.route = std::move(r); },
-        [](const YAML::Node& node){ return parse_service_route(node); });
-}
-
-//==============================================================================
-using ReadDictEntry =
-    std::function<bool(const std::string& key, const YAML::Node& value)>;
+  if(!node.IsMap())
+  {
+    std::cerr << "A [queue] field was given for the topic configuration ["
+              << name << "], but it is not a dictionary!" << std::endl;
+    return false;
+  }
 
-bool read_dictionary(
-    const YAML::Node& config_node,
-    const std::string& field_name,
-    const std::string& filename,
-    const ReadDictEntry& read_fcn)
-{
-  const YAML::Node& field = config_node[field_name];
-  if(field)
+  const YAML::Node& policy = node["policy"];
+  if(policy)
   {
-    if(!field.IsMap())
+    const std::string policy_name = policy.as<std::string>();
+    if(policy_name == "drop_oldest")
+      queue.policy = TopicQueueConfig::Policy::DropOldest;
+    else if(policy_name == "drop_newest")
+      queue.policy = TopicQueueConfig::Policy::DropNewest;
+    else if(policy_name == "keep_latest")
+      queue.policy = TopicQueueConfig::Policy::KeepLatest;
+    else if(policy_name == "block")
+      queue.policy = TopicQueueConfig::Policy::Block;
+    else
     {
-      std::cerr << "The config file [" << filename << "] has a [" << field_name
-                << "] field, but it is not pointing to a dictionary of "
-                // We use this to make the field name singular
-                << field_name.substr(0, field_name.size()-1)
-                << "configurations!" << std::endl;
+      std::cerr << "Unrecognized queue policy [" << policy_name << "] for the "
+                << "topic configuration [" << name << "]. The options are: "
+                << "drop_oldest, drop_newest, keep_latest, block" << std::endl;
       return false;
     }
+  }
 
-    bool configs_okay = true;
-    for(YAML::const_iterator it = field.begin(); it != field.end(); ++it)
+  const YAML::Node& depth = node["depth"];
+  if(depth)
+  {
+    const int value = depth.as<int>();
+    if(value < 1)
     {
-      configs_okay &= read_fcn(it->first.as<std::string>(), it->second);
+      std::cerr << "The queue [depth] of the topic configuration [" << name
+                << "] must be at least 1, but it is [" << value << "]"
+                << std::endl;
+      return false;
     }
 
-    if(!configs_okay)
+    queue.depth = static_cast<std::size_t>(value);
+  }
+  else if(queue.policy == TopicQueueConfig::Policy::KeepLatest)
+  {
+    queue.depth = 1;
+  }
+  else
+  {
+    std::cerr << "The queue of the topic configuration [" << name << "] is "
+              << "missing its [depth] field!" << std::endl;
+    return false;
+  }
+
+  const YAML::Node& batch = node["batch"];
+  if(batch)
+  {
+    const int value = batch.as<int>();
+    if(value < 1)
     {
-      std::cerr << "Error found in an entry of the [" << field_name
-                << "] dictionary of the config-file [" << filename << "]"
+      std::cerr << "The queue [batch] of the topic configuration [" << name
+                << "] must be at least 1, but it is [" << value << "]"
                 << std::endl;
       return false;
     }
+
+    queue.batch = static_cast<std::size_t>(value);
   }
 
+  const YAML::Node& memory_budget = node["memory_budget"];
+  if(memory_budget && !parse_memory_size(
+       "queue [memory_budget] of the topic configuration [" + name + "]",
+       memory_budget, queue.memory_budget))
+    return false;
+
   return true;
 }
 
 //==============================================================================
-YAML::Node config_or_empty_node(
-    const std::string& key,
-    const std::map<std::string, YAML::Node>& map)
+bool parse_throttle_rate(
+    const std::string& name,
+    const YAML::Node& node,
+    TopicThrottleConfig& throttle)
 {
-  const auto it = map.find(key);
-  if(it == map.end())
-    return YAML::Node();
+  const double rate = node.as<double>();
+  if(rate <= 0.0)
+  {
+    std::cerr << "The [rate] of the topic configuration [" << name << "] "
+              << "must be positive, but it is [" << rate << "]" << std::endl;
+    return false;
+  }
 
-  return it->second;
+  throttle.rate = rate;
+  return true;
 }
 
 //==============================================================================
-std::string remap_if_needed(
-    const std::string& middleware,
-    const std::map<std::string, std::string>& remap,
-    const std::string& original)
+bool parse_throttle_decimate(
+    const std::string& name,
+    const YAML::Node& node,
+    TopicThrottleConfig& throttle)
 {
-  const auto it = remap.find(middleware);
-  if(it == remap.end())
-    return original;
+  const int decimate = node.as<int>();
+  if(decimate < 1)
+  {
+    std::cerr << "The [decimate] of the topic configuration [" << name << "] "
+              << "must be at least 1, but it is [" << decimate << "]"
+              << std::endl;
+    return false;
+  }
 
-  return it->second;
+  throttle.decimate = static_cast<std::size_t>(decimate);
+  return true;
 }
 
-} // anonymous namespace
+//==============================================================================
+/// Parse the [rate] and [decimate] fields of a topic. Each of them is either
+/// a single value for every destination of the topic, or a dictionary from
+/// destination names to values. Destinations that are missing from the
+/// dictionary keep the values that were given for every destination.
+bool parse_topic_throttles(
+    const std::string& name,
+    const YAML::Node& node,
+    std::map<std::string, TopicThrottleConfig>& throttles)
+{
+  using ParseField = bool(*)(
+      const std::string&, const YAML::Node&, TopicThrottleConfig&);
+
+  const std::pair<const char*, ParseField> fields[] = {
+    {"rate", &parse_throttle_rate},
+    {"decimate", &parse_throttle_decimate}
+  };
+
+  TopicThrottleConfig all;
+  for(const auto& field : fields)
+  {
+    const YAML::Node& value = node[field.first];
+    if(value && !value.IsMap() && !field.second(name, value, all))
+      return false;
+  }
+
+  if(all.enabled())
+    throttles[std::string()] = all;
+
+  for(const auto& field : fields)
+  {
+    const YAML::Node& value = node[field.first];
+    if(!value || !value.IsMap())
+      continue;
+
+    for(const auto& entry : value)
+    {
+      const std::string destination = entry.first.as<std::string>();
+      TopicThrottleConfig& throttle =
+          throttles.insert(std::make_pair(destination, all)).first->second;
+
+      if(!field.second(name, entry.second, throttle))
+        return false;
+    }
+  }
+
+  return true;
+}
 
 //==============================================================================
-Config::Config(const YAML::Node& node, const std::string& filename)
+/// Nested fields are named by their path, like [header.stamp]
+bool is_field_path(const std::string& path)
 {
-  if(node && !node.IsNull())
-    parse(node, filename);
+  return !path.empty() && path.front() != '.' && path.back() != '.'
+      && path.find("..") == std::string::npos;
 }
 
 //==============================================================================
-Config Config::from_file(const std::string& file)
+bool parse_field_paths(
+    const std::string& name,
+    const YAML::Node& node,
+    std::vector<std::string>& paths)
 {
-  YAML::Node config_node;
-  try
+  if(!node.IsSequence())
   {
-    config_node = YAML::LoadFile(file);
+    std::cerr << "The [fields] of the topic configuration [" << name << "] "
+              << "must be a list of field names" << std::endl;
+    return false;
   }
-  catch(const std::exception& e)
+
+  for(const YAML::Node& entry : node)
   {
-    std::cerr << "Could not parse the config-file named [" << file
-              << "]: " << e.what() << std::endl;
-    return Config();
+    const std::string path = entry.as<std::string>();
+    if(!is_field_path(path))
+    {
+      std::cerr << "The topic configuration [" << name << "] asks for the "
+                << "field [" << path << "], which is not a valid field name. "
+                << "Nested fields are named like [header.stamp]" << std::endl;
+      return false;
+    }
+
+    paths.push_back(path);
   }
 
-  if(!config_node)
+  return true;
+}
+
+//==============================================================================
+/// Parse the [fields] of a topic, which is either a list of the fields that
+/// every destination gets, or a dictionary from destination names to lists.
+bool parse_topic_projections(
+    const std::string& name,
+    const YAML::Node& node,
+    std::map<std::string, std::vector<std::string>>& projections)
+{
+  if(!node.IsMap())
+    return parse_field_paths(name, node, projections[std::string()]);
+
+  for(const auto& entry : node)
   {
-    std::cerr << "Could not parse the config-file [" << file
-              << "]" << std::endl;
-    return Config();
+    if(!parse_field_paths(
+         name, entry.second, projections[entry.first.as<std::string>()]))
+      return false;
   }
 
-  return Config(config_node, file);
+  return true;
 }
 
 //==============================================================================
-bool Config::parse(const YAML::Node& config_node, const std::string& file)
+/// Parse the [on_change] field of a topic, which is either a boolean, or a
+/// dictionary with the optional [fields] to compare and the [max_silence] in
+/// seconds.
+bool parse_topic_on_change(
+    const std::string& name,
+    const YAML::Node& node,
+    TopicOnChangeConfig& on_change)
 {
-  _okay = false;
-
-  if(!config_node.IsMap())
+  if(node.IsScalar())
   {
-    std::cerr << "The config-file [" << file << "] needs to be a map "
-              << "containing [systems], and possibly [routes], [topics], "
-              << "and/or [services]!" << std::endl;
-    return false;
+    on_change.enabled = node.as<bool>();
+    return true;
   }
 
-  const YAML::Node& systems = config_node["systems"];
-  if(!systems || !systems.IsMap())
+  if(!node.IsMap())
   {
-    std::cerr << "The config-file [" << file << "] is missing a "
-              << "dictionary for [systems]! You must specify at least two "
-              << "systems in your config-file." << std::endl;
+    std::cerr << "The [on_change] field of the topic configuration [" << name
+              << "] must be a boolean or a dictionary" << std::endl;
     return false;
   }
 
-  for(YAML::const_iterator it = systems.begin(); it != systems.end(); ++it)
+  on_change.enabled = true;
+
+  const YAML::Node& fields = node["fields"];
+  if(fields && !parse_field_paths(name, fields, on_change.fields))
+    return false;
+
+  if(const YAML::Node& silence = node["max_silence"])
   {
-    const std::string middleware_alias = it->first.as<std::string>();
+    const double seconds = silence.as<double>();
+    if(seconds <= 0.0)
+    {
+      std::cerr << "The [max_silence] of the topic configuration [" << name
+                << "] must be positive, but it is [" << seconds << "]"
+                << std::endl;
+      return false;
+    }
 
-    const YAML::Node& config = it->second;
+    on_change.max_silence = std::chrono::nanoseconds(
+          static_cast<int64_t>(seconds*1e9));
+  }
 
-    const YAML::Node& type_node = config["type"];
-    const std::string middleware = type_node?
-          type_node.as<std::string>() : middleware_alias;
+  return true;
+}
 
-    m_middlewares.insert(
-          std::make_pair(
-            middleware_alias, MiddlewareConfig{middleware, config}));
+//==============================================================================
+bool parse_dispatch_targets(
+    const std::string& name,
+    const std::string& value,
+    const YAML::Node& node,
+    TopicDispatchConfig::Targets& targets)
+{
+  if(!node.IsMap())
+  {
+    std::cerr << "The dispatch case [" << value << "] of the topic "
+              << "configuration [" << name << "] must be a dictionary from "
+              << "destinations to the names that they give the topic"
+              << std::endl;
+    return false;
   }
 
-  if(m_middlewares.size() < 2)
+  for(const auto& entry : node)
   {
-    std::cerr << "The config-file [" << file << "] does not specify enough "
-              << "middlewares [" << m_middlewares.size() << "]! The "
-              << "minimum is 2." << std::endl;
+    targets[entry.first.as<std::string>()] =
+        entry.second.as<std::string>();
+  }
+
+  return true;
+}
+
+//==============================================================================
+/// Parse the [dispatch] of a topic, e.g.
+///
+///   dispatch:
+///     field: robot_id
+///     cases:
+///       robot_1: { ros2: /robot_1/status }
+///       robot_2: { ros2: /robot_2/status }
+///     default: { ros2: /unassigned/status }
+bool parse_topic_dispatch(
+    const std::string& name,
+    const YAML::Node& node,
+    TopicDispatchConfig& dispatch)
+{
+  if(!node.IsMap())
+  {
+    std::cerr << "A [dispatch] field was given for the topic configuration ["
+              << name << "], but it is not a dictionary!" << std::endl;
     return false;
   }
 
-  auto read_route = [&](const std::string& key, const YAML::Node& n) -> bool
+  const YAML::Node& field = node["field"];
+  if(!field || !field.IsScalar())
   {
-    return add_named_route(key, n, m_topic_routes, m_service_routes);
-  };
-  if(!read_dictionary(config_node, "routes", file, read_route))
+    std::cerr << "The [dispatch] of the topic configuration [" << name << "] "
+              << "must name the [field] to dispatch on" << std::endl;
     return false;
+  }
 
-  auto read_topic = [&](const std::string& key, const YAML::Node& n) -> bool
+  dispatch.field = field.as<std::string>();
+  if(!is_field_path(dispatch.field))
   {
-    return add_topic_config(key, n, m_topic_routes, m_topic_configs);
-  };
-  if(!read_dictionary(config_node, "topics", file, read_topic))
+    std::cerr << "The topic configuration [" << name << "] dispatches on the "
+              << "field [" << dispatch.field << "], which is not a valid field "
+              << "name. Nested fields are named like [header.frame_id]"
+              << std::endl;
     return false;
+  }
 
-  auto read_service = [&](const std::string& key, const YAML::Node& n) -> bool
+  const YAML::Node& cases = node["cases"];
+  if(!cases || !cases.IsMap() || cases.size() == 0)
   {
-    return add_service_config(key, n, m_service_routes, m_service_configs);
-  };
-  if(!read_dictionary(config_node, "services", file, read_service))
+    std::cerr << "The [dispatch] of the topic configuration [" << name << "] "
+              << "must have a dictionary of [cases] from the values of the "
+              << "field [" << dispatch.field << "] to their destinations"
+              << std::endl;
     return false;
+  }
 
-  for(const auto& entry : m_topic_configs)
+  for(const auto& entry : cases)
   {
-    const TopicConfig& config = entry.second;
-    const std::set<std::string>& middlewares = config.route.all();
-    for(const std::string& mw : middlewares)
-    {
-      if(m_middlewares.find(mw) == m_middlewares.end())
-      {
-        std::cerr << "Unrecognized system [" << mw << "] requested for topic ["
-                  << entry.first << "]" << std::endl;
-        return false;
-      }
-      m_required_types[mw].messages.insert(config.message_type);
-    }
+    const std::string value = entry.first.as<std::string>();
+    if(!parse_dispatch_targets(
+         name, value, entry.second, dispatch.cases[value]))
+      return false;
   }
 
-  for(const auto& entry : m_service_configs)
+  if(const YAML::Node& fallback = node["default"])
   {
-    const ServiceConfig& config = entry.second;
+    if(!parse_dispatch_targets(name, "default", fallback, dispatch.fallback))
+      return false;
+  }
+
+  return true;
+}
+
+//==============================================================================
+bool add_topic_config(
+    const std::string& name,
+    const YAML::Node& node,
+    const std::map<std::string, TopicRoute>& topic_routes,
+    std::map<std::string, TopicConfig>& topic_configs)
+{
+  TopicQueueConfig queue;
+  const YAML::Node& queue_node = node["queue"];
+  if(queue_node && !parse_topic_queue(name, queue_node, queue))
+    return false;
+
+  std::map<std::string, TopicThrottleConfig> throttles;
+  if(!parse_topic_throttles(name, node, throttles))
+    return false;
+
+  std::map<std::string, std::vector<std::string>> projections;
+  const YAML::Node& fields_node = node["fields"];
+  if(fields_node && !parse_topic_projections(name, fields_node, projections))
+    return false;
+
+  TopicDispatchConfig dispatch;
+  const YAML::Node& dispatch_node = node["dispatch"];
+  if(dispatch_node && !parse_topic_dispatch(name, dispatch_node, dispatch))
+    return false;
+
+  TopicOnChangeConfig on_change;
+  const YAML::Node& on_change_node = node["on_change"];
+  if(on_change_node && !parse_topic_on_change(name, on_change_node, on_change))
+    return false;
+
+  return add_topic_or_service_config<TopicConfig, TopicRoute>(
+        "topic", name, node, topic_routes, topic_configs,
+        [&](TopicConfig& c, std::string s)
+        {
+          c.message_type = std::move(s);
+          c.queue = queue;
+          c.throttles = throttles;
+          c.projections = projections;
+          c.dispatch = dispatch;
+          c.on_change = on_change;
+        },
+        [](TopicConfig& c, TopicRoute r){ c.route = std::move(r); },
+        [](const YAML::Node& node){ return parse_topic_route(node); });
+}
+
+//==============================================================================
+bool parse_service_cache(
+    const std::string& name,
+    const YAML::Node& node,
+    ServiceCacheConfig& cache)
+{
+  if(!node.IsMap())
+  {
+    std::cerr << "A [cache] field was given for the service configuration ["
+              << name << "], but it is not a dictionary!" << std::endl;
+    return false;
+  }
+
+  cache.size = 64;
+  if(const YAML::Node& size = node["size"])
+  {
+    const int value = size.as<int>();
+    if(value < 1)
+    {
+      std::cerr << "The cache [size] of the service configuration [" << name
+                << "] must be at least 1, but it is [" << value << "]"
+                << std::endl;
+      return false;
+    }
+
+    cache.size = static_cast<std::size_t>(value);
+  }
+
+  if(const YAML::Node& ttl = node["ttl"])
+  {
+    const double seconds = ttl.as<double>();
+    if(seconds <= 0.0)
+    {
+      std::cerr << "The cache [ttl] of the service configuration [" << name
+                << "] must be positive, but it is [" << seconds << "]"
+                << std::endl;
+      return false;
+    }
+
+    cache.ttl = std::chrono::milliseconds(
+          std::max<int64_t>(1, static_cast<int64_t>(seconds*1000.0)));
+  }
+
+  return true;
+}
+
+//==============================================================================
+bool add_service_config(
+    const std::string& name,
+    const YAML::Node& node,
+    const std::map<std::string, ServiceRoute>& service_routes,
+    std::map<std::string, ServiceConfig>& service_configs)
+{
+  std::chrono::milliseconds timeout(0);
+  if(const YAML::Node& timeout_node = node["timeout"])
+  {
+    const double seconds = timeout_node.as<double>();
+    if(seconds < 0.0)
+    {
+      std::cerr << "The [timeout] of the service [" << name << "] must not be "
+                << "negative, but it is [" << seconds << "]" << std::endl;
+      return false;
+    }
+
+    timeout = std::chrono::milliseconds(static_cast<int64_t>(seconds*1000.0));
+  }
+
+  ServiceConfig::Balancing balancing = ServiceConfig::Balancing::RoundRobin;
+  if(const YAML::Node& balancing_node = node["balancing"])
+  {
+    const std::string value = balancing_node.as<std::string>();
+    if(value == "round_robin")
+      balancing = ServiceConfig::Balancing::RoundRobin;
+    else if(value == "least_outstanding")
+      balancing = ServiceConfig::Balancing::LeastOutstanding;
+    else if(value == "latency")
+      balancing = ServiceConfig::Balancing::Latency;
+    else
+    {
+      std::cerr << "The [balancing] of the service [" << name << "] must be "
+                << "[round_robin], [least_outstanding] or [latency], but it is "
+                << "[" << value << "]" << std::endl;
+      return false;
+    }
+  }
+
+  ServiceCacheConfig cache;
+  if(const YAML::Node& cache_node = node["cache"])
+  {
+    if(!parse_service_cache(name, cache_node, cache))
+      return false;
+  }
+
+  return add_topic_or_service_config<ServiceConfig, ServiceRoute>(
+        "service", name, node, service_routes, service_configs,
+        [&](ServiceConfig& c, std::string s)
+        {
+          c.service_type = std::move(s);
+          c.timeout = timeout;
+          c.balancing = balancing;
+          c.cache = cache;
+        },
+        [](ServiceConfig& c, ServiceRoute r){ c.route = std::move(r); },
+        [](const YAML::Node& node){ return parse_service_route(node); });
+}
+
+//==============================================================================
+using ReadDictEntry =
+    std::function<bool(const std::string& key, const YAML::Node& value)>;
+
+bool read_dictionary(
+    const YAML::Node& config_node,
+    const std::string& field_name,
+    const std::string& filename,
+    const ReadDictEntry& read_fcn)
+{
+  const YAML::Node& field = config_node[field_name];
+  if(field)
+  {
+    if(!field.IsMap())
+    {
+      std::cerr << "The config file [" << filename << "] has a [" << field_name
+                << "] field, but it is not pointing to a dictionary of "
+                // We use this to make the field name singular
+                << field_name.substr(0, field_name.size()-1)
+                << "configurations!" << std::endl;
+      return false;
+    }
+
+    bool configs_okay = true;
+    for(YAML::const_iterator it = field.begin(); it != field.end(); ++it)
+    {
+      configs_okay &= read_fcn(it->first.as<std::string>(), it->second);
+    }
+
+    if(!configs_okay)
+    {
+      std::cerr << "Error found in an entry of the [" << field_name
+                << "] dictionary of the config-file [" << filename << "]"
+                << std::endl;
+      return false;
+    }
+  }
+
+  return true;
+}
+
+//==============================================================================
+bool parse_metrics(
+    const YAML::Node& node,
+    const std::string& filename,
+    MetricsConfig& metrics)
+{
+  if(!node.IsMap())
+  {
+    std::cerr << "The config-file [" << filename << "] has a [metrics] field, "
+              << "but it is not a dictionary!" << std::endl;
+    return false;
+  }
+
+  const YAML::Node& file = node["file"];
+  if(!file || !file.IsScalar() || file.as<std::string>().empty())
+  {
+    std::cerr << "The [metrics] of the config-file [" << filename << "] must "
+              << "name the [file] that they should be written to!"
+              << std::endl;
+    return false;
+  }
+
+  metrics.file = file.as<std::string>();
+
+  const YAML::Node& period = node["period"];
+  if(period)
+  {
+    const double seconds = period.as<double>();
+    if(seconds <= 0.0)
+    {
+      std::cerr << "The metrics [period] of the config-file [" << filename
+                << "] must be positive, but it is [" << seconds << "]"
+                << std::endl;
+      return false;
+    }
+
+    metrics.period = std::chrono::milliseconds(
+          static_cast<int64_t>(seconds*1000.0));
+  }
+
+  return true;
+}
+
+//==============================================================================
+bool parse_memory(
+    const YAML::Node& node,
+    const std::string& filename,
+    MemoryConfig& memory)
+{
+  if(!node.IsMap())
+  {
+    std::cerr << "The config-file [" << filename << "] has a [memory] field, "
+              << "but it is not a dictionary!" << std::endl;
+    return false;
+  }
+
+  const YAML::Node& budget = node["budget"];
+  if(budget && !parse_memory_size(
+       "memory [budget] of the config-file [" + filename + "]",
+       budget, memory.budget))
+    return false;
+
+  return true;
+}
+
+//==============================================================================
+bool parse_watchdog(
+    const YAML::Node& node,
+    const std::string& filename,
+    WatchdogConfig& watchdog)
+{
+  if(node.IsScalar())
+  {
+    watchdog.enabled = node.as<bool>();
+    return true;
+  }
+
+  if(!node.IsMap())
+  {
+    std::cerr << "The config-file [" << filename << "] has a [watchdog] "
+              << "field, but it is neither true, false, nor a dictionary!"
+              << std::endl;
+    return false;
+  }
+
+  watchdog.enabled = true;
+
+  const YAML::Node& threshold = node["stall_threshold"];
+  if(threshold)
+  {
+    const double seconds = threshold.as<double>();
+    if(seconds <= 0.0)
+    {
+      std::cerr << "The watchdog [stall_threshold] of the config-file ["
+                << filename << "] must be positive, but it is [" << seconds
+                << "]" << std::endl;
+      return false;
+    }
+
+    watchdog.stall_threshold = std::chrono::nanoseconds(
+          static_cast<int64_t>(seconds*1e9));
+  }
+
+  const YAML::Node& routes = node["routes"];
+  if(routes)
+    watchdog.routes = routes.as<bool>();
+
+  return true;
+}
+
+//==============================================================================
+bool parse_executor(
+    const YAML::Node& node,
+    const std::string& filename,
+    ExecutorConfig& executor)
+{
+  executor.definition = YAML::Dump(node);
+
+  if(node.IsScalar())
+  {
+    executor.enabled = node.as<bool>();
+    return true;
+  }
+
+  if(!node.IsMap())
+  {
+    std::cerr << "The config-file [" << filename << "] has an [executor] "
+              << "field, but it is neither true, false, nor a dictionary!"
+              << std::endl;
+    return false;
+  }
+
+  executor.enabled = true;
+
+  const YAML::Node& threads = node["threads"];
+  if(threads)
+  {
+    const int count = threads.as<int>();
+    if(count < 0)
+    {
+      std::cerr << "The executor [threads] of the config-file [" << filename
+                << "] must not be negative, but it is [" << count << "]"
+                << std::endl;
+      return false;
+    }
+
+    executor.threads = static_cast<std::size_t>(count);
+  }
+
+  return executor.thread.parse(node[YamlThreadKey], "executor");
+}
+
+//==============================================================================
+YAML::Node config_or_empty_node(
+    const std::string& key,
+    const std::map<std::string, YAML::Node>& map)
+{
+  const auto it = map.find(key);
+  if(it == map.end())
+    return YAML::Node();
+
+  return it->second;
+}
+
+//==============================================================================
+/// Sits between a ServiceProvider and the ServiceClients that it is answering
+/// so that the latency of every service call gets measured, and so that calls
+/// which take longer than the timeout of the service fail.
+class TimedServiceClient
+    : public ServiceClient,
+      public std::enable_shared_from_this<TimedServiceClient>
+{
+public:
+
+  using Clock = std::chrono::steady_clock;
+
+  TimedServiceClient(
+      const std::string& service,
+      ChannelMetrics& metrics,
+      std::shared_ptr<ServiceProvider> provider,
+      const std::chrono::milliseconds timeout)
+    : _service(service),
+      _metrics(metrics),
+      _provider(std::move(provider)),
+      _timeout(timeout),
+      _outstanding(0),
+      _average_latency_ns(0)
+  {
+    // Do nothing
+  }
+
+  /// The number of calls that are still waiting for their response
+  std::size_t outstanding() const { return _outstanding; }
+
+  /// A moving average of how long the provider has been taking to respond,
+  /// or zero if it has not responded yet
+  std::chrono::nanoseconds average_latency() const
+  {
+    return std::chrono::nanoseconds(_average_latency_ns.load());
+  }
+
+  /// Pass a request from a client on to the provider
+  void call(
+      const soss::Message& request,
+      ServiceClient& client,
+      const std::shared_ptr<void>& call_handle)
+  {
+    _metrics.count_message();
+    ++_outstanding;
+    const auto call = std::make_shared<Call>(client, call_handle);
+
+    if(_timeout.count() > 0)
+    {
+      // The timer keeps the call alive, so that the client hears about the
+      // failure even if the provider has let go of the call.
+      const std::weak_ptr<TimedServiceClient> weak_self = shared_from_this();
+      call->timer = TimerWheel::shared().schedule(
+            _timeout, [weak_self, call]()
+      {
+        if(const auto self = weak_self.lock())
+          self->_time_out(call);
+      });
+    }
+
+    SOSS_TRACE(service_call, _service.c_str(), call.get());
+    _provider->call_service(request, *this, call);
+  }
+
+  void receive_response(
+      std::shared_ptr<void> call_handle,
+      const soss::Message& response) override
+  {
+    Call& call = *std::static_pointer_cast<Call>(call_handle);
+
+    // The client has already been told that this call failed
+    if(call.finished.exchange(true))
+      return;
+
+    if(call.timer)
+      TimerWheel::shared().cancel(call.timer);
+
+    SOSS_TRACE(service_response, _service.c_str(), &call, 1);
+    const auto latency = Clock::now() - call.sent;
+    _metrics.record_latency(latency);
+    _finish(latency);
+    call.client.receive_response(call.handle, response);
+  }
+
+  void receive_error(
+      std::shared_ptr<void> call_handle,
+      const std::string& error) override
+  {
+    Call& call = *std::static_pointer_cast<Call>(call_handle);
+    if(call.finished.exchange(true))
+      return;
+
+    if(call.timer)
+      TimerWheel::shared().cancel(call.timer);
+
+    SOSS_TRACE(service_response, _service.c_str(), &call, 0);
+    _metrics.count_drop();
+    _finish(Clock::now() - call.sent);
+    call.client.receive_error(call.handle, error);
+  }
+
+private:
+
+  struct Call
+  {
+    Call(ServiceClient& client_, std::shared_ptr<void> handle_)
+      : client(client_),
+        handle(std::move(handle_)),
+        sent(Clock::now()),
+        finished(false)
+    {
+      // Do nothing
+    }
+
+    ServiceClient& client;
+    std::shared_ptr<void> handle;
+    Clock::time_point sent;
+    std::atomic_bool finished;
+    TimerWheel::TimerId timer = 0;
+  };
+
+  void _time_out(const std::shared_ptr<Call>& call)
+  {
+    if(call->finished.exchange(true))
+      return;
+
+    SOSS_TRACE(service_response, _service.c_str(), call.get(), 0);
+    _metrics.count_drop();
+    _finish(Clock::now() - call->sent);
+    call->client.receive_error(
+          call->handle,
+          "the service provider did not respond within "
+          + std::to_string(_timeout.count()) + "ms");
+
+    _provider->cancel_service_call(call);
+  }
+
+  /// Update the statistics of the provider once a call has finished. Calls
+  /// that fail count towards the latency too, so that a provider which stops
+  /// answering will be avoided.
+  void _finish(const Clock::duration elapsed)
+  {
+    --_outstanding;
+
+    // An exponential moving average that gives each new sample a weight of 1/8.
+    // Concurrent updates may lose a sample, which is fine for an estimate.
+    const int64_t sample =
+        std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+    const int64_t previous = _average_latency_ns.load();
+    _average_latency_ns =
+        previous == 0? sample : previous + (sample - previous)/8;
+  }
+
+  const std::string _service;
+  ChannelMetrics& _metrics;
+  const std::shared_ptr<ServiceProvider> _provider;
+  const std::chrono::milliseconds _timeout;
+  std::atomic_size_t _outstanding;
+  std::atomic<int64_t> _average_latency_ns;
+
+};
+
+//==============================================================================
+/// Chooses which of the servers of a service should receive each request
+class ServiceBalancer
+{
+public:
+
+  using Servers = std::vector<std::shared_ptr<TimedServiceClient>>;
+
+  ServiceBalancer(Servers servers, const ServiceConfig::Balancing balancing)
+    : _servers(std::move(servers)),
+      _balancing(balancing),
+      _next(0)
+  {
+    // Do nothing
+  }
+
+  TimedServiceClient& choose()
+  {
+    // Every choice starts looking at a different server, so that ties are
+    // shared out evenly.
+    const std::size_t start = _next++;
+    const std::size_t count = _servers.size();
+    if(count == 1 || _balancing == ServiceConfig::Balancing::RoundRobin)
+      return *_servers[start % count];
+
+    const double prior = _prior();
+    std::size_t best = start % count;
+    double best_score = _score(*_servers[best], prior);
+    for(std::size_t i=1; i < count; ++i)
+    {
+      const std::size_t index = (start + i) % count;
+      const double score = _score(*_servers[index], prior);
+      if(score < best_score)
+      {
+        best = index;
+        best_score = score;
+      }
+    }
+
+    return *_servers[best];
+  }
+
+private:
+
+  /// The latency to expect from a server that has not answered anything yet:
+  /// the average of the servers that have. Until any of them has answered,
+  /// the latency mode picks by the number of unanswered requests alone.
+  double _prior() const
+  {
+    if(_balancing != ServiceConfig::Balancing::Latency)
+      return 0.0;
+
+    double total = 0.0;
+    std::size_t answered = 0;
+    for(const auto& server : _servers)
+    {
+      const auto latency = server->average_latency().count();
+      if(latency > 0)
+      {
+        total += static_cast<double>(latency);
+        ++answered;
+      }
+    }
+
+    return answered == 0? 1.0 : total/static_cast<double>(answered);
+  }
+
+  double _score(const TimedServiceClient& server, const double prior) const
+  {
+    const double outstanding = static_cast<double>(server.outstanding());
+    if(_balancing == ServiceConfig::Balancing::LeastOutstanding)
+      return outstanding;
+
+    // The time that a new request can expect to wait. A server that has not
+    // answered yet still counts the requests that it is sitting on, so that
+    // a server which never answers does not get every request.
+    const auto latency = server.average_latency().count();
+    return (latency > 0? static_cast<double>(latency) : prior)
+        * (outstanding + 1.0);
+  }
+
+  const Servers _servers;
+  const ServiceConfig::Balancing _balancing;
+  std::atomic_size_t _next;
+
+};
+
+//==============================================================================
+std::string remap_if_needed(
+    const std::string& middleware,
+    const std::map<std::string, std::string>& remap,
+    const std::string& original)
+{
+  const auto it = remap.find(middleware);
+  if(it == remap.end())
+    return original;
+
+  return it->second;
+}
+
+//==============================================================================
+/// Find and load the extension of a middleware type, which registers its
+/// system handle.
+bool load_middleware_mix(const std::string& middleware_type)
+{
+  const auto start = std::chrono::steady_clock::now();
+  const Search::Implementation search(middleware_type);
+
+  std::vector<std::string> checked_paths;
+  const std::string path = search.find_middleware_mix(checked_paths);
+  if(path.empty())
+  {
+    std::string message =
+        "Unable to find .mix file for middleware [" + middleware_type + "].\n"
+        "The following locations were checked unsucessfully: ";
+    for(const std::string& checked : checked_paths)
+      message += "\n - " + checked;
+
+    message +=
+        "\nTry adding your middleware's install path to SOSS_PREFIX_PATH "
+        "or SOSS_" + to_env_format(middleware_type) + "_PREFIX_PATH "
+        "environment variables.";
+
+    std::cerr << message << std::endl;
+    return false;
+  }
+
+  const bool loaded = Mix::from_file(path).load();
+  Metrics::record_startup(
+        "load_mix", middleware_type, std::chrono::steady_clock::now() - start);
+
+  return loaded;
+}
+
+//==============================================================================
+/// Find the setting that a topic has for one of its destinations. Settings
+/// under an empty name apply to every destination without its own setting.
+template<typename Setting>
+const Setting* find_for_destination(
+    const std::string& destination,
+    const std::map<std::string, Setting>& settings)
+{
+  auto it = settings.find(destination);
+  if(it == settings.end())
+    it = settings.find(std::string());
+
+  if(it == settings.end())
+    return nullptr;
+
+  return &it->second;
+}
+
+//==============================================================================
+template<typename Setting>
+bool check_destinations(
+    const std::string& topic_name,
+    const std::string& action,
+    const TopicRoute& route,
+    const std::map<std::string, Setting>& settings)
+{
+  bool valid = true;
+  for(const auto& setting : settings)
+  {
+    if(!setting.first.empty() && route.to.count(setting.first) == 0)
+    {
+      std::cerr << "The topic [" << topic_name << "] " << action << " the "
+                << "destination [" << setting.first << "], but it is not one "
+                << "of the destinations of the topic" << std::endl;
+      valid = false;
+    }
+  }
+
+  return valid;
+}
+
+//==============================================================================
+bool same_middlewares(
+    const std::map<std::string, MiddlewareConfig>& a,
+    const std::map<std::string, MiddlewareConfig>& b)
+{
+  if(a.size() != b.size())
+    return false;
+
+  for(auto ita = a.begin(), itb = b.begin(); ita != a.end(); ++ita, ++itb)
+  {
+    if(ita->first != itb->first
+       || ita->second.type != itb->second.type
+       || YAML::Dump(ita->second.config_node)
+          != YAML::Dump(itb->second.config_node))
+      return false;
+  }
+
+  return true;
+}
+
+//==============================================================================
+// Named routes get resolved while parsing, so a topic or service can also be
+// changed by a change to the route that it names.
+bool same_channel(const TopicConfig& a, const TopicConfig& b)
+{
+  return a.definition == b.definition
+      && a.route.from == b.route.from
+      && a.route.to == b.route.to;
+}
+
+//==============================================================================
+bool same_channel(const ServiceConfig& a, const ServiceConfig& b)
+{
+  return a.definition == b.definition
+      && a.route.servers == b.route.servers
+      && a.route.clients == b.route.clients;
+}
+
+//==============================================================================
+/// The key of a topic or service in the RouteTable. A topic and a service may
+/// have the same name, so each kind of channel gets keys of its own.
+std::string channel_key(
+    const std::string& channel_type,
+    const std::string& name)
+{
+  return channel_type + ":" + name;
+}
+
+//==============================================================================
+template<typename ChannelConfig, typename Configure>
+bool reconfigure_channels(
+    const std::string& channel_type,
+    const std::map<std::string, ChannelConfig>& previous,
+    std::map<std::string, ChannelConfig>& current,
+    RouteTable& table,
+    Configure configure)
+{
+  for(const auto& entry : previous)
+  {
+    if(current.count(entry.first) == 0)
+    {
+      std::cout << "Removing the " << channel_type << " [" << entry.first
+                << "]" << std::endl;
+      table.remove(channel_key(channel_type, entry.first));
+    }
+  }
+
+  bool valid = true;
+  for(auto it = current.begin(); it != current.end();)
+  {
+    const auto pit = previous.find(it->first);
+    if(pit != previous.end() && same_channel(pit->second, it->second))
+    {
+      ++it;
+      continue;
+    }
+
+    std::cout << (pit == previous.end()? "Adding" : "Updating") << " the "
+              << channel_type << " [" << it->first << "]" << std::endl;
+    if(configure(it->first, it->second))
+    {
+      ++it;
+      continue;
+    }
+
+    std::cerr << "Failed to configure the " << channel_type << " ["
+              << it->first << "], so it has been left out" << std::endl;
+    table.remove(channel_key(channel_type, it->first));
+    it = current.erase(it);
+    valid = false;
+  }
+
+  return valid;
+}
+
+} // anonymous namespace
+
+//==============================================================================
+Config::Config(const YAML::Node& node, const std::string& filename)
+{
+  if(node && !node.IsNull())
+    parse(node, filename);
+}
+
+//==============================================================================
+Config Config::from_file(const std::string& file)
+{
+  YAML::Node config_node;
+  try
+  {
+    config_node = YAML::LoadFile(file);
+  }
+  catch(const std::exception& e)
+  {
+    std::cerr << "Could not parse the config-file named [" << file
+              << "]: " << e.what() << std::endl;
+    return Config();
+  }
+
+  if(!config_node)
+  {
+    std::cerr << "Could not parse the config-file [" << file
+              << "]" << std::endl;
+    return Config();
+  }
+
+  return Config(config_node, file);
+}
+
+//==============================================================================
+bool Config::parse(const YAML::Node& config_node, const std::string& file)
+{
+  _okay = false;
+
+  if(!config_node.IsMap())
+  {
+    std::cerr << "The config-file [" << file << "] needs to be a map "
+              << "containing [systems], and possibly [routes], [topics], "
+              << "and/or [services]!" << std::endl;
+    return false;
+  }
+
+  const YAML::Node& systems = config_node["systems"];
+  if(!systems || !systems.IsMap())
+  {
+    std::cerr << "The config-file [" << file << "] is missing a "
+              << "dictionary for [systems]! You must specify at least two "
+              << "systems in your config-file." << std::endl;
+    return false;
+  }
+
+  for(YAML::const_iterator it = systems.begin(); it != systems.end(); ++it)
+  {
+    const std::string middleware_alias = it->first.as<std::string>();
+
+    const YAML::Node& config = it->second;
+
+    const YAML::Node& type_node = config["type"];
+    const std::string middleware = type_node?
+          type_node.as<std::string>() : middleware_alias;
+
+    ThreadSettings thread;
+    if(!thread.parse(
+         config[YamlThreadKey], "system [" + middleware_alias + "]"))
+      return false;
+
+    const YAML::Node& shared_node = config["shared"];
+    const bool shared = shared_node && shared_node.as<bool>();
+
+    m_middlewares.insert(
+          std::make_pair(
+            middleware_alias,
+            MiddlewareConfig{middleware, config, thread, shared}));
+  }
+
+  if(m_middlewares.size() < 2)
+  {
+    std::cerr << "The config-file [" << file << "] does not specify enough "
+              << "middlewares [" << m_middlewares.size() << "]! The "
+              << "minimum is 2." << std::endl;
+    return false;
+  }
+
+  auto read_route = [&](const std::string& key, const YAML::Node& n) -> bool
+  {
+    return add_named_route(key, n, m_topic_routes, m_service_routes);
+  };
+  if(!read_dictionary(config_node, "routes", file, read_route))
+    return false;
+
+  auto read_topic = [&](const std::string& key, const YAML::Node& n) -> bool
+  {
+    return add_topic_config(key, n, m_topic_routes, m_topic_configs);
+  };
+  if(!read_dictionary(config_node, "topics", file, read_topic))
+    return false;
+
+  auto read_service = [&](const std::string& key, const YAML::Node& n) -> bool
+  {
+    return add_service_config(key, n, m_service_routes, m_service_configs);
+  };
+  if(!read_dictionary(config_node, "services", file, read_service))
+    return false;
+
+  const YAML::Node& metrics = config_node["metrics"];
+  if(metrics && !parse_metrics(metrics, file, m_metrics))
+    return false;
+
+  const YAML::Node& executor = config_node["executor"];
+  if(executor && !parse_executor(executor, file, m_executor))
+    return false;
+
+  const YAML::Node& memory = config_node["memory"];
+  if(memory && !parse_memory(memory, file, m_memory))
+    return false;
+
+  const YAML::Node& watchdog = config_node["watchdog"];
+  if(watchdog && !parse_watchdog(watchdog, file, m_watchdog))
+    return false;
+
+  for(const auto& entry : m_topic_configs)
+  {
+    const TopicConfig& config = entry.second;
+    const std::set<std::string>& middlewares = config.route.all();
+    for(const std::string& mw : middlewares)
+    {
+      if(m_middlewares.find(mw) == m_middlewares.end())
+      {
+        std::cerr << "Unrecognized system [" << mw << "] requested for topic ["
+                  << entry.first << "]" << std::endl;
+        return false;
+      }
+      m_required_types[mw].messages.insert(config.message_type);
+    }
+  }
+
+  for(const auto& entry : m_service_configs)
+  {
+    const ServiceConfig& config = entry.second;
     const std::set<std::string>& middlewares = config.route.all();
     for(const std::string& mw : middlewares)
     {
@@ -532,154 +1671,516 @@ bool Config::parse(const YAML::Node& config_node, const std::string& file)
 //==============================================================================
 bool Config::load_middlewares(SystemHandleInfoMap& info_map) const
 {
+  using Clock = std::chrono::steady_clock;
+  const auto start = Clock::now();
+
+  // Each middleware type only needs its extension to be loaded once, however
+  // many systems use it. The systems of a type get configured as soon as their
+  // extension is ready, alongside the systems of every other middleware.
+  std::map<std::string, std::shared_future<bool>> extensions;
+  for(const auto& mw_entry : m_middlewares)
+  {
+    const std::string& middleware_type = mw_entry.second.type;
+    if(extensions.count(middleware_type) > 0)
+      continue;
+
+    extensions[middleware_type] = std::async(
+          std::launch::async, &load_middleware_mix, middleware_type).share();
+  }
+
+  std::vector<std::pair<std::string, std::future<SystemHandleInfo>>> systems;
   for(const auto& mw_entry : m_middlewares)
   {
     const std::string& mw_name = mw_entry.first;
     const MiddlewareConfig& mw_config = mw_entry.second;
-    const std::string& middleware_type = mw_config.type;
+    const std::shared_future<bool> extension = extensions.at(mw_config.type);
 
-    const Search::Implementation search(mw_config.type);
+    const RequiredTypes* requirements = nullptr;
+    const auto it = m_required_types.find(mw_name);
+    if(it != m_required_types.end())
+      requirements = &it->second;
 
-    std::vector<std::string> checked_paths;
-    const std::string path = search.find_middleware_mix(checked_paths);
-    if(path.empty())
+    systems.emplace_back(mw_name, std::async(std::launch::async, [=]()
     {
-      std::string message =
-          "Unable to find .mix file for middleware [" + middleware_type + "].\n"
-          "The following locations were checked unsucessfully: ";
-      for(const std::string& checked : checked_paths)
-        message += "\n - " + checked;
+      if(!extension.get())
+        return SystemHandleInfo(nullptr);
 
-      message +=
-          "\nTry adding your middleware's install path to SOSS_PREFIX_PATH "
-          "or SOSS_" + to_env_format(middleware_type) + "_PREFIX_PATH "
-          "environment variables.";
-
-      std::cerr << message << std::endl;
-      return false;
-    }
+      // A shared system only gets created and configured by the first instance
+      // that asks for it. The others get a proxy to the same system handle.
+      if(mw_config.shared && requirements)
+      {
+        const auto configure_start = Clock::now();
+        SystemHandleInfo shared = SharedSystems::attach(
+              mw_name, mw_config.type, *requirements, mw_config.config_node,
+              mw_config.thread, [=]()
+        {
+          return internal::Register::get(mw_config.type);
+        });
+        Metrics::record_startup(
+              "configure", mw_name, Clock::now() - configure_start);
+
+        if(!shared)
+        {
+          std::cerr << "Failed to configure the shared middleware [" << mw_name
+                    << "] of type [" << mw_config.type << "]" << std::endl;
+        }
+
+        return shared;
+      }
 
-    if(!Mix::from_file(path).load())
-      return false;
+      // After loading the mix file, the middleware's plugin library should be
+      // loaded, and it should be possible to find the middleware info in the
+      // internal Register.
+      SystemHandleInfo info = internal::Register::get(mw_config.type);
+      if(!info || !requirements)
+        return info;
 
-    // After loading the mix file, the middleware's plugin library should be
-    // loaded, and it should be possible to find the middleware info in the
-    // internal Register.
-    internal::SystemHandleInfo info = internal::Register::get(middleware_type);
+      const auto configure_start = Clock::now();
+      const bool configured =
+          info.handle->configure(*requirements, mw_config.config_node);
+      Metrics::record_startup(
+            "configure", mw_name, Clock::now() - configure_start);
 
-    if(!info)
-      return false;
+      if(!configured)
+      {
+        std::cerr << "Failed to configure the middleware [" << mw_name
+                  << "] of type [" << mw_config.type << "]" << std::endl;
+        return SystemHandleInfo(nullptr);
+      }
 
-    bool configured = true;
-    const auto requirements = m_required_types.find(mw_name);
-    if(requirements != m_required_types.end())
-      configured &=
-          info.handle->configure(requirements->second, mw_config.config_node);
+      return info;
+    }));
+  }
 
-    if(!configured)
-      return false;
+  // Wait for every system, even after a failure, so that none of them are
+  // still being configured when we return
+  bool success = true;
+  for(auto& system : systems)
+  {
+    SystemHandleInfo info = system.second.get();
+    if(!info)
+    {
+      success = false;
+      continue;
+    }
 
-    info_map.insert(std::make_pair(mw_name, std::move(info)));
+    info_map.insert(std::make_pair(system.first, std::move(info)));
   }
 
-  return true;
+  Metrics::record_startup("load_middlewares", "", Clock::now() - start);
+  return success;
 }
 
 //==============================================================================
-bool Config::configure_topics(const SystemHandleInfoMap& info_map) const
+bool Config::configure_topics(
+    const SystemHandleInfoMap& info_map,
+    RouteTable& table) const
 {
   bool valid = true;
   for(const auto& entry : m_topic_configs)
+    valid &= _configure_topic(entry.first, entry.second, info_map, table);
+
+  return valid;
+}
+
+//==============================================================================
+bool Config::_configure_topic(
+    const std::string& topic_name,
+    const TopicConfig& config,
+    const SystemHandleInfoMap& info_map,
+    RouteTable& table) const
+{
+  // Whatever this topic had from an earlier configuration keeps running until
+  // the new routes are in place
+  const std::string channel = channel_key("topic", topic_name);
+  table.begin(channel);
+
+  bool valid = true;
+
+  // Routes into each destination only get measured while the metrics are
+  // exported, so otherwise the publishers do not need to read the clock.
+  const bool trace_routes = !m_metrics.file.empty();
+  std::vector<ChannelMetrics*> routes;
+
+  // The tracepoints get handed pointers to the names, so the routes keep their
+  // own copies alive, since a route may outlive the Config that made it.
+  const auto names = std::make_shared<std::deque<std::string>>();
+  names->push_back(topic_name);
+  const char* const topic = names->back().c_str();
+  std::vector<const char*> destinations;
+
+  // Get the publisher of a destination, wrapped in whatever only applies to
+  // that destination
+  const auto make_publisher = [&](
+      const std::string& to,
+      const std::string& name) -> std::shared_ptr<TopicPublisher>
   {
-    const std::string& topic_name = entry.first;
-    const TopicConfig& config = entry.second;
+    const auto it = info_map.find(to);
+    if(it == info_map.end() || !it->second.topic_publisher)
+    {
+      std::cerr << "Could not find topic publishing capabilities for system "
+                << "named [" << to << "], requested for topic ["
+                << topic_name << "]" <<  std::endl;
+      return nullptr;
+    }
 
-    std::vector<std::shared_ptr<TopicPublisher>> publishers;
+    std::shared_ptr<TopicPublisher> publisher = table.advertise(
+          channel, to, *it->second.topic_publisher, name,
+          config.message_type,
+          config_or_empty_node(to, config.middleware_configs));
+
+    if(!publisher)
+    {
+      std::cerr << "The system [" << to << "] failed to produce a publisher "
+                << "for the topic [" << name << "] and message type ["
+                << config.message_type << "]" << std::endl;
+      return nullptr;
+    }
+
+    const std::vector<std::string>* const fields =
+        find_for_destination(to, config.projections);
+    if(fields)
+      publisher = std::make_shared<ProjectedPublisher>(publisher, *fields);
+
+    // Throttled messages get dropped here, before the publisher spends
+    // any time converting them for its middleware.
+    const TopicThrottleConfig* const throttle =
+        find_for_destination(to, config.throttles);
+    if(throttle && throttle->enabled())
+      publisher = std::make_shared<ThrottledPublisher>(publisher, *throttle);
+
+    return publisher;
+  };
+
+  std::vector<std::shared_ptr<TopicPublisher>> publishers;
+  if(config.dispatch.enabled())
+  {
+    // The cases may share destinations, so each destination only gets one
+    // publisher (and one throttle) per name.
+    std::map<std::pair<std::string, std::string>,
+        std::shared_ptr<TopicPublisher>> advertised;
+    const auto make_publishers = [&](
+        const TopicDispatchConfig::Targets& targets)
+    {
+      DispatchPublisher::Publishers case_publishers;
+      for(const auto& target : targets)
+      {
+        if(config.route.to.count(target.first) == 0)
+        {
+          std::cerr << "The topic [" << topic_name << "] dispatches messages "
+                    << "to [" << target.first << "], but it is not one of the "
+                    << "destinations of the topic" << std::endl;
+          valid = false;
+          continue;
+        }
+
+        auto& publisher = advertised[target];
+        if(!publisher)
+          publisher = make_publisher(target.first, target.second);
+
+        if(publisher)
+          case_publishers.push_back(publisher);
+        else
+          valid = false;
+      }
+
+      return case_publishers;
+    };
+
+    std::map<std::string, DispatchPublisher::Publishers> cases;
+    for(const auto& entry : config.dispatch.cases)
+      cases[entry.first] = make_publishers(entry.second);
+
+    publishers.push_back(std::make_shared<DispatchPublisher>(
+          topic_name, config.dispatch.field, std::move(cases),
+          make_publishers(config.dispatch.fallback),
+          Metrics::topic(topic_name)));
+
+    // The destinations of each message depend on its field, so the dispatch
+    // counts as a single destination for the tracepoints
+    names->push_back("dispatch:" + config.dispatch.field);
+    destinations.push_back(names->back().c_str());
+    if(trace_routes)
+      routes.push_back(&Metrics::route(topic_name, names->back()));
+  }
+  else
+  {
     publishers.reserve(config.route.to.size());
     for(const std::string& to : config.route.to)
     {
-      const auto it = info_map.find(to);
-      if(it == info_map.end() || !it->second.topic_publisher)
+      const std::shared_ptr<TopicPublisher> publisher = make_publisher(
+            to, remap_if_needed(to, config.remap, topic_name));
+      if(!publisher)
       {
-        std::cerr << "Could not find topic publishing capabilities for system "
-                  << "named [" << to << "], requested for topic ["
-                  << topic_name << "]" <<  std::endl;
         valid = false;
         continue;
       }
 
-      std::shared_ptr<TopicPublisher> publisher =
-          it->second.topic_publisher->advertise(
-            remap_if_needed(to, config.remap, topic_name),
-            config.message_type,
-            config_or_empty_node(to, config.middleware_configs));
+      publishers.push_back(publisher);
+      names->push_back(to);
+      destinations.push_back(names->back().c_str());
+      if(trace_routes)
+        routes.push_back(&Metrics::route(topic_name, to));
+    }
+  }
+
+  valid &= check_destinations(
+        topic_name, "limits the rate of", config.route, config.throttles);
+  valid &= check_destinations(
+        topic_name, "selects the fields for", config.route,
+        config.projections);
 
-      if(!publisher)
+  if(trace_routes)
+    Ingress::set_enabled(true);
+
+  using Clock = std::chrono::steady_clock;
+  ChannelMetrics* const metrics = &Metrics::topic(topic_name);
+
+  // Records how long a message took from its ingress until the publisher of
+  // a destination was done with it
+  const auto egress = [routes, names, topic, destinations](
+      const std::size_t index,
+      const Message* const message,
+      const Clock::time_point ingress)
+  {
+    SOSS_TRACE(topic_egress, topic, destinations[index], message);
+    if(!routes.empty())
+      routes[index]->record_latency(Clock::now() - ingress);
+  };
+
+  TopicSubscriberSystem::SubscriptionCallback callback;
+  if(publishers.size() == 1)
+  {
+    // The only publisher may take over the contents of the message, as long
+    // as the subscription was done with it.
+    const std::shared_ptr<TopicPublisher> publisher = publishers.front();
+    callback = TopicSubscriberSystem::SubscriptionCallback(
+          [=](const soss::Message& message)
+    {
+      const RouteActivity activity(topic);
+      publisher->publish(message);
+      egress(0, &message,
+             routes.empty()? Clock::time_point() : Ingress::time());
+    },
+          [=](soss::Message&& message)
+    {
+      const RouteActivity activity(topic);
+      publisher->publish_owned(std::move(message));
+      egress(0, &message,
+             routes.empty()? Clock::time_point() : Ingress::time());
+    });
+  }
+  else
+  {
+    // Route the same envelope through every publisher so that they can share
+    // the work of encoding the message with each other.
+    callback = [=](const soss::Message& message)
+    {
+      const RouteActivity activity(topic);
+      const MessageEnvelope envelope(message);
+      const Clock::time_point ingress =
+          routes.empty()? Clock::time_point() : Ingress::time();
+      for(std::size_t i=0; i < publishers.size(); ++i)
       {
-        std::cerr << "The system [" << to << "] failed to produce a publisher "
-                  << "for the topic [" << topic_name << "] and message type ["
-                  << config.message_type << "]" << std::endl;
-        valid = false;
+        publishers[i]->publish_envelope(envelope);
+        egress(i, &message, ingress);
       }
-      else
+    };
+  }
+
+  if(config.queue.enabled())
+  {
+    // Hand the messages to the publishers from the worker of a queue so that
+    // a slow publisher cannot hold up the middleware that is subscribing.
+    TopicQueue::BatchSink sink;
+    if(publishers.size() == 1)
+    {
+      const std::shared_ptr<TopicPublisher> publisher = publishers.front();
+      sink = [publisher, metrics, egress, names, topic](
+          std::vector<TopicQueue::Entry>& batch)
       {
-        publishers.push_back(publisher);
-      }
+        const RouteActivity activity(topic);
+        if(batch.size() == 1)
+        {
+          publisher->publish(*batch.front().message);
+        }
+        else
+        {
+          std::vector<std::shared_ptr<const Message>> messages;
+          messages.reserve(batch.size());
+          for(const TopicQueue::Entry& entry : batch)
+            messages.push_back(entry.message);
+
+          publisher->publish_batch(messages);
+        }
+
+        const Clock::time_point now = Clock::now();
+        for(const TopicQueue::Entry& entry : batch)
+        {
+          metrics->record_latency(now - entry.received);
+          egress(0, entry.message.get(), entry.received);
+        }
+      };
+    }
+    else
+    {
+      sink = [publishers, metrics, egress, names, topic](
+          std::vector<TopicQueue::Entry>& batch)
+      {
+        const RouteActivity activity(topic);
+        for(TopicQueue::Entry& entry : batch)
+        {
+          const MessageEnvelope envelope(std::move(entry.message));
+          for(std::size_t i=0; i < publishers.size(); ++i)
+          {
+            publishers[i]->publish_envelope(envelope);
+            egress(i, &envelope.message(), entry.received);
+          }
+          metrics->record_latency(Clock::now() - entry.received);
+        }
+      };
     }
 
-    TopicSubscriberSystem::SubscriptionCallback callback =
-        [=](const soss::Message& message)
+    const TopicQueuePtr queue = std::make_shared<TopicQueue>(
+          topic_name, config.queue, sink, *metrics, table.executor());
+    table.add_queue(channel, queue);
+
+    callback = TopicSubscriberSystem::SubscriptionCallback(
+          [queue, metrics, names, topic](const soss::Message& message)
     {
-      for(const std::shared_ptr<TopicPublisher>& publisher : publishers)
+      SOSS_TRACE(topic_ingress, topic, &message);
+      metrics->count_message();
+      queue->push(message);
+    },
+          [queue, metrics, names, topic](soss::Message&& message)
+    {
+      SOSS_TRACE(topic_ingress, topic, &message);
+      metrics->count_message();
+      queue->push(std::move(message));
+    });
+  }
+  else
+  {
+    const auto deliver = std::make_shared<
+        const TopicSubscriberSystem::SubscriptionCallback>(
+          std::move(callback));
+
+    callback = TopicSubscriberSystem::SubscriptionCallback(
+          [deliver, metrics, names, topic](const soss::Message& message)
+    {
+      SOSS_TRACE(topic_ingress, topic, &message);
+      metrics->count_message();
+      const Clock::time_point received = Ingress::time();
+      (*deliver)(message);
+      metrics->record_latency(Clock::now() - received);
+    },
+          [deliver, metrics, names, topic](soss::Message&& message)
+    {
+      SOSS_TRACE(topic_ingress, topic, &message);
+      metrics->count_message();
+      const Clock::time_point received = Ingress::time();
+      (*deliver)(std::move(message));
+      metrics->record_latency(Clock::now() - received);
+    });
+  }
+
+  if(config.on_change.enabled)
+  {
+    // Repeated messages get dropped as soon as they arrive, before they take
+    // up room in a queue or get converted by any of the publishers
+    const auto on_change = std::make_shared<TopicOnChange>(config.on_change);
+    const auto deliver = std::make_shared<
+        const TopicSubscriberSystem::SubscriptionCallback>(
+          std::move(callback));
+
+    callback = TopicSubscriberSystem::SubscriptionCallback(
+          [deliver, on_change, metrics](const soss::Message& message)
+    {
+      if(!on_change->admit(message))
       {
-        publisher->publish(message);
+        metrics->count_drop();
+        return;
       }
-    };
 
-    for(const std::string& from : config.route.from)
+      (*deliver)(message);
+    },
+          [deliver, on_change, metrics](soss::Message&& message)
     {
-      const auto it = info_map.find(from);
-      if(it == info_map.end() || !it->second.topic_subscriber)
+      if(!on_change->admit(message))
       {
-        std::cerr << "Could not find topic subscribing capabilities for system "
-                  << "named [" << from << "], requested for topic ["
-                  << topic_name << "]" << std::endl;
-        valid = false;
-        continue;
+        metrics->count_drop();
+        return;
       }
 
-      valid &= it->second.topic_subscriber->subscribe(
-            remap_if_needed(from, config.remap, topic_name),
-            config.message_type, callback,
-            config_or_empty_node(from, config.middleware_configs));
+      (*deliver)(std::move(message));
+    });
+  }
+
+  for(const std::string& from : config.route.from)
+  {
+    const auto it = info_map.find(from);
+    if(it == info_map.end() || !it->second.topic_subscriber)
+    {
+      std::cerr << "Could not find topic subscribing capabilities for system "
+                << "named [" << from << "], requested for topic ["
+                << topic_name << "]" << std::endl;
+      valid = false;
+      continue;
     }
+
+    valid &= table.subscribe(
+          channel, from, *it->second.topic_subscriber,
+          remap_if_needed(from, config.remap, topic_name),
+          config.message_type, callback,
+          config_or_empty_node(from, config.middleware_configs));
   }
 
+  table.finish(channel);
   return valid;
 }
 
 //==============================================================================
-bool Config::configure_services(const SystemHandleInfoMap& info_map) const
+bool Config::configure_services(
+    const SystemHandleInfoMap& info_map,
+    RouteTable& table) const
 {
   bool valid = true;
   for(const auto& entry : m_service_configs)
-  {
-    const std::string& service_name = entry.first;
-    const ServiceConfig& config = entry.second;
+    valid &= _configure_service(entry.first, entry.second, info_map, table);
+
+  return valid;
+}
+
+//==============================================================================
+bool Config::_configure_service(
+    const std::string& service_name,
+    const ServiceConfig& config,
+    const SystemHandleInfoMap& info_map,
+    RouteTable& table) const
+{
+  const std::string channel = channel_key("service", service_name);
+  table.begin(channel);
+
+  bool valid = true;
 
-    const std::string& server = config.route.server;
+  // Requests get routed through a TimedServiceClient for each server so that
+  // we can measure how long the server takes to respond to them, and give up
+  // on them once the timeout of the service has passed.
+  ServiceBalancer::Servers servers;
+  for(const std::string& server : config.route.servers)
+  {
     const auto it = info_map.find(server);
     if(it == info_map.end() || !it->second.service_provider)
     {
-      std::cerr << "Could not find service providing capabilities for system "
-                << "named [" << server << "], requested for service ["
+      std::cerr << "Could not find service providing capabilities for "
+                << "system named [" << server << "], requested for service ["
                 << service_name << "]" << std::endl;
       valid = false;
       continue;
     }
 
-    std::shared_ptr<ServiceProvider> provider =
-        it->second.service_provider->create_service_proxy(
+    std::shared_ptr<ServiceProvider> provider = table.create_service_proxy(
+          channel, server, *it->second.service_provider,
           remap_if_needed(server, config.remap, service_name),
           config.service_type,
           config_or_empty_node(server, config.middleware_configs));
@@ -689,36 +2190,134 @@ bool Config::configure_services(const SystemHandleInfoMap& info_map) const
       std::cerr << "Failed to create a service provider in middleware ["
                 << server << "] for service type [" << config.service_type
                 << "]" << std::endl;
+      table.finish(channel);
       return false;
     }
 
-    ServiceClientSystem::RequestCallback callback =
-        [=](const soss::Message& request,
-            ServiceClient& client,
-            const std::shared_ptr<void>& call_handle)
+    servers.push_back(
+          std::make_shared<TimedServiceClient>(
+            service_name, Metrics::service(service_name), provider,
+            config.timeout));
+  }
+
+  if(servers.empty())
+  {
+    table.finish(channel);
+    return valid;
+  }
+
+  const auto balancer =
+      std::make_shared<ServiceBalancer>(std::move(servers), config.balancing);
+
+  // Keeps the name of the service alive for the watchdog
+  const auto name = std::make_shared<const std::string>(service_name);
+
+  ServiceClientSystem::RequestCallback callback =
+      [=](const soss::Message& request,
+          ServiceClient& client,
+          const std::shared_ptr<void>& call_handle)
+  {
+    const RouteActivity activity(name->c_str());
+    balancer->choose().call(request, client, call_handle);
+  };
+
+  // The cache sits in front of the balancer, so that only the requests which
+  // it cannot answer reach the servers.
+  if(config.cache.enabled())
+  {
+    const auto cache =
+        std::make_shared<ServiceCache>(config.cache, std::move(callback));
+
+    callback = [=](const soss::Message& request,
+                   ServiceClient& client,
+                   const std::shared_ptr<void>& call_handle)
     {
-      provider->call_service(request, client, call_handle);
+      cache->call(request, client, call_handle);
     };
+  }
 
-    for(const std::string& client : config.route.clients)
+  for(const std::string& client : config.route.clients)
+  {
+    const auto it = info_map.find(client);
+    if(it == info_map.end() || !it->second.service_client)
     {
-      const auto it = info_map.find(client);
-      if(it == info_map.end() || !it->second.service_client)
-      {
-        std::cerr << "Could not find service client capabilities for system "
-                  << "named [" << client << "], requested for service ["
-                  << service_name << "]" << std::endl;
-        valid = false;
-        continue;
-      }
-
-      valid &= it->second.service_client->create_client_proxy(
-            remap_if_needed(client, config.remap, service_name),
-            config.service_type, callback,
-            config_or_empty_node(client, config.middleware_configs));
+      std::cerr << "Could not find service client capabilities for system "
+                << "named [" << client << "], requested for service ["
+                << service_name << "]" << std::endl;
+      valid = false;
+      continue;
     }
+
+    valid &= table.create_client_proxy(
+          channel, client, *it->second.service_client,
+          remap_if_needed(client, config.remap, service_name),
+          config.service_type, callback,
+          config_or_empty_node(client, config.middleware_configs));
+  }
+
+  table.finish(channel);
+  return valid;
+}
+
+//==============================================================================
+bool Config::reconfigure(
+    const Config& previous,
+    const SystemHandleInfoMap& info_map,
+    RouteTable& table)
+{
+  if(!same_middlewares(previous.m_middlewares, m_middlewares))
+  {
+    std::cerr << "The new configuration changes the [systems] of soss, which "
+              << "can only be done by restarting it" << std::endl;
+    *this = previous;
+    return false;
   }
 
+  if(previous.m_metrics.file != m_metrics.file
+     || previous.m_metrics.period != m_metrics.period)
+  {
+    std::cout << "WARNING: Changes to the [metrics] of soss only take effect "
+              << "once it gets restarted" << std::endl;
+    m_metrics = previous.m_metrics;
+  }
+
+  if(previous.m_memory.budget != m_memory.budget)
+  {
+    std::cout << "WARNING: Changes to the [memory] of soss only take effect "
+              << "once it gets restarted" << std::endl;
+    m_memory = previous.m_memory;
+  }
+
+  if(previous.m_watchdog.enabled != m_watchdog.enabled
+     || previous.m_watchdog.stall_threshold != m_watchdog.stall_threshold
+     || previous.m_watchdog.routes != m_watchdog.routes)
+  {
+    std::cout << "WARNING: Changes to the [watchdog] of soss only take effect "
+              << "once it gets restarted" << std::endl;
+    m_watchdog = previous.m_watchdog;
+  }
+
+  if(previous.m_executor.definition != m_executor.definition)
+  {
+    std::cout << "WARNING: Changes to the [executor] of soss only take effect "
+              << "once it gets restarted" << std::endl;
+    m_executor = previous.m_executor;
+  }
+
+  bool valid = reconfigure_channels(
+        "topic", previous.m_topic_configs, m_topic_configs, table,
+        [&](const std::string& name, const TopicConfig& config)
+  {
+    return _configure_topic(name, config, info_map, table);
+  });
+
+  valid &= reconfigure_channels(
+        "service", previous.m_service_configs, m_service_configs, table,
+        [&](const std::string& name, const ServiceConfig& config)
+  {
+    return _configure_service(name, config, info_map, table);
+  });
+
   return valid;
 }
 
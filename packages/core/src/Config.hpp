@@ -18,10 +18,20 @@
 #ifndef SOSS__INTERNAL__CONFIG_HPP
 #define SOSS__INTERNAL__CONFIG_HPP
 
+#include "FieldProjection.hpp"
 #include "register_system.hpp"
+#include "RouteTable.hpp"
+#include "ServiceCache.hpp"
+#include "TopicDispatch.hpp"
+#include "TopicOnChange.hpp"
+#include "TopicQueue.hpp"
+#include "TopicThrottle.hpp"
+
+#include <soss/ThreadSettings.hpp>
 
 #include <yaml-cpp/yaml.h>
 
+#include <chrono>
 #include <set>
 #include <vector>
 
@@ -33,6 +43,13 @@ struct MiddlewareConfig
 {
   std::string type;
   YAML::Node config_node;
+
+  /// How the thread that spins this middleware should run
+  ThreadSettings thread;
+
+  /// True if the system handle may be shared with the other soss instances of
+  /// the process that configure an identical system
+  bool shared = false;
 };
 
 //==============================================================================
@@ -52,13 +69,15 @@ struct TopicRoute
 //==============================================================================
 struct ServiceRoute
 {
-  std::string server;
+  /// The middlewares that can answer the requests of this service. When there
+  /// are several, each request goes to one of them.
+  std::set<std::string> servers;
   std::set<std::string> clients;
 
   std::set<std::string> all() const
   {
     std::set<std::string> _all = clients;
-    _all.insert(server);
+    _all.insert(servers.begin(), servers.end());
     return _all;
   }
 };
@@ -66,6 +85,10 @@ struct ServiceRoute
 //==============================================================================
 struct TopicConfig
 {
+  /// The YAML that this topic was configured from, for telling whether a new
+  /// configuration changes it
+  std::string definition;
+
   std::string message_type;
   TopicRoute route;
 
@@ -73,11 +96,33 @@ struct TopicConfig
   std::map<std::string, std::string> remap;
 
   std::map<std::string, YAML::Node> middleware_configs;
+
+  /// Optional queue between the subscribers and the publishers of this topic
+  TopicQueueConfig queue;
+
+  /// Limits on how many messages reach each destination of this topic.
+  /// key: destination middleware, or an empty string for every destination
+  /// that does not have its own entry
+  std::map<std::string, TopicThrottleConfig> throttles;
+
+  /// The fields that each destination of this topic gets, for destinations
+  /// that only need part of the message. Keyed like the throttles.
+  std::map<std::string, std::vector<std::string>> projections;
+
+  /// Sends each message only to the destinations that the value of one of
+  /// its fields picks, instead of to every destination of the route
+  TopicDispatchConfig dispatch;
+
+  /// Drops the messages that repeat the last message of this topic
+  TopicOnChangeConfig on_change;
 };
 
 //==============================================================================
 struct ServiceConfig
 {
+  /// The YAML that this service was configured from
+  std::string definition;
+
   std::string service_type;
   ServiceRoute route;
 
@@ -85,6 +130,80 @@ struct ServiceConfig
   std::map<std::string, std::string> remap;
 
   std::map<std::string, YAML::Node> middleware_configs;
+
+  /// How long a request may wait for its response before it fails. A timeout
+  /// of zero means that requests wait for as long as it takes.
+  std::chrono::milliseconds timeout = std::chrono::milliseconds(0);
+
+  enum class Balancing
+  {
+    /// Take turns sending requests to each server
+    RoundRobin,
+
+    /// Send each request to the server with the fewest unanswered requests
+    LeastOutstanding,
+
+    /// Prefer the servers that have been answering the fastest, taking their
+    /// unanswered requests into account
+    Latency
+  };
+
+  /// How requests get spread out when the route has several servers
+  Balancing balancing = Balancing::RoundRobin;
+
+  /// Whether the responses of the service get reused for identical requests
+  ServiceCacheConfig cache;
+};
+
+//==============================================================================
+struct MetricsConfig
+{
+  /// The file that the metrics get written to. The metrics are not exported
+  /// when this is empty.
+  std::string file;
+
+  /// How often the file gets rewritten
+  std::chrono::milliseconds period = std::chrono::seconds(5);
+};
+
+//==============================================================================
+struct MemoryConfig
+{
+  /// The most memory that soss may hold on to for its channels altogether, or
+  /// zero for no limit. See soss::Metrics::set_memory_budget().
+  std::size_t budget = 0;
+};
+
+//==============================================================================
+struct WatchdogConfig
+{
+  /// Whether the workers of the instance are watched
+  bool enabled = false;
+
+  /// How long a worker may stay busy with one piece of work before it counts
+  /// as stalled
+  std::chrono::nanoseconds stall_threshold = std::chrono::seconds(1);
+
+  /// Whether the route that a stalled worker is delivering gets reported
+  bool routes = true;
+};
+
+//==============================================================================
+struct ExecutorConfig
+{
+  /// The YAML that the executor was configured from
+  std::string definition;
+
+  /// Whether the instance runs on the Executor that is shared by the process,
+  /// instead of on threads of its own
+  bool enabled = false;
+
+  /// The number of workers of the executor, or zero for one per CPU. This
+  /// only matters to the instance that starts the shared executor.
+  std::size_t threads = 0;
+
+  /// How the workers of the executor should run
+  ThreadSettings thread;
 };
 
 //==============================================================================
@@ -105,9 +224,32 @@ public:
 
   bool load_middlewares(SystemHandleInfoMap& info_map) const;
 
-  bool configure_topics(const SystemHandleInfoMap& info_map) const;
+  /// \brief Connect the subscribers of every topic to its publishers through
+  /// the table. The queues of any topics that requested one are kept by the
+  /// table, and they must be stopped before the middlewares in info_map are
+  /// destroyed.
+  bool configure_topics(
+      const SystemHandleInfoMap& info_map,
+      RouteTable& table) const;
+
+  bool configure_services(
+      const SystemHandleInfoMap& info_map,
+      RouteTable& table) const;
 
-  bool configure_services(const SystemHandleInfoMap& info_map) const;
+  /// \brief Change the routes of a running instance, which were configured
+  /// from the previous Config, so that they match this one. Only the topics
+  /// and services that have been added, removed or changed get touched.
+  ///
+  /// Whether or not it succeeds, this Config describes the routes that are in
+  /// place afterwards. The middlewares themselves cannot be changed this way,
+  /// so if their configuration differs, nothing gets touched and this Config
+  /// becomes a copy of the previous one. Topics and services that fail to be
+  /// configured are left out of this Config, so that the next reconfiguration
+  /// will try them again.
+  bool reconfigure(
+      const Config& previous,
+      const SystemHandleInfoMap& info_map,
+      RouteTable& table);
 
   std::map<std::string, MiddlewareConfig> m_middlewares;
   std::map<std::string, TopicRoute> m_topic_routes;
@@ -115,10 +257,26 @@ public:
   std::map<std::string, TopicConfig> m_topic_configs;
   std::map<std::string, ServiceConfig> m_service_configs;
   std::map<std::string, RequiredTypes> m_required_types;
+  MetricsConfig m_metrics;
+  MemoryConfig m_memory;
+  WatchdogConfig m_watchdog;
+  ExecutorConfig m_executor;
 
 
 private:
 
+  bool _configure_topic(
+      const std::string& topic_name,
+      const TopicConfig& config,
+      const SystemHandleInfoMap& info_map,
+      RouteTable& table) const;
+
+  bool _configure_service(
+      const std::string& service_name,
+      const ServiceConfig& config,
+      const SystemHandleInfoMap& info_map,
+      RouteTable& table) const;
+
   bool _okay = false;
 
 };
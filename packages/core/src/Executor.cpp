@@ -0,0 +1,303 @@
+/*
+ * Copyright (C) 2019 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include "TimerWheel.hpp"
+
+#include <soss/Executor.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace soss {
+
+//==============================================================================
+class Executor::Implementation
+    : public std::enable_shared_from_this<Implementation>
+{
+public:
+
+  Implementation(const std::size_t threads)
+    : _workers(threads),
+      _pending(0),
+      _next(0),
+      _stopped(false)
+  {
+    // Do nothing
+  }
+
+  void start(const ThreadSettings& settings)
+  {
+    // The workers keep the implementation alive, in case the last reference
+    // to the executor gets dropped by one of its own tasks.
+    const std::shared_ptr<Implementation> self = shared_from_this();
+    _threads.reserve(_workers.size());
+    for(std::size_t i=0; i < _workers.size(); ++i)
+      _threads.emplace_back([self, i, settings]() { self->_run(i, settings); });
+  }
+
+  void post(Task task)
+  {
+    if(_stopped)
+      return;
+
+    // Tasks that get posted by a worker stay with that worker, where whatever
+    // they touch is most likely to still be in the cache.
+    const std::size_t index = current == this?
+          current_index : _next++ % _workers.size();
+
+    Worker& worker = _workers[index];
+    {
+      std::unique_lock<std::mutex> lock(worker.mutex);
+      worker.tasks.push_back(std::move(task));
+    }
+
+    {
+      // Count the task under the mutex, so that the notification cannot slip
+      // in between a worker checking the count and beginning its wait.
+      std::unique_lock<std::mutex> lock(_mutex);
+      ++_pending;
+    }
+    _wakeup.notify_one();
+  }
+
+  void post_after(const std::chrono::milliseconds delay, Task task)
+  {
+    std::weak_ptr<Implementation> weak = shared_from_this();
+    internal::TimerWheel::shared().schedule(
+          delay, [weak, task = std::move(task)]() mutable
+    {
+      if(const auto self = weak.lock())
+        self->post(std::move(task));
+    });
+  }
+
+  std::size_t size() const
+  {
+    return _workers.size();
+  }
+
+  bool on_worker() const
+  {
+    return current == this;
+  }
+
+  void stop()
+  {
+    {
+      std::unique_lock<std::mutex> lock(_mutex);
+      _stopped = true;
+    }
+    _wakeup.notify_all();
+
+    for(std::thread& thread : _threads)
+    {
+      if(!thread.joinable())
+        continue;
+
+      if(thread.get_id() == std::this_thread::get_id())
+        thread.detach();
+      else
+        thread.join();
+    }
+  }
+
+private:
+
+  struct Worker
+  {
+    std::mutex mutex;
+    std::deque<Task> tasks;
+  };
+
+  void _run(const std::size_t index, const ThreadSettings& settings)
+  {
+    current = this;
+    current_index = index;
+    settings.apply("soss-exec-" + std::to_string(index));
+
+    Task task;
+    while(!_stopped)
+    {
+      if(_take(index, task))
+      {
+        --_pending;
+        _execute(task);
+        task = nullptr;
+        continue;
+      }
+
+      std::unique_lock<std::mutex> lock(_mutex);
+      _wakeup.wait(lock, [&]() { return _stopped || _pending > 0; });
+    }
+  }
+
+  bool _take(const std::size_t index, Task& task)
+  {
+    {
+      // A worker runs its own tasks in the order they were posted, so a task
+      // that keeps posting itself cannot starve the tasks behind it.
+      Worker& own = _workers[index];
+      std::unique_lock<std::mutex> lock(own.mutex);
+      if(!own.tasks.empty())
+      {
+        task = std::move(own.tasks.front());
+        own.tasks.pop_front();
+        return true;
+      }
+    }
+
+    // Steal from the other end of the queues of the other workers, so that
+    // we do not contend with their owners for the same tasks.
+    for(std::size_t i=1; i < _workers.size(); ++i)
+    {
+      Worker& victim = _workers[(index + i) % _workers.size()];
+      std::unique_lock<std::mutex> lock(victim.mutex);
+      if(!victim.tasks.empty())
+      {
+        task = std::move(victim.tasks.back());
+        victim.tasks.pop_back();
+        return true;
+      }
+    }
+
+    return false;
+  }
+
+  static void _execute(const Task& task)
+  {
+    try
+    {
+      task();
+    }
+    catch(const std::exception& e)
+    {
+      std::cerr << "[soss::Executor] A task failed with an exception: "
+                << e.what() << std::endl;
+    }
+  }
+
+  static thread_local const Implementation* current;
+  static thread_local std::size_t current_index;
+
+  std::vector<Worker> _workers;
+  std::vector<std::thread> _threads;
+
+  /// The number of tasks that are waiting in the queues of the workers. It
+  /// only gets incremented under _mutex, but it may briefly dip below zero
+  /// when a task is taken before it has been counted.
+  std::atomic<int64_t> _pending;
+  std::atomic_size_t _next;
+  std::atomic_bool _stopped;
+  std::mutex _mutex;
+  std::condition_variable _wakeup;
+
+};
+
+thread_local const Executor::Implementation*
+Executor::Implementation::current = nullptr;
+
+thread_local std::size_t Executor::Implementation::current_index = 0;
+
+//==============================================================================
+Executor::Executor(const std::size_t threads, const ThreadSettings& settings)
+{
+  std::size_t count = threads;
+  if(count == 0)
+    count = std::max(std::thread::hardware_concurrency(), 1u);
+
+  _pimpl = std::make_shared<Implementation>(count);
+  _pimpl->start(settings);
+}
+
+//==============================================================================
+void Executor::post(Task task)
+{
+  _pimpl->post(std::move(task));
+}
+
+//==============================================================================
+void Executor::post_after(const std::chrono::milliseconds delay, Task task)
+{
+  _pimpl->post_after(delay, std::move(task));
+}
+
+//==============================================================================
+std::size_t Executor::size() const
+{
+  return _pimpl->size();
+}
+
+//==============================================================================
+bool Executor::on_worker() const
+{
+  return _pimpl->on_worker();
+}
+
+//==============================================================================
+namespace {
+
+std::mutex shared_executor_mutex;
+std::weak_ptr<Executor> shared_executor;
+
+} // anonymous namespace
+
+//==============================================================================
+std::shared_ptr<Executor> Executor::shared(
+    const std::size_t threads,
+    const ThreadSettings& settings)
+{
+  std::unique_lock<std::mutex> lock(shared_executor_mutex);
+  std::shared_ptr<Executor> executor = shared_executor.lock();
+  if(executor)
+  {
+    if(threads != 0 && threads != executor->size())
+    {
+      std::cerr << "[soss::Executor] WARNING: The shared executor is already "
+                << "running with [" << executor->size() << "] threads, so the "
+                << "request for [" << threads << "] threads is ignored"
+                << std::endl;
+    }
+
+    return executor;
+  }
+
+  executor = std::make_shared<Executor>(threads, settings);
+  shared_executor = executor;
+  return executor;
+}
+
+//==============================================================================
+std::shared_ptr<Executor> Executor::shared()
+{
+  std::unique_lock<std::mutex> lock(shared_executor_mutex);
+  return shared_executor.lock();
+}
+
+//==============================================================================
+Executor::~Executor()
+{
+  _pimpl->stop();
+}
+
+} // namespace soss
@@ -0,0 +1,200 @@
+/*
+ * Copyright (C) 2019 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include "FieldProjection.hpp"
+
+namespace soss {
+namespace internal {
+
+//==============================================================================
+FieldProjection::FieldProjection(const std::vector<std::string>& paths)
+{
+  for(const std::string& path : paths)
+  {
+    Node* node = &_root;
+    std::size_t begin = 0;
+    while(!node->whole)
+    {
+      const std::size_t end = path.find('.', begin);
+      node = &node->children[path.substr(begin, end - begin)];
+      if(end == std::string::npos)
+      {
+        // Asking for a whole field makes any requests for parts of it moot
+        node->whole = true;
+        node->children.clear();
+        break;
+      }
+
+      begin = end + 1;
+    }
+  }
+}
+
+//==============================================================================
+Message FieldProjection::project(const Message& message) const
+{
+  // A message that only carries its native representation has no fields to
+  // pick from, so it is passed on whole
+  if(message.data.empty() && message.native)
+    return message;
+
+  return _project(message, _root);
+}
+
+//==============================================================================
+Message FieldProjection::project(Message&& message) const
+{
+  if(message.data.empty() && message.native)
+    return std::move(message);
+
+  return _project(std::move(message), _root);
+}
+
+//==============================================================================
+Message FieldProjection::_project(const Message& message, const Node& node)
+{
+  Message projected;
+  projected.type = message.type;
+  projected.data.reserve(node.children.size());
+
+  // The children are sorted by name just like the fields of a message, so
+  // every field gets appended to the end.
+  for(const auto& child : node.children)
+  {
+    const auto it = message.data.find(child.first);
+    if(it == message.data.end())
+      continue;
+
+    const Field& field = it->second;
+    if(!child.second.whole)
+    {
+      if(const Message* const nested = field.cast<Message>())
+      {
+        projected.data.emplace(
+              child.first,
+              make_field<Message>(_project(*nested, child.second)));
+        continue;
+      }
+
+      if(const auto* const nested = field.cast<std::vector<Message>>())
+      {
+        std::vector<Message> elements;
+        elements.reserve(nested->size());
+        for(const Message& element : *nested)
+          elements.push_back(_project(element, child.second));
+
+        projected.data.emplace(
+              child.first, make_field<std::vector<Message>>(
+                std::move(elements)));
+        continue;
+      }
+    }
+
+    // Fields that do not contain messages can only be taken whole
+    projected.data.emplace(child.first, field);
+  }
+
+  return projected;
+}
+
+//==============================================================================
+Message FieldProjection::_project(Message&& message, const Node& node)
+{
+  Message projected;
+  projected.type = std::move(message.type);
+  projected.data.reserve(node.children.size());
+
+  for(const auto& child : node.children)
+  {
+    const auto it = message.data.find(child.first);
+    if(it == message.data.end())
+      continue;
+
+    Field& field = it->second;
+    if(!child.second.whole)
+    {
+      if(Message* const nested = field.cast<Message>())
+      {
+        projected.data.emplace(
+              child.first,
+              make_field<Message>(_project(std::move(*nested), child.second)));
+        continue;
+      }
+
+      if(auto* const nested = field.cast<std::vector<Message>>())
+      {
+        for(Message& element : *nested)
+          element = _project(std::move(element), child.second);
+
+        projected.data.emplace(child.first, std::move(field));
+        continue;
+      }
+    }
+
+    projected.data.emplace(child.first, std::move(field));
+  }
+
+  return projected;
+}
+
+//==============================================================================
+ProjectedPublisher::ProjectedPublisher(
+    std::shared_ptr<TopicPublisher> publisher,
+    const std::vector<std::string>& fields)
+  : _publisher(std::move(publisher)),
+    _projection(fields)
+{
+  // Do nothing
+}
+
+//==============================================================================
+bool ProjectedPublisher::publish(const Message& message)
+{
+  return _publisher->publish_owned(_projection.project(message));
+}
+
+//==============================================================================
+bool ProjectedPublisher::publish_owned(Message&& message)
+{
+  return _publisher->publish_owned(_projection.project(std::move(message)));
+}
+
+//==============================================================================
+bool ProjectedPublisher::publish_envelope(const MessageEnvelope& envelope)
+{
+  // The projected message is only seen by this publisher, so there is no
+  // encoding that could be shared with the others.
+  return _publisher->publish_owned(_projection.project(envelope.message()));
+}
+
+//==============================================================================
+bool ProjectedPublisher::publish_batch(
+    const std::vector<std::shared_ptr<const Message>>& messages)
+{
+  std::vector<std::shared_ptr<const Message>> projected;
+  projected.reserve(messages.size());
+  for(const std::shared_ptr<const Message>& message : messages)
+  {
+    projected.push_back(
+          std::make_shared<const Message>(_projection.project(*message)));
+  }
+
+  return _publisher->publish_batch(projected);
+}
+
+} // namespace internal
+} // namespace soss
@@ -0,0 +1,100 @@
+/*
+ * Copyright (C) 2019 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#ifndef SOSS__INTERNAL__FIELDPROJECTION_HPP
+#define SOSS__INTERNAL__FIELDPROJECTION_HPP
+
+#include <soss/SystemHandle.hpp>
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace soss {
+namespace internal {
+
+//==============================================================================
+/// FieldProjection cuts a message down to the fields that were asked for.
+/// Fields are named by their path through the nested messages, e.g.
+/// "header.stamp" or "pose.position". A path that names a field of a message
+/// array applies to every element of the array. Messages that only carry
+/// their native representation, without any fields, are passed on whole.
+class FieldProjection
+{
+public:
+
+  FieldProjection(const std::vector<std::string>& paths);
+
+  /// \brief Copy the requested fields of a message into a new message of the
+  /// same type. Requested fields that the message does not have are skipped.
+  Message project(const Message& message) const;
+
+  /// \brief Same as project(const Message&), except the requested fields get
+  /// moved out of the message instead of copied.
+  Message project(Message&& message) const;
+
+private:
+
+  struct Node
+  {
+    /// The whole field was requested, not just some of its fields
+    bool whole = false;
+
+    std::map<std::string, Node> children;
+  };
+
+  static Message _project(const Message& message, const Node& node);
+
+  static Message _project(Message&& message, const Node& node);
+
+  Node _root;
+
+};
+
+//==============================================================================
+/// ProjectedPublisher hands only the requested fields of each message to the
+/// publisher of a destination, so the destination's middleware never has to
+/// convert or send the rest of them.
+class ProjectedPublisher : public TopicPublisher
+{
+public:
+
+  ProjectedPublisher(
+      std::shared_ptr<TopicPublisher> publisher,
+      const std::vector<std::string>& fields);
+
+  bool publish(const Message& message) override;
+
+  bool publish_owned(Message&& message) override;
+
+  bool publish_envelope(const MessageEnvelope& envelope) override;
+
+  bool publish_batch(
+      const std::vector<std::shared_ptr<const Message>>& messages) override;
+
+private:
+
+  const std::shared_ptr<TopicPublisher> _publisher;
+  const FieldProjection _projection;
+
+};
+
+} // namespace internal
+} // namespace soss
+
+#endif // SOSS__INTERNAL__FIELDPROJECTION_HPP
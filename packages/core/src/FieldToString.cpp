@@ -17,66 +17,108 @@
 
 #include <soss/FieldToString.hpp>
 
+#include <cstdio>
 #include <string>
-#include <unordered_map>
 
 namespace soss {
 
 namespace {
 //==============================================================================
-class FieldConversions
+/// Write the digits of an integer backwards from the end of a buffer, instead
+/// of going through a temporary string like std::to_string(~) does.
+/// \returns the position of the first digit
+char* format_digits(uint64_t value, char* const end)
 {
-public:
-
-  static const FieldConversions& instance()
-  {
-    static FieldConversions conversions;
-    return conversions;
-  }
-
-  std::string to_string(
-      const soss::Message::const_iterator& field_it,
-      const std::string& details) const
+  char* it = end;
+  do
   {
-    const auto& field_name = field_it->first;
-    const auto& field = field_it->second;
+    *--it = static_cast<char>('0' + value % 10);
+    value /= 10;
+  } while(value != 0);
 
-    const std::string& type = field.type();
-    const auto it = conversions.find(type);
-    if(it != conversions.end())
-      return it->second(field);
+  return it;
+}
 
-    throw UnknownFieldToStringCast(type, field_name, details);
-  }
+//==============================================================================
+void append_unsigned(const uint64_t value, std::string& output)
+{
+  // 20 digits are enough for the largest uint64_t
+  char buffer[20];
+  char* const end = buffer + sizeof(buffer);
+  const char* const begin = format_digits(value, end);
+  output.append(begin, static_cast<std::size_t>(end - begin));
+}
 
-private:
+//==============================================================================
+void append_signed(const int64_t value, std::string& output)
+{
+  if(value >= 0)
+    return append_unsigned(static_cast<uint64_t>(value), output);
+
+  // Negate in unsigned arithmetic, so that the lowest int64_t does not
+  // overflow
+  char buffer[21];
+  char* const end = buffer + sizeof(buffer);
+  char* const begin =
+      format_digits(0 - static_cast<uint64_t>(value), end) - 1;
+  *begin = '-';
+  output.append(begin, static_cast<std::size_t>(end - begin));
+}
 
-  FieldConversions()
+//==============================================================================
+void append_double(const double value, std::string& output)
+{
+  // Use the same format as std::to_string(~). Almost every value fits into
+  // the buffer on the stack, and the rest get written into the output.
+  char buffer[64];
+  const int length = std::snprintf(buffer, sizeof(buffer), "%f", value);
+  if(length < 0)
+    return;
+
+  const std::size_t size = static_cast<std::size_t>(length);
+  if(size < sizeof(buffer))
   {
-    conversions[typeid(std::string).name()] = [](const soss::Field& field)
-    {
-      return *field.cast<std::string>();
-    };
-
-    add_primitive_conversion<int64_t>();
-    add_primitive_conversion<uint64_t>();
-    add_primitive_conversion<double>();
+    output.append(buffer, size);
+    return;
   }
 
-  template<typename T>
-  void add_primitive_conversion()
+  const std::size_t offset = output.size();
+  output.resize(offset + size + 1);
+  std::snprintf(&output[offset], size + 1, "%f", value);
+  output.resize(offset + size);
+}
+
+//==============================================================================
+void append_field(
+    const soss::Message::const_iterator& field_it,
+    const std::string& details,
+    std::string& output)
+{
+  const auto& field_name = field_it->first;
+  const auto& field = field_it->second;
+
+  switch(field.type_tag())
   {
-    conversions[typeid(T).name()] = [](const soss::Field& field)
-    {
-      return std::to_string(*field.cast<T>());
-    };
-  }
+    case FieldTypeTag::String:
+      output += *field.cast<std::string>();
+      return;
+
+    case FieldTypeTag::Int64:
+      append_signed(*field.cast<int64_t>(), output);
+      return;
 
-  using ConversionFunc = std::function<std::string(const soss::Field&)>;
-  using ConversionMap = std::unordered_map<std::string, ConversionFunc>;
+    case FieldTypeTag::UInt64:
+      append_unsigned(*field.cast<uint64_t>(), output);
+      return;
 
-  ConversionMap conversions;
-};
+    case FieldTypeTag::Double:
+      append_double(*field.cast<double>(), output);
+      return;
+
+    default:
+      throw UnknownFieldToStringCast(field.type(), field_name, details);
+  }
+}
 } // anonymous namespace
 
 //==============================================================================
@@ -90,7 +132,17 @@ FieldToString::FieldToString(const std::string& usage_details)
 std::string FieldToString::to_string(
     const Message::const_iterator& field_it) const
 {
-  return FieldConversions::instance().to_string(field_it, details);
+  std::string output;
+  append_field(field_it, details, output);
+  return output;
+}
+
+//==============================================================================
+void FieldToString::append(
+    const Message::const_iterator& field_it,
+    std::string& output) const
+{
+  append_field(field_it, details, output);
 }
 
 //==============================================================================
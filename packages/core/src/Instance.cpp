@@ -18,15 +18,21 @@
 #include "Config.hpp"
 #include "Search-impl.hpp"
 #include "register_system.hpp"
+#include "SharedSystems.hpp"
+#include "Watchdog.hpp"
 
+#include <soss/Executor.hpp>
 #include <soss/Instance.hpp>
+#include <soss/Metrics.hpp>
 #include <soss/MiddlewareInterfaceExtension.hpp>
+#include <soss/ThreadSettings.hpp>
 
 #include <yaml-cpp/yaml.h>
 
 #include <boost/program_options.hpp>
 
 #include <atomic>
+#include <chrono>
 #include <condition_variable>
 #include <experimental/filesystem>
 #include <iostream>
@@ -43,6 +49,14 @@ static int interruptable_instances = 0;
 static bool interrupted = false;
 static std::mutex change_interruption_mutex;
 
+// How long a middleware thread may block while waiting for work before it
+// checks whether a SIGINT has arrived
+static const std::chrono::milliseconds InterruptionPollPeriod(100);
+
+// How long a middleware that runs on the executor may block while waiting for
+// work before it lets the other tasks of the executor have a turn
+static const std::chrono::milliseconds ExecutorSpinSlice(1);
+
 extern "C" void interruption_handler(int)
 {
   interrupted = true;
@@ -69,8 +83,21 @@ public:
       _configuration(std::move(configuration)),
       _quit(false),
       _active_middlewares(0),
-      _return_code(0)
+      _return_code(0),
+      _active_tasks(0)
   {
+    const internal::ExecutorConfig& executor = _configuration.m_executor;
+    if(executor.enabled)
+    {
+      _executor = Executor::shared(executor.threads, executor.thread);
+      _routes.set_executor(_executor);
+    }
+
+    // The budget belongs to the whole process, so an instance that does not
+    // ask for one leaves the budget of any other instance alone
+    if(_configuration.m_memory.budget > 0)
+      Metrics::set_memory_budget(_configuration.m_memory.budget);
+
     if(!configure_soss())
     {
       _quit = true;
@@ -83,11 +110,24 @@ public:
     : m_running(false),
       _quit(true),
       _active_middlewares(0),
-      _return_code(return_code)
+      _return_code(return_code),
+      _active_tasks(0)
   {
     // Do nothing
   }
 
+  ~Implementation()
+  {
+    // The subscriptions of the middlewares keep their queues alive, so we need
+    // to stop the queue workers explicitly before any of the middlewares that
+    // they publish to get destroyed.
+    _routes.stop_queues();
+
+    // The systems that are shared with other instances keep running after this
+    // one is gone, so they must stop delivering to our routes first.
+    internal::SharedSystems::release(_info_map);
+  }
+
   bool configure_soss()
   {
     if(!_configuration.load_middlewares(_info_map))
@@ -96,13 +136,13 @@ public:
       return false;
     }
 
-    if(!_configuration.configure_topics(_info_map))
+    if(!_configuration.configure_topics(_info_map, _routes))
     {
       std::cerr << "Failed to configure topics!" << std::endl;
       return false;
     }
 
-    if(!_configuration.configure_services(_info_map))
+    if(!_configuration.configure_services(_info_map, _routes))
     {
       std::cerr << "Failed to configure services!" << std::endl;
       return false;
@@ -111,6 +151,39 @@ public:
     return true;
   }
 
+  bool reconfigure(internal::Config configuration)
+  {
+    if(!configuration)
+    {
+      std::cerr << "Failed to parse the new configuration, so soss will keep "
+                << "running with its current one" << std::endl;
+      return false;
+    }
+
+    std::unique_lock<std::mutex> lock(_reconfigure_mutex);
+    if(_quit || !m_running)
+    {
+      std::cerr << "Cannot reconfigure a soss instance that is not running"
+                << std::endl;
+      return false;
+    }
+
+    using Clock = std::chrono::steady_clock;
+    const auto start = Clock::now();
+    const bool success =
+        configuration.reconfigure(_configuration, _info_map, _routes);
+    Metrics::record_startup("reconfigure", "", Clock::now() - start);
+
+    _configuration = std::move(configuration);
+
+    // If we started to quit in the meantime, the queues of the new routes
+    // need to be stopped as well
+    if(_quit)
+      _routes.stop_queues();
+
+    return success;
+  }
+
   void run()
   {
     if(_quit)
@@ -136,37 +209,170 @@ public:
       ++interruptable_instances;
     }
 
-    _work_threads.reserve(_info_map.size());
+    std::vector<const Entry*> self_driven;
+    std::vector<const Entry*> spinning;
     for(const auto& entry : _info_map)
     {
-      auto runner = [&]()
+      if(entry.second.handle->self_driven())
+        self_driven.push_back(&entry);
+      else
+        spinning.push_back(&entry);
+    }
+
+    // Count every worker before launching any of them so that an early exit
+    // of one worker cannot be mistaken for the end of the whole instance.
+    _active_middlewares = spinning.size() + (self_driven.empty()? 0 : 1);
+
+    const internal::WatchdogConfig& watchdog = _configuration.m_watchdog;
+    if(watchdog.enabled)
+    {
+      internal::Watchdog::get().configure(
+            watchdog.stall_threshold, watchdog.routes);
+
+      for(const Entry* entry : spinning)
+      {
+        _heartbeats[entry->first] =
+            std::make_unique<internal::Heartbeat>("soss-" + entry->first);
+      }
+
+      // The watchdog always gets a thread of its own, so that it can still
+      // report when every worker of the executor is stuck
+      _work_threads.emplace_back([this, watchdog]()
+      {
+        ThreadSettings().apply("soss-watchdog");
+
+        const auto period = std::min<std::chrono::nanoseconds>(
+              InterruptionPollPeriod, watchdog.stall_threshold/2);
+        while(!interrupted && !_quit)
+        {
+          std::unique_lock<std::mutex> lock(_wakeup_mutex);
+          _wakeup.wait_for(lock, period, [&]() { return _quit.load(); });
+          lock.unlock();
+
+          internal::Watchdog::get().check();
+        }
+      });
+    }
+
+    if(_executor)
+    {
+      _run_on_executor(spinning, self_driven);
+      return;
+    }
+
+    _work_threads.reserve(_work_threads.size() + _active_middlewares + 1);
+    for(const Entry* entry : spinning)
+    {
+      const ThreadSettings& thread =
+          _configuration.m_middlewares.at(entry->first).thread;
+
+      auto runner = [this, entry, thread]()
       {
-        ++_active_middlewares;
+        // Failures get reported, but the middleware still gets to run
+        thread.apply("soss-" + entry->first);
+
         while(!interrupted && !_quit)
         {
-          const bool okay = entry.second.handle->spin_once();
+          const bool okay = _spin_once(entry);
           if(!okay)
+            _report_failure(entry->first);
+
+          if(interrupted || _quit)
+            break;
+
+          entry->second.handle->wait_for_work(InterruptionPollPeriod);
+        }
+
+        _middleware_done();
+      };
+
+      _work_threads.emplace_back(runner);
+    }
+
+    if(!self_driven.empty())
+    {
+      // All the self-driven middlewares share one thread, which only needs to
+      // start them up and then keep an eye on their health.
+      auto supervisor = [this, self_driven]()
+      {
+        // The threads of the self-driven middlewares belong to them, so they
+        // apply their own thread settings.
+        ThreadSettings().apply("soss-supervise");
+
+        for(const Entry* entry : self_driven)
+        {
+          if(!entry->second.handle->spin_once())
+            _report_failure(entry->first);
+        }
+
+        while(!interrupted && !_quit)
+        {
+          for(const Entry* entry : self_driven)
           {
-            _quit = true;
-            _return_code = 1;
-            std::cout << "Runtime Error: middleware named [" << entry.first
-                      << "] has experienced a failure! We will now quit!"
-                      << std::endl;
+            if(!entry->second.handle->okay())
+              _report_failure(entry->first);
           }
+
+          // A signal handler cannot safely notify a condition variable, so we
+          // wake up periodically to check whether we have been interrupted.
+          std::unique_lock<std::mutex> lock(_wakeup_mutex);
+          _wakeup.wait_for(
+                lock, InterruptionPollPeriod, [&]() { return _quit.load(); });
         }
 
-        --_active_middlewares;
-        if(_active_middlewares == 0)
-          _finished();
+        _middleware_done();
       };
 
-      _work_threads.emplace_back(runner);
+      _work_threads.emplace_back(supervisor);
+    }
+
+    const internal::MetricsConfig& metrics = _configuration.m_metrics;
+    if(!metrics.file.empty())
+    {
+      auto exporter = [this, metrics]()
+      {
+        ThreadSettings().apply("soss-metrics");
+
+        auto next_export = std::chrono::steady_clock::now() + metrics.period;
+        while(!interrupted && !_quit)
+        {
+          std::unique_lock<std::mutex> lock(_wakeup_mutex);
+          _wakeup.wait_for(
+                lock, InterruptionPollPeriod, [&]() { return _quit.load(); });
+          lock.unlock();
+
+          if(std::chrono::steady_clock::now() < next_export)
+            continue;
+
+          Metrics::write_prometheus(metrics.file);
+          next_export += metrics.period;
+        }
+
+        // Leave a final snapshot behind for whoever wants to inspect the run
+        Metrics::write_prometheus(metrics.file);
+      };
+
+      _work_threads.emplace_back(exporter);
     }
   }
 
   void quit()
   {
     _quit = true;
+
+    // Release any subscribers that are blocked on a full queue, so that their
+    // middlewares are able to notice that we are quitting.
+    _routes.stop_queues();
+
+    {
+      // Lock the mutex so that the notification cannot slip in between the
+      // supervisor checking the _quit flag and beginning its wait.
+      std::unique_lock<std::mutex> lock(_wakeup_mutex);
+    }
+    _wakeup.notify_all();
+
+    for(const auto& entry : _info_map)
+      entry.second.handle->wake_up();
   }
 
   int return_code() const
@@ -182,6 +388,9 @@ public:
         thread.join();
     }
 
+    std::unique_lock<std::mutex> lock(_wakeup_mutex);
+    _tasks_done.wait(lock, [&]() { return _active_tasks == 0; });
+
     return _return_code;
   }
 
@@ -190,6 +399,143 @@ public:
 
 private:
 
+  using Entry = internal::SystemHandleInfoMap::value_type;
+
+  /// Do the work of the middleware threads, the supervisor and the metrics
+  /// exporter as tasks on the executor. Each of them keeps posting its next
+  /// step until the instance quits.
+  void _run_on_executor(
+      const std::vector<const Entry*>& spinning,
+      const std::vector<const Entry*>& self_driven)
+  {
+    const bool export_metrics = !_configuration.m_metrics.file.empty();
+    _active_tasks = spinning.size()
+        + (self_driven.empty()? 0 : 1) + (export_metrics? 1 : 0);
+
+    for(const Entry* entry : spinning)
+      _executor->post([this, entry]() { _spin(entry); });
+
+    if(!self_driven.empty())
+    {
+      _executor->post([this, self_driven]()
+      {
+        for(const Entry* entry : self_driven)
+        {
+          if(!entry->second.handle->spin_once())
+            _report_failure(entry->first);
+        }
+
+        _supervise(self_driven);
+      });
+    }
+
+    if(export_metrics)
+    {
+      _export_metrics(
+            std::chrono::steady_clock::now() + _configuration.m_metrics.period);
+    }
+  }
+
+  void _spin(const Entry* entry)
+  {
+    if(interrupted || _quit)
+    {
+      _middleware_done();
+      _task_done();
+      return;
+    }
+
+    if(!_spin_once(entry))
+      _report_failure(entry->first);
+
+    // Only wait for a short slice, since other systems may be waiting for this
+    // worker of the executor
+    if(!interrupted && !_quit)
+      entry->second.handle->wait_for_work(ExecutorSpinSlice);
+
+    _executor->post([this, entry]() { _spin(entry); });
+  }
+
+  /// Spin a system once, under the eyes of the watchdog if it is enabled
+  bool _spin_once(const Entry* entry)
+  {
+    const auto heartbeat = _heartbeats.find(entry->first);
+    if(heartbeat == _heartbeats.end())
+      return entry->second.handle->spin_once();
+
+    heartbeat->second->busy();
+    const bool okay = entry->second.handle->spin_once();
+    heartbeat->second->idle();
+    return okay;
+  }
+
+  void _supervise(const std::vector<const Entry*>& self_driven)
+  {
+    if(interrupted || _quit)
+    {
+      _middleware_done();
+      _task_done();
+      return;
+    }
+
+    for(const Entry* entry : self_driven)
+    {
+      if(!entry->second.handle->okay())
+        _report_failure(entry->first);
+    }
+
+    _executor->post_after(
+          InterruptionPollPeriod,
+          [this, self_driven]() { _supervise(self_driven); });
+  }
+
+  void _export_metrics(const std::chrono::steady_clock::time_point next_export)
+  {
+    const internal::MetricsConfig& metrics = _configuration.m_metrics;
+    if(interrupted || _quit)
+    {
+      // Leave a final snapshot behind for whoever wants to inspect the run
+      Metrics::write_prometheus(metrics.file);
+      _task_done();
+      return;
+    }
+
+    auto next = next_export;
+    if(std::chrono::steady_clock::now() >= next)
+    {
+      Metrics::write_prometheus(metrics.file);
+      next += metrics.period;
+    }
+
+    _executor->post_after(
+          std::min(InterruptionPollPeriod, metrics.period),
+          [this, next]() { _export_metrics(next); });
+  }
+
+  void _task_done()
+  {
+    {
+      std::unique_lock<std::mutex> lock(_wakeup_mutex);
+      --_active_tasks;
+    }
+    _tasks_done.notify_all();
+  }
+
+  void _report_failure(const std::string& middleware)
+  {
+    _return_code = 1;
+    std::cout << "Runtime Error: middleware named [" << middleware
+              << "] has experienced a failure! We will now quit!"
+              << std::endl;
+    quit();
+  }
+
+  void _middleware_done()
+  {
+    if(--_active_middlewares == 0)
+      _finished();
+  }
+
   void _finished()
   {
     {
@@ -207,12 +553,25 @@ private:
     m_finished.notify_all();
   }
 
+  // The executor gets declared first so that it outlives the queues and the
+  // middlewares, which may still have tasks on it.
+  std::shared_ptr<Executor> _executor;
   std::vector<std::thread> _work_threads;
+  std::map<std::string, std::unique_ptr<internal::Heartbeat>> _heartbeats;
   internal::Config _configuration;
   internal::SystemHandleInfoMap _info_map;
+  internal::RouteTable _routes;
+  std::mutex _reconfigure_mutex;
+
   std::atomic_bool _quit;
   std::atomic<int64_t> _active_middlewares;
   std::atomic_int _return_code;
+  std::mutex _wakeup_mutex;
+  std::condition_variable _wakeup;
+
+  // The number of tasks that the instance is still running on the executor
+  int _active_tasks;
+  std::condition_variable _tasks_done;
 
 };
 
@@ -473,6 +832,18 @@ int InstanceHandle::wait()
   return _pimpl->wait();
 }
 
+//==============================================================================
+bool InstanceHandle::reconfigure(const YAML::Node& config_node)
+{
+  return _pimpl->reconfigure(internal::Config(config_node));
+}
+
+//==============================================================================
+bool InstanceHandle::reconfigure(const std::string& config_file_path)
+{
+  return _pimpl->reconfigure(internal::Config::from_file(config_file_path));
+}
+
 //==============================================================================
 InstanceHandle& InstanceHandle::wait_for(
     const std::chrono::nanoseconds& max_time)
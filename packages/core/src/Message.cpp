@@ -15,154 +15,331 @@
  *
 */
 
+#include <soss/Blob.hpp>
 #include <soss/Message.hpp>
 
+#include <cstring>
+
 namespace soss {
 
 //==============================================================================
-class Field::Implementation
+Field::Field()
+  : _vtable(nullptr)
 {
-public:
+  // Do nothing
+}
 
-  Implementation()
-    : _type(nullptr),
-      _data(nullptr)
-  {
-    // Do nothing
-  }
+//==============================================================================
+Field::Field(const Field& other)
+  : _vtable(nullptr)
+{
+  _copy_from(other);
+}
 
-  Implementation(const Implementation& other)
-  {
-    *this = other;
-  }
+//==============================================================================
+Field::Field(Field&& other) noexcept
+  : _vtable(nullptr)
+{
+  _move_from(other);
+}
 
-  Implementation& operator=(const Implementation& other)
+//==============================================================================
+Field& Field::operator=(const Field& other)
+{
+  if(this != &other)
   {
-    _type = other._type;
-    _data = other.clone_data();
-    _copier = other._copier;
-    _deleter = other._deleter;
-    return *this;
+    _reset();
+    _copy_from(other);
   }
 
-  void* clone_data() const
-  {
-    return _copier(_data);
-  }
+  return *this;
+}
 
-  void _set(const std::type_info& type, void* data,
-            std::function<void*(const void*)>&& copier,
-            std::function<void(void*)>&& deleter)
+//==============================================================================
+Field& Field::operator=(Field&& other) noexcept
+{
+  if(this != &other)
   {
-    _type = &type;
-    _data = data;
-    _copier = copier;
-    _deleter = deleter;
+    _reset();
+    _move_from(other);
   }
 
-  void* _cast(const std::type_info& type) const
-  {
-    // This means we have an empty field
-    if(!_type)
-      return nullptr;
+  return *this;
+}
 
-    // TODO(MXG): If we ever need to support windows, we probably cannot rely
-    // on this check
-    if(*_type == type)
-      return _data;
+//==============================================================================
+std::string Field::type() const
+{
+  // TODO(MXG): Consider demangling this typename
+  if(_vtable)
+    return _vtable->type->name();
 
-    // If the type check failed, then we should return a nullptr.
-    return nullptr;
-  }
+  return "empty";
+}
+
+namespace {
 
-  std::string type() const
+//==============================================================================
+bool messages_equal(const Message& a, const Message& b)
+{
+  if(a.type != b.type || a.data.size() != b.data.size())
+    return false;
+
+  // The fields of both messages are sorted by name, so they line up
+  auto b_it = b.data.begin();
+  for(const auto& a_field : a.data)
   {
-    // TODO(MXG): Consider demangling this typename
-    if(_type)
-      return _type->name();
+    if(a_field.first != b_it->first || !a_field.second.equals(b_it->second))
+      return false;
 
-    return "empty";
+    ++b_it;
   }
 
-  ~Implementation()
+  return true;
+}
+
+//==============================================================================
+template<typename T>
+bool values_equal(const Field& a, const Field& b)
+{
+  return *a.cast<T>() == *b.cast<T>();
+}
+
+} // anonymous namespace
+
+//==============================================================================
+bool Field::equals(const Field& other) const
+{
+  const FieldTypeTag tag = type_tag();
+  if(tag != other.type_tag())
+    return false;
+
+  switch(tag)
   {
-    if(_deleter && _data)
-      _deleter(_data);
+    case FieldTypeTag::String:
+      return values_equal<std::string>(*this, other);
+    case FieldTypeTag::Bool:
+      return values_equal<bool>(*this, other);
+    case FieldTypeTag::Int64:
+      return values_equal<int64_t>(*this, other);
+    case FieldTypeTag::UInt64:
+      return values_equal<uint64_t>(*this, other);
+    case FieldTypeTag::Double:
+      return values_equal<double>(*this, other);
+    case FieldTypeTag::Message:
+      return messages_equal(*cast<Message>(), *other.cast<Message>());
+    case FieldTypeTag::StringVector:
+      return values_equal<std::vector<std::string>>(*this, other);
+    case FieldTypeTag::Int64Vector:
+      return values_equal<std::vector<int64_t>>(*this, other);
+    case FieldTypeTag::UInt64Vector:
+      return values_equal<std::vector<uint64_t>>(*this, other);
+    case FieldTypeTag::DoubleVector:
+      return values_equal<std::vector<double>>(*this, other);
+    case FieldTypeTag::MessageVector:
+    {
+      const auto& a = *cast<std::vector<Message>>();
+      const auto& b = *other.cast<std::vector<Message>>();
+      return a.size() == b.size()
+          && std::equal(a.begin(), a.end(), b.begin(), &messages_equal);
+    }
+    case FieldTypeTag::UInt8Vector:
+      return values_equal<std::vector<uint8_t>>(*this, other);
+    case FieldTypeTag::Int8Vector:
+      return values_equal<std::vector<int8_t>>(*this, other);
+    case FieldTypeTag::UInt16Vector:
+      return values_equal<std::vector<uint16_t>>(*this, other);
+    case FieldTypeTag::Int16Vector:
+      return values_equal<std::vector<int16_t>>(*this, other);
+    case FieldTypeTag::UInt32Vector:
+      return values_equal<std::vector<uint32_t>>(*this, other);
+    case FieldTypeTag::Int32Vector:
+      return values_equal<std::vector<int32_t>>(*this, other);
+    case FieldTypeTag::FloatVector:
+      return values_equal<std::vector<float>>(*this, other);
+    case FieldTypeTag::Blob:
+      return values_equal<Blob>(*this, other);
+    case FieldTypeTag::Other:
+      break;
   }
 
-private:
-  const std::type_info* _type;
-  void* _data;
-  std::function<void*(const void*)> _copier;
-  std::function<void(void*)> _deleter;
+  return false;
+}
 
-};
+//==============================================================================
+Field::~Field()
+{
+  _reset();
+}
 
 //==============================================================================
-Field::Field()
-  : _pimpl(new Implementation)
+void* Field::_cast(const std::type_info& type)
 {
-  // Do nothing
+  // This means we have an empty field
+  if(!_vtable)
+    return nullptr;
+
+  // TODO(MXG): If we ever need to support windows, we probably cannot rely
+  // on this check
+  if(*_vtable->type == type)
+    return _data();
+
+  // If the type check failed, then we should return a nullptr.
+  return nullptr;
 }
 
 //==============================================================================
-Field::Field(const Field& other)
-  : _pimpl(new Implementation(*other._pimpl))
+const void* Field::_cast(const std::type_info& type) const
 {
-  // Do nothing
+  return const_cast<Field&>(*this)._cast(type);
 }
 
 //==============================================================================
-Field::Field(Field&& other)
-  : _pimpl(std::move(other._pimpl))
+void* Field::_data()
 {
-  // Do nothing
+  if(_vtable->is_inline)
+    return _storage;
+
+  return *reinterpret_cast<void**>(_storage);
 }
 
 //==============================================================================
-Field& Field::operator=(const Field& other)
+void Field::_reset()
 {
-  *_pimpl = *other._pimpl;
-  return *this;
+  if(!_vtable)
+    return;
+
+  if(!_vtable->is_trivial)
+    _vtable->destroy(_storage);
+
+  _vtable = nullptr;
 }
 
 //==============================================================================
-Field& Field::operator=(Field&& other)
+void Field::_copy_from(const Field& other)
 {
-  _pimpl = std::move(other._pimpl);
-  return *this;
+  if(!other._vtable)
+    return;
+
+  if(other._vtable->is_trivial)
+    std::memcpy(_storage, other._storage, sizeof(_storage));
+  else
+    other._vtable->copy(const_cast<Field&>(other)._data(), _storage);
+
+  _vtable = other._vtable;
 }
 
 //==============================================================================
-std::string Field::type() const
+void Field::_move_from(Field& other) noexcept
 {
-  return _pimpl->type();
+  if(!other._vtable)
+    return;
+
+  if(other._vtable->is_trivial)
+    std::memcpy(_storage, other._storage, sizeof(_storage));
+  else
+    other._vtable->move(other._storage, _storage);
+
+  _vtable = other._vtable;
+  other._vtable = nullptr;
 }
 
+namespace {
 //==============================================================================
-Field::~Field()
+template<typename T>
+std::size_t vector_footprint(const Field& field)
 {
-  // Do nothing
+  return field.cast<std::vector<T>>()->capacity()*sizeof(T);
 }
 
 //==============================================================================
-void Field::_set(const std::type_info& type, void* data,
-                 std::function<void*(const void*)>&& copier,
-                 std::function<void(void*)>&& deleter)
+std::size_t string_footprint(const std::string& value)
 {
-  _pimpl->_set(type, data, std::move(copier), std::move(deleter));
+  // Short strings live inside of the std::string itself
+  return value.capacity() < sizeof(std::string)? 0 : value.capacity() + 1;
 }
 
 //==============================================================================
-void* Field::_cast(const std::type_info& type)
+std::size_t field_footprint(const Field& field)
+{
+  switch(field.type_tag())
+  {
+    case FieldTypeTag::String:
+      return string_footprint(*field.cast<std::string>());
+    case FieldTypeTag::Bool:
+    case FieldTypeTag::Int64:
+    case FieldTypeTag::UInt64:
+    case FieldTypeTag::Double:
+      return 0;
+    case FieldTypeTag::Message:
+      return memory_footprint(*field.cast<Message>());
+    case FieldTypeTag::StringVector:
+    {
+      const auto& values = *field.cast<std::vector<std::string>>();
+      std::size_t bytes = values.capacity()*sizeof(std::string);
+      for(const std::string& value : values)
+        bytes += string_footprint(value);
+
+      return bytes;
+    }
+    case FieldTypeTag::Int64Vector:
+      return vector_footprint<int64_t>(field);
+    case FieldTypeTag::UInt64Vector:
+      return vector_footprint<uint64_t>(field);
+    case FieldTypeTag::DoubleVector:
+      return vector_footprint<double>(field);
+    case FieldTypeTag::MessageVector:
+    {
+      const auto& values = *field.cast<std::vector<Message>>();
+      std::size_t bytes = values.capacity()*sizeof(Message);
+      for(const Message& value : values)
+        bytes += memory_footprint(value) - sizeof(Message);
+
+      return bytes;
+    }
+    case FieldTypeTag::UInt8Vector:
+      return vector_footprint<uint8_t>(field);
+    case FieldTypeTag::Int8Vector:
+      return vector_footprint<int8_t>(field);
+    case FieldTypeTag::UInt16Vector:
+      return vector_footprint<uint16_t>(field);
+    case FieldTypeTag::Int16Vector:
+      return vector_footprint<int16_t>(field);
+    case FieldTypeTag::UInt32Vector:
+      return vector_footprint<uint32_t>(field);
+    case FieldTypeTag::Int32Vector:
+      return vector_footprint<int32_t>(field);
+    case FieldTypeTag::FloatVector:
+      return vector_footprint<float>(field);
+    case FieldTypeTag::Blob:
+      return field.cast<Blob>()->size();
+    case FieldTypeTag::Other:
+      break;
+  }
+
+  // We cannot see inside of other types, so only count their storage
+  return 0;
+}
+
+} // anonymous namespace
+
+//==============================================================================
+std::size_t memory_footprint(const Message& message)
 {
-  return _pimpl->_cast(type);
+  std::size_t bytes = sizeof(Message)
+      + string_footprint(message.type)
+      + message.data.size()*sizeof(FieldMap::value_type);
+
+  for(const auto& field : message.data)
+    bytes += string_footprint(field.first) + field_footprint(field.second);
+
+  return bytes;
 }
 
 //==============================================================================
-const void* Field::_cast(const std::type_info& type) const
+NativeMessage::~NativeMessage()
 {
-  return _pimpl->_cast(type);
+  // Do nothing
 }
 
 } // namespace soss
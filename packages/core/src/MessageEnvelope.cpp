@@ -0,0 +1,127 @@
+/*
+ * Copyright (C) 2019 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include <soss/MessageEnvelope.hpp>
+
+#include <mutex>
+#include <unordered_map>
+
+namespace soss {
+
+//==============================================================================
+class MessageEnvelope::Implementation
+{
+public:
+
+  Implementation(const Message& message)
+    : _message(&message)
+  {
+    // Do nothing
+  }
+
+  Implementation(std::shared_ptr<const Message> message)
+    : _message(message.get()),
+      _owned(std::move(message))
+  {
+    // Do nothing
+  }
+
+  const Message& message() const
+  {
+    return *_message;
+  }
+
+  std::shared_ptr<const Message> retain()
+  {
+    std::unique_lock<std::mutex> lock(_mutex);
+    if(!_owned)
+      _owned = std::make_shared<Message>(*_message);
+
+    return _owned;
+  }
+
+  std::shared_ptr<const void> encoding(
+      const std::string& format,
+      const Encoder& encoder)
+  {
+    {
+      std::unique_lock<std::mutex> lock(_mutex);
+      const auto it = _encodings.find(format);
+      if(it != _encodings.end())
+        return it->second;
+    }
+
+    // We don't hold the lock while encoding, so that publishers of other
+    // formats are not blocked by us. If two publishers race to encode the same
+    // format, the first result to be stored wins and is shared by both.
+    std::shared_ptr<const void> encoded = encoder(*_message);
+
+    std::unique_lock<std::mutex> lock(_mutex);
+    return _encodings.insert(std::make_pair(format, std::move(encoded)))
+        .first->second;
+  }
+
+private:
+
+  const Message* const _message;
+  std::shared_ptr<const Message> _owned;
+  std::unordered_map<std::string, std::shared_ptr<const void>> _encodings;
+  std::mutex _mutex;
+
+};
+
+//==============================================================================
+MessageEnvelope::MessageEnvelope(const Message& message)
+  : _pimpl(new Implementation(message))
+{
+  // Do nothing
+}
+
+//==============================================================================
+MessageEnvelope::MessageEnvelope(std::shared_ptr<const Message> message)
+  : _pimpl(new Implementation(std::move(message)))
+{
+  // Do nothing
+}
+
+//==============================================================================
+const Message& MessageEnvelope::message() const
+{
+  return _pimpl->message();
+}
+
+//==============================================================================
+std::shared_ptr<const Message> MessageEnvelope::retain() const
+{
+  return _pimpl->retain();
+}
+
+//==============================================================================
+std::shared_ptr<const void> MessageEnvelope::_encoding(
+    const std::string& format,
+    const Encoder& encoder) const
+{
+  return _pimpl->encoding(format, encoder);
+}
+
+//==============================================================================
+MessageEnvelope::~MessageEnvelope()
+{
+  // Do nothing
+}
+
+} // namespace soss
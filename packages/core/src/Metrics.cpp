@@ -0,0 +1,714 @@
+/*
+ * Copyright (C) 2019 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include <soss/Metrics.hpp>
+
+#include <array>
+#include <atomic>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <vector>
+
+namespace soss {
+
+namespace {
+
+//==============================================================================
+/// Upper bounds of the histogram buckets, in seconds. These cover everything
+/// from a fast in-process hop to a badly stalled network sink.
+const std::array<double, 12> HistogramBounds = {
+  0.00001, 0.00005, 0.0001, 0.0005,
+  0.001, 0.005, 0.01, 0.05,
+  0.1, 0.5, 1.0, 5.0
+};
+
+//==============================================================================
+class Histogram
+{
+public:
+
+  Histogram()
+    : _sum_ns(0)
+  {
+    for(auto& bucket : _buckets)
+      bucket = 0;
+  }
+
+  void record(const std::chrono::nanoseconds duration)
+  {
+    const double seconds = std::chrono::duration<double>(duration).count();
+    std::size_t i = 0;
+    while(i < HistogramBounds.size() && HistogramBounds[i] < seconds)
+      ++i;
+
+    _buckets[i].fetch_add(1, std::memory_order_relaxed);
+    _sum_ns.fetch_add(
+          static_cast<uint64_t>(duration.count()), std::memory_order_relaxed);
+  }
+
+  void render(
+      std::ostream& out,
+      const std::string& name,
+      const std::string& labels) const
+  {
+    uint64_t cumulative = 0;
+    for(std::size_t i=0; i < HistogramBounds.size(); ++i)
+    {
+      cumulative += _buckets[i].load(std::memory_order_relaxed);
+      out << name << "_bucket{" << labels << ",le=\"" << HistogramBounds[i]
+          << "\"} " << cumulative << "\n";
+    }
+
+    cumulative += _buckets.back().load(std::memory_order_relaxed);
+    out << name << "_bucket{" << labels << ",le=\"+Inf\"} "
+        << cumulative << "\n";
+    out << name << "_sum{" << labels << "} "
+        << static_cast<double>(_sum_ns.load(std::memory_order_relaxed))*1e-9
+        << "\n";
+    out << name << "_count{" << labels << "} " << cumulative << "\n";
+  }
+
+private:
+
+  // The final bucket catches everything above the largest bound
+  std::array<std::atomic<uint64_t>, HistogramBounds.size()+1> _buckets;
+  std::atomic<uint64_t> _sum_ns;
+
+};
+
+//==============================================================================
+std::string escape_label(const std::string& value)
+{
+  std::string escaped;
+  escaped.reserve(value.size());
+  for(const char c : value)
+  {
+    if(c == '\\' || c == '"')
+      escaped.push_back('\\');
+
+    if(c == '\n')
+    {
+      escaped += "\\n";
+      continue;
+    }
+
+    escaped.push_back(c);
+  }
+
+  return escaped;
+}
+
+//==============================================================================
+/// The memory that is accounted to every channel of the process together
+std::atomic<uint64_t>& process_memory()
+{
+  static std::atomic<uint64_t> bytes(0);
+  return bytes;
+}
+
+//==============================================================================
+std::atomic<uint64_t>& memory_budget_bytes()
+{
+  static std::atomic<uint64_t> bytes(0);
+  return bytes;
+}
+
+} // anonymous namespace
+
+//==============================================================================
+class ChannelMetrics::Implementation
+{
+public:
+
+  Implementation()
+    : messages(0),
+      bytes(0),
+      drops(0),
+      queue_depth(0),
+      buffered_bytes(0),
+      memory(0)
+  {
+    // Do nothing
+  }
+
+  std::atomic<uint64_t> messages;
+  std::atomic<uint64_t> bytes;
+  std::atomic<uint64_t> drops;
+  std::atomic<uint64_t> queue_depth;
+  std::atomic<uint64_t> buffered_bytes;
+  std::atomic<uint64_t> memory;
+  Histogram latency;
+  Histogram conversion;
+
+};
+
+//==============================================================================
+ChannelMetrics::ChannelMetrics()
+  : _pimpl(new Implementation)
+{
+  // Do nothing
+}
+
+//==============================================================================
+void ChannelMetrics::count_message()
+{
+  _pimpl->messages.fetch_add(1, std::memory_order_relaxed);
+}
+
+//==============================================================================
+void ChannelMetrics::count_bytes(const std::size_t bytes)
+{
+  _pimpl->bytes.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+//==============================================================================
+void ChannelMetrics::count_drop()
+{
+  _pimpl->drops.fetch_add(1, std::memory_order_relaxed);
+}
+
+//==============================================================================
+void ChannelMetrics::set_queue_depth(const std::size_t depth)
+{
+  _pimpl->queue_depth.store(depth, std::memory_order_relaxed);
+}
+
+//==============================================================================
+void ChannelMetrics::set_buffered_bytes(const std::size_t bytes)
+{
+  const uint64_t previous =
+      _pimpl->buffered_bytes.exchange(bytes, std::memory_order_relaxed);
+
+  // Unsigned arithmetic wraps around, so adding the difference also works
+  // when the buffer shrinks
+  const uint64_t difference = bytes - previous;
+  _pimpl->memory.fetch_add(difference, std::memory_order_relaxed);
+  process_memory().fetch_add(difference, std::memory_order_relaxed);
+}
+
+//==============================================================================
+bool ChannelMetrics::reserve_memory(const std::size_t bytes)
+{
+  std::atomic<uint64_t>& total = process_memory();
+  const uint64_t budget = memory_budget_bytes().load(std::memory_order_relaxed);
+
+  uint64_t current = total.load(std::memory_order_relaxed);
+  do
+  {
+    if(budget > 0 && current + bytes > budget)
+      return false;
+  } while(!total.compare_exchange_weak(
+            current, current + bytes, std::memory_order_relaxed));
+
+  _pimpl->memory.fetch_add(bytes, std::memory_order_relaxed);
+  return true;
+}
+
+//==============================================================================
+void ChannelMetrics::release_memory(const std::size_t bytes)
+{
+  _pimpl->memory.fetch_sub(bytes, std::memory_order_relaxed);
+  process_memory().fetch_sub(bytes, std::memory_order_relaxed);
+}
+
+//==============================================================================
+void ChannelMetrics::record_latency(const std::chrono::nanoseconds duration)
+{
+  _pimpl->latency.record(duration);
+}
+
+//==============================================================================
+void ChannelMetrics::record_conversion(const std::chrono::nanoseconds duration)
+{
+  _pimpl->conversion.record(duration);
+}
+
+//==============================================================================
+ChannelMetrics::~ChannelMetrics()
+{
+  // Do nothing
+}
+
+namespace {
+
+//==============================================================================
+struct Registry
+{
+  using ChannelMap = std::map<std::string, std::unique_ptr<ChannelMetrics>>;
+
+  std::mutex mutex;
+  ChannelMap topics;
+  ChannelMap services;
+  ChannelMap connections;
+  std::map<std::pair<std::string, std::string>,
+           std::unique_ptr<ChannelMetrics>> routes;
+
+  // Seconds taken by each (phase, component) of the startup
+  std::map<std::pair<std::string, std::string>, double> startup;
+
+  struct Thread
+  {
+    double cpu_seconds;
+    double stall_seconds;
+    std::size_t stalls;
+  };
+
+  std::map<std::string, Thread> threads;
+
+  static Registry& get()
+  {
+    static Registry registry;
+    return registry;
+  }
+};
+
+//==============================================================================
+using ChannelList =
+    std::vector<std::pair<std::string, const ChannelMetrics::Implementation*>>;
+
+//==============================================================================
+void render_channels(
+    std::ostream& out,
+    const std::string& kind,
+    const ChannelList& channels)
+{
+  if(channels.empty())
+    return;
+
+  const std::string prefix = "soss_" + kind;
+  const auto labels = [&](const std::string& channel)
+  {
+    return kind + "=\"" + escape_label(channel) + "\"";
+  };
+
+  struct Scalar
+  {
+    const char* metric;
+    const char* type;
+    const char* help;
+    std::atomic<uint64_t> ChannelMetrics::Implementation::* field;
+  };
+
+  const Scalar scalars[] = {
+    {"messages_total", "counter", "Messages that passed through the channel",
+     &ChannelMetrics::Implementation::messages},
+    {"bytes_total", "counter", "Bytes that were sent or received on the wire",
+     &ChannelMetrics::Implementation::bytes},
+    {"dropped_total", "counter", "Messages that were discarded",
+     &ChannelMetrics::Implementation::drops},
+    {"queue_depth", "gauge", "Messages waiting in the queue of the channel",
+     &ChannelMetrics::Implementation::queue_depth},
+    {"buffered_bytes", "gauge", "Bytes waiting to be written to the wire",
+     &ChannelMetrics::Implementation::buffered_bytes},
+    {"memory_bytes", "gauge", "Bytes of memory held on behalf of the channel",
+     &ChannelMetrics::Implementation::memory}
+  };
+
+  for(const Scalar& scalar : scalars)
+  {
+    const std::string name = prefix + "_" + scalar.metric;
+    out << "# HELP " << name << " " << scalar.help << "\n";
+    out << "# TYPE " << name << " " << scalar.type << "\n";
+    for(const auto& entry : channels)
+    {
+      const ChannelMetrics::Implementation& impl = *entry.second;
+      out << name << "{" << labels(entry.first) << "} "
+          << (impl.*scalar.field).load(std::memory_order_relaxed) << "\n";
+    }
+  }
+
+  struct Distribution
+  {
+    const char* metric;
+    const char* help;
+    Histogram ChannelMetrics::Implementation::* field;
+  };
+
+  const Distribution distributions[] = {
+    {"latency_seconds", "Time taken to deliver a message or answer a request",
+     &ChannelMetrics::Implementation::latency},
+    {"conversion_seconds", "Time that middlewares spent converting messages",
+     &ChannelMetrics::Implementation::conversion}
+  };
+
+  for(const Distribution& distribution : distributions)
+  {
+    const std::string name = prefix + "_" + distribution.metric;
+    out << "# HELP " << name << " " << distribution.help << "\n";
+    out << "# TYPE " << name << " histogram\n";
+    for(const auto& entry : channels)
+    {
+      const ChannelMetrics::Implementation& impl = *entry.second;
+      (impl.*distribution.field).render(out, name, labels(entry.first));
+    }
+  }
+}
+
+//==============================================================================
+void render_routes(
+    std::ostream& out,
+    const std::vector<std::pair<std::pair<std::string, std::string>,
+                                const ChannelMetrics::Implementation*>>& routes)
+{
+  if(routes.empty())
+    return;
+
+  const std::string name = "soss_route_latency_seconds";
+  out << "# HELP " << name << " Time from the ingress of a message until it "
+      << "was published to its destination\n";
+  out << "# TYPE " << name << " histogram\n";
+  for(const auto& entry : routes)
+  {
+    entry.second->latency.render(
+          out, name,
+          "topic=\"" + escape_label(entry.first.first) + "\",destination=\""
+          + escape_label(entry.first.second) + "\"");
+  }
+}
+
+//==============================================================================
+void render_startup(
+    std::ostream& out,
+    const std::map<std::pair<std::string, std::string>, double>& startup)
+{
+  if(startup.empty())
+    return;
+
+  const std::string name = "soss_startup_seconds";
+  out << "# HELP " << name << " Time taken by each phase of the startup\n";
+  out << "# TYPE " << name << " gauge\n";
+  for(const auto& entry : startup)
+  {
+    out << name << "{phase=\"" << escape_label(entry.first.first)
+        << "\",component=\"" << escape_label(entry.first.second) << "\"} "
+        << entry.second << "\n";
+  }
+}
+
+//==============================================================================
+void render_threads(
+    std::ostream& out,
+    const std::map<std::string, Registry::Thread>& threads)
+{
+  if(threads.empty())
+    return;
+
+  struct Value
+  {
+    const char* metric;
+    const char* type;
+    const char* help;
+    double (*get)(const Registry::Thread&);
+  };
+
+  const Value values[] = {
+    {"cpu_seconds_total", "counter", "CPU time taken by the work of the thread",
+     [](const Registry::Thread& t) { return t.cpu_seconds; }},
+    {"stall_seconds", "gauge", "How long the thread has been stuck on its "
+     "current piece of work",
+     [](const Registry::Thread& t) { return t.stall_seconds; }},
+    {"stalls_total", "counter", "Times that the thread got stuck",
+     [](const Registry::Thread& t) { return static_cast<double>(t.stalls); }}
+  };
+
+  for(const Value& value : values)
+  {
+    const std::string name = std::string("soss_thread_") + value.metric;
+    out << "# HELP " << name << " " << value.help << "\n";
+    out << "# TYPE " << name << " " << value.type << "\n";
+    for(const auto& entry : threads)
+    {
+      out << name << "{thread=\"" << escape_label(entry.first) << "\"} "
+          << value.get(entry.second) << "\n";
+    }
+  }
+}
+
+//==============================================================================
+void render_memory(std::ostream& out)
+{
+  const std::string name = "soss_memory_bytes";
+  out << "# HELP " << name << " Bytes of memory held on behalf of every "
+      << "channel together\n";
+  out << "# TYPE " << name << " gauge\n";
+  out << name << " " << process_memory().load(std::memory_order_relaxed)
+      << "\n";
+
+  const uint64_t budget = memory_budget_bytes().load(std::memory_order_relaxed);
+  if(budget == 0)
+    return;
+
+  const std::string budget_name = "soss_memory_budget_bytes";
+  out << "# HELP " << budget_name << " The most memory that the channels may "
+      << "hold on to\n";
+  out << "# TYPE " << budget_name << " gauge\n";
+  out << budget_name << " " << budget << "\n";
+}
+
+} // anonymous namespace
+
+//==============================================================================
+ChannelMetrics& Metrics::topic(const std::string& name)
+{
+  Registry& registry = Registry::get();
+  std::unique_lock<std::mutex> lock(registry.mutex);
+  std::unique_ptr<ChannelMetrics>& channel = registry.topics[name];
+  if(!channel)
+    channel.reset(new ChannelMetrics);
+
+  return *channel;
+}
+
+//==============================================================================
+ChannelMetrics& Metrics::service(const std::string& name)
+{
+  Registry& registry = Registry::get();
+  std::unique_lock<std::mutex> lock(registry.mutex);
+  std::unique_ptr<ChannelMetrics>& channel = registry.services[name];
+  if(!channel)
+    channel.reset(new ChannelMetrics);
+
+  return *channel;
+}
+
+//==============================================================================
+ChannelMetrics& Metrics::connection(const std::string& name)
+{
+  Registry& registry = Registry::get();
+  std::unique_lock<std::mutex> lock(registry.mutex);
+  std::unique_ptr<ChannelMetrics>& channel = registry.connections[name];
+  if(!channel)
+    channel.reset(new ChannelMetrics);
+
+  return *channel;
+}
+
+//==============================================================================
+void Metrics::release_connection(const std::string& name)
+{
+  Registry& registry = Registry::get();
+  std::unique_lock<std::mutex> lock(registry.mutex);
+  const auto it = registry.connections.find(name);
+  if(it == registry.connections.end())
+    return;
+
+  // Whatever the connection was still holding goes away along with it
+  process_memory().fetch_sub(
+        it->second->_pimpl->memory.load(std::memory_order_relaxed),
+        std::memory_order_relaxed);
+
+  registry.connections.erase(it);
+}
+
+//==============================================================================
+ChannelMetrics& Metrics::route(
+    const std::string& topic,
+    const std::string& destination)
+{
+  Registry& registry = Registry::get();
+  std::unique_lock<std::mutex> lock(registry.mutex);
+  std::unique_ptr<ChannelMetrics>& channel =
+      registry.routes[std::make_pair(topic, destination)];
+  if(!channel)
+    channel.reset(new ChannelMetrics);
+
+  return *channel;
+}
+
+//==============================================================================
+void Metrics::record_startup(
+    const std::string& phase,
+    const std::string& component,
+    const std::chrono::nanoseconds duration)
+{
+  Registry& registry = Registry::get();
+  std::unique_lock<std::mutex> lock(registry.mutex);
+  registry.startup[std::make_pair(phase, component)] =
+      std::chrono::duration<double>(duration).count();
+}
+
+//==============================================================================
+void Metrics::record_thread(
+    const std::string& thread,
+    const std::chrono::nanoseconds cpu_time,
+    const std::chrono::nanoseconds stalled,
+    const std::size_t stalls)
+{
+  Registry& registry = Registry::get();
+  std::unique_lock<std::mutex> lock(registry.mutex);
+  registry.threads[thread] = Registry::Thread{
+      std::chrono::duration<double>(cpu_time).count(),
+      std::chrono::duration<double>(stalled).count(),
+      stalls};
+}
+
+//==============================================================================
+void Metrics::release_thread(const std::string& thread)
+{
+  Registry& registry = Registry::get();
+  std::unique_lock<std::mutex> lock(registry.mutex);
+  registry.threads.erase(thread);
+}
+
+//==============================================================================
+void Metrics::set_memory_budget(const std::size_t bytes)
+{
+  memory_budget_bytes().store(bytes, std::memory_order_relaxed);
+}
+
+//==============================================================================
+std::size_t Metrics::memory_budget()
+{
+  return memory_budget_bytes().load(std::memory_order_relaxed);
+}
+
+//==============================================================================
+std::size_t Metrics::memory_bytes()
+{
+  return process_memory().load(std::memory_order_relaxed);
+}
+
+//==============================================================================
+bool Metrics::over_memory_budget()
+{
+  const uint64_t budget = memory_budget_bytes().load(std::memory_order_relaxed);
+  return budget > 0
+      && process_memory().load(std::memory_order_relaxed) >= budget;
+}
+
+//==============================================================================
+std::string Metrics::to_prometheus()
+{
+  Registry& registry = Registry::get();
+  std::unique_lock<std::mutex> lock(registry.mutex);
+
+  const auto list = [](const Registry::ChannelMap& channels)
+  {
+    ChannelList result;
+    result.reserve(channels.size());
+    for(const auto& entry : channels)
+      result.emplace_back(entry.first, entry.second->_pimpl.get());
+
+    return result;
+  };
+
+  std::ostringstream out;
+  render_channels(out, "topic", list(registry.topics));
+  render_channels(out, "service", list(registry.services));
+  render_channels(out, "connection", list(registry.connections));
+
+  std::vector<std::pair<std::pair<std::string, std::string>,
+                        const ChannelMetrics::Implementation*>> routes;
+  routes.reserve(registry.routes.size());
+  for(const auto& entry : registry.routes)
+    routes.emplace_back(entry.first, entry.second->_pimpl.get());
+
+  render_routes(out, routes);
+  render_startup(out, registry.startup);
+  render_threads(out, registry.threads);
+  render_memory(out);
+  return out.str();
+}
+
+//==============================================================================
+bool Metrics::write_prometheus(const std::string& filename)
+{
+  // Write to a temporary file and then rename it, so that a scraper can never
+  // read a half-written file.
+  const std::string temp_filename = filename + ".tmp";
+  {
+    std::ofstream file(temp_filename, std::ios::trunc);
+    if(!file)
+    {
+      std::cerr << "Unable to open the metrics file [" << temp_filename
+                << "] for writing!" << std::endl;
+      return false;
+    }
+
+    file << to_prometheus();
+    if(!file)
+    {
+      std::cerr << "Failed while writing the metrics file [" << temp_filename
+                << "]!" << std::endl;
+      return false;
+    }
+  }
+
+  if(std::rename(temp_filename.c_str(), filename.c_str()) != 0)
+  {
+    std::cerr << "Unable to move the metrics file [" << temp_filename
+              << "] to [" << filename << "]!" << std::endl;
+    return false;
+  }
+
+  return true;
+}
+
+namespace {
+
+//==============================================================================
+std::atomic_bool ingress_enabled(false);
+
+// The ingress of the message that this thread is handing to soss, if its
+// middleware opened a scope for it
+thread_local bool ingress_marked = false;
+thread_local Ingress::Clock::time_point ingress_time;
+
+} // anonymous namespace
+
+//==============================================================================
+Ingress::Scope::Scope()
+  : _active(ingress_enabled.load(std::memory_order_relaxed) && !ingress_marked)
+{
+  // A scope that opens inside of another one leaves the outer mark alone
+  if(!_active)
+    return;
+
+  ingress_time = Clock::now();
+  ingress_marked = true;
+}
+
+//==============================================================================
+Ingress::Scope::~Scope()
+{
+  if(_active)
+    ingress_marked = false;
+}
+
+//==============================================================================
+Ingress::Clock::time_point Ingress::time()
+{
+  return ingress_marked? ingress_time : Clock::now();
+}
+
+//==============================================================================
+void Ingress::set_enabled(const bool enabled)
+{
+  ingress_enabled.store(enabled, std::memory_order_relaxed);
+}
+
+//==============================================================================
+bool Ingress::enabled()
+{
+  return ingress_enabled.load(std::memory_order_relaxed);
+}
+
+} // namespace soss
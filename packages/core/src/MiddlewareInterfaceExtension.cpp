@@ -17,8 +17,11 @@
 
 #include <soss/MiddlewareInterfaceExtension.hpp>
 
+#include <algorithm>
+#include <atomic>
 #include <experimental/filesystem>
 #include <iostream>
+#include <thread>
 
 #ifdef WIN32
 // WINDOWS includes
@@ -26,6 +29,7 @@
 #include <assert.h>
 #else
 #include <dlfcn.h>
+#include <cassert>
 #endif
 
 #ifdef WIN32
@@ -176,6 +180,46 @@ bool Mix::load() const
   return _pimpl->load();
 }
 
+//==============================================================================
+bool Mix::load_files(const std::vector<std::string>& filenames)
+{
+  std::atomic_size_t next(0);
+  std::atomic_bool success(true);
+  const auto load_next = [&]()
+  {
+    for(std::size_t i = next++; i < filenames.size(); i = next++)
+    {
+      try
+      {
+        if(!from_file(filenames[i]).load())
+          success = false;
+      }
+      catch(const YAML::Exception& e)
+      {
+        std::cerr << "Failed to read the extension [" << filenames[i] << "]: "
+                  << e.what() << std::endl;
+        success = false;
+      }
+    }
+  };
+
+  // The dynamic loader serializes much of its work, so a handful of threads
+  // is all that it takes to hide the time spent parsing and searching.
+  const std::size_t thread_count = std::min<std::size_t>(
+        {filenames.size(), std::max(1u, std::thread::hardware_concurrency()),
+         8});
+
+  std::vector<std::thread> threads;
+  for(std::size_t i = 1; i < thread_count; ++i)
+    threads.emplace_back(load_next);
+
+  load_next();
+  for(std::thread& thread : threads)
+    thread.join();
+
+  return success;
+}
+
 //==============================================================================
 Mix::~MiddlewareInterfaceExtension()
 {
@@ -0,0 +1,420 @@
+/*
+ * Copyright (C) 2019 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+
+#include "RouteTable.hpp"
+
+#include <algorithm>
+#include <atomic>
+
+namespace soss {
+namespace internal {
+
+namespace {
+
+//==============================================================================
+/// The key of everything that a middleware makes with the same arguments
+std::string make_group_key(
+    const std::string& middleware,
+    const std::string& name,
+    const std::string& type,
+    const YAML::Node& configuration)
+{
+  std::string key = middleware;
+  key.append(1, '\n').append(name);
+  key.append(1, '\n').append(type);
+  key.append(1, '\n').append(YAML::Dump(configuration));
+  return key;
+}
+
+//==============================================================================
+std::string make_key(const std::string& channel, const std::string& group)
+{
+  return channel + '\n' + group;
+}
+
+//==============================================================================
+template<typename T>
+void merge(std::set<T>& into, const std::set<T>& from)
+{
+  into.insert(from.begin(), from.end());
+}
+
+//==============================================================================
+template<typename K, typename V>
+void merge(std::map<K, V>& into, const std::map<K, V>& from)
+{
+  into.insert(from.begin(), from.end());
+}
+
+} // anonymous namespace
+
+//==============================================================================
+bool RouteTable::subscribe(
+    const std::string& channel,
+    const std::string& middleware,
+    TopicSubscriberSystem& system,
+    const std::string& topic_name,
+    const std::string& message_type,
+    SubscriptionCallback callback,
+    const YAML::Node& configuration)
+{
+  const std::string group =
+      make_group_key(middleware, topic_name, message_type, configuration);
+  const std::string key = make_key(channel, group);
+  auto route = std::make_shared<const SubscriptionCallback>(std::move(callback));
+
+  std::unique_lock<std::mutex> lock(_mutex);
+  const auto it = _subscriptions.find(key);
+  if(it != _subscriptions.end())
+  {
+    std::atomic_store(&it->second->route, std::move(route));
+    _channels[channel].subscriptions.insert(key);
+    return true;
+  }
+
+  const auto slot = std::make_shared<SubscriptionSlot>();
+  slot->route = std::move(route);
+  slot->group = group;
+
+  const SubscriptionCallback forward(
+        [slot](const Message& message)
+  {
+    if(const auto route = std::atomic_load(&slot->route))
+      (*route)(message);
+  },
+        [slot](Message&& message)
+  {
+    if(const auto route = std::atomic_load(&slot->route))
+      (*route)(std::move(message));
+  });
+
+  if(!system.subscribe(topic_name, message_type, forward, configuration))
+    return false;
+
+  Group& subscriptions = _subscription_groups[group];
+  if(!subscriptions.release)
+  {
+    subscriptions.release = [&system, topic_name, message_type, configuration]()
+    {
+      return system.unsubscribe(topic_name, message_type, configuration);
+    };
+  }
+
+  subscriptions.keys.push_back(key);
+  _subscriptions.insert(std::make_pair(key, slot));
+  _channels[channel].subscriptions.insert(key);
+  return true;
+}
+
+//==============================================================================
+std::shared_ptr<TopicPublisher> RouteTable::advertise(
+    const std::string& channel,
+    const std::string& middleware,
+    TopicPublisherSystem& system,
+    const std::string& topic_name,
+    const std::string& message_type,
+    const YAML::Node& configuration)
+{
+  const std::string key = make_key(
+        channel,
+        make_group_key(middleware, topic_name, message_type, configuration));
+
+  std::unique_lock<std::mutex> lock(_mutex);
+  std::shared_ptr<TopicPublisher> publisher =
+      _find(channel, &Channel::publishers, key);
+
+  if(!publisher)
+    publisher = system.advertise(topic_name, message_type, configuration);
+
+  if(publisher)
+    _channels[channel].publishers[key] = publisher;
+
+  return publisher;
+}
+
+//==============================================================================
+bool RouteTable::create_client_proxy(
+    const std::string& channel,
+    const std::string& middleware,
+    ServiceClientSystem& system,
+    const std::string& service_name,
+    const std::string& service_type,
+    RequestCallback callback,
+    const YAML::Node& configuration)
+{
+  const std::string group =
+      make_group_key(middleware, service_name, service_type, configuration);
+  const std::string key = make_key(channel, group);
+  auto route = std::make_shared<const RequestCallback>(std::move(callback));
+
+  std::unique_lock<std::mutex> lock(_mutex);
+  const auto it = _clients.find(key);
+  if(it != _clients.end())
+  {
+    std::atomic_store(&it->second->route, std::move(route));
+    _channels[channel].clients.insert(key);
+    return true;
+  }
+
+  const auto slot = std::make_shared<ClientSlot>();
+  slot->route = std::move(route);
+  slot->group = group;
+
+  const RequestCallback forward = [slot](
+      const Message& request,
+      ServiceClient& client,
+      std::shared_ptr<void> call_handle)
+  {
+    if(const auto route = std::atomic_load(&slot->route))
+    {
+      (*route)(request, client, std::move(call_handle));
+      return;
+    }
+
+    client.receive_error(
+          std::move(call_handle),
+          "the service is no longer part of the soss configuration");
+  };
+
+  if(!system.create_client_proxy(
+       service_name, service_type, forward, configuration))
+    return false;
+
+  Group& clients = _client_groups[group];
+  if(!clients.release)
+  {
+    clients.release = [&system, service_name, service_type, configuration]()
+    {
+      return system.release_client_proxy(
+            service_name, service_type, configuration);
+    };
+  }
+
+  clients.keys.push_back(key);
+  _clients.insert(std::make_pair(key, slot));
+  _channels[channel].clients.insert(key);
+  return true;
+}
+
+//==============================================================================
+std::shared_ptr<ServiceProvider> RouteTable::create_service_proxy(
+    const std::string& channel,
+    const std::string& middleware,
+    ServiceProviderSystem& system,
+    const std::string& service_name,
+    const std::string& service_type,
+    const YAML::Node& configuration)
+{
+  const std::string key = make_key(
+        channel,
+        make_group_key(middleware, service_name, service_type, configuration));
+
+  std::unique_lock<std::mutex> lock(_mutex);
+  std::shared_ptr<ServiceProvider> provider =
+      _find(channel, &Channel::providers, key);
+
+  if(!provider)
+  {
+    provider = system.create_service_proxy(
+          service_name, service_type, configuration);
+  }
+
+  if(provider)
+    _channels[channel].providers[key] = provider;
+
+  return provider;
+}
+
+//==============================================================================
+void RouteTable::set_executor(std::shared_ptr<Executor> executor)
+{
+  std::unique_lock<std::mutex> lock(_mutex);
+  _executor = std::move(executor);
+}
+
+//==============================================================================
+std::shared_ptr<Executor> RouteTable::executor() const
+{
+  std::unique_lock<std::mutex> lock(_mutex);
+  return _executor;
+}
+
+//==============================================================================
+void RouteTable::add_queue(const std::string& channel, TopicQueuePtr queue)
+{
+  std::unique_lock<std::mutex> lock(_mutex);
+  _channels[channel].queues.push_back(std::move(queue));
+}
+
+//==============================================================================
+void RouteTable::begin(const std::string& channel)
+{
+  std::unique_lock<std::mutex> lock(_mutex);
+  const auto it = _channels.find(channel);
+  if(it == _channels.end())
+    return;
+
+  // If the channel is begun twice, it keeps everything it had before either
+  Channel& previous = _previous[channel];
+  merge(previous.subscriptions, it->second.subscriptions);
+  merge(previous.clients, it->second.clients);
+  merge(previous.publishers, it->second.publishers);
+  merge(previous.providers, it->second.providers);
+  previous.queues.insert(
+        previous.queues.end(),
+        it->second.queues.begin(), it->second.queues.end());
+
+  _channels.erase(it);
+}
+
+//==============================================================================
+void RouteTable::finish(const std::string& channel)
+{
+  // The publishers and providers that are no longer used get released as this
+  // goes out of scope, after the routes that were using them have been cut.
+  Channel previous;
+
+  {
+    std::unique_lock<std::mutex> lock(_mutex);
+    const auto pit = _previous.find(channel);
+    if(pit == _previous.end())
+      return;
+
+    previous = std::move(pit->second);
+    _previous.erase(pit);
+
+    const Channel none;
+    const auto cit = _channels.find(channel);
+    _cut(previous, cit == _channels.end()? none : cit->second);
+  }
+
+  // Stopping a queue waits for its worker, which may be publishing right now
+  for(const TopicQueuePtr& queue : previous.queues)
+    queue->stop();
+}
+
+//==============================================================================
+void RouteTable::remove(const std::string& channel)
+{
+  begin(channel);
+  finish(channel);
+}
+
+//==============================================================================
+void RouteTable::stop_queues()
+{
+  std::vector<TopicQueuePtr> queues;
+  {
+    std::unique_lock<std::mutex> lock(_mutex);
+    for(const auto* channels : {&_channels, &_previous})
+    {
+      for(const auto& entry : *channels)
+      {
+        queues.insert(
+              queues.end(),
+              entry.second.queues.begin(), entry.second.queues.end());
+      }
+    }
+  }
+
+  for(const TopicQueuePtr& queue : queues)
+    queue->stop();
+}
+
+//==============================================================================
+template<typename T>
+std::shared_ptr<T> RouteTable::_find(
+    const std::string& channel,
+    std::map<std::string, std::shared_ptr<T>> Channel::* field,
+    const std::string& key) const
+{
+  for(const auto* channels : {&_channels, &_previous})
+  {
+    const auto cit = channels->find(channel);
+    if(cit == channels->end())
+      continue;
+
+    const auto& entries = cit->second.*field;
+    const auto it = entries.find(key);
+    if(it != entries.end())
+      return it->second;
+  }
+
+  return nullptr;
+}
+
+//==============================================================================
+void RouteTable::_cut(const Channel& previous, const Channel& current)
+{
+  for(const std::string& key : previous.subscriptions)
+  {
+    if(current.subscriptions.count(key) == 0)
+      _cut(key, _subscriptions, _subscription_groups);
+  }
+
+  for(const std::string& key : previous.clients)
+  {
+    if(current.clients.count(key) == 0)
+      _cut(key, _clients, _client_groups);
+  }
+}
+
+//==============================================================================
+template<typename Callback>
+void RouteTable::_cut(
+    const std::string& key,
+    std::map<std::string, std::shared_ptr<Slot<Callback>>>& slots,
+    std::map<std::string, Group>& groups)
+{
+  const auto it = slots.find(key);
+  if(it == slots.end())
+    return;
+
+  const std::shared_ptr<Slot<Callback>> slot = it->second;
+  std::atomic_store(&slot->route, std::shared_ptr<const Callback>());
+
+  const auto git = groups.find(slot->group);
+  Group& group = git->second;
+  const std::string last = group.keys.back();
+  if(last != key)
+  {
+    // Drop the route of the last slot before it moves, so that no message
+    // gets delivered twice while both slots have it
+    std::shared_ptr<Slot<Callback>>& moving = slots.at(last);
+    const auto route = std::atomic_exchange(
+          &moving->route, std::shared_ptr<const Callback>());
+    std::atomic_store(&slot->route, route);
+
+    std::swap(moving, it->second);
+    *std::find(group.keys.begin(), group.keys.end(), key) = last;
+    group.keys.back() = key;
+  }
+
+  // The middleware may keep the last slot, in which case it gets reused when
+  // a channel asks for it again
+  if(!group.release())
+    return;
+
+  slots.erase(it);
+  group.keys.pop_back();
+  if(group.keys.empty())
+    groups.erase(git);
+}
+
+} // namespace internal
+} // namespace soss
@@ -0,0 +1,204 @@
+/*
+ * Copyright (C) 2019 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+
+#ifndef SOSS__INTERNAL__ROUTETABLE_HPP
+#define SOSS__INTERNAL__ROUTETABLE_HPP
+
+#include "TopicQueue.hpp"
+
+#include <soss/SystemHandle.hpp>
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace soss {
+namespace internal {
+
+//==============================================================================
+/// RouteTable keeps track of the subscriptions, publishers and service proxies
+/// that each topic and service of the configuration (each channel) has gotten
+/// from the middlewares.
+///
+/// The callbacks that the middlewares are given for subscriptions and client
+/// proxies forward to a route that the table can replace or cut off. That lets
+/// a channel be configured again while soss is running: begin() the channel,
+/// ask for whatever the new version of the channel needs, and finish() it.
+/// Anything that the channel asks for again gets reused, and anything that it
+/// no longer asks for gets cut off and handed back to its middleware, see
+/// TopicSubscriberSystem::unsubscribe(~). Middlewares that cannot take it back
+/// keep it, and it gets reused if a channel asks for it again.
+class RouteTable
+{
+public:
+
+  using SubscriptionCallback = TopicSubscriberSystem::SubscriptionCallback;
+  using RequestCallback = ServiceClientSystem::RequestCallback;
+
+  /// \brief Subscribe to a topic on behalf of a channel. If the channel already
+  /// had a subscription with the same arguments, its messages get rerouted to
+  /// the new callback instead of subscribing again.
+  bool subscribe(
+      const std::string& channel,
+      const std::string& middleware,
+      TopicSubscriberSystem& system,
+      const std::string& topic_name,
+      const std::string& message_type,
+      SubscriptionCallback callback,
+      const YAML::Node& configuration);
+
+  /// \brief Advertise a topic on behalf of a channel, or get the publisher
+  /// that the channel had already been given for the same arguments.
+  std::shared_ptr<TopicPublisher> advertise(
+      const std::string& channel,
+      const std::string& middleware,
+      TopicPublisherSystem& system,
+      const std::string& topic_name,
+      const std::string& message_type,
+      const YAML::Node& configuration);
+
+  /// \brief Create a client proxy on behalf of a channel. If the channel
+  /// already had one with the same arguments, its requests get rerouted to the
+  /// new callback instead.
+  bool create_client_proxy(
+      const std::string& channel,
+      const std::string& middleware,
+      ServiceClientSystem& system,
+      const std::string& service_name,
+      const std::string& service_type,
+      RequestCallback callback,
+      const YAML::Node& configuration);
+
+  /// \brief Create a service proxy on behalf of a channel, or get the one that
+  /// the channel had already been given for the same arguments.
+  std::shared_ptr<ServiceProvider> create_service_proxy(
+      const std::string& channel,
+      const std::string& middleware,
+      ServiceProviderSystem& system,
+      const std::string& service_name,
+      const std::string& service_type,
+      const YAML::Node& configuration);
+
+  /// \brief Set the executor that the queues of the topics should run on
+  /// instead of on threads of their own. This only affects the queues that
+  /// get created afterwards.
+  void set_executor(std::shared_ptr<Executor> executor);
+
+  /// \brief The executor that the queues should run on, or a nullptr if each
+  /// queue should have a thread of its own
+  std::shared_ptr<Executor> executor() const;
+
+  /// \brief Hand over the queue of a topic. It gets stopped once the channel
+  /// is finished with a configuration that no longer uses it.
+  void add_queue(const std::string& channel, TopicQueuePtr queue);
+
+  /// \brief Get ready to configure a channel again. Until finish(channel) gets
+  /// called, whatever the channel had before keeps working.
+  void begin(const std::string& channel);
+
+  /// \brief Cut off whatever the channel had before begin(channel) and has
+  /// not asked for again since then.
+  void finish(const std::string& channel);
+
+  /// \brief Cut off everything that a channel had.
+  void remove(const std::string& channel);
+
+  /// \brief Stop the queue of every channel. This must happen before the
+  /// middlewares that the queues publish to get destroyed.
+  void stop_queues();
+
+private:
+
+  /// Where the messages or requests of one of our subscriptions or client
+  /// proxies go. The route is only accessed through std::atomic_load and
+  /// std::atomic_store, and it is empty once the channel no longer uses it.
+  template<typename Callback>
+  struct Slot
+  {
+    std::shared_ptr<const Callback> route;
+
+    /// The key of the group of the slot
+    std::string group;
+  };
+
+  /// The keys of the slots that a middleware has made with the same arguments
+  /// for any of the channels, in the order that it made them, and how to ask
+  /// the middleware to take back the last one of them
+  struct Group
+  {
+    std::vector<std::string> keys;
+    std::function<bool()> release;
+  };
+
+  using SubscriptionSlot = Slot<SubscriptionCallback>;
+  using ClientSlot = Slot<RequestCallback>;
+
+  /// Everything that a channel has been given, by key
+  struct Channel
+  {
+    std::set<std::string> subscriptions;
+    std::set<std::string> clients;
+    std::map<std::string, std::shared_ptr<TopicPublisher>> publishers;
+    std::map<std::string, std::shared_ptr<ServiceProvider>> providers;
+    std::vector<TopicQueuePtr> queues;
+  };
+
+  /// Find something that the channel had before begin(channel) or has already
+  /// been given since then
+  template<typename T>
+  std::shared_ptr<T> _find(
+      const std::string& channel,
+      std::map<std::string, std::shared_ptr<T>> Channel::* field,
+      const std::string& key) const;
+
+  void _cut(const Channel& previous, const Channel& current);
+
+  /// Cut off one slot and hand it back to its middleware. A middleware only
+  /// takes back the last slot that it made with the same arguments, so if that
+  /// belongs to another channel, the route of that channel moves into the slot
+  /// that is being cut, and the two slots swap their keys.
+  template<typename Callback>
+  void _cut(
+      const std::string& key,
+      std::map<std::string, std::shared_ptr<Slot<Callback>>>& slots,
+      std::map<std::string, Group>& groups);
+
+  std::map<std::string, std::shared_ptr<SubscriptionSlot>> _subscriptions;
+  std::map<std::string, std::shared_ptr<ClientSlot>> _clients;
+  std::map<std::string, Group> _subscription_groups;
+  std::map<std::string, Group> _client_groups;
+
+  std::map<std::string, Channel> _channels;
+
+  // What the channels that are being configured again had before
+  std::map<std::string, Channel> _previous;
+
+  std::shared_ptr<Executor> _executor;
+
+  mutable std::mutex _mutex;
+
+};
+
+} // namespace internal
+} // namespace soss
+
+#endif // SOSS__INTERNAL__ROUTETABLE_HPP
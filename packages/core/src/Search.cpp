@@ -19,8 +19,12 @@
 
 #include <algorithm>
 #include <cctype>
+#include <chrono>
 #include <experimental/filesystem>
 #include <iostream>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
 
 #include <cstdlib>
 
@@ -40,6 +44,102 @@ const std::string HomeEnvVar = "HOME";
 
 namespace filesystem = std::experimental::filesystem;
 
+namespace {
+
+//==============================================================================
+/// DirectoryCache remembers the contents of every directory that a search has
+/// looked into, so that each candidate path can be checked without touching
+/// the filesystem. Most candidates live in the same few directories, or in
+/// directories that do not exist at all, so this turns the dozens of stat
+/// calls per file into one directory listing per prefix. The cache is shared
+/// by every Search instance in the process.
+class DirectoryCache
+{
+public:
+
+  static DirectoryCache& get()
+  {
+    static DirectoryCache cache;
+    return cache;
+  }
+
+  bool exists(const filesystem::path& path)
+  {
+    const filesystem::path parent = path.parent_path();
+    const std::string name = path.filename().string();
+
+    std::unique_lock<std::mutex> lock(_mutex);
+    Listing& listing = _listings[parent.string()];
+    const auto now = Clock::now();
+    if(listing.checked == Clock::time_point() ||
+       RevalidationPeriod < now - listing.checked)
+      refresh(parent, listing, now);
+
+    return listing.entries.count(name) > 0;
+  }
+
+private:
+
+  using Clock = std::chrono::steady_clock;
+
+  /// A listing is trusted for this long before we check whether its directory
+  /// has been modified. New files that are installed while soss is running
+  /// will be noticed after at most this much time.
+  static constexpr std::chrono::seconds RevalidationPeriod =
+      std::chrono::seconds(1);
+
+  struct Listing
+  {
+    Clock::time_point checked;
+    bool exists = false;
+    filesystem::file_time_type modified;
+    std::unordered_set<std::string> entries;
+  };
+
+  static void refresh(
+      const filesystem::path& directory,
+      Listing& listing,
+      const Clock::time_point now)
+  {
+    listing.checked = now;
+
+    std::error_code ec;
+    const auto modified = filesystem::last_write_time(directory, ec);
+    if(ec || !filesystem::is_directory(directory, ec))
+    {
+      listing.exists = false;
+      listing.entries.clear();
+      return;
+    }
+
+    if(listing.exists && modified == listing.modified)
+      return;
+
+    listing.exists = true;
+    listing.modified = modified;
+    listing.entries.clear();
+    for(filesystem::directory_iterator it(directory, ec), end;
+        !ec && it != end; it.increment(ec))
+    {
+      listing.entries.insert(it->path().filename().string());
+    }
+  }
+
+  std::mutex _mutex;
+  std::unordered_map<std::string, Listing> _listings;
+
+};
+
+constexpr std::chrono::seconds DirectoryCache::RevalidationPeriod;
+
+//==============================================================================
+bool cached_exists(const filesystem::path& path)
+{
+  return DirectoryCache::get().exists(path);
+}
+
+} // anonymous namespace
+
 //==============================================================================
 // initialize static members
 Search::Implementation::GlobalPaths
@@ -182,7 +282,7 @@ std::string Search::Implementation::find_file(
       const filesystem::path test) -> bool
   {
     checked_paths.push_back(test.string());
-    return filesystem::exists(test);
+    return cached_exists(test);
   };
 
   for(const PathSet& middleware_prefixes :
@@ -266,7 +366,7 @@ std::string Search::Implementation::find_middleware_mix(
       const filesystem::path test) -> bool
   {
     checked_paths.push_back(test.string());
-    return filesystem::exists(test);
+    return cached_exists(test);
   };
 
   for(const PathSet& middleware_prefixes :
@@ -499,6 +599,23 @@ std::string Search::find_service_mix(
   return find_generic_mix(srv_type, "srv", checked_paths);
 }
 
+//==============================================================================
+std::string Search::find_package_mix(
+    const std::string& type,
+    std::vector<std::string>* checked_paths) const
+{
+  const std::size_t slash = type.find('/');
+  if(slash == 0 || slash == std::string::npos)
+  {
+    if(checked_paths)
+      checked_paths->clear();
+
+    return std::string();
+  }
+
+  return find_generic_mix(type.substr(0, slash), "pkg", checked_paths);
+}
+
 //==============================================================================
 std::string Search::find_generic_mix(
     const std::string& type,
@@ -0,0 +1,310 @@
+/*
+ * Copyright (C) 2019 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include "ServiceCache.hpp"
+
+#include <soss/Blob.hpp>
+
+namespace soss {
+namespace internal {
+
+namespace {
+
+//==============================================================================
+void append_size(const std::size_t size, std::string& key)
+{
+  const uint64_t value = size;
+  key.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+//==============================================================================
+void append_bytes(const void* const data, const std::size_t size,
+                  std::string& key)
+{
+  append_size(size, key);
+  key.append(static_cast<const char*>(data), size);
+}
+
+//==============================================================================
+template<typename T>
+void append_value(const T& value, std::string& key)
+{
+  key.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+//==============================================================================
+template<typename T>
+void append_vector(const std::vector<T>& values, std::string& key)
+{
+  append_bytes(values.data(), values.size()*sizeof(T), key);
+}
+
+//==============================================================================
+bool append_field(const Field& field, std::string& key);
+
+//==============================================================================
+bool append_message(const Message& message, std::string& key)
+{
+  append_bytes(message.type.data(), message.type.size(), key);
+  append_size(message.data.size(), key);
+
+  // The fields are always sorted by name, so equal messages give equal keys
+  for(const auto& entry : message.data)
+  {
+    append_bytes(entry.first.data(), entry.first.size(), key);
+    if(!append_field(entry.second, key))
+      return false;
+  }
+
+  return true;
+}
+
+//==============================================================================
+bool append_field(const Field& field, std::string& key)
+{
+  const FieldTypeTag tag = field.type_tag();
+  key.push_back(static_cast<char>(tag));
+
+  switch(tag)
+  {
+    case FieldTypeTag::String:
+    {
+      const std::string& value = *field.cast<std::string>();
+      append_bytes(value.data(), value.size(), key);
+      return true;
+    }
+    case FieldTypeTag::Bool:
+      key.push_back(*field.cast<bool>()? 1 : 0);
+      return true;
+    case FieldTypeTag::Int64:
+      append_value(*field.cast<int64_t>(), key);
+      return true;
+    case FieldTypeTag::UInt64:
+      append_value(*field.cast<uint64_t>(), key);
+      return true;
+    case FieldTypeTag::Double:
+      append_value(*field.cast<double>(), key);
+      return true;
+    case FieldTypeTag::Message:
+      return append_message(*field.cast<Message>(), key);
+    case FieldTypeTag::StringVector:
+    {
+      const auto& values = *field.cast<std::vector<std::string>>();
+      append_size(values.size(), key);
+      for(const std::string& value : values)
+        append_bytes(value.data(), value.size(), key);
+      return true;
+    }
+    case FieldTypeTag::Int64Vector:
+      append_vector(*field.cast<std::vector<int64_t>>(), key);
+      return true;
+    case FieldTypeTag::UInt64Vector:
+      append_vector(*field.cast<std::vector<uint64_t>>(), key);
+      return true;
+    case FieldTypeTag::DoubleVector:
+      append_vector(*field.cast<std::vector<double>>(), key);
+      return true;
+    case FieldTypeTag::MessageVector:
+    {
+      const auto& values = *field.cast<std::vector<Message>>();
+      append_size(values.size(), key);
+      for(const Message& value : values)
+      {
+        if(!append_message(value, key))
+          return false;
+      }
+      return true;
+    }
+    case FieldTypeTag::UInt8Vector:
+      append_vector(*field.cast<std::vector<uint8_t>>(), key);
+      return true;
+    case FieldTypeTag::Int8Vector:
+      append_vector(*field.cast<std::vector<int8_t>>(), key);
+      return true;
+    case FieldTypeTag::UInt16Vector:
+      append_vector(*field.cast<std::vector<uint16_t>>(), key);
+      return true;
+    case FieldTypeTag::Int16Vector:
+      append_vector(*field.cast<std::vector<int16_t>>(), key);
+      return true;
+    case FieldTypeTag::UInt32Vector:
+      append_vector(*field.cast<std::vector<uint32_t>>(), key);
+      return true;
+    case FieldTypeTag::Int32Vector:
+      append_vector(*field.cast<std::vector<int32_t>>(), key);
+      return true;
+    case FieldTypeTag::FloatVector:
+      append_vector(*field.cast<std::vector<float>>(), key);
+      return true;
+    case FieldTypeTag::Blob:
+    {
+      const Blob& value = *field.cast<Blob>();
+      append_bytes(value.data(), value.size(), key);
+      return true;
+    }
+    case FieldTypeTag::Other:
+      break;
+  }
+
+  // We cannot tell whether two values of an unknown type are equal
+  return false;
+}
+
+} // anonymous namespace
+
+//==============================================================================
+bool make_message_key(const Message& message, std::string& key)
+{
+  key.clear();
+  return append_message(message, key);
+}
+
+//==============================================================================
+ServiceCache::ServiceCache(
+    const ServiceCacheConfig& config,
+    Upstream upstream)
+  : _config(config),
+    _upstream(std::move(upstream))
+{
+  // Do nothing
+}
+
+//==============================================================================
+void ServiceCache::call(
+    const Message& request,
+    ServiceClient& client,
+    const std::shared_ptr<void>& call_handle)
+{
+  std::string key;
+  if(!make_message_key(request, key))
+  {
+    _upstream(request, client, call_handle);
+    return;
+  }
+
+  std::shared_ptr<Flight> flight;
+  {
+    std::unique_lock<std::mutex> lock(_mutex);
+    const auto it = _entries.find(key);
+    if(it != _entries.end())
+    {
+      if(Clock::now() < it->second.expiry)
+      {
+        _recent.splice(_recent.begin(), _recent, it->second.recent);
+        const std::shared_ptr<const Message> response = it->second.response;
+        lock.unlock();
+
+        client.receive_response(call_handle, *response);
+        return;
+      }
+
+      _recent.erase(it->second.recent);
+      _entries.erase(it);
+    }
+
+    // Someone else already asked this exact question, so we wait with them
+    const auto fit = _flights.find(key);
+    if(fit != _flights.end())
+    {
+      fit->second->waiters.emplace_back(&client, call_handle);
+      return;
+    }
+
+    flight = std::make_shared<Flight>();
+    flight->key = key;
+    flight->waiters.emplace_back(&client, call_handle);
+    _flights.emplace(std::move(key), flight);
+  }
+
+  _upstream(request, *this, flight);
+}
+
+//==============================================================================
+void ServiceCache::receive_response(
+    std::shared_ptr<void> call_handle,
+    const Message& response)
+{
+  const Flight& flight = *std::static_pointer_cast<Flight>(call_handle);
+  const auto cached = std::make_shared<const Message>(response);
+
+  std::vector<Waiter> waiters;
+  {
+    std::unique_lock<std::mutex> lock(_mutex);
+    waiters = _land(flight);
+
+    auto inserted = _entries.emplace(flight.key, Entry());
+    Entry& entry = inserted.first->second;
+    if(!inserted.second)
+      _recent.erase(entry.recent);
+
+    entry.response = cached;
+    entry.expiry = Clock::now() + _config.ttl;
+    _recent.push_front(&inserted.first->first);
+    entry.recent = _recent.begin();
+
+    while(_entries.size() > _config.size)
+    {
+      _entries.erase(*_recent.back());
+      _recent.pop_back();
+    }
+  }
+
+  for(const Waiter& waiter : waiters)
+    waiter.first->receive_response(waiter.second, *cached);
+}
+
+//==============================================================================
+void ServiceCache::receive_error(
+    std::shared_ptr<void> call_handle,
+    const std::string& error)
+{
+  const Flight& flight = *std::static_pointer_cast<Flight>(call_handle);
+
+  // Failures are never cached, so the next request will try again
+  std::vector<Waiter> waiters;
+  {
+    std::unique_lock<std::mutex> lock(_mutex);
+    waiters = _land(flight);
+  }
+
+  for(const Waiter& waiter : waiters)
+    waiter.first->receive_error(waiter.second, error);
+}
+
+//==============================================================================
+std::size_t ServiceCache::size() const
+{
+  std::unique_lock<std::mutex> lock(_mutex);
+  return _entries.size();
+}
+
+//==============================================================================
+std::vector<ServiceCache::Waiter> ServiceCache::_land(const Flight& flight)
+{
+  // A provider might answer the same call more than once, but only the first
+  // answer gets handed to the waiters.
+  const auto it = _flights.find(flight.key);
+  if(it == _flights.end() || it->second.get() != &flight)
+    return {};
+
+  std::vector<Waiter> waiters = std::move(it->second->waiters);
+  _flights.erase(it);
+  return waiters;
+}
+
+} // namespace internal
+} // namespace soss
@@ -0,0 +1,136 @@
+/*
+ * Copyright (C) 2019 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#ifndef SOSS__INTERNAL__SERVICECACHE_HPP
+#define SOSS__INTERNAL__SERVICECACHE_HPP
+
+#include <soss/SystemHandle.hpp>
+
+#include <chrono>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace soss {
+namespace internal {
+
+//==============================================================================
+struct ServiceCacheConfig
+{
+  /// The most responses that may be cached at once. A size of zero means that
+  /// the responses of the service are not cached.
+  std::size_t size = 0;
+
+  /// How long a cached response may be handed out before the service has to
+  /// be asked again
+  std::chrono::milliseconds ttl = std::chrono::seconds(1);
+
+  bool enabled() const { return size > 0; }
+};
+
+//==============================================================================
+/// \brief Write a key that identifies the contents of a message. Two messages
+/// get the same key exactly when they have the same type and the same fields
+/// with the same values.
+///
+/// \returns false if the message has a field of a type that cannot be keyed,
+/// in which case it should not be looked up in a cache.
+bool make_message_key(const Message& message, std::string& key);
+
+//==============================================================================
+/// ServiceCache sits in front of the providers of a service whose responses
+/// only depend on the request, like map queries or parameter reads. Responses
+/// are remembered for a while, so repeated requests get answered without
+/// crossing the bridge again, and identical requests that arrive while the
+/// first one is still being answered all share its response.
+class ServiceCache : public ServiceClient
+{
+public:
+
+  using Clock = std::chrono::steady_clock;
+
+  /// Signature of the function that forwards a request to the providers
+  using Upstream = std::function<void(
+      const Message& request,
+      ServiceClient& client,
+      const std::shared_ptr<void>& call_handle)>;
+
+  ServiceCache(const ServiceCacheConfig& config, Upstream upstream);
+
+  /// \brief Answer a request from the cache if possible, otherwise pass it on
+  /// to the providers.
+  void call(
+      const Message& request,
+      ServiceClient& client,
+      const std::shared_ptr<void>& call_handle);
+
+  void receive_response(
+      std::shared_ptr<void> call_handle,
+      const Message& response) override;
+
+  void receive_error(
+      std::shared_ptr<void> call_handle,
+      const std::string& error) override;
+
+  /// \brief The number of responses that are currently cached
+  std::size_t size() const;
+
+private:
+
+  using Waiter = std::pair<ServiceClient*, std::shared_ptr<void>>;
+
+  /// A request that the providers are working on
+  struct Flight
+  {
+    std::string key;
+    std::vector<Waiter> waiters;
+  };
+
+  struct Entry
+  {
+    std::shared_ptr<const Message> response;
+    Clock::time_point expiry;
+
+    // Where this entry is in _recent
+    std::list<const std::string*>::iterator recent;
+  };
+
+  std::vector<Waiter> _land(const Flight& flight);
+
+  const ServiceCacheConfig _config;
+  const Upstream _upstream;
+
+  std::unordered_map<std::string, Entry> _entries;
+
+  // The keys of the cached responses, most recently used first
+  std::list<const std::string*> _recent;
+
+  std::unordered_map<std::string, std::shared_ptr<Flight>> _flights;
+
+  mutable std::mutex _mutex;
+
+};
+
+} // namespace internal
+} // namespace soss
+
+#endif // SOSS__INTERNAL__SERVICECACHE_HPP
@@ -0,0 +1,325 @@
+/*
+ * Copyright (C) 2019 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include <soss/ServiceCall.hpp>
+
+#include <atomic>
+#include <mutex>
+
+namespace soss {
+
+//==============================================================================
+class ServiceCall::Implementation
+{
+public:
+
+  /// \brief Finish the call, unless it has already finished, and run its
+  /// continuations.
+  void finish(Result result)
+  {
+    std::vector<std::pair<Continuation, std::shared_ptr<Executor>>> waiting;
+    {
+      std::unique_lock<std::mutex> lock(_mutex);
+      if(_finished)
+        return;
+
+      _result = std::move(result);
+      _finished = true;
+      _provider = nullptr;
+      _upstream = nullptr;
+      waiting.swap(_continuations);
+    }
+
+    for(auto& continuation : waiting)
+      _run(std::move(continuation.first), std::move(continuation.second));
+  }
+
+  void finish_with_error(std::string error)
+  {
+    Result result;
+    result.error = std::move(error);
+    finish(std::move(result));
+  }
+
+  void then(Continuation continuation, std::shared_ptr<Executor> executor)
+  {
+    std::unique_lock<std::mutex> lock(_mutex);
+    if(!_finished)
+    {
+      _continuations.emplace_back(std::move(continuation), std::move(executor));
+      return;
+    }
+    lock.unlock();
+
+    _run(std::move(continuation), std::move(executor));
+  }
+
+  bool ready() const
+  {
+    std::unique_lock<std::mutex> lock(_mutex);
+    return _finished;
+  }
+
+  /// \brief Remember the provider that is answering this call, so that it can
+  /// be told when the call gets cancelled
+  void answered_by(std::shared_ptr<ServiceProvider> provider)
+  {
+    std::unique_lock<std::mutex> lock(_mutex);
+    if(!_finished)
+      _provider = std::move(provider);
+  }
+
+  /// \brief Remember the call that this chained call is waiting for, so that
+  /// it gets cancelled along with this one
+  void waiting_for(std::shared_ptr<Implementation> upstream)
+  {
+    std::unique_lock<std::mutex> lock(_mutex);
+    if(!_finished)
+    {
+      _upstream = std::move(upstream);
+      return;
+    }
+    lock.unlock();
+
+    // This call was cancelled while its next step was being made
+    cancel(upstream);
+  }
+
+  static void cancel(const std::shared_ptr<Implementation>& call)
+  {
+    std::shared_ptr<ServiceProvider> provider;
+    std::shared_ptr<Implementation> upstream;
+    {
+      std::unique_lock<std::mutex> lock(call->_mutex);
+      if(call->_finished)
+        return;
+
+      provider = call->_provider;
+      upstream = call->_upstream;
+    }
+
+    call->finish_with_error("the service call was cancelled");
+
+    if(provider)
+      provider->cancel_service_call(call);
+
+    if(upstream)
+      cancel(upstream);
+  }
+
+private:
+
+  void _run(Continuation continuation, std::shared_ptr<Executor> executor)
+  {
+    if(!executor)
+    {
+      continuation(_result);
+      return;
+    }
+
+    // The result never changes once the call has finished, so the task only
+    // needs to keep the call alive to read it
+    executor->post(
+          [continuation = std::move(continuation), result = &_result,
+           keep = _self.lock()]()
+    {
+      continuation(*result);
+    });
+  }
+
+  friend class ServiceCall;
+
+  mutable std::mutex _mutex;
+  bool _finished = false;
+  Result _result;
+  std::vector<std::pair<Continuation, std::shared_ptr<Executor>>>
+      _continuations;
+
+  std::shared_ptr<ServiceProvider> _provider;
+  std::shared_ptr<Implementation> _upstream;
+  std::weak_ptr<Implementation> _self;
+};
+
+namespace {
+
+//==============================================================================
+/// The client that every ServiceCall hands to its provider. The call_handle
+/// of each request is the call itself, so the client does not need to keep
+/// track of anything.
+class CallClient : public ServiceClient
+{
+public:
+
+  void receive_response(
+      std::shared_ptr<void> call_handle,
+      const Message& response) override
+  {
+    ServiceCall::Result result;
+    result.succeeded = true;
+    result.response = response;
+    static_cast<ServiceCall::Implementation*>(call_handle.get())->finish(
+          std::move(result));
+  }
+
+  void receive_error(
+      std::shared_ptr<void> call_handle,
+      const std::string& error) override
+  {
+    static_cast<ServiceCall::Implementation*>(call_handle.get())
+        ->finish_with_error(error);
+  }
+
+  static CallClient& instance()
+  {
+    static CallClient client;
+    return client;
+  }
+};
+
+} // anonymous namespace
+
+//==============================================================================
+ServiceCall ServiceCall::call(
+    std::shared_ptr<ServiceProvider> provider,
+    const Message& request)
+{
+  ServiceCall call(std::make_shared<Implementation>());
+  if(!provider)
+  {
+    call._pimpl->finish_with_error("there is no provider for the service");
+    return call;
+  }
+
+  // The provider might answer before call_service(~) returns
+  call._pimpl->answered_by(provider);
+  provider->call_service(request, CallClient::instance(), call._pimpl);
+  return call;
+}
+
+//==============================================================================
+ServiceCall ServiceCall::finished(Result result)
+{
+  ServiceCall call(std::make_shared<Implementation>());
+  call._pimpl->finish(std::move(result));
+  return call;
+}
+
+//==============================================================================
+void ServiceCall::then(
+    Continuation continuation,
+    std::shared_ptr<Executor> executor) const
+{
+  _pimpl->then(std::move(continuation), std::move(executor));
+}
+
+//==============================================================================
+ServiceCall ServiceCall::then_call(
+    Next next,
+    std::shared_ptr<Executor> executor) const
+{
+  ServiceCall chained(std::make_shared<Implementation>());
+  chained._pimpl->waiting_for(_pimpl);
+
+  const std::shared_ptr<Implementation> chain = chained._pimpl;
+  _pimpl->then([chain, next = std::move(next)](const Result& result)
+  {
+    // A cancelled chain does not make its next call
+    if(chain->ready())
+      return;
+
+    const ServiceCall step = next(result);
+    chain->waiting_for(step._pimpl);
+    step._pimpl->then([chain](const Result& step_result)
+    {
+      chain->finish(step_result);
+    }, nullptr);
+  }, std::move(executor));
+
+  return chained;
+}
+
+//==============================================================================
+void ServiceCall::when_all(
+    const std::vector<ServiceCall>& calls,
+    JoinedContinuation continuation,
+    std::shared_ptr<Executor> executor)
+{
+  struct Join
+  {
+    std::vector<Result> results;
+    std::atomic_size_t remaining;
+    JoinedContinuation continuation;
+    std::shared_ptr<Executor> executor;
+  };
+
+  if(calls.empty())
+  {
+    ServiceCall::finished(Result()).then(
+          [continuation = std::move(continuation)](const Result&)
+    {
+      continuation({});
+    }, std::move(executor));
+    return;
+  }
+
+  const auto join = std::make_shared<Join>();
+  join->results.resize(calls.size());
+  join->remaining = calls.size();
+  join->continuation = std::move(continuation);
+  join->executor = std::move(executor);
+
+  for(std::size_t i=0; i < calls.size(); ++i)
+  {
+    calls[i]._pimpl->then([join, i](const Result& result)
+    {
+      // Each call writes its own slot, and the last one to finish sees all of
+      // them, since the counter orders the writes before it
+      join->results[i] = result;
+      if(--join->remaining > 0)
+        return;
+
+      if(!join->executor)
+      {
+        join->continuation(join->results);
+        return;
+      }
+
+      join->executor->post([join]() { join->continuation(join->results); });
+    }, nullptr);
+  }
+}
+
+//==============================================================================
+bool ServiceCall::ready() const
+{
+  return _pimpl->ready();
+}
+
+//==============================================================================
+void ServiceCall::cancel() const
+{
+  Implementation::cancel(_pimpl);
+}
+
+//==============================================================================
+ServiceCall::ServiceCall(std::shared_ptr<Implementation> impl)
+  : _pimpl(std::move(impl))
+{
+  _pimpl->_self = _pimpl;
+}
+
+} // namespace soss
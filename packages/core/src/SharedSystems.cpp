@@ -0,0 +1,623 @@
+/*
+ * Copyright (C) 2019 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include "SharedSystems.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <shared_mutex>
+#include <thread>
+#include <unordered_map>
+
+namespace soss {
+namespace internal {
+
+namespace {
+
+//==============================================================================
+/// How long a shared system that is not self-driven may wait for work before
+/// its thread checks whether it should quit
+const std::chrono::milliseconds SharedSpinPeriod(100);
+
+//==============================================================================
+std::string make_key(
+    const std::string& name,
+    const std::string& type,
+    const YAML::Node& configuration)
+{
+  std::string key = name;
+  key.append(1, '\n').append(type);
+  key.append(1, '\n').append(YAML::Dump(configuration));
+  return key;
+}
+
+//==============================================================================
+/// A Fanout hands whatever one subscription or client proxy of a shared system
+/// receives to the routes of the instances that use it. The deliveries hold a
+/// shared lock, so removing a route waits for the deliveries in flight.
+template<typename Callback>
+struct Fanout
+{
+  std::shared_timed_mutex mutex;
+  std::vector<std::pair<const void*, Callback>> routes;
+
+  /// The key of the fanout in its shared system, and how to ask the shared
+  /// system to take back the subscription or client proxy that feeds it. Both
+  /// are only used while holding the mutex of the shared system.
+  std::string key;
+  std::function<bool()> release;
+
+  void add(const void* owner, Callback callback)
+  {
+    std::unique_lock<std::shared_timed_mutex> lock(mutex);
+    routes.emplace_back(owner, std::move(callback));
+  }
+
+  /// Remove every route of the owner
+  /// \returns true if no routes are left
+  bool remove(const void* owner)
+  {
+    std::unique_lock<std::shared_timed_mutex> lock(mutex);
+    routes.erase(
+          std::remove_if(routes.begin(), routes.end(),
+                         [&](const std::pair<const void*, Callback>& route)
+    {
+      return route.first == owner;
+    }), routes.end());
+
+    return routes.empty();
+  }
+
+  /// Remove the route that the owner added last
+  /// \returns true if no routes are left
+  bool remove_last(const void* owner)
+  {
+    std::unique_lock<std::shared_timed_mutex> lock(mutex);
+    for(auto it = routes.rbegin(); it != routes.rend(); ++it)
+    {
+      if(it->first == owner)
+      {
+        routes.erase(std::next(it).base());
+        break;
+      }
+    }
+
+    return routes.empty();
+  }
+};
+
+using SubscriptionCallback = TopicSubscriberSystem::SubscriptionCallback;
+using RequestCallback = ServiceClientSystem::RequestCallback;
+using SubscriptionFanout = Fanout<SubscriptionCallback>;
+using ClientFanout = Fanout<RequestCallback>;
+
+//==============================================================================
+/// The system handle that several instances share, along with everything that
+/// has been created on it for them
+class Shared
+{
+public:
+
+  Shared(
+      std::string name,
+      SystemHandleInfo system,
+      RequiredTypes configured_types,
+      const ThreadSettings& thread)
+    : info(std::move(system)),
+      types(std::move(configured_types)),
+      _name(std::move(name)),
+      _quit(false)
+  {
+    _thread = std::thread([this, thread]() { this->_spin(thread); });
+  }
+
+  ~Shared()
+  {
+    {
+      std::unique_lock<std::mutex> lock(_quit_mutex);
+      _quit = true;
+    }
+    _quit_cv.notify_all();
+    info.handle->wake_up();
+
+    // The last user of the system might let go of it from a delivery of the
+    // system itself
+    if(_thread.get_id() == std::this_thread::get_id())
+      _thread.detach();
+    else
+      _thread.join();
+  }
+
+  SystemHandleInfo info;
+
+  /// The types that the system was configured with
+  const RequiredTypes types;
+
+  /// Guards the maps below, and every call into the system handle, except for
+  /// the spinning of a self-driven system
+  std::mutex mutex;
+  std::unordered_map<std::string, std::shared_ptr<SubscriptionFanout>>
+      subscriptions;
+  std::unordered_map<std::string, std::shared_ptr<ClientFanout>> clients;
+  std::unordered_map<std::string, std::weak_ptr<TopicPublisher>> publishers;
+  std::unordered_map<std::string, std::weak_ptr<ServiceProvider>> providers;
+
+private:
+
+  void _spin(const ThreadSettings& thread)
+  {
+    thread.apply("soss-" + _name);
+
+    SystemHandle& handle = *info.handle;
+    if(handle.self_driven())
+    {
+      if(!handle.spin_once())
+        _report_failure();
+
+      std::unique_lock<std::mutex> lock(_quit_mutex);
+      _quit_cv.wait(lock, [&]() { return _quit.load(); });
+      return;
+    }
+
+    while(!_quit)
+    {
+      bool okay;
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        okay = handle.spin_once();
+      }
+
+      if(!okay)
+      {
+        // The instances find out through the okay() of their proxies
+        _report_failure();
+        std::unique_lock<std::mutex> lock(_quit_mutex);
+        _quit_cv.wait(lock, [&]() { return _quit.load(); });
+        return;
+      }
+
+      handle.wait_for_work(SharedSpinPeriod);
+    }
+  }
+
+  void _report_failure() const
+  {
+    std::cerr << "[soss] The shared system [" << _name << "] has stopped "
+              << "working, so the instances that share it will stop receiving "
+              << "from it" << std::endl;
+  }
+
+  const std::string _name;
+  std::atomic_bool _quit;
+  std::mutex _quit_mutex;
+  std::condition_variable _quit_cv;
+  std::thread _thread;
+};
+
+//==============================================================================
+/// Gives out a publisher or provider of a shared system that keeps the system
+/// alive for as long as it is held, since the routes of an instance may hold on
+/// to it after the instance has released its proxy
+template<typename T>
+std::shared_ptr<T> keep_alive(
+    std::shared_ptr<T> object,
+    const std::shared_ptr<Shared>& shared)
+{
+  struct Keeper
+  {
+    // The object gets destroyed before the system that made it
+    std::shared_ptr<Shared> shared;
+    std::shared_ptr<T> object;
+  };
+
+  T* const raw = object.get();
+  return std::shared_ptr<T>(
+        std::make_shared<Keeper>(Keeper{shared, std::move(object)}), raw);
+}
+
+//==============================================================================
+/// The system handle that each instance gets for a shared system
+class SharedSystemProxy : public FullSystem
+{
+public:
+
+  SharedSystemProxy(std::shared_ptr<Shared> shared)
+    : _shared(std::move(shared))
+  {
+    // Do nothing
+  }
+
+  ~SharedSystemProxy() override
+  {
+    // Whatever no other instance routes anymore gets handed back to the shared
+    // system, so it does not keep receiving for nobody
+    Shared& shared = *_shared;
+    std::unique_lock<std::mutex> lock(shared.mutex);
+    _abandon(shared.subscriptions, _subscriptions);
+    _abandon(shared.clients, _clients);
+  }
+
+  bool configure(const RequiredTypes&, const YAML::Node&) override
+  {
+    // The shared system was configured by the first instance that used it
+    return true;
+  }
+
+  bool okay() const override
+  {
+    return _shared->info.handle->okay();
+  }
+
+  bool spin_once() override
+  {
+    // The shared system gets spun by a thread of its own
+    return okay();
+  }
+
+  bool self_driven() const override
+  {
+    return true;
+  }
+
+  bool subscribe(
+      const std::string& topic_name,
+      const std::string& message_type,
+      SubscriptionCallback callback,
+      const YAML::Node& configuration) override
+  {
+    Shared& shared = *_shared;
+    std::unique_lock<std::mutex> lock(shared.mutex);
+
+    const std::string key = make_key(topic_name, message_type, configuration);
+    std::shared_ptr<SubscriptionFanout> fanout;
+    const auto it = shared.subscriptions.find(key);
+    if(it != shared.subscriptions.end())
+    {
+      fanout = it->second;
+    }
+    else
+    {
+      fanout = std::make_shared<SubscriptionFanout>();
+
+      // Only one route may take ownership of a message, so the others are
+      // handed copies
+      const SubscriptionCallback deliver(
+            [fanout](const Message& message)
+      {
+        std::shared_lock<std::shared_timed_mutex> lock(fanout->mutex);
+        for(const auto& route : fanout->routes)
+          route.second(message);
+      },
+            [fanout](Message&& message)
+      {
+        std::shared_lock<std::shared_timed_mutex> lock(fanout->mutex);
+        if(fanout->routes.size() == 1)
+        {
+          fanout->routes.front().second(std::move(message));
+          return;
+        }
+
+        for(const auto& route : fanout->routes)
+          route.second(message);
+      });
+
+      if(!shared.info.topic_subscriber->subscribe(
+           topic_name, message_type, deliver, configuration))
+        return false;
+
+      TopicSubscriberSystem* const subscriber = shared.info.topic_subscriber;
+      fanout->key = key;
+      fanout->release = [=]()
+      {
+        return subscriber->unsubscribe(
+              topic_name, message_type, configuration);
+      };
+
+      shared.subscriptions.insert(std::make_pair(key, fanout));
+    }
+
+    fanout->add(this, std::move(callback));
+    _subscriptions.push_back(std::move(fanout));
+    return true;
+  }
+
+  bool unsubscribe(
+      const std::string& topic_name,
+      const std::string& message_type,
+      const YAML::Node& configuration) override
+  {
+    Shared& shared = *_shared;
+    std::unique_lock<std::mutex> lock(shared.mutex);
+    return _release(
+          make_key(topic_name, message_type, configuration),
+          shared.subscriptions, _subscriptions);
+  }
+
+  std::shared_ptr<TopicPublisher> advertise(
+      const std::string& topic_name,
+      const std::string& message_type,
+      const YAML::Node& configuration) override
+  {
+    Shared& shared = *_shared;
+    std::unique_lock<std::mutex> lock(shared.mutex);
+
+    std::weak_ptr<TopicPublisher>& cached = shared.publishers[
+        make_key(topic_name, message_type, configuration)];
+    if(const auto publisher = cached.lock())
+      return publisher;
+
+    std::shared_ptr<TopicPublisher> publisher =
+        shared.info.topic_publisher->advertise(
+          topic_name, message_type, configuration);
+    if(!publisher)
+      return nullptr;
+
+    publisher = keep_alive(std::move(publisher), _shared);
+    cached = publisher;
+    return publisher;
+  }
+
+  bool create_client_proxy(
+      const std::string& service_name,
+      const std::string& service_type,
+      RequestCallback callback,
+      const YAML::Node& configuration) override
+  {
+    Shared& shared = *_shared;
+    std::unique_lock<std::mutex> lock(shared.mutex);
+
+    const std::string key =
+        make_key(service_name, service_type, configuration);
+    std::shared_ptr<ClientFanout> fanout;
+    const auto it = shared.clients.find(key);
+    if(it != shared.clients.end())
+    {
+      fanout = it->second;
+    }
+    else
+    {
+      fanout = std::make_shared<ClientFanout>();
+
+      // A request must only be answered once, so it goes to the instance that
+      // has routed the service for the longest
+      const RequestCallback deliver = [fanout](
+          const Message& request,
+          ServiceClient& client,
+          std::shared_ptr<void> call_handle)
+      {
+        std::shared_lock<std::shared_timed_mutex> lock(fanout->mutex);
+        if(fanout->routes.empty())
+        {
+          lock.unlock();
+          client.receive_error(
+                std::move(call_handle),
+                "no soss instance routes the service anymore");
+          return;
+        }
+
+        fanout->routes.front().second(request, client, std::move(call_handle));
+      };
+
+      if(!shared.info.service_client->create_client_proxy(
+           service_name, service_type, deliver, configuration))
+        return false;
+
+      ServiceClientSystem* const clients = shared.info.service_client;
+      fanout->key = key;
+      fanout->release = [=]()
+      {
+        return clients->release_client_proxy(
+              service_name, service_type, configuration);
+      };
+
+      shared.clients.insert(std::make_pair(key, fanout));
+    }
+
+    fanout->add(this, std::move(callback));
+    _clients.push_back(std::move(fanout));
+    return true;
+  }
+
+  bool release_client_proxy(
+      const std::string& service_name,
+      const std::string& service_type,
+      const YAML::Node& configuration) override
+  {
+    Shared& shared = *_shared;
+    std::unique_lock<std::mutex> lock(shared.mutex);
+    return _release(
+          make_key(service_name, service_type, configuration),
+          shared.clients, _clients);
+  }
+
+  std::shared_ptr<ServiceProvider> create_service_proxy(
+      const std::string& service_name,
+      const std::string& service_type,
+      const YAML::Node& configuration) override
+  {
+    Shared& shared = *_shared;
+    std::unique_lock<std::mutex> lock(shared.mutex);
+
+    std::weak_ptr<ServiceProvider>& cached = shared.providers[
+        make_key(service_name, service_type, configuration)];
+    if(const auto provider = cached.lock())
+      return provider;
+
+    std::shared_ptr<ServiceProvider> provider =
+        shared.info.service_provider->create_service_proxy(
+          service_name, service_type, configuration);
+    if(!provider)
+      return nullptr;
+
+    provider = keep_alive(std::move(provider), _shared);
+    cached = provider;
+    return provider;
+  }
+
+private:
+
+  /// Remove the route that this instance added last to a fanout. The shared
+  /// system only gets asked to take back its subscription or client proxy
+  /// once no instance routes it anymore.
+  template<typename FanoutType>
+  bool _release(
+      const std::string& key,
+      std::unordered_map<std::string, std::shared_ptr<FanoutType>>& shared,
+      std::vector<std::shared_ptr<FanoutType>>& used)
+  {
+    const auto it = shared.find(key);
+    if(it == shared.end())
+      return false;
+
+    const std::shared_ptr<FanoutType> fanout = it->second;
+    const auto use = std::find(used.rbegin(), used.rend(), fanout);
+    if(use == used.rend())
+      return false;
+
+    used.erase(std::next(use).base());
+    if(fanout->remove_last(this) && fanout->release())
+      shared.erase(it);
+
+    return true;
+  }
+
+  /// Remove every route of this instance from the fanouts that it used, and
+  /// hand back the ones that no instance routes anymore, like _release(~)
+  template<typename FanoutType>
+  void _abandon(
+      std::unordered_map<std::string, std::shared_ptr<FanoutType>>& shared,
+      std::vector<std::shared_ptr<FanoutType>>& used)
+  {
+    // An instance may route the same fanout more than once
+    std::sort(used.begin(), used.end());
+    used.erase(std::unique(used.begin(), used.end()), used.end());
+
+    for(const std::shared_ptr<FanoutType>& fanout : used)
+    {
+      if(fanout->remove(this) && fanout->release())
+        shared.erase(fanout->key);
+    }
+
+    used.clear();
+  }
+
+  std::shared_ptr<Shared> _shared;
+  std::vector<std::shared_ptr<SubscriptionFanout>> _subscriptions;
+  std::vector<std::shared_ptr<ClientFanout>> _clients;
+
+};
+
+//==============================================================================
+struct Registry
+{
+  std::mutex mutex;
+  std::unordered_map<std::string, std::weak_ptr<Shared>> systems;
+};
+
+//==============================================================================
+Registry& registry()
+{
+  static Registry instance;
+  return instance;
+}
+
+//==============================================================================
+bool covers(const std::set<std::string>& configured,
+            const std::set<std::string>& required)
+{
+  return std::includes(
+        configured.begin(), configured.end(),
+        required.begin(), required.end());
+}
+
+} // anonymous namespace
+
+//==============================================================================
+SystemHandleInfo SharedSystems::attach(
+    const std::string& name,
+    const std::string& type,
+    const RequiredTypes& types,
+    const YAML::Node& configuration,
+    const ThreadSettings& thread,
+    const Factory& factory)
+{
+  const std::string key = type + "\n" + YAML::Dump(configuration);
+
+  // The lock is held while the system gets configured, so that the instances
+  // that start at the same time do not each create one
+  Registry& shared_systems = registry();
+  std::unique_lock<std::mutex> lock(shared_systems.mutex);
+  std::shared_ptr<Shared> shared = shared_systems.systems[key].lock();
+  if(shared)
+  {
+    if(!covers(shared->types.messages, types.messages)
+       || !covers(shared->types.services, types.services))
+    {
+      std::cerr << "[soss] The system [" << name << "] shares a system that "
+                << "was configured by another instance for fewer types than "
+                << "it needs. The types that it adds might not be supported."
+                << std::endl;
+    }
+  }
+  else
+  {
+    SystemHandleInfo info = factory();
+    if(!info)
+      return info;
+
+    if(!info.handle->configure(types, configuration))
+      return SystemHandleInfo(nullptr);
+
+    shared = std::make_shared<Shared>(name, std::move(info), types, thread);
+    shared_systems.systems[key] = shared;
+  }
+  lock.unlock();
+
+  const SystemHandleInfo& system = shared->info;
+  SystemHandleInfo proxy(std::make_unique<SharedSystemProxy>(shared));
+
+  // The proxy can only do what the shared system can do
+  if(!system.topic_publisher)
+    proxy.topic_publisher = nullptr;
+  if(!system.topic_subscriber)
+    proxy.topic_subscriber = nullptr;
+  if(!system.service_client)
+    proxy.service_client = nullptr;
+  if(!system.service_provider)
+    proxy.service_provider = nullptr;
+
+  return proxy;
+}
+
+//==============================================================================
+void SharedSystems::release(SystemHandleInfoMap& info_map)
+{
+  for(auto it = info_map.begin(); it != info_map.end();)
+  {
+    if(dynamic_cast<SharedSystemProxy*>(it->second.handle.get()))
+      it = info_map.erase(it);
+    else
+      ++it;
+  }
+}
+
+} // namespace internal
+} // namespace soss
@@ -0,0 +1,78 @@
+/*
+ * Copyright (C) 2019 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#ifndef SOSS__INTERNAL__SHAREDSYSTEMS_HPP
+#define SOSS__INTERNAL__SHAREDSYSTEMS_HPP
+
+#include "register_system.hpp"
+
+#include <soss/ThreadSettings.hpp>
+
+#include <functional>
+
+namespace soss {
+namespace internal {
+
+//==============================================================================
+/// SharedSystems lets several soss instances of one process share the system
+/// handles of the systems that they configure the same way, so that they
+/// share one connection to each middleware instead of opening one each.
+///
+/// A system opts into this with [shared: true] in its configuration. Every
+/// instance gets a proxy of its own, which hands the subscriptions, clients,
+/// publishers and providers of the instance to the one shared handle. Each
+/// topic or service only gets subscribed to once, and its messages get fanned
+/// out to every instance that routes it. The shared handle gets spun by a
+/// thread of its own, and it is destroyed when the last instance that uses it
+/// lets go of its proxy.
+class SharedSystems
+{
+public:
+
+  using Factory = std::function<SystemHandleInfo()>;
+
+  /// \brief Get a proxy for the shared system with this type and
+  /// configuration, creating and configuring the system if no instance is
+  /// using one yet.
+  ///
+  /// \param[in] name
+  ///   The name of the system in the configuration that asks for it
+  ///
+  /// \param[in] factory
+  ///   Creates the system handle if there is none to share yet
+  ///
+  /// \returns a proxy for the shared system, or an empty SystemHandleInfo if
+  /// the system could not be created or configured
+  static SystemHandleInfo attach(
+      const std::string& name,
+      const std::string& type,
+      const RequiredTypes& types,
+      const YAML::Node& configuration,
+      const ThreadSettings& thread,
+      const Factory& factory);
+
+  /// \brief Remove the shared proxies from an instance's systems, which stops
+  /// the shared systems from delivering anything more to that instance. This
+  /// blocks until the deliveries that are in flight have finished.
+  static void release(SystemHandleInfoMap& info_map);
+
+};
+
+} // namespace internal
+} // namespace soss
+
+#endif // SOSS__INTERNAL__SHAREDSYSTEMS_HPP
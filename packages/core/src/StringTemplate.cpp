@@ -18,6 +18,8 @@
 #include <soss/StringTemplate.hpp>
 #include <soss/FieldToString.hpp>
 
+#include <atomic>
+#include <functional>
 #include <vector>
 
 namespace soss {
@@ -36,76 +38,203 @@ public:
     std::size_t start = template_string.find('{', last_end);
     while(start < template_string.size())
     {
-      components.push_back(template_string.substr(last_end, start-last_end));
+      if(start > last_end)
+        add_literal(template_string.substr(last_end, start-last_end));
 
-      last_end = template_string.find('}', start) + 1;
-      if(last_end == std::string::npos)
+      const std::size_t end = template_string.find('}', start);
+      if(end == std::string::npos)
       {
         throw InvalidTemplateFormat(template_string, usage_details);
       }
+      last_end = end + 1;
 
-      const std::string substitution_string = template_string.substr(start+1, last_end-start-2);
-      if(substitution_string.substr(0,8) != "message.")
+      const std::string substitution_string =
+          template_string.substr(start+1, end-start-1);
+      if(substitution_string.substr(0,8) != "message."
+         || substitution_string.size() == 8)
       {
         throw InvalidTemplateFormat(template_string, usage_details);
       }
-      substitutions[components.size()] = substitution_string.substr(8);
 
-      // We use an empty string to represent components that will get
-      // substituted later.
-      components.push_back("");
+      Token token;
+      std::size_t name_start = 8;
+      while(name_start <= substitution_string.size())
+      {
+        std::size_t name_end = substitution_string.find('.', name_start);
+        if(name_end == std::string::npos)
+          name_end = substitution_string.size();
+
+        if(name_end == name_start)
+          throw InvalidTemplateFormat(template_string, usage_details);
+
+        token.path.push_back(
+              substitution_string.substr(name_start, name_end-name_start));
+        name_start = name_end + 1;
+      }
+
+      token.field_name = substitution_string.substr(8);
+      tokens.emplace_back(std::move(token));
 
       start = template_string.find('{', last_end);
     }
 
     if(last_end < template_string.size())
-      components.push_back(template_string.substr(last_end));
+      add_literal(template_string.substr(last_end));
   }
 
-  std::string compute_string(const soss::Message& message) const
+  void compute_string(const soss::Message& message, std::string& output) const
   {
-    std::string result;
-
-    SubstitutionMap::const_iterator substitute_it = substitutions.begin();
-    for(std::size_t i=0; i < components.size(); ++i)
+    output.clear();
+    for(const Token& token : tokens)
     {
-      if(substitute_it != substitutions.end() && substitute_it->first == i)
+      if(token.path.empty())
       {
-        const std::string& field_name = substitute_it->second;
-        const soss::Message::const_iterator field_it =
-            message.data.find(field_name);
+        output += token.literal;
+        continue;
+      }
+
+      converter.append(find_field(message, token), output);
+    }
+  }
+
+  std::size_t compute_key(const soss::Message& message, std::string& key) const
+  {
+    key.clear();
+    for(const Token& token : tokens)
+    {
+      if(token.path.empty())
+        continue;
+
+      const Field& field = find_field(message, token)->second;
+      const FieldTypeTag tag = field.type_tag();
+      key.push_back(static_cast<char>(tag));
 
-        if(field_it == message.data.end())
+      switch(tag)
+      {
+        case FieldTypeTag::String:
         {
-          throw UnavailableMessageField(field_name, converter.details);
+          const std::string& value = *field.cast<std::string>();
+          append_bytes(key, value.size());
+          key += value;
+          break;
         }
 
-        result += converter.to_string(field_it);
-        ++substitute_it;
-        continue;
-      }
+        case FieldTypeTag::Int64:
+          append_bytes(key, *field.cast<int64_t>());
+          break;
+
+        case FieldTypeTag::UInt64:
+          append_bytes(key, *field.cast<uint64_t>());
+          break;
 
-      result += components[i];
+        case FieldTypeTag::Double:
+          append_bytes(key, *field.cast<double>());
+          break;
+
+        default:
+        {
+          // Fall back to the string of any other type, so that we report the
+          // same error that compute_string() would.
+          const std::string value =
+              converter.to_string(find_field(message, token));
+          append_bytes(key, value.size());
+          key += value;
+          break;
+        }
+      }
     }
 
-    return result;
+    return std::hash<std::string>()(key);
   }
 
   FieldToString converter;
 
-  /// This contains a vector of string literal components.
-  std::vector<std::string> components;
+private:
+
+  void add_literal(std::string literal)
+  {
+    Token token;
+    token.literal = std::move(literal);
+    tokens.emplace_back(std::move(token));
+  }
+
+  struct Token
+  {
+    Token()
+      : hint(0)
+    {
+      // Do nothing
+    }
+
+    Token(const Token& other)
+      : literal(other.literal),
+        field_name(other.field_name),
+        path(other.path),
+        hint(other.hint.load(std::memory_order_relaxed))
+    {
+      // Do nothing
+    }
+
+    /// The literal text of this token. Only used if path is empty.
+    std::string literal;
+
+    /// The full name of the substituted field, for error messages
+    std::string field_name;
+
+    /// The names of the fields to step through to reach the substituted field
+    std::vector<std::string> path;
+
+    /// Messages of one type always keep their fields at the same positions, so
+    /// we remember where we last found the top level field.
+    mutable std::atomic_size_t hint;
+  };
+
+  template<typename T>
+  static void append_bytes(std::string& key, const T& value)
+  {
+    key.append(reinterpret_cast<const char*>(&value), sizeof(T));
+  }
+
+  soss::Message::const_iterator find_field(
+      const soss::Message& message,
+      const Token& token) const
+  {
+    const soss::Message::FieldMap& top = message.data;
+    const std::string& first = token.path.front();
 
-  // This uses an ordered map so that we can iterate through it linearly as we
-  // perform substitutions.
-  using SubstitutionMap = std::map<std::size_t, std::string>;
+    soss::Message::const_iterator it;
+    const std::size_t hint = token.hint.load(std::memory_order_relaxed);
+    if(hint < top.size() && (top.begin() + hint)->first == first)
+    {
+      it = top.begin() + hint;
+    }
+    else
+    {
+      it = top.find(first);
+      if(it == top.end())
+        throw UnavailableMessageField(token.field_name, converter.details);
 
-  /// Right now this simply maps a component index to a soss::Message field name.
-  /// In the future, we can replace std::string with an abstract Substitution
-  /// class that gets factory generated based on what type of substitution is
-  /// requested. For right now we've only implemented "message.field"
-  /// substitutions.
-  SubstitutionMap substitutions;
+      token.hint.store(
+            static_cast<std::size_t>(it - top.begin()),
+            std::memory_order_relaxed);
+    }
+
+    for(std::size_t i=1; i < token.path.size(); ++i)
+    {
+      const soss::Message* nested = it->second.cast<soss::Message>();
+      if(!nested)
+        throw UnavailableMessageField(token.field_name, converter.details);
+
+      it = nested->data.find(token.path[i]);
+      if(it == nested->data.end())
+        throw UnavailableMessageField(token.field_name, converter.details);
+    }
+
+    return it;
+  }
+
+  /// The literals and substitutions of the template, in order
+  std::vector<Token> tokens;
 
 };
 
@@ -135,7 +264,25 @@ StringTemplate::StringTemplate(StringTemplate&& other)
 //==============================================================================
 std::string StringTemplate::compute_string(const soss::Message& message) const
 {
-  return pimpl->compute_string(message);
+  std::string output;
+  pimpl->compute_string(message, output);
+  return output;
+}
+
+//==============================================================================
+void StringTemplate::compute_string(
+    const soss::Message& message,
+    std::string& output) const
+{
+  pimpl->compute_string(message, output);
+}
+
+//==============================================================================
+std::size_t StringTemplate::compute_key(
+    const soss::Message& message,
+    std::string& key) const
+{
+  return pimpl->compute_key(message, key);
 }
 
 //==============================================================================
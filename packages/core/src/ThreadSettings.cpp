@@ -0,0 +1,225 @@
+/*
+ * Copyright (C) 2019 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+
+#include <soss/ThreadSettings.hpp>
+
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace soss {
+
+const std::string YamlThreadKey = "thread";
+
+namespace {
+
+const std::string YamlCpusKey = "cpus";
+const std::string YamlPolicyKey = "policy";
+const std::string YamlPriorityKey = "priority";
+const std::string YamlNameKey = "name";
+
+//==============================================================================
+bool parse_cpu_list(
+    const std::string& text,
+    std::vector<int>& cpus,
+    const std::string& context)
+{
+  std::stringstream stream(text);
+  std::string item;
+  while(std::getline(stream, item, ','))
+  {
+    const std::size_t dash = item.find('-');
+    try
+    {
+      std::size_t end = 0;
+      const int first = std::stoi(item, &end);
+      int last = first;
+      if(dash != std::string::npos)
+      {
+        std::size_t last_end = 0;
+        last = std::stoi(item.substr(dash+1), &last_end);
+        end = dash + 1 + last_end;
+      }
+
+      if(end != item.size() || first < 0 || last < first)
+        throw std::invalid_argument(item);
+
+      for(int cpu = first; cpu <= last; ++cpu)
+        cpus.push_back(cpu);
+    }
+    catch(const std::exception&)
+    {
+      std::cerr << "The [" << YamlCpusKey << "] of the " << context
+                << " has an invalid entry [" << item << "]. Use CPU numbers "
+                << "and ranges like [0-3,6]." << std::endl;
+      return false;
+    }
+  }
+
+  return true;
+}
+
+} // anonymous namespace
+
+//==============================================================================
+bool ThreadSettings::parse(const YAML::Node& node, const std::string& context)
+{
+  if(!node)
+    return true;
+
+  if(!node.IsMap())
+  {
+    std::cerr << "The [" << YamlThreadKey << "] settings of the " << context
+              << " must be a dictionary" << std::endl;
+    return false;
+  }
+
+  if(const YAML::Node cpus_node = node[YamlCpusKey])
+  {
+    cpus.clear();
+    if(cpus_node.IsSequence())
+    {
+      for(const YAML::Node& cpu : cpus_node)
+      {
+        if(!parse_cpu_list(cpu.as<std::string>(), cpus, context))
+          return false;
+      }
+    }
+    else if(!parse_cpu_list(cpus_node.as<std::string>(), cpus, context))
+    {
+      return false;
+    }
+  }
+
+  if(const YAML::Node policy_node = node[YamlPolicyKey])
+  {
+    const std::string value = policy_node.as<std::string>();
+    if(value == "other")
+      policy = Policy::Other;
+    else if(value == "fifo")
+      policy = Policy::Fifo;
+    else if(value == "round_robin")
+      policy = Policy::RoundRobin;
+    else
+    {
+      std::cerr << "The [" << YamlPolicyKey << "] of the " << context
+                << " must be [other], [fifo] or [round_robin], but it is ["
+                << value << "]" << std::endl;
+      return false;
+    }
+  }
+
+  if(const YAML::Node priority_node = node[YamlPriorityKey])
+    priority = priority_node.as<int>();
+
+  if(policy == Policy::Fifo || policy == Policy::RoundRobin)
+  {
+    if(priority < 1 || priority > 99)
+    {
+      std::cerr << "The " << context << " uses a real-time scheduling policy, "
+                << "which needs a [" << YamlPriorityKey << "] from 1 to 99, "
+                << "but it is [" << priority << "]" << std::endl;
+      return false;
+    }
+  }
+
+  if(const YAML::Node name_node = node[YamlNameKey])
+    name = name_node.as<std::string>();
+
+  return true;
+}
+
+//==============================================================================
+bool ThreadSettings::apply(const std::string& default_name) const
+{
+  bool success = true;
+
+#ifdef __linux__
+  const pthread_t self = pthread_self();
+
+  // Thread names are limited to 15 characters on Linux
+  const std::string& thread_name = name.empty()? default_name : name;
+  if(!thread_name.empty())
+    pthread_setname_np(self, thread_name.substr(0, 15).c_str());
+
+  if(!cpus.empty())
+  {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for(const int cpu : cpus)
+    {
+      if(cpu < CPU_SETSIZE)
+        CPU_SET(cpu, &set);
+    }
+
+    const int error = pthread_setaffinity_np(self, sizeof(set), &set);
+    if(error != 0)
+    {
+      std::cerr << "Failed to set the CPU affinity of the thread ["
+                << thread_name << "]: " << std::strerror(error) << std::endl;
+      success = false;
+    }
+  }
+
+  if(policy != Policy::Inherit)
+  {
+    const int native_policy =
+        policy == Policy::Fifo? SCHED_FIFO
+      : policy == Policy::RoundRobin? SCHED_RR
+      : SCHED_OTHER;
+
+    sched_param param;
+    std::memset(&param, 0, sizeof(param));
+    param.sched_priority = native_policy == SCHED_OTHER? 0 : priority;
+
+    const int error = pthread_setschedparam(self, native_policy, &param);
+    if(error != 0)
+    {
+      std::cerr << "Failed to set the scheduling policy of the thread ["
+                << thread_name << "]: " << std::strerror(error)
+                << (error == EPERM? " (real-time scheduling needs the "
+                                    "CAP_SYS_NICE capability or an rtprio "
+                                    "limit)" : "") << std::endl;
+      success = false;
+    }
+  }
+#else
+  if(!empty())
+  {
+    std::cerr << "Thread settings are only supported on Linux, so they will "
+              << "be ignored" << std::endl;
+  }
+  (void)default_name;
+#endif
+
+  return success;
+}
+
+//==============================================================================
+bool ThreadSettings::empty() const
+{
+  return cpus.empty() && policy == Policy::Inherit && name.empty();
+}
+
+} // namespace soss
@@ -0,0 +1,182 @@
+/*
+ * Copyright (C) 2019 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include "TimerWheel.hpp"
+
+#include <algorithm>
+#include <iterator>
+
+namespace soss {
+namespace internal {
+
+//==============================================================================
+TimerWheel::TimerWheel(
+    const std::chrono::milliseconds tick,
+    const std::size_t slots)
+  : _tick(std::max(tick, std::chrono::milliseconds(1))),
+    _start(Clock::now()),
+    _slots(std::max<std::size_t>(slots, 1)),
+    _next_id(1),
+    _processed_tick(0),
+    _stopped(false)
+{
+  _worker = std::thread([this]() { _run(); });
+}
+
+//==============================================================================
+TimerWheel& TimerWheel::shared()
+{
+  static TimerWheel wheel;
+  return wheel;
+}
+
+//==============================================================================
+TimerWheel::TimerId TimerWheel::schedule(
+    const std::chrono::milliseconds delay,
+    Callback callback)
+{
+  const auto wait = std::max(delay, std::chrono::milliseconds(0));
+
+  std::unique_lock<std::mutex> lock(_mutex);
+  const bool was_idle = _timers.empty();
+
+  // Round the deadline up to the next tick boundary, so that a timer never
+  // fires before its delay has passed, even if it was scheduled partway
+  // through a tick.
+  const Clock::duration deadline = Clock::now() - _start + wait;
+  const uint64_t expiry_tick = std::max(
+        _processed_tick + 1,
+        static_cast<uint64_t>(
+          (deadline + _tick - Clock::duration(1)) / _tick));
+  const std::size_t slot = expiry_tick % _slots.size();
+
+  const TimerId id = _next_id++;
+  Slot& timers = _slots[slot];
+  timers.push_back(Timer{id, expiry_tick, std::move(callback)});
+  _timers[id] = Location{slot, std::prev(timers.end())};
+
+  // The worker only needs a nudge if it was waiting for the first timer
+  if(was_idle)
+    _wakeup.notify_all();
+
+  return id;
+}
+
+//==============================================================================
+bool TimerWheel::cancel(const TimerId id)
+{
+  std::unique_lock<std::mutex> lock(_mutex);
+  const auto it = _timers.find(id);
+  if(it == _timers.end())
+    return false;
+
+  _slots[it->second.slot].erase(it->second.timer);
+  _timers.erase(it);
+  return true;
+}
+
+//==============================================================================
+std::size_t TimerWheel::size() const
+{
+  std::unique_lock<std::mutex> lock(_mutex);
+  return _timers.size();
+}
+
+//==============================================================================
+void TimerWheel::stop()
+{
+  {
+    std::unique_lock<std::mutex> lock(_mutex);
+    _stopped = true;
+  }
+
+  _wakeup.notify_all();
+
+  if(_worker.joinable() && _worker.get_id() != std::this_thread::get_id())
+    _worker.join();
+}
+
+//==============================================================================
+TimerWheel::~TimerWheel()
+{
+  stop();
+}
+
+//==============================================================================
+uint64_t TimerWheel::_tick_of(const Clock::time_point time) const
+{
+  return static_cast<uint64_t>((time - _start) / _tick);
+}
+
+//==============================================================================
+void TimerWheel::_run()
+{
+  std::vector<Callback> due;
+
+  std::unique_lock<std::mutex> lock(_mutex);
+  while(!_stopped)
+  {
+    if(_timers.empty())
+    {
+      _wakeup.wait(lock);
+      continue;
+    }
+
+    const uint64_t now_tick = _tick_of(Clock::now());
+    if(now_tick <= _processed_tick)
+    {
+      _wakeup.wait_until(
+            lock, _start + _tick*static_cast<int64_t>(_processed_tick + 1));
+      continue;
+    }
+
+    // Visit every slot whose tick has passed since we last looked. If we fell
+    // behind by a whole revolution, then each slot only needs one visit.
+    const uint64_t last_tick =
+        std::min<uint64_t>(now_tick, _processed_tick + _slots.size());
+    for(uint64_t tick = _processed_tick + 1; tick <= last_tick; ++tick)
+    {
+      Slot& timers = _slots[tick % _slots.size()];
+      for(auto it = timers.begin(); it != timers.end(); )
+      {
+        // Timers that are more than one revolution away share this slot too
+        if(now_tick < it->expiry_tick)
+        {
+          ++it;
+          continue;
+        }
+
+        due.push_back(std::move(it->callback));
+        _timers.erase(it->id);
+        it = timers.erase(it);
+      }
+    }
+
+    _processed_tick = now_tick;
+
+    // Run the callbacks without the lock, so that they may schedule or cancel
+    // other timers.
+    lock.unlock();
+    for(Callback& callback : due)
+      callback();
+    due.clear();
+    lock.lock();
+  }
+}
+
+} // namespace internal
+} // namespace soss
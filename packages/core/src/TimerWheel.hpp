@@ -0,0 +1,118 @@
+/*
+ * Copyright (C) 2019 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#ifndef SOSS__INTERNAL__TIMERWHEEL_HPP
+#define SOSS__INTERNAL__TIMERWHEEL_HPP
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace soss {
+namespace internal {
+
+//==============================================================================
+/// TimerWheel runs callbacks once their delay has passed. Timers are hashed
+/// into a ring of slots by the tick that they expire on, so scheduling and
+/// cancelling a timer are constant time no matter how many timers are waiting.
+/// A single worker thread advances the wheel, and it only wakes up while there
+/// are timers to run.
+///
+/// Callbacks run on the worker thread, so they should be quick. A timer fires
+/// at most one tick late.
+class TimerWheel
+{
+public:
+
+  using Clock = std::chrono::steady_clock;
+  using Callback = std::function<void()>;
+  using TimerId = uint64_t;
+
+  TimerWheel(
+      std::chrono::milliseconds tick = std::chrono::milliseconds(10),
+      std::size_t slots = 512);
+
+  /// \brief The wheel that is shared by everything in this process
+  static TimerWheel& shared();
+
+  /// \brief Run a callback once the delay has passed
+  /// \returns an id that can be given to cancel(~). Ids are never 0.
+  TimerId schedule(std::chrono::milliseconds delay, Callback callback);
+
+  /// \brief Prevent a timer from running
+  /// \returns true if the timer was still waiting, or false if it has already
+  /// run or been cancelled.
+  bool cancel(TimerId id);
+
+  /// \brief The number of timers that are waiting
+  std::size_t size() const;
+
+  /// \brief Stop the worker thread. Timers that are still waiting will never
+  /// run.
+  void stop();
+
+  TimerWheel(const TimerWheel&) = delete;
+  TimerWheel& operator=(const TimerWheel&) = delete;
+
+  ~TimerWheel();
+
+private:
+
+  struct Timer
+  {
+    TimerId id;
+    uint64_t expiry_tick;
+    Callback callback;
+  };
+
+  using Slot = std::list<Timer>;
+
+  uint64_t _tick_of(Clock::time_point time) const;
+
+  void _run();
+
+  const std::chrono::milliseconds _tick;
+  const Clock::time_point _start;
+  std::vector<Slot> _slots;
+
+  // Where each waiting timer is, so that it can be cancelled right away
+  struct Location
+  {
+    std::size_t slot;
+    Slot::iterator timer;
+  };
+  std::unordered_map<TimerId, Location> _timers;
+
+  TimerId _next_id;
+  uint64_t _processed_tick;
+  bool _stopped;
+  mutable std::mutex _mutex;
+  std::condition_variable _wakeup;
+  std::thread _worker;
+
+};
+
+} // namespace internal
+} // namespace soss
+
+#endif // SOSS__INTERNAL__TIMERWHEEL_HPP
@@ -0,0 +1,196 @@
+/*
+ * Copyright (C) 2019 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include "TopicDispatch.hpp"
+
+#include <soss/MessageEnvelope.hpp>
+
+#include <iostream>
+
+namespace soss {
+namespace internal {
+
+namespace {
+
+// A field that takes on many values that match no case, like a sequence
+// number, would otherwise make the cache grow without bound, so it starts
+// over once it remembers this many values.
+const std::size_t MaxCachedValues = 4096;
+
+//==============================================================================
+bool publish_to(
+    const DispatchPublisher::Publishers& publishers,
+    const Message& message)
+{
+  if(publishers.size() == 1)
+    return publishers.front()->publish(message);
+
+  // Let the publishers share the work of encoding the message
+  const MessageEnvelope envelope(message);
+  bool success = true;
+  for(const auto& publisher : publishers)
+    success &= publisher->publish_envelope(envelope);
+
+  return success;
+}
+
+} // anonymous namespace
+
+//==============================================================================
+DispatchPublisher::DispatchPublisher(
+    const std::string& topic,
+    const std::string& field,
+    std::map<std::string, Publishers> cases,
+    Publishers fallback,
+    ChannelMetrics& metrics)
+  : _topic(topic),
+    _template("{message." + field + "}",
+              "dispatching the topic [" + topic + "]"),
+    _cache(_template),
+    _metrics(metrics)
+{
+  _cases.reserve(cases.size() + 1);
+  for(auto& entry : cases)
+  {
+    _index[entry.first] = _cases.size();
+    _cases.push_back(std::move(entry.second));
+  }
+
+  _cases.push_back(std::move(fallback));
+}
+
+//==============================================================================
+bool DispatchPublisher::publish(const Message& message)
+{
+  const Publishers& publishers = _cases[_find(message)];
+  if(publishers.empty())
+  {
+    _metrics.count_drop();
+    return true;
+  }
+
+  return publish_to(publishers, message);
+}
+
+//==============================================================================
+bool DispatchPublisher::publish_owned(Message&& message)
+{
+  const Publishers& publishers = _cases[_find(message)];
+  if(publishers.empty())
+  {
+    _metrics.count_drop();
+    return true;
+  }
+
+  if(publishers.size() == 1)
+    return publishers.front()->publish_owned(std::move(message));
+
+  return publish_to(publishers, message);
+}
+
+//==============================================================================
+bool DispatchPublisher::publish_envelope(const MessageEnvelope& envelope)
+{
+  const Publishers& publishers = _cases[_find(envelope.message())];
+  if(publishers.empty())
+  {
+    _metrics.count_drop();
+    return true;
+  }
+
+  bool success = true;
+  for(const auto& publisher : publishers)
+    success &= publisher->publish_envelope(envelope);
+
+  return success;
+}
+
+//==============================================================================
+bool DispatchPublisher::publish_batch(
+    const std::vector<std::shared_ptr<const Message>>& messages)
+{
+  // Sort the batch into one batch per case, keeping the order of the
+  // messages within each case
+  std::vector<std::vector<std::shared_ptr<const Message>>> batches(
+        _cases.size());
+  for(const std::shared_ptr<const Message>& message : messages)
+    batches[_find(*message)].push_back(message);
+
+  bool success = true;
+  for(std::size_t i=0; i < _cases.size(); ++i)
+  {
+    if(batches[i].empty())
+      continue;
+
+    if(_cases[i].empty())
+    {
+      for(std::size_t j=0; j < batches[i].size(); ++j)
+        _metrics.count_drop();
+
+      continue;
+    }
+
+    for(const auto& publisher : _cases[i])
+      success &= publisher->publish_batch(batches[i]);
+  }
+
+  return success;
+}
+
+//==============================================================================
+std::size_t DispatchPublisher::_find(const Message& message)
+{
+  const std::size_t fallback = _cases.size() - 1;
+
+  std::unique_lock<std::mutex> lock(_cache_mutex);
+  if(message.data.empty() && message.native)
+  {
+    // A message that only carries its native representation has no field to
+    // dispatch on, e.g. the messages of a ros2 topic with serialized or
+    // direct_json
+    if(!_warned_native)
+    {
+      std::cerr << "[soss::dispatch] The messages of topic [" << _topic
+                << "] skip the conversion into soss fields, so they cannot be "
+                << "dispatched on their fields and will all go to the default "
+                << "destinations" << std::endl;
+      _warned_native = true;
+    }
+
+    return fallback;
+  }
+
+  if(_cache.size() >= MaxCachedValues)
+    _cache.clear();
+
+  try
+  {
+    return _cache.get(message, [&](const std::string& value)
+    {
+      const auto it = _index.find(value);
+      return it == _index.end()? fallback : it->second;
+    });
+  }
+  catch(const UnavailableMessageField&)
+  {
+    // Messages without the field cannot match any of the cases
+    return fallback;
+  }
+}
+
+} // namespace internal
+} // namespace soss
@@ -0,0 +1,126 @@
+/*
+ * Copyright (C) 2019 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#ifndef SOSS__INTERNAL__TOPICDISPATCH_HPP
+#define SOSS__INTERNAL__TOPICDISPATCH_HPP
+
+#include <soss/Metrics.hpp>
+#include <soss/StringTemplate.hpp>
+#include <soss/SystemHandle.hpp>
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace soss {
+namespace internal {
+
+//==============================================================================
+struct TopicDispatchConfig
+{
+  /// Where each case sends its messages.
+  /// key: destination middleware, value: that middleware's name for the topic
+  using Targets = std::map<std::string, std::string>;
+
+  /// The field whose value picks the case of each message, named by its path
+  /// through the nested messages, e.g. "header.frame_id". The topic is not
+  /// dispatched when this is empty.
+  std::string field;
+
+  /// key: the value of the field, as text
+  std::map<std::string, Targets> cases;
+
+  /// Where the messages go that do not match any case, or that do not have
+  /// the field at all. They get dropped if this is empty.
+  Targets fallback;
+
+  bool enabled() const { return !field.empty(); }
+};
+
+//==============================================================================
+/// DispatchPublisher sends each message of a topic only to the publishers of
+/// the case that the value of one of its fields matches. The cases are kept in
+/// a hash index, and the case of every distinct value gets remembered in a
+/// StringTemplateCache, so most messages get dispatched without turning their
+/// field into a string. Messages that only carry their native representation
+/// have no fields, so they always go to the fallback.
+class DispatchPublisher : public TopicPublisher
+{
+public:
+
+  using Publishers = std::vector<std::shared_ptr<TopicPublisher>>;
+
+  /// \param[in] topic
+  ///   The name of the topic, for error messages
+  ///
+  /// \param[in] field
+  ///   The path of the field to dispatch on
+  ///
+  /// \param[in] cases
+  ///   The publishers of each value of the field
+  ///
+  /// \param[in] fallback
+  ///   The publishers of the messages that do not match any case
+  ///
+  /// \param[in] metrics
+  ///   Counts the messages that match no case and have no fallback as drops
+  DispatchPublisher(
+      const std::string& topic,
+      const std::string& field,
+      std::map<std::string, Publishers> cases,
+      Publishers fallback,
+      ChannelMetrics& metrics);
+
+  bool publish(const Message& message) override;
+
+  bool publish_owned(Message&& message) override;
+
+  bool publish_envelope(const MessageEnvelope& envelope) override;
+
+  bool publish_batch(
+      const std::vector<std::shared_ptr<const Message>>& messages) override;
+
+private:
+
+  /// Find the index of the case of the message in _cases. Messages that do
+  /// not match any case get the index of the fallback, which is the last one.
+  std::size_t _find(const Message& message);
+
+  const std::string _topic;
+
+  /// The publishers of each case, followed by those of the fallback
+  std::vector<Publishers> _cases;
+
+  /// key: the value of the field, value: the index of its case
+  std::unordered_map<std::string, std::size_t> _index;
+
+  const StringTemplate _template;
+  StringTemplateCache<std::size_t> _cache;
+  std::mutex _cache_mutex;
+  bool _warned_native = false;
+
+  ChannelMetrics& _metrics;
+
+};
+
+} // namespace internal
+} // namespace soss
+
+#endif // SOSS__INTERNAL__TOPICDISPATCH_HPP
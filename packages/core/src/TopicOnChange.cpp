@@ -0,0 +1,66 @@
+/*
+ * Copyright (C) 2019 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include "TopicOnChange.hpp"
+
+#include "ServiceCache.hpp"
+
+namespace soss {
+namespace internal {
+
+//==============================================================================
+TopicOnChange::TopicOnChange(const TopicOnChangeConfig& config)
+  : _projection(config.fields.empty()?
+                  nullptr : std::make_unique<FieldProjection>(config.fields)),
+    _max_silence(std::chrono::duration_cast<Clock::duration>(
+                   config.max_silence))
+{
+  // Do nothing
+}
+
+//==============================================================================
+bool TopicOnChange::admit(const Message& message, const Clock::time_point now)
+{
+  // A message that only carries its native representation, like the
+  // serialized messages of ros2, has no fields to compare, so it always gets
+  // through
+  if(message.data.empty() && message.native)
+    return true;
+
+  // The key gets made before taking the lock, since it is the expensive part
+  std::string key;
+  const bool keyed = _projection?
+        make_message_key(_projection->project(message), key)
+      : make_message_key(message, key);
+
+  if(!keyed)
+    return true;
+
+  std::unique_lock<std::mutex> lock(_mutex);
+  if(_has_last && key == _last_key
+     && (_max_silence == Clock::duration::zero()
+         || now - _last_time < _max_silence))
+    return false;
+
+  _has_last = true;
+  _last_key = std::move(key);
+  _last_time = now;
+  return true;
+}
+
+} // namespace internal
+} // namespace soss
@@ -0,0 +1,87 @@
+/*
+ * Copyright (C) 2019 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#ifndef SOSS__INTERNAL__TOPICONCHANGE_HPP
+#define SOSS__INTERNAL__TOPICONCHANGE_HPP
+
+#include "FieldProjection.hpp"
+
+#include <soss/SystemHandle.hpp>
+
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace soss {
+namespace internal {
+
+//==============================================================================
+struct TopicOnChangeConfig
+{
+  /// Only pass on the messages that differ from the last one that was passed
+  bool enabled = false;
+
+  /// The fields that are compared, named by their path like for projections.
+  /// The whole message is compared when this is empty.
+  std::vector<std::string> fields;
+
+  /// Pass on a repeated message anyway once nothing has been passed on for
+  /// this long, so that the destinations keep hearing from the topic. Zero
+  /// means that repeats are always dropped.
+  std::chrono::nanoseconds max_silence = std::chrono::nanoseconds(0);
+};
+
+//==============================================================================
+/// TopicOnChange drops the messages of a topic that repeat the last message it
+/// let through, like the messages of latched state or static transforms that
+/// get republished at a fixed rate. It is asked as soon as a message arrives,
+/// so the repeats never reach a queue or get converted by any publisher.
+///
+/// Messages get compared by the key of their contents, exactly as the service
+/// cache compares requests, so a change can never be mistaken for a repeat.
+/// Messages with fields that cannot be keyed, and messages that only carry
+/// their native representation, are always let through.
+class TopicOnChange
+{
+public:
+
+  using Clock = std::chrono::steady_clock;
+
+  TopicOnChange(const TopicOnChangeConfig& config);
+
+  /// \brief Find out whether a message that arrived at the given time differs
+  /// from the last one that was let through, or has been silent for too long.
+  bool admit(const Message& message, Clock::time_point now = Clock::now());
+
+private:
+
+  const std::unique_ptr<const FieldProjection> _projection;
+  const Clock::duration _max_silence;
+
+  std::mutex _mutex;
+  bool _has_last = false;
+  std::string _last_key;
+  Clock::time_point _last_time;
+
+};
+
+} // namespace internal
+} // namespace soss
+
+#endif // SOSS__INTERNAL__TOPICONCHANGE_HPP
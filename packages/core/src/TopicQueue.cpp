@@ -0,0 +1,375 @@
+/*
+ * Copyright (C) 2019 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include "TopicQueue.hpp"
+
+#include <algorithm>
+#include <iostream>
+
+namespace soss {
+namespace internal {
+
+//==============================================================================
+TopicQueue::TopicQueue(
+    std::string topic,
+    const TopicQueueConfig& config,
+    Sink sink,
+    ChannelMetrics& metrics,
+    std::shared_ptr<Executor> executor)
+  : TopicQueue(
+      std::move(topic), config,
+      BatchSink([sink = std::move(sink)](std::vector<Entry>& batch)
+      {
+        for(Entry& entry : batch)
+          sink(std::move(entry.message), entry.received);
+      }),
+      metrics,
+      std::move(executor))
+{
+  // Do nothing
+}
+
+//==============================================================================
+TopicQueue::TopicQueue(
+    std::string topic,
+    const TopicQueueConfig& config,
+    BatchSink sink,
+    ChannelMetrics& metrics,
+    std::shared_ptr<Executor> executor)
+  : _topic(std::move(topic)),
+    _config(config),
+    _sink(std::move(sink)),
+    _metrics(metrics),
+    _executor(std::move(executor)),
+    _memory(0),
+    _warned_memory(false),
+    _dropped(0),
+    _stopped(false),
+    _scheduled(false)
+{
+  if(!_executor)
+    _worker = std::thread([this]() { _drain(); });
+}
+
+//==============================================================================
+void TopicQueue::push(const Message& message)
+{
+  // Copy the message before taking the lock, because the subscription that
+  // gave it to us only lends it for the duration of its callback.
+  _push(std::make_shared<const Message>(message));
+}
+
+//==============================================================================
+void TopicQueue::push(Message&& message)
+{
+  _push(std::make_shared<const Message>(std::move(message)));
+}
+
+//==============================================================================
+void TopicQueue::_push(std::shared_ptr<const Message> message)
+{
+  // The footprint is estimated before taking the lock, since it has to visit
+  // every field of the message
+  const std::size_t bytes = memory_footprint(*message);
+  Entry entry{std::move(message), Ingress::time(), bytes};
+
+  std::unique_lock<std::mutex> lock(_mutex);
+  if(_stopped)
+    return;
+
+  const std::size_t depth =
+      _config.policy == TopicQueueConfig::Policy::KeepLatest?
+        1 : _config.depth;
+
+  if(_messages.size() >= depth)
+  {
+    switch(_config.policy)
+    {
+      case TopicQueueConfig::Policy::DropOldest:
+        _pop_oldest();
+        _drop();
+        break;
+
+      case TopicQueueConfig::Policy::KeepLatest:
+        // Replacing stale messages is the whole point of this policy, so it
+        // does not deserve a warning.
+        _pop_oldest();
+        ++_dropped;
+        _metrics.count_drop();
+        break;
+
+      case TopicQueueConfig::Policy::DropNewest:
+        _drop();
+        return;
+
+      case TopicQueueConfig::Policy::Block:
+        _not_full.wait(lock, [&]()
+        {
+          return _stopped || _messages.size() < depth;
+        });
+
+        if(_stopped)
+          return;
+
+        break;
+    }
+  }
+
+  if(!_reserve(lock, bytes))
+  {
+    if(!_stopped)
+      _drop_for_memory();
+
+    return;
+  }
+
+  _memory += bytes;
+  _messages.push_back(std::move(entry));
+  _metrics.set_queue_depth(_messages.size());
+
+  if(!_executor)
+  {
+    lock.unlock();
+    _not_empty.notify_one();
+    return;
+  }
+
+  if(_scheduled)
+    return;
+
+  _scheduled = true;
+  lock.unlock();
+
+  // The task must not keep the queue alive, or else a queue that has been
+  // dropped could not be destroyed until the executor gets to its task.
+  std::weak_ptr<TopicQueue> weak = shared_from_this();
+  _executor->post([weak]()
+  {
+    if(const auto queue = weak.lock())
+      queue->_drain_once();
+  });
+}
+
+//==============================================================================
+void TopicQueue::stop()
+{
+  {
+    std::unique_lock<std::mutex> lock(_mutex);
+    _stopped = true;
+    _messages.clear();
+    _metrics.release_memory(_memory);
+    _memory = 0;
+    _metrics.set_queue_depth(0);
+  }
+
+  _not_empty.notify_all();
+  _not_full.notify_all();
+
+  if(_worker.joinable() && _worker.get_id() != std::this_thread::get_id())
+    _worker.join();
+
+  if(_executor)
+  {
+    // Tasks that have not started yet will find the queue stopped, but one
+    // that is already in the sink has to finish before we can return.
+    std::unique_lock<std::mutex> lock(_mutex);
+    _sunk.wait(lock, [&]()
+    {
+      return _sinking == std::thread::id()
+          || _sinking == std::this_thread::get_id();
+    });
+  }
+}
+
+//==============================================================================
+TopicQueue::~TopicQueue()
+{
+  stop();
+}
+
+//==============================================================================
+void TopicQueue::_drain()
+{
+  const std::size_t batch_size = std::max<std::size_t>(_config.batch, 1);
+  std::vector<Entry> batch;
+  batch.reserve(batch_size);
+
+  std::unique_lock<std::mutex> lock(_mutex);
+  while(true)
+  {
+    _not_empty.wait(lock, [&]() { return _stopped || !_messages.empty(); });
+    if(_stopped)
+      return;
+
+    _take_batch(lock, batch);
+    _sink(batch);
+    batch.clear();
+    lock.lock();
+  }
+}
+
+//==============================================================================
+void TopicQueue::_drain_once()
+{
+  std::vector<Entry> batch;
+  batch.reserve(std::max<std::size_t>(_config.batch, 1));
+
+  std::unique_lock<std::mutex> lock(_mutex);
+  if(_stopped || _messages.empty())
+  {
+    _scheduled = false;
+    return;
+  }
+
+  _sinking = std::this_thread::get_id();
+  _take_batch(lock, batch);
+  _sink(batch);
+
+  lock.lock();
+  _sinking = std::thread::id();
+  const bool more = !_stopped && !_messages.empty();
+  _scheduled = more;
+  lock.unlock();
+  _sunk.notify_all();
+
+  // Go to the back of the line instead of looping, so that a busy topic
+  // cannot hold on to a worker of the executor
+  if(more)
+  {
+    std::weak_ptr<TopicQueue> weak = shared_from_this();
+    _executor->post([weak]()
+    {
+      if(const auto queue = weak.lock())
+        queue->_drain_once();
+    });
+  }
+}
+
+//==============================================================================
+void TopicQueue::_take_batch(
+    std::unique_lock<std::mutex>& lock,
+    std::vector<Entry>& batch)
+{
+  const std::size_t batch_size = std::max<std::size_t>(_config.batch, 1);
+
+  // Take whatever has piled up, so that a burst gets delivered in fewer
+  // calls to the sink
+  std::size_t released = 0;
+  while(!_messages.empty() && batch.size() < batch_size)
+  {
+    released += _messages.front().bytes;
+    batch.push_back(std::move(_messages.front()));
+    _messages.pop_front();
+  }
+  _memory -= released;
+  _metrics.release_memory(released);
+  _metrics.set_queue_depth(_messages.size());
+
+  lock.unlock();
+  if(batch.size() > 1)
+    _not_full.notify_all();
+  else
+    _not_full.notify_one();
+}
+
+//==============================================================================
+void TopicQueue::_drop()
+{
+  _metrics.count_drop();
+
+  // Only complain about the first message that gets dropped, or else a
+  // saturated route would flood the output.
+  if(_dropped++ == 0)
+  {
+    std::cerr << "WARNING: The queue of topic [" << _topic << "] is full, so "
+              << "messages are being dropped. Consider increasing its depth."
+              << std::endl;
+  }
+}
+
+//==============================================================================
+bool TopicQueue::_reserve(
+    std::unique_lock<std::mutex>& lock,
+    const std::size_t bytes)
+{
+  const std::size_t budget = _config.memory_budget;
+  const auto within_budget = [&]()
+  {
+    // A message that is bigger than the whole budget still gets through an
+    // empty queue, or else it could never be delivered at all
+    return budget == 0 || _messages.empty() || _memory + bytes <= budget;
+  };
+
+  while(true)
+  {
+    if(within_budget() && _metrics.reserve_memory(bytes))
+      return true;
+
+    // Only the messages of this queue can be discarded to make room, so once
+    // it is empty, the process is out of memory for anything new
+    if(_messages.empty())
+      return false;
+
+    switch(_config.policy)
+    {
+      case TopicQueueConfig::Policy::DropOldest:
+      case TopicQueueConfig::Policy::KeepLatest:
+        _pop_oldest();
+        _drop_for_memory();
+        break;
+
+      case TopicQueueConfig::Policy::DropNewest:
+        return false;
+
+      case TopicQueueConfig::Policy::Block:
+        _not_full.wait(lock);
+        if(_stopped)
+          return false;
+
+        break;
+    }
+  }
+}
+
+//==============================================================================
+void TopicQueue::_pop_oldest()
+{
+  const std::size_t bytes = _messages.front().bytes;
+  _messages.pop_front();
+  _memory -= bytes;
+  _metrics.release_memory(bytes);
+}
+
+//==============================================================================
+void TopicQueue::_drop_for_memory()
+{
+  ++_dropped;
+  _metrics.count_drop();
+
+  if(!_warned_memory)
+  {
+    _warned_memory = true;
+    std::cerr << "WARNING: The queue of topic [" << _topic << "] has run out "
+              << "of memory, so messages are being dropped. The queue holds ["
+              << _memory << "] bytes, and soss holds ["
+              << Metrics::memory_bytes() << "] bytes altogether. Consider "
+              << "raising the memory budget." << std::endl;
+  }
+}
+
+} // namespace internal
+} // namespace soss
@@ -0,0 +1,204 @@
+/*
+ * Copyright (C) 2019 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#ifndef SOSS__INTERNAL__TOPICQUEUE_HPP
+#define SOSS__INTERNAL__TOPICQUEUE_HPP
+
+#include <soss/Executor.hpp>
+#include <soss/Message.hpp>
+#include <soss/Metrics.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace soss {
+namespace internal {
+
+//==============================================================================
+struct TopicQueueConfig
+{
+  enum class Policy
+  {
+    /// Discard the oldest queued message to make room for a new one
+    DropOldest,
+
+    /// Discard the incoming message when the queue is full
+    DropNewest,
+
+    /// Only hold on to the most recent message of the topic
+    KeepLatest,
+
+    /// Make the subscriber wait until there is room in the queue
+    Block
+  };
+
+  /// The maximum number of messages that may be waiting. A depth of zero means
+  /// that the topic is not queued, and its publishers are called directly from
+  /// the subscription callback.
+  std::size_t depth = 0;
+
+  Policy policy = Policy::DropOldest;
+
+  /// The most messages that the worker will take out of the queue and hand
+  /// to the sink at once
+  std::size_t batch = 1;
+
+  /// The most bytes of memory that the waiting messages may hold, as
+  /// estimated by soss::memory_footprint(), or zero for no limit. The policy
+  /// of the queue decides what happens when a message would go over it, just
+  /// like when the queue is at its depth.
+  std::size_t memory_budget = 0;
+
+  bool enabled() const { return depth > 0; }
+};
+
+//==============================================================================
+/// TopicQueue decouples the subscriptions of a topic route from its
+/// publishers. Incoming messages are copied into a bounded queue, and a worker
+/// thread that belongs to the queue hands them to the publishers, so a slow
+/// sink can only slow down its own route.
+///
+/// A queue that is given an Executor does not have a thread of its own.
+/// Instead it posts a task that hands over one batch at a time whenever it
+/// has messages waiting. Such a queue must be owned by a std::shared_ptr.
+class TopicQueue : public std::enable_shared_from_this<TopicQueue>
+{
+public:
+
+  using Clock = std::chrono::steady_clock;
+
+  /// Signature of the function that delivers the queued messages. It also
+  /// receives the Ingress::time() of the message, which is when it was pushed
+  /// into the queue unless its middleware marked an earlier ingress.
+  using Sink = std::function<void(
+      std::shared_ptr<const Message> message,
+      Clock::time_point received)>;
+
+  struct Entry
+  {
+    std::shared_ptr<const Message> message;
+    Clock::time_point received;
+
+    /// The memory that the message was accounted for while it was waiting
+    std::size_t bytes;
+  };
+
+  /// Signature of a function that delivers several queued messages at once,
+  /// oldest first. The batch holds at least one and at most
+  /// TopicQueueConfig::batch entries.
+  using BatchSink = std::function<void(std::vector<Entry>& batch)>;
+
+  TopicQueue(
+      std::string topic,
+      const TopicQueueConfig& config,
+      Sink sink,
+      ChannelMetrics& metrics,
+      std::shared_ptr<Executor> executor = nullptr);
+
+  TopicQueue(
+      std::string topic,
+      const TopicQueueConfig& config,
+      BatchSink sink,
+      ChannelMetrics& metrics,
+      std::shared_ptr<Executor> executor = nullptr);
+
+  /// \brief Add a message to the queue, applying the policy of the queue if
+  /// it is already full.
+  void push(const Message& message);
+
+  /// \brief Add a message that the subscription no longer needs, without
+  /// copying it.
+  void push(Message&& message);
+
+  /// \brief Stop the worker thread, or wait for the batch that is being
+  /// handed over on the executor, and release anyone who is blocked on the
+  /// queue. Messages that are still waiting will be discarded.
+  void stop();
+
+  /// \brief The number of messages that have been discarded by this queue
+  std::size_t dropped() const { return _dropped; }
+
+  TopicQueue(const TopicQueue&) = delete;
+  TopicQueue& operator=(const TopicQueue&) = delete;
+
+  ~TopicQueue();
+
+private:
+
+  void _push(std::shared_ptr<const Message> message);
+
+  void _drain();
+
+  /// Hand over one batch on the executor, and post another task if more
+  /// messages are waiting afterwards
+  void _drain_once();
+
+  /// Move the oldest waiting messages into the batch and release anyone who
+  /// was waiting for room in the queue. The lock gets released.
+  void _take_batch(
+      std::unique_lock<std::mutex>& lock,
+      std::vector<Entry>& batch);
+
+  void _drop();
+
+  /// Make room for the memory of a new message, following the policy of the
+  /// queue. Returns false if the new message has to be dropped instead.
+  bool _reserve(std::unique_lock<std::mutex>& lock, std::size_t bytes);
+
+  /// Discard the oldest waiting message and return its memory
+  void _pop_oldest();
+
+  void _drop_for_memory();
+
+  const std::string _topic;
+  const TopicQueueConfig _config;
+  const BatchSink _sink;
+  ChannelMetrics& _metrics;
+  const std::shared_ptr<Executor> _executor;
+
+  std::deque<Entry> _messages;
+  std::size_t _memory;
+  bool _warned_memory;
+  std::atomic_size_t _dropped;
+  bool _stopped;
+  std::mutex _mutex;
+  std::condition_variable _not_empty;
+  std::condition_variable _not_full;
+  std::thread _worker;
+
+  // Whether a task of this queue has been posted to the executor, and which
+  // thread is handing a batch to the sink, if any
+  bool _scheduled;
+  std::thread::id _sinking;
+  std::condition_variable _sunk;
+
+};
+
+using TopicQueuePtr = std::shared_ptr<TopicQueue>;
+
+} // namespace internal
+} // namespace soss
+
+#endif // SOSS__INTERNAL__TOPICQUEUE_HPP
@@ -0,0 +1,129 @@
+/*
+ * Copyright (C) 2019 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include "TopicThrottle.hpp"
+
+#include <algorithm>
+
+namespace soss {
+namespace internal {
+
+//==============================================================================
+TopicThrottle::TopicThrottle(const TopicThrottleConfig& config)
+  : _decimate(std::max<std::size_t>(config.decimate, 1)),
+    _interval_ns(config.rate > 0.0?
+                   static_cast<int64_t>(1e9/config.rate) : 0),
+    _count(0),
+    _next_ns(0)
+{
+  // Do nothing
+}
+
+//==============================================================================
+bool TopicThrottle::admit(const Clock::time_point now)
+{
+  if(_decimate > 1 && _count++ % _decimate != 0)
+    return false;
+
+  if(_interval_ns > 0)
+    return _admit_rate(now);
+
+  return true;
+}
+
+//==============================================================================
+bool TopicThrottle::_admit_rate(const Clock::time_point now)
+{
+  const int64_t now_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        now.time_since_epoch()).count();
+
+  int64_t next = _next_ns.load();
+  while(true)
+  {
+    if(now_ns < next)
+      return false;
+
+    // Keep to the schedule while messages arrive steadily, so that jitter in
+    // the arrival times does not lower the rate. After a gap the schedule
+    // starts over from this message.
+    const int64_t following = now_ns - next < _interval_ns?
+          next + _interval_ns : now_ns + _interval_ns;
+
+    if(_next_ns.compare_exchange_weak(next, following))
+      return true;
+  }
+}
+
+//==============================================================================
+ThrottledPublisher::ThrottledPublisher(
+    std::shared_ptr<TopicPublisher> publisher,
+    const TopicThrottleConfig& config)
+  : _publisher(std::move(publisher)),
+    _throttle(config)
+{
+  // Do nothing
+}
+
+//==============================================================================
+bool ThrottledPublisher::publish(const Message& message)
+{
+  if(!_throttle.admit())
+    return true;
+
+  return _publisher->publish(message);
+}
+
+//==============================================================================
+bool ThrottledPublisher::publish_owned(Message&& message)
+{
+  if(!_throttle.admit())
+    return true;
+
+  return _publisher->publish_owned(std::move(message));
+}
+
+//==============================================================================
+bool ThrottledPublisher::publish_envelope(const MessageEnvelope& envelope)
+{
+  if(!_throttle.admit())
+    return true;
+
+  return _publisher->publish_envelope(envelope);
+}
+
+//==============================================================================
+bool ThrottledPublisher::publish_batch(
+    const std::vector<std::shared_ptr<const Message>>& messages)
+{
+  std::vector<std::shared_ptr<const Message>> admitted;
+  admitted.reserve(messages.size());
+
+  const TopicThrottle::Clock::time_point now = TopicThrottle::Clock::now();
+  for(const std::shared_ptr<const Message>& message : messages)
+  {
+    if(_throttle.admit(now))
+      admitted.push_back(message);
+  }
+
+  if(admitted.empty())
+    return true;
+
+  return _publisher->publish_batch(admitted);
+}
+
+} // namespace internal
+} // namespace soss
@@ -0,0 +1,105 @@
+/*
+ * Copyright (C) 2019 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#ifndef SOSS__INTERNAL__TOPICTHROTTLE_HPP
+#define SOSS__INTERNAL__TOPICTHROTTLE_HPP
+
+#include <soss/SystemHandle.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+
+namespace soss {
+namespace internal {
+
+//==============================================================================
+struct TopicThrottleConfig
+{
+  /// The most messages per second that get published. A rate of zero means
+  /// that the rate is not limited.
+  double rate = 0.0;
+
+  /// Only every nth message gets published
+  std::size_t decimate = 1;
+
+  bool enabled() const { return rate > 0.0 || decimate > 1; }
+};
+
+//==============================================================================
+/// TopicThrottle decides which messages of a topic may reach one of its
+/// destinations. It is thread-safe and lock-free, since it gets asked from
+/// the subscription callbacks of the topic.
+class TopicThrottle
+{
+public:
+
+  using Clock = std::chrono::steady_clock;
+
+  TopicThrottle(const TopicThrottleConfig& config);
+
+  /// \brief Find out whether the message that arrived at the given time should
+  /// be published. Each call counts as one message of the topic.
+  bool admit(Clock::time_point now = Clock::now());
+
+private:
+
+  bool _admit_rate(Clock::time_point now);
+
+  const std::size_t _decimate;
+  const int64_t _interval_ns;
+  std::atomic<uint64_t> _count;
+
+  // The earliest time at which the next message may be published, measured
+  // in nanoseconds since the epoch of the clock
+  std::atomic<int64_t> _next_ns;
+
+};
+
+//==============================================================================
+/// ThrottledPublisher passes only the messages that its throttle admits on to
+/// the publisher of a destination. The messages that get dropped are never
+/// converted for the destination's middleware.
+class ThrottledPublisher : public TopicPublisher
+{
+public:
+
+  ThrottledPublisher(
+      std::shared_ptr<TopicPublisher> publisher,
+      const TopicThrottleConfig& config);
+
+  bool publish(const Message& message) override;
+
+  bool publish_owned(Message&& message) override;
+
+  bool publish_envelope(const MessageEnvelope& envelope) override;
+
+  bool publish_batch(
+      const std::vector<std::shared_ptr<const Message>>& messages) override;
+
+private:
+
+  const std::shared_ptr<TopicPublisher> _publisher;
+  TopicThrottle _throttle;
+
+};
+
+} // namespace internal
+} // namespace soss
+
+#endif // SOSS__INTERNAL__TOPICTHROTTLE_HPP
@@ -0,0 +1,267 @@
+/*
+ * Copyright (C) 2019 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include "Watchdog.hpp"
+
+#include <soss/Metrics.hpp>
+
+#include <iostream>
+#include <memory>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <time.h>
+#endif
+
+namespace soss {
+namespace internal {
+
+namespace {
+
+//==============================================================================
+int64_t steady_now()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//==============================================================================
+/// The CPU time that this thread has used, in nanoseconds. It is only
+/// measured on Linux, so elsewhere the work of each thread takes no CPU time.
+int64_t thread_cpu_now()
+{
+#ifdef __linux__
+  timespec time;
+  if(clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time) != 0)
+    return 0;
+
+  return static_cast<int64_t>(time.tv_sec)*1000000000 + time.tv_nsec;
+#else
+  return 0;
+#endif
+}
+
+//==============================================================================
+/// The heartbeat that is busy on this thread, if any
+thread_local Heartbeat* current_heartbeat = nullptr;
+
+//==============================================================================
+/// Give a thread that delivers messages without a heartbeat one of its own,
+/// named after the thread
+Heartbeat& heartbeat_of_thread()
+{
+  static std::atomic_size_t count(0);
+  thread_local std::unique_ptr<Heartbeat> heartbeat;
+  if(!heartbeat)
+  {
+#ifdef __linux__
+    char name[16] = "";
+    pthread_getname_np(pthread_self(), name, sizeof(name));
+#else
+    const char* const name = "thread";
+#endif
+    heartbeat.reset(new Heartbeat(
+          std::string(name) + "/" + std::to_string(count++)));
+  }
+
+  return *heartbeat;
+}
+
+} // anonymous namespace
+
+//==============================================================================
+Heartbeat::Heartbeat(std::string name)
+  : _name(std::move(name)),
+    _busy_since(0),
+    _cpu_at_busy(0),
+    _cpu(0),
+    _route(nullptr),
+    _reported_since(0),
+    _stalls(0)
+{
+  Watchdog::get()._add(this);
+}
+
+//==============================================================================
+void Heartbeat::busy()
+{
+  current_heartbeat = this;
+  _cpu_at_busy = thread_cpu_now();
+  _busy_since.store(steady_now(), std::memory_order_relaxed);
+}
+
+//==============================================================================
+void Heartbeat::idle()
+{
+  _busy_since.store(0, std::memory_order_relaxed);
+  _cpu.fetch_add(
+        static_cast<uint64_t>(thread_cpu_now() - _cpu_at_busy),
+        std::memory_order_relaxed);
+  current_heartbeat = nullptr;
+}
+
+//==============================================================================
+Heartbeat::~Heartbeat()
+{
+  if(current_heartbeat == this)
+    current_heartbeat = nullptr;
+
+  Watchdog::get()._remove(this);
+}
+
+//==============================================================================
+RouteActivity::RouteActivity(const char* const route)
+  : _heartbeat(nullptr),
+    _previous(nullptr),
+    _owns_work(false)
+{
+  if(!Watchdog::tracking_routes())
+    return;
+
+  _heartbeat = current_heartbeat;
+  if(!_heartbeat)
+  {
+    // Nobody else is watching this thread, so the delivery itself is the
+    // piece of work
+    _heartbeat = &heartbeat_of_thread();
+    _heartbeat->busy();
+    _owns_work = true;
+  }
+
+  std::unique_lock<std::mutex> lock(_heartbeat->_route_mutex);
+  _previous = _heartbeat->_route;
+  _heartbeat->_route = route;
+}
+
+//==============================================================================
+RouteActivity::~RouteActivity()
+{
+  if(!_heartbeat)
+    return;
+
+  {
+    std::unique_lock<std::mutex> lock(_heartbeat->_route_mutex);
+    _heartbeat->_route = _previous;
+  }
+
+  if(_owns_work)
+    _heartbeat->idle();
+}
+
+//==============================================================================
+Watchdog& Watchdog::get()
+{
+  static Watchdog watchdog;
+  return watchdog;
+}
+
+//==============================================================================
+Watchdog::Watchdog()
+  : _threshold(std::chrono::nanoseconds(std::chrono::seconds(1)).count()),
+    _track_routes(false)
+{
+  // Do nothing
+}
+
+//==============================================================================
+void Watchdog::configure(
+    const std::chrono::nanoseconds threshold,
+    const bool track_routes)
+{
+  _threshold.store(threshold.count(), std::memory_order_relaxed);
+  _track_routes.store(track_routes, std::memory_order_relaxed);
+}
+
+//==============================================================================
+void Watchdog::check()
+{
+  const int64_t threshold = _threshold.load(std::memory_order_relaxed);
+  const int64_t now = steady_now();
+
+  std::unique_lock<std::mutex> lock(_mutex);
+  for(Heartbeat* const heartbeat : _heartbeats)
+  {
+    const int64_t since =
+        heartbeat->_busy_since.load(std::memory_order_relaxed);
+    const bool stalled = since != 0 && now - since >= threshold;
+
+    if(heartbeat->_reported_since != 0
+       && heartbeat->_reported_since != since)
+    {
+      std::cerr << "[soss::watchdog] The thread [" << heartbeat->_name
+                << "] has recovered from its stall" << std::endl;
+      heartbeat->_reported_since = 0;
+    }
+
+    if(stalled && heartbeat->_reported_since != since)
+    {
+      heartbeat->_reported_since = since;
+      ++heartbeat->_stalls;
+
+      std::string route;
+      {
+        std::unique_lock<std::mutex> route_lock(heartbeat->_route_mutex);
+        if(heartbeat->_route)
+          route = heartbeat->_route;
+      }
+
+      std::cerr << "[soss::watchdog] The thread [" << heartbeat->_name
+                << "] has been busy with the same piece of work for ["
+                << std::chrono::duration<double>(
+                     std::chrono::nanoseconds(now - since)).count()
+                << "] seconds";
+      if(!route.empty())
+        std::cerr << " while delivering the route [" << route << "]";
+      std::cerr << std::endl;
+    }
+
+    Metrics::record_thread(
+          heartbeat->_name,
+          std::chrono::nanoseconds(
+            heartbeat->_cpu.load(std::memory_order_relaxed)),
+          std::chrono::nanoseconds(stalled? now - since : 0),
+          heartbeat->_stalls);
+  }
+}
+
+//==============================================================================
+void Watchdog::_add(Heartbeat* const heartbeat)
+{
+  std::unique_lock<std::mutex> lock(_mutex);
+  _heartbeats.push_back(heartbeat);
+}
+
+//==============================================================================
+void Watchdog::_remove(Heartbeat* const heartbeat)
+{
+  {
+    std::unique_lock<std::mutex> lock(_mutex);
+    for(auto it = _heartbeats.begin(); it != _heartbeats.end(); ++it)
+    {
+      if(*it == heartbeat)
+      {
+        _heartbeats.erase(it);
+        break;
+      }
+    }
+  }
+
+  Metrics::release_thread(heartbeat->_name);
+}
+
+} // namespace internal
+} // namespace soss
@@ -0,0 +1,159 @@
+/*
+ * Copyright (C) 2019 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#ifndef SOSS__INTERNAL__WATCHDOG_HPP
+#define SOSS__INTERNAL__WATCHDOG_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace soss {
+namespace internal {
+
+//==============================================================================
+/// Heartbeat follows one worker of soss, like the thread that spins a system,
+/// or the task that spins it on the executor. The worker marks when it starts
+/// and finishes each piece of work, so that the Watchdog can tell when it gets
+/// stuck, and so that the CPU time of its work can be accounted.
+///
+/// Threads that deliver messages without having a Heartbeat of their own, like
+/// the threads of self-driven middlewares and of topic queues, get one from
+/// RouteActivity the first time that they deliver a message.
+class Heartbeat
+{
+public:
+
+  /// The name is used in the metrics and warnings of the watchdog, and should
+  /// match the name of the thread when the worker has a thread of its own.
+  explicit Heartbeat(std::string name);
+
+  /// \brief Mark that the worker has started a piece of work on this thread.
+  void busy();
+
+  /// \brief Mark that the worker has finished its piece of work. The CPU time
+  /// that this thread spent since busy() gets accounted to the worker.
+  void idle();
+
+  const std::string& name() const { return _name; }
+
+  Heartbeat(const Heartbeat&) = delete;
+  Heartbeat& operator=(const Heartbeat&) = delete;
+
+  ~Heartbeat();
+
+private:
+
+  friend class Watchdog;
+  friend class RouteActivity;
+
+  const std::string _name;
+
+  // When the current piece of work started, in nanoseconds of the steady
+  // clock, or zero while the worker is idle
+  std::atomic<int64_t> _busy_since;
+
+  // The CPU time of the thread when the current piece of work started. Only
+  // the worker touches this.
+  int64_t _cpu_at_busy;
+
+  // CPU time, in nanoseconds, that the finished pieces of work have taken
+  std::atomic<uint64_t> _cpu;
+
+  // The route that the worker is delivering, if any. It is only valid while
+  // the RouteActivity that set it stays open, so it must be read under the
+  // mutex.
+  std::mutex _route_mutex;
+  const char* _route;
+
+  // Only touched by the Watchdog
+  int64_t _reported_since;
+  uint64_t _stalls;
+};
+
+//==============================================================================
+/// RouteActivity marks the route that the current thread is delivering while
+/// it stays open, so that the Watchdog can name the route of a worker that is
+/// stuck. It does nothing unless the Watchdog tracks routes.
+class RouteActivity
+{
+public:
+
+  /// The route must outlive the RouteActivity
+  explicit RouteActivity(const char* route);
+
+  RouteActivity(const RouteActivity&) = delete;
+  RouteActivity& operator=(const RouteActivity&) = delete;
+
+  ~RouteActivity();
+
+private:
+
+  Heartbeat* _heartbeat;
+  const char* _previous;
+  bool _owns_work;
+};
+
+//==============================================================================
+/// Watchdog is the process-wide registry of Heartbeats. Each instance of soss
+/// that enables the watchdog checks on the heartbeats periodically from a
+/// thread of its own, so that it keeps working even when every other thread
+/// is stuck.
+class Watchdog
+{
+public:
+
+  static Watchdog& get();
+
+  /// \brief Set how long a worker may stay busy with one piece of work before
+  /// it counts as stalled, and whether the routes that workers are delivering
+  /// get tracked. This enables the watchdog for the whole process.
+  void configure(std::chrono::nanoseconds threshold, bool track_routes);
+
+  /// \brief Whether RouteActivity should mark the routes of each thread
+  static bool tracking_routes()
+  {
+    return get()._track_routes.load(std::memory_order_relaxed);
+  }
+
+  /// \brief Report the workers that have become stalled or have recovered
+  /// since the last check, and update the metrics of every worker.
+  void check();
+
+private:
+
+  friend class Heartbeat;
+
+  Watchdog();
+
+  void _add(Heartbeat* heartbeat);
+  void _remove(Heartbeat* heartbeat);
+
+  std::atomic<int64_t> _threshold;
+  std::atomic_bool _track_routes;
+
+  std::mutex _mutex;
+  std::vector<Heartbeat*> _heartbeats;
+};
+
+} // namespace internal
+} // namespace soss
+
+#endif // SOSS__INTERNAL__WATCHDOG_HPP
@@ -42,15 +42,22 @@ void Register::insert(
 //==============================================================================
 SystemHandleInfo Register::get(const std::string& middleware)
 {
+  // Other middleware libraries may be registering themselves while we look,
+  // so the factory is copied out before the lock is released.
+  std::unique_lock<std::mutex> lock(_mutex);
   const FactoryMap::const_iterator it = _info_map.find(middleware);
   if(it == _info_map.end())
   {
+    lock.unlock();
     std::cerr << "Could not find system handle for middleware of type ["
               << middleware << "]" << std::endl;
     return SystemHandleInfo(nullptr);
   }
 
-  return SystemHandleInfo(_info_map.at(middleware)());
+  const detail::SystemHandleFactory factory = it->second;
+  lock.unlock();
+
+  return SystemHandleInfo(factory());
 }
 
 } // namespace internal
@@ -0,0 +1,189 @@
+/*
+ * Copyright (C) 2019 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+
+#include "payloads.hpp"
+
+#include <benchmark/benchmark.h>
+
+namespace {
+
+const std::size_t PathSize = 10000;
+const std::size_t BytesSize = 1024*1024;
+
+//==============================================================================
+void primitives_to_soss(benchmark::State& state)
+{
+  using Convert = soss::Convert<soss_benchmark::Primitives>;
+  const soss_benchmark::Primitives native;
+  for(auto _ : state)
+  {
+    soss::Message message = Convert::make_soss();
+    Convert::to_soss(native, message);
+    benchmark::DoNotOptimize(message);
+  }
+}
+BENCHMARK(primitives_to_soss);
+
+//==============================================================================
+void primitives_from_soss(benchmark::State& state)
+{
+  using Convert = soss::Convert<soss_benchmark::Primitives>;
+  soss::Message message = Convert::make_soss();
+  Convert::to_soss(soss_benchmark::Primitives(), message);
+  for(auto _ : state)
+  {
+    soss_benchmark::Primitives native;
+    Convert::from_soss(message, native);
+    benchmark::DoNotOptimize(native);
+  }
+}
+BENCHMARK(primitives_from_soss);
+
+//==============================================================================
+void path_to_soss(benchmark::State& state)
+{
+  using Convert = soss::Convert<soss_benchmark::Path>;
+  const soss_benchmark::Path native = soss_benchmark::make_path(PathSize);
+  for(auto _ : state)
+  {
+    soss::Message message = Convert::make_soss();
+    Convert::to_soss(native, message);
+    benchmark::DoNotOptimize(message);
+  }
+
+  state.SetItemsProcessed(
+        static_cast<int64_t>(state.iterations()*PathSize));
+}
+BENCHMARK(path_to_soss)->Unit(benchmark::kMillisecond);
+
+//==============================================================================
+void path_from_soss(benchmark::State& state)
+{
+  using Convert = soss::Convert<soss_benchmark::Path>;
+  soss::Message message = Convert::make_soss();
+  Convert::to_soss(soss_benchmark::make_path(PathSize), message);
+  for(auto _ : state)
+  {
+    soss_benchmark::Path native;
+    Convert::from_soss(message, native);
+    benchmark::DoNotOptimize(native);
+  }
+
+  state.SetItemsProcessed(
+        static_cast<int64_t>(state.iterations()*PathSize));
+}
+BENCHMARK(path_from_soss)->Unit(benchmark::kMillisecond);
+
+//==============================================================================
+void path_move_from_soss(benchmark::State& state)
+{
+  using Convert = soss::Convert<soss_benchmark::Path>;
+  soss::Message original = Convert::make_soss();
+  Convert::to_soss(soss_benchmark::make_path(PathSize), original);
+  for(auto _ : state)
+  {
+    state.PauseTiming();
+    soss::Message message = original;
+    state.ResumeTiming();
+
+    soss_benchmark::Path native;
+    Convert::move_from_soss(std::move(message), native);
+    benchmark::DoNotOptimize(native);
+  }
+
+  state.SetItemsProcessed(
+        static_cast<int64_t>(state.iterations()*PathSize));
+}
+BENCHMARK(path_move_from_soss)->Unit(benchmark::kMillisecond);
+
+//==============================================================================
+/// Converting into a container that already holds the right number of
+/// elements reuses them instead of creating new ones
+void bounded_vector_into_existing(benchmark::State& state)
+{
+  using Element = soss_benchmark::PoseStamped;
+  std::vector<soss::Message> from;
+  soss::Convert<std::vector<Element>>::to_soss(
+        soss_benchmark::make_path(PathSize).poses, from);
+
+  std::vector<Element> to(PathSize);
+  for(auto _ : state)
+  {
+    soss::convert_bounded_vector<Element, PathSize>::convert(
+          from, to, &soss::Convert<Element>::from_soss);
+    benchmark::DoNotOptimize(to);
+  }
+
+  state.SetItemsProcessed(
+        static_cast<int64_t>(state.iterations()*PathSize));
+}
+BENCHMARK(bounded_vector_into_existing)->Unit(benchmark::kMillisecond);
+
+//==============================================================================
+void bytes_to_soss(benchmark::State& state)
+{
+  using Convert = soss::Convert<std::vector<uint8_t>>;
+  const std::vector<uint8_t> native(BytesSize, 0x5A);
+  for(auto _ : state)
+  {
+    Convert::soss_type field_data;
+    Convert::to_soss(native, field_data);
+    benchmark::DoNotOptimize(field_data);
+  }
+
+  state.SetBytesProcessed(
+        static_cast<int64_t>(state.iterations()*BytesSize));
+}
+BENCHMARK(bytes_to_soss);
+
+//==============================================================================
+void bytes_from_soss(benchmark::State& state)
+{
+  using Convert = soss::Convert<std::vector<uint8_t>>;
+  Convert::soss_type field_data;
+  Convert::to_soss(std::vector<uint8_t>(BytesSize, 0x5A), field_data);
+  for(auto _ : state)
+  {
+    std::vector<uint8_t> native;
+    Convert::from_soss(field_data, native);
+    benchmark::DoNotOptimize(native);
+  }
+
+  state.SetBytesProcessed(
+        static_cast<int64_t>(state.iterations()*BytesSize));
+}
+BENCHMARK(bytes_from_soss);
+
+//==============================================================================
+void bytes_to_blob(benchmark::State& state)
+{
+  using Convert = soss::BlobConvert<std::vector<uint8_t>>;
+  const std::vector<uint8_t> native(BytesSize, 0x5A);
+  for(auto _ : state)
+  {
+    soss::Blob blob;
+    Convert::to_soss(native, blob);
+    benchmark::DoNotOptimize(blob);
+  }
+
+  state.SetBytesProcessed(
+        static_cast<int64_t>(state.iterations()*BytesSize));
+}
+BENCHMARK(bytes_to_blob);
+
+} // anonymous namespace
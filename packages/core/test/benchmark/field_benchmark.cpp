@@ -0,0 +1,146 @@
+/*
+ * Copyright (C) 2019 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+
+#include "payloads.hpp"
+
+#include <benchmark/benchmark.h>
+
+namespace {
+
+//==============================================================================
+soss::Message make_path_message(const std::size_t size)
+{
+  using Convert = soss::Convert<soss_benchmark::Path>;
+  soss::Message message = Convert::make_soss();
+  Convert::to_soss(soss_benchmark::make_path(size), message);
+  return message;
+}
+
+//==============================================================================
+void copy_primitives_field(benchmark::State& state)
+{
+  using Convert = soss::Convert<soss_benchmark::Primitives>;
+  soss::Message message = Convert::make_soss();
+  Convert::to_soss(soss_benchmark::Primitives(), message);
+  const soss::Field field = soss::make_field<soss::Message>(message);
+
+  for(auto _ : state)
+  {
+    soss::Field copy = field;
+    benchmark::DoNotOptimize(copy);
+  }
+}
+BENCHMARK(copy_primitives_field);
+
+//==============================================================================
+void copy_path_field(benchmark::State& state)
+{
+  const soss::Field field =
+      soss::make_field<soss::Message>(make_path_message(10000));
+
+  for(auto _ : state)
+  {
+    soss::Field copy = field;
+    benchmark::DoNotOptimize(copy);
+  }
+}
+BENCHMARK(copy_path_field)->Unit(benchmark::kMillisecond);
+
+//==============================================================================
+void copy_bytes_field(benchmark::State& state)
+{
+  const std::size_t size = static_cast<std::size_t>(state.range(0));
+  const soss::Field field = soss::Convert<std::vector<uint8_t>>
+      ::make_soss_field(std::vector<uint8_t>(size, 0x5A));
+
+  for(auto _ : state)
+  {
+    soss::Field copy = field;
+    benchmark::DoNotOptimize(copy);
+  }
+
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()*size));
+}
+BENCHMARK(copy_bytes_field)->Arg(1024)->Arg(1024*1024);
+
+//==============================================================================
+void copy_blob_field(benchmark::State& state)
+{
+  const std::vector<uint8_t> bytes(1024*1024, 0x5A);
+  const soss::Field field = soss::BlobConvert<std::vector<uint8_t>>
+      ::make_soss_field(bytes.data(), bytes.size());
+
+  for(auto _ : state)
+  {
+    soss::Field copy = field;
+    benchmark::DoNotOptimize(copy);
+  }
+}
+BENCHMARK(copy_blob_field);
+
+//==============================================================================
+void set_double_field(benchmark::State& state)
+{
+  soss::Field field;
+  double value = 0.0;
+  for(auto _ : state)
+  {
+    field.set(value);
+    value += 1.0;
+    benchmark::DoNotOptimize(field);
+  }
+}
+BENCHMARK(set_double_field);
+
+//==============================================================================
+void set_string_field(benchmark::State& state)
+{
+  const std::string value(static_cast<std::size_t>(state.range(0)), 'x');
+  soss::Field field;
+  for(auto _ : state)
+  {
+    field.set(std::string(value));
+    benchmark::DoNotOptimize(field);
+  }
+}
+BENCHMARK(set_string_field)->Arg(8)->Arg(64);
+
+//==============================================================================
+void cast_field(benchmark::State& state)
+{
+  soss::Field field = soss::Convert<double>::make_soss_field(1.0);
+  for(auto _ : state)
+  {
+    benchmark::DoNotOptimize(field.cast<double>());
+    benchmark::DoNotOptimize(field.cast<int64_t>());
+  }
+}
+BENCHMARK(cast_field);
+
+//==============================================================================
+void find_field(benchmark::State& state)
+{
+  using Convert = soss::Convert<soss_benchmark::Primitives>;
+  soss::Message message = Convert::make_soss();
+  Convert::to_soss(soss_benchmark::Primitives(), message);
+  for(auto _ : state)
+    benchmark::DoNotOptimize(message.data.find("string_value"));
+}
+BENCHMARK(find_field);
+
+} // anonymous namespace
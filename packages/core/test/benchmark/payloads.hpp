@@ -0,0 +1,238 @@
+/*
+ * Copyright (C) 2019 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+
+#ifndef SOSS__TEST__BENCHMARK__PAYLOADS_HPP
+#define SOSS__TEST__BENCHMARK__PAYLOADS_HPP
+
+#include <soss/utilities.hpp>
+
+#include <string>
+#include <vector>
+
+// These native types and their conversions follow the code that soss-rosidl
+// generates for ROS2 messages, so the benchmarks exercise the same templates
+// as a real middleware.
+namespace soss_benchmark {
+
+//==============================================================================
+struct Primitives
+{
+  bool bool_value = true;
+  uint8_t byte_value = 1;
+  uint8_t char_value = 'a';
+  float float32_value = 1.5f;
+  double float64_value = 2.25;
+  int8_t int8_value = -8;
+  uint8_t uint8_value = 8;
+  int16_t int16_value = -16;
+  uint16_t uint16_value = 16;
+  int32_t int32_value = -32;
+  uint32_t uint32_value = 32;
+  int64_t int64_value = -64;
+  uint64_t uint64_value = 64;
+  std::string string_value = "a string that does not fit in place";
+};
+
+struct Time
+{
+  int32_t sec = 0;
+  uint32_t nanosec = 0;
+};
+
+struct Header
+{
+  Time stamp;
+  std::string frame_id;
+};
+
+struct Point
+{
+  double x = 0.0;
+  double y = 0.0;
+  double z = 0.0;
+};
+
+struct Quaternion
+{
+  double x = 0.0;
+  double y = 0.0;
+  double z = 0.0;
+  double w = 1.0;
+};
+
+struct Pose
+{
+  Point position;
+  Quaternion orientation;
+};
+
+struct PoseStamped
+{
+  Header header;
+  Pose pose;
+};
+
+struct Path
+{
+  Header header;
+  std::vector<PoseStamped> poses;
+};
+
+//==============================================================================
+inline Path make_path(const std::size_t size)
+{
+  Path path;
+  path.header.frame_id = "map";
+  path.poses.resize(size);
+  for(std::size_t i=0; i < size; ++i)
+  {
+    PoseStamped& pose = path.poses[i];
+    pose.header.stamp.sec = static_cast<int32_t>(i);
+    pose.header.frame_id = "map";
+    pose.pose.position.x = static_cast<double>(i);
+    pose.pose.position.y = static_cast<double>(i)*0.5;
+  }
+
+  return path;
+}
+
+} // namespace soss_benchmark
+
+//==============================================================================
+/// Declares the conversions of a native message type in the same way as the
+/// generated code. The fields have to be listed in alphabetical order.
+#define SOSS_BENCHMARK_MESSAGE(Type, Name, FIELDS) \
+  namespace soss_benchmark { \
+  namespace convert__##Type { \
+  inline soss::Message initialize() \
+  { \
+    soss::Message msg; \
+    msg.type = Name; \
+    FIELDS(SOSS_BENCHMARK_ADD_FIELD) \
+    return msg; \
+  } \
+  inline void convert_to_native(const soss::Message& from, Type& to) \
+  { \
+    auto from_field = from.data.begin(); \
+    FIELDS(SOSS_BENCHMARK_FROM_FIELD) \
+    (void)to; (void)from_field; \
+  } \
+  inline void move_to_native(soss::Message&& from, Type& to) \
+  { \
+    auto from_field = from.data.begin(); \
+    FIELDS(SOSS_BENCHMARK_MOVE_FIELD) \
+    (void)to; (void)from_field; \
+  } \
+  inline void convert_to_soss(const Type& from, soss::Message& to) \
+  { \
+    auto to_field = to.data.begin(); \
+    FIELDS(SOSS_BENCHMARK_TO_FIELD) \
+    (void)from; (void)to_field; \
+  } \
+  } \
+  } \
+  namespace soss { \
+  template<> \
+  struct Convert<soss_benchmark::Type> \
+    : MessageConvert< \
+      soss_benchmark::Type, \
+      &soss_benchmark::convert__##Type::initialize, \
+      &soss_benchmark::convert__##Type::convert_to_native, \
+      &soss_benchmark::convert__##Type::convert_to_soss, \
+      &soss_benchmark::convert__##Type::move_to_native> { }; \
+  }
+
+#define SOSS_BENCHMARK_ADD_FIELD(Type, field) \
+  soss::Convert<decltype(Type::field)>::add_field(msg, #field);
+
+#define SOSS_BENCHMARK_FROM_FIELD(Type, field) \
+  soss::Convert<decltype(Type::field)>::from_soss_field(from_field++, to.field);
+
+#define SOSS_BENCHMARK_MOVE_FIELD(Type, field) \
+  soss::move_from_soss_field<soss::Convert<decltype(Type::field)>>( \
+    from_field++, to.field);
+
+#define SOSS_BENCHMARK_TO_FIELD(Type, field) \
+  soss::Convert<decltype(Type::field)>::to_soss_field(from.field, to_field++);
+
+#define SOSS_BENCHMARK_PRIMITIVES_FIELDS(F) \
+  F(Primitives, bool_value) \
+  F(Primitives, byte_value) \
+  F(Primitives, char_value) \
+  F(Primitives, float32_value) \
+  F(Primitives, float64_value) \
+  F(Primitives, int16_value) \
+  F(Primitives, int32_value) \
+  F(Primitives, int64_value) \
+  F(Primitives, int8_value) \
+  F(Primitives, string_value) \
+  F(Primitives, uint16_value) \
+  F(Primitives, uint32_value) \
+  F(Primitives, uint64_value) \
+  F(Primitives, uint8_value)
+
+#define SOSS_BENCHMARK_TIME_FIELDS(F) \
+  F(Time, nanosec) \
+  F(Time, sec)
+
+#define SOSS_BENCHMARK_HEADER_FIELDS(F) \
+  F(Header, frame_id) \
+  F(Header, stamp)
+
+#define SOSS_BENCHMARK_POINT_FIELDS(F) \
+  F(Point, x) \
+  F(Point, y) \
+  F(Point, z)
+
+#define SOSS_BENCHMARK_QUATERNION_FIELDS(F) \
+  F(Quaternion, w) \
+  F(Quaternion, x) \
+  F(Quaternion, y) \
+  F(Quaternion, z)
+
+#define SOSS_BENCHMARK_POSE_FIELDS(F) \
+  F(Pose, orientation) \
+  F(Pose, position)
+
+#define SOSS_BENCHMARK_POSE_STAMPED_FIELDS(F) \
+  F(PoseStamped, header) \
+  F(PoseStamped, pose)
+
+#define SOSS_BENCHMARK_PATH_FIELDS(F) \
+  F(Path, header) \
+  F(Path, poses)
+
+SOSS_BENCHMARK_MESSAGE(
+    Primitives, "test_msgs/Primitives", SOSS_BENCHMARK_PRIMITIVES_FIELDS)
+SOSS_BENCHMARK_MESSAGE(
+    Time, "builtin_interfaces/Time", SOSS_BENCHMARK_TIME_FIELDS)
+SOSS_BENCHMARK_MESSAGE(
+    Header, "std_msgs/Header", SOSS_BENCHMARK_HEADER_FIELDS)
+SOSS_BENCHMARK_MESSAGE(
+    Point, "geometry_msgs/Point", SOSS_BENCHMARK_POINT_FIELDS)
+SOSS_BENCHMARK_MESSAGE(
+    Quaternion, "geometry_msgs/Quaternion", SOSS_BENCHMARK_QUATERNION_FIELDS)
+SOSS_BENCHMARK_MESSAGE(
+    Pose, "geometry_msgs/Pose", SOSS_BENCHMARK_POSE_FIELDS)
+SOSS_BENCHMARK_MESSAGE(
+    PoseStamped, "geometry_msgs/PoseStamped",
+    SOSS_BENCHMARK_POSE_STAMPED_FIELDS)
+SOSS_BENCHMARK_MESSAGE(
+    Path, "nav_msgs/Path", SOSS_BENCHMARK_PATH_FIELDS)
+
+#endif // SOSS__TEST__BENCHMARK__PAYLOADS_HPP
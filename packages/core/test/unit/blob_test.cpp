@@ -0,0 +1,86 @@
+/*
+ * Copyright (C) 2019 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include <soss/utilities.hpp>
+
+#include <catch2/catch.hpp>
+
+TEST_CASE("Copies of a blob share their bytes", "[blob][core]")
+{
+  std::vector<uint8_t> bytes = {1, 2, 3, 4};
+  const uint8_t* const original = bytes.data();
+
+  soss::Message message;
+  message.data["data"] = soss::make_field<soss::Blob>(std::move(bytes));
+  CHECK(message.data.at("data").type_tag() == soss::FieldTypeTag::Blob);
+
+  // Neither the moved vector nor any copies of the message duplicate the bytes
+  const soss::Message copy = message;
+  const soss::Blob& blob = *copy.data.at("data").cast<soss::Blob>();
+  CHECK(blob.data() == original);
+  CHECK(blob.size() == 4);
+  CHECK(blob.to_vector() == (std::vector<uint8_t>{1, 2, 3, 4}));
+
+  // The bytes outlive the message that they were created for
+  soss::Blob kept = blob;
+  message.data.clear();
+  CHECK(kept.data() == original);
+  CHECK(kept == soss::Blob(std::vector<uint8_t>{1, 2, 3, 4}));
+  CHECK(kept != soss::Blob());
+
+  // A blob can also point into a buffer that belongs to another object
+  auto owner = std::make_shared<std::array<uint8_t, 3>>();
+  (*owner)[1] = 7;
+  std::weak_ptr<std::array<uint8_t, 3>> weak_owner = owner;
+  {
+    const soss::Blob borrowed(owner, owner->data(), owner->size());
+    owner.reset();
+
+    // The blob is now the only thing that keeps the owner alive
+    CHECK(!weak_owner.expired());
+    CHECK(borrowed[1] == 7);
+  }
+  CHECK(weak_owner.expired());
+}
+
+TEST_CASE("Blobs can be converted to native bytes", "[blob][core]")
+{
+  using ImageData = std::vector<uint8_t>;
+  using BlobConvert = soss::BlobConvert<ImageData>;
+
+  soss::Message message;
+  BlobConvert::add_field(message, "data");
+  CHECK(message.data.at("data").cast<soss::Blob>()->empty());
+
+  const ImageData image = {10, 20, 30};
+  BlobConvert::to_soss_field(image, message.data.begin());
+
+  ImageData output;
+  BlobConvert::from_soss_field(message.data.begin(), output);
+  CHECK(output == image);
+
+  // The default converter for bytes is able to read a blob as well
+  ImageData packed;
+  soss::Convert<ImageData>::from_soss_field(message.data.begin(), packed);
+  CHECK(packed == image);
+
+  // And a blob converter still accepts plain arrays of numbers
+  message.data["data"] = soss::make_field<std::vector<uint64_t>>(
+        std::vector<uint64_t>{5, 6});
+  BlobConvert::from_soss_field(message.data.begin(), output);
+  CHECK(output == (ImageData{5, 6}));
+}
@@ -0,0 +1,267 @@
+/*
+ * Copyright (C) 2019 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include <soss/utilities.hpp>
+
+#include <catch2/catch.hpp>
+
+TEST_CASE("Arrays of numbers keep their native width", "[convert][core]")
+{
+  using ByteConvert = soss::Convert<std::vector<uint8_t>>;
+  static_assert(
+        std::is_same<ByteConvert::soss_type, std::vector<uint8_t>>::value,
+        "Bytes should not be widened");
+
+  soss::Message message;
+  ByteConvert::add_field(message, "data");
+  CHECK(message.data.at("data").type_tag() == soss::FieldTypeTag::UInt8Vector);
+
+  const std::vector<uint8_t> image = {0, 1, 2, 254, 255};
+  ByteConvert::to_soss_field(image, message.data.begin());
+  CHECK(*message.data.at("data").cast<std::vector<uint8_t>>() == image);
+
+  std::vector<uint8_t> output;
+  ByteConvert::from_soss_field(message.data.begin(), output);
+  CHECK(output == image);
+
+  // Booleans are still widened
+  CHECK(std::is_same<soss::Convert<std::vector<bool>>::soss_type,
+                     std::vector<uint64_t>>::value);
+}
+
+TEST_CASE("Widened arrays get narrowed", "[convert][core]")
+{
+  // Other middlewares, like websocket, can only produce 64-bit arrays
+  soss::Message message;
+  message.data["data"] = soss::make_field<std::vector<uint64_t>>(
+        std::vector<uint64_t>{3, 4, 5});
+  message.data["floats"] = soss::make_field<std::vector<double>>(
+        std::vector<double>{0.5, 1.5});
+
+  std::vector<uint16_t> data;
+  soss::Convert<std::vector<uint16_t>>::from_soss_field(
+        message.data.find("data"), data);
+  CHECK(data == std::vector<uint16_t>{3, 4, 5});
+
+  // Fixed-size arrays only take as many elements as they can hold
+  std::array<uint8_t, 2> bounded;
+  soss::Convert<std::array<uint8_t, 2>>::from_soss_field(
+        message.data.find("data"), bounded);
+  CHECK(bounded == (std::array<uint8_t, 2>{3, 4}));
+
+  std::array<float, 2> floats;
+  soss::Convert<std::array<float, 2>>::from_soss_field(
+        message.data.find("floats"), floats);
+  CHECK(floats == (std::array<float, 2>{0.5f, 1.5f}));
+
+  message.data["text"] = soss::make_field<std::string>("not numbers");
+  CHECK_THROWS_AS(
+        soss::Convert<std::vector<uint16_t>>::from_soss_field(
+          message.data.find("text"), data),
+        std::runtime_error);
+}
+
+TEST_CASE("Bounded vectors of numbers are copied in bulk", "[convert][core]")
+{
+  static_assert(
+        soss::is_packed_copy<std::vector<float>, std::vector<double>>::value,
+        "Vectors of numbers should be copied in bulk");
+  static_assert(
+        !soss::is_packed_copy<std::vector<bool>, std::vector<uint64_t>>::value,
+        "Vectors of bools cannot be copied in bulk");
+  static_assert(
+        !soss::is_packed_copy<
+          std::vector<soss::Message>, std::vector<soss::Message>>::value,
+        "Vectors of messages must be converted element by element");
+
+  const std::vector<float> ranges = {0.25f, 1.5f, 10.0f};
+
+  std::vector<double> widened = {7.0, 8.0, 9.0, 10.0};
+  soss::convert_bounded_vector<float, 2>::convert(
+        ranges, widened, &soss::Convert<float>::to_soss);
+  CHECK(widened == (std::vector<double>{0.25, 1.5}));
+
+  std::vector<float> copied;
+  soss::convert_bounded_vector<float, 8>::convert(
+        ranges, copied, &soss::Convert<float>::from_soss);
+  CHECK(copied == ranges);
+
+  std::array<int32_t, 2> narrowed;
+  soss::convert_bounded_vector<int32_t, 2>::convert(
+        std::vector<int64_t>{-3, 4, 5}, narrowed,
+        &soss::Convert<int32_t>::from_soss);
+  CHECK(narrowed == (std::array<int32_t, 2>{-3, 4}));
+}
+
+namespace {
+
+//==============================================================================
+struct NativeLabel
+{
+  std::string text;
+  std::vector<float> values;
+};
+
+//==============================================================================
+soss::Message initialize_label()
+{
+  soss::Message message;
+  message.type = "test/Label";
+  soss::Convert<std::string>::add_field(message, "text");
+  soss::Convert<std::vector<float>>::add_field(message, "values");
+  return message;
+}
+
+//==============================================================================
+void label_to_native(const soss::Message& from, NativeLabel& to)
+{
+  auto field = from.data.begin();
+  soss::Convert<std::string>::from_soss_field(field++, to.text);
+  soss::Convert<std::vector<float>>::from_soss_field(field++, to.values);
+}
+
+//==============================================================================
+void move_label_to_native(soss::Message&& from, NativeLabel& to)
+{
+  auto field = from.data.begin();
+  soss::move_from_soss_field<soss::Convert<std::string>>(field++, to.text);
+  soss::move_from_soss_field<soss::Convert<std::vector<float>>>(
+        field++, to.values);
+}
+
+//==============================================================================
+void label_to_soss(const NativeLabel& from, soss::Message& to)
+{
+  auto field = to.data.begin();
+  soss::Convert<std::string>::to_soss_field(from.text, field++);
+  soss::Convert<std::vector<float>>::to_soss_field(from.values, field++);
+}
+
+} // anonymous namespace
+
+namespace soss {
+
+template<>
+struct Convert<NativeLabel>
+    : MessageConvert<
+      NativeLabel,
+      &initialize_label,
+      &label_to_native,
+      &label_to_soss,
+      &move_label_to_native> { };
+
+} // namespace soss
+
+TEST_CASE("Messages that are no longer needed get moved", "[convert][core]")
+{
+  const NativeLabel original{
+    "a label that is too long to fit into a small string buffer",
+    {1.0f, 2.0f, 3.0f}};
+
+  std::vector<NativeLabel> labels;
+  labels.push_back(original);
+  labels.push_back(original);
+
+  soss::Message message;
+  message.type = "test/Labels";
+  soss::Convert<std::vector<NativeLabel>>::add_field(message, "labels");
+  soss::Convert<std::vector<NativeLabel>>::to_soss_field(
+        labels, message.data.begin());
+
+  const soss::Message& first =
+      message.data.at("labels").cast<std::vector<soss::Message>>()->front();
+  const char* const text = first.data.at("text").cast<std::string>()->data();
+  const float* const values =
+      first.data.at("values").cast<std::vector<float>>()->data();
+
+  std::vector<NativeLabel> output;
+  soss::move_from_soss_field<soss::Convert<std::vector<NativeLabel>>>(
+        message.data.begin(), output);
+
+  REQUIRE(output.size() == 2);
+  CHECK(output[0].text == original.text);
+  CHECK(output[1].values == original.values);
+
+  // The buffers were handed over instead of copied
+  CHECK(output[0].text.data() == text);
+  CHECK(output[0].values.data() == values);
+
+  // Widened fields still get converted, and converters without a move fall
+  // back to copying
+  message.data["values"] = soss::make_field<std::vector<double>>(
+        std::vector<double>{0.5});
+  std::vector<float> narrowed;
+  soss::move_from_soss_field<soss::Convert<std::vector<float>>>(
+        message.data.find("values"), narrowed);
+  CHECK(narrowed == std::vector<float>{0.5f});
+
+  message.data["count"] = soss::Convert<uint32_t>::make_soss_field(7);
+  uint32_t count = 0;
+  soss::move_from_soss_field<soss::Convert<uint32_t>>(
+        message.data.find("count"), count);
+  CHECK(count == 7);
+}
+
+TEST_CASE("Sequences of messages are converted in place", "[convert][core]")
+{
+  using LabelsConvert = soss::Convert<std::vector<NativeLabel>>;
+
+  const NativeLabel label{"a label", {1.0f, 2.0f}};
+  const std::vector<NativeLabel> three(3, label);
+  const std::vector<NativeLabel> one(1, label);
+
+  soss::Message message;
+  LabelsConvert::add_field(message, "labels");
+  LabelsConvert::to_soss_field(three, message.data.begin());
+
+  const auto& elements =
+      *message.data.at("labels").cast<std::vector<soss::Message>>();
+  REQUIRE(elements.size() == 3);
+
+  std::vector<const void*> fields;
+  for(const soss::Message& element : elements)
+    fields.push_back(&*element.data.begin());
+
+  // Converting the same shape again keeps every nested message
+  LabelsConvert::to_soss_field(three, message.data.begin());
+  REQUIRE(elements.size() == 3);
+  for(std::size_t i=0; i < 3; ++i)
+    CHECK(&*elements[i].data.begin() == fields[i]);
+
+  // Cutting the tail and growing it again gives back the same nested messages
+  LabelsConvert::to_soss_field(one, message.data.begin());
+  CHECK(elements.size() == 1);
+  CHECK(&*elements[0].data.begin() == fields[0]);
+
+  LabelsConvert::to_soss_field(three, message.data.begin());
+  REQUIRE(elements.size() == 3);
+  for(std::size_t i=0; i < 3; ++i)
+  {
+    CHECK(&*elements[i].data.begin() == fields[i]);
+    CHECK(*elements[i].data.at("text").cast<std::string>() == label.text);
+  }
+
+  // Native sequences are converted in place too
+  std::vector<NativeLabel> output;
+  LabelsConvert::from_soss_field(message.data.begin(), output);
+  REQUIRE(output.size() == 3);
+  const float* const values = output[2].values.data();
+
+  LabelsConvert::from_soss_field(message.data.begin(), output);
+  CHECK(output[2].values.data() == values);
+  CHECK(output[2].values == label.values);
+}
@@ -0,0 +1,128 @@
+/*
+ * Copyright (C) 2019 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include <soss/Executor.hpp>
+
+#include <catch2/catch.hpp>
+
+#include <atomic>
+#include <future>
+#include <mutex>
+#include <vector>
+
+using namespace std::chrono_literals;
+
+TEST_CASE("Executors run every task that gets posted", "[executor]")
+{
+  soss::Executor executor(3);
+  CHECK(executor.size() == 3);
+  CHECK_FALSE(executor.on_worker());
+
+  constexpr int outer = 50;
+  constexpr int inner = 20;
+  std::atomic_int count(0);
+  std::atomic_bool on_worker(true);
+  std::promise<void> done;
+
+  // Tasks that get posted from a worker stay on that worker unless they get
+  // stolen, so this exercises both paths.
+  for(int i=0; i < outer; ++i)
+  {
+    executor.post([&]()
+    {
+      for(int j=0; j < inner; ++j)
+      {
+        executor.post([&]()
+        {
+          on_worker = on_worker && executor.on_worker();
+          if(++count == outer*inner)
+            done.set_value();
+        });
+      }
+    });
+  }
+
+  REQUIRE(done.get_future().wait_for(5s) == std::future_status::ready);
+  CHECK(count == outer*inner);
+  CHECK(on_worker);
+}
+
+TEST_CASE("Idle workers steal from busy ones", "[executor]")
+{
+  soss::Executor executor(2);
+
+  std::promise<void> release;
+  std::shared_future<void> released = release.get_future().share();
+  std::promise<void> stolen;
+
+  // The first task holds on to its worker and posts a task behind itself,
+  // which can only run if the other worker steals it.
+  executor.post([&]()
+  {
+    executor.post([&]() { stolen.set_value(); });
+    released.wait();
+  });
+
+  CHECK(stolen.get_future().wait_for(5s) == std::future_status::ready);
+  release.set_value();
+}
+
+TEST_CASE("Delayed tasks run once their delay has passed", "[executor]")
+{
+  soss::Executor executor(1);
+
+  std::mutex mutex;
+  std::vector<int> order;
+  std::promise<void> done;
+
+  const auto start = std::chrono::steady_clock::now();
+  executor.post_after(30ms, [&]()
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    order.push_back(2);
+    done.set_value();
+  });
+
+  executor.post([&]()
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    order.push_back(1);
+  });
+
+  REQUIRE(done.get_future().wait_for(5s) == std::future_status::ready);
+  CHECK(std::chrono::steady_clock::now() - start >= 30ms);
+
+  std::unique_lock<std::mutex> lock(mutex);
+  CHECK(order == (std::vector<int>{1, 2}));
+}
+
+TEST_CASE("The shared executor lives as long as someone uses it", "[executor]")
+{
+  CHECK_FALSE(soss::Executor::shared());
+
+  auto first = soss::Executor::shared(2);
+  auto second = soss::Executor::shared(0);
+  CHECK(first == second);
+  CHECK(soss::Executor::shared() == first);
+  CHECK(first->size() == 2);
+
+  first.reset();
+  CHECK(soss::Executor::shared());
+
+  second.reset();
+  CHECK_FALSE(soss::Executor::shared());
+}
@@ -0,0 +1,157 @@
+/*
+ * Copyright (C) 2019 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include "FieldProjection.hpp"
+
+#include <soss/utilities.hpp>
+
+#include <catch2/catch.hpp>
+
+namespace {
+
+//==============================================================================
+soss::Message make_pose()
+{
+  soss::Message position;
+  position.type = "test/Point";
+  position.data["x"] = soss::Convert<double>::make_soss_field(1.0);
+  position.data["y"] = soss::Convert<double>::make_soss_field(2.0);
+
+  soss::Message stamp;
+  stamp.type = "test/Time";
+  stamp.data["sec"] = soss::Convert<int64_t>::make_soss_field(10);
+
+  soss::Message header;
+  header.type = "test/Header";
+  header.data["frame_id"] = soss::Convert<std::string>::make_soss_field("map");
+  header.data["stamp"] = soss::make_field<soss::Message>(stamp);
+
+  soss::Message pose;
+  pose.type = "test/Pose";
+  pose.data["header"] = soss::make_field<soss::Message>(header);
+  pose.data["position"] = soss::make_field<soss::Message>(position);
+  pose.data["waypoints"] = soss::make_field<std::vector<soss::Message>>(
+        std::vector<soss::Message>{position, position});
+  pose.data["covariance"] = soss::Convert<std::vector<double>>
+      ::make_soss_field(std::vector<double>(36, 0.5));
+
+  return pose;
+}
+
+//==============================================================================
+void check_projection(const soss::Message& projected)
+{
+  CHECK(projected.type == "test/Pose");
+  REQUIRE(projected.data.size() == 3);
+
+  const soss::Message& header = *projected.data.at("header").cast<soss::Message>();
+  REQUIRE(header.data.size() == 1);
+  const soss::Message& stamp = *header.data.at("stamp").cast<soss::Message>();
+  CHECK(*stamp.data.at("sec").cast<int64_t>() == 10);
+
+  const soss::Message& position =
+      *projected.data.at("position").cast<soss::Message>();
+  CHECK(position.data.size() == 2);
+
+  const auto& waypoints =
+      *projected.data.at("waypoints").cast<std::vector<soss::Message>>();
+  REQUIRE(waypoints.size() == 2);
+  for(const soss::Message& waypoint : waypoints)
+  {
+    CHECK(waypoint.type == "test/Point");
+    REQUIRE(waypoint.data.size() == 1);
+    CHECK(*waypoint.data.at("x").cast<double>() == 1.0);
+  }
+
+  CHECK(projected.data.count("covariance") == 0);
+}
+
+//==============================================================================
+class RecordingPublisher : public soss::TopicPublisher
+{
+public:
+
+  bool publish(const soss::Message& message) override
+  {
+    published.push_back(message);
+    return true;
+  }
+
+  std::vector<soss::Message> published;
+};
+
+} // anonymous namespace
+
+TEST_CASE("Project nested fields out of a message", "[projection]")
+{
+  const soss::internal::FieldProjection projection(
+        {"header.stamp", "position.y", "position", "waypoints.x", "missing.z"});
+
+  const soss::Message pose = make_pose();
+  check_projection(projection.project(pose));
+
+  // The original message must be left alone
+  CHECK(pose.data.size() == 4);
+
+  soss::Message owned = make_pose();
+  check_projection(projection.project(std::move(owned)));
+}
+
+TEST_CASE("Projected publishers only see the requested fields", "[projection]")
+{
+  auto recorder = std::make_shared<RecordingPublisher>();
+  soss::internal::ProjectedPublisher publisher(
+        recorder, {"header.stamp", "position", "waypoints.x"});
+
+  const soss::Message pose = make_pose();
+  CHECK(publisher.publish(pose));
+  CHECK(publisher.publish_envelope(soss::MessageEnvelope(pose)));
+  CHECK(publisher.publish_batch(
+          {std::make_shared<const soss::Message>(make_pose())}));
+
+  REQUIRE(recorder->published.size() == 3);
+  for(const soss::Message& message : recorder->published)
+    check_projection(message);
+}
+
+TEST_CASE("Messages without fields are passed on whole", "[projection]")
+{
+  // e.g. the serialized messages of ros2 that skip the conversion
+  struct Serialized : soss::NativeMessage { };
+
+  soss::Message message;
+  message.type = "test/Pose";
+  message.native = std::make_shared<Serialized>();
+
+  const soss::internal::FieldProjection projection({"position"});
+  CHECK(projection.project(message).native == message.native);
+
+  soss::Message owned = message;
+  CHECK(projection.project(std::move(owned)).native == message.native);
+
+  auto recorder = std::make_shared<RecordingPublisher>();
+  soss::internal::ProjectedPublisher publisher(recorder, {"position"});
+  CHECK(publisher.publish(message));
+  CHECK(publisher.publish_envelope(soss::MessageEnvelope(message)));
+
+  REQUIRE(recorder->published.size() == 2);
+  for(const soss::Message& published : recorder->published)
+  {
+    CHECK(published.type == "test/Pose");
+    CHECK(published.native == message.native);
+  }
+}
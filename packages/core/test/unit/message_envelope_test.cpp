@@ -0,0 +1,54 @@
+/*
+ * Copyright (C) 2019 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include <soss/MessageEnvelope.hpp>
+#include <soss/utilities.hpp>
+
+#include <catch2/catch.hpp>
+
+TEST_CASE("Encode a shared message once per format", "[envelope][core]")
+{
+  soss::Message message;
+  message.type = "test/Number";
+  message.data["value"] = soss::Convert<double>::make_soss_field(2.5);
+
+  const soss::MessageEnvelope envelope(message);
+  CHECK(&envelope.message() == &message);
+
+  int encode_count = 0;
+  const std::function<std::shared_ptr<const std::string>(const soss::Message&)>
+  encoder = [&](const soss::Message& msg)
+  {
+    ++encode_count;
+    return std::make_shared<const std::string>(msg.type);
+  };
+
+  const auto first = envelope.encoding<std::string>("format_a", encoder);
+  const auto second = envelope.encoding<std::string>("format_a", encoder);
+  CHECK(encode_count == 1);
+  CHECK(first == second);
+  CHECK(*first == "test/Number");
+
+  envelope.encoding<std::string>("format_b", encoder);
+  CHECK(encode_count == 2);
+
+  const std::shared_ptr<const soss::Message> retained = envelope.retain();
+  CHECK(retained.get() != &message);
+  CHECK(retained == envelope.retain());
+  CHECK(retained->type == message.type);
+  CHECK(retained->data.size() == 1);
+}
@@ -0,0 +1,162 @@
+/*
+ * Copyright (C) 2019 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include <soss/Message.hpp>
+#include <soss/utilities.hpp>
+
+#include <catch2/catch.hpp>
+
+#include <thread>
+
+TEST_CASE("Fields stay sorted by name", "[message][core]")
+{
+  soss::Message message;
+  message.data["orange"] = soss::Convert<int64_t>::make_soss_field(3);
+  message.data["apple"] = soss::Convert<int64_t>::make_soss_field(1);
+  message.data["banana"] = soss::Convert<int64_t>::make_soss_field(2);
+
+  REQUIRE(message.data.size() == 3);
+
+  int64_t expected = 1;
+  for(const auto& field : message.data)
+  {
+    CHECK(*field.second.cast<int64_t>() == expected);
+    ++expected;
+  }
+
+  CHECK(message.data.find("banana") != message.data.end());
+  CHECK(message.data.find("cherry") == message.data.end());
+  CHECK(message.data.count("apple") == 1);
+
+  // Assigning to an existing field must not add a new one
+  message.data["apple"] = soss::Convert<int64_t>::make_soss_field(4);
+  CHECK(message.data.size() == 3);
+  CHECK(*message.data.at("apple").cast<int64_t>() == 4);
+
+  CHECK(message.data.erase("banana") == 1);
+  CHECK(message.data.size() == 2);
+  CHECK_THROWS_AS(message.data.at("banana"), std::out_of_range);
+}
+
+TEST_CASE("Copy and move fields of every storage kind", "[message][core]")
+{
+  soss::Message nested;
+  nested.type = "test/Nested";
+  nested.data["value"] = soss::Convert<double>::make_soss_field(1.5);
+
+  soss::Field scalar = soss::Convert<int64_t>::make_soss_field(42);
+  soss::Field text = soss::Convert<std::string>::make_soss_field("banana");
+  soss::Field message = soss::make_field<soss::Message>(nested);
+
+  const soss::Field scalar_copy = scalar;
+  const soss::Field text_copy = text;
+  const soss::Field message_copy = message;
+  CHECK(*scalar_copy.cast<int64_t>() == 42);
+  CHECK(*text_copy.cast<std::string>() == "banana");
+  CHECK(message_copy.cast<soss::Message>()->type == "test/Nested");
+  CHECK(message_copy.cast<soss::Message>() != message.cast<soss::Message>());
+  CHECK(scalar_copy.cast<double>() == nullptr);
+
+  CHECK(scalar_copy.type_tag() == soss::FieldTypeTag::Int64);
+  CHECK(text_copy.type_tag() == soss::FieldTypeTag::String);
+  CHECK(message_copy.type_tag() == soss::FieldTypeTag::Message);
+
+  soss::Field moved = std::move(message);
+  CHECK(message.cast<soss::Message>() == nullptr);
+  CHECK(message.type() == "empty");
+  CHECK(message.type_tag() == soss::FieldTypeTag::Other);
+  CHECK(moved.type_tag() == soss::FieldTypeTag::Message);
+  CHECK(moved.cast<soss::Message>()->data.size() == 1);
+
+  // Setting a field from its own contents must not read a destroyed value
+  text.set(*text.cast<std::string>() + " split");
+  CHECK(*text.cast<std::string>() == "banana split");
+
+  text = scalar;
+  CHECK(text.cast<std::string>() == nullptr);
+  CHECK(*text.cast<int64_t>() == 42);
+}
+
+TEST_CASE("Nested messages reuse the blocks of freed fields", "[message][core]")
+{
+  soss::Message inner;
+  inner.type = "test/Inner";
+  inner.data["value"] = soss::Convert<int64_t>::make_soss_field(4);
+
+  const void* block = nullptr;
+  {
+    const soss::Field field = soss::make_field<soss::Message>(inner);
+    block = field.cast<soss::Message>();
+  }
+
+  // The next nested message on this thread gets the same block
+  soss::Field field = soss::make_field<soss::Message>(inner);
+  CHECK(field.cast<soss::Message>() == block);
+  CHECK(field.cast<soss::Message>()->type == "test/Inner");
+
+  // A cached block can also be freed by a thread other than the one that
+  // allocated it
+  std::thread([&]() { field = soss::Field(); }).join();
+  CHECK(field.type_tag() == soss::FieldTypeTag::Other);
+}
+
+TEST_CASE("Compare the values of fields", "[message][core]")
+{
+  soss::Message inner;
+  inner.type = "test/Inner";
+  inner.data["value"] = soss::Convert<double>::make_soss_field(1.5);
+
+  const soss::Field a = soss::make_field<soss::Message>(inner);
+  soss::Field b = soss::make_field<soss::Message>(inner);
+  CHECK(a.equals(b));
+
+  b.cast<soss::Message>()->data["value"] =
+      soss::Convert<double>::make_soss_field(2.5);
+  CHECK_FALSE(a.equals(b));
+
+  const soss::Field text = soss::Convert<std::string>::make_soss_field("1.5");
+  CHECK_FALSE(a.equals(text));
+  CHECK(text.equals(soss::Convert<std::string>::make_soss_field("1.5")));
+
+  const auto list = soss::make_field<std::vector<soss::Message>>(
+        std::vector<soss::Message>{inner, inner});
+  CHECK(list.equals(list));
+  CHECK_FALSE(list.equals(soss::make_field<std::vector<soss::Message>>(
+                            std::vector<soss::Message>{inner})));
+
+  // Values of untagged types cannot be compared
+  const soss::Field empty;
+  CHECK_FALSE(empty.equals(empty));
+}
+
+TEST_CASE("Estimate the memory footprint of messages", "[message][core]")
+{
+  soss::Message empty;
+  CHECK(soss::memory_footprint(empty) == sizeof(soss::Message));
+
+  soss::Message message;
+  message.data["samples"] = soss::make_field<std::vector<double>>(1000, 0.0);
+  const std::size_t footprint = soss::memory_footprint(message);
+  CHECK(footprint >= sizeof(soss::Message) + 1000*sizeof(double));
+
+  // Nested messages are counted along with their parent
+  soss::Message parent;
+  parent.data["child"] = soss::make_field<soss::Message>(message);
+  parent.data["children"] = soss::make_field<std::vector<soss::Message>>(
+        2, message);
+  CHECK(soss::memory_footprint(parent) >= 3*footprint);
+}
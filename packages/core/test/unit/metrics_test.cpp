@@ -0,0 +1,185 @@
+/*
+ * Copyright (C) 2019 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include <soss/Metrics.hpp>
+
+#include <catch2/catch.hpp>
+
+#include <thread>
+
+namespace {
+
+//==============================================================================
+bool contains(const std::string& text, const std::string& line)
+{
+  return text.find(line + "\n") != std::string::npos;
+}
+
+} // anonymous namespace
+
+TEST_CASE("Render channel metrics as Prometheus text", "[metrics][core]")
+{
+  soss::ChannelMetrics& topic = soss::Metrics::topic("metrics_test/topic");
+  CHECK(&topic == &soss::Metrics::topic("metrics_test/topic"));
+
+  topic.count_message();
+  topic.count_message();
+  topic.count_bytes(128);
+  topic.count_drop();
+  topic.set_queue_depth(3);
+  topic.record_latency(std::chrono::microseconds(200));
+  topic.record_latency(std::chrono::seconds(10));
+
+  soss::Metrics::service("metrics_test/\"service\"").count_message();
+
+  const std::string text = soss::Metrics::to_prometheus();
+  const std::string labels = "topic=\"metrics_test/topic\"";
+
+  CHECK(contains(text, "# TYPE soss_topic_messages_total counter"));
+  CHECK(contains(text, "soss_topic_messages_total{" + labels + "} 2"));
+  CHECK(contains(text, "soss_topic_bytes_total{" + labels + "} 128"));
+  CHECK(contains(text, "soss_topic_dropped_total{" + labels + "} 1"));
+  CHECK(contains(text, "soss_topic_queue_depth{" + labels + "} 3"));
+
+  CHECK(contains(text,
+      "soss_topic_latency_seconds_bucket{" + labels + ",le=\"0.0001\"} 0"));
+  CHECK(contains(text,
+      "soss_topic_latency_seconds_bucket{" + labels + ",le=\"0.0005\"} 1"));
+  CHECK(contains(text,
+      "soss_topic_latency_seconds_bucket{" + labels + ",le=\"5\"} 1"));
+  CHECK(contains(text,
+      "soss_topic_latency_seconds_bucket{" + labels + ",le=\"+Inf\"} 2"));
+  CHECK(contains(text, "soss_topic_latency_seconds_count{" + labels + "} 2"));
+
+  CHECK(contains(text,
+      "soss_service_messages_total{service=\"metrics_test/\\\"service\\\"\"} 1"));
+}
+
+TEST_CASE("Connection metrics go away once released", "[metrics][core]")
+{
+  soss::ChannelMetrics& connection =
+      soss::Metrics::connection("metrics_test/connection");
+  connection.set_queue_depth(7);
+  connection.set_buffered_bytes(4096);
+
+  const std::string labels = "connection=\"metrics_test/connection\"";
+  std::string text = soss::Metrics::to_prometheus();
+  CHECK(contains(text, "soss_connection_queue_depth{" + labels + "} 7"));
+  CHECK(contains(text, "soss_connection_buffered_bytes{" + labels + "} 4096"));
+
+  soss::Metrics::release_connection("metrics_test/connection");
+  text = soss::Metrics::to_prometheus();
+  CHECK(text.find(labels) == std::string::npos);
+}
+
+TEST_CASE("Channels account their memory within the budget", "[metrics][core]")
+{
+  soss::ChannelMetrics& topic = soss::Metrics::topic("memory_topic");
+  soss::ChannelMetrics& connection = soss::Metrics::connection("memory_peer");
+  const std::size_t baseline = soss::Metrics::memory_bytes();
+
+  soss::Metrics::set_memory_budget(baseline + 1000);
+  CHECK(topic.reserve_memory(600));
+  CHECK_FALSE(topic.reserve_memory(600));
+  CHECK(soss::Metrics::memory_bytes() == baseline + 600);
+
+  // Buffered bytes cannot be refused, but they do count towards the budget
+  connection.set_buffered_bytes(500);
+  CHECK(soss::Metrics::over_memory_budget());
+  CHECK_FALSE(topic.reserve_memory(1));
+
+  const std::string text = soss::Metrics::to_prometheus();
+  CHECK(text.find("soss_topic_memory_bytes{topic=\"memory_topic\"} 600")
+        != std::string::npos);
+  CHECK(text.find("soss_connection_memory_bytes{connection=\"memory_peer\"} "
+                  "500") != std::string::npos);
+  CHECK(text.find("soss_memory_budget_bytes " + std::to_string(baseline + 1000))
+        != std::string::npos);
+
+  connection.set_buffered_bytes(100);
+  CHECK(soss::Metrics::memory_bytes() == baseline + 700);
+
+  // Releasing a connection gives back whatever it was still holding
+  soss::Metrics::release_connection("memory_peer");
+  topic.release_memory(600);
+  CHECK(soss::Metrics::memory_bytes() == baseline);
+  CHECK_FALSE(soss::Metrics::over_memory_budget());
+
+  soss::Metrics::set_memory_budget(0);
+}
+
+TEST_CASE("Render startup timings as Prometheus text", "[metrics][core]")
+{
+  soss::Metrics::record_startup(
+        "metrics_test", "component", std::chrono::milliseconds(1500));
+  soss::Metrics::record_startup(
+        "metrics_test", "component", std::chrono::milliseconds(250));
+
+  const std::string text = soss::Metrics::to_prometheus();
+  CHECK(contains(text, "# TYPE soss_startup_seconds gauge"));
+  CHECK(contains(text,
+      "soss_startup_seconds{phase=\"metrics_test\",component=\"component\"} "
+      "0.25"));
+}
+
+TEST_CASE("Ingress scopes mark when messages came in", "[metrics][core]")
+{
+  using namespace std::chrono_literals;
+  using Clock = soss::Ingress::Clock;
+
+  const bool was_enabled = soss::Ingress::enabled();
+
+  // Without tracing, scopes leave no mark behind
+  soss::Ingress::set_enabled(false);
+  {
+    const soss::Ingress::Scope ingress;
+    const Clock::time_point before = Clock::now();
+    CHECK(soss::Ingress::time() >= before);
+  }
+
+  soss::Ingress::set_enabled(true);
+  Clock::time_point marked;
+  {
+    const soss::Ingress::Scope ingress;
+    marked = soss::Ingress::time();
+    std::this_thread::sleep_for(2ms);
+    CHECK(soss::Ingress::time() == marked);
+
+    // An inner scope keeps the mark of the outer one
+    const soss::Ingress::Scope inner;
+    CHECK(soss::Ingress::time() == marked);
+
+    // Other threads have marks of their own
+    Clock::time_point other;
+    std::thread([&]() { other = soss::Ingress::time(); }).join();
+    CHECK(other > marked);
+  }
+
+  CHECK(soss::Ingress::time() > marked);
+  soss::Ingress::set_enabled(was_enabled);
+
+  soss::Metrics::route("metrics_test/topic", "sink")
+      .record_latency(std::chrono::microseconds(20));
+
+  const std::string text = soss::Metrics::to_prometheus();
+  const std::string labels =
+      "topic=\"metrics_test/topic\",destination=\"sink\"";
+  CHECK(contains(text, "# TYPE soss_route_latency_seconds histogram"));
+  CHECK(contains(text,
+      "soss_route_latency_seconds_bucket{" + labels + ",le=\"0.0001\"} 1"));
+  CHECK(contains(text, "soss_route_latency_seconds_count{" + labels + "} 1"));
+}
@@ -0,0 +1,64 @@
+/*
+ * Copyright (C) 2019 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#ifndef SOSS__TEST__UNIT__NUMBERS_HPP
+#define SOSS__TEST__UNIT__NUMBERS_HPP
+
+#include <soss/SystemHandle.hpp>
+#include <soss/utilities.hpp>
+
+#include <vector>
+
+// Many of the unit tests route messages that only carry a number, so they can
+// tell which messages arrived and in what order.
+namespace soss_test {
+
+//==============================================================================
+inline soss::Message make_number(const int value)
+{
+  soss::Message message;
+  message.type = "test/Number";
+  message.data["value"] = soss::Convert<int>::make_soss_field(value);
+  return message;
+}
+
+//==============================================================================
+inline int value_of(const soss::Message& message)
+{
+  int value = 0;
+  soss::Convert<int>::from_soss_field(message.data.find("value"), value);
+  return value;
+}
+
+//==============================================================================
+/// Keeps the number of every message that gets published to it
+class RecordingPublisher : public soss::TopicPublisher
+{
+public:
+
+  bool publish(const soss::Message& message) override
+  {
+    published.push_back(value_of(message));
+    return true;
+  }
+
+  std::vector<int> published;
+};
+
+} // namespace soss_test
+
+#endif // SOSS__TEST__UNIT__NUMBERS_HPP
@@ -0,0 +1,109 @@
+/*
+ * Copyright (C) 2019 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include <soss/utilities.hpp>
+
+#include <catch2/catch.hpp>
+
+#include <thread>
+#include <vector>
+
+namespace {
+
+//==============================================================================
+soss::Message initialize_message()
+{
+  soss::Message message;
+  message.type = "test/Pooled";
+  message.data["value"] = soss::Convert<double>::make_soss_field(0.0);
+  return message;
+}
+
+using MessagePool = soss::ResourcePool<soss::Message, &initialize_message>;
+
+} // anonymous namespace
+
+TEST_CASE("Leased resources return to their pool", "[utilities][core]")
+{
+  MessagePool pool(0);
+
+  const soss::Field* field = nullptr;
+  {
+    const std::shared_ptr<soss::Message> first = pool.lease();
+    const std::shared_ptr<soss::Message> second = pool.lease();
+    CHECK(first != second);
+    CHECK(first->type == "test/Pooled");
+    field = &first->data.at("value");
+  }
+
+  // The first message was released last, so it comes back first. It is moved
+  // in and out of the pool, so the nodes of its map are reused rather than
+  // reallocated.
+  const std::shared_ptr<soss::Message> reused = pool.lease();
+  CHECK(&reused->data.at("value") == field);
+}
+
+TEST_CASE("Leases may outlive their pool", "[utilities][core]")
+{
+  std::shared_ptr<soss::Message> message;
+  {
+    MessagePool pool;
+    message = pool.lease();
+  }
+
+  CHECK(message->type == "test/Pooled");
+  message.reset();
+}
+
+TEST_CASE("Pools track their high-water mark", "[utilities][core]")
+{
+  MessagePool pool(2);
+  CHECK(pool.available() == 2);
+  CHECK(pool.high_water_mark() == 0);
+
+  {
+    const auto first = pool.lease();
+    const auto second = pool.lease();
+    const auto third = pool.lease();
+    CHECK(pool.available() == 0);
+  }
+
+  CHECK(pool.available() == 3);
+  CHECK(pool.high_water_mark() == 3);
+
+  const std::size_t thread_count = 4;
+  std::vector<std::thread> threads;
+  for(std::size_t i=0; i < thread_count; ++i)
+  {
+    threads.emplace_back([&pool]()
+    {
+      for(std::size_t j=0; j < 1000; ++j)
+      {
+        soss::Message message = pool.pop();
+        message.data["value"] = soss::Convert<double>::make_soss_field(1.0*j);
+        pool.recycle(std::move(message));
+      }
+    });
+  }
+
+  for(std::thread& thread : threads)
+    thread.join();
+
+  // Each thread only ever holds one message at a time
+  CHECK(pool.high_water_mark() <= std::max<std::size_t>(3, thread_count));
+  CHECK(pool.available() <= std::max<std::size_t>(3, thread_count));
+}
@@ -0,0 +1,503 @@
+/*
+ * Copyright (C) 2019 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+
+#include "Config.hpp"
+#include "RouteTable.hpp"
+#include "numbers.hpp"
+
+#include <soss/utilities.hpp>
+
+#include <catch2/catch.hpp>
+
+namespace {
+
+using soss_test::make_number;
+using soss_test::value_of;
+using soss_test::RecordingPublisher;
+
+//==============================================================================
+class ToySubscriber : public soss::TopicSubscriberSystem
+{
+public:
+
+  bool configure(const soss::RequiredTypes&, const YAML::Node&) override
+  {
+    return true;
+  }
+
+  bool okay() const override { return true; }
+
+  bool spin_once() override { return true; }
+
+  bool subscribe(
+      const std::string& topic_name,
+      const std::string& /*message_type*/,
+      SubscriptionCallback callback,
+      const YAML::Node& /*configuration*/) override
+  {
+    subscriptions.emplace_back(topic_name, std::move(callback));
+    return true;
+  }
+
+  std::vector<std::pair<std::string, SubscriptionCallback>> subscriptions;
+};
+
+//==============================================================================
+class ToyPublisherSystem : public soss::TopicPublisherSystem
+{
+public:
+
+  bool configure(const soss::RequiredTypes&, const YAML::Node&) override
+  {
+    return true;
+  }
+
+  bool okay() const override { return true; }
+
+  bool spin_once() override { return true; }
+
+  std::shared_ptr<soss::TopicPublisher> advertise(
+      const std::string& /*topic_name*/,
+      const std::string& /*message_type*/,
+      const YAML::Node& /*configuration*/) override
+  {
+    ++advertised;
+    return std::make_shared<RecordingPublisher>();
+  }
+
+  int advertised = 0;
+};
+
+//==============================================================================
+class RecordingClient : public soss::ServiceClient
+{
+public:
+
+  void receive_response(
+      std::shared_ptr<void> /*call_handle*/,
+      const soss::Message& response) override
+  {
+    responses.push_back(value_of(response));
+  }
+
+  void receive_error(
+      std::shared_ptr<void> /*call_handle*/,
+      const std::string& error) override
+  {
+    errors.push_back(error);
+  }
+
+  std::vector<int> responses;
+  std::vector<std::string> errors;
+};
+
+//==============================================================================
+class ToyClientSystem : public soss::ServiceClientSystem
+{
+public:
+
+  bool configure(const soss::RequiredTypes&, const YAML::Node&) override
+  {
+    return true;
+  }
+
+  bool okay() const override { return true; }
+
+  bool spin_once() override { return true; }
+
+  bool create_client_proxy(
+      const std::string& /*service_name*/,
+      const std::string& /*service_type*/,
+      RequestCallback callback,
+      const YAML::Node& /*configuration*/) override
+  {
+    callbacks.push_back(std::move(callback));
+    return true;
+  }
+
+  std::vector<RequestCallback> callbacks;
+};
+
+//==============================================================================
+soss::TopicSubscriberSystem::SubscriptionCallback forward_to(
+    const std::shared_ptr<soss::TopicPublisher>& publisher)
+{
+  return [publisher](const soss::Message& message)
+  {
+    publisher->publish(message);
+  };
+}
+
+} // anonymous namespace
+
+TEST_CASE("Reconfigured topics reuse what they still need", "[route_table]")
+{
+  soss::internal::RouteTable table;
+  ToySubscriber subscriber;
+  ToyPublisherSystem publishers;
+  const YAML::Node empty;
+
+  const auto first = table.advertise(
+        "chatter", "to", publishers, "chatter", "test/Number", empty);
+  REQUIRE(first);
+  CHECK(table.subscribe(
+          "chatter", "from", subscriber, "chatter", "test/Number",
+          forward_to(first), empty));
+  REQUIRE(subscriber.subscriptions.size() == 1);
+
+  subscriber.subscriptions[0].second(make_number(1));
+  CHECK(static_cast<RecordingPublisher&>(*first).published
+        == std::vector<int>{1});
+
+  // The topic changes, but its subscription and publisher stay the same
+  table.begin("chatter");
+  const auto again = table.advertise(
+        "chatter", "to", publishers, "chatter", "test/Number", empty);
+  CHECK(again == first);
+  CHECK(publishers.advertised == 1);
+
+  int rerouted = 0;
+  CHECK(table.subscribe(
+          "chatter", "from", subscriber, "chatter", "test/Number",
+          [&](const soss::Message&) { ++rerouted; }, empty));
+  table.finish("chatter");
+
+  CHECK(subscriber.subscriptions.size() == 1);
+  subscriber.subscriptions[0].second(make_number(2));
+  CHECK(rerouted == 1);
+  CHECK(static_cast<RecordingPublisher&>(*first).published.size() == 1);
+
+  // Subscribing under a different name cuts off the old subscription
+  table.begin("chatter");
+  CHECK(table.subscribe(
+          "chatter", "from", subscriber, "renamed", "test/Number",
+          [&](const soss::Message&) { rerouted += 10; }, empty));
+  table.finish("chatter");
+
+  REQUIRE(subscriber.subscriptions.size() == 2);
+  subscriber.subscriptions[0].second(make_number(3));
+  CHECK(rerouted == 1);
+  subscriber.subscriptions[1].second(make_number(3));
+  CHECK(rerouted == 11);
+
+  // Removing the topic cuts everything off, and adding it back reuses the
+  // subscription that the middleware still has
+  table.remove("chatter");
+  subscriber.subscriptions[1].second(make_number(4));
+  CHECK(rerouted == 11);
+
+  CHECK(table.subscribe(
+          "chatter", "from", subscriber, "renamed", "test/Number",
+          [&](const soss::Message&) { rerouted += 100; }, empty));
+  CHECK(subscriber.subscriptions.size() == 2);
+  subscriber.subscriptions[1].second(make_number(5));
+  CHECK(rerouted == 111);
+}
+
+TEST_CASE("Removed services turn their requests away", "[route_table]")
+{
+  soss::internal::RouteTable table;
+  ToyClientSystem clients;
+  const YAML::Node empty;
+
+  CHECK(table.create_client_proxy(
+          "add", "client", clients, "add", "test/Add",
+          [](const soss::Message& request, soss::ServiceClient& client,
+             std::shared_ptr<void> handle)
+  {
+    client.receive_response(handle, make_number(value_of(request) + 1));
+  }, empty));
+  REQUIRE(clients.callbacks.size() == 1);
+
+  RecordingClient client;
+  clients.callbacks[0](make_number(1), client, nullptr);
+  CHECK(client.responses == std::vector<int>{2});
+
+  table.remove("add");
+  clients.callbacks[0](make_number(1), client, nullptr);
+  CHECK(client.responses.size() == 1);
+  CHECK(client.errors.size() == 1);
+}
+
+namespace {
+
+//==============================================================================
+/// A subscriber that takes back the last subscription that it made with the
+/// same arguments when it is asked to
+class ReleasingSubscriber : public ToySubscriber
+{
+public:
+
+  bool unsubscribe(
+      const std::string& topic_name,
+      const std::string& /*message_type*/,
+      const YAML::Node& /*configuration*/) override
+  {
+    for(auto it = subscriptions.rbegin(); it != subscriptions.rend(); ++it)
+    {
+      if(it->first == topic_name)
+      {
+        subscriptions.erase(std::next(it).base());
+        ++released;
+        return true;
+      }
+    }
+
+    return false;
+  }
+
+  int released = 0;
+};
+
+//==============================================================================
+class ReleasingClientSystem : public ToyClientSystem
+{
+public:
+
+  bool release_client_proxy(
+      const std::string& /*service_name*/,
+      const std::string& /*service_type*/,
+      const YAML::Node& /*configuration*/) override
+  {
+    callbacks.pop_back();
+    return true;
+  }
+};
+
+} // anonymous namespace
+
+TEST_CASE("Subscriptions that are cut off get released", "[route_table]")
+{
+  soss::internal::RouteTable table;
+  ReleasingSubscriber subscriber;
+  const YAML::Node empty;
+
+  std::vector<int> first;
+  std::vector<int> second;
+  const auto record = [](std::vector<int>& into)
+  {
+    return [&into](const soss::Message& message)
+    {
+      into.push_back(value_of(message));
+    };
+  };
+
+  // Two channels subscribe to the same topic with the same arguments
+  CHECK(table.subscribe(
+          "first", "from", subscriber, "chatter", "test/Number",
+          record(first), empty));
+  CHECK(table.subscribe(
+          "second", "from", subscriber, "chatter", "test/Number",
+          record(second), empty));
+  REQUIRE(subscriber.subscriptions.size() == 2);
+
+  // The middleware takes back its last subscription, so the one that is left
+  // has to deliver to the channel that is left
+  table.remove("first");
+  CHECK(subscriber.released == 1);
+  REQUIRE(subscriber.subscriptions.size() == 1);
+  subscriber.subscriptions[0].second(make_number(1));
+  CHECK(first.empty());
+  CHECK(second == std::vector<int>{1});
+
+  // Adding the channel back subscribes again
+  CHECK(table.subscribe(
+          "first", "from", subscriber, "chatter", "test/Number",
+          record(first), empty));
+  REQUIRE(subscriber.subscriptions.size() == 2);
+  subscriber.subscriptions[1].second(make_number(2));
+  CHECK(first == std::vector<int>{2});
+
+  // A topic that changes its name releases the subscription of the old name
+  table.begin("second");
+  CHECK(table.subscribe(
+          "second", "from", subscriber, "renamed", "test/Number",
+          record(second), empty));
+  table.finish("second");
+  CHECK(subscriber.released == 2);
+  REQUIRE(subscriber.subscriptions.size() == 2);
+  CHECK(subscriber.subscriptions[0].first == "chatter");
+  CHECK(subscriber.subscriptions[1].first == "renamed");
+
+  subscriber.subscriptions[0].second(make_number(3));
+  subscriber.subscriptions[1].second(make_number(4));
+  CHECK(first == std::vector<int>({2, 3}));
+  CHECK(second == std::vector<int>({1, 4}));
+
+  table.remove("first");
+  table.remove("second");
+  CHECK(subscriber.released == 4);
+  CHECK(subscriber.subscriptions.empty());
+}
+
+TEST_CASE("Client proxies that are cut off get released", "[route_table]")
+{
+  soss::internal::RouteTable table;
+  ReleasingClientSystem clients;
+  const YAML::Node empty;
+
+  const auto add = [](const int amount)
+  {
+    return [amount](const soss::Message& request, soss::ServiceClient& client,
+        std::shared_ptr<void> handle)
+    {
+      client.receive_response(handle, make_number(value_of(request) + amount));
+    };
+  };
+
+  CHECK(table.create_client_proxy(
+          "one", "client", clients, "add", "test/Add", add(1), empty));
+  CHECK(table.create_client_proxy(
+          "ten", "client", clients, "add", "test/Add", add(10), empty));
+  REQUIRE(clients.callbacks.size() == 2);
+
+  table.remove("one");
+  REQUIRE(clients.callbacks.size() == 1);
+
+  RecordingClient client;
+  clients.callbacks[0](make_number(1), client, nullptr);
+  CHECK(client.responses == std::vector<int>{11});
+
+  table.remove("ten");
+  CHECK(clients.callbacks.empty());
+}
+
+namespace {
+
+//==============================================================================
+class EchoProvider : public soss::ServiceProvider
+{
+public:
+
+  void call_service(
+      const soss::Message& request,
+      soss::ServiceClient& client,
+      std::shared_ptr<void> call_handle) override
+  {
+    client.receive_response(call_handle, request);
+  }
+};
+
+//==============================================================================
+class ToyMiddleware : public soss::FullSystem
+{
+public:
+
+  bool configure(const soss::RequiredTypes&, const YAML::Node&) override
+  {
+    return true;
+  }
+
+  bool okay() const override { return true; }
+
+  bool spin_once() override { return true; }
+
+  bool subscribe(
+      const std::string& /*topic_name*/,
+      const std::string& /*message_type*/,
+      SubscriptionCallback callback,
+      const YAML::Node& /*configuration*/) override
+  {
+    subscriptions.push_back(std::move(callback));
+    return true;
+  }
+
+  std::shared_ptr<soss::TopicPublisher> advertise(
+      const std::string& /*topic_name*/,
+      const std::string& /*message_type*/,
+      const YAML::Node& /*configuration*/) override
+  {
+    publishers.push_back(std::make_shared<RecordingPublisher>());
+    return publishers.back();
+  }
+
+  bool create_client_proxy(
+      const std::string& /*service_name*/,
+      const std::string& /*service_type*/,
+      RequestCallback callback,
+      const YAML::Node& /*configuration*/) override
+  {
+    clients.push_back(std::move(callback));
+    return true;
+  }
+
+  std::shared_ptr<soss::ServiceProvider> create_service_proxy(
+      const std::string& /*service_name*/,
+      const std::string& /*service_type*/,
+      const YAML::Node& /*configuration*/) override
+  {
+    return std::make_shared<EchoProvider>();
+  }
+
+  std::vector<SubscriptionCallback> subscriptions;
+  std::vector<std::shared_ptr<RecordingPublisher>> publishers;
+  std::vector<RequestCallback> clients;
+};
+
+} // anonymous namespace
+
+TEST_CASE("Topics and services with the same name keep their own routes",
+          "[route_table]")
+{
+  using soss::internal::Config;
+
+  const Config config(YAML::Load(
+    "systems: { a: { type: toy }, b: { type: toy } }\n"
+    "topics:\n"
+    "  foo: { type: 'test/Number', route: { from: a, to: b } }\n"
+    "services:\n"
+    "  foo: { type: 'test/Number', route: { server: b, clients: a } }\n"));
+  REQUIRE(config);
+
+  ToyMiddleware* const a = new ToyMiddleware;
+  ToyMiddleware* const b = new ToyMiddleware;
+  soss::internal::SystemHandleInfoMap info_map;
+  info_map.emplace("a", std::unique_ptr<soss::SystemHandle>(a));
+  info_map.emplace("b", std::unique_ptr<soss::SystemHandle>(b));
+
+  soss::internal::RouteTable table;
+  CHECK(config.configure_topics(info_map, table));
+  CHECK(config.configure_services(info_map, table));
+
+  REQUIRE(a->subscriptions.size() == 1);
+  REQUIRE(b->publishers.size() == 1);
+  a->subscriptions[0](make_number(1));
+  CHECK(b->publishers[0]->published == std::vector<int>{1});
+
+  REQUIRE(a->clients.size() == 1);
+  RecordingClient client;
+  a->clients[0](make_number(2), client, nullptr);
+  CHECK(client.responses == std::vector<int>{2});
+
+  // Removing the service leaves the topic of the same name alone
+  Config without_service(YAML::Load(
+    "systems: { a: { type: toy }, b: { type: toy } }\n"
+    "topics:\n"
+    "  foo: { type: 'test/Number', route: { from: a, to: b } }\n"));
+  REQUIRE(without_service);
+  CHECK(without_service.reconfigure(config, info_map, table));
+
+  a->subscriptions[0](make_number(3));
+  CHECK(b->publishers[0]->published == std::vector<int>({1, 3}));
+
+  a->clients[0](make_number(4), client, nullptr);
+  CHECK(client.responses == std::vector<int>{2});
+  CHECK(client.errors.size() == 1);
+
+  table.stop_queues();
+}
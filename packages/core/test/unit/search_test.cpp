@@ -19,7 +19,11 @@
 
 #include <catch2/catch.hpp>
 
+#include <chrono>
+#include <cstdio>
+#include <fstream>
 #include <iostream>
+#include <thread>
 
 TEST_CASE("Use config-file directory", "[search][core]")
 {
@@ -35,3 +39,47 @@ TEST_CASE("Use config-file directory", "[search][core]")
   REQUIRE(with_config_dir.find_file(SEARCH_TEST__MOCK_FILE_NAME)
           == SEARCH_TEST__MOCK_FILE_PATH);
 }
+
+TEST_CASE("Notice files that are added after a search", "[search][core]")
+{
+  const std::string filename = "added_later.mix";
+  const std::string path =
+      std::string(SEARCH_TEST__MOCK_PREFIX_DIRECTORY) + "/" + filename;
+  std::remove(path.c_str());
+
+  soss::Search search("mock");
+  search.add_priority_middleware_prefix(SEARCH_TEST__MOCK_PREFIX_DIRECTORY);
+  search.ignore_soss_prefixes();
+  CHECK(search.find_file(filename).empty());
+
+  std::ofstream(path) << "intentionally blank";
+
+  // Directory listings are remembered for a moment before they get checked
+  // for changes again
+  std::this_thread::sleep_for(std::chrono::milliseconds(1100));
+  CHECK(search.find_file(filename) == path);
+
+  // Other instances share what has been found
+  soss::Search other("mock");
+  other.add_priority_middleware_prefix(SEARCH_TEST__MOCK_PREFIX_DIRECTORY);
+  CHECK(other.find_file(filename) == path);
+
+  std::remove(path.c_str());
+}
+
+TEST_CASE("Find the mix file of a whole package", "[search][core]")
+{
+  soss::Search search("mock");
+  search.add_priority_middleware_prefix(SEARCH_TEST__MOCK_PREFIX_DIRECTORY);
+  search.ignore_soss_prefixes();
+
+  const std::string path =
+      std::string(SEARCH_TEST__MOCK_PREFIX_DIRECTORY) + "/pkg/mock_msgs.mix";
+  CHECK(search.find_package_mix("mock_msgs/Type") == path);
+  CHECK(search.find_package_mix("mock_msgs/nested/Type") == path);
+  CHECK(search.find_package_mix("other_msgs/Type").empty());
+
+  std::vector<std::string> checked_paths{"stale"};
+  CHECK(search.find_package_mix("Type", &checked_paths).empty());
+  CHECK(checked_paths.empty());
+}
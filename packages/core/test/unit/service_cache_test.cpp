@@ -0,0 +1,228 @@
+/*
+ * Copyright (C) 2019 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include "ServiceCache.hpp"
+
+#include <soss/utilities.hpp>
+
+#include <catch2/catch.hpp>
+
+#include <thread>
+
+using namespace std::chrono_literals;
+
+namespace {
+
+//==============================================================================
+struct Unkeyable
+{
+  int value;
+};
+
+//==============================================================================
+soss::Message make_request(const int64_t value)
+{
+  soss::Message request;
+  request.type = "test/Request";
+  request.data["value"] = soss::Convert<int64_t>::make_soss_field(value);
+  return request;
+}
+
+//==============================================================================
+class RecordingClient : public soss::ServiceClient
+{
+public:
+
+  void receive_response(
+      std::shared_ptr<void> /*call_handle*/,
+      const soss::Message& response) override
+  {
+    responses.push_back(*response.data.at("value").cast<int64_t>());
+  }
+
+  void receive_error(
+      std::shared_ptr<void> /*call_handle*/,
+      const std::string& error) override
+  {
+    errors.push_back(error);
+  }
+
+  std::vector<int64_t> responses;
+  std::vector<std::string> errors;
+};
+
+//==============================================================================
+/// Holds on to the requests that reach the providers, so the test can decide
+/// when each of them gets answered
+struct Upstream
+{
+  struct Call
+  {
+    int64_t value;
+    soss::ServiceClient* client;
+    std::shared_ptr<void> handle;
+  };
+
+  soss::internal::ServiceCache::Upstream function()
+  {
+    return [this](
+        const soss::Message& request,
+        soss::ServiceClient& client,
+        const std::shared_ptr<void>& handle)
+    {
+      calls.push_back(
+            Call{*request.data.at("value").cast<int64_t>(), &client, handle});
+    };
+  }
+
+  void respond(const std::size_t index, const int64_t value)
+  {
+    const Call& call = calls.at(index);
+    call.client->receive_response(call.handle, make_request(value));
+  }
+
+  std::vector<Call> calls;
+};
+
+} // anonymous namespace
+
+TEST_CASE("Message keys identify the contents of a message", "[service_cache]")
+{
+  std::string a;
+  std::string b;
+
+  REQUIRE(soss::internal::make_message_key(make_request(1), a));
+  REQUIRE(soss::internal::make_message_key(make_request(1), b));
+  CHECK(a == b);
+
+  REQUIRE(soss::internal::make_message_key(make_request(2), b));
+  CHECK(a != b);
+
+  soss::Message other_type = make_request(1);
+  other_type.type = "test/Other";
+  REQUIRE(soss::internal::make_message_key(other_type, b));
+  CHECK(a != b);
+
+  soss::Message nested = make_request(1);
+  nested.data["inner"] = soss::make_field<soss::Message>(make_request(3));
+  nested.data["names"] = soss::Convert<std::vector<std::string>>
+      ::make_soss_field(std::vector<std::string>{"ab", "c"});
+  REQUIRE(soss::internal::make_message_key(nested, a));
+
+  nested.data["names"] = soss::Convert<std::vector<std::string>>
+      ::make_soss_field(std::vector<std::string>{"a", "bc"});
+  REQUIRE(soss::internal::make_message_key(nested, b));
+  CHECK(a != b);
+
+  nested.data["unknown"] = soss::make_field<Unkeyable>(Unkeyable{1});
+  CHECK_FALSE(soss::internal::make_message_key(nested, a));
+}
+
+TEST_CASE("Identical requests share one call to the providers", "[service_cache]")
+{
+  Upstream upstream;
+  soss::internal::ServiceCacheConfig config;
+  config.size = 4;
+  config.ttl = 1h;
+  soss::internal::ServiceCache cache(config, upstream.function());
+
+  RecordingClient client;
+  cache.call(make_request(1), client, nullptr);
+  cache.call(make_request(1), client, nullptr);
+  cache.call(make_request(2), client, nullptr);
+  REQUIRE(upstream.calls.size() == 2);
+  CHECK(client.responses.empty());
+
+  upstream.respond(0, 10);
+  CHECK(client.responses == (std::vector<int64_t>{10, 10}));
+  CHECK(cache.size() == 1);
+
+  // A second answer to the same call must not reach the clients again
+  upstream.respond(0, 11);
+  CHECK(client.responses.size() == 2);
+
+  // Now the response comes straight out of the cache
+  cache.call(make_request(1), client, nullptr);
+  CHECK(upstream.calls.size() == 2);
+  CHECK(client.responses.back() == 11);
+}
+
+TEST_CASE("Cached responses expire and get evicted", "[service_cache]")
+{
+  Upstream upstream;
+  soss::internal::ServiceCacheConfig config;
+  config.size = 2;
+  config.ttl = 20ms;
+  soss::internal::ServiceCache cache(config, upstream.function());
+  RecordingClient client;
+
+  cache.call(make_request(1), client, nullptr);
+  upstream.respond(0, 10);
+  std::this_thread::sleep_for(40ms);
+
+  cache.call(make_request(1), client, nullptr);
+  REQUIRE(upstream.calls.size() == 2);
+  upstream.respond(1, 10);
+
+  // Only the two most recently used responses are kept
+  config.ttl = 1h;
+  soss::internal::ServiceCache small(config, upstream.function());
+  for(int64_t value = 1; value <= 3; ++value)
+  {
+    small.call(make_request(value), client, nullptr);
+    upstream.respond(upstream.calls.size()-1, value);
+  }
+  CHECK(small.size() == 2);
+
+  const std::size_t calls = upstream.calls.size();
+  small.call(make_request(3), client, nullptr);
+  small.call(make_request(2), client, nullptr);
+  CHECK(upstream.calls.size() == calls);
+
+  small.call(make_request(1), client, nullptr);
+  CHECK(upstream.calls.size() == calls + 1);
+}
+
+TEST_CASE("Failures and unkeyable requests are never cached", "[service_cache]")
+{
+  Upstream upstream;
+  soss::internal::ServiceCacheConfig config;
+  config.size = 4;
+  config.ttl = 1h;
+  soss::internal::ServiceCache cache(config, upstream.function());
+  RecordingClient client;
+
+  cache.call(make_request(1), client, nullptr);
+  cache.call(make_request(1), client, nullptr);
+  REQUIRE(upstream.calls.size() == 1);
+
+  const Upstream::Call& failed = upstream.calls.front();
+  failed.client->receive_error(failed.handle, "timed out");
+  CHECK(client.errors.size() == 2);
+  CHECK(cache.size() == 0);
+
+  cache.call(make_request(1), client, nullptr);
+  CHECK(upstream.calls.size() == 2);
+
+  // Requests that cannot be keyed go straight to the providers
+  soss::Message request = make_request(5);
+  request.data["unknown"] = soss::make_field<Unkeyable>(Unkeyable{1});
+  cache.call(request, client, nullptr);
+  cache.call(request, client, nullptr);
+  REQUIRE(upstream.calls.size() == 4);
+  CHECK(upstream.calls.back().client == &client);
+}
@@ -0,0 +1,212 @@
+/*
+ * Copyright (C) 2019 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include "numbers.hpp"
+
+#include <soss/ServiceCall.hpp>
+#include <soss/utilities.hpp>
+
+#include <catch2/catch.hpp>
+
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+namespace {
+
+using soss_test::make_number;
+using soss_test::value_of;
+
+//==============================================================================
+/// Holds on to its requests until the test answers them
+class ToyProvider : public soss::ServiceProvider
+{
+public:
+
+  struct Pending
+  {
+    int request;
+    soss::ServiceClient* client;
+    std::shared_ptr<void> call_handle;
+  };
+
+  void call_service(
+      const soss::Message& request,
+      soss::ServiceClient& client,
+      std::shared_ptr<void> call_handle) override
+  {
+    pending.push_back({value_of(request), &client, std::move(call_handle)});
+  }
+
+  void cancel_service_call(const std::shared_ptr<void>& call_handle) override
+  {
+    cancelled.push_back(call_handle);
+  }
+
+  /// Answer the oldest request with the request plus an offset
+  void answer(const int offset)
+  {
+    const Pending call = pending.front();
+    pending.erase(pending.begin());
+    call.client->receive_response(
+          call.call_handle, make_number(call.request + offset));
+  }
+
+  std::vector<Pending> pending;
+  std::vector<std::shared_ptr<void>> cancelled;
+};
+
+} // anonymous namespace
+
+TEST_CASE("Service calls finish when the provider answers", "[service_call]")
+{
+  const auto provider = std::make_shared<ToyProvider>();
+
+  const soss::ServiceCall call =
+      soss::ServiceCall::call(provider, make_number(1));
+  CHECK_FALSE(call.ready());
+  REQUIRE(provider->pending.size() == 1);
+
+  std::vector<int> responses;
+  call.then([&](const soss::ServiceCall::Result& result)
+  {
+    CHECK(result.succeeded);
+    responses.push_back(value_of(result.response));
+  });
+  CHECK(responses.empty());
+
+  provider->answer(10);
+  CHECK(call.ready());
+  CHECK(responses == std::vector<int>{11});
+
+  // Continuations that come late run right away
+  call.then([&](const soss::ServiceCall::Result& result)
+  {
+    responses.push_back(value_of(result.response));
+  });
+  CHECK(responses == std::vector<int>{11, 11});
+
+  // A call without a provider has already failed
+  const soss::ServiceCall orphan =
+      soss::ServiceCall::call(nullptr, make_number(1));
+  CHECK(orphan.ready());
+  orphan.then([&](const soss::ServiceCall::Result& result)
+  {
+    CHECK_FALSE(result.succeeded);
+    CHECK_FALSE(result.error.empty());
+  });
+}
+
+TEST_CASE("Chained service calls make each call in turn", "[service_call]")
+{
+  const auto provider = std::make_shared<ToyProvider>();
+
+  const soss::ServiceCall chain =
+      soss::ServiceCall::call(provider, make_number(1))
+      .then_call([&](const soss::ServiceCall::Result& result)
+  {
+    return soss::ServiceCall::call(
+          provider, make_number(value_of(result.response)));
+  });
+
+  int final_response = 0;
+  chain.then([&](const soss::ServiceCall::Result& result)
+  {
+    final_response = value_of(result.response);
+  });
+
+  provider->answer(10);
+  CHECK_FALSE(chain.ready());
+  REQUIRE(provider->pending.size() == 1);
+  CHECK(provider->pending.front().request == 11);
+
+  provider->answer(100);
+  CHECK(chain.ready());
+  CHECK(final_response == 111);
+
+  // Cancelling a chain cancels the call that it is waiting for, and it does
+  // not make the calls that would have come next
+  bool next_made = false;
+  const soss::ServiceCall cancelled =
+      soss::ServiceCall::call(provider, make_number(1))
+      .then_call([&](const soss::ServiceCall::Result& result)
+  {
+    next_made = true;
+    return soss::ServiceCall::finished(result);
+  });
+
+  cancelled.cancel();
+  CHECK(cancelled.ready());
+  CHECK(provider->cancelled.size() == 1);
+
+  provider->answer(0);
+  CHECK_FALSE(next_made);
+}
+
+TEST_CASE("Concurrent service calls get joined", "[service_call]")
+{
+  const auto provider = std::make_shared<ToyProvider>();
+
+  std::vector<soss::ServiceCall> calls;
+  for(int i=0; i < 3; ++i)
+    calls.push_back(soss::ServiceCall::call(provider, make_number(i)));
+
+  std::vector<int> joined;
+  soss::ServiceCall::when_all(
+        calls, [&](const std::vector<soss::ServiceCall::Result>& results)
+  {
+    for(const auto& result : results)
+      joined.push_back(value_of(result.response));
+  });
+
+  // The calls may finish in any order, but the results keep the order of the
+  // calls
+  std::reverse(provider->pending.begin(), provider->pending.end());
+  provider->answer(10);
+  provider->answer(10);
+  CHECK(joined.empty());
+  provider->answer(10);
+  CHECK(joined == std::vector<int>{10, 11, 12});
+}
+
+TEST_CASE("Service call continuations run on their executor", "[service_call]")
+{
+  const auto executor = std::make_shared<soss::Executor>(1);
+  const auto provider = std::make_shared<ToyProvider>();
+
+  std::mutex mutex;
+  std::condition_variable cv;
+  bool on_worker = false;
+  bool done = false;
+
+  soss::ServiceCall::call(provider, make_number(1)).then(
+        [&](const soss::ServiceCall::Result& result)
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    on_worker = executor->on_worker() && value_of(result.response) == 2;
+    done = true;
+    cv.notify_all();
+  }, executor);
+
+  provider->answer(1);
+
+  std::unique_lock<std::mutex> lock(mutex);
+  REQUIRE(cv.wait_for(
+            lock, std::chrono::seconds(5), [&]() { return done; }));
+  CHECK(on_worker);
+}
@@ -0,0 +1,381 @@
+/*
+ * Copyright (C) 2019 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include "SharedSystems.hpp"
+#include "numbers.hpp"
+
+#include <soss/utilities.hpp>
+
+#include <catch2/catch.hpp>
+
+namespace {
+
+using soss_test::make_number;
+using soss_test::value_of;
+using soss_test::RecordingPublisher;
+
+//==============================================================================
+class ToyClient : public soss::ServiceClient
+{
+public:
+
+  void receive_response(
+      std::shared_ptr<void> /*call_handle*/,
+      const soss::Message& /*response*/) override
+  {
+    // Do nothing
+  }
+
+  void receive_error(
+      std::shared_ptr<void> /*call_handle*/,
+      const std::string& error) override
+  {
+    errors.push_back(error);
+  }
+
+  std::vector<std::string> errors;
+};
+
+//==============================================================================
+class ToySystem : public soss::TopicSystem, public soss::ServiceClientSystem
+{
+public:
+
+  ToySystem(int& created)
+  {
+    ++created;
+  }
+
+  bool configure(const soss::RequiredTypes&, const YAML::Node&) override
+  {
+    ++configured;
+    return true;
+  }
+
+  bool okay() const override { return true; }
+
+  bool spin_once() override { return true; }
+
+  bool self_driven() const override { return true; }
+
+  bool subscribe(
+      const std::string& /*topic_name*/,
+      const std::string& /*message_type*/,
+      SubscriptionCallback callback,
+      const YAML::Node& /*configuration*/) override
+  {
+    subscriptions.push_back(std::move(callback));
+    return true;
+  }
+
+  bool unsubscribe(
+      const std::string& /*topic_name*/,
+      const std::string& /*message_type*/,
+      const YAML::Node& /*configuration*/) override
+  {
+    subscriptions.pop_back();
+    ++unsubscribed;
+    return true;
+  }
+
+  std::shared_ptr<soss::TopicPublisher> advertise(
+      const std::string& /*topic_name*/,
+      const std::string& /*message_type*/,
+      const YAML::Node& /*configuration*/) override
+  {
+    ++advertised;
+    return std::make_shared<RecordingPublisher>();
+  }
+
+  bool create_client_proxy(
+      const std::string& /*service_name*/,
+      const std::string& /*service_type*/,
+      RequestCallback callback,
+      const YAML::Node& /*configuration*/) override
+  {
+    clients.push_back(std::move(callback));
+    return true;
+  }
+
+  int configured = 0;
+  int advertised = 0;
+  int unsubscribed = 0;
+  std::vector<SubscriptionCallback> subscriptions;
+  std::vector<RequestCallback> clients;
+};
+
+//==============================================================================
+struct ToyFactory
+{
+  int created = 0;
+  ToySystem* last = nullptr;
+
+  soss::internal::SystemHandleInfo operator()()
+  {
+    auto system = std::make_unique<ToySystem>(created);
+    last = system.get();
+    return soss::internal::SystemHandleInfo(std::move(system));
+  }
+};
+
+//==============================================================================
+soss::internal::SystemHandleInfoMap attach(
+    ToyFactory& factory,
+    const YAML::Node& configuration)
+{
+  soss::internal::SystemHandleInfoMap info_map;
+  info_map.insert(
+        std::make_pair(
+          "toy", soss::internal::SharedSystems::attach(
+            "toy", "toy", soss::RequiredTypes(), configuration,
+            soss::ThreadSettings(), [&]() { return factory(); })));
+  return info_map;
+}
+
+} // anonymous namespace
+
+TEST_CASE("Instances share the systems that they configure alike",
+          "[shared_systems]")
+{
+  ToyFactory factory;
+  const YAML::Node config = YAML::Load("{shared: true, test: alike}");
+
+  auto first = attach(factory, config);
+  ToySystem* const system = factory.last;
+  auto second = attach(factory, config);
+  REQUIRE(first.at("toy"));
+  REQUIRE(second.at("toy"));
+  CHECK(factory.created == 1);
+  CHECK(system->configured == 1);
+
+  // A system that is configured differently is not shared
+  auto other = attach(factory, YAML::Load("{shared: true, test: different}"));
+  REQUIRE(other.at("toy"));
+  CHECK(factory.created == 2);
+
+  // Once nothing uses a shared system anymore, it is gone for good
+  first.clear();
+  second.clear();
+  auto third = attach(factory, config);
+  CHECK(factory.created == 3);
+}
+
+TEST_CASE("Shared subscriptions fan out to every instance", "[shared_systems]")
+{
+  ToyFactory factory;
+  const YAML::Node config = YAML::Load("{shared: true, test: fanout}");
+  const YAML::Node empty;
+
+  auto first = attach(factory, config);
+  ToySystem* const system = factory.last;
+  auto second = attach(factory, config);
+
+  std::vector<int> first_received;
+  std::vector<int> second_received;
+  const auto record_in = [](std::vector<int>& received)
+  {
+    return [&received](const soss::Message& message)
+    {
+      received.push_back(value_of(message));
+    };
+  };
+
+  REQUIRE(first.at("toy").topic_subscriber->subscribe(
+            "chatter", "test/Number", record_in(first_received), empty));
+  REQUIRE(second.at("toy").topic_subscriber->subscribe(
+            "chatter", "test/Number", record_in(second_received), empty));
+
+  // The middleware only gets subscribed to once
+  REQUIRE(system->subscriptions.size() == 1);
+
+  system->subscriptions[0](make_number(1));
+  system->subscriptions[0](make_number(2));
+  CHECK(first_received == std::vector<int>{1, 2});
+  CHECK(second_received == std::vector<int>{1, 2});
+
+  // An instance that has gone away stops receiving, while the others go on
+  soss::internal::SharedSystems::release(first);
+  CHECK(first.empty());
+  system->subscriptions[0](make_number(3));
+  CHECK(first_received == std::vector<int>{1, 2});
+  CHECK(second_received == std::vector<int>{1, 2, 3});
+
+  // The last instance may take the message
+  system->subscriptions[0](make_number(4));
+  CHECK(second_received == std::vector<int>{1, 2, 3, 4});
+}
+
+TEST_CASE("Shared subscriptions are released by the last instance",
+          "[shared_systems]")
+{
+  ToyFactory factory;
+  const YAML::Node config = YAML::Load("{shared: true, test: unsubscribe}");
+  const YAML::Node empty;
+
+  auto first = attach(factory, config);
+  ToySystem* const system = factory.last;
+  auto second = attach(factory, config);
+
+  int first_received = 0;
+  int second_received = 0;
+  REQUIRE(first.at("toy").topic_subscriber->subscribe(
+            "chatter", "test/Number",
+            [&](const soss::Message&) { ++first_received; }, empty));
+  REQUIRE(second.at("toy").topic_subscriber->subscribe(
+            "chatter", "test/Number",
+            [&](const soss::Message&) { ++second_received; }, empty));
+  REQUIRE(system->subscriptions.size() == 1);
+
+  // The middleware keeps its subscription while another instance uses it
+  CHECK(first.at("toy").topic_subscriber->unsubscribe(
+          "chatter", "test/Number", empty));
+  CHECK(system->unsubscribed == 0);
+  system->subscriptions[0](make_number(1));
+  CHECK(first_received == 0);
+  CHECK(second_received == 1);
+
+  // Nothing is left to take back from an instance that already let go
+  CHECK_FALSE(first.at("toy").topic_subscriber->unsubscribe(
+                "chatter", "test/Number", empty));
+
+  CHECK(second.at("toy").topic_subscriber->unsubscribe(
+          "chatter", "test/Number", empty));
+  CHECK(system->unsubscribed == 1);
+  CHECK(system->subscriptions.empty());
+
+  // Subscribing again asks the middleware again
+  REQUIRE(first.at("toy").topic_subscriber->subscribe(
+            "chatter", "test/Number",
+            [&](const soss::Message&) { ++first_received; }, empty));
+  REQUIRE(system->subscriptions.size() == 1);
+  system->subscriptions[0](make_number(2));
+  CHECK(first_received == 1);
+}
+
+TEST_CASE("Shared subscriptions are released when instances go away",
+          "[shared_systems]")
+{
+  ToyFactory factory;
+  const YAML::Node config = YAML::Load("{shared: true, test: abandon}");
+  const YAML::Node empty;
+
+  auto first = attach(factory, config);
+  ToySystem* const system = factory.last;
+  auto second = attach(factory, config);
+
+  int received = 0;
+  const auto count = [&](const soss::Message&) { ++received; };
+  REQUIRE(first.at("toy").topic_subscriber->subscribe(
+            "chatter", "test/Number", count, empty));
+  REQUIRE(first.at("toy").topic_subscriber->subscribe(
+            "chatter", "test/Number", count, empty));
+  REQUIRE(second.at("toy").topic_subscriber->subscribe(
+            "chatter", "test/Number", count, empty));
+  REQUIRE(first.at("toy").topic_subscriber->subscribe(
+            "status", "test/Number", count, empty));
+  REQUIRE(system->subscriptions.size() == 2);
+
+  // The topic that only the instance routed gets released, and the one that
+  // another instance still routes stays
+  soss::internal::SharedSystems::release(first);
+  CHECK(system->unsubscribed == 1);
+  REQUIRE(system->subscriptions.size() == 1);
+  system->subscriptions[0](make_number(1));
+  CHECK(received == 1);
+
+  // A new instance subscribes to the released topic again
+  auto third = attach(factory, config);
+  REQUIRE(third.at("toy").topic_subscriber->subscribe(
+            "status", "test/Number", count, empty));
+  CHECK(system->subscriptions.size() == 2);
+
+  soss::internal::SharedSystems::release(second);
+  soss::internal::SharedSystems::release(third);
+  CHECK(system->unsubscribed == 3);
+}
+
+TEST_CASE("Shared publishers outlive the proxies", "[shared_systems]")
+{
+  ToyFactory factory;
+  const YAML::Node config = YAML::Load("{shared: true, test: publishers}");
+  const YAML::Node empty;
+
+  auto first = attach(factory, config);
+  ToySystem* const system = factory.last;
+  auto second = attach(factory, config);
+
+  const auto publisher = first.at("toy").topic_publisher->advertise(
+        "chatter", "test/Number", empty);
+  const auto again = second.at("toy").topic_publisher->advertise(
+        "chatter", "test/Number", empty);
+  REQUIRE(publisher);
+  CHECK(again == publisher);
+  CHECK(system->advertised == 1);
+
+  // The routes of an instance may still hold a publisher after the instance
+  // has released its systems
+  first.clear();
+  second.clear();
+  CHECK(publisher->publish(make_number(5)));
+  CHECK(static_cast<RecordingPublisher&>(*publisher).published
+        == std::vector<int>{5});
+}
+
+TEST_CASE("Shared client proxies answer each request once", "[shared_systems]")
+{
+  ToyFactory factory;
+  const YAML::Node config = YAML::Load("{shared: true, test: clients}");
+  const YAML::Node empty;
+
+  auto first = attach(factory, config);
+  ToySystem* const system = factory.last;
+  auto second = attach(factory, config);
+
+  int first_requests = 0;
+  int second_requests = 0;
+  REQUIRE(first.at("toy").service_client->create_client_proxy(
+            "add", "test/Add",
+            [&](const soss::Message&, soss::ServiceClient&,
+                std::shared_ptr<void>) { ++first_requests; },
+            empty));
+  REQUIRE(second.at("toy").service_client->create_client_proxy(
+            "add", "test/Add",
+            [&](const soss::Message&, soss::ServiceClient&,
+                std::shared_ptr<void>) { ++second_requests; },
+            empty));
+  REQUIRE(system->clients.size() == 1);
+
+  // The topic system has no service providers, and neither does its proxy
+  CHECK_FALSE(first.at("toy").service_provider);
+
+  ToyClient client;
+  system->clients[0](make_number(1), client, nullptr);
+  CHECK(first_requests == 1);
+  CHECK(second_requests == 0);
+
+  soss::internal::SharedSystems::release(first);
+  system->clients[0](make_number(2), client, nullptr);
+  CHECK(first_requests == 1);
+  CHECK(second_requests == 1);
+
+  // Keep the system alive while nothing routes the service anymore
+  const auto publisher = second.at("toy").topic_publisher->advertise(
+        "chatter", "test/Number", empty);
+  soss::internal::SharedSystems::release(second);
+  system->clients[0](make_number(3), client, nullptr);
+  CHECK(client.errors.size() == 1);
+}
@@ -0,0 +1,134 @@
+/*
+ * Copyright (C) 2019 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+#include <soss/FieldToString.hpp>
+#include <soss/StringTemplate.hpp>
+#include <soss/utilities.hpp>
+
+#include <catch2/catch.hpp>
+
+#include <limits>
+
+namespace {
+soss::Message make_message(const int64_t id, const std::string& frame)
+{
+  soss::Message header;
+  header.data["frame_id"] = soss::Convert<std::string>::make_soss_field(frame);
+
+  soss::Message message;
+  message.data["header"] = soss::make_field<soss::Message>(std::move(header));
+  message.data["id"] = soss::Convert<int64_t>::make_soss_field(id);
+  return message;
+}
+} // anonymous namespace
+
+TEST_CASE("Templates substitute message fields", "[string_template][core]")
+{
+  const soss::StringTemplate topic(
+        "/robot_{message.id}/{message.header.frame_id}", "test");
+
+  CHECK(topic.compute_string(make_message(3, "map")) == "/robot_3/map");
+  CHECK(topic.compute_string(make_message(12, "odom")) == "/robot_12/odom");
+
+  const soss::StringTemplate copy = topic;
+  CHECK(copy.compute_string(make_message(3, "map")) == "/robot_3/map");
+
+  CHECK_THROWS_AS(
+        topic.compute_string(soss::Message()), soss::UnavailableMessageField);
+  CHECK_THROWS_AS(
+        soss::StringTemplate("/robot_{message.id", "test"),
+        soss::InvalidTemplateFormat);
+  CHECK_THROWS_AS(
+        soss::StringTemplate("/robot_{id}", "test"),
+        soss::InvalidTemplateFormat);
+}
+
+TEST_CASE("Template keys match their strings", "[string_template][core]")
+{
+  const soss::StringTemplate topic(
+        "/robot_{message.id}/{message.header.frame_id}", "test");
+
+  std::string key_a;
+  std::string key_b;
+  std::string key_c;
+  const std::size_t hash_a = topic.compute_key(make_message(3, "map"), key_a);
+  const std::size_t hash_b = topic.compute_key(make_message(3, "map"), key_b);
+  topic.compute_key(make_message(3, "mapx"), key_c);
+
+  CHECK(key_a == key_b);
+  CHECK(hash_a == hash_b);
+  CHECK(key_a != key_c);
+
+  int made = 0;
+  soss::StringTemplateCache<std::string> cache(topic);
+  const auto make = [&](const std::string& s) { ++made; return s; };
+  for(int64_t i=0; i < 100; ++i)
+    CHECK(cache.get(make_message(i, "map"), make)
+          == "/robot_" + std::to_string(i) + "/map");
+
+  for(int64_t i=0; i < 100; ++i)
+    CHECK(cache.get(make_message(i, "map"), make)
+          == "/robot_" + std::to_string(i) + "/map");
+
+  CHECK(made == 100);
+}
+
+TEST_CASE("Templates compute into a reused buffer", "[string_template][core]")
+{
+  const soss::StringTemplate topic("/{message.value}", "test");
+
+  const auto make = [](soss::Field field)
+  {
+    soss::Message message;
+    message.data["value"] = std::move(field);
+    return message;
+  };
+
+  std::string buffer = "leftover contents";
+  topic.compute_string(
+        make(soss::Convert<int64_t>::make_soss_field(0)), buffer);
+  CHECK(buffer == "/0");
+
+  const int64_t lowest = std::numeric_limits<int64_t>::lowest();
+  topic.compute_string(
+        make(soss::Convert<int64_t>::make_soss_field(lowest)), buffer);
+  CHECK(buffer == "/" + std::to_string(lowest));
+
+  topic.compute_string(
+        make(soss::Convert<int64_t>::make_soss_field(-42)), buffer);
+  CHECK(buffer == "/-42");
+
+  const uint64_t highest = std::numeric_limits<uint64_t>::max();
+  topic.compute_string(
+        make(soss::Convert<uint64_t>::make_soss_field(highest)), buffer);
+  CHECK(buffer == "/" + std::to_string(highest));
+
+  for(const double value : {0.0, -2.5, 1.0/3.0, 1e300})
+  {
+    topic.compute_string(
+          make(soss::Convert<double>::make_soss_field(value)), buffer);
+    CHECK(buffer == "/" + std::to_string(value));
+  }
+
+  const soss::Message message =
+      make(soss::Convert<uint64_t>::make_soss_field(12));
+  const soss::FieldToString converter("test");
+  CHECK(converter.to_string(message.data.find("value")) == "12");
+
+  std::string output = "id_";
+  converter.append(message.data.find("value"), output);
+  CHECK(output == "id_12");
+}
@@ -0,0 +1,84 @@
+/*
+ * Copyright (C) 2019 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include "TimerWheel.hpp"
+
+#include <catch2/catch.hpp>
+
+#include <atomic>
+#include <future>
+#include <mutex>
+#include <vector>
+
+using namespace std::chrono_literals;
+
+TEST_CASE("Timers fire in order once their delay has passed", "[timer]")
+{
+  // Use only a few slots, so that some timers are more than a revolution away
+  soss::internal::TimerWheel wheel(1ms, 4);
+
+  std::mutex mutex;
+  std::vector<int> fired;
+  std::promise<void> done;
+
+  const auto start = soss::internal::TimerWheel::Clock::now();
+  const auto record = [&](const int value)
+  {
+    return [&, value]()
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      fired.push_back(value);
+      if(fired.size() == 3)
+        done.set_value();
+    };
+  };
+
+  wheel.schedule(30ms, record(3));
+  wheel.schedule(2ms, record(1));
+  wheel.schedule(11ms, record(2));
+  CHECK(wheel.size() == 3);
+
+  REQUIRE(done.get_future().wait_for(5s) == std::future_status::ready);
+  CHECK(soss::internal::TimerWheel::Clock::now() - start >= 30ms);
+
+  std::unique_lock<std::mutex> lock(mutex);
+  CHECK(fired == (std::vector<int>{1, 2, 3}));
+  CHECK(wheel.size() == 0);
+}
+
+TEST_CASE("Cancelled timers never fire", "[timer]")
+{
+  soss::internal::TimerWheel wheel(1ms, 8);
+
+  std::atomic_bool cancelled_fired(false);
+  std::promise<void> done;
+
+  const auto id = wheel.schedule(5ms, [&]() { cancelled_fired = true; });
+  wheel.schedule(20ms, [&]() { done.set_value(); });
+
+  CHECK(wheel.cancel(id));
+  CHECK_FALSE(wheel.cancel(id));
+
+  REQUIRE(done.get_future().wait_for(5s) == std::future_status::ready);
+  CHECK_FALSE(cancelled_fired);
+
+  // Timers that have already fired cannot be cancelled anymore
+  std::promise<void> fired;
+  const auto late = wheel.schedule(1ms, [&]() { fired.set_value(); });
+  REQUIRE(fired.get_future().wait_for(5s) == std::future_status::ready);
+  CHECK_FALSE(wheel.cancel(late));
+}
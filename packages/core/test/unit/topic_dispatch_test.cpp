@@ -0,0 +1,141 @@
+/*
+ * Copyright (C) 2019 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include "TopicDispatch.hpp"
+#include "numbers.hpp"
+
+#include <soss/MessageEnvelope.hpp>
+#include <soss/utilities.hpp>
+
+#include <catch2/catch.hpp>
+
+#include <vector>
+
+namespace {
+
+//==============================================================================
+soss::Message make_status(const std::string& robot, const int value)
+{
+  soss::Message header;
+  header.type = "test/Header";
+  header.data["robot_id"] = soss::Convert<std::string>::make_soss_field(robot);
+
+  soss::Message message;
+  message.type = "test/Status";
+  message.data["header"] = soss::make_field<soss::Message>(header);
+  message.data["zone"] = soss::Convert<int>::make_soss_field(value % 2);
+  message.data["value"] = soss::Convert<int>::make_soss_field(value);
+  return message;
+}
+
+//==============================================================================
+class CountingPublisher : public soss::TopicPublisher
+{
+public:
+
+  bool publish(const soss::Message& /*message*/) override
+  {
+    ++published;
+    return true;
+  }
+
+  int published = 0;
+};
+
+using soss_test::RecordingPublisher;
+using Publishers = soss::internal::DispatchPublisher::Publishers;
+
+} // anonymous namespace
+
+TEST_CASE("Dispatched topics only reach the matching case", "[dispatch]")
+{
+  const auto robot_1 = std::make_shared<RecordingPublisher>();
+  const auto robot_2 = std::make_shared<RecordingPublisher>();
+  const auto monitor = std::make_shared<RecordingPublisher>();
+  const auto unknown = std::make_shared<RecordingPublisher>();
+
+  std::map<std::string, Publishers> cases;
+  cases["robot_1"] = {robot_1, monitor};
+  cases["robot_2"] = {robot_2};
+
+  soss::internal::DispatchPublisher dispatch(
+        "status", "header.robot_id", std::move(cases), {unknown},
+        soss::Metrics::topic("status"));
+
+  dispatch.publish(make_status("robot_1", 1));
+  dispatch.publish_owned(make_status("robot_2", 2));
+  dispatch.publish(make_status("robot_3", 3));
+  dispatch.publish_envelope(
+        soss::MessageEnvelope(make_status("robot_1", 4)));
+
+  // Messages without the field are not an error, they just match no case
+  soss::Message headless = make_status("robot_1", 5);
+  headless.data.erase(headless.data.find("header"));
+  dispatch.publish(headless);
+
+  dispatch.publish_batch({
+        std::make_shared<const soss::Message>(make_status("robot_2", 6)),
+        std::make_shared<const soss::Message>(make_status("robot_1", 7)),
+        std::make_shared<const soss::Message>(make_status("robot_2", 8))});
+
+  CHECK(robot_1->published == std::vector<int>({1, 4, 7}));
+  CHECK(monitor->published == std::vector<int>({1, 4, 7}));
+  CHECK(robot_2->published == std::vector<int>({2, 6, 8}));
+  CHECK(unknown->published == std::vector<int>({3, 5}));
+}
+
+TEST_CASE("Dispatch matches numeric fields by their text", "[dispatch]")
+{
+  const auto even = std::make_shared<RecordingPublisher>();
+
+  std::map<std::string, Publishers> cases;
+  cases["0"] = {even};
+
+  // Without a fallback, the messages that match no case get dropped
+  soss::internal::DispatchPublisher dispatch(
+        "zones", "zone", std::move(cases), {}, soss::Metrics::topic("zones"));
+
+  for(int i=0; i < 6; ++i)
+    CHECK(dispatch.publish(make_status("robot_1", i)));
+
+  CHECK(even->published == std::vector<int>({0, 2, 4}));
+}
+
+TEST_CASE("Messages without fields go to the fallback", "[dispatch]")
+{
+  // e.g. the serialized messages of ros2 that skip the conversion
+  struct Serialized : soss::NativeMessage { };
+
+  const auto robot_1 = std::make_shared<CountingPublisher>();
+  const auto unknown = std::make_shared<CountingPublisher>();
+
+  std::map<std::string, Publishers> cases;
+  cases["robot_1"] = {robot_1};
+
+  soss::internal::DispatchPublisher dispatch(
+        "status", "header.robot_id", std::move(cases), {unknown},
+        soss::Metrics::topic("status"));
+
+  soss::Message message;
+  message.type = "test/Status";
+  message.native = std::make_shared<Serialized>();
+  for(int i=0; i < 3; ++i)
+    CHECK(dispatch.publish(message));
+
+  CHECK(robot_1->published == 0);
+  CHECK(unknown->published == 3);
+}
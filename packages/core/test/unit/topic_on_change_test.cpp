@@ -0,0 +1,112 @@
+/*
+ * Copyright (C) 2019 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include "TopicOnChange.hpp"
+
+#include <soss/utilities.hpp>
+
+#include <catch2/catch.hpp>
+
+using namespace std::chrono_literals;
+
+namespace {
+
+//==============================================================================
+soss::Message make_state(const int mode, const int sequence)
+{
+  soss::Message message;
+  message.type = "test/State";
+  message.data["mode"] = soss::Convert<int>::make_soss_field(mode);
+  message.data["sequence"] = soss::Convert<int>::make_soss_field(sequence);
+  return message;
+}
+
+} // anonymous namespace
+
+TEST_CASE("Repeated messages get dropped", "[on_change]")
+{
+  soss::internal::TopicOnChangeConfig config;
+  config.enabled = true;
+  soss::internal::TopicOnChange on_change(config);
+
+  const auto start = soss::internal::TopicOnChange::Clock::now();
+  CHECK(on_change.admit(make_state(1, 1), start));
+  CHECK_FALSE(on_change.admit(make_state(1, 1), start + 1s));
+  CHECK_FALSE(on_change.admit(make_state(1, 1), start + 1h));
+
+  // Any change gets through, and becomes what the next messages are compared
+  // against
+  CHECK(on_change.admit(make_state(2, 1), start + 2h));
+  CHECK_FALSE(on_change.admit(make_state(2, 1), start + 3h));
+  CHECK(on_change.admit(make_state(1, 1), start + 4h));
+}
+
+TEST_CASE("Only the selected fields get compared", "[on_change]")
+{
+  soss::internal::TopicOnChangeConfig config;
+  config.enabled = true;
+  config.fields = {"mode"};
+  soss::internal::TopicOnChange on_change(config);
+
+  const auto start = soss::internal::TopicOnChange::Clock::now();
+  CHECK(on_change.admit(make_state(1, 1), start));
+  CHECK_FALSE(on_change.admit(make_state(1, 2), start));
+  CHECK_FALSE(on_change.admit(make_state(1, 3), start));
+  CHECK(on_change.admit(make_state(2, 4), start));
+}
+
+TEST_CASE("Repeats get through after the max silence", "[on_change]")
+{
+  soss::internal::TopicOnChangeConfig config;
+  config.enabled = true;
+  config.max_silence = 1s;
+  soss::internal::TopicOnChange on_change(config);
+
+  const auto start = soss::internal::TopicOnChange::Clock::now();
+  CHECK(on_change.admit(make_state(1, 1), start));
+  CHECK_FALSE(on_change.admit(make_state(1, 1), start + 500ms));
+  CHECK_FALSE(on_change.admit(make_state(1, 1), start + 999ms));
+  CHECK(on_change.admit(make_state(1, 1), start + 1s));
+
+  // The silence is measured from the keepalive
+  CHECK_FALSE(on_change.admit(make_state(1, 1), start + 1500ms));
+  CHECK(on_change.admit(make_state(1, 1), start + 2s));
+}
+
+TEST_CASE("Messages without fields always get through", "[on_change]")
+{
+  // e.g. the serialized messages of ros2 that skip the conversion
+  struct Serialized : soss::NativeMessage { };
+
+  soss::Message message;
+  message.type = "test/State";
+  message.native = std::make_shared<Serialized>();
+
+  soss::internal::TopicOnChangeConfig config;
+  config.enabled = true;
+  soss::internal::TopicOnChange on_change(config);
+
+  config.fields = {"mode"};
+  soss::internal::TopicOnChange on_mode_change(config);
+
+  const auto start = soss::internal::TopicOnChange::Clock::now();
+  for(int i=0; i < 3; ++i)
+  {
+    CHECK(on_change.admit(message, start));
+    CHECK(on_mode_change.admit(message, start));
+  }
+}
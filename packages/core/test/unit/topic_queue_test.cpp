@@ -0,0 +1,293 @@
+/*
+ * Copyright (C) 2019 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include "TopicQueue.hpp"
+#include "numbers.hpp"
+
+#include <soss/utilities.hpp>
+
+#include <catch2/catch.hpp>
+
+#include <future>
+#include <vector>
+
+namespace {
+
+using soss_test::make_number;
+using soss_test::value_of;
+
+//==============================================================================
+/// Run a queue whose sink stays blocked until release() gets called, so that
+/// the tests can fill up the queue behind the message that is being sunk.
+class StalledSink
+{
+public:
+
+  soss::internal::TopicQueue::Sink sink()
+  {
+    return [this](
+        std::shared_ptr<const soss::Message> message,
+        soss::internal::TopicQueue::Clock::time_point)
+    {
+      std::unique_lock<std::mutex> lock(_mutex);
+      if(_received.empty())
+        _first.set_value();
+
+      _received.push_back(value_of(*message));
+      _released.wait(lock, [&]() { return _release; });
+    };
+  }
+
+  soss::internal::TopicQueue::BatchSink batch_sink()
+  {
+    return [this](std::vector<soss::internal::TopicQueue::Entry>& batch)
+    {
+      std::unique_lock<std::mutex> lock(_mutex);
+      if(_received.empty())
+        _first.set_value();
+
+      _batches.push_back(batch.size());
+      for(const auto& entry : batch)
+        _received.push_back(value_of(*entry.message));
+
+      _released.wait(lock, [&]() { return _release; });
+    };
+  }
+
+  void wait_for_first()
+  {
+    _first.get_future().wait();
+  }
+
+  void release()
+  {
+    std::unique_lock<std::mutex> lock(_mutex);
+    _release = true;
+    _released.notify_all();
+  }
+
+  std::vector<int> received()
+  {
+    std::unique_lock<std::mutex> lock(_mutex);
+    return _received;
+  }
+
+  std::vector<std::size_t> batches()
+  {
+    std::unique_lock<std::mutex> lock(_mutex);
+    return _batches;
+  }
+
+private:
+
+  std::mutex _mutex;
+  std::condition_variable _released;
+  bool _release = false;
+  std::promise<void> _first;
+  std::vector<int> _received;
+  std::vector<std::size_t> _batches;
+
+};
+
+//==============================================================================
+std::vector<int> run_stalled_queue(
+    const soss::internal::TopicQueueConfig& config,
+    const std::size_t expected_count,
+    std::size_t& dropped,
+    std::shared_ptr<soss::Executor> executor = nullptr)
+{
+  StalledSink stalled;
+  const auto queue = std::make_shared<soss::internal::TopicQueue>(
+        "test", config, stalled.sink(), soss::Metrics::topic("test"),
+        std::move(executor));
+
+  queue->push(make_number(0));
+  stalled.wait_for_first();
+
+  for(int i=1; i <= 5; ++i)
+    queue->push(make_number(i));
+
+  dropped = queue->dropped();
+
+  stalled.release();
+  const auto deadline =
+      std::chrono::steady_clock::now() + std::chrono::seconds(5);
+  while(stalled.received().size() < expected_count
+        && std::chrono::steady_clock::now() < deadline)
+  {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+
+  queue->stop();
+  return stalled.received();
+}
+
+} // anonymous namespace
+
+TEST_CASE("Bounded topic queues apply their policy", "[queue][core]")
+{
+  using Policy = soss::internal::TopicQueueConfig::Policy;
+  soss::internal::TopicQueueConfig config;
+  config.depth = 2;
+  std::size_t dropped = 0;
+
+  SECTION("drop_oldest")
+  {
+    config.policy = Policy::DropOldest;
+    CHECK(run_stalled_queue(config, 3, dropped) == std::vector<int>({0, 4, 5}));
+    CHECK(dropped == 3);
+  }
+
+  SECTION("drop_newest")
+  {
+    config.policy = Policy::DropNewest;
+    CHECK(run_stalled_queue(config, 3, dropped) == std::vector<int>({0, 1, 2}));
+    CHECK(dropped == 3);
+  }
+
+  SECTION("keep_latest")
+  {
+    config.policy = Policy::KeepLatest;
+    CHECK(run_stalled_queue(config, 2, dropped) == std::vector<int>({0, 5}));
+    CHECK(dropped == 4);
+  }
+}
+
+TEST_CASE("Topic queues can drain on an executor", "[queue][core]")
+{
+  using Policy = soss::internal::TopicQueueConfig::Policy;
+  soss::internal::TopicQueueConfig config;
+  config.depth = 2;
+  std::size_t dropped = 0;
+
+  const auto executor = std::make_shared<soss::Executor>(2);
+
+  config.policy = Policy::DropOldest;
+  CHECK(run_stalled_queue(config, 3, dropped, executor)
+        == std::vector<int>({0, 4, 5}));
+  CHECK(dropped == 3);
+
+  config.policy = Policy::DropNewest;
+  CHECK(run_stalled_queue(config, 3, dropped, executor)
+        == std::vector<int>({0, 1, 2}));
+  CHECK(dropped == 3);
+}
+
+TEST_CASE("Blocking topic queues hold back the subscriber", "[queue][core]")
+{
+  soss::internal::TopicQueueConfig config;
+  config.depth = 1;
+  config.policy = soss::internal::TopicQueueConfig::Policy::Block;
+
+  StalledSink stalled;
+  soss::internal::TopicQueue queue(
+        "test", config, stalled.sink(), soss::Metrics::topic("test"));
+
+  queue.push(make_number(0));
+  stalled.wait_for_first();
+  queue.push(make_number(1));
+
+  auto blocked = std::async(std::launch::async, [&]()
+  {
+    queue.push(make_number(2));
+  });
+
+  CHECK(blocked.wait_for(std::chrono::milliseconds(50))
+        == std::future_status::timeout);
+
+  // Stopping the queue must release the blocked subscriber
+  stalled.release();
+  queue.stop();
+  CHECK(blocked.wait_for(std::chrono::seconds(5))
+        == std::future_status::ready);
+  CHECK(queue.dropped() == 0);
+}
+
+TEST_CASE("Topic queues deliver bursts in batches", "[queue][core]")
+{
+  soss::internal::TopicQueueConfig config;
+  config.depth = 10;
+  config.batch = 3;
+
+  StalledSink stalled;
+  soss::internal::TopicQueue queue(
+        "test", config, stalled.batch_sink(), soss::Metrics::topic("test"));
+
+  queue.push(make_number(0));
+  stalled.wait_for_first();
+
+  for(int i=1; i <= 5; ++i)
+    queue.push(make_number(i));
+
+  stalled.release();
+  const auto deadline =
+      std::chrono::steady_clock::now() + std::chrono::seconds(5);
+  while(stalled.received().size() < 6
+        && std::chrono::steady_clock::now() < deadline)
+  {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+
+  queue.stop();
+  CHECK(stalled.received() == std::vector<int>({0, 1, 2, 3, 4, 5}));
+  CHECK(stalled.batches() == std::vector<std::size_t>({1, 3, 2}));
+  CHECK(queue.dropped() == 0);
+}
+
+TEST_CASE("Topic queues stay within their memory budget", "[queue][core]")
+{
+  using Policy = soss::internal::TopicQueueConfig::Policy;
+  soss::internal::TopicQueueConfig config;
+  config.depth = 10;
+  std::size_t dropped = 0;
+
+  // Every message of the test has the same footprint
+  const std::size_t footprint = soss::memory_footprint(make_number(0));
+  CHECK(footprint >= sizeof(soss::Message));
+  const std::size_t baseline = soss::Metrics::memory_bytes();
+
+  SECTION("queue budget")
+  {
+    config.memory_budget = 2*footprint;
+
+    config.policy = Policy::DropOldest;
+    CHECK(run_stalled_queue(config, 3, dropped) == std::vector<int>({0, 4, 5}));
+    CHECK(dropped == 3);
+
+    config.policy = Policy::DropNewest;
+    CHECK(run_stalled_queue(config, 3, dropped) == std::vector<int>({0, 1, 2}));
+    CHECK(dropped == 3);
+  }
+
+  SECTION("process budget")
+  {
+    soss::Metrics::set_memory_budget(baseline + 2*footprint);
+
+    config.policy = Policy::DropOldest;
+    CHECK(run_stalled_queue(config, 3, dropped) == std::vector<int>({0, 4, 5}));
+    CHECK(dropped == 3);
+
+    config.policy = Policy::DropNewest;
+    CHECK(run_stalled_queue(config, 3, dropped) == std::vector<int>({0, 1, 2}));
+    CHECK(dropped == 3);
+
+    soss::Metrics::set_memory_budget(0);
+  }
+
+  // The queues give back all of their memory once they are stopped
+  CHECK(soss::Metrics::memory_bytes() == baseline);
+}
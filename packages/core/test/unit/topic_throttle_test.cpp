@@ -0,0 +1,98 @@
+/*
+ * Copyright (C) 2019 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include "TopicThrottle.hpp"
+#include "numbers.hpp"
+
+#include <soss/utilities.hpp>
+
+#include <catch2/catch.hpp>
+
+#include <vector>
+
+using namespace std::chrono_literals;
+using soss_test::make_number;
+using soss_test::RecordingPublisher;
+
+TEST_CASE("Decimation keeps every nth message", "[throttle]")
+{
+  soss::internal::TopicThrottleConfig config;
+  config.decimate = 3;
+  REQUIRE(config.enabled());
+
+  auto recorder = std::make_shared<RecordingPublisher>();
+  soss::internal::ThrottledPublisher publisher(recorder, config);
+
+  for(int i=0; i < 7; ++i)
+    CHECK(publisher.publish(make_number(i)));
+
+  CHECK(recorder->published == (std::vector<int>{0, 3, 6}));
+
+  std::vector<std::shared_ptr<const soss::Message>> batch;
+  for(int i=7; i < 10; ++i)
+    batch.push_back(std::make_shared<const soss::Message>(make_number(i)));
+
+  CHECK(publisher.publish_batch(batch));
+  CHECK(recorder->published == (std::vector<int>{0, 3, 6, 9}));
+}
+
+TEST_CASE("Rate limits keep to their schedule", "[throttle]")
+{
+  soss::internal::TopicThrottleConfig config;
+  config.rate = 100.0;
+  soss::internal::TopicThrottle throttle(config);
+
+  // 1000 messages per second with some jitter get cut down to 100 per second
+  const auto start = soss::internal::TopicThrottle::Clock::now();
+  std::size_t admitted = 0;
+  for(int i=0; i < 1000; ++i)
+  {
+    const auto jitter = std::chrono::microseconds((i*37) % 300);
+    if(throttle.admit(start + i*1ms + jitter))
+      ++admitted;
+  }
+
+  CHECK(admitted >= 99);
+  CHECK(admitted <= 101);
+
+  // After a pause, the next message goes through right away, but the schedule
+  // does not let a burst make up for the pause.
+  const auto later = start + 10s;
+  CHECK(throttle.admit(later));
+  CHECK_FALSE(throttle.admit(later + 1ms));
+  CHECK_FALSE(throttle.admit(later + 9ms));
+  CHECK(throttle.admit(later + 10ms));
+}
+
+TEST_CASE("Rate limits and decimation combine", "[throttle]")
+{
+  soss::internal::TopicThrottleConfig config;
+  config.rate = 10.0;
+  config.decimate = 2;
+  soss::internal::TopicThrottle throttle(config);
+
+  const auto start = soss::internal::TopicThrottle::Clock::now();
+  CHECK(throttle.admit(start));
+  CHECK_FALSE(throttle.admit(start + 200ms));
+  CHECK(throttle.admit(start + 300ms));
+
+  // This would be the next decimated message, but it comes too soon
+  CHECK_FALSE(throttle.admit(start + 310ms));
+  CHECK_FALSE(throttle.admit(start + 320ms));
+  CHECK_FALSE(throttle.admit(start + 330ms));
+  CHECK(throttle.admit(start + 400ms));
+}
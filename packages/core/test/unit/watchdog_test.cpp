@@ -0,0 +1,88 @@
+/*
+ * Copyright (C) 2019 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include "Watchdog.hpp"
+
+#include <soss/Metrics.hpp>
+
+#include <catch2/catch.hpp>
+
+#include <thread>
+
+namespace {
+
+//==============================================================================
+bool has_line(const std::string& text, const std::string& line)
+{
+  return text.find("\n" + line + "\n") != std::string::npos;
+}
+
+} // anonymous namespace
+
+TEST_CASE("The watchdog reports workers that get stuck", "[watchdog][core]")
+{
+  using soss::internal::Watchdog;
+  Watchdog::get().configure(std::chrono::milliseconds(20), true);
+
+  {
+    soss::internal::Heartbeat heartbeat("stuck-worker");
+
+    heartbeat.busy();
+    Watchdog::get().check();
+    CHECK(has_line(soss::Metrics::to_prometheus(),
+                   "soss_thread_stalls_total{thread=\"stuck-worker\"} 0"));
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(40));
+    Watchdog::get().check();
+    Watchdog::get().check();
+
+    // The same stall only gets counted once
+    std::string text = soss::Metrics::to_prometheus();
+    CHECK(has_line(text,
+                   "soss_thread_stalls_total{thread=\"stuck-worker\"} 1"));
+    CHECK_FALSE(has_line(text,
+                   "soss_thread_stall_seconds{thread=\"stuck-worker\"} 0"));
+
+    heartbeat.idle();
+    Watchdog::get().check();
+    text = soss::Metrics::to_prometheus();
+    CHECK(has_line(text,
+                   "soss_thread_stall_seconds{thread=\"stuck-worker\"} 0"));
+    CHECK(has_line(text,
+                   "soss_thread_stalls_total{thread=\"stuck-worker\"} 1"));
+  }
+
+  // The metrics of a worker go away along with it
+  CHECK(soss::Metrics::to_prometheus().find("stuck-worker")
+        == std::string::npos);
+
+  // Threads without a heartbeat of their own get one while they deliver
+  std::string text;
+  std::thread delivery([&]()
+  {
+    const soss::internal::RouteActivity activity("stuck_route");
+    std::this_thread::sleep_for(std::chrono::milliseconds(40));
+    Watchdog::get().check();
+    text = soss::Metrics::to_prometheus();
+  });
+  delivery.join();
+
+  CHECK(text.find("soss_thread_stalls_total") != std::string::npos);
+  CHECK(text.find("} 1\n") != std::string::npos);
+
+  Watchdog::get().configure(std::chrono::seconds(1), false);
+}
@@ -0,0 +1,223 @@
+/*
+ * Copyright (C) 2019 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+
+#include <soss/json/conversion.hpp>
+#include <soss/json/sax.hpp>
+#include <soss/utilities.hpp>
+
+#include <benchmark/benchmark.h>
+
+namespace {
+
+//==============================================================================
+/// Shaped like the prototype test_msgs/Primitives
+soss::Message make_primitives()
+{
+  soss::Message message;
+  message.type = "test_msgs/Primitives";
+  message.data["bool_value"] = soss::Convert<bool>::make_soss_field(true);
+  message.data["byte_value"] = soss::Convert<uint8_t>::make_soss_field(1);
+  message.data["char_value"] = soss::Convert<uint8_t>::make_soss_field('a');
+  message.data["float32_value"] = soss::Convert<float>::make_soss_field(1.5f);
+  message.data["float64_value"] = soss::Convert<double>::make_soss_field(2.25);
+  message.data["int8_value"] = soss::Convert<int8_t>::make_soss_field(-8);
+  message.data["uint8_value"] = soss::Convert<uint8_t>::make_soss_field(8);
+  message.data["int16_value"] = soss::Convert<int16_t>::make_soss_field(-16);
+  message.data["uint16_value"] = soss::Convert<uint16_t>::make_soss_field(16);
+  message.data["int32_value"] = soss::Convert<int32_t>::make_soss_field(-32);
+  message.data["uint32_value"] = soss::Convert<uint32_t>::make_soss_field(32);
+  message.data["int64_value"] = soss::Convert<int64_t>::make_soss_field(-64);
+  message.data["uint64_value"] = soss::Convert<uint64_t>::make_soss_field(64);
+  message.data["string_value"] = soss::Convert<std::string>::make_soss_field(
+        "a string that does not fit in place");
+  return message;
+}
+
+//==============================================================================
+soss::Message make_header(const int64_t sec)
+{
+  soss::Message stamp;
+  stamp.type = "builtin_interfaces/Time";
+  stamp.data["sec"] = soss::Convert<int64_t>::make_soss_field(sec);
+  stamp.data["nanosec"] = soss::Convert<uint64_t>::make_soss_field(0);
+
+  soss::Message header;
+  header.type = "std_msgs/Header";
+  header.data["frame_id"] = soss::Convert<std::string>::make_soss_field("map");
+  header.data["stamp"] = soss::make_field<soss::Message>(std::move(stamp));
+  return header;
+}
+
+//==============================================================================
+/// Shaped like a nav_msgs/Path
+soss::Message make_path(const std::size_t size)
+{
+  std::vector<soss::Message> poses;
+  poses.reserve(size);
+  for(std::size_t i=0; i < size; ++i)
+  {
+    soss::Message position;
+    position.type = "geometry_msgs/Point";
+    position.data["x"] = soss::Convert<double>::make_soss_field(i*1.0);
+    position.data["y"] = soss::Convert<double>::make_soss_field(i*0.5);
+    position.data["z"] = soss::Convert<double>::make_soss_field(0.0);
+
+    soss::Message orientation;
+    orientation.type = "geometry_msgs/Quaternion";
+    orientation.data["x"] = soss::Convert<double>::make_soss_field(0.0);
+    orientation.data["y"] = soss::Convert<double>::make_soss_field(0.0);
+    orientation.data["z"] = soss::Convert<double>::make_soss_field(0.0);
+    orientation.data["w"] = soss::Convert<double>::make_soss_field(1.0);
+
+    soss::Message pose;
+    pose.type = "geometry_msgs/Pose";
+    pose.data["position"] = soss::make_field<soss::Message>(std::move(position));
+    pose.data["orientation"] =
+        soss::make_field<soss::Message>(std::move(orientation));
+
+    soss::Message stamped;
+    stamped.type = "geometry_msgs/PoseStamped";
+    stamped.data["header"] = soss::make_field<soss::Message>(
+          make_header(static_cast<int64_t>(i)));
+    stamped.data["pose"] = soss::make_field<soss::Message>(std::move(pose));
+    poses.push_back(std::move(stamped));
+  }
+
+  soss::Message path;
+  path.type = "nav_msgs/Path";
+  path.data["header"] = soss::make_field<soss::Message>(make_header(0));
+  path.data["poses"] =
+      soss::make_field<std::vector<soss::Message>>(std::move(poses));
+  return path;
+}
+
+//==============================================================================
+/// Shaped like a message with a 1 MB uint8[] field
+soss::Message make_bytes()
+{
+  soss::Message message;
+  message.type = "test_msgs/Bytes";
+  message.data["data"] = soss::Convert<std::vector<uint8_t>>::make_soss_field(
+        std::vector<uint8_t>(1024*1024, 0x5A));
+  return message;
+}
+
+//==============================================================================
+soss::Message make_payload(const int64_t shape)
+{
+  switch(shape)
+  {
+    case 0: return make_primitives();
+    case 1: return make_path(10000);
+    default: return make_bytes();
+  }
+}
+
+//==============================================================================
+void name_payload(benchmark::State& state)
+{
+  const char* const names[] = {"Primitives", "Path", "Bytes"};
+  state.SetLabel(names[std::min<int64_t>(state.range(0), 2)]);
+}
+
+//==============================================================================
+void soss_to_json(benchmark::State& state)
+{
+  name_payload(state);
+  const soss::Message message = make_payload(state.range(0));
+  for(auto _ : state)
+    benchmark::DoNotOptimize(soss::json::convert(message));
+}
+BENCHMARK(soss_to_json)->DenseRange(0, 2)->Unit(benchmark::kMicrosecond);
+
+//==============================================================================
+void soss_to_json_with_precision(benchmark::State& state)
+{
+  name_payload(state);
+  const soss::Message message = make_payload(state.range(0));
+  for(auto _ : state)
+    benchmark::DoNotOptimize(soss::json::convert(message, 4));
+}
+BENCHMARK(soss_to_json_with_precision)->Arg(1)->Unit(benchmark::kMicrosecond);
+
+//==============================================================================
+void soss_to_text(benchmark::State& state)
+{
+  name_payload(state);
+  const soss::Message message = make_payload(state.range(0));
+  std::size_t bytes = 0;
+  for(auto _ : state)
+  {
+    const std::string text = soss::json::convert(message).dump();
+    bytes += text.size();
+    benchmark::DoNotOptimize(text);
+  }
+
+  state.SetBytesProcessed(static_cast<int64_t>(bytes));
+}
+BENCHMARK(soss_to_text)->DenseRange(0, 2)->Unit(benchmark::kMicrosecond);
+
+//==============================================================================
+void json_to_soss(benchmark::State& state)
+{
+  name_payload(state);
+  const soss::Message message = make_payload(state.range(0));
+  const soss::json::Json json = soss::json::convert(message);
+  for(auto _ : state)
+    benchmark::DoNotOptimize(soss::json::convert(message.type, json));
+}
+BENCHMARK(json_to_soss)->DenseRange(0, 2)->Unit(benchmark::kMicrosecond);
+
+//==============================================================================
+/// Parsing text into a Json tree and then converting the tree
+void text_to_soss_by_tree(benchmark::State& state)
+{
+  name_payload(state);
+  const soss::Message message = make_payload(state.range(0));
+  const std::string text = soss::json::convert(message).dump();
+  for(auto _ : state)
+  {
+    benchmark::DoNotOptimize(
+          soss::json::convert(message.type, soss::json::Json::parse(text)));
+  }
+
+  state.SetBytesProcessed(
+        static_cast<int64_t>(state.iterations()*text.size()));
+}
+BENCHMARK(text_to_soss_by_tree)->DenseRange(0, 2)->Unit(benchmark::kMicrosecond);
+
+//==============================================================================
+/// Parsing text straight into a soss::Message
+void text_to_soss_by_sax(benchmark::State& state)
+{
+  name_payload(state);
+  const soss::Message message = make_payload(state.range(0));
+  const std::string text = soss::json::convert(message).dump();
+  for(auto _ : state)
+  {
+    soss::json::MessageBuilder builder(message.type);
+    soss::json::Json::sax_parse(text, &builder);
+    benchmark::DoNotOptimize(builder.take());
+  }
+
+  state.SetBytesProcessed(
+        static_cast<int64_t>(state.iterations()*text.size()));
+}
+BENCHMARK(text_to_soss_by_sax)->DenseRange(0, 2)->Unit(benchmark::kMicrosecond);
+
+} // anonymous namespace
@@ -28,9 +28,17 @@ namespace json {
 using Json = nlohmann::json;
 
 //==============================================================================
-/// Convert from a soss message to a JSON message
+/// Convert from a soss message to a JSON message. If the message has a
+/// NativeJson attached to it (see soss/json/native.hpp), that will be used
+/// instead of the fields of the message.
 Json SOSS_JSON_API convert(const soss::Message& input);
 
+/// Same as convert(const soss::Message&), except floating point values get
+/// rounded to the given number of significant digits, which makes them much
+/// shorter to write out. A precision of zero leaves them exact. This does not
+/// apply to messages that are written from their NativeJson.
+Json SOSS_JSON_API convert(const soss::Message& input, int precision);
+
 /// Convert from a JSON message to a soss message
 soss::Message SOSS_JSON_API convert(const std::string& type, const Json& input);
 
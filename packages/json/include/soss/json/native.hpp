@@ -0,0 +1,101 @@
+/*
+ * Copyright (C) 2019 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#ifndef SOSS__JSON__NATIVE_HPP
+#define SOSS__JSON__NATIVE_HPP
+
+#include <soss/json/conversion.hpp>
+#include <soss/utilities.hpp>
+
+#include <array>
+#include <vector>
+
+namespace soss {
+namespace json {
+
+//==============================================================================
+/// NativeJson is a NativeMessage that can write itself straight into JSON.
+/// When one of these is attached to a soss::Message, soss::json::convert(~)
+/// uses it instead of walking the fields of the message.
+class SOSS_JSON_API NativeJson : public virtual soss::NativeMessage
+{
+public:
+
+  /// \brief Write this message into output. This must produce exactly what
+  /// soss::json::convert(~) would produce for the equivalent soss::Message.
+  virtual void to_json(Json& output) const = 0;
+
+  ~NativeJson() override;
+
+};
+
+//==============================================================================
+/// ToJson writes a native value straight into a Json value, using the same
+/// representation that soss::Convert gives to that type, e.g. booleans and
+/// small integers are widened to 64 bits and floats become doubles.
+///
+/// Code generators should specialize this for their compound message types.
+template<typename T>
+struct ToJson
+{
+  static void convert(const T& from, Json& to)
+  {
+    to = static_cast<typename soss::Convert<T>::soss_type>(from);
+  }
+};
+
+//==============================================================================
+/// Write any container of native values into a Json array
+template<typename ElementType, typename Container>
+void container_to_json(const Container& from, Json& to)
+{
+  to = Json::array();
+  Json::array_t& array = to.get_ref<Json::array_t&>();
+  array.resize(from.size());
+
+  // We use operator[] instead of iterating so that std::vector<bool> elements
+  // can be passed along as plain bools.
+  for(std::size_t i=0; i < from.size(); ++i)
+    ToJson<ElementType>::convert(from[i], array[i]);
+}
+
+//==============================================================================
+template<typename ElementType, typename Allocator>
+struct ToJson<std::vector<ElementType, Allocator>>
+{
+  static void convert(
+      const std::vector<ElementType, Allocator>& from,
+      Json& to)
+  {
+    container_to_json<ElementType>(from, to);
+  }
+};
+
+//==============================================================================
+template<typename ElementType, std::size_t N>
+struct ToJson<std::array<ElementType, N>>
+{
+  static void convert(const std::array<ElementType, N>& from, Json& to)
+  {
+    container_to_json<ElementType>(from, to);
+  }
+};
+
+} // namespace json
+} // namespace soss
+
+#endif // SOSS__JSON__NATIVE_HPP
@@ -0,0 +1,80 @@
+/*
+ * Copyright (C) 2019 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#ifndef SOSS__JSON__SAX_HPP
+#define SOSS__JSON__SAX_HPP
+
+#include <soss/json/conversion.hpp>
+
+#include <memory>
+
+namespace soss {
+namespace json {
+
+//==============================================================================
+/// MessageBuilder is a SAX handler that builds a soss::Message straight from
+/// the parsing events of a JSON object, without creating an intermediate Json
+/// tree. It follows the same rules as soss::json::convert(~), so both of them
+/// produce identical messages from the same input.
+///
+/// The builder can be given to Json::sax_parse(~) directly, or another SAX
+/// handler may forward to it the events of an object that is nested inside of
+/// a larger document. It is finished as soon as the object that it began with
+/// has ended.
+///
+/// Errors in the input are reported by throwing std::runtime_error.
+class SOSS_JSON_API MessageBuilder : public nlohmann::json_sax<Json>
+{
+public:
+
+  /// \brief Construct a builder for a message of the given type
+  MessageBuilder(const std::string& type = "");
+
+  /// \brief True once the object that this builder began with has ended
+  bool finished() const;
+
+  /// \brief Take the message that was built. This may only be called once the
+  /// builder has finished.
+  soss::Message take();
+
+  bool null() override;
+  bool boolean(bool val) override;
+  bool number_integer(number_integer_t val) override;
+  bool number_unsigned(number_unsigned_t val) override;
+  bool number_float(number_float_t val, const string_t& s) override;
+  bool string(string_t& val) override;
+  bool start_object(std::size_t elements) override;
+  bool key(string_t& val) override;
+  bool end_object() override;
+  bool start_array(std::size_t elements) override;
+  bool end_array() override;
+  bool parse_error(
+      std::size_t position,
+      const std::string& last_token,
+      const nlohmann::detail::exception& ex) override;
+
+  ~MessageBuilder();
+
+  class Implementation;
+private:
+  std::unique_ptr<Implementation> _pimpl;
+};
+
+} // namespace json
+} // namespace soss
+
+#endif // SOSS__JSON__SAX_HPP
@@ -16,15 +16,22 @@
 */
 
 #include <soss/json/conversion.hpp>
+#include <soss/json/native.hpp>
 #include <soss/utilities.hpp>
 
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <limits>
+#include <string>
 #include <unordered_map>
 
 namespace soss {
 namespace json {
 
-using field_iterator = std::map<std::string, Field>::iterator;
-using const_field_iterator = std::map<std::string, Field>::const_iterator;
+using field_iterator = soss::Message::iterator;
+using const_field_iterator = soss::Message::const_iterator;
 
 using nlohmann::detail::value_t;
 
@@ -38,16 +45,83 @@ using ToSossArrayMap =
       value_t,
       std::function<Field(const Json& input)>>;
 
-using ToJsonMap =
-  std::unordered_map<
-      std::string,
-      std::function<Json(const const_field_iterator& input)>>;
-
 using ToStringMap =
   std::unordered_map<
       value_t,
       std::function<std::string(const Json& input)>>;
 
+namespace {
+
+//==============================================================================
+/// Find the double with the shortest decimal representation that still reads
+/// back as the given value, optionally rounded to some significant digits. A
+/// float that gets widened to a double keeps all of the noise of its binary
+/// representation, e.g. 0.1f becomes 0.10000000149011612, whereas this gives
+/// 0.1 back.
+template<typename FloatType>
+double shortest_decimal(const FloatType value, const int precision)
+{
+  if(!std::isfinite(value) || value == 0)
+    return static_cast<double>(value);
+
+  const int max_digits = std::numeric_limits<FloatType>::max_digits10;
+  const int digits =
+      precision > 0? std::min(precision, max_digits) : max_digits;
+
+  // Any normal value that reads back from fewer than digits10 digits is also
+  // printed that way by %g at digits10, so shorter lengths only need to be
+  // tried for subnormal values, which have fewer digits of precision.
+  const int min_digits =
+      std::abs(value) < std::numeric_limits<FloatType>::min()?
+        1 : std::numeric_limits<FloatType>::digits10;
+
+  // At most max_digits10 digits, a sign, a point and an exponent like e-308
+  char text[32];
+  const auto print = [&](const int length)
+  {
+    const int written = std::snprintf(
+          text, sizeof(text), "%.*g", length, static_cast<double>(value));
+    return 0 < written && written < static_cast<int>(sizeof(text));
+  };
+
+  for(int length = std::min(min_digits, digits); length < digits; ++length)
+  {
+    if(!print(length))
+      break;
+
+    const double result = std::strtod(text, nullptr);
+    if(static_cast<FloatType>(result) == value)
+      return result;
+  }
+
+  if(!print(digits))
+    return static_cast<double>(value);
+
+  return std::strtod(text, nullptr);
+}
+
+//==============================================================================
+template<typename T>
+Json number_to_json(const T& value, int /*precision*/)
+{
+  return Json(value);
+}
+
+Json number_to_json(const double value, const int precision)
+{
+  if(precision <= 0)
+    return Json(value);
+
+  return Json(shortest_decimal(value, precision));
+}
+
+Json number_to_json(const float value, const int precision)
+{
+  return Json(shortest_decimal(value, precision));
+}
+
+} // anonymous namespace
+
 //==============================================================================
 struct Converter
 {
@@ -82,16 +156,6 @@ struct Converter
       convert_from_json_object(input, output);
       return soss::make_field<soss::Message>(std::move(output));
     };
-
-    map_to_json[typeid(soss::Message).name()] =
-        [](const const_field_iterator& input) -> Json
-    {
-      const soss::Message& from_msg = *input->second.cast<soss::Message>();
-
-      Json output;
-      convert_from_soss_message(from_msg, output);
-      return output;
-    };
   }
 
   void add_array_conversions()
@@ -170,9 +234,6 @@ struct Converter
     add_primitive_array_conversion<int64_t>(value_t::number_integer);
     add_primitive_array_conversion<uint64_t>(value_t::number_unsigned);
     add_primitive_array_conversion<double>(value_t::number_float);
-
-    // Note: the map_to_json will be filled in by the individual
-    // add_*_array_conversion functions.
   }
 
   template<typename T>
@@ -183,14 +244,6 @@ struct Converter
     {
       return soss::Convert<T>::make_soss_field(input.get<T>());
     };
-
-    map_to_json[typeid(T).name()] =
-        [](const const_field_iterator& input) -> Json
-    {
-      T output;
-      soss::Convert<T>::from_soss_field(input, output);
-      return Json(output);
-    };
   }
 
   template<typename JsonT, typename SossT=JsonT>
@@ -208,20 +261,6 @@ struct Converter
 
       return soss::Convert<std::vector<SossT>>::make_soss_field(output);
     };
-
-    map_to_json[typeid(std::vector<SossT>).name()] =
-        [](const const_field_iterator& input) -> Json
-    {
-      std::vector<SossT> content;
-      soss::Convert<std::vector<SossT>>::from_soss_field(input, content);
-
-      std::vector<JsonT> output;
-      output.reserve(content.size());
-      for(const SossT& c : content)
-        output.push_back(static_cast<JsonT>(c));
-
-      return Json(output);
-    };
   }
 
   void add_object_array_conversion()
@@ -241,20 +280,6 @@ struct Converter
       return soss::Convert<std::vector<soss::Message>>
               ::make_soss_field(std::move(output));
     };
-
-    map_to_json[typeid(std::vector<soss::Message>).name()] =
-        [](const const_field_iterator& input) -> Json
-    {
-      const std::vector<soss::Message>& input_array =
-          *input->second.cast<std::vector<soss::Message>>();
-
-      std::vector<Json> output;
-      output.resize(input_array.size());
-      for(std::size_t i = 0; i < input_array.size(); ++i)
-        convert_from_soss_message(input_array[i], output[i]);
-
-      return Json(output);
-    };
   }
 
   void add_string_forwarding()
@@ -278,6 +303,7 @@ struct Converter
 
   static void convert_from_json_object(const Json& input, soss::Message& output)
   {
+    output.data.reserve(input.size());
     for(Json::const_iterator it = input.begin(); it != input.end(); ++it)
     {
       const auto& conversion = instance().map_to_soss.at(it.value().type());
@@ -285,26 +311,132 @@ struct Converter
     }
   }
 
-  static void convert_from_soss_message(const soss::Message& input, Json& output)
+  template<typename T>
+  static Json primitive_to_json(const Field& input, const int precision)
   {
-    for(const_field_iterator it = input.data.begin(); it != input.data.end(); ++it)
+    return number_to_json(*input.cast<T>(), precision);
+  }
+
+  template<typename T>
+  static Json array_to_json(const Field& input, const int precision)
+  {
+    const std::vector<T>& content = *input.cast<std::vector<T>>();
+    Json output = Json::array();
+    Json::array_t& array = output.get_ref<Json::array_t&>();
+    array.reserve(content.size());
+    for(const T& c : content)
+      array.emplace_back(number_to_json(c, precision));
+
+    return output;
+  }
+
+  static Json field_to_json(const Field& input, const int precision)
+  {
+    // Dispatch on the tag of the field, so that we never need to compare the
+    // names of types
+    switch(input.type_tag())
     {
-      const std::string& key = it->first;
-      const Field& value = it->second;
+      case FieldTypeTag::String:
+        return primitive_to_json<std::string>(input, precision);
+      case FieldTypeTag::Bool:
+        return primitive_to_json<bool>(input, precision);
+      case FieldTypeTag::Int64:
+        return primitive_to_json<int64_t>(input, precision);
+      case FieldTypeTag::UInt64:
+        return primitive_to_json<uint64_t>(input, precision);
+      case FieldTypeTag::Double:
+        return primitive_to_json<double>(input, precision);
+
+      case FieldTypeTag::Message:
+      {
+        Json output;
+        convert_from_soss_message(
+            *input.cast<soss::Message>(), output, precision);
+        return output;
+      }
 
-      const auto& conversion = instance().map_to_json.at(value.type());
+      case FieldTypeTag::StringVector:
+        return array_to_json<std::string>(input, precision);
+      case FieldTypeTag::Int64Vector:
+        return array_to_json<int64_t>(input, precision);
+      case FieldTypeTag::UInt64Vector:
+        return array_to_json<uint64_t>(input, precision);
+      case FieldTypeTag::DoubleVector:
+        return array_to_json<double>(input, precision);
+      case FieldTypeTag::UInt8Vector:
+        return array_to_json<uint8_t>(input, precision);
+      case FieldTypeTag::Int8Vector:
+        return array_to_json<int8_t>(input, precision);
+      case FieldTypeTag::UInt16Vector:
+        return array_to_json<uint16_t>(input, precision);
+      case FieldTypeTag::Int16Vector:
+        return array_to_json<int16_t>(input, precision);
+      case FieldTypeTag::UInt32Vector:
+        return array_to_json<uint32_t>(input, precision);
+      case FieldTypeTag::Int32Vector:
+        return array_to_json<int32_t>(input, precision);
+      case FieldTypeTag::FloatVector:
+        return array_to_json<float>(input, precision);
+
+      case FieldTypeTag::Blob:
+      {
+        // Read the shared bytes in place instead of copying them into a vector
+        const soss::Blob& content = *input.cast<soss::Blob>();
+        Json output = Json::array();
+        Json::array_t& array = output.get_ref<Json::array_t&>();
+        array.reserve(content.size());
+        for(const uint8_t c : content)
+          array.emplace_back(c);
+
+        return output;
+      }
+
+      case FieldTypeTag::MessageVector:
+      {
+        const std::vector<soss::Message>& input_array =
+            *input.cast<std::vector<soss::Message>>();
 
-      output[key] = conversion(it);
+        Json output = Json::array();
+        Json::array_t& array = output.get_ref<Json::array_t&>();
+        array.resize(input_array.size());
+        for(std::size_t i = 0; i < input_array.size(); ++i)
+          convert_from_soss_message(input_array[i], array[i], precision);
+
+        return output;
+      }
+
+      case FieldTypeTag::Other:
+        break;
     }
+
+    throw std::out_of_range(
+          "[soss::json::convert] Cannot convert a field of type ["
+          + input.type() + "] into JSON");
+  }
+
+  static void convert_from_soss_message(
+      const soss::Message& input,
+      Json& output,
+      const int precision)
+  {
+    for(const_field_iterator it = input.data.begin(); it != input.data.end(); ++it)
+      output[it->first] = field_to_json(it->second, precision);
   }
 
 
   // ------------ Functions for using converter ------------
 
-  static Json to_json(const Message& input)
+  static Json to_json(const Message& input, const int precision)
   {
     Json output;
-    convert_from_soss_message(input, output);
+    if(const NativeJson* native =
+       dynamic_cast<const NativeJson*>(input.native.get()))
+    {
+      native->to_json(output);
+      return output;
+    }
+
+    convert_from_soss_message(input, output, precision);
 
     return output;
   }
@@ -348,14 +480,25 @@ struct Converter
 
   ToSossMap map_to_soss;
   ToSossArrayMap map_to_soss_array;
-  ToJsonMap map_to_json;
   ToStringMap map_to_string;
 };
 
+//==============================================================================
+NativeJson::~NativeJson()
+{
+  // Do nothing
+}
+
 //==============================================================================
 Json convert(const soss::Message& input)
 {
-  return Converter::to_json(input);
+  return Converter::to_json(input, 0);
+}
+
+//==============================================================================
+Json convert(const soss::Message& input, const int precision)
+{
+  return Converter::to_json(input, precision);
 }
 
 //==============================================================================
@@ -0,0 +1,408 @@
+/*
+ * Copyright (C) 2019 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include <soss/json/sax.hpp>
+
+#include <soss/utilities.hpp>
+
+#include <stdexcept>
+#include <vector>
+
+namespace soss {
+namespace json {
+
+using nlohmann::detail::value_t;
+
+//==============================================================================
+class MessageBuilder::Implementation
+{
+public:
+
+  Implementation(const std::string& type)
+    : _type(type),
+      _finished(false)
+  {
+    // Do nothing
+  }
+
+  bool finished() const
+  {
+    return _finished;
+  }
+
+  soss::Message take()
+  {
+    if(!_finished)
+    {
+      throw std::runtime_error(
+            "[soss::json::MessageBuilder] Attempting to take a message before "
+            "it has been fully parsed");
+    }
+
+    return std::move(_result);
+  }
+
+  template<typename T>
+  void value(const value_t type, T&& value)
+  {
+    if(_stack.empty())
+      throw_not_an_object();
+
+    Frame& frame = _stack.back();
+    if(!frame.is_array)
+    {
+      // Use the same representation that soss::Convert gives to each type,
+      // e.g. booleans are stored as uint64_t.
+      frame.message.data[frame.key] =
+          soss::Convert<typename std::decay<T>::type>::make_soss_field(
+            std::forward<T>(value));
+      return;
+    }
+
+    check_array_type(frame, type);
+    append(frame, std::forward<T>(value));
+  }
+
+  void null()
+  {
+    throw std::runtime_error(
+          "[soss::json::MessageBuilder] Cannot convert a null value into a "
+          "soss::Message field");
+  }
+
+  void start_object(const std::size_t elements)
+  {
+    if(_finished)
+    {
+      throw std::runtime_error(
+            "[soss::json::MessageBuilder] Received a new object after the "
+            "message was already finished");
+    }
+
+    if(!_stack.empty() && _stack.back().is_array)
+      check_array_type(_stack.back(), value_t::object);
+
+    _stack.emplace_back(false);
+    Frame& frame = _stack.back();
+    if(_stack.size() == 1)
+      frame.message.type = _type;
+
+    // Binary formats tell us the size of the object ahead of time
+    if(elements != static_cast<std::size_t>(-1))
+      frame.message.data.reserve(elements);
+  }
+
+  void key(std::string& key)
+  {
+    _stack.back().key = std::move(key);
+  }
+
+  void end_object()
+  {
+    soss::Message message = std::move(_stack.back().message);
+    _stack.pop_back();
+
+    if(_stack.empty())
+    {
+      _result = std::move(message);
+      _finished = true;
+      return;
+    }
+
+    Frame& parent = _stack.back();
+    if(parent.is_array)
+    {
+      parent.messages.emplace_back(std::move(message));
+      return;
+    }
+
+    parent.message.data[parent.key] =
+        soss::make_field<soss::Message>(std::move(message));
+  }
+
+  void start_array(const std::size_t elements)
+  {
+    if(_stack.empty())
+      throw_not_an_object();
+
+    if(_stack.back().is_array)
+    {
+      throw std::runtime_error(
+            "[soss::json::MessageBuilder] Nested arrays cannot be converted "
+            "into soss::Message fields");
+    }
+
+    _stack.emplace_back(true);
+    _stack.back().expected_size = elements;
+  }
+
+  void end_array()
+  {
+    Frame frame = std::move(_stack.back());
+    _stack.pop_back();
+
+    Field field;
+    switch(frame.array_type)
+    {
+      case value_t::string:
+        field = soss::make_field<std::vector<std::string>>(
+              std::move(frame.strings));
+        break;
+
+      case value_t::boolean:
+      case value_t::number_unsigned:
+        field = soss::make_field<std::vector<uint64_t>>(
+              std::move(frame.unsigneds));
+        break;
+
+      case value_t::number_integer:
+        field = soss::make_field<std::vector<int64_t>>(
+              std::move(frame.integers));
+        break;
+
+      case value_t::number_float:
+        field = soss::make_field<std::vector<double>>(std::move(frame.floats));
+        break;
+
+      case value_t::object:
+        field = soss::make_field<std::vector<soss::Message>>(
+              std::move(frame.messages));
+        break;
+
+      default:
+        // This matches soss::json::convert(~), which cannot infer the element
+        // type of an empty array either.
+        throw std::runtime_error(
+              "[soss::json::MessageBuilder] Cannot infer the type of an empty "
+              "array");
+    }
+
+    Frame& parent = _stack.back();
+    parent.message.data[parent.key] = std::move(field);
+  }
+
+private:
+
+  struct Frame
+  {
+    Frame(const bool array)
+      : is_array(array)
+    {
+      // Do nothing
+    }
+
+    bool is_array;
+
+    // Used by objects
+    soss::Message message;
+    std::string key;
+
+    // Used by arrays
+    value_t array_type = value_t::discarded;
+    std::size_t expected_size = static_cast<std::size_t>(-1);
+    std::vector<std::string> strings;
+    std::vector<int64_t> integers;
+    std::vector<uint64_t> unsigneds;
+    std::vector<double> floats;
+    std::vector<soss::Message> messages;
+  };
+
+  static void throw_not_an_object()
+  {
+    throw std::runtime_error(
+          "[soss::json::MessageBuilder] Received a JSON-encoded message that "
+          "is not an object");
+  }
+
+  template<typename T>
+  static void reserve(const Frame& frame, std::vector<T>& entries)
+  {
+    if(entries.empty() && frame.expected_size != static_cast<std::size_t>(-1))
+      entries.reserve(frame.expected_size);
+  }
+
+  void check_array_type(Frame& frame, const value_t type)
+  {
+    if(frame.array_type == value_t::discarded)
+    {
+      frame.array_type = type;
+      return;
+    }
+
+    if(frame.array_type != type)
+    {
+      throw std::runtime_error(
+            "[soss::json::MessageBuilder] Mismatch in array types. Expected ["
+            + std::to_string(static_cast<int>(frame.array_type))
+            + "] instead got [" + std::to_string(static_cast<int>(type))
+            + "] for the field [" + _stack[_stack.size()-2].key + "]");
+    }
+  }
+
+  void append(Frame& frame, std::string&& value)
+  {
+    reserve(frame, frame.strings);
+    frame.strings.emplace_back(std::move(value));
+  }
+
+  void append(Frame& frame, const bool value)
+  {
+    reserve(frame, frame.unsigneds);
+    frame.unsigneds.push_back(static_cast<uint64_t>(value));
+  }
+
+  void append(Frame& frame, const int64_t value)
+  {
+    reserve(frame, frame.integers);
+    frame.integers.push_back(value);
+  }
+
+  void append(Frame& frame, const uint64_t value)
+  {
+    reserve(frame, frame.unsigneds);
+    frame.unsigneds.push_back(value);
+  }
+
+  void append(Frame& frame, const double value)
+  {
+    reserve(frame, frame.floats);
+    frame.floats.push_back(value);
+  }
+
+  const std::string _type;
+  std::vector<Frame> _stack;
+  soss::Message _result;
+  bool _finished;
+
+};
+
+//==============================================================================
+MessageBuilder::MessageBuilder(const std::string& type)
+  : _pimpl(new Implementation(type))
+{
+  // Do nothing
+}
+
+//==============================================================================
+bool MessageBuilder::finished() const
+{
+  return _pimpl->finished();
+}
+
+//==============================================================================
+soss::Message MessageBuilder::take()
+{
+  return _pimpl->take();
+}
+
+//==============================================================================
+bool MessageBuilder::null()
+{
+  _pimpl->null();
+  return true;
+}
+
+//==============================================================================
+bool MessageBuilder::boolean(const bool val)
+{
+  _pimpl->value(value_t::boolean, val);
+  return true;
+}
+
+//==============================================================================
+bool MessageBuilder::number_integer(const number_integer_t val)
+{
+  _pimpl->value(value_t::number_integer, static_cast<int64_t>(val));
+  return true;
+}
+
+//==============================================================================
+bool MessageBuilder::number_unsigned(const number_unsigned_t val)
+{
+  _pimpl->value(value_t::number_unsigned, static_cast<uint64_t>(val));
+  return true;
+}
+
+//==============================================================================
+bool MessageBuilder::number_float(
+    const number_float_t val,
+    const string_t& /*s*/)
+{
+  _pimpl->value(value_t::number_float, static_cast<double>(val));
+  return true;
+}
+
+//==============================================================================
+bool MessageBuilder::string(string_t& val)
+{
+  _pimpl->value(value_t::string, std::move(val));
+  return true;
+}
+
+//==============================================================================
+bool MessageBuilder::start_object(const std::size_t elements)
+{
+  _pimpl->start_object(elements);
+  return true;
+}
+
+//==============================================================================
+bool MessageBuilder::key(string_t& val)
+{
+  _pimpl->key(val);
+  return true;
+}
+
+//==============================================================================
+bool MessageBuilder::end_object()
+{
+  _pimpl->end_object();
+  return true;
+}
+
+//==============================================================================
+bool MessageBuilder::start_array(const std::size_t elements)
+{
+  _pimpl->start_array(elements);
+  return true;
+}
+
+//==============================================================================
+bool MessageBuilder::end_array()
+{
+  _pimpl->end_array();
+  return true;
+}
+
+//==============================================================================
+bool MessageBuilder::parse_error(
+    const std::size_t /*position*/,
+    const std::string& /*last_token*/,
+    const nlohmann::detail::exception& ex)
+{
+  throw std::runtime_error(
+        std::string("[soss::json::MessageBuilder] ") + ex.what());
+}
+
+//==============================================================================
+MessageBuilder::~MessageBuilder()
+{
+  // Do nothing
+}
+
+} // namespace json
+} // namespace soss
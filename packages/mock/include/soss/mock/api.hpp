@@ -7,6 +7,7 @@
 #include <functional>
 #include <future>
 #include <string>
+#include <vector>
 #include <soss/mock/export.hpp>
 
 namespace soss {
@@ -42,6 +43,82 @@ void SOSS_MOCK_API serve(
     const std::string& topic,
     MockServiceCallback callback);
 
+/// Results of a load that was put on soss with publish_load(~) or
+/// request_load(~). Times are measured with the clock of the mock middleware,
+/// which may be virtual (see use_virtual_clock(~)).
+struct LoadResult
+{
+  /// How many messages or requests were handed to soss
+  std::size_t sent = 0;
+
+  /// How many messages soss refused, because nothing subscribes to them
+  std::size_t rejected = 0;
+
+  /// The time between each request and its response, in the order that the
+  /// responses arrived. This stays empty for publish_load(~).
+  std::vector<std::chrono::nanoseconds> latencies;
+
+  /// The time from the first message until the last message was sent, or
+  /// until the last response arrived
+  std::chrono::nanoseconds elapsed = std::chrono::nanoseconds(0);
+};
+
+/// Publish messages into soss at a target rate. The messages of the pool get
+/// published in turn, so they can be built before the load starts, and all the
+/// publishing happens on the timer threads of the mock middleware.
+/// \param[in] rate
+///     Messages per second. Every message is due at a fixed time from the
+///     start, so a late message does not push the rest back. A rate of zero
+///     publishes all of the messages at once.
+/// \returns a future that is ready once the last message was published
+std::shared_future<LoadResult> SOSS_MOCK_API publish_load(
+    const std::string& topic,
+    std::vector<soss::Message> pool,
+    std::size_t count,
+    double rate);
+
+enum class LoadMode
+{
+  /// Requests go out on schedule, whether or not earlier requests have been
+  /// answered yet. This shows how soss copes with more than it can handle.
+  OpenLoop,
+
+  /// Only a fixed number of requests may wait for their responses at once,
+  /// and each response lets the next request go out. This measures how fast
+  /// soss answers.
+  ClosedLoop
+};
+
+/// Send requests into soss, and measure how long each of them takes to get
+/// answered. The requests of the pool get sent in turn.
+/// \param[in] rate
+///     Requests per second, or zero to send them as fast as the mode allows
+/// \param[in] concurrency
+///     How many requests may wait for their responses at once in ClosedLoop
+///     mode
+/// \returns a future that is ready once every request has been answered
+std::shared_future<LoadResult> SOSS_MOCK_API request_load(
+    const std::string& topic,
+    std::vector<soss::Message> pool,
+    std::size_t count,
+    double rate,
+    LoadMode mode = LoadMode::OpenLoop,
+    std::size_t concurrency = 1);
+
+/// Switch the mock middleware to a virtual clock, or back to the steady
+/// clock. On the virtual clock, loads and request retries only make progress
+/// when advance_virtual_clock(~) is called, so a run does the same thing every
+/// time. Switch clocks before starting any loads, because anything that is
+/// still scheduled gets dropped.
+void SOSS_MOCK_API use_virtual_clock(bool enable);
+
+/// Move the virtual clock forward, and run everything that comes due on the
+/// calling thread
+/// \returns false if the virtual clock is not in use
+bool SOSS_MOCK_API advance_virtual_clock(std::chrono::nanoseconds duration);
+
+/// The current time of the clock that the mock middleware uses
+std::chrono::nanoseconds SOSS_MOCK_API now();
 
 } // namespace mock
 } // namespace soss
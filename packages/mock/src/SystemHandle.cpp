@@ -15,10 +15,14 @@
  *
 */
 
+#include "TimerPool.hpp"
+
 #include <soss/mock/api.hpp>
 
+#include <soss/Metrics.hpp>
 #include <soss/SystemHandle.hpp>
 
+#include <algorithm>
 #include <iostream>
 
 namespace soss {
@@ -61,9 +65,17 @@ public:
   // really a concern.
   std::vector<std::shared_ptr<MockServiceClient>> mock_clients;
 
+  // Runs the loads and the request retries. This is declared last so that its
+  // threads get stopped before anything they use is destroyed.
+  TimerPool timers;
+
 private:
 
-  Implementation() = default;
+  Implementation()
+    : timers(std::max(2u, std::min(4u, std::thread::hardware_concurrency())))
+  {
+    // Do nothing
+  }
 
 };
 
@@ -111,6 +123,33 @@ public:
     return true;
   }
 
+  bool publish_batch(
+      const std::vector<std::shared_ptr<const Message>>& messages) override
+  {
+    const auto pub_it = impl().publishers.find(_topic);
+    if(pub_it == impl().publishers.end() || pub_it->second.empty())
+    {
+      throw std::runtime_error(
+          "SOSS attempted to publish to a topic/message pair "
+          "that it didn't advertise");
+    }
+
+    // Look up the mock subscriptions once for the whole batch
+    const auto it = impl().mock_subscriptions.find(_topic);
+    if(it == impl().mock_subscriptions.end())
+      return true;
+
+    for(const std::shared_ptr<const Message>& message : messages)
+    {
+      for(const auto& callback : it->second)
+      {
+        callback(*message);
+      }
+    }
+
+    return true;
+  }
+
   const std::string _topic;
 
 };
@@ -167,9 +206,13 @@ public:
 
   bool spin_once() override
   {
-    // We're always spinning. We'll put a sleep here so that this thread doesn't
-    // do too heavy of a dead spin.
-    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    // Everything happens directly inside of the API calls, so there is nothing
+    // to do here.
+    return true;
+  }
+
+  bool self_driven() const override
+  {
     return true;
   }
 
@@ -230,6 +273,7 @@ bool publish_message(
   if(cb == impl().soss_subscription_callbacks.end())
     return false;
 
+  const soss::Ingress::Scope ingress;
   cb->second(msg);
 
   return true;
@@ -258,8 +302,7 @@ class MockServiceClient
 public:
 
   MockServiceClient()
-    : response_received(false),
-      quit(false)
+    : response_received(false)
   {
     // Do nothing
   }
@@ -277,29 +320,41 @@ public:
             + topic);
     }
 
-    it->second(request_msg, *this, shared_from_this());
-
     auto future = promise.get_future().share();
 
+    it->second(request_msg, *this, shared_from_this());
+
+    // If a non-zero retry is specified, then we keep retrying the service
+    // request as often as specified, until the result is received.
     if(retry != std::chrono::nanoseconds(0))
-    {
-      // If a non-zero retry is specified, then we will launch a thread that
-      // keeps retrying the service request as often as specified, until the
-      // result is received.
-      retry_thread = std::thread([=](){
-        while(future.wait_for(retry) != std::future_status::ready)
-        {
-          if(this->quit)
-            break;
-
-          it->second(request_msg, *this, shared_from_this());
-        }
-      });
-    }
+      schedule_retry(it->second, request_msg, retry);
 
     return future;
   }
 
+  void schedule_retry(
+      const ServiceClientSystem::RequestCallback& callback,
+      const soss::Message& request_msg,
+      const std::chrono::nanoseconds retry)
+  {
+    const std::weak_ptr<MockServiceClient> weak = shared_from_this();
+    impl().timers.schedule(impl().timers.now() + retry, [=]()
+    {
+      const auto self = weak.lock();
+      if(!self)
+        return;
+
+      {
+        std::unique_lock<std::mutex> lock(self->mutex);
+        if(self->response_received)
+          return;
+      }
+
+      callback(request_msg, *self, self);
+      self->schedule_retry(callback, request_msg, retry);
+    });
+  }
+
   void receive_response(
       std::shared_ptr<void> call_handle,
       const soss::Message& response) override
@@ -315,17 +370,8 @@ public:
   }
 
   std::promise<soss::Message> promise;
-  std::thread retry_thread;
   bool response_received;
-  std::atomic_bool quit;
   std::mutex mutex;
-
-  ~MockServiceClient() override
-  {
-    quit = true;
-    if(retry_thread.joinable())
-      retry_thread.join();
-  }
 };
 
 //==============================================================================
@@ -368,6 +414,288 @@ void serve(const std::string& topic, MockServiceCallback callback)
   }
 }
 
+//==============================================================================
+namespace {
+
+//==============================================================================
+TimerPool::Time period_of(const double rate)
+{
+  if(rate <= 0.0)
+    return TimerPool::Time(0);
+
+  return std::chrono::duration_cast<TimerPool::Time>(
+        std::chrono::duration<double>(1.0/rate));
+}
+
+//==============================================================================
+/// Publishes one message at a time, and schedules the next one when it is done
+class PublishLoad : public std::enable_shared_from_this<PublishLoad>
+{
+public:
+
+  PublishLoad(
+      const std::string& topic,
+      std::vector<soss::Message> pool,
+      const std::size_t count,
+      const double rate)
+    : _topic(topic),
+      _pool(std::move(pool)),
+      _count(count),
+      _period(period_of(rate))
+  {
+    // Do nothing
+  }
+
+  std::shared_future<LoadResult> start()
+  {
+    auto future = _promise.get_future().share();
+    _start = impl().timers.now();
+    if(_count == 0)
+    {
+      _promise.set_value(_result);
+      return future;
+    }
+
+    const auto self = shared_from_this();
+    impl().timers.schedule(_start, [self]() { self->_step(); });
+    return future;
+  }
+
+private:
+
+  void _step()
+  {
+    // Without a rate, everything goes out in this one step
+    do
+    {
+      if(!publish_message(_topic, _pool[_result.sent % _pool.size()]))
+        ++_result.rejected;
+
+      ++_result.sent;
+    } while(_period.count() == 0 && _result.sent < _count);
+
+    if(_result.sent < _count)
+    {
+      const auto self = shared_from_this();
+      impl().timers.schedule(
+            _start + _period*static_cast<int64_t>(_result.sent),
+            [self]() { self->_step(); });
+      return;
+    }
+
+    _result.elapsed = impl().timers.now() - _start;
+    _promise.set_value(std::move(_result));
+  }
+
+  const std::string _topic;
+  const std::vector<soss::Message> _pool;
+  const std::size_t _count;
+  const TimerPool::Time _period;
+
+  TimerPool::Time _start;
+  LoadResult _result;
+  std::promise<LoadResult> _promise;
+
+};
+
+//==============================================================================
+/// Sends requests on schedule and keeps track of their responses
+class RequestLoad
+    : public virtual soss::ServiceClient,
+      public std::enable_shared_from_this<RequestLoad>
+{
+public:
+
+  RequestLoad(
+      ServiceClientSystem::RequestCallback callback,
+      std::vector<soss::Message> pool,
+      const std::size_t count,
+      const double rate,
+      const LoadMode mode,
+      const std::size_t concurrency)
+    : _callback(std::move(callback)),
+      _pool(std::move(pool)),
+      _count(count),
+      _period(period_of(rate)),
+      _mode(mode),
+      _concurrency(std::max<std::size_t>(1, concurrency)),
+      _finished(false)
+  {
+    _result.latencies.reserve(_count);
+  }
+
+  std::shared_future<LoadResult> start()
+  {
+    auto future = _promise.get_future().share();
+    _start = impl().timers.now();
+    if(_count == 0)
+    {
+      _finished = true;
+      _promise.set_value(_result);
+      return future;
+    }
+
+    const std::size_t first = _mode == LoadMode::OpenLoop?
+          1 : std::min(_concurrency, _count);
+
+    const auto self = shared_from_this();
+    for(std::size_t i=0; i < first; ++i)
+      impl().timers.schedule(_due(i), [self]() { self->_send(); });
+
+    return future;
+  }
+
+  void receive_response(
+      std::shared_ptr<void> call_handle,
+      const soss::Message& /*response*/) override
+  {
+    Call& call = *std::static_pointer_cast<Call>(call_handle);
+    const TimerPool::Time now = impl().timers.now();
+
+    std::unique_lock<std::mutex> lock(_mutex);
+
+    // Providers knowing no better may answer the same request more than once
+    if(call.answered || _finished)
+      return;
+
+    call.answered = true;
+    _result.latencies.push_back(now - call.sent);
+
+    if(_result.latencies.size() == _count)
+    {
+      _finished = true;
+      _result.elapsed = now - _start;
+      _promise.set_value(std::move(_result));
+      return;
+    }
+
+    // In a closed loop, each response makes room for the next request
+    if(_mode == LoadMode::ClosedLoop && _next < _count)
+    {
+      const TimerPool::Time due = std::max(now, _due(_next));
+      const auto self = shared_from_this();
+      lock.unlock();
+      impl().timers.schedule(due, [self]() { self->_send(); });
+    }
+  }
+
+private:
+
+  struct Call
+  {
+    std::shared_ptr<RequestLoad> load;
+    TimerPool::Time sent;
+    bool answered;
+  };
+
+  TimerPool::Time _due(const std::size_t index) const
+  {
+    return _start + _period*static_cast<int64_t>(index);
+  }
+
+  void _send()
+  {
+    std::unique_lock<std::mutex> lock(_mutex);
+    if(_next >= _count)
+      return;
+
+    const std::size_t index = _next++;
+    ++_result.sent;
+
+    if(_mode == LoadMode::OpenLoop && _next < _count)
+    {
+      // Without a rate, the open loop sends everything in a burst
+      const auto self = shared_from_this();
+      impl().timers.schedule(_due(_next), [self]() { self->_send(); });
+    }
+
+    lock.unlock();
+
+    const auto call = std::make_shared<Call>(
+          Call{shared_from_this(), impl().timers.now(), false});
+    _callback(_pool[index % _pool.size()], *this, call);
+  }
+
+  const ServiceClientSystem::RequestCallback _callback;
+  const std::vector<soss::Message> _pool;
+  const std::size_t _count;
+  const TimerPool::Time _period;
+  const LoadMode _mode;
+  const std::size_t _concurrency;
+
+  TimerPool::Time _start;
+  std::size_t _next = 0;
+  bool _finished;
+  LoadResult _result;
+  std::promise<LoadResult> _promise;
+  std::mutex _mutex;
+
+};
+
+} // anonymous namespace
+
+//==============================================================================
+std::shared_future<LoadResult> publish_load(
+    const std::string& topic,
+    std::vector<soss::Message> pool,
+    const std::size_t count,
+    const double rate)
+{
+  if(pool.empty())
+  {
+    throw std::runtime_error(
+          "a load on the topic [" + topic + "] needs at least one message");
+  }
+
+  return std::make_shared<PublishLoad>(
+        topic, std::move(pool), count, rate)->start();
+}
+
+//==============================================================================
+std::shared_future<LoadResult> request_load(
+    const std::string& topic,
+    std::vector<soss::Message> pool,
+    const std::size_t count,
+    const double rate,
+    const LoadMode mode,
+    const std::size_t concurrency)
+{
+  const auto it = impl().soss_request_callbacks.find(topic);
+  if(it == impl().soss_request_callbacks.end())
+  {
+    throw std::runtime_error(
+          "you have requested a service from mock middleware "
+          "that it is not providing: " + topic);
+  }
+
+  if(pool.empty())
+  {
+    throw std::runtime_error(
+          "a load on the service [" + topic + "] needs at least one request");
+  }
+
+  return std::make_shared<RequestLoad>(
+        it->second, std::move(pool), count, rate, mode, concurrency)->start();
+}
+
+//==============================================================================
+void use_virtual_clock(const bool enable)
+{
+  impl().timers.use_virtual_clock(enable);
+}
+
+//==============================================================================
+bool advance_virtual_clock(const std::chrono::nanoseconds duration)
+{
+  return impl().timers.advance(duration);
+}
+
+//==============================================================================
+std::chrono::nanoseconds now()
+{
+  return impl().timers.now();
+}
+
 } // namespace mock
 } // namespace soss
 
@@ -0,0 +1,148 @@
+/*
+ * Copyright (C) 2019 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+
+#include "TimerPool.hpp"
+
+#include <algorithm>
+#include <iostream>
+
+namespace soss {
+namespace mock {
+
+//==============================================================================
+TimerPool::TimerPool(const std::size_t threads)
+  : _thread_count(std::max<std::size_t>(1, threads)),
+    _next_order(0),
+    _virtual(false),
+    _virtual_now(0),
+    _quit(false)
+{
+  // Do nothing
+}
+
+//==============================================================================
+TimerPool::Time TimerPool::now() const
+{
+  std::unique_lock<std::mutex> lock(_mutex);
+  return _virtual? _virtual_now : _steady_now();
+}
+
+//==============================================================================
+void TimerPool::schedule(const Time when, Task task)
+{
+  std::unique_lock<std::mutex> lock(_mutex);
+  _timers.push(Timer{when, _next_order++, std::move(task)});
+
+  if(!_virtual && _threads.empty())
+  {
+    for(std::size_t i=0; i < _thread_count; ++i)
+      _threads.emplace_back([this]() { _work(); });
+  }
+
+  _wakeup.notify_one();
+}
+
+//==============================================================================
+void TimerPool::use_virtual_clock(const bool enable)
+{
+  std::unique_lock<std::mutex> lock(_mutex);
+  _virtual = enable;
+  _virtual_now = Time(0);
+  _timers = decltype(_timers)();
+  _wakeup.notify_all();
+}
+
+//==============================================================================
+bool TimerPool::advance(const Time duration)
+{
+  std::unique_lock<std::mutex> lock(_mutex);
+  if(!_virtual)
+  {
+    std::cerr << "[soss::mock] The virtual clock can only be advanced while "
+              << "it is in use" << std::endl;
+    return false;
+  }
+
+  const Time target = _virtual_now + duration;
+  while(_virtual && !_timers.empty() && _timers.top().when <= target)
+  {
+    const Timer timer = _timers.top();
+    _timers.pop();
+    _virtual_now = std::max(_virtual_now, timer.when);
+
+    lock.unlock();
+    timer.task();
+    lock.lock();
+  }
+
+  _virtual_now = std::max(_virtual_now, target);
+  return true;
+}
+
+//==============================================================================
+TimerPool::~TimerPool()
+{
+  {
+    std::unique_lock<std::mutex> lock(_mutex);
+    _quit = true;
+    _wakeup.notify_all();
+  }
+
+  for(std::thread& thread : _threads)
+    thread.join();
+}
+
+//==============================================================================
+TimerPool::Time TimerPool::_steady_now()
+{
+  return std::chrono::duration_cast<Time>(
+        std::chrono::steady_clock::now().time_since_epoch());
+}
+
+//==============================================================================
+void TimerPool::_work()
+{
+  std::unique_lock<std::mutex> lock(_mutex);
+  while(!_quit)
+  {
+    // While the virtual clock is in use, all of the tasks get run by advance()
+    if(_virtual || _timers.empty())
+    {
+      _wakeup.wait(lock);
+      continue;
+    }
+
+    const Time when = _timers.top().when;
+    const Time now = _steady_now();
+    if(now < when)
+    {
+      _wakeup.wait_for(lock, when - now);
+      continue;
+    }
+
+    const Task task = _timers.top().task;
+    _timers.pop();
+
+    lock.unlock();
+    task();
+    lock.lock();
+  }
+}
+
+} // namespace mock
+} // namespace soss
@@ -0,0 +1,109 @@
+/*
+ * Copyright (C) 2019 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+
+#ifndef SOSS__MOCK__SRC__TIMERPOOL_HPP
+#define SOSS__MOCK__SRC__TIMERPOOL_HPP
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+namespace soss {
+namespace mock {
+
+//==============================================================================
+/// TimerPool runs tasks at the times they were scheduled for, on a small pool
+/// of worker threads that gets started the first time something is scheduled.
+///
+/// The pool can also run on a virtual clock. Then the workers stay idle, and
+/// time only moves when advance(~) is called, which runs every task that comes
+/// due on the calling thread, in the order of their times. Tasks with the same
+/// time run in the order they were scheduled, so runs are repeatable.
+class TimerPool
+{
+public:
+
+  /// Times are measured from the epoch of the clock that is in use, which is
+  /// zero for the virtual clock
+  using Time = std::chrono::nanoseconds;
+  using Task = std::function<void()>;
+
+  TimerPool(std::size_t threads);
+
+  /// \brief The current time of the clock that is in use
+  Time now() const;
+
+  /// \brief Run a task once the clock reaches a time
+  void schedule(Time when, Task task);
+
+  /// \brief Switch between the steady clock and a virtual clock. The virtual
+  /// clock starts over from zero, and any tasks that were waiting get dropped,
+  /// because their times belong to the other clock.
+  void use_virtual_clock(bool enable);
+
+  /// \brief Move the virtual clock forward, running the tasks that come due
+  /// \returns false if the virtual clock is not in use
+  bool advance(Time duration);
+
+  TimerPool(const TimerPool&) = delete;
+  TimerPool& operator=(const TimerPool&) = delete;
+
+  ~TimerPool();
+
+private:
+
+  struct Timer
+  {
+    Time when;
+    uint64_t order;
+    Task task;
+
+    bool operator>(const Timer& other) const
+    {
+      return when != other.when? when > other.when : order > other.order;
+    }
+  };
+
+  static Time _steady_now();
+
+  void _work();
+
+  const std::size_t _thread_count;
+
+  std::priority_queue<Timer, std::vector<Timer>, std::greater<Timer>> _timers;
+  uint64_t _next_order;
+
+  bool _virtual;
+  Time _virtual_now;
+  bool _quit;
+
+  mutable std::mutex _mutex;
+  std::condition_variable _wakeup;
+  std::vector<std::thread> _threads;
+
+};
+
+} // namespace mock
+} // namespace soss
+
+#endif // SOSS__MOCK__SRC__TIMERPOOL_HPP
@@ -0,0 +1,181 @@
+/*
+ * Copyright (C) 2019 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include <soss/mock/api.hpp>
+#include <soss/Instance.hpp>
+#include <soss/utilities.hpp>
+
+#include <catch2/catch.hpp>
+
+#include <yaml-cpp/yaml.h>
+
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+
+#include <unistd.h>
+
+namespace {
+
+using namespace std::chrono_literals;
+using Clock = std::chrono::steady_clock;
+
+//==============================================================================
+soss::Message sample(const uint32_t index)
+{
+  soss::Message message;
+  message.type = "recorder_test/Sample";
+  message.data["index"] = soss::Convert<uint32_t>::make_soss_field(index);
+  return message;
+}
+
+//==============================================================================
+/// The messages that came out of a replay, in the order that they arrived
+struct Arrivals
+{
+  void add(const std::string& topic, const soss::Message& message)
+  {
+    uint32_t index = 0;
+    soss::Convert<uint32_t>::from_soss_field(message.data.begin(), index);
+
+    std::unique_lock<std::mutex> lock(mutex);
+    topics.push_back(topic);
+    indices.push_back(index);
+    times.push_back(Clock::now());
+    arrived.notify_all();
+  }
+
+  bool wait(const std::size_t count)
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    return arrived.wait_for(lock, 10s, [&]() { return indices.size() >= count; });
+  }
+
+  void clear()
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    topics.clear();
+    indices.clear();
+    times.clear();
+  }
+
+  std::mutex mutex;
+  std::condition_variable arrived;
+  std::vector<std::string> topics;
+  std::vector<uint32_t> indices;
+  std::vector<Clock::time_point> times;
+};
+
+//==============================================================================
+double milliseconds(const Clock::duration duration)
+{
+  return std::chrono::duration<double, std::milli>(duration).count();
+}
+
+} // anonymous namespace
+
+TEST_CASE("Replays keep the order and timing of the recording", "[recorder]")
+{
+  const std::string path =
+      "/tmp/soss-recorder-test-" + std::to_string(getpid());
+
+  // When each message gets published, counted from the [start] message. The
+  // first gap leaves time to subscribe to the replay before anything arrives.
+  const std::vector<std::pair<std::string, Clock::duration>> schedule = {
+    {"apple", 400ms},
+    {"banana", 450ms},
+    {"apple", 550ms},
+    {"banana", 560ms},
+    {"apple", 700ms}
+  };
+
+  std::vector<Clock::time_point> sent;
+  {
+    YAML::Node config = YAML::LoadFile(RECORDER__RECORD__TEST_CONFIG);
+    config["systems"]["recorder"]["path"] = path;
+    soss::InstanceHandle handle = soss::run_instance(config);
+    REQUIRE(handle);
+
+    const Clock::time_point start = Clock::now();
+    REQUIRE(soss::mock::publish_message("start", sample(0)));
+    for(std::size_t i = 0; i < schedule.size(); ++i)
+    {
+      std::this_thread::sleep_until(start + schedule[i].second);
+      sent.push_back(Clock::now());
+      REQUIRE(soss::mock::publish_message(
+                schedule[i].first, sample(static_cast<uint32_t>(i))));
+    }
+
+    handle.quit().wait();
+  }
+
+  Arrivals arrivals;
+  bool subscribed = false;
+  for(const double rate : {1.0, 2.0})
+  {
+    CAPTURE(rate);
+    arrivals.clear();
+
+    YAML::Node config = YAML::LoadFile(RECORDER__REPLAY__TEST_CONFIG);
+    config["systems"]["player"]["path"] = path;
+    config["systems"]["player"]["rate"] = rate;
+    soss::InstanceHandle handle = soss::run_instance(config);
+    REQUIRE(handle);
+
+    // The subscriptions of the mock middleware outlive its instances
+    if(!subscribed)
+    {
+      for(const std::string topic : {"apple", "banana"})
+      {
+        REQUIRE(soss::mock::subscribe(
+                  topic, [&arrivals, topic](const soss::Message& message)
+        {
+          arrivals.add(topic, message);
+        }));
+      }
+
+      subscribed = true;
+    }
+
+    REQUIRE(arrivals.wait(schedule.size()));
+    handle.quit().wait();
+
+    std::unique_lock<std::mutex> lock(arrivals.mutex);
+    REQUIRE(arrivals.indices.size() == schedule.size());
+    for(std::size_t i = 0; i < schedule.size(); ++i)
+    {
+      CHECK(arrivals.indices[i] == i);
+      CHECK(arrivals.topics[i] == schedule[i].first);
+
+      // The gaps between the messages get scaled by the rate
+      const double expected = milliseconds(sent[i] - sent[0])/rate;
+      const double actual = milliseconds(arrivals.times[i] - arrivals.times[0]);
+      CHECK(actual == Approx(expected).margin(20.0));
+    }
+  }
+
+  for(std::size_t index = 0; ; ++index)
+  {
+    char segment[32];
+    std::snprintf(segment, sizeof(segment), "/segment-%06zu.log", index);
+    if(std::remove((path + segment).c_str()) != 0)
+      break;
+  }
+
+  rmdir(path.c_str());
+}
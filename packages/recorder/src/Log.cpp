@@ -0,0 +1,397 @@
+/*
+ * Copyright (C) 2019 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include "Log.hpp"
+
+#include <soss/binary/conversion.hpp>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <limits>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace soss {
+namespace recorder {
+
+namespace {
+
+//==============================================================================
+const char segment_magic[8] = {'S', 'O', 'S', 'S', 'L', 'O', 'G', '\0'};
+constexpr uint32_t segment_version = 1;
+
+//==============================================================================
+std::size_t aligned(const std::size_t size)
+{
+  return (size + 7) & ~static_cast<std::size_t>(7);
+}
+
+//==============================================================================
+bool make_directories(const std::string& directory)
+{
+  for(std::size_t slash = directory.find('/', 1);;
+      slash = directory.find('/', slash + 1))
+  {
+    const std::string path = directory.substr(0, slash);
+    if(!path.empty() && mkdir(path.c_str(), 0755) != 0 && errno != EEXIST)
+    {
+      std::cerr << "[soss::recorder] Failed to create the directory [" << path
+                << "]: " << std::strerror(errno) << std::endl;
+      return false;
+    }
+
+    if(slash == std::string::npos)
+      return true;
+  }
+}
+
+//==============================================================================
+uint64_t wall_time()
+{
+  return static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::system_clock::now().time_since_epoch()).count());
+}
+
+} // anonymous namespace
+
+//==============================================================================
+std::string segment_path(const std::string& directory, const std::size_t index)
+{
+  char name[32];
+  std::snprintf(name, sizeof(name), "segment-%06zu.log", index);
+  return directory + "/" + name;
+}
+
+//==============================================================================
+LogWriter::LogWriter(
+    const std::string& directory,
+    const std::size_t segment_size)
+  : _directory(directory),
+    _segment_size(segment_size),
+    _start(Clock::now()),
+    _start_time(wall_time()),
+    _index(0),
+    _fd(-1),
+    _memory(nullptr),
+    _capacity(0),
+    _used(0)
+{
+  // Do nothing
+}
+
+//==============================================================================
+std::unique_ptr<LogWriter> LogWriter::make(
+    const std::string& directory,
+    const std::size_t segment_size)
+{
+  if(!make_directories(directory))
+    return nullptr;
+
+  // Never append to an old recording, since its times would not line up
+  const std::string first = segment_path(directory, 0);
+  if(access(first.c_str(), F_OK) == 0)
+  {
+    std::cerr << "[soss::recorder] The directory [" << directory << "] "
+              << "already holds a recording" << std::endl;
+    return nullptr;
+  }
+
+  std::unique_ptr<LogWriter> writer(new LogWriter(directory, segment_size));
+  if(!writer->_open_segment(0))
+    return nullptr;
+
+  return writer;
+}
+
+//==============================================================================
+bool LogWriter::append(
+    const std::string& topic,
+    const Clock::time_point time,
+    const Message& message)
+{
+  const std::size_t message_size = binary::encoded_size(message);
+  if(message_size == 0)
+  {
+    std::cerr << "[soss::recorder] A message on topic [" << topic << "] "
+              << "cannot be recorded, because it has fields of types that "
+              << "soss does not know" << std::endl;
+    return false;
+  }
+
+  const std::size_t topic_size = aligned(topic.size());
+  const std::size_t size = sizeof(RecordHeader) + topic_size + message_size;
+  if(size > std::numeric_limits<uint32_t>::max())
+    return false;
+
+  const auto elapsed = std::max(
+        std::chrono::nanoseconds(0),
+        std::chrono::duration_cast<std::chrono::nanoseconds>(time - _start));
+
+  std::unique_lock<std::mutex> lock(_mutex);
+  if(!_memory)
+    return false;
+
+  if(_used + size > _capacity)
+  {
+    _close_segment();
+    ++_index;
+    if(!_open_segment(size))
+      return false;
+  }
+
+  uint8_t* out = _memory + _used;
+  const RecordHeader header{
+    static_cast<uint32_t>(size),
+    static_cast<uint32_t>(topic.size()),
+    static_cast<uint64_t>(elapsed.count())};
+  std::memcpy(out, &header, sizeof(header));
+  out += sizeof(header);
+
+  std::memcpy(out, topic.data(), topic.size());
+  std::memset(out + topic.size(), 0, topic_size - topic.size());
+  out += topic_size;
+
+  binary::encode(message, out, message_size);
+
+  _used += size;
+  reinterpret_cast<SegmentHeader*>(_memory)->used = _used;
+  return true;
+}
+
+//==============================================================================
+LogWriter::~LogWriter()
+{
+  _close_segment();
+}
+
+//==============================================================================
+bool LogWriter::_open_segment(const std::size_t min_size)
+{
+  // A message that is larger than a segment gets a segment of its own
+  _capacity = std::max(_segment_size, sizeof(SegmentHeader) + min_size);
+
+  const std::string path = segment_path(_directory, _index);
+  _fd = open(path.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+  if(_fd < 0)
+  {
+    std::cerr << "[soss::recorder] Failed to create [" << path << "]: "
+              << std::strerror(errno) << std::endl;
+    return false;
+  }
+
+  if(ftruncate(_fd, static_cast<off_t>(_capacity)) != 0)
+  {
+    std::cerr << "[soss::recorder] Failed to size [" << path << "]: "
+              << std::strerror(errno) << std::endl;
+    close(_fd);
+    return false;
+  }
+
+  void* const memory = mmap(
+        nullptr, _capacity, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, 0);
+  if(memory == MAP_FAILED)
+  {
+    std::cerr << "[soss::recorder] Failed to map [" << path << "]: "
+              << std::strerror(errno) << std::endl;
+    close(_fd);
+    return false;
+  }
+
+  _memory = static_cast<uint8_t*>(memory);
+  _used = sizeof(SegmentHeader);
+
+  SegmentHeader& header = *reinterpret_cast<SegmentHeader*>(_memory);
+  std::memcpy(header.magic, segment_magic, sizeof(segment_magic));
+  header.version = segment_version;
+  header.index = static_cast<uint32_t>(_index);
+  header.start_time = _start_time;
+  header.used = _used;
+
+  return true;
+}
+
+//==============================================================================
+void LogWriter::_close_segment()
+{
+  if(!_memory)
+    return;
+
+  munmap(_memory, _capacity);
+  _memory = nullptr;
+
+  // Give back the part of the segment that was never used
+  if(ftruncate(_fd, static_cast<off_t>(_used)) != 0)
+  {
+    std::cerr << "[soss::recorder] Failed to trim "
+              << segment_path(_directory, _index) << ": "
+              << std::strerror(errno) << std::endl;
+  }
+
+  close(_fd);
+  _fd = -1;
+}
+
+//==============================================================================
+LogReader::LogReader(const std::string& directory)
+  : _directory(directory),
+    _index(0),
+    _fd(-1),
+    _memory(nullptr),
+    _size(0),
+    _used(0),
+    _position(0)
+{
+  // Do nothing
+}
+
+//==============================================================================
+std::unique_ptr<LogReader> LogReader::make(const std::string& directory)
+{
+  std::unique_ptr<LogReader> reader(new LogReader(directory));
+  if(!reader->_open_segment(0))
+  {
+    std::cerr << "[soss::recorder] There is no recording in [" << directory
+              << "]" << std::endl;
+    return nullptr;
+  }
+
+  return reader;
+}
+
+//==============================================================================
+bool LogReader::next(Record& record)
+{
+  while(_memory)
+  {
+    RecordHeader header;
+    if(_position + sizeof(RecordHeader) <= _used)
+    {
+      std::memcpy(&header, _memory + _position, sizeof(header));
+      const std::size_t topic_size = aligned(header.topic_length);
+      if(header.size >= sizeof(RecordHeader) + topic_size
+         && header.size <= _used - _position)
+      {
+        const uint8_t* const data = _memory + _position;
+        record.topic = reinterpret_cast<const char*>(data + sizeof(header));
+        record.topic_length = header.topic_length;
+        record.time = std::chrono::nanoseconds(header.time);
+        record.data = data + sizeof(header) + topic_size;
+        record.size = header.size - sizeof(header) - topic_size;
+
+        _position += header.size;
+        return true;
+      }
+
+      std::cerr << "[soss::recorder] Found a damaged record in "
+                << segment_path(_directory, _index) << ", skipping the rest "
+                << "of the segment" << std::endl;
+    }
+
+    const std::size_t next = _index + 1;
+    if(!_open_segment(next))
+      return false;
+  }
+
+  return false;
+}
+
+//==============================================================================
+void LogReader::rewind()
+{
+  _open_segment(0);
+}
+
+//==============================================================================
+LogReader::~LogReader()
+{
+  _close_segment();
+}
+
+//==============================================================================
+bool LogReader::_open_segment(const std::size_t index)
+{
+  _close_segment();
+  _index = index;
+
+  const std::string path = segment_path(_directory, index);
+  _fd = open(path.c_str(), O_RDONLY);
+  if(_fd < 0)
+    return false;
+
+  struct stat info;
+  if(fstat(_fd, &info) != 0
+     || static_cast<std::size_t>(info.st_size) < sizeof(SegmentHeader))
+  {
+    _close_segment();
+    return false;
+  }
+
+  _size = static_cast<std::size_t>(info.st_size);
+  void* const memory = mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, _fd, 0);
+  if(memory == MAP_FAILED)
+  {
+    std::cerr << "[soss::recorder] Failed to map [" << path << "]: "
+              << std::strerror(errno) << std::endl;
+    close(_fd);
+    _fd = -1;
+    return false;
+  }
+
+  madvise(memory, _size, MADV_SEQUENTIAL);
+  _memory = static_cast<const uint8_t*>(memory);
+
+  SegmentHeader header;
+  std::memcpy(&header, _memory, sizeof(header));
+  if(std::memcmp(header.magic, segment_magic, sizeof(segment_magic)) != 0
+     || header.version != segment_version)
+  {
+    std::cerr << "[soss::recorder] [" << path << "] is not a segment of a "
+              << "soss recording" << std::endl;
+    _close_segment();
+    return false;
+  }
+
+  _used = std::min<std::size_t>(header.used, _size);
+  _position = sizeof(SegmentHeader);
+  return true;
+}
+
+//==============================================================================
+void LogReader::_close_segment()
+{
+  if(_memory)
+  {
+    munmap(const_cast<uint8_t*>(_memory), _size);
+    _memory = nullptr;
+  }
+
+  if(_fd >= 0)
+  {
+    close(_fd);
+    _fd = -1;
+  }
+}
+
+} // namespace recorder
+} // namespace soss
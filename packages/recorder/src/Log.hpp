@@ -0,0 +1,169 @@
+/*
+ * Copyright (C) 2019 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#ifndef SOSS__RECORDER__SRC__LOG_HPP
+#define SOSS__RECORDER__SRC__LOG_HPP
+
+#include <soss/Message.hpp>
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace soss {
+namespace recorder {
+
+//==============================================================================
+/// A recording is a directory of segment files, numbered from zero. Each
+/// segment starts with a SegmentHeader, followed by records that are each
+/// aligned to 8 bytes:
+///
+///   RecordHeader
+///   the name of the topic, padded to 8 bytes
+///   the message, in the soss binary format
+struct SegmentHeader
+{
+  char magic[8];
+  uint32_t version;
+  uint32_t index;
+
+  /// When the recording started, in nanoseconds since the epoch
+  uint64_t start_time;
+
+  /// How many bytes of the segment are taken up by complete records, counted
+  /// from the start of the file
+  uint64_t used;
+
+  uint64_t reserved[4];
+};
+
+//==============================================================================
+struct RecordHeader
+{
+  /// The size of the whole record, including this header and its padding
+  uint32_t size;
+  uint32_t topic_length;
+
+  /// When the message came into soss, in nanoseconds since the recording
+  /// started
+  uint64_t time;
+};
+
+static_assert(sizeof(SegmentHeader) == 64, "A segment header must be 64 bytes");
+static_assert(sizeof(RecordHeader) == 16, "A record header must be 16 bytes");
+
+//==============================================================================
+std::string segment_path(const std::string& directory, std::size_t index);
+
+//==============================================================================
+/// Appends messages to a recording. The segments are mapped into memory, so
+/// appending a message is only a copy; the files only get touched by system
+/// calls when a segment fills up and the next one gets started.
+class LogWriter
+{
+public:
+
+  using Clock = std::chrono::steady_clock;
+
+  /// \returns nullptr if the directory cannot be used for a new recording
+  static std::unique_ptr<LogWriter> make(
+      const std::string& directory,
+      std::size_t segment_size);
+
+  /// \brief Append a message that came into soss at the given time
+  bool append(
+      const std::string& topic,
+      Clock::time_point time,
+      const Message& message);
+
+  ~LogWriter();
+
+private:
+
+  LogWriter(const std::string& directory, std::size_t segment_size);
+
+  bool _open_segment(std::size_t min_size);
+  void _close_segment();
+
+  const std::string _directory;
+  const std::size_t _segment_size;
+  const Clock::time_point _start;
+  const uint64_t _start_time;
+
+  std::size_t _index;
+  int _fd;
+  uint8_t* _memory;
+  std::size_t _capacity;
+  std::size_t _used;
+
+  std::mutex _mutex;
+
+};
+
+//==============================================================================
+/// Reads the records of a recording in order, through read-only mappings of
+/// its segments
+class LogReader
+{
+public:
+
+  struct Record
+  {
+    const char* topic;
+    std::size_t topic_length;
+    std::chrono::nanoseconds time;
+    const uint8_t* data;
+    std::size_t size;
+  };
+
+  /// \returns nullptr if the directory has no recording
+  static std::unique_ptr<LogReader> make(const std::string& directory);
+
+  /// \brief Get the next record. It remains valid until the next call.
+  ///
+  /// \returns false at the end of the recording
+  bool next(Record& record);
+
+  /// \brief Go back to the first record
+  void rewind();
+
+  ~LogReader();
+
+private:
+
+  LogReader(const std::string& directory);
+
+  bool _open_segment(std::size_t index);
+  void _close_segment();
+
+  const std::string _directory;
+
+  std::size_t _index;
+  int _fd;
+  const uint8_t* _memory;
+  std::size_t _size;
+  std::size_t _used;
+  std::size_t _position;
+
+};
+
+} // namespace recorder
+} // namespace soss
+
+#endif // SOSS__RECORDER__SRC__LOG_HPP
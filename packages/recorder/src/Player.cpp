@@ -0,0 +1,296 @@
+/*
+ * Copyright (C) 2019 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include "Log.hpp"
+
+#include <soss/binary/conversion.hpp>
+
+#include <soss/Metrics.hpp>
+#include <soss/SystemHandle.hpp>
+
+#include <condition_variable>
+#include <iostream>
+#include <mutex>
+#include <unordered_map>
+
+namespace soss {
+namespace recorder {
+
+namespace {
+
+//==============================================================================
+const std::string YamlPathKey = "path";
+const std::string YamlRateKey = "rate";
+const std::string YamlLoopKey = "loop";
+
+/// Waiting for a message only sleeps until this long before it is due, and
+/// spins on the clock for the rest, because waking up from a sleep is much
+/// less precise than that
+constexpr std::chrono::microseconds SpinMargin(200);
+
+/// When playing as fast as possible, spin_once() hands over this many messages
+/// at a time so that soss can still shut the player down
+constexpr std::size_t FastBatch = 1024;
+
+} // anonymous namespace
+
+//==============================================================================
+/// Replays a recording that was made by the recorder middleware, with the
+/// same timing as the original traffic or sped up by a constant factor
+class Player : public virtual soss::TopicSubscriberSystem
+{
+public:
+
+  using Clock = std::chrono::steady_clock;
+
+  bool configure(
+      const RequiredTypes&,
+      const YAML::Node& configuration) override
+  {
+    const YAML::Node path_node = configuration[YamlPathKey];
+    if(!path_node)
+    {
+      std::cerr << "[soss::player] The player needs the [" << YamlPathKey
+                << "] of a recording" << std::endl;
+      return false;
+    }
+
+    if(const YAML::Node rate_node = configuration[YamlRateKey])
+    {
+      _rate = rate_node.as<double>();
+      if(_rate < 0.0)
+      {
+        std::cerr << "[soss::player] The [" << YamlRateKey << "] setting "
+                  << "must not be negative, but it is [" << _rate << "]"
+                  << std::endl;
+        return false;
+      }
+    }
+
+    if(const YAML::Node loop_node = configuration[YamlLoopKey])
+      _loop = loop_node.as<bool>();
+
+    _reader = LogReader::make(path_node.as<std::string>());
+    return static_cast<bool>(_reader);
+  }
+
+  bool okay() const override
+  {
+    return static_cast<bool>(_reader);
+  }
+
+  bool subscribe(
+      const std::string& topic_name,
+      const std::string& message_type,
+      SubscriptionCallback callback,
+      const YAML::Node& /*configuration*/) override
+  {
+    Subscription& subscription = _subscriptions[topic_name];
+    subscription.message_type = message_type;
+    subscription.callback = std::move(callback);
+    return true;
+  }
+
+  bool spin_once() override
+  {
+    if(!_reader)
+      return false;
+
+    if(!_started)
+    {
+      _started = true;
+      _fetch();
+      _origin = Clock::now();
+    }
+
+    std::size_t delivered = 0;
+    while(_pending)
+    {
+      if(_rate > 0.0)
+      {
+        if(Clock::now() < _due())
+          break;
+      }
+      else if(delivered == FastBatch)
+      {
+        break;
+      }
+
+      _deliver();
+      ++delivered;
+      _fetch();
+    }
+
+    return true;
+  }
+
+  void wait_for_work(const std::chrono::nanoseconds max_wait) override
+  {
+    if(_pending && _rate == 0.0)
+      return;
+
+    const Clock::time_point now = Clock::now();
+    const Clock::time_point limit = now + max_wait;
+    const Clock::time_point due = _pending? _due() : Clock::time_point::max();
+    if(due <= now)
+      return;
+
+    {
+      std::unique_lock<std::mutex> lock(_wake_mutex);
+      const Clock::time_point until =
+          due - now > SpinMargin? std::min(due - SpinMargin, limit) : now;
+      _wake.wait_until(lock, until, [&]() { return _woken; });
+
+      if(_woken)
+      {
+        _woken = false;
+        return;
+      }
+    }
+
+    if(due > limit)
+      return;
+
+    while(Clock::now() < due)
+    {
+      // Spin until the message is due
+    }
+  }
+
+  void wake_up() override
+  {
+    std::unique_lock<std::mutex> lock(_wake_mutex);
+    _woken = true;
+    _wake.notify_all();
+  }
+
+private:
+
+  struct Subscription
+  {
+    std::string message_type;
+    SubscriptionCallback callback;
+    bool warned = false;
+  };
+
+  /// When the pending record should be delivered
+  Clock::time_point _due() const
+  {
+    return _at(_record.time);
+  }
+
+  /// When a point of the current lap of the recording should be played
+  Clock::time_point _at(const std::chrono::nanoseconds time) const
+  {
+    const auto offset = std::chrono::duration<double, std::nano>(
+          (time - _first).count()/_rate);
+
+    return _origin + std::chrono::duration_cast<Clock::duration>(offset);
+  }
+
+  /// Get the next record that somebody subscribes to
+  void _fetch()
+  {
+    _pending = false;
+    bool rewound = false;
+    while(true)
+    {
+      if(!_reader->next(_record))
+      {
+        // A lap without anything to deliver would make looping spin forever
+        if(!_loop || rewound)
+          return;
+
+        // The next lap starts where this one ended
+        _origin = _rate > 0.0? _at(_last) : Clock::now();
+        _reader->rewind();
+        _lap_started = false;
+        rewound = true;
+        continue;
+      }
+
+      if(!_lap_started)
+      {
+        _first = _record.time;
+        _lap_started = true;
+      }
+
+      _last = _record.time;
+      _topic.assign(_record.topic, _record.topic_length);
+      _subscription = _subscriptions.find(_topic);
+      if(_subscription != _subscriptions.end())
+      {
+        _pending = true;
+        return;
+      }
+    }
+  }
+
+  void _deliver()
+  {
+    Subscription& subscription = _subscription->second;
+    if(!binary::decode(_record.data, _record.size, _message))
+    {
+      std::cerr << "[soss::player] Failed to decode a recorded message on "
+                << "topic [" << _topic << "]" << std::endl;
+      return;
+    }
+
+    if(_message.type != subscription.message_type)
+    {
+      if(!subscription.warned)
+      {
+        std::cerr << "[soss::player] The recording has [" << _message.type
+                  << "] on topic [" << _topic << "] instead of ["
+                  << subscription.message_type << "]. Those messages will "
+                  << "be skipped." << std::endl;
+        subscription.warned = true;
+      }
+      return;
+    }
+
+    const soss::Ingress::Scope ingress;
+    subscription.callback(std::move(_message));
+  }
+
+  std::unique_ptr<LogReader> _reader;
+  double _rate = 1.0;
+  bool _loop = false;
+
+  std::unordered_map<std::string, Subscription> _subscriptions;
+
+  bool _started = false;
+  bool _pending = false;
+  bool _lap_started = false;
+  LogReader::Record _record;
+  std::chrono::nanoseconds _first;
+  std::chrono::nanoseconds _last;
+  Clock::time_point _origin;
+  std::string _topic;
+  std::unordered_map<std::string, Subscription>::iterator _subscription;
+  soss::Message _message;
+
+  std::mutex _wake_mutex;
+  std::condition_variable _wake;
+  bool _woken = false;
+
+};
+
+} // namespace recorder
+} // namespace soss
+
+SOSS_REGISTER_SYSTEM("player", soss::recorder::Player)
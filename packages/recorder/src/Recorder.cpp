@@ -0,0 +1,137 @@
+/*
+ * Copyright (C) 2019 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include "Log.hpp"
+
+#include <soss/Metrics.hpp>
+#include <soss/SystemHandle.hpp>
+
+#include <iostream>
+
+namespace soss {
+namespace recorder {
+
+namespace {
+
+//==============================================================================
+const std::string YamlPathKey = "path";
+const std::string YamlSegmentSizeKey = "segment_size";
+
+constexpr std::size_t DefaultSegmentSize = 64*1024*1024;
+
+//==============================================================================
+class RecordingPublisher : public virtual soss::TopicPublisher
+{
+public:
+
+  RecordingPublisher(
+      const std::string& topic,
+      std::shared_ptr<LogWriter> writer)
+    : _topic(topic),
+      _writer(std::move(writer))
+  {
+    // Do nothing
+  }
+
+  bool publish(const soss::Message& message) override
+  {
+    // Record when the message came into soss rather than when it got here, so
+    // that a replay has the same timing as the original traffic
+    return _writer->append(_topic, soss::Ingress::time(), message);
+  }
+
+private:
+
+  const std::string _topic;
+  const std::shared_ptr<LogWriter> _writer;
+
+};
+
+} // anonymous namespace
+
+//==============================================================================
+/// Records every message that gets routed to it into a directory of
+/// memory-mapped segment files, which the player middleware can replay
+class Recorder : public virtual soss::TopicPublisherSystem
+{
+public:
+
+  bool configure(
+      const RequiredTypes&,
+      const YAML::Node& configuration) override
+  {
+    const YAML::Node path_node = configuration[YamlPathKey];
+    if(!path_node)
+    {
+      std::cerr << "[soss::recorder] The recorder needs a [" << YamlPathKey
+                << "] for its recording" << std::endl;
+      return false;
+    }
+
+    std::size_t segment_size = DefaultSegmentSize;
+    if(const YAML::Node size_node = configuration[YamlSegmentSizeKey])
+    {
+      const int64_t value = size_node.as<int64_t>();
+      if(value <= 0)
+      {
+        std::cerr << "[soss::recorder] The [" << YamlSegmentSizeKey
+                  << "] setting must be positive, but it is [" << value
+                  << "]" << std::endl;
+        return false;
+      }
+
+      segment_size = static_cast<std::size_t>(value);
+    }
+
+    _writer = LogWriter::make(path_node.as<std::string>(), segment_size);
+    return static_cast<bool>(_writer);
+  }
+
+  bool okay() const override
+  {
+    return static_cast<bool>(_writer);
+  }
+
+  bool spin_once() override
+  {
+    // Everything happens inside of the publishers
+    return true;
+  }
+
+  bool self_driven() const override
+  {
+    return true;
+  }
+
+  std::shared_ptr<soss::TopicPublisher> advertise(
+      const std::string& topic_name,
+      const std::string& /*message_type*/,
+      const YAML::Node& /*configuration*/) override
+  {
+    return std::make_shared<RecordingPublisher>(topic_name, _writer);
+  }
+
+private:
+
+  std::shared_ptr<LogWriter> _writer;
+
+};
+
+} // namespace recorder
+} // namespace soss
+
+SOSS_REGISTER_SYSTEM("recorder", soss::recorder::Recorder)
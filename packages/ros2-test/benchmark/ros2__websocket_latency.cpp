@@ -0,0 +1,531 @@
+/*
+ * Copyright (C) 2019 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+
+#include <rclcpp/node.hpp>
+#include <rclcpp/executors/single_threaded_executor.hpp>
+
+#include <soss/Instance.hpp>
+
+#include <nav_msgs/msg/path.hpp>
+#include <nav_msgs/srv/get_plan.hpp>
+
+#include <algorithm>
+#include <condition_variable>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+//==============================================================================
+struct Options
+{
+  std::string config = ROS2__WEBSOCKET_LATENCY__BENCHMARK_CONFIG;
+
+  // Each pair of these gets its own run
+  std::vector<std::size_t> sizes = {1, 100, 1000, 10000};
+  std::vector<double> rates = {10.0, 100.0};
+
+  // How many messages or calls get measured in each run
+  std::size_t count = 200;
+
+  bool topics = true;
+  bool services = true;
+};
+
+//==============================================================================
+void print_usage()
+{
+  std::cout
+      << "Usage: soss-ros2-websocket-benchmark [options]\n\n"
+      << "Sends ros2 messages and service calls through a soss websocket "
+      << "server and\nclient pair and back into ros2, and measures how long "
+      << "they take.\n\n"
+      << "  --config <file>    soss configuration to run\n"
+      << "  --sizes <n,...>    poses in each nav_msgs/Path "
+      << "(1,100,1000,10000)\n"
+      << "  --rates <hz,...>   messages or calls per second (10,100)\n"
+      << "  --count <n>        messages or calls to measure in each run (200)\n"
+      << "  --mode <mode>      topics, services or all (all)\n"
+      << std::endl;
+}
+
+//==============================================================================
+template<typename T, typename Parse>
+std::vector<T> parse_list(const std::string& value, Parse parse)
+{
+  std::vector<T> list;
+  std::stringstream stream(value);
+  std::string entry;
+  while(std::getline(stream, entry, ','))
+    list.push_back(static_cast<T>(parse(entry)));
+
+  return list;
+}
+
+//==============================================================================
+bool parse_options(const int argc, char* argv[], Options& options)
+{
+  for(int i=1; i < argc; ++i)
+  {
+    const std::string arg = argv[i];
+    if(arg == "-h" || arg == "--help")
+    {
+      print_usage();
+      std::exit(0);
+    }
+
+    if(i+1 >= argc)
+    {
+      std::cerr << "Missing a value for the option [" << arg << "]"
+                << std::endl;
+      return false;
+    }
+
+    const std::string value = argv[++i];
+    const auto size = [](const std::string& s) { return std::stoul(s); };
+    const auto real = [](const std::string& s) { return std::stod(s); };
+
+    try
+    {
+      if(arg == "--config")
+        options.config = value;
+      else if(arg == "--sizes")
+        options.sizes = parse_list<std::size_t>(value, size);
+      else if(arg == "--rates")
+        options.rates = parse_list<double>(value, real);
+      else if(arg == "--count")
+        options.count = size(value);
+      else if(arg == "--mode")
+      {
+        if(value != "topics" && value != "services" && value != "all")
+          throw std::invalid_argument(value);
+
+        options.topics = (value != "services");
+        options.services = (value != "topics");
+      }
+      else
+      {
+        std::cerr << "Unknown option [" << arg << "]" << std::endl;
+        return false;
+      }
+    }
+    catch(const std::exception&)
+    {
+      std::cerr << "Invalid value [" << value << "] for the option [" << arg
+                << "]" << std::endl;
+      return false;
+    }
+  }
+
+  for(const double rate : options.rates)
+  {
+    if(rate <= 0.0)
+    {
+      std::cerr << "Every rate must be above zero" << std::endl;
+      return false;
+    }
+  }
+
+  if(options.count == 0 || options.sizes.empty() || options.rates.empty())
+  {
+    std::cerr << "At least one message must be measured" << std::endl;
+    return false;
+  }
+
+  return true;
+}
+
+//==============================================================================
+/// The send time travels inside of the message, so the latency can be read
+/// off of whatever comes back
+builtin_interfaces::msg::Time make_stamp(const Clock::time_point time)
+{
+  const int64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        time.time_since_epoch()).count();
+
+  builtin_interfaces::msg::Time stamp;
+  stamp.sec = static_cast<int32_t>(ns / 1000000000);
+  stamp.nanosec = static_cast<uint32_t>(ns % 1000000000);
+  return stamp;
+}
+
+//==============================================================================
+int64_t elapsed_ns(const builtin_interfaces::msg::Time& stamp)
+{
+  const int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        Clock::now().time_since_epoch()).count();
+  return now - (static_cast<int64_t>(stamp.sec)*1000000000 + stamp.nanosec);
+}
+
+//==============================================================================
+nav_msgs::msg::Path make_path(const std::size_t size)
+{
+  nav_msgs::msg::Path path;
+  path.header.frame_id = "map";
+  path.poses.resize(size);
+  for(std::size_t i=0; i < size; ++i)
+  {
+    geometry_msgs::msg::PoseStamped& pose = path.poses[i];
+    pose.header.frame_id = "map";
+    pose.pose.position.x = static_cast<double>(i);
+    pose.pose.position.y = 0.5*static_cast<double>(i);
+    pose.pose.orientation.w = 1.0;
+  }
+
+  return path;
+}
+
+//==============================================================================
+/// Collects the latencies of one run
+class Recorder
+{
+public:
+
+  void start(const std::size_t count)
+  {
+    std::unique_lock<std::mutex> lock(_mutex);
+    _latencies.clear();
+    _latencies.reserve(count);
+    _active = true;
+  }
+
+  void record(const int64_t latency)
+  {
+    std::unique_lock<std::mutex> lock(_mutex);
+    if(!_active)
+      return;
+
+    _latencies.push_back(latency);
+    _cv.notify_all();
+  }
+
+  /// Wait until a number of results came in, or give up on the rest
+  std::vector<int64_t> finish(
+      const std::size_t count,
+      const std::chrono::milliseconds timeout)
+  {
+    std::unique_lock<std::mutex> lock(_mutex);
+    _cv.wait_for(lock, timeout, [&]() { return _latencies.size() >= count; });
+    _active = false;
+    return std::move(_latencies);
+  }
+
+  std::size_t size() const
+  {
+    std::unique_lock<std::mutex> lock(_mutex);
+    return _latencies.size();
+  }
+
+private:
+
+  mutable std::mutex _mutex;
+  std::condition_variable _cv;
+  std::vector<int64_t> _latencies;
+  bool _active = false;
+
+};
+
+//==============================================================================
+double percentile_us(const std::vector<int64_t>& sorted, const double p)
+{
+  if(sorted.empty())
+    return 0.0;
+
+  const std::size_t index = std::min(
+        sorted.size() - 1,
+        static_cast<std::size_t>(p*static_cast<double>(sorted.size())));
+  return static_cast<double>(sorted[index])*1e-3;
+}
+
+//==============================================================================
+void print_header()
+{
+  std::cout << std::left
+            << std::setw(10) << "variant"
+            << std::setw(8) << "poses"
+            << std::setw(8) << "rate"
+            << std::setw(12) << "received"
+            << std::setw(12) << "p50 (us)"
+            << std::setw(12) << "p90 (us)"
+            << std::setw(12) << "p99 (us)"
+            << std::setw(12) << "max (us)"
+            << std::endl;
+}
+
+//==============================================================================
+void print_row(
+    const std::string& variant,
+    const std::size_t size,
+    const double rate,
+    const std::size_t count,
+    std::vector<int64_t> latencies)
+{
+  std::sort(latencies.begin(), latencies.end());
+  std::stringstream received;
+  received << latencies.size() << "/" << count;
+
+  std::cout << std::left << std::fixed << std::setprecision(1)
+            << std::setw(10) << variant
+            << std::setw(8) << size
+            << std::setw(8) << rate
+            << std::setw(12) << received.str()
+            << std::setw(12) << percentile_us(latencies, 0.5)
+            << std::setw(12) << percentile_us(latencies, 0.9)
+            << std::setw(12) << percentile_us(latencies, 0.99)
+            << std::setw(12)
+            << (latencies.empty()? 0.0 : latencies.back()*1e-3)
+            << std::endl;
+}
+
+//==============================================================================
+Clock::duration period_of(const double rate)
+{
+  return std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double>(1.0/rate));
+}
+
+//==============================================================================
+class Benchmark
+{
+public:
+
+  Benchmark(const Options& options)
+    : _options(options),
+      _node(std::make_shared<rclcpp::Node>("soss_latency_benchmark_probe"))
+  {
+    const auto echo = [this](nav_msgs::msg::Path::UniquePtr path)
+    {
+      _topic_results.record(elapsed_ns(path->header.stamp));
+    };
+
+    const auto provide = [this](
+        const std::shared_ptr<rmw_request_id_t> /*request_header*/,
+        const std::shared_ptr<nav_msgs::srv::GetPlan::Request> request,
+        const std::shared_ptr<nav_msgs::srv::GetPlan::Response> response)
+    {
+      // The plan echoes the stamp of the start pose, and has as many poses
+      // as the start pose asks for through its x coordinate
+      response->plan = make_path(
+            static_cast<std::size_t>(request->start.pose.position.x));
+      response->plan.header.stamp = request->start.header.stamp;
+    };
+
+#ifndef RCLCPP__QOS_HPP_
+    _publisher = _node->create_publisher<nav_msgs::msg::Path>("bench_path");
+    _subscription = _node->create_subscription<nav_msgs::msg::Path>(
+          "bench_path_echo", echo);
+#else
+    _publisher = _node->create_publisher<nav_msgs::msg::Path>(
+          "bench_path", rclcpp::SystemDefaultsQoS());
+    _subscription = _node->create_subscription<nav_msgs::msg::Path>(
+          "bench_path_echo", rclcpp::SystemDefaultsQoS(), echo);
+#endif // RCLCPP__QOS_HPP_
+
+    _provider = _node->create_service<nav_msgs::srv::GetPlan>(
+          "bench_plan_provider", provide);
+    _client = _node->create_client<nav_msgs::srv::GetPlan>("bench_plan");
+
+    _executor.add_node(_node);
+    _spinner = std::thread([this]() { _executor.spin(); });
+  }
+
+  ~Benchmark()
+  {
+    _executor.cancel();
+    _spinner.join();
+  }
+
+  /// The websocket client needs a moment to connect to the server, so we keep
+  /// probing until something makes it all the way through
+  bool wait_until_connected(const std::chrono::seconds timeout)
+  {
+    using namespace std::chrono_literals;
+
+    const auto deadline = Clock::now() + timeout;
+    if(_options.topics)
+    {
+      _topic_results.start(1);
+      while(_topic_results.size() == 0)
+      {
+        if(Clock::now() > deadline)
+          return false;
+
+        nav_msgs::msg::Path path = make_path(1);
+        path.header.stamp = make_stamp(Clock::now());
+        _publisher->publish(path);
+        std::this_thread::sleep_for(100ms);
+      }
+      _topic_results.finish(1, 0ms);
+    }
+
+    if(_options.services)
+    {
+      if(!_client->wait_for_service(std::chrono::duration_cast<
+            std::chrono::nanoseconds>(deadline - Clock::now())))
+        return false;
+
+      _service_results.start(1);
+      while(_service_results.size() == 0)
+      {
+        if(Clock::now() > deadline)
+          return false;
+
+        _call(1, Clock::now());
+        std::this_thread::sleep_for(100ms);
+      }
+      _service_results.finish(1, 0ms);
+    }
+
+    return true;
+  }
+
+  void run_topics(const std::size_t size, const double rate)
+  {
+    nav_msgs::msg::Path path = make_path(size);
+    const Clock::duration period = period_of(rate);
+
+    _topic_results.start(_options.count);
+    Clock::time_point next_send = Clock::now();
+    for(std::size_t i=0; i < _options.count; ++i)
+    {
+      std::this_thread::sleep_until(next_send);
+      next_send += period;
+
+      path.header.stamp = make_stamp(Clock::now());
+      _publisher->publish(path);
+    }
+
+    print_row("topic", size, rate, _options.count,
+              _topic_results.finish(_options.count, std::chrono::seconds(5)));
+  }
+
+  void run_services(const std::size_t size, const double rate)
+  {
+    const Clock::duration period = period_of(rate);
+
+    _service_results.start(_options.count);
+    Clock::time_point next_send = Clock::now();
+    for(std::size_t i=0; i < _options.count; ++i)
+    {
+      std::this_thread::sleep_until(next_send);
+      next_send += period;
+
+      _call(size, Clock::now());
+    }
+
+    print_row("service", size, rate, _options.count,
+              _service_results.finish(_options.count, std::chrono::seconds(5)));
+  }
+
+private:
+
+  void _call(const std::size_t size, const Clock::time_point sent)
+  {
+    auto request = std::make_shared<nav_msgs::srv::GetPlan::Request>();
+    request->start.header.stamp = make_stamp(sent);
+    request->start.pose.position.x = static_cast<double>(size);
+    request->goal.pose.orientation.w = 1.0;
+
+    using Future = rclcpp::Client<nav_msgs::srv::GetPlan>::SharedFuture;
+    _client->async_send_request(request, [this](Future future)
+    {
+      _service_results.record(elapsed_ns(future.get()->plan.header.stamp));
+    });
+  }
+
+  const Options& _options;
+
+  rclcpp::Node::SharedPtr _node;
+  rclcpp::executors::SingleThreadedExecutor _executor;
+  std::thread _spinner;
+
+  rclcpp::Publisher<nav_msgs::msg::Path>::SharedPtr _publisher;
+  rclcpp::Subscription<nav_msgs::msg::Path>::SharedPtr _subscription;
+  rclcpp::Service<nav_msgs::srv::GetPlan>::SharedPtr _provider;
+  rclcpp::Client<nav_msgs::srv::GetPlan>::SharedPtr _client;
+
+  Recorder _topic_results;
+  Recorder _service_results;
+
+};
+
+} // anonymous namespace
+
+//==============================================================================
+int main(int argc, char* argv[])
+{
+  using namespace std::chrono_literals;
+
+  Options options;
+  if(!parse_options(argc, argv, options))
+  {
+    print_usage();
+    return 1;
+  }
+
+  soss::InstanceHandle handle = soss::run_instance(
+        options.config, {ROS2__ROSIDL__BUILD_DIR});
+  if(!handle)
+  {
+    std::cerr << "Failed to start soss with [" << options.config << "]"
+              << std::endl;
+    return 1;
+  }
+
+  // soss keeps its rclcpp contexts to itself, so the probe needs its own
+  rclcpp::init(argc, argv);
+
+  int result = 0;
+  {
+    Benchmark benchmark(options);
+    if(!benchmark.wait_until_connected(30s))
+    {
+      std::cerr << "Nothing came back through the websocket within 30 seconds"
+                << std::endl;
+      result = 1;
+    }
+    else
+    {
+      std::cout << "config: " << options.config << "\n" << std::endl;
+      print_header();
+      for(const double rate : options.rates)
+      {
+        for(const std::size_t size : options.sizes)
+        {
+          if(options.topics)
+            benchmark.run_topics(size, rate);
+
+          if(options.services)
+            benchmark.run_services(size, rate);
+        }
+      }
+    }
+  }
+
+  rclcpp::shutdown();
+
+  handle.quit().wait_for(1min);
+  return result;
+}
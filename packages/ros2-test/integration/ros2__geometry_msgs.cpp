@@ -166,6 +166,13 @@ TEST_CASE("Talk between ros2 and the mock middleware", "[ros2]")
 
   REQUIRE(handle);
 
+  // soss keeps its rclcpp contexts to itself, so the test needs its own
+  if(!rclcpp::is_initialized())
+  {
+    const char* const argv[] = {"soss_test"};
+    rclcpp::init(1, argv);
+  }
+
   rclcpp::Node::SharedPtr ros2 = std::make_shared<rclcpp::Node>("ros2_test");
   rclcpp::executors::SingleThreadedExecutor executor;
 
@@ -122,6 +122,13 @@ TEST_CASE("Transmit and receive all test messages", "[ros2]")
 
   REQUIRE(handle);
 
+  // soss keeps its rclcpp contexts to itself, so the test needs its own
+  if(!rclcpp::is_initialized())
+  {
+    const char* const argv[] = {"soss_test"};
+    rclcpp::init(1, argv);
+  }
+
   rclcpp::Node::SharedPtr ros2 = std::make_shared<rclcpp::Node>("ros2_test");
   rclcpp::executors::SingleThreadedExecutor executor;
 
@@ -358,6 +365,13 @@ TEST_CASE("Transmit and receive all test messages", "[ros2]")
 
   REQUIRE(handle);
 
+  // soss keeps its rclcpp contexts to itself, so the test needs its own
+  if(!rclcpp::is_initialized())
+  {
+    const char* const argv[] = {"soss_test"};
+    rclcpp::init(1, argv);
+  }
+
   rclcpp::Node::SharedPtr ros2 = std::make_shared<rclcpp::Node>("ros2_test");
   rclcpp::executors::SingleThreadedExecutor executor;
 
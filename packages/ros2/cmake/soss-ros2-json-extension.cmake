@@ -0,0 +1,4 @@
+# soss-ros2 was built with direct_json support, so anything that links to it
+# also needs soss-json.
+include(CMakeFindDependencyMacro)
+find_dependency(soss-json)
@@ -41,6 +41,37 @@ public:
   /// factories with this singleton so that
   static Factory& instance();
 
+  /// \brief The callback group that a subscription or service should be
+  /// assigned to. A nullptr means the default callback group of the node.
+  using CallbackGroupPtr = rclcpp::callback_group::CallbackGroup::SharedPtr;
+
+
+  /// \brief Optional behaviors of a subscription
+  struct SubscriptionOptions
+  {
+    // This is a nested class used in a default argument, so its members must
+    // be initialized by a constructor rather than default member initializers
+    SubscriptionOptions()
+      : direct_json(false),
+        serialized(false)
+    {
+      // Do nothing
+    }
+
+    /// Attach each incoming ROS 2 message to the soss::Message as a
+    /// soss::json::NativeJson instead of converting its fields. This is only
+    /// available if soss-ros2 was built with soss-json, and it should only be
+    /// used on routes whose publishers all encode messages with soss::json,
+    /// e.g. websocket.
+    bool direct_json;
+
+    /// Receive the serialized (CDR) form of each ROS 2 message and attach it to
+    /// the soss::Message as a soss::ros2::NativeSerializedMessage, leaving its
+    /// fields empty. A ros2 publisher of the same message type will forward
+    /// the bytes untouched, so this should only be used on routes whose
+    /// publishers all belong to ros2 systems. Requires rclcpp foxy or newer.
+    bool serialized;
+  };
 
   /// \brief Signature for subscription factories
   using SubscriptionFactory =
@@ -48,7 +79,9 @@ public:
           rclcpp::Node& node,
           const std::string& topic_name,
           TopicSubscriberSystem::SubscriptionCallback callback,
-          const rmw_qos_profile_t& qos_profile)>;
+          const rmw_qos_profile_t& qos_profile,
+          const CallbackGroupPtr& callback_group,
+          const SubscriptionOptions& options)>;
 
   /// \brief Register a subscription factory
   void register_subscription_factory(
@@ -62,7 +95,9 @@ public:
       rclcpp::Node& node,
       const std::string& topic_name,
       TopicSubscriberSystem::SubscriptionCallback callback,
-      const rmw_qos_profile_t& qos_profile);
+      const rmw_qos_profile_t& qos_profile,
+      const CallbackGroupPtr& callback_group = nullptr,
+      const SubscriptionOptions& options = SubscriptionOptions());
 
 
   /// \brief Signature for publisher factories
@@ -91,7 +126,8 @@ public:
           rclcpp::Node& node,
           const std::string& service_name,
           const ServiceClientSystem::RequestCallback& callback,
-          const rmw_qos_profile_t& qos_profile)>;
+          const rmw_qos_profile_t& qos_profile,
+          const CallbackGroupPtr& callback_group)>;
 
   /// \brief Register a client proxy factory
   void register_client_proxy_factory(
@@ -105,7 +141,8 @@ public:
       rclcpp::Node& node,
       const std::string& service_name,
       const ServiceClientSystem::RequestCallback& callback,
-      const rmw_qos_profile_t& qos_profile);
+      const rmw_qos_profile_t& qos_profile,
+      const CallbackGroupPtr& callback_group = nullptr);
 
 
   /// \brief Signature for server proxy factories
@@ -113,7 +150,8 @@ public:
       std::function<std::shared_ptr<ServiceProvider>(
           rclcpp::Node& node,
           const std::string& service_name,
-          const rmw_qos_profile_t& qos_profile)>;
+          const rmw_qos_profile_t& qos_profile,
+          const CallbackGroupPtr& callback_group)>;
 
   /// \brief Register a server proxy factory
   void register_server_proxy_factory(
@@ -126,7 +164,8 @@ public:
       const std::string& service_type,
       rclcpp::Node& node,
       const std::string& service_name,
-      const rmw_qos_profile_t& qos_profile);
+      const rmw_qos_profile_t& qos_profile,
+      const CallbackGroupPtr& callback_group = nullptr);
 
 private:
 
@@ -0,0 +1,85 @@
+/*
+ * Copyright (C) 2019 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#ifndef SOSS__ROS2__JSON_HPP
+#define SOSS__ROS2__JSON_HPP
+
+#include <soss/ros2/utilities.hpp>
+
+#ifdef SOSS_ROS2__DIRECT_JSON
+
+#include <soss/json/native.hpp>
+
+namespace soss {
+namespace json {
+
+//==============================================================================
+template<typename ElementType, std::size_t UpperBound, typename Allocator>
+struct ToJson<
+  rosidl_generator_cpp::BoundedVector<ElementType, UpperBound, Allocator>>
+{
+  static void convert(
+      const rosidl_generator_cpp::BoundedVector<
+        ElementType, UpperBound, Allocator>& from,
+      Json& to)
+  {
+    container_to_json<ElementType>(from, to);
+  }
+};
+
+} // namespace json
+
+namespace ros2 {
+
+//==============================================================================
+/// NativeJsonMessage takes ownership of a ROS 2 message that was received by a
+/// subscription, so that it can be attached to a soss::Message and written
+/// straight into JSON by the generated soss::json::ToJson specialization of
+/// its type.
+template<typename Ros2_Msg>
+class NativeJsonMessage final : public soss::json::NativeJson
+{
+public:
+
+  NativeJsonMessage(typename Ros2_Msg::UniquePtr message)
+    : _message(std::move(message))
+  {
+    // Do nothing
+  }
+
+  void to_json(soss::json::Json& output) const override
+  {
+    soss::json::ToJson<Ros2_Msg>::convert(*_message, output);
+  }
+
+  const Ros2_Msg& message() const
+  {
+    return *_message;
+  }
+
+private:
+
+  const typename Ros2_Msg::UniquePtr _message;
+
+};
+
+} // namespace ros2
+} // namespace soss
+
+#endif // SOSS_ROS2__DIRECT_JSON
+
+#endif // SOSS__ROS2__JSON_HPP
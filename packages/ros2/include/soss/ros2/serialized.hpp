@@ -0,0 +1,81 @@
+/*
+ * Copyright (C) 2019 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#ifndef SOSS__ROS2__SERIALIZED_HPP
+#define SOSS__ROS2__SERIALIZED_HPP
+
+#include <soss/Message.hpp>
+
+// Subscriptions can receive serialized messages through rclcpp's own type
+// since rclcpp foxy
+#if defined(__has_include)
+#  if __has_include(<rclcpp/serialized_message.hpp>)
+#    define SOSS_ROS2__SERIALIZED_MESSAGES
+#  endif
+#endif
+
+#ifdef SOSS_ROS2__SERIALIZED_MESSAGES
+
+#include <rclcpp/serialized_message.hpp>
+
+#include <memory>
+#include <string>
+
+namespace soss {
+namespace ros2 {
+
+//==============================================================================
+/// NativeSerializedMessage carries the serialized (CDR) form of a ROS 2 message
+/// exactly as a subscription received it, so that a ros2 publisher of the same
+/// type can forward the bytes without deserializing them.
+class NativeSerializedMessage final : public virtual soss::NativeMessage
+{
+public:
+
+  NativeSerializedMessage(
+      const std::string& type,
+      std::shared_ptr<rclcpp::SerializedMessage> message)
+    : _type(type),
+      _message(std::move(message))
+  {
+    // Do nothing
+  }
+
+  /// \brief The ROS 2 type of the serialized message, e.g. "std_msgs/String"
+  const std::string& type() const
+  {
+    return _type;
+  }
+
+  const rclcpp::SerializedMessage& message() const
+  {
+    return *_message;
+  }
+
+private:
+
+  const std::string _type;
+  const std::shared_ptr<rclcpp::SerializedMessage> _message;
+
+};
+
+} // namespace ros2
+} // namespace soss
+
+#endif // SOSS_ROS2__SERIALIZED_MESSAGES
+
+#endif // SOSS__ROS2__SERIALIZED_HPP
@@ -21,17 +21,23 @@
 #include <soss/utilities.hpp>
 #include <rosidl_generator_cpp/bounded_vector.hpp>
 
+// Publishers can lend out middleware memory for messages since rclcpp foxy
+#if defined(__has_include)
+#  if __has_include(<rclcpp/loaned_message.hpp>)
+#    define SOSS_ROS2__LOANED_MESSAGES
+#  endif
+#endif
+
 namespace soss {
 
 //==============================================================================
 template<typename ElementType, std::size_t UpperBound, typename Allocator>
 struct Convert<
   rosidl_generator_cpp::BoundedVector<ElementType, UpperBound, Allocator>>
-    : ContainerConvert<
+    : SequenceConvert<
     ElementType,
     rosidl_generator_cpp::BoundedVector<ElementType, UpperBound, Allocator>,
-    std::vector<typename Convert<ElementType>::soss_type>,
-    soss::convert_bounded_vector<ElementType, UpperBound> > { };
+    UpperBound> { };
 
 } // namespace soss
 
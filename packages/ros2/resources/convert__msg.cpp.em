@@ -30,10 +30,18 @@ conversion_dependency = 'soss/rosidl/ros2/{}/msg/convert__msg__{}.hpp'.format(
 
 // Include the Factory header so we can add this message type to the Factory
 #include <soss/ros2/Factory.hpp>
+#include <soss/ros2/serialized.hpp>
 
 // Include the Node API so we can subscribe and advertise
 #include <rclcpp/node.hpp>
 
+#include <soss/Metrics.hpp>
+#include <soss/Trace.hpp>
+
+#include <chrono>
+#include <iostream>
+#include <type_traits>
+
 namespace soss {
 namespace ros2 {
 namespace @(namespace_variable) {
@@ -47,42 +55,125 @@ public:
       rclcpp::Node& node,
       TopicSubscriberSystem::SubscriptionCallback callback,
       const std::string& topic_name,
-      const rmw_qos_profile_t& qos_profile)
-    : _callback(std::move(callback))
+      const rmw_qos_profile_t& qos_profile,
+      const Factory::CallbackGroupPtr& callback_group,
+      const Factory::SubscriptionOptions& options)
+    : _callback(std::move(callback)),
+      _metrics(soss::Metrics::topic(topic_name)),
+      _direct_json(options.direct_json),
+      _pool(0)
   {
-    _message = initialize();
+    if(_direct_json || options.serialized)
+    {
+      // The fields are not used when the native message gets attached
+      _pool.setInitializer([]()
+      {
+        soss::Message message;
+        message.type = g_msg_name;
+        return message;
+      });
+    }
+
+#ifdef SOSS_ROS2__SERIALIZED_MESSAGES
+    if(options.serialized)
+    {
+      rclcpp::SubscriptionOptions ros2_options;
+      ros2_options.callback_group = callback_group;
+
+      _subscription = node.create_subscription<Ros2_Msg>(
+            topic_name,
+            rclcpp::QoS(rclcpp::QoSInitialization::from_rmw(qos_profile)),
+            [=](std::shared_ptr<rclcpp::SerializedMessage> msg)
+            { this->serialized_callback(std::move(msg)); },
+            ros2_options);
+      return;
+    }
+#endif // SOSS_ROS2__SERIALIZED_MESSAGES
 
 #ifndef RCLCPP__QOS_HPP_
     _subscription = node.create_subscription<Ros2_Msg>(
           topic_name,
-          [=](Ros2_Msg::UniquePtr msg) { this->subscription_callback(*msg); },
-          qos_profile);
+          [=](Ros2_Msg::UniquePtr msg)
+          { this->subscription_callback(std::move(msg)); },
+          qos_profile,
+          callback_group);
 #else
+    rclcpp::SubscriptionOptions ros2_options;
+    ros2_options.callback_group = callback_group;
+
     _subscription = node.create_subscription<Ros2_Msg>(
           topic_name,
           rclcpp::QoS(rclcpp::QoSInitialization::from_rmw(qos_profile)),
-          [=](Ros2_Msg::UniquePtr msg) { this->subscription_callback(*msg); });
+          [=](Ros2_Msg::UniquePtr msg)
+          { this->subscription_callback(std::move(msg)); },
+          ros2_options);
 #endif
   }
 
 private:
 
-  void subscription_callback(const Ros2_Msg& msg)
+  void subscription_callback(Ros2_Msg::UniquePtr msg)
   {
-    convert_to_soss(msg, _message);
-    _callback(_message);
+    // Mark when the message arrived, so the metrics include its conversion
+    const soss::Ingress::Scope ingress;
+
+#ifdef SOSS_ROS2__DIRECT_JSON
+    if(_direct_json)
+    {
+      // Hand over the message itself, so it can be written straight into JSON
+      // by whoever receives it. The soss::Message fields are left empty.
+      const std::shared_ptr<soss::Message> message = _pool.lease();
+      message->native =
+          std::make_shared<NativeJsonMessage<Ros2_Msg>>(std::move(msg));
+      _callback(*message);
+      message->native.reset();
+      return;
+    }
+#endif // SOSS_ROS2__DIRECT_JSON
+
+    const std::shared_ptr<soss::Message> message = _pool.lease();
+    const auto start = std::chrono::steady_clock::now();
+    SOSS_TRACE(convert_to_soss_begin, g_msg_name.c_str(), message.get());
+    convert_to_soss(*msg, *message);
+    SOSS_TRACE(convert_to_soss_end, g_msg_name.c_str(), message.get());
+    _metrics.record_conversion(std::chrono::steady_clock::now() - start);
+
+    _callback(*message);
   }
 
+#ifdef SOSS_ROS2__SERIALIZED_MESSAGES
+  void serialized_callback(std::shared_ptr<rclcpp::SerializedMessage> msg)
+  {
+    // Hand over the CDR bytes so that ros2 publishers of the same type can
+    // forward them without deserializing. The soss::Message fields are left
+    // empty.
+    const soss::Ingress::Scope ingress;
+    _metrics.count_bytes(msg->size());
+    const std::shared_ptr<soss::Message> message = _pool.lease();
+    message->native = std::make_shared<NativeSerializedMessage>(
+          g_msg_name, std::move(msg));
+    _callback(*message);
+    message->native.reset();
+  }
+#endif // SOSS_ROS2__SERIALIZED_MESSAGES
+
   // Save the SOSS callback that we were given by the soss-ros2 plugin
   TopicSubscriberSystem::SubscriptionCallback _callback;
 
-  // Save a pre-initialized copy of the message so that we don't need to
-  // allocate and deallocate more than necessary
-  soss::Message _message;
+  soss::ChannelMetrics& _metrics;
+
+  // True if we attach the native message instead of converting it
+  const bool _direct_json;
+
+  // Pre-initialized messages, so that we don't need to allocate and deallocate
+  // more than necessary. Each callback leases one of its own, which keeps
+  // concurrent callbacks from sharing a message.
+  soss::ResourcePool<soss::Message, &initialize> _pool;
 
   // Hang onto the subscription handle to make sure the connection to the topic
-  // stays alive
-  rclcpp::Subscription<Ros2_Msg>::SharedPtr _subscription;
+  // stays alive. Serialized subscriptions have a different type, so we only
+  // keep the base class.
+  rclcpp::SubscriptionBase::SharedPtr _subscription;
 
 };
 
@@ -91,10 +182,13 @@ std::shared_ptr<void> subscribe(
     rclcpp::Node& node,
     const std::string& topic_name,
     TopicSubscriberSystem::SubscriptionCallback callback,
-    const rmw_qos_profile_t& qos_profile)
+    const rmw_qos_profile_t& qos_profile,
+    const Factory::CallbackGroupPtr& callback_group,
+    const Factory::SubscriptionOptions& options)
 {
   return std::make_shared<Subscription>(
-        node, std::move(callback), topic_name, qos_profile);
+        node, std::move(callback), topic_name, qos_profile, callback_group,
+        options);
 }
 
 namespace {
@@ -110,6 +204,7 @@ public:
       rclcpp::Node& node,
       const std::string& topic_name,
       const rmw_qos_profile_t& qos_profile)
+    : _metrics(soss::Metrics::topic(topic_name))
   {
 #ifndef RCLCPP__QOS_HPP_
     // If the rclcpp/qos.hpp header does not exist, then we assume that we
@@ -120,21 +215,148 @@ public:
           topic_name,
           rclcpp::QoS(rclcpp::QoSInitialization::from_rmw(qos_profile)));
 #endif
+
+#ifdef SOSS_ROS2__LOANED_MESSAGES
+    // Middlewares only lend out memory for messages of a fixed size, which we
+    // can convert into directly. We also require that the type is trivially
+    // copyable, because the loaned memory may not have been constructed.
+    _loan_messages = std::is_trivially_copyable<Ros2_Msg>::value
+        && _publisher->can_loan_messages();
+#endif // SOSS_ROS2__LOANED_MESSAGES
   }
 
   bool publish(const soss::Message& message) override
   {
+#ifdef SOSS_ROS2__DIRECT_JSON
+    // A message that came from a ros2 subscription of the same type with
+    // direct_json enabled can be published as-is.
+    if(const auto* native = dynamic_cast<const NativeJsonMessage<Ros2_Msg>*>(
+         message.native.get()))
+    {
+      _publisher->publish(native->message());
+      return true;
+    }
+#endif // SOSS_ROS2__DIRECT_JSON
+
+#ifdef SOSS_ROS2__SERIALIZED_MESSAGES
+    // A message that came from a serialized ros2 subscription is forwarded
+    // byte for byte, as long as it has the same type as this publisher.
+    if(const auto* serialized = dynamic_cast<const NativeSerializedMessage*>(
+         message.native.get()))
+    {
+      if(serialized->type() != g_msg_name)
+      {
+        std::cerr << "[soss::ros2] A serialized message of type ["
+                  << serialized->type() << "] cannot be published as ["
+                  << g_msg_name << "]. Remove the [serialized] option from "
+                  << "the topic, so that its messages get converted."
+                  << std::endl;
+        return false;
+      }
+
+      _metrics.count_bytes(serialized->message().size());
+      _publisher->publish(serialized->message());
+      return true;
+    }
+#endif // SOSS_ROS2__SERIALIZED_MESSAGES
+
+#ifdef SOSS_ROS2__LOANED_MESSAGES
+    if(_loan_messages)
+    {
+      // Convert straight into the memory of the middleware, so that the
+      // message does not get copied again when it is published.
+      auto loaned_msg = _publisher->borrow_loaned_message();
+      const auto start = std::chrono::steady_clock::now();
+      SOSS_TRACE(convert_from_soss_begin, g_msg_name.c_str(), &message);
+      convert_to_ros2(message, loaned_msg.get());
+      SOSS_TRACE(convert_from_soss_end, g_msg_name.c_str(), &message);
+      _metrics.record_conversion(std::chrono::steady_clock::now() - start);
+
+      _publisher->publish(std::move(loaned_msg));
+      return true;
+    }
+#endif // SOSS_ROS2__LOANED_MESSAGES
+
     Ros2_Msg ros2_msg;
+    const auto start = std::chrono::steady_clock::now();
+    SOSS_TRACE(convert_from_soss_begin, g_msg_name.c_str(), &message);
     convert_to_ros2(message, ros2_msg);
+    SOSS_TRACE(convert_from_soss_end, g_msg_name.c_str(), &message);
+    _metrics.record_conversion(std::chrono::steady_clock::now() - start);
 
     _publisher->publish(ros2_msg);
     return true;
   }
 
+  bool publish_owned(soss::Message&& message) override
+  {
+#if defined(SOSS_ROS2__DIRECT_JSON) || defined(SOSS_ROS2__SERIALIZED_MESSAGES)
+    if(message.native)
+      return publish(message);
+#endif
+
+#ifdef SOSS_ROS2__LOANED_MESSAGES
+    // Loans are only used for trivially copyable types, which have no strings
+    // or arrays that could be moved
+    if(_loan_messages)
+      return publish(message);
+#endif // SOSS_ROS2__LOANED_MESSAGES
+
+    // Nothing else needs the message, so its strings and arrays can be moved
+    // into the ros2 message instead of copied
+    Ros2_Msg ros2_msg;
+    const auto start = std::chrono::steady_clock::now();
+    SOSS_TRACE(convert_from_soss_begin, g_msg_name.c_str(), &message);
+    convert_to_ros2(std::move(message), ros2_msg);
+    SOSS_TRACE(convert_from_soss_end, g_msg_name.c_str(), &message);
+    _metrics.record_conversion(std::chrono::steady_clock::now() - start);
+
+    _publisher->publish(ros2_msg);
+    return true;
+  }
+
+  bool publish_envelope(const soss::MessageEnvelope& envelope) override
+  {
+#if defined(SOSS_ROS2__DIRECT_JSON) || defined(SOSS_ROS2__SERIALIZED_MESSAGES)
+    if(envelope.message().native)
+      return publish(envelope.message());
+#endif
+
+#ifdef SOSS_ROS2__LOANED_MESSAGES
+    // Each publisher needs a loan of its own, so there is nothing to share
+    if(_loan_messages)
+      return publish(envelope.message());
+#endif // SOSS_ROS2__LOANED_MESSAGES
+
+    // Every ros2 publisher of this message type on the route can share the
+    // same conversion, even if they live on different nodes or domains.
+    const std::shared_ptr<const Ros2_Msg> ros2_msg =
+        envelope.encoding<Ros2_Msg>(
+          "ros2/" + g_msg_name,
+          [this](const soss::Message& message)
+    {
+      auto converted = std::make_shared<Ros2_Msg>();
+      const auto start = std::chrono::steady_clock::now();
+      SOSS_TRACE(convert_from_soss_begin, g_msg_name.c_str(), &message);
+      convert_to_ros2(message, *converted);
+      SOSS_TRACE(convert_from_soss_end, g_msg_name.c_str(), &message);
+      _metrics.record_conversion(std::chrono::steady_clock::now() - start);
+      return std::shared_ptr<const Ros2_Msg>(std::move(converted));
+    });
+
+    _publisher->publish(*ros2_msg);
+    return true;
+  }
+
 private:
 
   rclcpp::Publisher<Ros2_Msg>::SharedPtr _publisher;
 
+  soss::ChannelMetrics& _metrics;
+
+  // True if the middleware lends us the memory of each message
+  bool _loan_messages = false;
+
 };
 
 //==============================================================================
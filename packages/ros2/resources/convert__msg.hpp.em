@@ -54,6 +54,10 @@ alphabetical_fields = sorted(spec.fields, key=lambda x: x.name)
 // Include the header for the generic soss message type
 #include <soss/ros2/utilities.hpp>
 
+// Include the header for writing ros2 messages straight into JSON, if soss-ros2
+// was built with support for it
+#include <soss/ros2/json.hpp>
+
 // Include the header for the concrete ros2 message type
 #include <@(ros2_msg_dependency)>
 
@@ -78,6 +82,7 @@ inline soss::Message initialize()
 {
   soss::Message msg;
   msg.type = g_msg_name;
+  msg.data.reserve(@(len(alphabetical_fields)));
 @[for field in alphabetical_fields]@
   soss::Convert<Ros2_Msg::_@(field.name)_type>::add_field(msg, "@(field.name)");
 @[end for]@
@@ -100,8 +105,32 @@ inline void convert_to_ros2(const soss::Message& from, Ros2_Msg& to)
 }
 
 //==============================================================================
+/// Same as convert_to_ros2(~), except the strings and arrays of the message get
+/// moved instead of copied. This is used when nothing else needs the message.
+inline void convert_to_ros2(soss::Message&& from, Ros2_Msg& to)
+{
+  auto from_field = from.data.begin();
+@[for field in alphabetical_fields]@
+  soss::move_from_soss_field<soss::Convert<Ros2_Msg::_@(field.name)_type>>(from_field++, to.@(field.name));
+@[end for]@
+
+  // Suppress possible unused variable warnings
+  (void)from;
+  (void)to;
+  (void)from_field;
+}
+
+//==============================================================================
+/// The fields that the message already holds get updated in place, so a
+/// message that is converted again and again, e.g. one from a pool, keeps
+/// reusing its nested messages and buffers.
 inline void convert_to_soss(const Ros2_Msg& from, soss::Message& to)
 {
+  // A message that does not hold the fields of this type, e.g. one whose
+  // contents were moved away, needs to be initialized first
+  if(to.data.size() != @(len(alphabetical_fields)) || to.type != g_msg_name)
+    to = initialize();
+
   auto to_field = to.data.begin();
 @[for field in alphabetical_fields]@
   soss::Convert<Ros2_Msg::_@(field.name)_type>::to_soss_field(from.@(field.name), to_field++);
@@ -113,6 +142,23 @@ inline void convert_to_soss(const Ros2_Msg& from, soss::Message& to)
   (void)to_field;
 }
 
+#ifdef SOSS_ROS2__DIRECT_JSON
+//==============================================================================
+/// Write the message straight into JSON, without going through soss::Message.
+/// This gives the same result as convert_to_soss(~) followed by
+/// soss::json::convert(~).
+inline void convert_to_json(const Ros2_Msg& from, soss::json::Json& to)
+{
+  to = soss::json::Json::object();
+@[for field in alphabetical_fields]@
+  soss::json::ToJson<Ros2_Msg::_@(field.name)_type>::convert(from.@(field.name), to["@(field.name)"]);
+@[end for]@
+
+  // Suppress possible unused variable warnings
+  (void)from;
+}
+#endif // SOSS_ROS2__DIRECT_JSON
+
 } // namespace @(namespace_variable)
 } // namespace ros2
 
@@ -122,9 +168,27 @@ struct Convert<ros2::@(namespace_variable)::Ros2_Msg>
      ros2::@(namespace_variable)::Ros2_Msg,
     &ros2::@(namespace_variable)::initialize,
     &ros2::@(namespace_variable)::convert_to_ros2,
-    &ros2::@(namespace_variable)::convert_to_soss
+    &ros2::@(namespace_variable)::convert_to_soss,
+    &ros2::@(namespace_variable)::convert_to_ros2
     > { };
 
+#ifdef SOSS_ROS2__DIRECT_JSON
+namespace json {
+
+template<>
+struct ToJson<ros2::@(namespace_variable)::Ros2_Msg>
+{
+  static void convert(
+      const ros2::@(namespace_variable)::Ros2_Msg& from,
+      Json& to)
+  {
+    ros2::@(namespace_variable)::convert_to_json(from, to);
+  }
+};
+
+} // namespace json
+#endif // SOSS_ROS2__DIRECT_JSON
+
 } // namespace soss
 
 #endif // @(header_guard_variable)
@@ -76,6 +76,7 @@ soss::Message initialize_request()
 {
   soss::Message msg;
   msg.type = g_request_name;
+  msg.data.reserve(@(len(alphabetical_request_fields)));
 @[for field in alphabetical_request_fields]@
   soss::Convert<Ros2_Request::_@(field.name)_type>::add_field(msg, "@(field.name)");
 @[end for]@
@@ -116,6 +117,7 @@ soss::Message initialize_response()
 {
   soss::Message msg;
   msg.type = g_response_name;
+  msg.data.reserve(@(len(alphabetical_response_fields)));
 @[for field in alphabetical_response_fields]@
   soss::Convert<Ros2_Response::_@(field.name)_type>::add_field(msg, "@(field.name)");
 @[end for]@
@@ -153,6 +155,57 @@ void response_to_soss(const Ros2_Response& from, soss::Message& to)
 
 } // anonymous namespace
 
+//==============================================================================
+/// A ROS 2 service whose responses get sent explicitly instead of being sent
+/// as soon as the request callback returns. This allows many requests to be
+/// outstanding at once without blocking an executor thread on any of them.
+class DeferredService final : public rclcpp::Service<Ros2_Srv>
+{
+public:
+
+  using RequestHandler = std::function<void(
+      const std::shared_ptr<rmw_request_id_t>& request_header,
+      const Ros2_Request& request)>;
+
+  DeferredService(
+      rclcpp::Node& node,
+      const std::string& service_name,
+      rcl_service_options_t& options,
+      RequestHandler handler)
+    : rclcpp::Service<Ros2_Srv>(
+        node.get_node_base_interface()->get_shared_rcl_node_handle(),
+        service_name,
+        make_unused_callback(),
+        options),
+      _handler(std::move(handler))
+  {
+    // Do nothing
+  }
+
+  void handle_request(
+      std::shared_ptr<rmw_request_id_t> request_header,
+      std::shared_ptr<void> request) override
+  {
+    // Unlike rclcpp::Service, we do not send a response here. It gets sent
+    // by send_response(~) once the soss response has arrived.
+    _handler(request_header, *std::static_pointer_cast<Ros2_Request>(request));
+  }
+
+private:
+
+  static rclcpp::AnyServiceCallback<Ros2_Srv> make_unused_callback()
+  {
+    rclcpp::AnyServiceCallback<Ros2_Srv> callback;
+    callback.set(
+          [](const std::shared_ptr<Ros2_Request>,
+             std::shared_ptr<Ros2_Response>) { });
+    return callback;
+  }
+
+  const RequestHandler _handler;
+
+};
+
 //==============================================================================
 class ClientProxy final : public virtual soss::ServiceClient
 {
@@ -162,62 +215,60 @@ public:
       rclcpp::Node& node,
       const std::string& service_name,
       const ServiceClientSystem::RequestCallback& callback,
-      const rmw_qos_profile_t& qos_profile)
-    : _callback(callback),
-      _handle(std::make_shared<PromiseHolder>())
+      const rmw_qos_profile_t& qos_profile,
+      const Factory::CallbackGroupPtr& callback_group)
+    : _callback(callback)
   {
     _request = initialize_request();
 
-    _service = node.create_service<Ros2_Srv>(
-          service_name,
-          [=](const std::shared_ptr<rmw_request_id_t> request_header,
-              const std::shared_ptr<Ros2_Request> request,
-              const std::shared_ptr<Ros2_Response> response)
-              { this->service_callback(request_header, request, response); },
-          qos_profile);
+    rcl_service_options_t options = rcl_service_get_default_options();
+    options.qos = qos_profile;
+
+    _service = std::make_shared<DeferredService>(
+          node, service_name, options,
+          [=](const std::shared_ptr<rmw_request_id_t>& request_header,
+              const Ros2_Request& request)
+              { this->service_callback(request_header, request); });
+
+    node.get_node_services_interface()->add_service(
+          std::dynamic_pointer_cast<rclcpp::ServiceBase>(_service),
+          callback_group);
   }
 
   void receive_response(
       std::shared_ptr<void> call_handle,
       const Message& result) override
   {
-    const std::shared_ptr<PromiseHolder>& handle =
-        std::static_pointer_cast<PromiseHolder>(call_handle);
-
-    response_to_ros2(result, _response);
-    handle->promise->set_value(_response);
+    const std::shared_ptr<CallHandle> handle =
+        std::static_pointer_cast<CallHandle>(call_handle);
+
+    // Each response gets its own message, since responses for different
+    // requests may arrive at the same time.
+    auto response = std::make_shared<Ros2_Response>();
+    response_to_ros2(result, *response);
+    _service->send_response(handle->request_header, response);
   }
 
 private:
 
   void service_callback(
-      const std::shared_ptr<rmw_request_id_t>& /*request_header*/,
-      const std::shared_ptr<Ros2_Request>& request,
-      const std::shared_ptr<Ros2_Response>& response)
+      const std::shared_ptr<rmw_request_id_t>& request_header,
+      const Ros2_Request& request)
   {
-    request_to_soss(*request, _request);
-
-    std::promise<Ros2_Response> response_promise;
-    _handle->promise = &response_promise;
-
-    std::future<Ros2_Response> future_response = response_promise.get_future();
-    _callback(_request, *this, _handle);
-
-    future_response.wait();
-
-    *response = future_response.get();
+    request_to_soss(request, _request);
+    _callback(
+          _request, *this,
+          std::make_shared<CallHandle>(CallHandle{request_header}));
   }
 
-  struct PromiseHolder
+  struct CallHandle
   {
-    std::promise<Ros2_Response>* promise;
+    std::shared_ptr<rmw_request_id_t> request_header;
   };
 
   const ServiceClientSystem::RequestCallback _callback;
-  const std::shared_ptr<PromiseHolder> _handle;
   soss::Message _request;
-  Ros2_Response _response;
-  rclcpp::Service<Ros2_Srv>::SharedPtr _service;
+  std::shared_ptr<DeferredService> _service;
 
 };
 
@@ -226,9 +277,11 @@ std::shared_ptr<soss::ServiceClient> make_client(
     rclcpp::Node& node,
     const std::string& service_name,
     const ServiceClientSystem::RequestCallback& callback,
-    const rmw_qos_profile_t& qos_profile)
+    const rmw_qos_profile_t& qos_profile,
+    const Factory::CallbackGroupPtr& callback_group)
 {
-  return std::make_shared<ClientProxy>(node, service_name, callback, qos_profile);
+  return std::make_shared<ClientProxy>(
+        node, service_name, callback, qos_profile, callback_group);
 }
 
 namespace {
@@ -243,12 +296,14 @@ public:
   ServerProxy(
       rclcpp::Node& node,
       const std::string& service_name,
-      const rmw_qos_profile_t& qos_profile)
+      const rmw_qos_profile_t& qos_profile,
+      const Factory::CallbackGroupPtr& callback_group)
     : _service_name(service_name),
       _request_pool(1),
       _response_pool(1)
   {
-    _ros2_client = node.create_client<Ros2_Srv>(service_name, qos_profile);
+    _ros2_client = node.create_client<Ros2_Srv>(
+          service_name, qos_profile, callback_group);
   }
 
   void call_service(
@@ -270,7 +325,16 @@ public:
     _ros2_client->async_send_request(
           ros2_request,
           [=](const rclcpp::Client<Ros2_Srv>::SharedFuture future_response)
-          { this->_wait_for_response(*ptr_to_soss_client, std::move(call_handle), future_response, ros2_request); });
+          { this->_wait_for_response(*ptr_to_soss_client, std::move(call_handle), future_response); });
+
+    // The request has been serialized by the time async_send_request returns,
+    // so it can go back into the pool right away instead of waiting for a
+    // response that may never arrive.
+    //
+    // cancel_service_call(~) is not overridden, because these versions of
+    // rclcpp cannot remove the pending request of a call that soss has given
+    // up on. A late response is simply ignored by soss.
+    _request_pool.recycle(std::move(ros2_request));
   }
 
 private:
@@ -278,8 +342,7 @@ private:
   void _wait_for_response(
       ServiceClient& soss_client,
       std::shared_ptr<void> call_handle,
-      const rclcpp::Client<Ros2_Srv>::SharedFuture& future_response,
-      Ros2_Request::SharedPtr used_request)
+      const rclcpp::Client<Ros2_Srv>::SharedFuture& future_response)
   {
     future_response.wait();
 
@@ -290,7 +353,6 @@ private:
     soss_client.receive_response(std::move(call_handle), soss_response);
 
     _response_pool.recycle(std::move(soss_response));
-    _request_pool.recycle(std::move(used_request));
   }
 
   const std::string _service_name;
@@ -304,9 +366,11 @@ private:
 std::shared_ptr<soss::ServiceProvider> make_server(
     rclcpp::Node& node,
     const std::string& service_name,
-    const rmw_qos_profile_t& qos_profile)
+    const rmw_qos_profile_t& qos_profile,
+    const Factory::CallbackGroupPtr& callback_group)
 {
-  return std::make_shared<ServerProxy>(node, service_name, qos_profile);
+  return std::make_shared<ServerProxy>(
+        node, service_name, qos_profile, callback_group);
 }
 
 namespace {
@@ -0,0 +1,195 @@
+/*
+ * Copyright (C) 2019 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include "DomainContext.hpp"
+
+#include <rclcpp/context.hpp>
+
+#include <cstdlib>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+// rcl_init_options_t carries the domain id since galactic. Before that, the
+// domain could only be chosen through the environment while creating a node.
+#if defined(__has_include)
+#  if __has_include(<rmw/domain_id.h>)
+#    define SOSS_ROS2__INIT_OPTIONS_DOMAIN_ID
+#  endif
+#endif
+
+namespace soss {
+namespace ros2 {
+
+namespace {
+
+//==============================================================================
+/// Owns a context on behalf of every node in its domain, and shuts it down
+/// when the last of them lets go of it.
+struct DomainContext
+{
+  DomainContext()
+    : context(std::make_shared<rclcpp::Context>())
+  {
+    // Do nothing
+  }
+
+  ~DomainContext()
+  {
+    context->shutdown("soss-ros2 released the domain");
+  }
+
+  const rclcpp::Context::SharedPtr context;
+};
+
+//==============================================================================
+struct Registry
+{
+  std::mutex mutex;
+  std::map<std::string, std::weak_ptr<DomainContext>> domains;
+
+  static Registry& get()
+  {
+    static Registry registry;
+    return registry;
+  }
+};
+
+#ifndef SOSS_ROS2__INIT_OPTIONS_DOMAIN_ID
+//==============================================================================
+int set_platform_env(
+    const std::string& variable,
+    const std::string& value,
+    const bool overwrite)
+{
+#ifdef WIN32
+  std::ostringstream aux_d;
+  aux_d << variable << "=" << value;
+  return _putenv(aux_d.str().c_str());
+#else
+  return setenv(variable.c_str(), value.c_str(), overwrite);
+#endif // WIN32
+}
+
+//==============================================================================
+int unset_platform_env(
+    const std::string& variable)
+{
+#ifdef WIN32
+  return set_platform_env(variable, "", false);
+#else
+  return unsetenv(variable.c_str());
+#endif // WIN32
+}
+#endif // SOSS_ROS2__INIT_OPTIONS_DOMAIN_ID
+
+//==============================================================================
+/// Get the context of the domain, or initialize it if no node is using it yet.
+/// This must be called while the registry is locked.
+rclcpp::Context::SharedPtr get_context(
+    Registry& registry,
+    const std::string& domain)
+{
+  std::weak_ptr<DomainContext>& entry = registry.domains[domain];
+  std::shared_ptr<DomainContext> owner = entry.lock();
+  if(!owner)
+  {
+    rclcpp::InitOptions options;
+#ifdef SOSS_ROS2__INIT_OPTIONS_DOMAIN_ID
+    if(!domain.empty())
+      options.set_domain_id(std::stoul(domain));
+#endif // SOSS_ROS2__INIT_OPTIONS_DOMAIN_ID
+
+    const int argc = 1;
+    const char* argv[argc] = {"soss"};
+
+    owner = std::make_shared<DomainContext>();
+    owner->context->init(argc, argv, options);
+    entry = owner;
+  }
+
+  // Nodes hold on to the context that they are given, so handing out a
+  // pointer that shares ownership of its owner keeps the whole domain alive.
+  return rclcpp::Context::SharedPtr(owner, owner->context.get());
+}
+
+//==============================================================================
+std::shared_ptr<rclcpp::Node> make_node(
+    const std::string& name,
+    const std::string& ns,
+    const rclcpp::Context::SharedPtr& context)
+{
+#ifndef RCLCPP__QOS_HPP_
+  // If the rclcpp/qos.hpp header does not exist, then we assume that we are in
+  // crystal, which has no NodeOptions
+  return std::make_shared<rclcpp::Node>(
+        name, ns, context,
+        std::vector<std::string>(),
+        std::vector<rclcpp::Parameter>());
+#else
+  return std::make_shared<rclcpp::Node>(
+        name, ns, rclcpp::NodeOptions().context(context));
+#endif
+}
+
+} // anonymous namespace
+
+//==============================================================================
+std::shared_ptr<rclcpp::Node> make_domain_node(
+    const std::string& name,
+    const std::string& ns,
+    const std::string& domain)
+{
+  if(domain.find_first_not_of("0123456789") != std::string::npos)
+  {
+    throw std::invalid_argument(
+          "[soss::ros2] The domain [" + domain + "] is not a valid domain id");
+  }
+
+  Registry& registry = Registry::get();
+  std::unique_lock<std::mutex> lock(registry.mutex);
+  const rclcpp::Context::SharedPtr context = get_context(registry, domain);
+
+#ifdef SOSS_ROS2__INIT_OPTIONS_DOMAIN_ID
+  lock.unlock();
+  return make_node(name, ns, context);
+#else
+  if(domain.empty())
+    return make_node(name, ns, context);
+
+  // The domain is read from the environment when the node gets created, so we
+  // swap it in for as long as that takes. Holding the registry lock means that
+  // ros2 systems never race each other on the variable.
+  const char* const previous = std::getenv("ROS_DOMAIN_ID");
+  const std::string previous_domain = previous ? previous : "";
+
+  set_platform_env("ROS_DOMAIN_ID", domain, true);
+  std::shared_ptr<rclcpp::Node> node = make_node(name, ns, context);
+
+  if(previous)
+    set_platform_env("ROS_DOMAIN_ID", previous_domain, true);
+  else
+    unset_platform_env("ROS_DOMAIN_ID");
+
+  return node;
+#endif // SOSS_ROS2__INIT_OPTIONS_DOMAIN_ID
+}
+
+} // namespace ros2
+} // namespace soss
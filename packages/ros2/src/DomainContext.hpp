@@ -0,0 +1,47 @@
+/*
+ * Copyright (C) 2019 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#ifndef SOSS__ROS2__SRC__DOMAINCONTEXT_HPP
+#define SOSS__ROS2__SRC__DOMAINCONTEXT_HPP
+
+#include <rclcpp/node.hpp>
+
+#include <memory>
+#include <string>
+
+namespace soss {
+namespace ros2 {
+
+//==============================================================================
+/// Create a node inside of the rclcpp context of the given ROS 2 domain. Every
+/// node of the same domain shares one context, which is initialized the first
+/// time that it is needed and shut down once the last node that uses it is
+/// destroyed, so ros2 systems never need the global rclcpp context.
+///
+/// An empty domain means the domain that is chosen by the ROS_DOMAIN_ID
+/// environment variable.
+///
+/// \throws std::invalid_argument if the domain is not a number
+std::shared_ptr<rclcpp::Node> make_domain_node(
+    const std::string& name,
+    const std::string& ns,
+    const std::string& domain);
+
+} // namespace ros2
+} // namespace soss
+
+#endif // SOSS__ROS2__SRC__DOMAINCONTEXT_HPP
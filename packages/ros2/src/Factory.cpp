@@ -17,7 +17,17 @@
 
 #include <soss/ros2/Factory.hpp>
 
+#include "Introspection.hpp"
+
+#include <soss/Mix.hpp>
+#include <soss/Search.hpp>
+
+#include <atomic>
+#include <iostream>
+#include <memory>
+#include <mutex>
 #include <unordered_map>
+#include <unordered_set>
 
 namespace soss {
 namespace ros2 {
@@ -32,7 +42,11 @@ public:
       const std::string& message_type,
       SubscriptionFactory subscriber_factory)
   {
-    _subscription_factories[message_type] = std::move(subscriber_factory);
+    update([&](Registry& registry)
+    {
+      registry.subscription_factories[message_type] =
+          std::move(subscriber_factory);
+    });
   }
 
   //============================================================================
@@ -41,13 +55,18 @@ public:
       rclcpp::Node& node,
       const std::string& topic_name,
       TopicSubscriberSystem::SubscriptionCallback callback,
-      const rmw_qos_profile_t& qos_profile)
+      const rmw_qos_profile_t& qos_profile,
+      const CallbackGroupPtr& callback_group,
+      const SubscriptionOptions& options)
   {
-    auto it = _subscription_factories.find(message_type);
-    if(it == _subscription_factories.end())
+    const auto factory = find(
+          &Registry::subscription_factories, message_type, Extension::Message);
+    if(!factory)
       return nullptr;
 
-    return it->second(node, topic_name, std::move(callback), qos_profile);
+    return factory(
+          node, topic_name, std::move(callback), qos_profile, callback_group,
+          options);
   }
 
   //============================================================================
@@ -55,7 +74,10 @@ public:
       const std::string& message_type,
       PublisherFactory publisher_factory)
   {
-    _publisher_factories[message_type] = std::move(publisher_factory);
+    update([&](Registry& registry)
+    {
+      registry.publisher_factories[message_type] = std::move(publisher_factory);
+    });
   }
 
   //============================================================================
@@ -65,11 +87,12 @@ public:
       const std::string& topic_name,
       const rmw_qos_profile_t& qos_profile)
   {
-    auto it = _publisher_factories.find(message_type);
-    if(it == _publisher_factories.end())
+    const auto factory = find(
+          &Registry::publisher_factories, message_type, Extension::Message);
+    if(!factory)
       return nullptr;
 
-    return it->second(node, topic_name, qos_profile);
+    return factory(node, topic_name, qos_profile);
   }
 
   //============================================================================
@@ -77,7 +100,11 @@ public:
       const std::string& service_type,
       ServiceClientFactory client_proxy_factory)
   {
-    _client_proxy_factories[service_type] = std::move(client_proxy_factory);
+    update([&](Registry& registry)
+    {
+      registry.client_proxy_factories[service_type] =
+          std::move(client_proxy_factory);
+    });
   }
 
   //============================================================================
@@ -86,13 +113,16 @@ public:
       rclcpp::Node& node,
       const std::string& service_name,
       const ServiceClientSystem::RequestCallback& callback,
-      const rmw_qos_profile_t& qos_profile)
+      const rmw_qos_profile_t& qos_profile,
+      const CallbackGroupPtr& callback_group)
   {
-    auto it = _client_proxy_factories.find(service_type);
-    if(it == _client_proxy_factories.end())
+    const auto factory = find(
+          &Registry::client_proxy_factories, service_type, Extension::Service);
+    if(!factory)
       return nullptr;
 
-    return it->second(node, service_name, callback, qos_profile);
+    return factory(
+          node, service_name, callback, qos_profile, callback_group);
   }
 
   //============================================================================
@@ -100,7 +130,10 @@ public:
       const std::string& service_type,
       ServiceProviderFactory server_proxy_factory)
   {
-    _server_proxy_factories[service_type] = server_proxy_factory;
+    update([&](Registry& registry)
+    {
+      registry.server_proxy_factories[service_type] = server_proxy_factory;
+    });
   }
 
   //============================================================================
@@ -108,21 +141,150 @@ public:
       const std::string& service_type,
       rclcpp::Node& node,
       const std::string& service_name,
-      const rmw_qos_profile_t& qos_profile)
+      const rmw_qos_profile_t& qos_profile,
+      const CallbackGroupPtr& callback_group)
   {
-    auto it = _server_proxy_factories.find(service_type);
-    if(it == _server_proxy_factories.end())
+    const auto factory = find(
+          &Registry::server_proxy_factories, service_type, Extension::Service);
+    if(!factory)
       return nullptr;
 
-    return it->second(node, service_name, qos_profile);
+    return factory(node, service_name, qos_profile, callback_group);
   }
 
 private:
 
-  std::unordered_map<std::string, SubscriptionFactory> _subscription_factories;
-  std::unordered_map<std::string, PublisherFactory> _publisher_factories;
-  std::unordered_map<std::string, ServiceClientFactory> _client_proxy_factories;
-  std::unordered_map<std::string, ServiceProviderFactory> _server_proxy_factories;
+  enum class Extension
+  {
+    Message,
+    Service
+  };
+
+  /// Every factory that has been registered. Registering a factory replaces
+  /// the whole registry with an updated copy, so lookups only need to take a
+  /// snapshot of the current registry and never wait on registrations, which
+  /// happen rarely after startup.
+  struct Registry
+  {
+    template<typename FactoryType>
+    using FactoryMap = std::unordered_map<std::string, FactoryType>;
+
+    FactoryMap<SubscriptionFactory> subscription_factories;
+    FactoryMap<PublisherFactory> publisher_factories;
+    FactoryMap<ServiceClientFactory> client_proxy_factories;
+    FactoryMap<ServiceProviderFactory> server_proxy_factories;
+  };
+
+  template<typename Modifier>
+  void update(const Modifier& modify)
+  {
+    std::unique_lock<std::mutex> lock(_update_mutex);
+    auto registry = std::make_shared<Registry>(*std::atomic_load(&_registry));
+    modify(*registry);
+    std::atomic_store(
+          &_registry, std::shared_ptr<const Registry>(std::move(registry)));
+  }
+
+  template<typename FactoryMap>
+  static typename FactoryMap::mapped_type find_in(
+      const Registry& registry,
+      FactoryMap Registry::* factories,
+      const std::string& type)
+  {
+    const FactoryMap& map = registry.*factories;
+    const auto it = map.find(type);
+    if(it == map.end())
+      return nullptr;
+
+    return it->second;
+  }
+
+  /// Get the factory that has been registered for a type. If there is none,
+  /// the extension of the type gets loaded first, so that types only need to
+  /// be loaded once something of their type is created.
+  template<typename FactoryMap>
+  typename FactoryMap::mapped_type find(
+      FactoryMap Registry::* factories,
+      const std::string& type,
+      const Extension extension)
+  {
+    if(auto factory = find_in(*std::atomic_load(&_registry), factories, type))
+      return factory;
+
+    load_extension(type, extension);
+    return find_in(*std::atomic_load(&_registry), factories, type);
+  }
+
+  void load_extension(const std::string& type, const Extension extension)
+  {
+    // Every extension gets one attempt, whether or not it succeeds. If another
+    // thread is loading the same one, we wait for it to finish.
+    std::unique_lock<std::mutex> lock(_extension_mutex);
+    const std::string key =
+        (extension == Extension::Message ? "msg:" : "srv:") + type;
+    if(!_attempted_extensions.insert(key).second)
+      return;
+
+    // The extension of a whole package registers all of its types, so it only
+    // gets one attempt no matter how many of them we ask for
+    const soss::Search search("ros2");
+    std::string path = search.find_package_mix(type);
+    if(!path.empty() && !_attempted_extensions.insert("pkg:" + path).second)
+      return;
+
+    if(path.empty())
+    {
+      path = extension == Extension::Message?
+            search.find_message_mix(type) : search.find_service_mix(type);
+    }
+
+    // Messages without a generated extension can still be converted by
+    // walking the runtime introspection of their type
+    if(path.empty() && extension == Extension::Message
+       && register_introspection_factories(type))
+    {
+      std::cout << "[soss::ros2] Using the runtime introspection of the "
+                << "message type [" << type << "], because no generated "
+                << "extension was found for it" << std::endl;
+      return;
+    }
+
+    if(path.empty())
+    {
+      std::cerr << "[soss::ros2] Could not find the .mix file of the "
+                << (extension == Extension::Message? "message" : "service")
+                << " type [" << type << "]. Make sure that you have generated "
+                << "the soss-ros2 extension for it by calling "
+                << "soss_rosidl_mix(PACKAGES <package> MIDDLEWARES ros2) in "
+                << "your build system!" << std::endl;
+      return;
+    }
+
+    try
+    {
+      if(!Mix::from_file(path).load())
+      {
+        std::cerr << "[soss::ros2] Failed to load the extension of [" << type
+                  << "] using mix file: " << path << std::endl;
+      }
+    }
+    catch(const YAML::Exception& e)
+    {
+      std::cerr << "[soss::ros2] Failed to read the mix file [" << path
+                << "]: " << e.what() << std::endl;
+    }
+  }
+
+  // Always read and replaced through std::atomic_load and std::atomic_store
+  std::shared_ptr<const Registry> _registry = std::make_shared<Registry>();
+
+  // Extensions get loaded from several threads at once, and each of them
+  // registers its factories as it gets loaded
+  std::mutex _update_mutex;
+
+  // Types whose extensions we have tried to load on demand
+  std::unordered_set<std::string> _attempted_extensions;
+  std::mutex _extension_mutex;
 
 };
 
@@ -148,10 +310,13 @@ std::shared_ptr<void> Factory::create_subscription(
     rclcpp::Node& node,
     const std::string& topic_name,
     TopicSubscriberSystem::SubscriptionCallback callback,
-    const rmw_qos_profile_t& qos_profile)
+    const rmw_qos_profile_t& qos_profile,
+    const CallbackGroupPtr& callback_group,
+    const SubscriptionOptions& options)
 {
   return _pimpl->create_subscription(
-        message_type, node, topic_name, std::move(callback), qos_profile);
+        message_type, node, topic_name, std::move(callback), qos_profile,
+        callback_group, options);
 }
 
 //==============================================================================
@@ -189,10 +354,12 @@ std::shared_ptr<ServiceClient> Factory::create_client_proxy(
     rclcpp::Node& node,
     const std::string& service_name,
     const ServiceClientSystem::RequestCallback& callback,
-    const rmw_qos_profile_t& qos_profile)
+    const rmw_qos_profile_t& qos_profile,
+    const CallbackGroupPtr& callback_group)
 {
   return _pimpl->create_client_proxy(
-        service_type, node, service_name, callback, qos_profile);
+        service_type, node, service_name, callback, qos_profile,
+        callback_group);
 }
 
 //==============================================================================
@@ -209,10 +376,11 @@ std::shared_ptr<ServiceProvider> Factory::create_server_proxy(
     const std::string& service_type,
     rclcpp::Node& node,
     const std::string& service_name,
-    const rmw_qos_profile_t& qos_profile)
+    const rmw_qos_profile_t& qos_profile,
+    const CallbackGroupPtr& callback_group)
 {
   return _pimpl->create_server_proxy(
-        service_type, node, service_name, qos_profile);
+        service_type, node, service_name, qos_profile, callback_group);
 }
 
 //==============================================================================
@@ -0,0 +1,1249 @@
+/*
+ * Copyright (C) 2019 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include "Introspection.hpp"
+
+#include <soss/ros2/serialized.hpp>
+
+// Subscriptions and publishers of types that are only known at runtime need
+// rclcpp to accept any type support handle, which it does since foxy, the same
+// release that introduced rclcpp::SerializedMessage
+#if defined(SOSS_ROS2__SERIALIZED_MESSAGES) && defined(__has_include)
+#  if __has_include(<rosidl_typesupport_introspection_cpp/message_introspection.hpp>) \
+  && __has_include(<rosidl_runtime_cpp/message_initialization.hpp>)
+#    define SOSS_ROS2__INTROSPECTION
+#  endif
+#endif
+
+#ifdef SOSS_ROS2__INTROSPECTION
+
+#include <soss/ros2/Factory.hpp>
+
+#include <soss/Metrics.hpp>
+#include <soss/Trace.hpp>
+#include <soss/utilities.hpp>
+
+#include <rclcpp/node.hpp>
+#include <rclcpp/publisher_base.hpp>
+#include <rclcpp/subscription_base.hpp>
+
+#include <rcl/error_handling.h>
+#include <rcl/publisher.h>
+#include <rmw/error_handling.h>
+#include <rmw/rmw.h>
+
+#include <rosidl_runtime_cpp/message_initialization.hpp>
+#include <rosidl_typesupport_introspection_cpp/field_types.hpp>
+#include <rosidl_typesupport_introspection_cpp/identifier.hpp>
+#include <rosidl_typesupport_introspection_cpp/message_introspection.hpp>
+
+#include <dlfcn.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#endif // SOSS_ROS2__INTROSPECTION
+
+namespace soss {
+namespace ros2 {
+
+#ifdef SOSS_ROS2__INTROSPECTION
+
+namespace {
+
+namespace rti = rosidl_typesupport_introspection_cpp;
+
+//==============================================================================
+/// Everything that converting a message type needs, worked out once from the
+/// introspection of the type, so that converting a message is only a walk over
+/// this table.
+struct Layout
+{
+  struct Member
+  {
+    std::string name;
+    uint8_t type_id;
+
+    /// Where the member lives inside of the native message
+    uint32_t offset;
+
+    /// Where the field of the member lives inside of the soss::Message, whose
+    /// fields are sorted by name instead of by declaration
+    std::size_t field_index;
+
+    bool is_array;
+
+    /// True if the array can change its size, i.e. it is a sequence
+    bool is_sequence;
+
+    /// The size of a fixed array, or the upper bound of a sequence
+    std::size_t bound;
+
+    /// The size of one element, so that arrays can be walked without calling
+    /// the introspection functions for each element
+    std::size_t element_size;
+
+    const rti::MessageMember* info;
+
+    /// The layout of a nested message type
+    const Layout* nested;
+  };
+
+  std::string type;
+  const rti::MessageMembers* members;
+  std::vector<Member> fields;
+
+  /// A soss::Message with every field of this type, which new messages get
+  /// copied from
+  soss::Message prototype;
+};
+
+using LayoutPtr = std::shared_ptr<const Layout>;
+
+//==============================================================================
+/// A message type whose type support has been loaded
+struct LoadedType
+{
+  /// The type support that the rmw implementation needs
+  const rosidl_message_type_support_t* rmw_support;
+
+  LayoutPtr layout;
+};
+
+using LoadedTypePtr = std::shared_ptr<const LoadedType>;
+
+//==============================================================================
+std::string type_name(const rti::MessageMembers& members)
+{
+  // The namespace has the form "package::msg"
+  const std::string ns = members.message_namespace_;
+  return ns.substr(0, ns.find("::")) + "/" + members.message_name_;
+}
+
+//==============================================================================
+std::size_t primitive_size(const uint8_t type_id)
+{
+  switch(type_id)
+  {
+    case rti::ROS_TYPE_FLOAT: return sizeof(float);
+    case rti::ROS_TYPE_DOUBLE: return sizeof(double);
+    case rti::ROS_TYPE_LONG_DOUBLE: return sizeof(long double);
+    case rti::ROS_TYPE_CHAR: return sizeof(uint8_t);
+    case rti::ROS_TYPE_WCHAR: return sizeof(char16_t);
+    case rti::ROS_TYPE_BOOLEAN: return sizeof(bool);
+    case rti::ROS_TYPE_OCTET: return sizeof(uint8_t);
+    case rti::ROS_TYPE_UINT8: return sizeof(uint8_t);
+    case rti::ROS_TYPE_INT8: return sizeof(int8_t);
+    case rti::ROS_TYPE_UINT16: return sizeof(uint16_t);
+    case rti::ROS_TYPE_INT16: return sizeof(int16_t);
+    case rti::ROS_TYPE_UINT32: return sizeof(uint32_t);
+    case rti::ROS_TYPE_INT32: return sizeof(int32_t);
+    case rti::ROS_TYPE_UINT64: return sizeof(uint64_t);
+    case rti::ROS_TYPE_INT64: return sizeof(int64_t);
+    case rti::ROS_TYPE_STRING: return sizeof(std::string);
+    case rti::ROS_TYPE_WSTRING: return sizeof(std::u16string);
+    default: return 0;
+  }
+}
+
+//==============================================================================
+/// Get the field of a member, turning it into the given type if it holds
+/// anything else
+template<typename SossType>
+SossType& field_as(soss::Field& field)
+{
+  if(SossType* const value = field.cast<SossType>())
+    return *value;
+
+  field.set(SossType());
+  return *field.cast<SossType>();
+}
+
+//==============================================================================
+/// The empty field of a member, holding the same type that the generated
+/// extensions would give it. See soss::Convert.
+soss::Field make_empty_field(const Layout::Member& member)
+{
+#define SOSS_ROS2_EMPTY_FIELD(Id, Scalar, Element) \
+  case rti::Id: \
+    return member.is_array? \
+          soss::make_field<std::vector<Element>>() \
+        : soss::make_field<Scalar>();
+
+  switch(member.type_id)
+  {
+    SOSS_ROS2_EMPTY_FIELD(ROS_TYPE_FLOAT, double, float)
+    SOSS_ROS2_EMPTY_FIELD(ROS_TYPE_DOUBLE, double, double)
+    SOSS_ROS2_EMPTY_FIELD(ROS_TYPE_LONG_DOUBLE, long double, long double)
+    SOSS_ROS2_EMPTY_FIELD(ROS_TYPE_CHAR, uint64_t, uint8_t)
+    SOSS_ROS2_EMPTY_FIELD(ROS_TYPE_WCHAR, char16_t, char16_t)
+    SOSS_ROS2_EMPTY_FIELD(ROS_TYPE_BOOLEAN, uint64_t, uint64_t)
+    SOSS_ROS2_EMPTY_FIELD(ROS_TYPE_OCTET, uint64_t, uint8_t)
+    SOSS_ROS2_EMPTY_FIELD(ROS_TYPE_UINT8, uint64_t, uint8_t)
+    SOSS_ROS2_EMPTY_FIELD(ROS_TYPE_INT8, int64_t, int8_t)
+    SOSS_ROS2_EMPTY_FIELD(ROS_TYPE_UINT16, uint64_t, uint16_t)
+    SOSS_ROS2_EMPTY_FIELD(ROS_TYPE_INT16, int64_t, int16_t)
+    SOSS_ROS2_EMPTY_FIELD(ROS_TYPE_UINT32, uint64_t, uint32_t)
+    SOSS_ROS2_EMPTY_FIELD(ROS_TYPE_INT32, int64_t, int32_t)
+    SOSS_ROS2_EMPTY_FIELD(ROS_TYPE_UINT64, uint64_t, uint64_t)
+    SOSS_ROS2_EMPTY_FIELD(ROS_TYPE_INT64, int64_t, int64_t)
+    SOSS_ROS2_EMPTY_FIELD(ROS_TYPE_STRING, std::string, std::string)
+    SOSS_ROS2_EMPTY_FIELD(ROS_TYPE_WSTRING, std::u16string, std::u16string)
+
+    case rti::ROS_TYPE_MESSAGE:
+      return member.is_array?
+            soss::make_field<std::vector<soss::Message>>()
+          : soss::make_field<soss::Message>(member.nested->prototype);
+
+    default:
+      return soss::Field();
+  }
+
+#undef SOSS_ROS2_EMPTY_FIELD
+}
+
+//==============================================================================
+/// Layouts are shared by every type that nests them, so each one only gets
+/// worked out once
+using LayoutMap =
+    std::unordered_map<const rti::MessageMembers*, LayoutPtr>;
+
+LayoutPtr make_layout(const rti::MessageMembers& members, LayoutMap& layouts)
+{
+  const auto found = layouts.find(&members);
+  if(found != layouts.end())
+    return found->second;
+
+  auto layout = std::make_shared<Layout>();
+  layout->type = type_name(members);
+  layout->members = &members;
+
+  std::vector<std::string> sorted_names;
+  for(uint32_t i=0; i < members.member_count_; ++i)
+    sorted_names.push_back(members.members_[i].name_);
+  std::sort(sorted_names.begin(), sorted_names.end());
+
+  layout->fields.resize(members.member_count_);
+  for(uint32_t i=0; i < members.member_count_; ++i)
+  {
+    const rti::MessageMember& info = members.members_[i];
+    Layout::Member& member = layout->fields[i];
+    member.name = info.name_;
+    member.type_id = info.type_id_;
+    member.offset = info.offset_;
+    member.field_index = static_cast<std::size_t>(
+          std::lower_bound(
+            sorted_names.begin(), sorted_names.end(), member.name)
+          - sorted_names.begin());
+    member.is_array = info.is_array_;
+    member.is_sequence =
+        info.is_array_ && (info.array_size_ == 0 || info.is_upper_bound_);
+    member.bound = !info.is_array_? 1
+        : info.array_size_ == 0? std::numeric_limits<std::size_t>::max()
+        : info.array_size_;
+    member.info = &info;
+    member.nested = nullptr;
+
+    if(info.type_id_ == rti::ROS_TYPE_MESSAGE)
+    {
+      member.nested = make_layout(
+            *static_cast<const rti::MessageMembers*>(info.members_->data),
+            layouts).get();
+      member.element_size = member.nested->members->size_of_;
+    }
+    else
+    {
+      member.element_size = primitive_size(info.type_id_);
+    }
+  }
+
+  soss::Message& prototype = layout->prototype;
+  prototype.type = layout->type;
+  prototype.data.reserve(layout->fields.size());
+  for(const Layout::Member& member : layout->fields)
+    prototype.data[member.name] = make_empty_field(member);
+
+  layouts[&members] = layout;
+  return layout;
+}
+
+//==============================================================================
+/// The address of the first element of an array. Fixed arrays are stored
+/// inside of the message, and sequences are std::vectors, whose elements are
+/// contiguous as well.
+const void* array_data(
+    const Layout::Member& member,
+    const void* const ptr,
+    const std::size_t size)
+{
+  if(!member.is_sequence)
+    return ptr;
+
+  return size > 0? member.info->get_const_function(ptr, 0) : nullptr;
+}
+
+//==============================================================================
+std::size_t array_size(const Layout::Member& member, const void* const ptr)
+{
+  if(!member.is_sequence)
+    return member.bound;
+
+  return member.info->size_function(ptr);
+}
+
+//==============================================================================
+/// Resize an array to hold the given number of elements, which must not exceed
+/// its bound, and get the address of its first element
+void* resize_array(
+    const Layout::Member& member,
+    void* const ptr,
+    const std::size_t size)
+{
+  if(!member.is_sequence)
+    return ptr;
+
+  member.info->resize_function(ptr, size);
+  return size > 0? member.info->get_function(ptr, 0) : nullptr;
+}
+
+//==============================================================================
+// Sequences of bools are std::vector<bool>, which has no contiguous elements,
+// so the introspection does not give access to them. Bounded sequences wrap a
+// std::vector of the same type without adding anything to it, so both can be
+// reached the same way.
+const std::vector<bool>& bool_sequence(const void* const ptr)
+{
+  return *static_cast<const std::vector<bool>*>(ptr);
+}
+
+std::vector<bool>& bool_sequence(void* const ptr)
+{
+  return *static_cast<std::vector<bool>*>(ptr);
+}
+
+//==============================================================================
+template<typename Native>
+void packed_to_soss(
+    const Layout::Member& member,
+    const void* const ptr,
+    soss::Field& field)
+{
+  const std::size_t size = array_size(member, ptr);
+  std::vector<Native>& to = field_as<std::vector<Native>>(field);
+  to.resize(size);
+  copy_packed(
+        static_cast<const Native*>(array_data(member, ptr, size)),
+        size, to.data());
+}
+
+//==============================================================================
+void to_soss(const Layout& layout, const void* from, soss::Message& to);
+
+//==============================================================================
+void array_to_soss(
+    const Layout::Member& member,
+    const void* const ptr,
+    soss::Field& field)
+{
+  switch(member.type_id)
+  {
+    case rti::ROS_TYPE_FLOAT: return packed_to_soss<float>(member, ptr, field);
+    case rti::ROS_TYPE_DOUBLE: return packed_to_soss<double>(member, ptr, field);
+    case rti::ROS_TYPE_LONG_DOUBLE:
+      return packed_to_soss<long double>(member, ptr, field);
+    case rti::ROS_TYPE_CHAR:
+    case rti::ROS_TYPE_OCTET:
+    case rti::ROS_TYPE_UINT8:
+      return packed_to_soss<uint8_t>(member, ptr, field);
+    case rti::ROS_TYPE_WCHAR:
+      return packed_to_soss<char16_t>(member, ptr, field);
+    case rti::ROS_TYPE_INT8: return packed_to_soss<int8_t>(member, ptr, field);
+    case rti::ROS_TYPE_UINT16:
+      return packed_to_soss<uint16_t>(member, ptr, field);
+    case rti::ROS_TYPE_INT16: return packed_to_soss<int16_t>(member, ptr, field);
+    case rti::ROS_TYPE_UINT32:
+      return packed_to_soss<uint32_t>(member, ptr, field);
+    case rti::ROS_TYPE_INT32: return packed_to_soss<int32_t>(member, ptr, field);
+    case rti::ROS_TYPE_UINT64:
+      return packed_to_soss<uint64_t>(member, ptr, field);
+    case rti::ROS_TYPE_INT64: return packed_to_soss<int64_t>(member, ptr, field);
+
+    case rti::ROS_TYPE_BOOLEAN:
+    {
+      // Booleans are widened, like soss::Convert does
+      std::vector<uint64_t>& to = field_as<std::vector<uint64_t>>(field);
+      if(member.is_sequence)
+      {
+        const std::vector<bool>& from = bool_sequence(ptr);
+        to.assign(from.begin(), from.end());
+      }
+      else
+      {
+        const bool* const from = static_cast<const bool*>(ptr);
+        to.assign(from, from + member.bound);
+      }
+      return;
+    }
+
+    case rti::ROS_TYPE_STRING:
+    {
+      const std::size_t size = array_size(member, ptr);
+      const auto* const from =
+          static_cast<const std::string*>(array_data(member, ptr, size));
+      field_as<std::vector<std::string>>(field).assign(from, from + size);
+      return;
+    }
+
+    case rti::ROS_TYPE_WSTRING:
+    {
+      const std::size_t size = array_size(member, ptr);
+      const auto* const from =
+          static_cast<const std::u16string*>(array_data(member, ptr, size));
+      field_as<std::vector<std::u16string>>(field).assign(from, from + size);
+      return;
+    }
+
+    case rti::ROS_TYPE_MESSAGE:
+    {
+      // The nested messages that are already there get converted in place
+      const std::size_t size = array_size(member, ptr);
+      const auto* const from =
+          static_cast<const uint8_t*>(array_data(member, ptr, size));
+      std::vector<soss::Message>& to =
+          field_as<std::vector<soss::Message>>(field);
+      if(to.size() > size)
+        to.resize(size);
+
+      to.reserve(size);
+      for(std::size_t i=0; i < size; ++i)
+      {
+        if(i == to.size())
+          to.push_back(member.nested->prototype);
+
+        to_soss(*member.nested, from + i*member.element_size, to[i]);
+      }
+      return;
+    }
+
+    default:
+      return;
+  }
+}
+
+//==============================================================================
+void to_soss(const Layout& layout, const void* const from, soss::Message& to)
+{
+  // Messages that already hold the fields of this type get updated in place
+  if(to.data.size() != layout.fields.size() || to.type != layout.type)
+    to = layout.prototype;
+
+  const auto fields = to.data.begin();
+  for(const Layout::Member& member : layout.fields)
+  {
+    soss::Field& field = (fields + member.field_index)->second;
+    const void* const ptr = static_cast<const uint8_t*>(from) + member.offset;
+
+    if(member.is_array)
+    {
+      array_to_soss(member, ptr, field);
+      continue;
+    }
+
+#define SOSS_ROS2_SCALAR_TO_SOSS(Id, Native, Soss) \
+    case rti::Id: \
+      field_as<Soss>(field) = *static_cast<const Native*>(ptr); \
+      break;
+
+    switch(member.type_id)
+    {
+      SOSS_ROS2_SCALAR_TO_SOSS(ROS_TYPE_FLOAT, float, double)
+      SOSS_ROS2_SCALAR_TO_SOSS(ROS_TYPE_DOUBLE, double, double)
+      SOSS_ROS2_SCALAR_TO_SOSS(ROS_TYPE_LONG_DOUBLE, long double, long double)
+      SOSS_ROS2_SCALAR_TO_SOSS(ROS_TYPE_CHAR, uint8_t, uint64_t)
+      SOSS_ROS2_SCALAR_TO_SOSS(ROS_TYPE_WCHAR, char16_t, char16_t)
+      SOSS_ROS2_SCALAR_TO_SOSS(ROS_TYPE_BOOLEAN, bool, uint64_t)
+      SOSS_ROS2_SCALAR_TO_SOSS(ROS_TYPE_OCTET, uint8_t, uint64_t)
+      SOSS_ROS2_SCALAR_TO_SOSS(ROS_TYPE_UINT8, uint8_t, uint64_t)
+      SOSS_ROS2_SCALAR_TO_SOSS(ROS_TYPE_INT8, int8_t, int64_t)
+      SOSS_ROS2_SCALAR_TO_SOSS(ROS_TYPE_UINT16, uint16_t, uint64_t)
+      SOSS_ROS2_SCALAR_TO_SOSS(ROS_TYPE_INT16, int16_t, int64_t)
+      SOSS_ROS2_SCALAR_TO_SOSS(ROS_TYPE_UINT32, uint32_t, uint64_t)
+      SOSS_ROS2_SCALAR_TO_SOSS(ROS_TYPE_INT32, int32_t, int64_t)
+      SOSS_ROS2_SCALAR_TO_SOSS(ROS_TYPE_UINT64, uint64_t, uint64_t)
+      SOSS_ROS2_SCALAR_TO_SOSS(ROS_TYPE_INT64, int64_t, int64_t)
+      SOSS_ROS2_SCALAR_TO_SOSS(ROS_TYPE_STRING, std::string, std::string)
+      SOSS_ROS2_SCALAR_TO_SOSS(ROS_TYPE_WSTRING, std::u16string, std::u16string)
+
+      case rti::ROS_TYPE_MESSAGE:
+        to_soss(*member.nested, ptr, field_as<soss::Message>(field));
+        break;
+
+      default:
+        break;
+    }
+
+#undef SOSS_ROS2_SCALAR_TO_SOSS
+  }
+}
+
+//==============================================================================
+/// Read a number from a field of any numeric type, since messages that come
+/// from other middlewares may not use the same widths as ros2
+template<typename Native>
+Native number_from(const soss::Field& field)
+{
+  switch(field.type_tag())
+  {
+    case FieldTypeTag::Bool:
+      return static_cast<Native>(*field.cast<bool>());
+    case FieldTypeTag::Int64:
+      return static_cast<Native>(*field.cast<int64_t>());
+    case FieldTypeTag::UInt64:
+      return static_cast<Native>(*field.cast<uint64_t>());
+    case FieldTypeTag::Double:
+      return static_cast<Native>(*field.cast<double>());
+    default:
+      break;
+  }
+
+  if(const Native* const value = field.cast<Native>())
+    return *value;
+
+  return Native();
+}
+
+//==============================================================================
+/// Call read(data, size) with the elements of a field that holds an array of
+/// any numeric type
+template<typename Native, typename Read>
+bool read_numbers(const soss::Field& field, const Read& read)
+{
+  switch(field.type_tag())
+  {
+#define SOSS_ROS2_READ_NUMBERS(Tag, Type) \
+    case FieldTypeTag::Tag: \
+    { \
+      const std::vector<Type>& from = *field.cast<std::vector<Type>>(); \
+      read(from.data(), from.size()); \
+      return true; \
+    }
+
+    SOSS_ROS2_READ_NUMBERS(UInt8Vector, uint8_t)
+    SOSS_ROS2_READ_NUMBERS(Int8Vector, int8_t)
+    SOSS_ROS2_READ_NUMBERS(UInt16Vector, uint16_t)
+    SOSS_ROS2_READ_NUMBERS(Int16Vector, int16_t)
+    SOSS_ROS2_READ_NUMBERS(UInt32Vector, uint32_t)
+    SOSS_ROS2_READ_NUMBERS(Int32Vector, int32_t)
+    SOSS_ROS2_READ_NUMBERS(UInt64Vector, uint64_t)
+    SOSS_ROS2_READ_NUMBERS(Int64Vector, int64_t)
+    SOSS_ROS2_READ_NUMBERS(FloatVector, float)
+    SOSS_ROS2_READ_NUMBERS(DoubleVector, double)
+
+#undef SOSS_ROS2_READ_NUMBERS
+
+    case FieldTypeTag::Blob:
+    {
+      const soss::Blob& from = *field.cast<soss::Blob>();
+      read(from.data(), from.size());
+      return true;
+    }
+
+    default:
+      break;
+  }
+
+  if(const auto* const from = field.cast<std::vector<Native>>())
+  {
+    read(from->data(), from->size());
+    return true;
+  }
+
+  return false;
+}
+
+//==============================================================================
+template<typename Native>
+void packed_from_soss(
+    const soss::Field& field,
+    const Layout::Member& member,
+    void* const ptr)
+{
+  read_numbers<Native>(field, [&](const auto* from, std::size_t size)
+  {
+    size = std::min(size, member.bound);
+    copy_packed(from, size, static_cast<Native*>(
+                  resize_array(member, ptr, size)));
+  });
+}
+
+//==============================================================================
+void from_soss(const Layout& layout, const soss::Message& from, void* to);
+
+//==============================================================================
+void array_from_soss(
+    const soss::Field& field,
+    const Layout::Member& member,
+    void* const ptr)
+{
+  switch(member.type_id)
+  {
+    case rti::ROS_TYPE_FLOAT:
+      return packed_from_soss<float>(field, member, ptr);
+    case rti::ROS_TYPE_DOUBLE:
+      return packed_from_soss<double>(field, member, ptr);
+    case rti::ROS_TYPE_LONG_DOUBLE:
+      return packed_from_soss<long double>(field, member, ptr);
+    case rti::ROS_TYPE_CHAR:
+    case rti::ROS_TYPE_OCTET:
+    case rti::ROS_TYPE_UINT8:
+      return packed_from_soss<uint8_t>(field, member, ptr);
+    case rti::ROS_TYPE_WCHAR:
+      return packed_from_soss<char16_t>(field, member, ptr);
+    case rti::ROS_TYPE_INT8:
+      return packed_from_soss<int8_t>(field, member, ptr);
+    case rti::ROS_TYPE_UINT16:
+      return packed_from_soss<uint16_t>(field, member, ptr);
+    case rti::ROS_TYPE_INT16:
+      return packed_from_soss<int16_t>(field, member, ptr);
+    case rti::ROS_TYPE_UINT32:
+      return packed_from_soss<uint32_t>(field, member, ptr);
+    case rti::ROS_TYPE_INT32:
+      return packed_from_soss<int32_t>(field, member, ptr);
+    case rti::ROS_TYPE_UINT64:
+      return packed_from_soss<uint64_t>(field, member, ptr);
+    case rti::ROS_TYPE_INT64:
+      return packed_from_soss<int64_t>(field, member, ptr);
+
+    case rti::ROS_TYPE_BOOLEAN:
+    {
+      read_numbers<uint64_t>(field, [&](const auto* from, std::size_t size)
+      {
+        size = std::min(size, member.bound);
+        if(member.is_sequence)
+        {
+          std::vector<bool>& to = bool_sequence(ptr);
+          to.resize(size);
+          for(std::size_t i=0; i < size; ++i)
+            to[i] = from[i] != 0;
+        }
+        else
+        {
+          bool* const to = static_cast<bool*>(ptr);
+          for(std::size_t i=0; i < size; ++i)
+            to[i] = from[i] != 0;
+        }
+      });
+      return;
+    }
+
+    case rti::ROS_TYPE_STRING:
+    {
+      const auto* const from = field.cast<std::vector<std::string>>();
+      if(!from)
+        return;
+
+      const std::size_t size = std::min(from->size(), member.bound);
+      std::copy_n(from->begin(), size,
+                  static_cast<std::string*>(resize_array(member, ptr, size)));
+      return;
+    }
+
+    case rti::ROS_TYPE_WSTRING:
+    {
+      const auto* const from = field.cast<std::vector<std::u16string>>();
+      if(!from)
+        return;
+
+      const std::size_t size = std::min(from->size(), member.bound);
+      std::copy_n(from->begin(), size, static_cast<std::u16string*>(
+                    resize_array(member, ptr, size)));
+      return;
+    }
+
+    case rti::ROS_TYPE_MESSAGE:
+    {
+      const auto* const from = field.cast<std::vector<soss::Message>>();
+      if(!from)
+        return;
+
+      const std::size_t size = std::min(from->size(), member.bound);
+      uint8_t* const to =
+          static_cast<uint8_t*>(resize_array(member, ptr, size));
+      for(std::size_t i=0; i < size; ++i)
+        from_soss(*member.nested, (*from)[i], to + i*member.element_size);
+      return;
+    }
+
+    default:
+      return;
+  }
+}
+
+//==============================================================================
+void from_soss(const Layout& layout, const soss::Message& from, void* const to)
+{
+  // A message that has exactly the fields of this type can be read by
+  // position. Anything else gets looked up by name, and the native message is
+  // reset first, so that the fields which are missing get their defaults.
+  const bool complete = from.data.size() == layout.fields.size();
+  if(!complete)
+  {
+    layout.members->fini_function(to);
+    layout.members->init_function(
+          to, rosidl_runtime_cpp::MessageInitialization::ALL);
+  }
+
+  for(const Layout::Member& member : layout.fields)
+  {
+    auto it = from.data.begin() + member.field_index;
+    if(!complete || it->first != member.name)
+    {
+      it = from.data.find(member.name);
+      if(it == from.data.end())
+        continue;
+    }
+
+    const soss::Field& field = it->second;
+    void* const ptr = static_cast<uint8_t*>(to) + member.offset;
+
+    if(member.is_array)
+    {
+      array_from_soss(field, member, ptr);
+      continue;
+    }
+
+#define SOSS_ROS2_NUMBER_FROM_SOSS(Id, Native) \
+    case rti::Id: \
+      *static_cast<Native*>(ptr) = number_from<Native>(field); \
+      break;
+
+    switch(member.type_id)
+    {
+      SOSS_ROS2_NUMBER_FROM_SOSS(ROS_TYPE_FLOAT, float)
+      SOSS_ROS2_NUMBER_FROM_SOSS(ROS_TYPE_DOUBLE, double)
+      SOSS_ROS2_NUMBER_FROM_SOSS(ROS_TYPE_LONG_DOUBLE, long double)
+      SOSS_ROS2_NUMBER_FROM_SOSS(ROS_TYPE_CHAR, uint8_t)
+      SOSS_ROS2_NUMBER_FROM_SOSS(ROS_TYPE_WCHAR, char16_t)
+      SOSS_ROS2_NUMBER_FROM_SOSS(ROS_TYPE_BOOLEAN, bool)
+      SOSS_ROS2_NUMBER_FROM_SOSS(ROS_TYPE_OCTET, uint8_t)
+      SOSS_ROS2_NUMBER_FROM_SOSS(ROS_TYPE_UINT8, uint8_t)
+      SOSS_ROS2_NUMBER_FROM_SOSS(ROS_TYPE_INT8, int8_t)
+      SOSS_ROS2_NUMBER_FROM_SOSS(ROS_TYPE_UINT16, uint16_t)
+      SOSS_ROS2_NUMBER_FROM_SOSS(ROS_TYPE_INT16, int16_t)
+      SOSS_ROS2_NUMBER_FROM_SOSS(ROS_TYPE_UINT32, uint32_t)
+      SOSS_ROS2_NUMBER_FROM_SOSS(ROS_TYPE_INT32, int32_t)
+      SOSS_ROS2_NUMBER_FROM_SOSS(ROS_TYPE_UINT64, uint64_t)
+      SOSS_ROS2_NUMBER_FROM_SOSS(ROS_TYPE_INT64, int64_t)
+
+      case rti::ROS_TYPE_STRING:
+        if(const auto* const value = field.cast<std::string>())
+          *static_cast<std::string*>(ptr) = *value;
+        break;
+
+      case rti::ROS_TYPE_WSTRING:
+        if(const auto* const value = field.cast<std::u16string>())
+          *static_cast<std::u16string*>(ptr) = *value;
+        break;
+
+      case rti::ROS_TYPE_MESSAGE:
+        if(const auto* const value = field.cast<soss::Message>())
+          from_soss(*member.nested, *value, ptr);
+        break;
+
+      default:
+        break;
+    }
+
+#undef SOSS_ROS2_NUMBER_FROM_SOSS
+  }
+}
+
+//==============================================================================
+/// A native message of a type that is only known at runtime
+class NativeBuffer
+{
+public:
+
+  NativeBuffer(const Layout& layout)
+    : _layout(layout),
+      _storage(new std::max_align_t[
+               (layout.members->size_of_ + sizeof(std::max_align_t) - 1)
+               / sizeof(std::max_align_t)])
+  {
+    _layout.members->init_function(
+          _storage.get(), rosidl_runtime_cpp::MessageInitialization::ALL);
+  }
+
+  ~NativeBuffer()
+  {
+    _layout.members->fini_function(_storage.get());
+  }
+
+  void* data()
+  {
+    return _storage.get();
+  }
+
+  NativeBuffer(const NativeBuffer&) = delete;
+  NativeBuffer& operator=(const NativeBuffer&) = delete;
+
+private:
+
+  const Layout& _layout;
+  std::unique_ptr<std::max_align_t[]> _storage;
+
+};
+
+using NativeBufferPool = soss::ResourcePool<
+    std::shared_ptr<NativeBuffer>, &initialize_shared_null<NativeBuffer>>;
+
+//==============================================================================
+soss::Message initialize_empty_message()
+{
+  return soss::Message();
+}
+
+//==============================================================================
+/// Loads the type support libraries of message types on demand. Each type
+/// gets one attempt, and the libraries stay loaded for as long as the process
+/// runs.
+class TypeSupportLoader
+{
+public:
+
+  static TypeSupportLoader& instance()
+  {
+    static TypeSupportLoader loader;
+    return loader;
+  }
+
+  LoadedTypePtr load(const std::string& message_type)
+  {
+    std::unique_lock<std::mutex> lock(_mutex);
+    const auto found = _types.find(message_type);
+    if(found != _types.end())
+      return found->second;
+
+    LoadedTypePtr& type = _types[message_type];
+    type = _load(message_type);
+    return type;
+  }
+
+private:
+
+  LoadedTypePtr _load(const std::string& message_type)
+  {
+    // Types are written as package/Type or package/msg/Type
+    const std::size_t first_slash = message_type.find('/');
+    const std::size_t last_slash = message_type.rfind('/');
+    if(first_slash == std::string::npos
+       || (last_slash != first_slash
+           && message_type.substr(first_slash, last_slash - first_slash)
+              != "/msg"))
+    {
+      return nullptr;
+    }
+
+    const std::string package = message_type.substr(0, first_slash);
+    const std::string name = message_type.substr(last_slash + 1);
+
+    const auto rmw_support = _type_support(
+          package, name, "rosidl_typesupport_cpp");
+    const auto introspection = _type_support(
+          package, name, "rosidl_typesupport_introspection_cpp");
+    if(!rmw_support || !introspection)
+      return nullptr;
+
+    if(std::strcmp(introspection->typesupport_identifier,
+                   rti::typesupport_identifier) != 0)
+    {
+      std::cerr << "[soss::ros2] The introspection library of the message type ["
+                << message_type << "] has the unexpected type support ["
+                << introspection->typesupport_identifier << "]" << std::endl;
+      return nullptr;
+    }
+
+    auto type = std::make_shared<LoadedType>();
+    type->rmw_support = rmw_support;
+    type->layout = make_layout(
+          *static_cast<const rti::MessageMembers*>(introspection->data),
+          _layouts);
+    return type;
+  }
+
+  static const rosidl_message_type_support_t* _type_support(
+      const std::string& package,
+      const std::string& name,
+      const std::string& typesupport)
+  {
+#ifdef __APPLE__
+    const std::string library =
+        "lib" + package + "__" + typesupport + ".dylib";
+#else
+    const std::string library = "lib" + package + "__" + typesupport + ".so";
+#endif
+
+    // The handle is never closed, because the types of the library may be used
+    // until the process exits
+    void* const handle = dlopen(library.c_str(), RTLD_LAZY | RTLD_LOCAL);
+    if(!handle)
+      return nullptr;
+
+    using GetTypeSupport = const rosidl_message_type_support_t* (*)();
+    const std::string symbol =
+        typesupport + "__get_message_type_support_handle__"
+        + package + "__msg__" + name;
+    const auto get = reinterpret_cast<GetTypeSupport>(
+          dlsym(handle, symbol.c_str()));
+    if(!get)
+      return nullptr;
+
+    return get();
+  }
+
+  std::mutex _mutex;
+  std::unordered_map<std::string, LoadedTypePtr> _types;
+  LayoutMap _layouts;
+
+};
+
+//==============================================================================
+class Subscription final : public rclcpp::SubscriptionBase
+{
+public:
+
+  Subscription(
+      rclcpp::Node& node,
+      LoadedTypePtr type,
+      const std::string& topic_name,
+      TopicSubscriberSystem::SubscriptionCallback callback,
+      const rmw_qos_profile_t& qos_profile,
+      const Factory::SubscriptionOptions& options)
+    : rclcpp::SubscriptionBase(
+        node.get_node_base_interface().get(),
+        *type->rmw_support,
+        topic_name,
+        _options(qos_profile),
+        true),
+      _type(std::move(type)),
+      _callback(std::move(callback)),
+      _metrics(soss::Metrics::topic(topic_name)),
+      _serialized(options.serialized),
+      _messages(0),
+      _buffers(0)
+  {
+    const Layout& layout = *_type->layout;
+    _messages.setInitializer([&layout]() { return layout.prototype; });
+    _buffers.setInitializer([&layout]()
+    {
+      return std::make_shared<NativeBuffer>(layout);
+    });
+  }
+
+  std::shared_ptr<void> create_message() override
+  {
+    return create_serialized_message();
+  }
+
+  std::shared_ptr<rclcpp::SerializedMessage>
+  create_serialized_message() override
+  {
+    return std::make_shared<rclcpp::SerializedMessage>(0);
+  }
+
+  void handle_message(
+      std::shared_ptr<void>& message,
+      const rclcpp::MessageInfo& /*message_info*/) override
+  {
+    // Mark when the message arrived, so the metrics include its conversion
+    const soss::Ingress::Scope ingress;
+
+    const auto serialized =
+        std::static_pointer_cast<rclcpp::SerializedMessage>(message);
+    _metrics.count_bytes(serialized->size());
+
+    const std::shared_ptr<soss::Message> soss_message = _messages.lease();
+    if(_serialized)
+    {
+      soss_message->native = std::make_shared<NativeSerializedMessage>(
+            _type->layout->type, serialized);
+      _callback(*soss_message);
+      soss_message->native.reset();
+      return;
+    }
+
+    const std::shared_ptr<std::shared_ptr<NativeBuffer>> buffer =
+        _buffers.lease();
+    const auto start = std::chrono::steady_clock::now();
+    if(rmw_deserialize(
+         &serialized->get_rcl_serialized_message(), _type->rmw_support,
+         (*buffer)->data()) != RMW_RET_OK)
+    {
+      std::cerr << "[soss::ros2] Failed to deserialize a message of type ["
+                << _type->layout->type << "] on the topic [" << get_topic_name()
+                << "]: " << rmw_get_error_string().str << std::endl;
+      rmw_reset_error();
+      _metrics.count_drop();
+      return;
+    }
+
+    const char* const type_name = _type->layout->type.c_str();
+    SOSS_TRACE(convert_to_soss_begin, type_name, soss_message.get());
+    to_soss(*_type->layout, (*buffer)->data(), *soss_message);
+    SOSS_TRACE(convert_to_soss_end, type_name, soss_message.get());
+    _metrics.record_conversion(std::chrono::steady_clock::now() - start);
+
+    _callback(*soss_message);
+  }
+
+  void handle_loaned_message(
+      void* /*loaned_message*/,
+      const rclcpp::MessageInfo& /*message_info*/) override
+  {
+    // Serialized subscriptions never receive loaned messages
+  }
+
+  void return_message(std::shared_ptr<void>& message) override
+  {
+    message.reset();
+  }
+
+  void return_serialized_message(
+      std::shared_ptr<rclcpp::SerializedMessage>& message) override
+  {
+    message.reset();
+  }
+
+private:
+
+  static rcl_subscription_options_t _options(
+      const rmw_qos_profile_t& qos_profile)
+  {
+    rcl_subscription_options_t options = rcl_subscription_get_default_options();
+    options.qos = qos_profile;
+    return options;
+  }
+
+  const LoadedTypePtr _type;
+  TopicSubscriberSystem::SubscriptionCallback _callback;
+  soss::ChannelMetrics& _metrics;
+
+  // True if we attach the serialized message instead of converting it
+  const bool _serialized;
+
+  // Each callback leases a message and a native buffer of its own, so that
+  // concurrent callbacks do not share them
+  soss::ResourcePool<soss::Message, &initialize_empty_message> _messages;
+  NativeBufferPool _buffers;
+
+};
+
+//==============================================================================
+class RclPublisher final : public rclcpp::PublisherBase
+{
+public:
+
+  RclPublisher(
+      rclcpp::Node& node,
+      const rosidl_message_type_support_t& type_support,
+      const std::string& topic_name,
+      const rmw_qos_profile_t& qos_profile)
+    : rclcpp::PublisherBase(
+        node.get_node_base_interface().get(),
+        topic_name,
+        type_support,
+        _options(qos_profile))
+  {
+    // Do nothing
+  }
+
+private:
+
+  static rcl_publisher_options_t _options(const rmw_qos_profile_t& qos_profile)
+  {
+    rcl_publisher_options_t options = rcl_publisher_get_default_options();
+    options.qos = qos_profile;
+    return options;
+  }
+
+};
+
+//==============================================================================
+class Publisher final : public virtual soss::TopicPublisher
+{
+public:
+
+  Publisher(
+      rclcpp::Node& node,
+      LoadedTypePtr type,
+      const std::string& topic_name,
+      const rmw_qos_profile_t& qos_profile)
+    : _type(std::move(type)),
+      _metrics(soss::Metrics::topic(topic_name)),
+      _buffers(0)
+  {
+    _publisher = std::make_shared<RclPublisher>(
+          node, *_type->rmw_support, topic_name, qos_profile);
+    node.get_node_topics_interface()->add_publisher(_publisher, nullptr);
+
+    const Layout& layout = *_type->layout;
+    _buffers.setInitializer([&layout]()
+    {
+      return std::make_shared<NativeBuffer>(layout);
+    });
+  }
+
+  bool publish(const soss::Message& message) override
+  {
+    rcl_publisher_t* const handle = &*_publisher->get_publisher_handle();
+
+    // A message that came from a serialized ros2 subscription is forwarded
+    // byte for byte, as long as it has the same type as this publisher.
+    if(const auto* serialized = dynamic_cast<const NativeSerializedMessage*>(
+         message.native.get()))
+    {
+      if(serialized->type() != _type->layout->type)
+      {
+        std::cerr << "[soss::ros2] A serialized message of type ["
+                  << serialized->type() << "] cannot be published as ["
+                  << _type->layout->type << "]. Remove the [serialized] "
+                  << "option from the topic, so that its messages get "
+                  << "converted." << std::endl;
+        return false;
+      }
+
+      _metrics.count_bytes(serialized->message().size());
+      return _check(rcl_publish_serialized_message(
+            handle, &serialized->message().get_rcl_serialized_message(),
+            nullptr));
+    }
+
+    const std::shared_ptr<std::shared_ptr<NativeBuffer>> buffer =
+        _buffers.lease();
+    const char* const type_name = _type->layout->type.c_str();
+    const auto start = std::chrono::steady_clock::now();
+    SOSS_TRACE(convert_from_soss_begin, type_name, &message);
+    from_soss(*_type->layout, message, (*buffer)->data());
+    SOSS_TRACE(convert_from_soss_end, type_name, &message);
+    _metrics.record_conversion(std::chrono::steady_clock::now() - start);
+
+    return _check(rcl_publish(handle, (*buffer)->data(), nullptr));
+  }
+
+private:
+
+  bool _check(const rcl_ret_t result)
+  {
+    if(result == RCL_RET_OK)
+      return true;
+
+    std::cerr << "[soss::ros2] Failed to publish a message of type ["
+              << _type->layout->type << "] on the topic ["
+              << _publisher->get_topic_name() << "]: "
+              << rcl_get_error_string().str << std::endl;
+    rcl_reset_error();
+    _metrics.count_drop();
+    return false;
+  }
+
+  const LoadedTypePtr _type;
+  std::shared_ptr<RclPublisher> _publisher;
+  soss::ChannelMetrics& _metrics;
+
+  // Each concurrent publish leases a native buffer of its own
+  NativeBufferPool _buffers;
+
+};
+
+} // anonymous namespace
+
+//==============================================================================
+bool introspection_available(const std::string& message_type)
+{
+  return static_cast<bool>(TypeSupportLoader::instance().load(message_type));
+}
+
+//==============================================================================
+bool register_introspection_factories(const std::string& message_type)
+{
+  const LoadedTypePtr type = TypeSupportLoader::instance().load(message_type);
+  if(!type)
+    return false;
+
+  Factory::instance().register_subscription_factory(
+        message_type,
+        [type](
+        rclcpp::Node& node,
+        const std::string& topic_name,
+        TopicSubscriberSystem::SubscriptionCallback callback,
+        const rmw_qos_profile_t& qos_profile,
+        const Factory::CallbackGroupPtr& callback_group,
+        const Factory::SubscriptionOptions& options) -> std::shared_ptr<void>
+  {
+    if(options.direct_json)
+    {
+      std::cerr << "[soss::ros2] The option [direct_json] is not available for "
+                << "the topic [" << topic_name << "], because its type ["
+                << type->layout->type << "] has no generated extension. Its "
+                << "messages will be converted as usual." << std::endl;
+    }
+
+    auto subscription = std::make_shared<Subscription>(
+          node, type, topic_name, std::move(callback), qos_profile, options);
+    node.get_node_topics_interface()->add_subscription(
+          subscription, callback_group);
+    return subscription;
+  });
+
+  Factory::instance().register_publisher_factory(
+        message_type,
+        [type](
+        rclcpp::Node& node,
+        const std::string& topic_name,
+        const rmw_qos_profile_t& qos_profile)
+        -> std::shared_ptr<soss::TopicPublisher>
+  {
+    return std::make_shared<Publisher>(node, type, topic_name, qos_profile);
+  });
+
+  return true;
+}
+
+#else // SOSS_ROS2__INTROSPECTION
+
+//==============================================================================
+bool introspection_available(const std::string& /*message_type*/)
+{
+  return false;
+}
+
+//==============================================================================
+bool register_introspection_factories(const std::string& /*message_type*/)
+{
+  return false;
+}
+
+#endif // SOSS_ROS2__INTROSPECTION
+
+} // namespace ros2
+} // namespace soss
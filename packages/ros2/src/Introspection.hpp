@@ -0,0 +1,44 @@
+/*
+ * Copyright (C) 2019 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#ifndef SOSS__ROS2__SRC__INTROSPECTION_HPP
+#define SOSS__ROS2__SRC__INTROSPECTION_HPP
+
+#include <string>
+
+namespace soss {
+namespace ros2 {
+
+//==============================================================================
+/// \brief Check whether the messages of a type can be converted by walking the
+/// runtime introspection of the type, instead of through a generated
+/// extension. This loads the type support libraries of the type the first time
+/// that it gets asked about. Those libraries get installed by every ROS 2
+/// package that defines messages, so no soss_rosidl_mix(~) step is needed.
+bool introspection_available(const std::string& message_type);
+
+//==============================================================================
+/// \brief Register subscription and publisher factories for a message type
+/// that convert its messages through its runtime introspection.
+///
+/// \returns true if the factories were registered
+bool register_introspection_factories(const std::string& message_type);
+
+} // namespace ros2
+} // namespace soss
+
+#endif // SOSS__ROS2__SRC__INTROSPECTION_HPP
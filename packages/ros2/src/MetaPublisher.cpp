@@ -19,59 +19,286 @@
 
 #include <soss/ros2/Factory.hpp>
 
+#include <soss/Metrics.hpp>
 #include <soss/StringTemplate.hpp>
 
+#include <condition_variable>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
 namespace soss {
 namespace ros2 {
 
+//==============================================================================
+/// The number of messages that may wait for a publisher that is still being
+/// created, unless the configuration says otherwise
+const std::size_t DefaultCreationBuffer = 16;
+
 //==============================================================================
 class MetaPublisher : public soss::TopicPublisher
 {
 public:
 
   MetaPublisher(
+      const std::string& topic_name,
       StringTemplate&& topic_template,
       const std::string& message_type,
       rclcpp::Node& node,
       const rmw_qos_profile_t& qos_profile,
-      const YAML::Node& /*unused*/)
-    : _topic_template(std::move(topic_template)),
+      const YAML::Node& configuration)
+    : _topic_name(topic_name),
+      _topic_template(std::move(topic_template)),
       _message_type(message_type),
       _node(node),
-      _qos_profile(qos_profile)
+      _qos_profile(qos_profile),
+      _asynchronous(
+        configuration["asynchronous_creation"].as<bool>(false)),
+      _creation_buffer(
+        configuration["creation_buffer"].as<std::size_t>(
+          DefaultCreationBuffer)),
+      _cache(_topic_template)
   {
-    // Do nothing
+    // Create the publishers of the topics that are expected ahead of time, so
+    // the first messages of those topics do not wait for them
+    const YAML::Node& warm_up = configuration["warm_up"];
+    if(warm_up && !warm_up.IsSequence())
+    {
+      std::cerr << "[soss::ros2] The [warm_up] option of the topic template ["
+                << _topic_name << "] must be a list of topic names. It will "
+                << "be ignored." << std::endl;
+    }
+    else if(warm_up)
+    {
+      for(const YAML::Node& topic : warm_up)
+      {
+        const std::string name = topic.as<std::string>();
+        Entry& entry = _entry(name);
+        if(!entry.publisher)
+          _create(entry, name);
+      }
+    }
+
+    if(_asynchronous)
+      _creation_thread = std::thread([this]() { this->_creation_loop(); });
   }
 
-  bool publish(const soss::Message& message) override final
+  ~MetaPublisher() override
   {
-    const std::string topic_name = _topic_template.compute_string(message);
+    if(!_creation_thread.joinable())
+      return;
 
-    const auto insertion = _publishers.insert(
-          std::make_pair(std::move(topic_name), nullptr));
-    const bool inserted = insertion.second;
-    TopicPublisherPtr& publisher = insertion.first->second;
+    {
+      std::unique_lock<std::mutex> lock(_creation_mutex);
+      _quit = true;
+    }
+    _creation_cv.notify_all();
+    _creation_thread.join();
+  }
 
-    if(inserted)
+  bool publish(const soss::Message& message) override final
+  {
+    // Messages may be published from several threads at once, and the entry
+    // that the cache hands out is only valid until its next lookup, so it
+    // gets copied out while the cache is locked
+    EntryPtr entry;
+    std::string create_topic;
     {
-      publisher = Factory::instance().create_publisher(
-            _message_type, _node, topic_name, _qos_profile);
+      std::unique_lock<std::mutex> cache_lock(_cache_mutex);
+      entry = _cache.get(message, [&](const std::string& topic_name)
+      {
+        std::unique_lock<std::mutex> lock(_creation_mutex);
+        const EntryPtr& new_entry = _entry_ptr(topic_name);
+        if(!new_entry->requested)
+        {
+          new_entry->requested = true;
+          if(_asynchronous)
+          {
+            _requests.emplace_back(topic_name, new_entry);
+            _creation_cv.notify_all();
+          }
+          else
+          {
+            create_topic = topic_name;
+          }
+        }
+
+        return new_entry;
+      });
     }
 
-    return publisher->publish(message);
+    // Other threads wait for the publisher in the meantime, instead of
+    // waiting for the cache
+    if(!create_topic.empty())
+      _create(*entry, create_topic);
+
+    if(const auto publisher = std::atomic_load(&entry->publisher))
+      return publisher->publish(message);
+
+    return _wait_for_publisher(*entry, message);
   }
 
 
 private:
 
+  using TopicPublisherPtr = std::shared_ptr<TopicPublisher>;
+
+  struct Entry
+  {
+    Entry(const std::string& topic_name)
+      : metrics(soss::Metrics::topic(topic_name))
+    {
+      // Do nothing
+    }
+
+    /// Set once the publisher has been created. Read it with atomic_load.
+    TopicPublisherPtr publisher;
+
+    /// Guards pending and failed
+    std::mutex mutex;
+
+    /// Messages that arrived while the publisher was being created
+    std::deque<soss::Message> pending;
+
+    /// True if the publisher could not be created
+    bool failed = false;
+
+    /// True once the creation of the publisher has been requested. Guarded by
+    /// the creation mutex.
+    bool requested = false;
+
+    soss::ChannelMetrics& metrics;
+  };
+
+  using EntryPtr = std::shared_ptr<Entry>;
+
+  /// Must be called while holding the creation mutex, unless the creation
+  /// thread has not been started yet
+  const EntryPtr& _entry_ptr(const std::string& topic_name)
+  {
+    EntryPtr& entry = _entries[topic_name];
+    if(!entry)
+      entry = std::make_shared<Entry>(topic_name);
+
+    return entry;
+  }
+
+  Entry& _entry(const std::string& topic_name)
+  {
+    const EntryPtr& entry = _entry_ptr(topic_name);
+    entry->requested = true;
+    return *entry;
+  }
+
+  /// Create the publisher of an entry, then publish the messages that were
+  /// waiting for it
+  void _create(Entry& entry, const std::string& topic_name)
+  {
+    TopicPublisherPtr publisher = Factory::instance().create_publisher(
+          _message_type, _node, topic_name, _qos_profile);
+
+    std::unique_lock<std::mutex> lock(entry.mutex);
+    if(!publisher)
+    {
+      std::cerr << "[soss::ros2] Unable to create a publisher for the topic ["
+                << topic_name << "] of the topic template ["
+                << _topic_name << "]. Its messages will be dropped."
+                << std::endl;
+      for(std::size_t i=0; i < entry.pending.size(); ++i)
+        entry.metrics.count_drop();
+
+      entry.pending.clear();
+      entry.failed = true;
+      return;
+    }
+
+    // The pending messages are published while holding the lock, so that
+    // nothing can overtake them before the publisher gets handed out
+    for(const soss::Message& message : entry.pending)
+      publisher->publish(message);
+
+    entry.pending.clear();
+    std::atomic_store(&entry.publisher, std::move(publisher));
+  }
+
+  bool _wait_for_publisher(Entry& entry, const soss::Message& message)
+  {
+    std::unique_lock<std::mutex> lock(entry.mutex);
+
+    // The publisher may have been finished while we were getting the lock
+    if(const auto publisher = std::atomic_load(&entry.publisher))
+    {
+      lock.unlock();
+      return publisher->publish(message);
+    }
+
+    if(entry.failed)
+    {
+      entry.metrics.count_drop();
+      return false;
+    }
+
+    if(_creation_buffer == 0)
+    {
+      entry.metrics.count_drop();
+      return false;
+    }
+
+    // Keep the newest messages if the publisher takes longer than expected
+    if(entry.pending.size() >= _creation_buffer)
+    {
+      entry.pending.pop_front();
+      entry.metrics.count_drop();
+    }
+
+    entry.pending.push_back(message);
+    return true;
+  }
+
+  void _creation_loop()
+  {
+    std::unique_lock<std::mutex> lock(_creation_mutex);
+    while(!_quit)
+    {
+      if(_requests.empty())
+      {
+        _creation_cv.wait(lock);
+        continue;
+      }
+
+      const auto request = std::move(_requests.front());
+      _requests.pop_front();
+
+      lock.unlock();
+      _create(*request.second, request.first);
+      lock.lock();
+    }
+  }
+
+  const std::string _topic_name;
   const soss::StringTemplate _topic_template;
   const std::string _message_type;
   rclcpp::Node& _node;
   const rmw_qos_profile_t _qos_profile;
 
-  using TopicPublisherPtr = std::shared_ptr<TopicPublisher>;
-  using PublisherMap = std::unordered_map<std::string, TopicPublisherPtr>;
-  PublisherMap _publishers;
+  // True if publishers get created on a thread of their own, so that the
+  // messages of other topics do not wait for them
+  const bool _asynchronous;
+  const std::size_t _creation_buffer;
+
+  // Guards the entries, the requests and the flag to quit
+  std::mutex _creation_mutex;
+  std::condition_variable _creation_cv;
+  std::unordered_map<std::string, EntryPtr> _entries;
+  std::deque<std::pair<std::string, EntryPtr>> _requests;
+  bool _quit = false;
+  std::thread _creation_thread;
+
+  // Finds the publisher of a message without computing its topic name
+  soss::StringTemplateCache<EntryPtr> _cache;
+  std::mutex _cache_mutex;
 
 };
 
@@ -96,6 +323,7 @@ std::shared_ptr<soss::TopicPublisher> make_meta_publisher(
     const YAML::Node& configuration)
 {
   return std::make_shared<MetaPublisher>(
+      topic_name,
       StringTemplate(topic_name, make_detail_string(topic_name, message_type)),
       message_type, node, qos_profile, configuration);
 }
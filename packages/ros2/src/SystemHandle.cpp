@@ -16,50 +16,171 @@
 */
 
 #include "SystemHandle.hpp"
+#include "DomainContext.hpp"
+#include "Introspection.hpp"
 #include "MetaPublisher.hpp"
 
 #include <soss/ros2/Factory.hpp>
+#include <soss/ros2/serialized.hpp>
 
 #include <soss/Mix.hpp>
 #include <soss/Search.hpp>
 
+#include <rclcpp/executors/multi_threaded_executor.hpp>
 #include <rclcpp/executors/single_threaded_executor.hpp>
 
+#include <set>
+
 namespace soss {
 namespace ros2 {
 
 namespace {
 
-int set_platform_env(
-    const std::string& variable, 
-    const std::string& value, 
-    const bool overwrite)
+//==============================================================================
+/// Subscriptions and client proxies that were made with the same arguments
+/// share a key, so the last of them can be found when soss takes it back
+std::string entity_key(
+    const std::string& name,
+    const std::string& type,
+    const YAML::Node& configuration)
 {
-#ifdef WIN32
-  std::ostringstream aux_d;
-  aux_d << variable << "=" << value;
-  return _putenv(aux_d.str().c_str());
-#else
-  return setenv(variable.c_str(), value.c_str(), overwrite);
-#endif // WIN32
+  std::string key = name;
+  key.append(1, '\n').append(type);
+  key.append(1, '\n').append(YAML::Dump(configuration));
+  return key;
 }
 
-int unset_platform_env(
-    const std::string& variable)
+//==============================================================================
+/// Release the last of the entities that were made with the given key
+template<typename T>
+bool release_last(
+    std::unordered_map<std::string, std::vector<std::shared_ptr<T>>>& entities,
+    const std::string& key)
 {
-#ifdef WIN32
-  return set_platform_env(variable, "", false);
-#else
-  return unsetenv(variable.c_str());
-#endif // WIN32
+  const auto it = entities.find(key);
+  if(it == entities.end())
+    return false;
+
+  it->second.pop_back();
+  if(it->second.empty())
+    entities.erase(it);
+
+  return true;
 }
 
+//==============================================================================
+void print_invalid_qos_value(
+    const std::string& key,
+    const std::string& value)
+{
+  std::cerr << "[soss::ros2] Ignoring invalid value [" << value << "] for the "
+            << "QoS setting [" << key << "]" << std::endl;
+}
+
+//==============================================================================
+rmw_time_t parse_rmw_time(const YAML::Node& node)
+{
+  // Durations are given in seconds
+  const double seconds = node.as<double>();
+  rmw_time_t time;
+  time.sec = static_cast<uint64_t>(seconds);
+  time.nsec = static_cast<uint64_t>((seconds - time.sec) * 1e9);
+  return time;
+}
+
+//==============================================================================
+/// Parse the `qos` entry of a topic or service configuration. This can either
+/// be the name of one of the predefined rmw profiles, or a dictionary of
+/// settings that modify the given default profile, e.g.:
+///
+///     ros2: { qos: { reliability: best_effort, depth: 5, deadline: 0.1 } }
 rmw_qos_profile_t parse_rmw_qos_configuration(
-    const YAML::Node& /*configuration*/)
+    const YAML::Node& configuration,
+    const rmw_qos_profile_t& default_profile = rmw_qos_profile_default)
 {
-  // TODO(MXG): Parse the configuration node
-  // This is currently considered low-priority
-  return rmw_qos_profile_default;
+  rmw_qos_profile_t profile = default_profile;
+
+  const YAML::Node qos = configuration["qos"];
+  if(!qos)
+    return profile;
+
+  if(qos.IsScalar())
+  {
+    const std::string name = qos.as<std::string>();
+    if(name == "default")
+      profile = rmw_qos_profile_default;
+    else if(name == "sensor_data")
+      profile = rmw_qos_profile_sensor_data;
+    else if(name == "services_default")
+      profile = rmw_qos_profile_services_default;
+    else if(name == "parameters")
+      profile = rmw_qos_profile_parameters;
+    else if(name == "system_default")
+      profile = rmw_qos_profile_system_default;
+    else
+      print_invalid_qos_value("qos", name);
+
+    return profile;
+  }
+
+  if(const YAML::Node history = qos["history"])
+  {
+    const std::string value = history.as<std::string>();
+    if(value == "keep_last")
+      profile.history = RMW_QOS_POLICY_HISTORY_KEEP_LAST;
+    else if(value == "keep_all")
+      profile.history = RMW_QOS_POLICY_HISTORY_KEEP_ALL;
+    else if(value == "system_default")
+      profile.history = RMW_QOS_POLICY_HISTORY_SYSTEM_DEFAULT;
+    else
+      print_invalid_qos_value("history", value);
+  }
+
+  if(const YAML::Node depth = qos["depth"])
+    profile.depth = depth.as<std::size_t>();
+
+  if(const YAML::Node reliability = qos["reliability"])
+  {
+    const std::string value = reliability.as<std::string>();
+    if(value == "reliable")
+      profile.reliability = RMW_QOS_POLICY_RELIABILITY_RELIABLE;
+    else if(value == "best_effort")
+      profile.reliability = RMW_QOS_POLICY_RELIABILITY_BEST_EFFORT;
+    else if(value == "system_default")
+      profile.reliability = RMW_QOS_POLICY_RELIABILITY_SYSTEM_DEFAULT;
+    else
+      print_invalid_qos_value("reliability", value);
+  }
+
+  if(const YAML::Node durability = qos["durability"])
+  {
+    const std::string value = durability.as<std::string>();
+    if(value == "volatile")
+      profile.durability = RMW_QOS_POLICY_DURABILITY_VOLATILE;
+    else if(value == "transient_local")
+      profile.durability = RMW_QOS_POLICY_DURABILITY_TRANSIENT_LOCAL;
+    else if(value == "system_default")
+      profile.durability = RMW_QOS_POLICY_DURABILITY_SYSTEM_DEFAULT;
+    else
+      print_invalid_qos_value("durability", value);
+  }
+
+#ifdef RCLCPP__QOS_HPP_
+  // Deadline and lifespan are not available in crystal
+  if(const YAML::Node deadline = qos["deadline"])
+    profile.deadline = parse_rmw_time(deadline);
+
+  if(const YAML::Node lifespan = qos["lifespan"])
+    profile.lifespan = parse_rmw_time(lifespan);
+#else
+  if(qos["deadline"] || qos["lifespan"])
+  {
+    std::cerr << "[soss::ros2] The deadline and lifespan QoS settings are not "
+              << "supported by this version of ROS 2" << std::endl;
+  }
+#endif
+
+  return profile;
 }
 
 }
@@ -97,15 +218,7 @@ bool SystemHandle::configure(
     const RequiredTypes& types,
     const YAML::Node& configuration)
 {
-  const int argc = 1;
-  const char* argv[argc];
   bool success = true;
-  argv[0] = "soss";
-
-  if(!rclcpp::is_initialized())
-  {
-    rclcpp::init(argc, argv);
-  }
 
   std::string ns = "";
   if(const YAML::Node namespace_node = configuration["namespace"])
@@ -119,64 +232,119 @@ bool SystemHandle::configure(
     name = name_node.as<std::string>("");
   }
 
+  std::string domain;
   if(const YAML::Node domain_node = configuration["domain"])
   {
-    std::string previous_domain;
-    if(getenv("ROS_DOMAIN_ID") != nullptr)
-    {
-      previous_domain = getenv("ROS_DOMAIN_ID");
-    }
+    domain = domain_node.as<std::string>();
+  }
+
+  try
+  {
+    _node = make_domain_node(name, ns, domain);
+  }
+  catch(const std::exception& e)
+  {
+    std::cerr << "[soss::ros2] Failed to create the node [" << name << "]: "
+              << e.what() << std::endl;
+    return false;
+  }
 
-    std::string domain = domain_node.as<std::string>();
+  _context = _node->get_node_base_interface()->get_context();
 
-    success += set_platform_env("ROS_DOMAIN_ID", domain.c_str(), true);
+  std::size_t threads = 1;
+  if(const YAML::Node executor_node = configuration["executor"])
+  {
+    if(const YAML::Node threads_node = executor_node["threads"])
+      threads = threads_node.as<std::size_t>();
+  }
 
-    _node = std::make_shared<rclcpp::Node>(name, ns);
+  // The executor must wait on the context of our domain, or else it would
+  // never notice that the context has been shut down
+  rclcpp::executor::ExecutorArgs executor_args =
+      rclcpp::executor::create_default_executor_arguments();
+  executor_args.context = _context;
 
-    if(previous_domain.empty())
-    {
-      success += unset_platform_env("ROS_DOMAIN_ID");
-    }
-    else
-    {
-      success += set_platform_env("ROS_DOMAIN_ID", previous_domain.c_str(), true);
-    }
+  if(threads == 1)
+  {
+    _executor = std::make_unique<rclcpp::executors::SingleThreadedExecutor>(
+          executor_args);
   }
   else
   {
-    _node = std::make_shared<rclcpp::Node>(name, ns);
+    // A thread count of 0 lets rclcpp use one thread per CPU core
+    _multi_threaded = true;
+    _executor = std::make_unique<rclcpp::executors::MultiThreadedExecutor>(
+          executor_args, threads);
   }
 
-  // TODO(MXG): Allow the type of executor to be specified by the configuration
-  _executor = std::make_unique<rclcpp::executors::SingleThreadedExecutor>();
+  // With lazy loading, the extension of a type only gets loaded when the
+  // Factory is first asked to create something of that type, except for the
+  // types that have been listed to preload. We still look for every extension
+  // up front, so that missing ones get reported right away.
+  const bool lazy = configuration["lazy_loading"].as<bool>(false);
+  std::set<std::string> preload;
+  if(const YAML::Node preload_node = configuration["preload"])
+  {
+    for(const YAML::Node& type : preload_node)
+      preload.insert(type.as<std::string>());
+  }
 
+  // Find the extension of every type up front, so that they can all be loaded
+  // together. Packages generated by soss_rosidl_mix have one extension for all
+  // of their types, which only needs to be loaded once, no matter how many of
+  // its types we use. Otherwise we fall back to the extension of each type.
   soss::Search search("ros2");
+  std::vector<std::string> mix_paths;
+  std::set<std::string> added_mix_paths;
+  const auto find_mix_path = [&](
+      const std::string& type,
+      const bool is_message,
+      std::vector<std::string>* checked_paths) -> std::string
+  {
+    const std::string package_mix_path = search.find_package_mix(type);
+    if(!package_mix_path.empty())
+      return package_mix_path;
+
+    return is_message?
+          search.find_message_mix(type, checked_paths)
+        : search.find_service_mix(type, checked_paths);
+  };
+
+  const auto add_mix_path = [&](
+      const std::string& type,
+      const std::string& path)
+  {
+    if(!lazy || preload.erase(type) > 0)
+    {
+      if(added_mix_paths.insert(path).second)
+        mix_paths.push_back(path);
+    }
+  };
+
   for(const std::string& type : types.messages)
   {
     std::vector<std::string> checked_paths;
-    const std::string msg_mix_path =
-        search.find_message_mix(type, &checked_paths);
+    const std::string msg_mix_path = find_mix_path(type, true, &checked_paths);
 
     if(msg_mix_path.empty())
     {
+      // The Factory falls back to the runtime introspection of the type when
+      // something of this type gets created
+      if(introspection_available(type))
+        continue;
+
       print_missing_mix_file("message", type, checked_paths);
       success = false;
       continue;
     }
 
-    if(!Mix::from_file(msg_mix_path).load())
-    {
-      std::cerr << "soss-ros2 failed to load extension for message type ["
-                << type << "] using mix file: " << msg_mix_path << std::endl;
-      success = false;
-    }
+    add_mix_path(type, msg_mix_path);
   }
 
   for(const std::string& type : types.services)
   {
     std::vector<std::string> checked_paths;
-    const std::string srv_mix_path =
-        search.find_service_mix(type, &checked_paths);
+    const std::string srv_mix_path = find_mix_path(type, false, &checked_paths);
 
     if(srv_mix_path.empty())
     {
@@ -185,12 +353,33 @@ bool SystemHandle::configure(
       continue;
     }
 
-    if(!Mix::from_file(srv_mix_path).load())
+    add_mix_path(type, srv_mix_path);
+  }
+
+  // Types may be preloaded even if no topic or service of this system names
+  // them yet, e.g. because they will be advertised at runtime
+  for(const std::string& type : preload)
+  {
+    std::string mix_path = find_mix_path(type, true, nullptr);
+    if(mix_path.empty())
+      mix_path = search.find_service_mix(type);
+
+    if(mix_path.empty())
     {
-      std::cerr << "soss-ros2 failed to load extension for service type ["
-                << type << "] using mix file: " << srv_mix_path << std::endl;
-      success = false;
+      std::cerr << "[soss::ros2] Could not find the extension of the type ["
+                << type << "] that was listed to preload" << std::endl;
+      continue;
     }
+
+    if(added_mix_paths.insert(mix_path).second)
+      mix_paths.push_back(mix_path);
+  }
+
+  if(!Mix::load_files(mix_paths))
+  {
+    std::cerr << "soss-ros2 failed to load the extensions of some of its "
+              << "message or service types" << std::endl;
+    success = false;
   }
 
   return success;
@@ -200,7 +389,7 @@ bool SystemHandle::configure(
 bool SystemHandle::okay() const
 {
   if(_node)
-    return rclcpp::ok();
+    return rclcpp::ok(_context);
 
   return false;
 }
@@ -208,17 +397,59 @@ bool SystemHandle::okay() const
 //==============================================================================
 bool SystemHandle::spin_once()
 {
+  if(_multi_threaded)
+  {
+    // The multi-threaded executor runs its own pool of threads, so we only
+    // need to start it up the first time that we're spun.
+    if(!_spin_thread.joinable())
+    {
+      _executor->add_node(_node);
+      _spin_thread = std::thread([this]() { this->_executor->spin(); });
+    }
+
+    return rclcpp::ok(_context);
+  }
+
+  // The executor blocks until one of our entities is ready or until wake_up()
+  // interrupts it, so the timeout only bounds how long it takes to notice a
+  // SIGINT.
   _executor->spin_node_once(_node, std::chrono::milliseconds(100));
-  return rclcpp::ok();
+  return rclcpp::ok(_context);
+}
+
+//==============================================================================
+void SystemHandle::wake_up()
+{
+  // Cancelling triggers the executor's interrupt guard condition, which makes
+  // any ongoing spin_node_once() return early.
+  if(_executor)
+    _executor->cancel();
+}
+
+//==============================================================================
+bool SystemHandle::self_driven() const
+{
+  return _multi_threaded;
 }
 
 //==============================================================================
 SystemHandle::~SystemHandle()
 {
+  if(_spin_thread.joinable())
+  {
+    _executor->cancel();
+    _spin_thread.join();
+  }
+
   _subscriptions.clear();
   _client_proxies.clear();
+  _callback_groups.clear();
+  _executor.reset();
 
-  rclcpp::shutdown();
+  // The context of our domain gets shut down once every node that uses it,
+  // including any publishers that outlive us, has been released
+  _node.reset();
+  _context.reset();
 }
 
 //==============================================================================
@@ -228,17 +459,62 @@ bool SystemHandle::subscribe(
     SubscriptionCallback callback,
     const YAML::Node& configuration)
 {
+  Factory::SubscriptionOptions options;
+  options.direct_json = configuration["direct_json"].as<bool>(false);
+#ifndef SOSS_ROS2__DIRECT_JSON
+  if(options.direct_json)
+  {
+    std::cerr << "[soss::ros2] The option [direct_json] was requested for the "
+              << "topic [" << topic_name << "], but soss-ros2 was built "
+              << "without soss-json. The messages of this topic will be "
+              << "converted as usual." << std::endl;
+    options.direct_json = false;
+  }
+#endif // SOSS_ROS2__DIRECT_JSON
+
+  options.serialized = configuration["serialized"].as<bool>(false);
+#ifndef SOSS_ROS2__SERIALIZED_MESSAGES
+  if(options.serialized)
+  {
+    std::cerr << "[soss::ros2] The option [serialized] was requested for the "
+              << "topic [" << topic_name << "], but this version of rclcpp "
+              << "does not support serialized subscriptions. The messages of "
+              << "this topic will be converted as usual." << std::endl;
+    options.serialized = false;
+  }
+#endif // SOSS_ROS2__SERIALIZED_MESSAGES
+
+  if(options.serialized && options.direct_json)
+  {
+    std::cerr << "[soss::ros2] The options [serialized] and [direct_json] "
+              << "cannot both be used for the topic [" << topic_name << "]. "
+              << "Only [serialized] will be applied." << std::endl;
+    options.direct_json = false;
+  }
+
   auto subscription = Factory::instance().create_subscription(
         message_type, *_node, topic_name, std::move(callback),
-        parse_rmw_qos_configuration(configuration));
+        parse_rmw_qos_configuration(configuration),
+        _callback_group(configuration), options);
 
   if(!subscription)
     return false;
 
-  _subscriptions.emplace_back(std::move(subscription));
+  _subscriptions[entity_key(topic_name, message_type, configuration)]
+      .emplace_back(std::move(subscription));
   return true;
 }
 
+//==============================================================================
+bool SystemHandle::unsubscribe(
+    const std::string& topic_name,
+    const std::string& message_type,
+    const YAML::Node& configuration)
+{
+  return release_last(
+        _subscriptions, entity_key(topic_name, message_type, configuration));
+}
+
 //==============================================================================
 std::shared_ptr<TopicPublisher> SystemHandle::advertise(
     const std::string& topic_name,
@@ -269,15 +545,28 @@ bool SystemHandle::create_client_proxy(
 {
   auto client_proxy = Factory::instance().create_client_proxy(
         service_type, *_node, service_name, callback,
-        parse_rmw_qos_configuration(configuration));
+        parse_rmw_qos_configuration(
+          configuration, rmw_qos_profile_services_default),
+        _callback_group(configuration));
 
   if(!client_proxy)
     return false;
 
-  _client_proxies.emplace_back(std::move(client_proxy));
+  _client_proxies[entity_key(service_name, service_type, configuration)]
+      .emplace_back(std::move(client_proxy));
   return true;
 }
 
+//==============================================================================
+bool SystemHandle::release_client_proxy(
+    const std::string& service_name,
+    const std::string& service_type,
+    const YAML::Node& configuration)
+{
+  return release_last(
+        _client_proxies, entity_key(service_name, service_type, configuration));
+}
+
 //==============================================================================
 std::shared_ptr<ServiceProvider> SystemHandle::create_service_proxy(
     const std::string& service_name,
@@ -286,7 +575,33 @@ std::shared_ptr<ServiceProvider> SystemHandle::create_service_proxy(
 {
   return Factory::instance().create_server_proxy(
         service_type, *_node, service_name,
-        parse_rmw_qos_configuration(configuration));
+        parse_rmw_qos_configuration(
+          configuration, rmw_qos_profile_services_default),
+        _callback_group(configuration));
+}
+
+//==============================================================================
+Factory::CallbackGroupPtr SystemHandle::_callback_group(
+    const YAML::Node& configuration)
+{
+  if(!_multi_threaded)
+    return nullptr;
+
+  const auto type = rclcpp::callback_group::CallbackGroupType::MutuallyExclusive;
+
+  // By default every topic and service gets a group of its own, so that its
+  // callbacks never run concurrently with themselves, but can run alongside
+  // those of any other topic or service. Entities that name the same group
+  // will never run concurrently with each other.
+  const std::string name = configuration["callback_group"].as<std::string>("");
+  if(name.empty())
+    return _node->create_callback_group(type);
+
+  Factory::CallbackGroupPtr& group = _callback_groups[name];
+  if(!group)
+    group = _node->create_callback_group(type);
+
+  return group;
 }
 
 } // namespace ros2
@@ -25,6 +25,8 @@
 
 #include <rclcpp/executors/single_threaded_executor.hpp>
 
+#include <thread>
+#include <unordered_map>
 #include <vector>
 
 namespace soss {
@@ -49,6 +51,12 @@ public:
   // Documentation inherited
   bool spin_once() override;
 
+  // Documentation inherited
+  void wake_up() override;
+
+  // Documentation inherited
+  bool self_driven() const override;
+
   // Documentation inherited
   ~SystemHandle() override;
 
@@ -59,6 +67,12 @@ public:
       SubscriptionCallback callback,
       const YAML::Node& configuration) override;
 
+  // Documentation inherited
+  bool unsubscribe(
+      const std::string& topic_name,
+      const std::string& message_type,
+      const YAML::Node& configuration) override;
+
   // Documentation inherited
   std::shared_ptr<TopicPublisher> advertise(
       const std::string& topic_name,
@@ -72,6 +86,12 @@ public:
       RequestCallback callback,
       const YAML::Node& configuration) override;
 
+  // Documentation inherited
+  bool release_client_proxy(
+      const std::string& service_name,
+      const std::string& service_type,
+      const YAML::Node& configuration) override;
+
   // Documentation inherited
   std::shared_ptr<ServiceProvider> create_service_proxy(
       const std::string& service_name,
@@ -80,10 +100,24 @@ public:
 
 private:
 
+  /// Get the callback group that an entity with the given configuration should
+  /// use. This is always the default group of the node unless we are using a
+  /// multi-threaded executor.
+  Factory::CallbackGroupPtr _callback_group(const YAML::Node& configuration);
+
+  rclcpp::Context::SharedPtr _context;
   std::shared_ptr<rclcpp::Node> _node;
   std::unique_ptr<rclcpp::executor::Executor> _executor;
-  std::vector<std::shared_ptr<void>> _subscriptions;
-  std::vector<std::shared_ptr<ServiceClient>> _client_proxies;
+  bool _multi_threaded = false;
+  std::thread _spin_thread;
+  std::unordered_map<std::string, Factory::CallbackGroupPtr> _callback_groups;
+
+  /// key: see entity_key(~) in SystemHandle.cpp, value: the entities that were
+  /// made with it, in the order that they were made
+  std::unordered_map<std::string, std::vector<std::shared_ptr<void>>>
+      _subscriptions;
+  std::unordered_map<std::string, std::vector<std::shared_ptr<ServiceClient>>>
+      _client_proxies;
 };
 
 
@@ -0,0 +1,4 @@
+# The clients of soss-shm read their messages with soss-binary, so anything
+# that links to soss-shm also needs it.
+include(CMakeFindDependencyMacro)
+find_dependency(soss-binary)
@@ -0,0 +1,137 @@
+/*
+ * Copyright (C) 2019 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#ifndef SOSS__SHM__API_HPP
+#define SOSS__SHM__API_HPP
+
+#include <soss/Message.hpp>
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <string>
+#include <soss/shm/export.hpp>
+
+namespace soss {
+namespace shm {
+
+/// The capacity of a segment when none is configured
+constexpr std::size_t default_capacity = 4*1024*1024;
+
+/// Publishes messages into the shared memory segment of a topic. Each segment
+/// has a single publisher at a time across all the processes of the host; the
+/// segment stays behind when the publisher goes away, so a publisher that gets
+/// restarted picks up where the last one stopped and readers stay attached.
+class SOSS_SHM_API Publisher
+{
+public:
+
+  /// \param[in] capacity
+  ///   Bytes in the ring of the segment, rounded up to a power of two. A
+  ///   message may take up at most half of the ring.
+  Publisher(
+      const std::string& topic,
+      const std::string& message_type,
+      std::size_t capacity = default_capacity,
+      const std::string& prefix = "soss");
+
+  Publisher(Publisher&&);
+  Publisher& operator=(Publisher&&);
+
+  /// \brief Whether the segment could be opened for writing
+  bool valid() const;
+
+  /// \brief Write a message into the segment. This never blocks on readers;
+  /// readers that fall a whole ring behind lose the messages they missed.
+  ///
+  /// \returns false if the publisher is not valid, or if the message is too
+  /// big for the segment or holds fields that cannot be encoded
+  bool publish(const soss::Message& message);
+
+  ~Publisher();
+
+private:
+
+  class Implementation;
+  std::unique_ptr<Implementation> _pimpl;
+
+};
+
+/// Reads the messages of a topic out of its shared memory segment. Every
+/// subscriber sees every message, starting with the first one that gets
+/// published after it attached. A subscriber that is made before its segment
+/// exists keeps trying to attach whenever it is asked for a message.
+class SOSS_SHM_API Subscriber
+{
+public:
+
+  /// The bytes of an encoded message, straight out of the segment. They must
+  /// not be used after the callback returns.
+  using RawCallback = std::function<void(const uint8_t* data, std::size_t size)>;
+
+  Subscriber(
+      const std::string& topic,
+      const std::string& prefix = "soss");
+
+  Subscriber(Subscriber&&);
+  Subscriber& operator=(Subscriber&&);
+
+  /// \brief Whether the subscriber is attached to its segment
+  bool valid() const;
+
+  /// \brief The message type of the segment, or an empty string if the
+  /// subscriber is not attached yet
+  std::string message_type() const;
+
+  /// \brief Wait for the next message and decode it.
+  ///
+  /// The encoded message gets copied out of the segment before it is decoded,
+  /// so the writer can never change it underneath the decoder.
+  ///
+  /// \returns false if no message arrived before the timeout
+  bool take(soss::Message& message, std::chrono::nanoseconds timeout);
+
+  /// \brief Wait for the next message and hand its encoded bytes to the
+  /// callback without copying them. The bytes are in the soss binary format
+  /// and aligned for soss::binary::MessageView, so single fields can be read
+  /// in place without decoding the whole message.
+  ///
+  /// The writer does not wait for readers, so a callback that is slower than
+  /// a whole lap of the ring may see the bytes change while it is running.
+  ///
+  /// \returns false if no message arrived before the timeout, or if the
+  /// message was overwritten before the callback finished, in which case the
+  /// callback should throw away whatever it got out of the bytes.
+  bool take_raw(const RawCallback& callback, std::chrono::nanoseconds timeout);
+
+  /// \brief How many messages this subscriber missed because it fell too far
+  /// behind
+  uint64_t lost() const;
+
+  ~Subscriber();
+
+private:
+
+  class Implementation;
+  std::unique_ptr<Implementation> _pimpl;
+
+};
+
+} // namespace shm
+} // namespace soss
+
+#endif // SOSS__SHM__API_HPP
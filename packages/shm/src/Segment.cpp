@@ -0,0 +1,498 @@
+/*
+ * Copyright (C) 2019 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include "Segment.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <thread>
+
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace soss {
+namespace shm {
+
+namespace {
+
+//==============================================================================
+constexpr uint64_t segment_magic = 0x534f53532d53484dull; // "SOSS-SHM"
+constexpr uint32_t segment_version = 1;
+constexpr uint32_t message_record = 1;
+constexpr uint32_t padding_record = 2;
+constexpr std::size_t min_capacity = 4096;
+
+//==============================================================================
+std::size_t aligned(const std::size_t size)
+{
+  return (size + record_alignment - 1) & ~(record_alignment - 1);
+}
+
+//==============================================================================
+std::size_t ring_capacity(const std::size_t requested)
+{
+  std::size_t capacity = min_capacity;
+  while(capacity < requested)
+    capacity *= 2;
+
+  return capacity;
+}
+
+//==============================================================================
+std::string header_type(const SegmentHeader& header)
+{
+  return std::string(header.type, strnlen(header.type, sizeof(header.type)));
+}
+
+//==============================================================================
+uint32_t* futex_word(std::atomic<uint32_t>& word)
+{
+  return reinterpret_cast<uint32_t*>(&word);
+}
+
+//==============================================================================
+void futex_wait(
+    std::atomic<uint32_t>& word,
+    const uint32_t value,
+    const std::chrono::nanoseconds timeout)
+{
+  const auto seconds = std::chrono::duration_cast<std::chrono::seconds>(timeout);
+  timespec ts;
+  ts.tv_sec = static_cast<time_t>(seconds.count());
+  ts.tv_nsec = static_cast<long>((timeout - seconds).count());
+
+  // The segment is shared between processes, so this cannot be a private futex
+  syscall(SYS_futex, futex_word(word), FUTEX_WAIT, value, &ts, nullptr, 0);
+}
+
+//==============================================================================
+void futex_wake(std::atomic<uint32_t>& word)
+{
+  syscall(SYS_futex, futex_word(word), FUTEX_WAKE, INT32_MAX,
+          nullptr, nullptr, 0);
+}
+
+//==============================================================================
+bool alive(const int32_t pid)
+{
+  return pid == getpid() || kill(pid, 0) == 0 || errno == EPERM;
+}
+
+} // anonymous namespace
+
+//==============================================================================
+std::string segment_name(const std::string& prefix, const std::string& topic)
+{
+  std::string name = "/" + prefix + ".";
+  for(const char c : topic)
+  {
+    if(c == '/')
+    {
+      // Leading slashes and runs of slashes do not change the name
+      if(name.back() != '.')
+        name.push_back('.');
+    }
+    else
+    {
+      name.push_back(c);
+    }
+  }
+
+  return name;
+}
+
+//==============================================================================
+Segment::Segment(int fd, void* memory, std::size_t size)
+  : _fd(fd),
+    _memory(memory),
+    _size(size),
+    _header(static_cast<SegmentHeader*>(memory)),
+    _ring(static_cast<uint8_t*>(memory) + sizeof(SegmentHeader))
+{
+  // Do nothing
+}
+
+//==============================================================================
+std::unique_ptr<Segment> Segment::create(
+    const std::string& name,
+    const std::string& type,
+    const std::size_t capacity_hint)
+{
+  if(type.size() >= sizeof(SegmentHeader::type))
+  {
+    std::cerr << "[soss::shm] The message type [" << type << "] is too long "
+              << "for a shared memory segment" << std::endl;
+    return nullptr;
+  }
+
+  const std::size_t capacity = ring_capacity(capacity_hint);
+  const int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0666);
+  if(fd < 0)
+  {
+    if(errno != EEXIST)
+    {
+      std::cerr << "[soss::shm] Failed to create the shared memory segment ["
+                << name << "]: " << std::strerror(errno) << std::endl;
+      return nullptr;
+    }
+
+    // Someone made this segment before us. Give its creator a moment to
+    // finish setting it up.
+    std::unique_ptr<Segment> segment;
+    for(int attempt = 0; !segment && attempt < 100; ++attempt)
+    {
+      segment = open(name);
+      if(!segment)
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+
+    if(!segment)
+    {
+      std::cerr << "[soss::shm] The shared memory segment [" << name
+                << "] exists but was never set up. Remove it from /dev/shm "
+                << "to start over." << std::endl;
+      return nullptr;
+    }
+
+    const std::string existing_type = header_type(segment->header());
+    if(segment->capacity() != capacity || existing_type != type)
+    {
+      std::cerr << "[soss::shm] The shared memory segment [" << name
+                << "] already carries [" << existing_type << "] with a "
+                << "capacity of " << segment->capacity() << " bytes, but ["
+                << type << "] with a capacity of " << capacity << " bytes "
+                << "was requested" << std::endl;
+      return nullptr;
+    }
+
+    return segment;
+  }
+
+  const std::size_t size = sizeof(SegmentHeader) + capacity;
+  if(ftruncate(fd, static_cast<off_t>(size)) != 0)
+  {
+    std::cerr << "[soss::shm] Failed to size the shared memory segment ["
+              << name << "]: " << std::strerror(errno) << std::endl;
+    close(fd);
+    shm_unlink(name.c_str());
+    return nullptr;
+  }
+
+  void* const memory =
+      mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if(memory == MAP_FAILED)
+  {
+    std::cerr << "[soss::shm] Failed to map the shared memory segment ["
+              << name << "]: " << std::strerror(errno) << std::endl;
+    close(fd);
+    shm_unlink(name.c_str());
+    return nullptr;
+  }
+
+  // The memory of a new segment is all zeros, which is already the right
+  // value for every counter in the header
+  std::unique_ptr<Segment> segment(new Segment(fd, memory, size));
+  SegmentHeader& header = segment->header();
+  header.version = segment_version;
+  header.capacity = capacity;
+  std::copy(type.begin(), type.end(), header.type);
+  header.magic.store(segment_magic, std::memory_order_release);
+
+  return segment;
+}
+
+//==============================================================================
+std::unique_ptr<Segment> Segment::open(const std::string& name)
+{
+  const int fd = shm_open(name.c_str(), O_RDWR, 0);
+  if(fd < 0)
+    return nullptr;
+
+  struct stat info;
+  if(fstat(fd, &info) != 0
+     || static_cast<std::size_t>(info.st_size) < sizeof(SegmentHeader))
+  {
+    close(fd);
+    return nullptr;
+  }
+
+  const std::size_t size = static_cast<std::size_t>(info.st_size);
+  void* const memory =
+      mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if(memory == MAP_FAILED)
+  {
+    close(fd);
+    return nullptr;
+  }
+
+  std::unique_ptr<Segment> segment(new Segment(fd, memory, size));
+  const SegmentHeader& header = segment->header();
+  if(header.magic.load(std::memory_order_acquire) != segment_magic)
+    return nullptr;
+
+  if(header.version != segment_version
+     || size != sizeof(SegmentHeader) + header.capacity)
+  {
+    std::cerr << "[soss::shm] The shared memory segment [" << name
+              << "] has an incompatible layout" << std::endl;
+    return nullptr;
+  }
+
+  return segment;
+}
+
+//==============================================================================
+Segment::~Segment()
+{
+  munmap(_memory, _size);
+  close(_fd);
+}
+
+//==============================================================================
+Writer::Writer(std::unique_ptr<Segment> segment)
+  : _segment(std::move(segment))
+{
+  // A writer that died in the middle of a record may have left the reserve
+  // ahead of the head
+  SegmentHeader& header = _segment->header();
+  _position = header.head.load(std::memory_order_relaxed);
+  _end = _position;
+  header.reserve.store(_position, std::memory_order_relaxed);
+}
+
+//==============================================================================
+std::unique_ptr<Writer> Writer::make(
+    const std::string& name,
+    const std::string& type,
+    const std::size_t capacity)
+{
+  std::unique_ptr<Segment> segment = Segment::create(name, type, capacity);
+  if(!segment)
+    return nullptr;
+
+  std::atomic<int32_t>& writer = segment->header().writer;
+  const int32_t pid = getpid();
+  int32_t expected = 0;
+  while(!writer.compare_exchange_strong(expected, pid))
+  {
+    if(alive(expected))
+    {
+      std::cerr << "[soss::shm] The shared memory segment [" << name
+                << "] is already being written by process " << expected
+                << std::endl;
+      return nullptr;
+    }
+
+    // The last writer exited without letting go, so we take over from it
+  }
+
+  return std::unique_ptr<Writer>(new Writer(std::move(segment)));
+}
+
+//==============================================================================
+uint8_t* Writer::reserve(const std::size_t size)
+{
+  const std::size_t length = aligned(sizeof(RecordHeader) + size);
+  if(size > max_size())
+    return nullptr;
+
+  SegmentHeader& header = _segment->header();
+  uint8_t* const ring = _segment->ring();
+  const uint64_t capacity = _segment->capacity();
+  const uint64_t offset = _position & (capacity - 1);
+
+  uint64_t start = _position;
+  if(offset + length > capacity)
+    start += capacity - offset;
+
+  _end = start + length;
+  header.reserve.store(_end, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  if(start != _position)
+  {
+    const RecordHeader padding{
+      static_cast<uint32_t>(capacity - offset - sizeof(RecordHeader)),
+      padding_record, 0};
+    std::memcpy(ring + offset, &padding, sizeof(padding));
+  }
+
+  const RecordHeader record{
+    static_cast<uint32_t>(size), message_record,
+    header.records.load(std::memory_order_relaxed)};
+
+  uint8_t* const out = ring + (start & (capacity - 1));
+  std::memcpy(out, &record, sizeof(record));
+  return out + sizeof(RecordHeader);
+}
+
+//==============================================================================
+void Writer::commit()
+{
+  SegmentHeader& header = _segment->header();
+  _position = _end;
+  header.head.store(_position, std::memory_order_release);
+  header.records.fetch_add(1, std::memory_order_release);
+
+  header.sequence.fetch_add(1);
+  if(header.waiters.load() > 0)
+    futex_wake(header.sequence);
+}
+
+//==============================================================================
+std::size_t Writer::max_size() const
+{
+  // Leave the other half of the ring for the records that readers are still
+  // working on
+  return _segment->capacity()/2 - sizeof(RecordHeader);
+}
+
+//==============================================================================
+Writer::~Writer()
+{
+  int32_t pid = getpid();
+  _segment->header().writer.compare_exchange_strong(pid, 0);
+}
+
+//==============================================================================
+Reader::Reader(std::unique_ptr<Segment> segment)
+  : _segment(std::move(segment)),
+    _position(_segment->header().head.load(std::memory_order_acquire)),
+    _next(_position),
+    _record(_segment->header().records.load(std::memory_order_acquire)),
+    _lost(0)
+{
+  // Do nothing
+}
+
+//==============================================================================
+std::unique_ptr<Reader> Reader::make(const std::string& name)
+{
+  std::unique_ptr<Segment> segment = Segment::open(name);
+  if(!segment)
+    return nullptr;
+
+  return std::unique_ptr<Reader>(new Reader(std::move(segment)));
+}
+
+//==============================================================================
+bool Reader::next(
+    const uint8_t*& data,
+    std::size_t& size,
+    const std::chrono::nanoseconds timeout)
+{
+  SegmentHeader& header = _segment->header();
+  uint8_t* const ring = _segment->ring();
+  const uint64_t capacity = _segment->capacity();
+  const auto deadline = std::chrono::steady_clock::now() + timeout;
+
+  while(true)
+  {
+    const uint64_t head = header.head.load(std::memory_order_acquire);
+    if(_position == head)
+    {
+      const auto remaining = deadline - std::chrono::steady_clock::now();
+      if(remaining <= std::chrono::nanoseconds(0))
+        return false;
+
+      header.waiters.fetch_add(1);
+      const uint32_t sequence = header.sequence.load();
+      if(header.head.load(std::memory_order_acquire) == _position)
+        futex_wait(header.sequence, sequence, remaining);
+      header.waiters.fetch_sub(1);
+      continue;
+    }
+
+    const uint64_t offset = _position & (capacity - 1);
+    RecordHeader record;
+    std::memcpy(&record, ring + offset, sizeof(record));
+
+    const std::size_t length = aligned(sizeof(RecordHeader) + record.size);
+    if(!_intact(_position) || offset + length > capacity)
+    {
+      // The writer lapped us, so whatever we had not read yet is gone
+      _skip();
+      continue;
+    }
+
+    if(record.kind == padding_record)
+    {
+      _position += length;
+      continue;
+    }
+
+    if(record.record > _record)
+      _lost += record.record - _record;
+
+    _record = record.record + 1;
+    _next = _position + length;
+
+    data = ring + offset + sizeof(RecordHeader);
+    size = record.size;
+    return true;
+  }
+}
+
+//==============================================================================
+bool Reader::release()
+{
+  const bool intact = _intact(_position);
+  if(!intact)
+    ++_lost;
+
+  _position = _next;
+  return intact;
+}
+
+//==============================================================================
+void Reader::_skip()
+{
+  const SegmentHeader& header = _segment->header();
+  _position = header.head.load(std::memory_order_acquire);
+
+  // The record count may already include a record that is past the head we
+  // just read, but then that record will not be counted as lost again.
+  const uint64_t records = header.records.load(std::memory_order_acquire);
+  if(records > _record)
+    _lost += records - _record;
+
+  _record = records;
+}
+
+//==============================================================================
+std::string Reader::type() const
+{
+  return header_type(_segment->header());
+}
+
+//==============================================================================
+bool Reader::_intact(const uint64_t position) const
+{
+  std::atomic_thread_fence(std::memory_order_acquire);
+  return _segment->header().reserve.load(std::memory_order_relaxed)
+      <= position + _segment->capacity();
+}
+
+} // namespace shm
+} // namespace soss
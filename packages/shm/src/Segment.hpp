@@ -0,0 +1,212 @@
+/*
+ * Copyright (C) 2019 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#ifndef SOSS__SHM__SRC__SEGMENT_HPP
+#define SOSS__SHM__SRC__SEGMENT_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace soss {
+namespace shm {
+
+//==============================================================================
+/// The header at the start of every segment. The ring of records follows it.
+///
+/// Positions in the ring only ever grow; a position is turned into an offset
+/// by masking it with capacity-1. Every record starts with a RecordHeader and
+/// is padded to a multiple of record_alignment. A record is never split
+/// across the end of the ring: when it would not fit, the rest of the ring is
+/// filled with a padding record instead.
+struct SegmentHeader
+{
+  /// Set last by the creator of the segment, once everything else is ready
+  std::atomic<uint64_t> magic;
+  uint32_t version;
+  uint32_t reserved;
+  uint64_t capacity;
+  char type[256];
+
+  /// Where the writer will write next. Everything before it is readable.
+  alignas(64) std::atomic<uint64_t> head;
+
+  /// The end of the record that the writer is working on. Readers use it to
+  /// tell whether the writer might have overwritten what they just read.
+  std::atomic<uint64_t> reserve;
+
+  /// The number of records that have been written, counting from the first
+  /// writer of the segment
+  std::atomic<uint64_t> records;
+
+  /// Bumped after every record. Readers wait on it with a futex.
+  alignas(64) std::atomic<uint32_t> sequence;
+
+  /// How many readers are waiting on the futex, so the writer can skip the
+  /// system call while nobody is
+  std::atomic<uint32_t> waiters;
+
+  /// The process that is allowed to write to the segment, or 0
+  std::atomic<int32_t> writer;
+};
+
+//==============================================================================
+struct RecordHeader
+{
+  uint32_t size;
+  uint32_t kind;
+  uint64_t record;
+};
+
+constexpr std::size_t record_alignment = 16;
+
+//==============================================================================
+/// \brief The name of the shared memory object that carries a topic
+std::string segment_name(const std::string& prefix, const std::string& topic);
+
+//==============================================================================
+/// A mapping of one segment into this process
+class Segment
+{
+public:
+
+  /// \brief Open the segment with the given name, creating it if it does not
+  /// exist yet.
+  ///
+  /// \returns nullptr if the segment exists with a different capacity or
+  /// message type
+  static std::unique_ptr<Segment> create(
+      const std::string& name,
+      const std::string& type,
+      std::size_t capacity);
+
+  /// \brief Open a segment that a writer has created.
+  ///
+  /// \returns nullptr if the segment does not exist or is not ready yet
+  static std::unique_ptr<Segment> open(const std::string& name);
+
+  SegmentHeader& header() { return *_header; }
+  uint8_t* ring() { return _ring; }
+  uint64_t capacity() const { return _header->capacity; }
+
+  ~Segment();
+
+private:
+
+  Segment(int fd, void* memory, std::size_t size);
+
+  const int _fd;
+  void* const _memory;
+  const std::size_t _size;
+  SegmentHeader* const _header;
+  uint8_t* const _ring;
+
+};
+
+//==============================================================================
+/// Writes records into a segment. Each segment accepts one writer at a time,
+/// which is enforced across processes.
+class Writer
+{
+public:
+
+  /// \returns nullptr if the segment cannot be created or if another writer is
+  /// alive
+  static std::unique_ptr<Writer> make(
+      const std::string& name,
+      const std::string& type,
+      std::size_t capacity);
+
+  /// \brief Get memory for a record of the given size. The contents of the
+  /// record become visible to readers once commit() is called.
+  ///
+  /// \returns nullptr if the record is larger than max_size()
+  uint8_t* reserve(std::size_t size);
+
+  /// \brief Publish the record that was reserved last
+  void commit();
+
+  /// \brief The largest record that fits into the segment
+  std::size_t max_size() const;
+
+  ~Writer();
+
+private:
+
+  Writer(std::unique_ptr<Segment> segment);
+
+  std::unique_ptr<Segment> _segment;
+  uint64_t _position;
+  uint64_t _end;
+
+};
+
+//==============================================================================
+/// Reads records out of a segment without taking anything away from the other
+/// readers. A reader starts with the next record that gets written. If it
+/// falls so far behind that the writer wraps around onto the records it has
+/// not read yet, it skips ahead and counts the records it missed as lost.
+class Reader
+{
+public:
+
+  /// \returns nullptr if the segment is not there yet
+  static std::unique_ptr<Reader> make(const std::string& name);
+
+  /// \brief Wait for the next record and get a view of it. The view points
+  /// straight into the segment, so it must be checked with release() after it
+  /// has been used.
+  ///
+  /// \returns false if no record arrived before the timeout
+  bool next(
+      const uint8_t*& data,
+      std::size_t& size,
+      std::chrono::nanoseconds timeout);
+
+  /// \brief Move past the record that next(~) returned.
+  ///
+  /// \returns true if the writer did not touch the record while it was being
+  /// used
+  bool release();
+
+  /// \brief The message type of the segment
+  std::string type() const;
+
+  /// \brief How many records this reader has missed
+  uint64_t lost() const { return _lost; }
+
+private:
+
+  Reader(std::unique_ptr<Segment> segment);
+
+  bool _intact(uint64_t position) const;
+  void _skip();
+
+  std::unique_ptr<Segment> _segment;
+  uint64_t _position;
+  uint64_t _next;
+  uint64_t _record;
+  uint64_t _lost;
+
+};
+
+} // namespace shm
+} // namespace soss
+
+#endif // SOSS__SHM__SRC__SEGMENT_HPP
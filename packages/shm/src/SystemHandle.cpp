@@ -0,0 +1,252 @@
+/*
+ * Copyright (C) 2019 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include <soss/shm/api.hpp>
+
+#include <soss/Metrics.hpp>
+#include <soss/SystemHandle.hpp>
+#include <soss/ThreadSettings.hpp>
+
+#include <atomic>
+#include <iostream>
+#include <map>
+#include <thread>
+#include <vector>
+
+namespace soss {
+namespace shm {
+
+namespace {
+
+//==============================================================================
+const std::string YamlPrefixKey = "prefix";
+const std::string YamlCapacityKey = "capacity";
+
+//==============================================================================
+bool parse_capacity(
+    const YAML::Node& configuration,
+    std::size_t& capacity)
+{
+  if(const YAML::Node capacity_node = configuration[YamlCapacityKey])
+  {
+    const int64_t value = capacity_node.as<int64_t>();
+    if(value <= 0)
+    {
+      std::cerr << "[soss::shm] The [" << YamlCapacityKey << "] setting must "
+                << "be positive, but it is [" << value << "]" << std::endl;
+      return false;
+    }
+
+    capacity = static_cast<std::size_t>(value);
+  }
+
+  return true;
+}
+
+//==============================================================================
+class SegmentPublisher : public virtual soss::TopicPublisher
+{
+public:
+
+  SegmentPublisher(
+      const std::string& topic,
+      std::shared_ptr<Publisher> publisher)
+    : _publisher(std::move(publisher)),
+      _metrics(soss::Metrics::topic(topic))
+  {
+    // Do nothing
+  }
+
+  bool publish(const soss::Message& message) override
+  {
+    const auto start = std::chrono::steady_clock::now();
+    if(!_publisher->publish(message))
+      return false;
+
+    _metrics.record_conversion(std::chrono::steady_clock::now() - start);
+    return true;
+  }
+
+private:
+
+  const std::shared_ptr<Publisher> _publisher;
+  soss::ChannelMetrics& _metrics;
+
+};
+
+//==============================================================================
+/// Reads one segment on a thread of its own and hands its messages to soss
+class Subscription
+{
+public:
+
+  Subscription(
+      const std::string& topic,
+      const std::string& message_type,
+      const std::string& prefix,
+      TopicSubscriberSystem::SubscriptionCallback callback,
+      const ThreadSettings& thread_settings)
+    : _topic(topic),
+      _message_type(message_type),
+      _subscriber(topic, prefix),
+      _callback(std::move(callback)),
+      _quit(false),
+      _thread([this, thread_settings]()
+      {
+        thread_settings.apply("soss-shm");
+        _run();
+      })
+  {
+    // Do nothing
+  }
+
+  ~Subscription()
+  {
+    _quit = true;
+    _thread.join();
+  }
+
+private:
+
+  void _run()
+  {
+    // Waking up every now and then lets the thread notice when it should quit
+    const auto timeout = std::chrono::milliseconds(100);
+    bool warned = false;
+
+    soss::Message message;
+    while(!_quit)
+    {
+      if(!_subscriber.take(message, timeout))
+        continue;
+
+      const soss::Ingress::Scope ingress;
+      if(message.type != _message_type)
+      {
+        if(!warned)
+        {
+          std::cerr << "[soss::shm] The segment of topic [" << _topic
+                    << "] carries [" << message.type << "] instead of ["
+                    << _message_type << "]. Its messages will be ignored."
+                    << std::endl;
+          warned = true;
+        }
+        continue;
+      }
+
+      _callback(std::move(message));
+    }
+  }
+
+  const std::string _topic;
+  const std::string _message_type;
+  Subscriber _subscriber;
+  const TopicSubscriberSystem::SubscriptionCallback _callback;
+  std::atomic_bool _quit;
+  std::thread _thread;
+
+};
+
+} // anonymous namespace
+
+//==============================================================================
+class SystemHandle : public virtual soss::TopicSystem
+{
+public:
+
+  bool configure(
+      const RequiredTypes&,
+      const YAML::Node& configuration) override
+  {
+    if(const YAML::Node prefix_node = configuration[YamlPrefixKey])
+      _prefix = prefix_node.as<std::string>();
+
+    if(!_thread_settings.parse(configuration[YamlThreadKey], "shm system"))
+      return false;
+
+    return parse_capacity(configuration, _capacity);
+  }
+
+  bool okay() const override
+  {
+    return true;
+  }
+
+  bool spin_once() override
+  {
+    // The subscriptions have threads of their own, so there is nothing to do
+    // here.
+    return true;
+  }
+
+  bool self_driven() const override
+  {
+    return true;
+  }
+
+  bool subscribe(
+      const std::string& topic_name,
+      const std::string& message_type,
+      SubscriptionCallback callback,
+      const YAML::Node& /*configuration*/) override
+  {
+    _subscriptions.emplace_back(
+          new Subscription(topic_name, message_type, _prefix,
+                           std::move(callback), _thread_settings));
+    return true;
+  }
+
+  std::shared_ptr<soss::TopicPublisher> advertise(
+      const std::string& topic_name,
+      const std::string& message_type,
+      const YAML::Node& configuration) override
+  {
+    // Only one publisher may write to a segment, so routes that end on the
+    // same topic share it
+    std::shared_ptr<Publisher>& publisher = _publishers[topic_name];
+    if(!publisher)
+    {
+      std::size_t capacity = _capacity;
+      if(!parse_capacity(configuration, capacity))
+        return nullptr;
+
+      publisher = std::make_shared<Publisher>(
+            topic_name, message_type, capacity, _prefix);
+      if(!publisher->valid())
+      {
+        publisher.reset();
+        return nullptr;
+      }
+    }
+
+    return std::make_shared<SegmentPublisher>(topic_name, publisher);
+  }
+
+private:
+
+  std::string _prefix = "soss";
+  std::size_t _capacity = default_capacity;
+  ThreadSettings _thread_settings;
+  std::map<std::string, std::shared_ptr<Publisher>> _publishers;
+  std::vector<std::unique_ptr<Subscription>> _subscriptions;
+
+};
+
+} // namespace shm
+} // namespace soss
+
+SOSS_REGISTER_SYSTEM("shm", soss::shm::SystemHandle)
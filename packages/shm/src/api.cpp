@@ -0,0 +1,278 @@
+/*
+ * Copyright (C) 2019 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include <soss/shm/api.hpp>
+
+#include "Segment.hpp"
+
+#include <soss/binary/conversion.hpp>
+
+#include <iostream>
+#include <algorithm>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace soss {
+namespace shm {
+
+//==============================================================================
+class Publisher::Implementation
+{
+public:
+
+  Implementation(
+      const std::string& topic,
+      const std::string& message_type,
+      const std::size_t capacity,
+      const std::string& prefix)
+    : _topic(topic),
+      _writer(Writer::make(segment_name(prefix, topic), message_type, capacity))
+  {
+    // Do nothing
+  }
+
+  bool valid() const
+  {
+    return static_cast<bool>(_writer);
+  }
+
+  bool publish(const soss::Message& message)
+  {
+    if(!_writer)
+      return false;
+
+    const std::size_t size = binary::encoded_size(message);
+    if(size == 0)
+    {
+      std::cerr << "[soss::shm] A message on topic [" << _topic << "] has "
+                << "fields that cannot be written to shared memory" << std::endl;
+      return false;
+    }
+
+    std::unique_lock<std::mutex> lock(_mutex);
+    uint8_t* const out = _writer->reserve(size);
+    if(!out)
+    {
+      std::cerr << "[soss::shm] A message of " << size << " bytes on topic ["
+                << _topic << "] does not fit into its segment, which takes "
+                << "messages of up to " << _writer->max_size() << " bytes"
+                << std::endl;
+      return false;
+    }
+
+    binary::encode(message, out, size);
+    _writer->commit();
+    return true;
+  }
+
+private:
+
+  const std::string _topic;
+  const std::unique_ptr<Writer> _writer;
+  std::mutex _mutex;
+
+};
+
+//==============================================================================
+Publisher::Publisher(
+    const std::string& topic,
+    const std::string& message_type,
+    const std::size_t capacity,
+    const std::string& prefix)
+  : _pimpl(new Implementation(topic, message_type, capacity, prefix))
+{
+  // Do nothing
+}
+
+//==============================================================================
+Publisher::Publisher(Publisher&&) = default;
+
+//==============================================================================
+Publisher& Publisher::operator=(Publisher&&) = default;
+
+//==============================================================================
+bool Publisher::valid() const
+{
+  return _pimpl->valid();
+}
+
+//==============================================================================
+bool Publisher::publish(const soss::Message& message)
+{
+  return _pimpl->publish(message);
+}
+
+//==============================================================================
+Publisher::~Publisher()
+{
+  // Do nothing
+}
+
+//==============================================================================
+class Subscriber::Implementation
+{
+public:
+
+  Implementation(
+      const std::string& topic,
+      const std::string& prefix)
+    : _name(segment_name(prefix, topic)),
+      _reader(Reader::make(_name))
+  {
+    // Do nothing
+  }
+
+  bool valid() const
+  {
+    return static_cast<bool>(_reader);
+  }
+
+  std::string message_type() const
+  {
+    return _reader? _reader->type() : std::string();
+  }
+
+  bool take(soss::Message& message, const std::chrono::nanoseconds timeout)
+  {
+    const auto deadline = std::chrono::steady_clock::now() + timeout;
+    bool copied = false;
+    while(!copied)
+    {
+      copied = take_raw(
+            [&](const uint8_t* const data, const std::size_t size)
+      {
+        _buffer.assign(data, data + size);
+      }, deadline - std::chrono::steady_clock::now());
+
+      if(!copied && std::chrono::steady_clock::now() >= deadline)
+        return false;
+    }
+
+    return binary::decode(_buffer.data(), _buffer.size(), message);
+  }
+
+  bool take_raw(
+      const RawCallback& callback,
+      const std::chrono::nanoseconds timeout)
+  {
+    if(!_attach(timeout))
+      return false;
+
+    const uint8_t* data;
+    std::size_t size;
+    if(!_reader->next(data, size, timeout))
+      return false;
+
+    callback(data, size);
+    return _reader->release();
+  }
+
+  uint64_t lost() const
+  {
+    return _reader? _reader->lost() : 0;
+  }
+
+private:
+
+  bool _attach(const std::chrono::nanoseconds timeout)
+  {
+    if(_reader)
+      return true;
+
+    // The writer has not made the segment yet, so check back every now and
+    // then until the timeout
+    const auto deadline = std::chrono::steady_clock::now() + timeout;
+    const auto interval = std::chrono::milliseconds(10);
+    while(true)
+    {
+      _reader = Reader::make(_name);
+      if(_reader)
+        return true;
+
+      const auto remaining = deadline - std::chrono::steady_clock::now();
+      if(remaining <= std::chrono::nanoseconds(0))
+        return false;
+
+      std::this_thread::sleep_for(std::min<std::chrono::nanoseconds>(
+                                    remaining, interval));
+    }
+  }
+
+  const std::string _name;
+  std::unique_ptr<Reader> _reader;
+  std::vector<uint8_t> _buffer;
+
+};
+
+//==============================================================================
+Subscriber::Subscriber(
+    const std::string& topic,
+    const std::string& prefix)
+  : _pimpl(new Implementation(topic, prefix))
+{
+  // Do nothing
+}
+
+//==============================================================================
+Subscriber::Subscriber(Subscriber&&) = default;
+
+//==============================================================================
+Subscriber& Subscriber::operator=(Subscriber&&) = default;
+
+//==============================================================================
+bool Subscriber::valid() const
+{
+  return _pimpl->valid();
+}
+
+//==============================================================================
+std::string Subscriber::message_type() const
+{
+  return _pimpl->message_type();
+}
+
+//==============================================================================
+bool Subscriber::take(
+    soss::Message& message,
+    const std::chrono::nanoseconds timeout)
+{
+  return _pimpl->take(message, timeout);
+}
+
+//==============================================================================
+bool Subscriber::take_raw(
+    const RawCallback& callback,
+    const std::chrono::nanoseconds timeout)
+{
+  return _pimpl->take_raw(callback, timeout);
+}
+
+//==============================================================================
+uint64_t Subscriber::lost() const
+{
+  return _pimpl->lost();
+}
+
+//==============================================================================
+Subscriber::~Subscriber()
+{
+  // Do nothing
+}
+
+} // namespace shm
+} // namespace soss
@@ -0,0 +1,131 @@
+/*
+ * Copyright (C) 2019 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include <catch2/catch.hpp>
+
+#include <soss/shm/api.hpp>
+#include <soss/binary/view.hpp>
+
+#include <Segment.hpp>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace {
+
+//==============================================================================
+const std::string prefix = "soss_test_api_" + std::to_string(getpid());
+
+//==============================================================================
+struct RemoveSegment
+{
+  ~RemoveSegment()
+  {
+    shm_unlink(soss::shm::segment_name(prefix, topic).c_str());
+  }
+
+  const std::string topic;
+};
+
+//==============================================================================
+soss::Message pose(const int64_t id, const std::string& frame)
+{
+  soss::Message message;
+  message.type = "test/Pose";
+  message.data["id"] = soss::make_field<int64_t>(id);
+  message.data["frame"] = soss::make_field<std::string>(frame);
+  message.data["position"] = soss::make_field<std::vector<double>>(
+        std::vector<double>{1.0, 2.0, 3.0});
+  return message;
+}
+
+} // anonymous namespace
+
+TEST_CASE("Messages go through shared memory", "[shm]")
+{
+  const RemoveSegment remove{"/robot/pose"};
+
+  // A subscriber may come before its publisher
+  soss::shm::Subscriber subscriber("/robot/pose", prefix);
+  CHECK_FALSE(subscriber.valid());
+  CHECK(subscriber.message_type().empty());
+
+  soss::shm::Publisher publisher("/robot/pose", "test/Pose", 4096, prefix);
+  REQUIRE(publisher.valid());
+
+  soss::Message message;
+  CHECK_FALSE(subscriber.take(message, std::chrono::milliseconds(20)));
+  CHECK(subscriber.valid());
+  CHECK(subscriber.message_type() == "test/Pose");
+
+  for(int64_t id = 0; id < 100; ++id)
+  {
+    REQUIRE(publisher.publish(pose(id, "map")));
+    REQUIRE(subscriber.take(message, std::chrono::milliseconds(100)));
+    CHECK(message.type == "test/Pose");
+    CHECK(*message.data.at("id").cast<int64_t>() == id);
+    CHECK(*message.data.at("frame").cast<std::string>() == "map");
+    CHECK(*message.data.at("position").cast<std::vector<double>>()
+          == std::vector<double>({1.0, 2.0, 3.0}));
+  }
+
+  CHECK(subscriber.lost() == 0);
+}
+
+TEST_CASE("Raw messages can be read in place", "[shm]")
+{
+  const RemoveSegment remove{"raw"};
+  soss::shm::Publisher publisher("raw", "test/Pose", 4096, prefix);
+  REQUIRE(publisher.valid());
+  soss::shm::Subscriber subscriber("raw", prefix);
+  REQUIRE(subscriber.valid());
+
+  REQUIRE(publisher.publish(pose(7, "odom")));
+
+  std::string frame;
+  int64_t id = 0;
+  REQUIRE(subscriber.take_raw(
+            [&](const uint8_t* data, std::size_t size)
+  {
+    const auto view = soss::binary::MessageView::parse(data, size);
+    REQUIRE(view.valid());
+    frame = view.find("frame").string().str();
+    view.find("id").get(id);
+  }, std::chrono::milliseconds(100)));
+
+  CHECK(frame == "odom");
+  CHECK(id == 7);
+}
+
+TEST_CASE("Publishers refuse what does not fit", "[shm]")
+{
+  const RemoveSegment remove{"refused"};
+  soss::shm::Publisher publisher("refused", "test/Pose", 4096, prefix);
+  REQUIRE(publisher.valid());
+
+  CHECK_FALSE(publisher.publish(pose(0, std::string(4096, 'x'))));
+
+  struct Unknown { int value; };
+  soss::Message message = pose(0, "map");
+  message.data["unknown"] = soss::make_field<Unknown>(Unknown{0});
+  CHECK_FALSE(publisher.publish(message));
+
+  // Only one publisher per segment
+  soss::shm::Publisher second("refused", "test/Pose", 4096, prefix);
+  CHECK_FALSE(second.valid());
+  CHECK_FALSE(second.publish(pose(0, "map")));
+}
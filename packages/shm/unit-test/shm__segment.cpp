@@ -0,0 +1,287 @@
+/*
+ * Copyright (C) 2019 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include <catch2/catch.hpp>
+
+#include <Segment.hpp>
+
+#include <cstring>
+
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace soss::shm;
+
+namespace {
+
+//==============================================================================
+/// Gives each test its own segment and removes it afterwards
+struct TestSegment
+{
+  TestSegment(const std::string& topic)
+    : name(segment_name("soss_test_" + std::to_string(getpid()), topic))
+  {
+    shm_unlink(name.c_str());
+  }
+
+  ~TestSegment()
+  {
+    shm_unlink(name.c_str());
+  }
+
+  const std::string name;
+};
+
+//==============================================================================
+/// Fill a record with its number followed by a pattern that depends on it
+void write(Writer& writer, const uint32_t number, const std::size_t size)
+{
+  uint8_t* const out = writer.reserve(size);
+  REQUIRE(out);
+  std::memcpy(out, &number, sizeof(number));
+  for(std::size_t i = sizeof(number); i < size; ++i)
+    out[i] = static_cast<uint8_t>(number + i);
+
+  writer.commit();
+}
+
+//==============================================================================
+/// Read the next record and check that it is intact
+bool read(Reader& reader, uint32_t& number, const std::size_t size)
+{
+  const uint8_t* data;
+  std::size_t length;
+  if(!reader.next(data, length, std::chrono::milliseconds(10)))
+    return false;
+
+  CHECK(length == size);
+  std::memcpy(&number, data, sizeof(number));
+  bool pattern = true;
+  for(std::size_t i = sizeof(number); i < length; ++i)
+    pattern &= data[i] == static_cast<uint8_t>(number + i);
+
+  CHECK(pattern);
+  CHECK(reader.release());
+  return true;
+}
+
+} // anonymous namespace
+
+TEST_CASE("Records wrap around the end of the ring", "[shm]")
+{
+  const TestSegment segment("wrap");
+  const auto writer = Writer::make(segment.name, "test/Type", 4096);
+  REQUIRE(writer);
+  const auto reader = Reader::make(segment.name);
+  REQUIRE(reader);
+  CHECK(reader->type() == "test/Type");
+
+  // Two of these fit into the ring, so the rest of each lap gets padded
+  const std::size_t size = 1500;
+  for(uint32_t i = 0; i < 50; ++i)
+  {
+    write(*writer, i, size);
+
+    uint32_t number = 0;
+    REQUIRE(read(*reader, number, size));
+    CHECK(number == i);
+  }
+
+  uint32_t number = 0;
+  CHECK_FALSE(read(*reader, number, size));
+  CHECK(reader->lost() == 0);
+}
+
+TEST_CASE("Readers see every record that fits into the ring", "[shm]")
+{
+  const TestSegment segment("backlog");
+  const auto writer = Writer::make(segment.name, "test/Type", 4096);
+  REQUIRE(writer);
+  const auto reader = Reader::make(segment.name);
+  REQUIRE(reader);
+
+  // Records that are written before the reader looks are still there for it
+  for(uint32_t i = 0; i < 3; ++i)
+    write(*writer, i, 1000);
+
+  for(uint32_t i = 0; i < 3; ++i)
+  {
+    uint32_t number = 0;
+    REQUIRE(read(*reader, number, 1000));
+    CHECK(number == i);
+  }
+
+  CHECK(reader->lost() == 0);
+}
+
+TEST_CASE("Readers that get lapped skip ahead", "[shm]")
+{
+  const TestSegment segment("lapped");
+  const auto writer = Writer::make(segment.name, "test/Type", 4096);
+  REQUIRE(writer);
+  const auto reader = Reader::make(segment.name);
+  REQUIRE(reader);
+
+  const std::size_t size = 1000;
+  write(*writer, 0, size);
+  uint32_t number = 0;
+  REQUIRE(read(*reader, number, size));
+  CHECK(number == 0);
+
+  // The writer runs several laps ahead without waiting for the reader
+  for(uint32_t i = 1; i <= 100; ++i)
+    write(*writer, i, size);
+
+  // Everything the reader gets is still intact, and what it did not get is
+  // counted as lost
+  uint32_t received = 0;
+  uint32_t last = 0;
+  while(read(*reader, number, size))
+  {
+    CHECK(number > last);
+    last = number;
+    ++received;
+  }
+
+  CHECK(received + reader->lost() == 100);
+  CHECK(reader->lost() > 0);
+
+  // Afterwards the reader keeps up again
+  write(*writer, 101, size);
+  REQUIRE(read(*reader, number, size));
+  CHECK(number == 101);
+  CHECK(received + reader->lost() == 100);
+}
+
+TEST_CASE("Readers notice records that get overwritten while in use", "[shm]")
+{
+  const TestSegment segment("overwritten");
+  const auto writer = Writer::make(segment.name, "test/Type", 4096);
+  REQUIRE(writer);
+  const auto reader = Reader::make(segment.name);
+  REQUIRE(reader);
+
+  write(*writer, 0, 1000);
+
+  const uint8_t* data;
+  std::size_t size;
+  REQUIRE(reader->next(data, size, std::chrono::milliseconds(10)));
+
+  for(uint32_t i = 1; i <= 8; ++i)
+    write(*writer, i, 1000);
+
+  CHECK_FALSE(reader->release());
+  CHECK(reader->lost() == 1);
+}
+
+TEST_CASE("Records that are too large are refused", "[shm]")
+{
+  const TestSegment segment("large");
+  const auto writer = Writer::make(segment.name, "test/Type", 4096);
+  REQUIRE(writer);
+
+  CHECK(writer->max_size() < 4096/2);
+  CHECK(writer->reserve(writer->max_size()));
+  CHECK_FALSE(writer->reserve(writer->max_size() + 1));
+}
+
+TEST_CASE("Segments keep their type and capacity", "[shm]")
+{
+  const TestSegment segment("mismatch");
+  CHECK_FALSE(Reader::make(segment.name));
+
+  const auto writer = Writer::make(segment.name, "test/Type", 4096);
+  REQUIRE(writer);
+
+  CHECK_FALSE(Segment::create(segment.name, "test/Other", 4096));
+  CHECK_FALSE(Segment::create(segment.name, "test/Type", 8192));
+  CHECK(Segment::create(segment.name, "test/Type", 4096));
+}
+
+TEST_CASE("A live writer keeps other writers out", "[shm]")
+{
+  const TestSegment segment("exclusive");
+  auto writer = Writer::make(segment.name, "test/Type", 4096);
+  REQUIRE(writer);
+  CHECK_FALSE(Writer::make(segment.name, "test/Type", 4096));
+
+  // Once it lets go, the next writer continues where it stopped
+  const auto reader = Reader::make(segment.name);
+  REQUIRE(reader);
+  write(*writer, 0, 100);
+  writer.reset();
+
+  writer = Writer::make(segment.name, "test/Type", 4096);
+  REQUIRE(writer);
+  write(*writer, 1, 100);
+
+  uint32_t number = 0;
+  REQUIRE(read(*reader, number, 100));
+  CHECK(number == 0);
+  REQUIRE(read(*reader, number, 100));
+  CHECK(number == 1);
+  CHECK(reader->lost() == 0);
+}
+
+TEST_CASE("A writer takes over from one that died mid-record", "[shm]")
+{
+  const TestSegment segment("takeover");
+  {
+    const auto writer = Writer::make(segment.name, "test/Type", 4096);
+    REQUIRE(writer);
+    write(*writer, 0, 100);
+  }
+
+  const auto reader = Reader::make(segment.name);
+  REQUIRE(reader);
+
+  // The other process claims the segment and dies before it commits
+  const pid_t child = fork();
+  REQUIRE(child >= 0);
+  if(child == 0)
+  {
+    const auto writer = Writer::make(segment.name, "test/Type", 4096);
+    if(writer)
+      std::memset(writer->reserve(2000), 0xFF, 2000);
+
+    _exit(writer? 0 : 1);
+  }
+
+  int status = 0;
+  REQUIRE(waitpid(child, &status, 0) == child);
+  REQUIRE(WIFEXITED(status));
+  REQUIRE(WEXITSTATUS(status) == 0);
+
+  // The unfinished record is neither visible nor does it make the reader
+  // think that it got lapped
+  uint32_t number = 0;
+  CHECK_FALSE(read(*reader, number, 100));
+
+  const auto writer = Writer::make(segment.name, "test/Type", 4096);
+  REQUIRE(writer);
+  for(uint32_t i = 1; i <= 3; ++i)
+    write(*writer, i, 100);
+
+  for(uint32_t i = 1; i <= 3; ++i)
+  {
+    REQUIRE(read(*reader, number, 100));
+    CHECK(number == i);
+  }
+
+  CHECK(reader->lost() == 0);
+}
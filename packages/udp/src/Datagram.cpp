@@ -0,0 +1,331 @@
+/*
+ * Copyright (C) 2019 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include "Datagram.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+namespace soss {
+namespace udp {
+
+namespace {
+
+//==============================================================================
+/// Serial number comparison, so the sequence can wrap around
+bool newer(const uint32_t a, const uint32_t b)
+{
+  return static_cast<int32_t>(a - b) > 0;
+}
+
+//==============================================================================
+void xor_into(uint8_t* target, const uint8_t* source, const std::size_t size)
+{
+  for(std::size_t i=0; i < size; ++i)
+    target[i] ^= source[i];
+}
+
+} // anonymous namespace
+
+//==============================================================================
+uint64_t topic_fingerprint(const std::string& topic)
+{
+  uint64_t hash = 0xcbf29ce484222325ull;
+  for(const char c : topic)
+  {
+    hash ^= static_cast<uint8_t>(c);
+    hash *= 0x100000001b3ull;
+  }
+
+  return hash;
+}
+
+//==============================================================================
+bool read_header(
+    const uint8_t* data,
+    const std::size_t size,
+    DatagramHeader& header)
+{
+  if(size < sizeof(DatagramHeader))
+    return false;
+
+  std::memcpy(&header, data, sizeof(DatagramHeader));
+  if(header.magic != datagram_magic || header.version != datagram_version)
+    return false;
+
+  if(header.kind != DatagramHeader::Data && header.kind != DatagramHeader::Parity)
+    return false;
+
+  if(header.count == 0 || header.chunk == 0 || header.index >= header.count)
+    return false;
+
+  // The fragments must cover the message, and only the last one may be short
+  const std::size_t capacity =
+      static_cast<std::size_t>(header.count) * header.chunk;
+  if(header.size > capacity || capacity - header.size >= header.chunk)
+    return false;
+
+  if(header.kind == DatagramHeader::Parity
+     && (header.group == 0 || header.index % header.group != 0))
+    return false;
+
+  return size - sizeof(DatagramHeader) <= header.chunk;
+}
+
+//==============================================================================
+Fragmenter::Fragmenter(
+    const std::string& topic,
+    const std::size_t datagram_size,
+    const std::size_t group)
+  : _topic(topic_fingerprint(topic)),
+    _chunk(static_cast<uint16_t>(
+             std::min<std::size_t>(
+               datagram_size - sizeof(DatagramHeader),
+               std::numeric_limits<uint16_t>::max()))),
+    _group(static_cast<uint16_t>(
+             std::min<std::size_t>(
+               group, std::numeric_limits<uint16_t>::max()))),
+    _sequence(0)
+{
+  // Do nothing
+}
+
+//==============================================================================
+bool Fragmenter::split(
+    const std::vector<uint8_t>& message,
+    std::vector<std::vector<uint8_t>>& datagrams)
+{
+  const std::size_t count =
+      std::max<std::size_t>((message.size() + _chunk - 1) / _chunk, 1);
+  if(count > std::numeric_limits<uint16_t>::max()
+     || message.size() > std::numeric_limits<uint32_t>::max())
+    return false;
+
+  DatagramHeader header;
+  std::memset(&header, 0, sizeof(header));
+  header.magic = datagram_magic;
+  header.version = datagram_version;
+  header.topic = _topic;
+  header.sequence = ++_sequence;
+  header.size = static_cast<uint32_t>(message.size());
+  header.count = static_cast<uint16_t>(count);
+  header.group = _group;
+  header.chunk = _chunk;
+
+  const std::size_t parities = _group == 0? 0 : (count + _group - 1) / _group;
+  datagrams.clear();
+  datagrams.reserve(count + parities);
+
+  std::vector<uint8_t> parity;
+  for(std::size_t i=0; i < count; ++i)
+  {
+    const std::size_t offset = i * _chunk;
+    const std::size_t size = std::min<std::size_t>(
+          _chunk, message.size() - offset);
+
+    header.kind = DatagramHeader::Data;
+    header.index = static_cast<uint16_t>(i);
+
+    datagrams.emplace_back(sizeof(DatagramHeader) + size);
+    std::vector<uint8_t>& datagram = datagrams.back();
+    std::memcpy(datagram.data(), &header, sizeof(DatagramHeader));
+    std::memcpy(datagram.data() + sizeof(DatagramHeader),
+                message.data() + offset, size);
+
+    if(_group == 0)
+      continue;
+
+    if(i % _group == 0)
+      parity.assign(_chunk, 0);
+
+    xor_into(parity.data(), message.data() + offset, size);
+
+    // Send the parity right behind its group, so a receiver does not have to
+    // hold on to a group for long before it knows what it can rebuild
+    if(i % _group == _group - 1u || i == count - 1)
+    {
+      header.kind = DatagramHeader::Parity;
+      header.index = static_cast<uint16_t>(i - i % _group);
+
+      datagrams.emplace_back(sizeof(DatagramHeader) + _chunk);
+      std::vector<uint8_t>& datagram = datagrams.back();
+      std::memcpy(datagram.data(), &header, sizeof(DatagramHeader));
+      std::memcpy(datagram.data() + sizeof(DatagramHeader),
+                  parity.data(), _chunk);
+    }
+  }
+
+  return true;
+}
+
+//==============================================================================
+Reassembler::Reassembler(
+    const std::size_t chunk,
+    const std::size_t max_message_size)
+  : _expected_chunk(chunk),
+    _max_message_size(max_message_size)
+{
+  // Do nothing
+}
+
+//==============================================================================
+bool Reassembler::add(
+    const DatagramHeader& header,
+    const uint8_t* payload,
+    const std::size_t payload_size,
+    std::vector<uint8_t>& message)
+{
+  if(header.chunk != _expected_chunk || header.size > _max_message_size)
+  {
+    ++_rejected;
+    return false;
+  }
+
+  // Once a message has been delivered, nothing older than it is of any use
+  if(_delivered_any && !newer(header.sequence, _last_delivered))
+    return false;
+
+  if(!_active || newer(header.sequence, _sequence))
+  {
+    if(_active)
+      ++_superseded;
+
+    _begin(header);
+  }
+  else if(header.sequence != _sequence)
+  {
+    // A fragment of a message that has already been abandoned
+    return false;
+  }
+
+  if(header.count != _count || header.chunk != _chunk
+     || header.size != _size || header.group != _group)
+    return false;
+
+  const std::size_t index = header.index;
+  if(header.kind == DatagramHeader::Parity)
+  {
+    std::vector<uint8_t>& parity = _parity[index];
+    parity.assign(_chunk, 0);
+    std::memcpy(parity.data(), payload, payload_size);
+    _recover(index);
+  }
+  else if(!_received[index])
+  {
+    _store(index, payload, payload_size);
+    _received[index] = true;
+    --_missing;
+
+    if(_group > 0)
+      _recover(index - index % _group);
+  }
+
+  if(_missing > 0)
+    return false;
+
+  message.resize(_size);
+  for(std::size_t i=0; i < _count; ++i)
+  {
+    const std::size_t offset = i * _chunk;
+    std::memcpy(message.data() + offset, _fragments[i].data(),
+                std::min<std::size_t>(_chunk, _size - offset));
+  }
+
+  _active = false;
+  _delivered_any = true;
+  _last_delivered = _sequence;
+  _parity.clear();
+  return true;
+}
+
+//==============================================================================
+void Reassembler::_begin(const DatagramHeader& header)
+{
+  _active = true;
+  _sequence = header.sequence;
+  _size = header.size;
+  _count = header.count;
+  _group = header.group;
+  _chunk = header.chunk;
+  _missing = _count;
+
+  // Nothing gets allocated for a fragment until it arrives
+  if(_fragments.size() < _count)
+    _fragments.resize(_count);
+
+  _received.assign(_count, false);
+  _parity.clear();
+}
+
+//==============================================================================
+void Reassembler::_store(
+    const std::size_t index,
+    const uint8_t* const payload,
+    const std::size_t size)
+{
+  // The padding of the last fragment has to be zero for its parity to work
+  std::vector<uint8_t>& fragment = _fragments[index];
+  fragment.assign(_chunk, 0);
+  std::memcpy(fragment.data(), payload, size);
+}
+
+//==============================================================================
+void Reassembler::_recover(const std::size_t group_start)
+{
+  const auto parity = _parity.find(group_start);
+  if(parity == _parity.end())
+    return;
+
+  const std::size_t end = std::min<std::size_t>(
+        group_start + _group, _count);
+
+  std::size_t missing = end;
+  for(std::size_t i=group_start; i < end; ++i)
+  {
+    if(_received[i])
+      continue;
+
+    if(missing != end)
+      return;
+
+    missing = i;
+  }
+
+  if(missing == end)
+  {
+    // The whole group is here, so its parity is not needed anymore
+    _parity.erase(parity);
+    return;
+  }
+
+  _store(missing, parity->second.data(), _chunk);
+  uint8_t* const target = _fragments[missing].data();
+  for(std::size_t i=group_start; i < end; ++i)
+  {
+    if(i != missing)
+      xor_into(target, _fragments[i].data(), _chunk);
+  }
+
+  _received[missing] = true;
+  --_missing;
+  ++_recovered;
+  _parity.erase(parity);
+}
+
+} // namespace udp
+} // namespace soss
@@ -0,0 +1,237 @@
+/*
+ * Copyright (C) 2019 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#ifndef SOSS__UDP__SRC__DATAGRAM_HPP
+#define SOSS__UDP__SRC__DATAGRAM_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace soss {
+namespace udp {
+
+//==============================================================================
+// The datagrams of the udp middleware
+//
+// Every message of a topic is encoded with soss-binary and split into
+// fragments that each fit into one datagram. A fragment carries a
+// DatagramHeader followed by its piece of the encoded message:
+//
+//   DatagramHeader
+//   payload                     at most DatagramHeader::chunk bytes
+//
+// When forward error correction is enabled, each group of fragments is
+// followed by a parity datagram whose payload is the XOR of the payloads of
+// the group, padded with zeros to the chunk size. A receiver can rebuild any
+// one fragment of a group that went missing.
+//
+// Like soss-binary, the header uses the byte order of the host that wrote it,
+// and a reader with a different byte order rejects it by its magic number.
+//==============================================================================
+
+/// "SOSU" in the byte order of the writer
+constexpr uint32_t datagram_magic = 0x534f5355;
+
+/// Bumped whenever the layout changes in a way that older readers cannot read
+constexpr uint8_t datagram_version = 1;
+
+//==============================================================================
+struct DatagramHeader
+{
+  enum Kind : uint8_t
+  {
+    Data = 0,
+    Parity = 1
+  };
+
+  uint32_t magic;
+  uint8_t version;
+  uint8_t kind;
+
+  /// The index of the fragment, or the index of the first fragment of the
+  /// group of a parity datagram
+  uint16_t index;
+
+  /// See topic_fingerprint(~)
+  uint64_t topic;
+
+  /// Counts up with each message of the topic, so a receiver can tell which
+  /// of two messages is newer
+  uint32_t sequence;
+
+  /// The size of the whole encoded message
+  uint32_t size;
+
+  /// The number of data fragments of the message
+  uint16_t count;
+
+  /// The number of data fragments per parity datagram, or 0 without parity
+  uint16_t group;
+
+  /// The payload size of every fragment but the last one
+  uint16_t chunk;
+
+  uint16_t reserved;
+};
+
+static_assert(sizeof(DatagramHeader) == 32,
+              "DatagramHeader must not have any padding");
+
+//==============================================================================
+/// \brief Identify a topic by a 64-bit FNV-1a hash of its name, so both ends
+/// agree on it without having to exchange anything.
+uint64_t topic_fingerprint(const std::string& topic);
+
+//==============================================================================
+/// \brief Read the header of a datagram.
+///
+/// \returns false if the datagram was not written by a compatible udp
+/// middleware, or if its header is inconsistent.
+bool read_header(
+    const uint8_t* data,
+    std::size_t size,
+    DatagramHeader& header);
+
+//==============================================================================
+/// Fragmenter splits the encoded messages of one topic into datagrams. It is
+/// thread-safe.
+class Fragmenter
+{
+public:
+
+  /// \param[in] topic
+  ///   The name of the topic
+  ///
+  /// \param[in] datagram_size
+  ///   The largest datagram to produce, including its header
+  ///
+  /// \param[in] group
+  ///   The number of data fragments per parity datagram, or 0 to send no
+  ///   parity at all
+  Fragmenter(
+      const std::string& topic,
+      std::size_t datagram_size,
+      std::size_t group);
+
+  /// \brief Split an encoded message into the datagrams that should be sent,
+  /// in order.
+  ///
+  /// \returns false if the message has too many fragments for the format
+  bool split(
+      const std::vector<uint8_t>& message,
+      std::vector<std::vector<uint8_t>>& datagrams);
+
+private:
+
+  const uint64_t _topic;
+  const uint16_t _chunk;
+  const uint16_t _group;
+  std::atomic<uint32_t> _sequence;
+
+};
+
+//==============================================================================
+/// Reassembler puts the messages of one topic back together from their
+/// datagrams. Only the newest message is ever being put together: a fragment
+/// of a newer message abandons the message in progress, and fragments of
+/// older messages are ignored, so a lost fragment never holds up the messages
+/// that come after it. This class is not thread-safe.
+///
+/// Memory is only set aside for the fragments that arrive, and headers that
+/// do not match the chunk size of this end or announce a message that is too
+/// large are rejected, so a forged header cannot make the receiver allocate
+/// more than max_message_size.
+class Reassembler
+{
+public:
+
+  /// \param[in] chunk
+  ///   The payload size of the fragments, which both ends derive from the
+  ///   same mtu
+  ///
+  /// \param[in] max_message_size
+  ///   The largest encoded message to put back together
+  Reassembler(std::size_t chunk, std::size_t max_message_size);
+
+  /// \brief Add a datagram whose header has been read by read_header(~).
+  ///
+  /// \param[out] message
+  ///   Receives the encoded message if this datagram completed it
+  ///
+  /// \returns true if a message was completed
+  bool add(
+      const DatagramHeader& header,
+      const uint8_t* payload,
+      std::size_t payload_size,
+      std::vector<uint8_t>& message);
+
+  /// \brief The number of messages that were abandoned before they were
+  /// complete, because a newer message of the topic arrived first
+  std::size_t superseded() const { return _superseded; }
+
+  /// \brief The number of fragments that were rebuilt from parity
+  std::size_t recovered() const { return _recovered; }
+
+  /// \brief The number of datagrams that were rejected because of their chunk
+  /// size or the size of their message
+  std::size_t rejected() const { return _rejected; }
+
+private:
+
+  void _begin(const DatagramHeader& header);
+
+  /// Store the payload of a fragment, padded with zeros to the chunk size
+  void _store(std::size_t index, const uint8_t* payload, std::size_t size);
+
+  /// Rebuild the fragment of a group that is missing, if it is the only one
+  void _recover(std::size_t group_start);
+
+  const std::size_t _expected_chunk;
+  const std::size_t _max_message_size;
+
+  bool _active = false;
+  bool _delivered_any = false;
+  uint32_t _sequence = 0;
+  uint32_t _last_delivered = 0;
+
+  uint32_t _size = 0;
+  uint16_t _count = 0;
+  uint16_t _group = 0;
+  uint16_t _chunk = 0;
+  std::size_t _missing = 0;
+
+  /// The payloads of the fragments that have arrived, by their index. The
+  /// slots keep their memory from one message to the next.
+  std::vector<std::vector<uint8_t>> _fragments;
+  std::vector<bool> _received;
+
+  /// key: the first fragment of the group, value: its parity
+  std::map<std::size_t, std::vector<uint8_t>> _parity;
+
+  std::size_t _superseded = 0;
+  std::size_t _recovered = 0;
+  std::size_t _rejected = 0;
+
+};
+
+} // namespace udp
+} // namespace soss
+
+#endif // SOSS__UDP__SRC__DATAGRAM_HPP
@@ -0,0 +1,568 @@
+/*
+ * Copyright (C) 2019 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include "Datagram.hpp"
+
+#include <soss/binary/conversion.hpp>
+
+#include <soss/Metrics.hpp>
+#include <soss/SystemHandle.hpp>
+#include <soss/ThreadSettings.hpp>
+
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+namespace soss {
+namespace udp {
+
+namespace {
+
+//==============================================================================
+const std::string YamlPortKey = "port";
+const std::string YamlPeerKey = "peer";
+const std::string YamlMtuKey = "mtu";
+const std::string YamlFecKey = "fec";
+const std::string YamlMaxMessageSizeKey = "max_message_size";
+
+/// Fits into the smallest MTU that IPv6 guarantees, with room to spare for
+/// the headers of tunnels that cellular links like to add
+const std::size_t default_mtu = 1200;
+
+/// The largest payload of a UDP datagram over IPv4
+const std::size_t max_mtu = 65507;
+
+/// Anything smaller spends more on headers than on the message
+const std::size_t min_mtu = 2*sizeof(DatagramHeader);
+
+/// The largest message that a receiver puts together unless told otherwise
+const std::size_t default_max_message_size = 16*1024*1024;
+
+//==============================================================================
+bool parse_bounded(
+    const YAML::Node& configuration,
+    const std::string& key,
+    const std::size_t min,
+    const std::size_t max,
+    std::size_t& value)
+{
+  if(const YAML::Node node = configuration[key])
+  {
+    const int64_t parsed = node.as<int64_t>();
+    if(parsed < static_cast<int64_t>(min) || parsed > static_cast<int64_t>(max))
+    {
+      std::cerr << "[soss::udp] The [" << key << "] setting must be between ["
+                << min << "] and [" << max << "], but it is [" << parsed
+                << "]" << std::endl;
+      return false;
+    }
+
+    value = static_cast<std::size_t>(parsed);
+  }
+
+  return true;
+}
+
+//==============================================================================
+/// Resolve an address of the form host:port or [ipv6-host]:port
+bool resolve_peer(
+    const std::string& peer,
+    sockaddr_storage& address,
+    socklen_t& length)
+{
+  const std::size_t colon = peer.rfind(':');
+  if(colon == std::string::npos || colon == 0 || colon + 1 == peer.size())
+  {
+    std::cerr << "[soss::udp] The [" << YamlPeerKey << "] setting must look "
+              << "like <host>:<port>, but it is [" << peer << "]" << std::endl;
+    return false;
+  }
+
+  std::string host = peer.substr(0, colon);
+  const std::string port = peer.substr(colon + 1);
+  if(host.size() > 2 && host.front() == '[' && host.back() == ']')
+    host = host.substr(1, host.size() - 2);
+
+  addrinfo hints;
+  std::memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_DGRAM;
+
+  addrinfo* result = nullptr;
+  const int error = getaddrinfo(host.c_str(), port.c_str(), &hints, &result);
+  if(error != 0 || !result)
+  {
+    std::cerr << "[soss::udp] Failed to resolve the peer [" << peer << "]: "
+              << gai_strerror(error) << std::endl;
+    return false;
+  }
+
+  std::memcpy(&address, result->ai_addr, result->ai_addrlen);
+  length = result->ai_addrlen;
+  freeaddrinfo(result);
+  return true;
+}
+
+//==============================================================================
+/// The socket that a udp system sends and receives on
+class Socket
+{
+public:
+
+  Socket()
+    : _fd(-1),
+      _peer_length(0)
+  {
+    // Do nothing
+  }
+
+  bool open(const uint16_t port, const std::string& peer)
+  {
+    int family = AF_INET;
+    if(!peer.empty())
+    {
+      if(!resolve_peer(peer, _peer, _peer_length))
+        return false;
+
+      family = _peer.ss_family;
+    }
+
+    _fd = ::socket(family, SOCK_DGRAM, 0);
+    if(_fd < 0)
+    {
+      std::cerr << "[soss::udp] Failed to open a socket: "
+                << std::strerror(errno) << std::endl;
+      return false;
+    }
+
+    sockaddr_storage local;
+    std::memset(&local, 0, sizeof(local));
+    socklen_t local_length = 0;
+    if(family == AF_INET6)
+    {
+      sockaddr_in6& address = reinterpret_cast<sockaddr_in6&>(local);
+      address.sin6_family = AF_INET6;
+      address.sin6_addr = in6addr_any;
+      address.sin6_port = htons(port);
+      local_length = sizeof(address);
+    }
+    else
+    {
+      sockaddr_in& address = reinterpret_cast<sockaddr_in&>(local);
+      address.sin_family = AF_INET;
+      address.sin_addr.s_addr = htonl(INADDR_ANY);
+      address.sin_port = htons(port);
+      local_length = sizeof(address);
+    }
+
+    if(::bind(_fd, reinterpret_cast<sockaddr*>(&local), local_length) != 0)
+    {
+      std::cerr << "[soss::udp] Failed to bind to port [" << port << "]: "
+                << std::strerror(errno) << std::endl;
+      return false;
+    }
+
+    return true;
+  }
+
+  bool valid() const
+  {
+    return _fd >= 0;
+  }
+
+  bool has_peer() const
+  {
+    return _peer_length > 0;
+  }
+
+  int fd() const
+  {
+    return _fd;
+  }
+
+  /// Never blocks. A datagram that does not fit into the send buffer right
+  /// now is dropped like any other lost datagram.
+  bool send(const std::vector<uint8_t>& datagram)
+  {
+    const ssize_t sent = ::sendto(
+          _fd, datagram.data(), datagram.size(), MSG_DONTWAIT,
+          reinterpret_cast<const sockaddr*>(&_peer), _peer_length);
+
+    return sent == static_cast<ssize_t>(datagram.size());
+  }
+
+  ~Socket()
+  {
+    if(_fd >= 0)
+      ::close(_fd);
+  }
+
+private:
+
+  int _fd;
+  sockaddr_storage _peer;
+  socklen_t _peer_length;
+
+};
+
+//==============================================================================
+class DatagramPublisher : public virtual soss::TopicPublisher
+{
+public:
+
+  DatagramPublisher(
+      const std::string& topic,
+      std::shared_ptr<Socket> socket,
+      const std::size_t mtu,
+      const std::size_t fec)
+    : _topic(topic),
+      _socket(std::move(socket)),
+      _fragmenter(topic, mtu, fec),
+      _metrics(soss::Metrics::topic(topic))
+  {
+    // Do nothing
+  }
+
+  bool publish(const soss::Message& message) override
+  {
+    thread_local std::vector<uint8_t> encoded;
+    thread_local std::vector<std::vector<uint8_t>> datagrams;
+
+    const auto start = std::chrono::steady_clock::now();
+    if(!soss::binary::encode(message, encoded)
+       || !_fragmenter.split(encoded, datagrams))
+    {
+      std::cerr << "[soss::udp] Failed to encode a message of topic ["
+                << _topic << "]" << std::endl;
+      return false;
+    }
+
+    _metrics.record_conversion(std::chrono::steady_clock::now() - start);
+
+    // A message that loses a datagram here will never be completed, so there
+    // is no point in sending the rest of it. The next message supersedes it.
+    for(const std::vector<uint8_t>& datagram : datagrams)
+    {
+      if(!_socket->send(datagram))
+      {
+        _metrics.count_drop();
+        return true;
+      }
+
+      _metrics.count_bytes(datagram.size());
+    }
+
+    return true;
+  }
+
+private:
+
+  const std::string _topic;
+  const std::shared_ptr<Socket> _socket;
+  Fragmenter _fragmenter;
+  soss::ChannelMetrics& _metrics;
+
+};
+
+//==============================================================================
+struct Subscription
+{
+  std::string message_type;
+  TopicSubscriberSystem::SubscriptionCallback callback;
+  bool warned;
+};
+
+//==============================================================================
+struct InboundTopic
+{
+  InboundTopic(
+      const std::string& name_,
+      const std::size_t chunk,
+      const std::size_t max_message_size)
+    : name(name_),
+      reassembler(chunk, max_message_size)
+  {
+    // Do nothing
+  }
+
+  std::string name;
+  Reassembler reassembler;
+  std::vector<Subscription> subscriptions;
+};
+
+} // anonymous namespace
+
+//==============================================================================
+class SystemHandle : public virtual soss::TopicSystem
+{
+public:
+
+  SystemHandle()
+    : _socket(std::make_shared<Socket>()),
+      _quit(false)
+  {
+    // Do nothing
+  }
+
+  bool configure(
+      const RequiredTypes&,
+      const YAML::Node& configuration) override
+  {
+    std::size_t port = 0;
+    if(!parse_bounded(configuration, YamlPortKey, 1, 65535, port))
+      return false;
+
+    std::string peer;
+    if(const YAML::Node peer_node = configuration[YamlPeerKey])
+      peer = peer_node.as<std::string>();
+
+    if(!parse_bounded(configuration, YamlMtuKey, min_mtu, max_mtu, _mtu))
+      return false;
+
+    if(!parse_bounded(configuration, YamlFecKey, 0, 255, _fec))
+      return false;
+
+    if(!parse_bounded(configuration, YamlMaxMessageSizeKey, 1,
+                      std::numeric_limits<uint32_t>::max(), _max_message_size))
+      return false;
+
+    if(!_thread_settings.parse(configuration[YamlThreadKey], "udp system"))
+      return false;
+
+    return _socket->open(static_cast<uint16_t>(port), peer);
+  }
+
+  bool okay() const override
+  {
+    return _socket->valid();
+  }
+
+  bool spin_once() override
+  {
+    // The datagrams are received on a thread of our own, so there is nothing
+    // to do here.
+    return true;
+  }
+
+  bool self_driven() const override
+  {
+    return true;
+  }
+
+  bool subscribe(
+      const std::string& topic_name,
+      const std::string& message_type,
+      SubscriptionCallback callback,
+      const YAML::Node& configuration) override
+  {
+    std::size_t max_message_size = _max_message_size;
+    if(!parse_bounded(configuration, YamlMaxMessageSizeKey, 1,
+                      std::numeric_limits<uint32_t>::max(), max_message_size))
+      return false;
+
+    {
+      std::unique_lock<std::mutex> lock(_mutex);
+      const uint64_t fingerprint = topic_fingerprint(topic_name);
+      auto it = _topics.find(fingerprint);
+      if(it == _topics.end())
+      {
+        it = _topics.emplace(
+              std::piecewise_construct,
+              std::forward_as_tuple(fingerprint),
+              std::forward_as_tuple(
+                topic_name, _mtu - sizeof(DatagramHeader),
+                max_message_size)).first;
+      }
+
+      InboundTopic& topic = it->second;
+      if(topic.name != topic_name)
+      {
+        std::cerr << "[soss::udp] The topics [" << topic.name << "] and ["
+                  << topic_name << "] cannot be told apart by their "
+                  << "fingerprints. Please rename one of them." << std::endl;
+        return false;
+      }
+
+      topic.subscriptions.push_back({message_type, std::move(callback), false});
+    }
+
+    if(!_thread.joinable())
+    {
+      _thread = std::thread([this]()
+      {
+        _thread_settings.apply("soss-udp");
+        _run();
+      });
+    }
+
+    return true;
+  }
+
+  std::shared_ptr<soss::TopicPublisher> advertise(
+      const std::string& topic_name,
+      const std::string& /*message_type*/,
+      const YAML::Node& configuration) override
+  {
+    if(!_socket->has_peer())
+    {
+      std::cerr << "[soss::udp] Cannot advertise topic [" << topic_name
+                << "] because the udp system has no [" << YamlPeerKey
+                << "] to send it to" << std::endl;
+      return nullptr;
+    }
+
+    std::size_t fec = _fec;
+    if(!parse_bounded(configuration, YamlFecKey, 0, 255, fec))
+      return nullptr;
+
+    return std::make_shared<DatagramPublisher>(
+          topic_name, _socket, _mtu, fec);
+  }
+
+  ~SystemHandle() override
+  {
+    _quit = true;
+    if(_thread.joinable())
+      _thread.join();
+  }
+
+private:
+
+  void _run()
+  {
+    // Waking up every now and then lets the thread notice when it should quit
+    const int timeout_ms = 100;
+    std::vector<uint8_t> buffer(max_mtu);
+    std::vector<uint8_t> encoded;
+
+    pollfd descriptor;
+    descriptor.fd = _socket->fd();
+    descriptor.events = POLLIN;
+
+    while(!_quit)
+    {
+      descriptor.revents = 0;
+      if(::poll(&descriptor, 1, timeout_ms) <= 0)
+        continue;
+
+      // Drain everything that has arrived, so that a burst of datagrams costs
+      // a single wakeup
+      while(!_quit)
+      {
+        const ssize_t size = ::recv(
+              descriptor.fd, buffer.data(), buffer.size(), MSG_DONTWAIT);
+        if(size < 0)
+          break;
+
+        _receive(buffer.data(), static_cast<std::size_t>(size), encoded);
+      }
+    }
+  }
+
+  void _receive(
+      const uint8_t* data,
+      const std::size_t size,
+      std::vector<uint8_t>& encoded)
+  {
+    DatagramHeader header;
+    if(!read_header(data, size, header))
+      return;
+
+    std::unique_lock<std::mutex> lock(_mutex);
+    const auto it = _topics.find(header.topic);
+    if(it == _topics.end())
+      return;
+
+    InboundTopic& topic = it->second;
+    const bool rejected_before = topic.reassembler.rejected() > 0;
+    if(!topic.reassembler.add(
+         header, data + sizeof(DatagramHeader),
+         size - sizeof(DatagramHeader), encoded))
+    {
+      if(!rejected_before && topic.reassembler.rejected() > 0)
+      {
+        std::cerr << "[soss::udp] Rejecting datagrams of topic [" << topic.name
+                  << "] whose fragments do not match the [" << YamlMtuKey
+                  << "] of this end, or whose messages exceed its ["
+                  << YamlMaxMessageSizeKey << "]" << std::endl;
+      }
+      return;
+    }
+
+    const soss::Ingress::Scope ingress;
+    soss::Message message;
+    if(!soss::binary::decode(encoded.data(), encoded.size(), message))
+    {
+      std::cerr << "[soss::udp] Received a damaged message on topic ["
+                << topic.name << "]" << std::endl;
+      return;
+    }
+
+    for(Subscription& subscription : topic.subscriptions)
+    {
+      if(message.type != subscription.message_type)
+      {
+        if(!subscription.warned)
+        {
+          std::cerr << "[soss::udp] Topic [" << topic.name << "] carries ["
+                    << message.type << "] instead of ["
+                    << subscription.message_type << "]. Its messages will be "
+                    << "ignored." << std::endl;
+          subscription.warned = true;
+        }
+        continue;
+      }
+
+      if(topic.subscriptions.size() == 1)
+        subscription.callback(std::move(message));
+      else
+        subscription.callback(message);
+    }
+  }
+
+  std::size_t _mtu = default_mtu;
+  std::size_t _fec = 0;
+  std::size_t _max_message_size = default_max_message_size;
+  ThreadSettings _thread_settings;
+  const std::shared_ptr<Socket> _socket;
+
+  std::mutex _mutex;
+  std::map<uint64_t, InboundTopic> _topics;
+
+  std::atomic_bool _quit;
+  std::thread _thread;
+
+};
+
+} // namespace udp
+} // namespace soss
+
+SOSS_REGISTER_SYSTEM("udp", soss::udp::SystemHandle)
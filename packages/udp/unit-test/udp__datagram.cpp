@@ -0,0 +1,352 @@
+/*
+ * Copyright (C) 2019 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include <catch2/catch.hpp>
+
+#include <Datagram.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <random>
+
+using namespace soss::udp;
+
+namespace {
+
+//==============================================================================
+constexpr std::size_t chunk = 1000;
+constexpr std::size_t datagram_size = sizeof(DatagramHeader) + chunk;
+constexpr std::size_t max_message_size = 1024*1024;
+
+using Datagrams = std::vector<std::vector<uint8_t>>;
+
+//==============================================================================
+std::vector<uint8_t> random_message(const std::size_t size)
+{
+  static std::mt19937 generator(1234);
+  std::uniform_int_distribution<int> byte(0, 255);
+
+  std::vector<uint8_t> message(size);
+  for(uint8_t& b : message)
+    b = static_cast<uint8_t>(byte(generator));
+
+  return message;
+}
+
+//==============================================================================
+DatagramHeader header_of(const std::vector<uint8_t>& datagram)
+{
+  DatagramHeader header;
+  std::memcpy(&header, datagram.data(), sizeof(header));
+  return header;
+}
+
+//==============================================================================
+void set_header(std::vector<uint8_t>& datagram, const DatagramHeader& header)
+{
+  std::memcpy(datagram.data(), &header, sizeof(header));
+}
+
+//==============================================================================
+/// Feed one datagram to the reassembler the way the receiver does
+bool deliver(
+    Reassembler& reassembler,
+    const std::vector<uint8_t>& datagram,
+    std::vector<uint8_t>& message)
+{
+  DatagramHeader header;
+  REQUIRE(read_header(datagram.data(), datagram.size(), header));
+  return reassembler.add(
+        header, datagram.data() + sizeof(DatagramHeader),
+        datagram.size() - sizeof(DatagramHeader), message);
+}
+
+//==============================================================================
+/// Feed datagrams to the reassembler and count the messages it completes
+std::size_t deliver_all(
+    Reassembler& reassembler,
+    const Datagrams& datagrams,
+    std::vector<uint8_t>& message)
+{
+  std::size_t completed = 0;
+  for(const auto& datagram : datagrams)
+  {
+    if(deliver(reassembler, datagram, message))
+      ++completed;
+  }
+
+  return completed;
+}
+
+//==============================================================================
+Datagrams only(const Datagrams& datagrams, const DatagramHeader::Kind kind)
+{
+  Datagrams result;
+  for(const auto& datagram : datagrams)
+  {
+    if(header_of(datagram).kind == kind)
+      result.push_back(datagram);
+  }
+
+  return result;
+}
+
+} // anonymous namespace
+
+TEST_CASE("Messages are split into fragments and put back together", "[udp]")
+{
+  Fragmenter fragmenter("topic", datagram_size, 0);
+  Reassembler reassembler(chunk, max_message_size);
+
+  // Encoded messages are never empty, because of their preamble
+  for(const std::size_t size : {1u, 999u, 1000u, 1001u, 10500u})
+  {
+    CAPTURE(size);
+    const std::vector<uint8_t> original = random_message(size);
+
+    Datagrams datagrams;
+    REQUIRE(fragmenter.split(original, datagrams));
+    CHECK(datagrams.size() == (size + chunk - 1)/chunk);
+    for(const auto& datagram : datagrams)
+    {
+      CHECK(datagram.size() <= datagram_size);
+      CHECK(header_of(datagram).topic == topic_fingerprint("topic"));
+    }
+
+    // Fragments may arrive in any order
+    std::reverse(datagrams.begin(), datagrams.end());
+
+    std::vector<uint8_t> message;
+    CHECK(deliver_all(reassembler, datagrams, message) == 1);
+    CHECK(message == original);
+  }
+
+  CHECK(reassembler.superseded() == 0);
+  CHECK(reassembler.recovered() == 0);
+  CHECK(reassembler.rejected() == 0);
+}
+
+TEST_CASE("Parity rebuilds one lost fragment per group", "[udp]")
+{
+  Fragmenter fragmenter("topic", datagram_size, 4);
+  const std::vector<uint8_t> original = random_message(9500);
+
+  Datagrams datagrams;
+  REQUIRE(fragmenter.split(original, datagrams));
+
+  // Ten data fragments, in groups of four with a parity behind each group
+  REQUIRE(only(datagrams, DatagramHeader::Data).size() == 10);
+  REQUIRE(only(datagrams, DatagramHeader::Parity).size() == 3);
+  CHECK(header_of(datagrams[4]).kind == DatagramHeader::Parity);
+  CHECK(header_of(datagrams[4]).index == 0);
+
+  SECTION("Losing one fragment of every group, including the short one")
+  {
+    Reassembler reassembler(chunk, max_message_size);
+    Datagrams received;
+    for(const auto& datagram : datagrams)
+    {
+      const DatagramHeader header = header_of(datagram);
+      if(header.kind == DatagramHeader::Data
+         && (header.index == 1 || header.index == 6 || header.index == 9))
+        continue;
+
+      received.push_back(datagram);
+    }
+
+    std::vector<uint8_t> message;
+    CHECK(deliver_all(reassembler, received, message) == 1);
+    CHECK(message == original);
+    CHECK(reassembler.recovered() == 3);
+  }
+
+  SECTION("The parity arriving before the rest of its group")
+  {
+    Reassembler reassembler(chunk, max_message_size);
+    Datagrams received = datagrams;
+    received.erase(received.begin() + 2);
+    std::rotate(received.begin(), received.begin() + 3, received.begin() + 4);
+
+    std::vector<uint8_t> message;
+    CHECK(deliver_all(reassembler, received, message) == 1);
+    CHECK(message == original);
+    CHECK(reassembler.recovered() == 1);
+  }
+
+  SECTION("Losing two fragments of the same group")
+  {
+    Reassembler reassembler(chunk, max_message_size);
+    Datagrams received = datagrams;
+    received.erase(received.begin() + 1, received.begin() + 3);
+
+    std::vector<uint8_t> message;
+    CHECK(deliver_all(reassembler, received, message) == 0);
+    CHECK(reassembler.recovered() == 0);
+  }
+}
+
+TEST_CASE("Newer messages supersede the one in progress", "[udp]")
+{
+  Fragmenter fragmenter("topic", datagram_size, 0);
+  Reassembler reassembler(chunk, max_message_size);
+
+  const std::vector<uint8_t> first = random_message(3000);
+  const std::vector<uint8_t> second = random_message(2000);
+  Datagrams first_datagrams;
+  Datagrams second_datagrams;
+  REQUIRE(fragmenter.split(first, first_datagrams));
+  REQUIRE(fragmenter.split(second, second_datagrams));
+
+  std::vector<uint8_t> message;
+
+  // The first message loses its last fragment, and the second one arrives
+  CHECK_FALSE(deliver(reassembler, first_datagrams[0], message));
+  CHECK_FALSE(deliver(reassembler, first_datagrams[1], message));
+  CHECK(deliver_all(reassembler, second_datagrams, message) == 1);
+  CHECK(message == second);
+  CHECK(reassembler.superseded() == 1);
+
+  // The missing fragment of the first message shows up late, and the second
+  // message gets duplicated. Neither of them is delivered again.
+  CHECK_FALSE(deliver(reassembler, first_datagrams[2], message));
+  CHECK(deliver_all(reassembler, first_datagrams, message) == 0);
+  CHECK(deliver_all(reassembler, second_datagrams, message) == 0);
+  CHECK(reassembler.superseded() == 1);
+
+  // The next message goes through as usual
+  const std::vector<uint8_t> third = random_message(10);
+  Datagrams third_datagrams;
+  REQUIRE(fragmenter.split(third, third_datagrams));
+  CHECK(deliver_all(reassembler, third_datagrams, message) == 1);
+  CHECK(message == third);
+}
+
+TEST_CASE("Sequence numbers may wrap around", "[udp]")
+{
+  Fragmenter fragmenter("topic", datagram_size, 0);
+  Reassembler reassembler(chunk, max_message_size);
+
+  const std::vector<uint8_t> original = random_message(1500);
+  Datagrams datagrams;
+  REQUIRE(fragmenter.split(original, datagrams));
+
+  std::vector<uint8_t> message;
+  for(const uint32_t sequence : {0xFFFFFFFEu, 0xFFFFFFFFu, 0u, 1u})
+  {
+    CAPTURE(sequence);
+    for(auto& datagram : datagrams)
+    {
+      DatagramHeader header = header_of(datagram);
+      header.sequence = sequence;
+      set_header(datagram, header);
+    }
+
+    message.clear();
+    CHECK(deliver_all(reassembler, datagrams, message) == 1);
+    CHECK(message == original);
+  }
+}
+
+TEST_CASE("Damaged and foreign headers are rejected", "[udp]")
+{
+  Fragmenter fragmenter("topic", datagram_size, 2);
+  Datagrams datagrams;
+  REQUIRE(fragmenter.split(random_message(2500), datagrams));
+
+  std::vector<uint8_t> datagram = datagrams[1];
+  DatagramHeader header;
+  REQUIRE(read_header(datagram.data(), datagram.size(), header));
+  CHECK_FALSE(read_header(datagram.data(), sizeof(DatagramHeader) - 1, header));
+
+  const auto rejects = [&](const std::function<void(DatagramHeader&)>& damage)
+  {
+    std::vector<uint8_t> damaged = datagram;
+    DatagramHeader h = header_of(damaged);
+    damage(h);
+    set_header(damaged, h);
+    DatagramHeader out;
+    return !read_header(damaged.data(), damaged.size(), out);
+  };
+
+  CHECK(rejects([](DatagramHeader& h) { h.magic = 0x55534f53; }));
+  CHECK(rejects([](DatagramHeader& h) { ++h.version; }));
+  CHECK(rejects([](DatagramHeader& h) { h.kind = 7; }));
+  CHECK(rejects([](DatagramHeader& h) { h.index = h.count; }));
+  CHECK(rejects([](DatagramHeader& h) { h.count = 0; }));
+  CHECK(rejects([](DatagramHeader& h) { h.chunk = 0; }));
+
+  // The fragments have to cover the message exactly
+  CHECK(rejects([](DatagramHeader& h) { h.size = h.count * h.chunk + 1; }));
+  CHECK(rejects([](DatagramHeader& h) { h.size = (h.count - 1) * h.chunk; }));
+
+  // Parity only ever starts a group
+  CHECK(rejects([](DatagramHeader& h)
+  {
+    h.kind = DatagramHeader::Parity;
+    h.index = 1;
+  }));
+
+  // The payload must not be larger than the chunk
+  datagram.push_back(0);
+  CHECK(rejects([](DatagramHeader&) {}));
+}
+
+TEST_CASE("Forged headers cannot make the receiver allocate", "[udp]")
+{
+  Reassembler reassembler(chunk, 4000);
+  std::vector<uint8_t> message;
+
+  DatagramHeader header;
+  std::memset(&header, 0, sizeof(header));
+  header.magic = datagram_magic;
+  header.version = datagram_version;
+  header.kind = DatagramHeader::Data;
+  header.sequence = 1;
+
+  // The largest message that the format can describe, which passes
+  // read_header(~) but is far larger than this end accepts
+  header.chunk = std::numeric_limits<uint16_t>::max();
+  header.count = std::numeric_limits<uint16_t>::max();
+  header.size = std::numeric_limits<uint32_t>::max();
+  const std::vector<uint8_t> payload(10, 0);
+  CHECK_FALSE(reassembler.add(header, payload.data(), payload.size(), message));
+  CHECK(reassembler.rejected() == 1);
+
+  // The chunk size of this end, but a message above its limit
+  header.chunk = chunk;
+  header.count = 5;
+  header.size = 4500;
+  CHECK_FALSE(reassembler.add(header, payload.data(), payload.size(), message));
+  CHECK(reassembler.rejected() == 2);
+
+  // A rejected header does not abandon the message in progress
+  Fragmenter fragmenter("topic", datagram_size, 0);
+  const std::vector<uint8_t> original = random_message(2500);
+  Datagrams datagrams;
+  REQUIRE(fragmenter.split(original, datagrams));
+
+  CHECK_FALSE(deliver(reassembler, datagrams[0], message));
+  header.sequence = 1000;
+  CHECK_FALSE(reassembler.add(header, payload.data(), payload.size(), message));
+  CHECK(reassembler.rejected() == 3);
+  CHECK_FALSE(deliver(reassembler, datagrams[1], message));
+  CHECK(deliver(reassembler, datagrams[2], message));
+  CHECK(message == original);
+  CHECK(reassembler.superseded() == 0);
+}
@@ -16,13 +16,20 @@
 */
 
 #include "Endpoint.hpp"
+#include "TlsSessions.hpp"
 
 #include <soss/Search.hpp>
+#include <soss/ThreadSettings.hpp>
 
+#include <algorithm>
 #include <chrono>
+#include <condition_variable>
+#include <limits>
+#include <mutex>
 #include <thread>
 #include <unordered_map>
 #include <unordered_set>
+#include <vector>
 #include <websocketpp/config/asio_client.hpp>
 
 namespace soss {
@@ -31,6 +38,7 @@ namespace websocket {
 const std::string WebsocketMiddlewareName = "websocket";
 const std::string YamlClientTokenKey = "token";
 const std::string WebsocketUriPrefix = "wss://";
+const std::string PlainWebsocketUriPrefix = "ws://";
 const std::string DefaultHostname = "localhost";
 
 const std::string YamlCertAuthoritiesKey = "cert_authorities";
@@ -38,8 +46,29 @@ const std::string YamlCertAuthoritiesKey = "cert_authorities";
 const std::string YamlAuthKey = "authentication";
 const std::string YamlJwtTokenKey = "jwt_secret";
 
+// The most bytes that may wait in the outbound queue of the client. Set this
+// to 0 to let the queue grow without limit.
+const std::string YamlSendQueueLimitKey = "send_queue_limit";
+const std::size_t DefaultSendQueueLimit = 8*1024*1024;
+
+// How many connections the client opens to the server, and which of them the
+// topics and services travel over
+const std::string YamlConnectionsKey = "connections";
+const std::string YamlConnectionCountKey = "count";
+const std::string YamlConnectionGroupsKey = "groups";
+const std::string YamlConnectionServicesKey = "services";
+
 using namespace std::chrono_literals;
 
+// How long to wait in between attempts to reconnect to the server. A
+// connection that closes gets its first attempt right away.
+const auto ReconnectPeriod = 2s;
+
+// How long the server gets to subscribe again to the topics of a connection
+// that has just opened, before the publications that were held for them are
+// given up on
+const auto ResubscribeWindow = 1s;
+
 //==============================================================================
 std::string parse_hostname(const YAML::Node& configuration)
 {
@@ -50,65 +79,177 @@ std::string parse_hostname(const YAML::Node& configuration)
 }
 
 //==============================================================================
-class Client : public Endpoint
+/// ConnectionLayout decides which of the connections of a client each topic
+/// and service goes over. Every connection is a TCP stream of its own, so a
+/// large publication on one of them does not hold up the others.
+struct ConnectionLayout
 {
-public:
+  /// The number of connections to the server
+  std::size_t count = 1;
 
-  Client()
-    : _host_uri("<undefined>"),
-      _closing_down(false),
-      _connection_failed(false)
+  /// Whether the first connection is kept for services, so that requests and
+  /// responses never wait behind publications
+  bool dedicated_services = false;
+
+  /// The connection of each topic that was put into a group explicitly
+  std::unordered_map<std::string, std::size_t> groups;
+
+  /// The connections that topics without a group get spread over by hash
+  std::size_t first_hashed = 0;
+
+  std::size_t connection_of(const std::string& topic) const
   {
-    // Do nothing
+    const auto group = groups.find(topic);
+    if(group != groups.end())
+      return group->second;
+
+    return first_hashed
+        + std::hash<std::string>()(topic) % (count - first_hashed);
   }
+};
 
-  WsCppEndpoint* configure_endpoint(
-      const RequiredTypes& /*types*/,
-      const YAML::Node& configuration) override
+//==============================================================================
+/// Parse the optional connections setting, which is either the number of
+/// connections or a map with the entries count, services and groups.
+///
+/// \returns false if the setting is invalid.
+bool parse_connection_layout(
+    const YAML::Node& configuration,
+    ConnectionLayout& layout)
+{
+  const YAML::Node node = configuration[YamlConnectionsKey];
+  if(!node)
+    return true;
+
+  const YAML::Node count_node =
+      node.IsMap()? node[YamlConnectionCountKey] : node;
+  if(count_node)
   {
-    const int32_t port = parse_port(configuration);
-    if(port < 0)
-      return nullptr;
+    const int64_t count = count_node.as<int64_t>();
+    if(count < 1)
+    {
+      std::cerr << "[soss::websocket::Client] The [" << YamlConnectionsKey
+                << "] setting must be at least 1, but it is [" << count << "]"
+                << std::endl;
+      return false;
+    }
 
-    const std::string hostname = parse_hostname(configuration);
-    const YAML::Node auth_node = configuration[YamlAuthKey];
-    if (auth_node)
-      _load_auth_config(auth_node);
+    layout.count = static_cast<std::size_t>(count);
+  }
 
-    const std::vector<std::string> extra_ca = [&]()
+  layout.dedicated_services = layout.count > 1;
+  if(node.IsMap())
+  {
+    if(const YAML::Node services_node = node[YamlConnectionServicesKey])
+      layout.dedicated_services = services_node.as<bool>();
+  }
+
+  const std::size_t first_topic_connection = layout.dedicated_services? 1 : 0;
+  const YAML::Node groups_node =
+      node.IsMap()? node[YamlConnectionGroupsKey] : YAML::Node();
+  const std::size_t num_groups = groups_node? groups_node.size() : 0;
+
+  if(layout.dedicated_services && layout.count < 2)
+  {
+    std::cerr << "[soss::websocket::Client] The services cannot have a "
+              << "connection of their own unless there are at least 2 "
+              << YamlConnectionsKey << std::endl;
+    return false;
+  }
+
+  if(first_topic_connection + num_groups > layout.count)
+  {
+    std::cerr << "[soss::websocket::Client] There are [" << num_groups
+              << "] topic groups, but only [" << layout.count
+              << "] connections" << (layout.dedicated_services?
+                 ", one of which is kept for services" : "") << std::endl;
+    return false;
+  }
+
+  for(std::size_t i=0; i < num_groups; ++i)
+  {
+    for(const auto topic_node : groups_node[i])
     {
-      std::vector<std::string> extra_ca;
-      const YAML::Node cert_authorities_node =
-          configuration[YamlCertAuthoritiesKey];
-      for(const auto node : cert_authorities_node)
-        extra_ca.push_back(node.as<std::string>());
+      const std::string topic = topic_node.as<std::string>();
+      if(!layout.groups.insert({topic, first_topic_connection + i}).second)
+      {
+        std::cerr << "[soss::websocket::Client] The topic [" << topic
+                  << "] is in more than one of the " << YamlConnectionsKey
+                  << " " << YamlConnectionGroupsKey << std::endl;
+        return false;
+      }
+    }
+  }
 
-      return extra_ca;
-    }();
+  // Topics without a group share the connections that are left over. If the
+  // groups took all of them, they share every topic connection instead.
+  layout.first_hashed = first_topic_connection + num_groups;
+  if(layout.first_hashed >= layout.count)
+    layout.first_hashed = first_topic_connection;
 
-    if(!configure_client(hostname, static_cast<uint16_t>(port), extra_ca))
-      return nullptr;
+  return true;
+}
+
+//==============================================================================
+/// ClientSecurity sets up whatever a client of the given configuration needs
+/// before it can connect to a server.
+template<typename Config>
+struct ClientSecurity;
 
-    return &_client;
+//==============================================================================
+template<>
+struct ClientSecurity<TlsConfig>
+{
+  static const std::string& uri_prefix()
+  {
+    return WebsocketUriPrefix;
   }
 
-  bool configure_client(
+  static bool configure(
+      WsCppClientT<TlsConfig>& client,
       const std::string& hostname,
-      const uint16_t port,
-      const std::vector<std::string>& extra_certificate_authorities)
+      const std::vector<std::string>& extra_certificate_authorities,
+      const TlsSettings& settings,
+      const std::string& metrics_prefix)
   {
-    _host_uri = WebsocketUriPrefix + hostname + ":" + std::to_string(port);
+    const WsCppSslContextPtr context =
+        make_context(hostname, extra_certificate_authorities);
+    if(!context)
+      return false;
+
+    if(!configure_client_tls(
+         context->native_handle(), settings, metrics_prefix))
+      return false;
 
-    _context = std::make_shared<WsCppSslContext>(
-          boost::asio::ssl::context::tlsv1);
+    client.set_tls_init_handler(
+          [context](WsCppWeakConnectPtr /*handle*/) -> WsCppSslContextPtr
+    {
+      return context;
+    });
+
+    return true;
+  }
+
+  static WsCppSslContextPtr make_context(
+      const std::string& hostname,
+      const std::vector<std::string>& extra_certificate_authorities)
+  {
+    // Negotiate the newest version of TLS that the server supports, since the
+    // ECDHE ciphers with AEAD need at least TLS 1.2
+    const WsCppSslContextPtr context = std::make_shared<WsCppSslContext>(
+          boost::asio::ssl::context::tls);
+    context->set_options(
+          boost::asio::ssl::context::default_workarounds |
+          boost::asio::ssl::context::no_sslv2 |
+          boost::asio::ssl::context::no_sslv3);
 
     boost::system::error_code ec;
-    _context->set_default_verify_paths(ec);
+    context->set_default_verify_paths(ec);
     if(ec)
     {
       std::cerr << "[soss::websocket::Client] Failed to load the default "
                 << "certificate authorities: " << ec.message() << std::endl;
-      return false;
+      return nullptr;
     }
 
     if(!extra_certificate_authorities.empty())
@@ -136,15 +277,15 @@ public:
             err += " -- " + checked_path + "\n";
 
           std::cerr << err << std::endl;
-          return false;
+          return nullptr;
         }
 
-        _context->load_verify_file(ca_file_path, ec);
+        context->load_verify_file(ca_file_path, ec);
         if(ec)
         {
           std::cerr << "[soss::websocket::Client] Failed to load the specified "
                     << "certificate authority: " << ca_file_path << std::endl;
-          return false;
+          return nullptr;
         }
 
         std::cout << "[soss::websocket::Client] Using an extra certificate "
@@ -152,23 +293,174 @@ public:
       }
     }
 
-    _context->set_verify_mode(boost::asio::ssl::context::verify_peer, ec);
+    context->set_verify_mode(boost::asio::ssl::context::verify_peer, ec);
     if(ec)
     {
       std::cerr << "[soss::websocket::Client] Failed to set the verify mode: "
                 << ec.message() << std::endl;
-      return false;
+      return nullptr;
     }
 
-    _context->set_verify_callback(
+    context->set_verify_callback(
           boost::asio::ssl::rfc2818_verification(hostname), ec);
     if(ec)
     {
       std::cerr << "[soss::websocket::Client] Failed to set the verify "
                 << "callback: " << ec.message() << std::endl;
+      return nullptr;
+    }
+
+    return context;
+  }
+
+  /// Offer the session of an earlier connection to the server, so that
+  /// reconnecting does not need a full handshake
+  static void init_socket(WsCppSslSocket& socket)
+  {
+    resume_tls_session(socket.native_handle());
+  }
+};
+
+//==============================================================================
+template<>
+struct ClientSecurity<TcpConfig>
+{
+  static const std::string& uri_prefix()
+  {
+    return PlainWebsocketUriPrefix;
+  }
+
+  static bool configure(
+      WsCppClientT<TcpConfig>& /*client*/,
+      const std::string& /*hostname*/,
+      const std::vector<std::string>& extra_certificate_authorities,
+      const TlsSettings& /*settings*/,
+      const std::string& /*metrics_prefix*/)
+  {
+    if(!extra_certificate_authorities.empty())
+    {
+      std::cerr << "[soss::websocket::Client] The [" << YamlCertAuthoritiesKey
+                << "] setting is ignored, because plain connections do not "
+                << "use TLS" << std::endl;
+    }
+
+    return true;
+  }
+
+  template<typename Socket>
+  static void init_socket(Socket& /*socket*/)
+  {
+    // Plain connections have no sessions to resume
+  }
+};
+
+//==============================================================================
+template<typename Config>
+class ClientT : public TransportEndpoint<Config>
+{
+public:
+
+  using ConnectionPtr = typename TransportEndpoint<Config>::ConnectionPtr;
+
+  ClientT()
+    : _host_uri("<undefined>"),
+      _deflate(DeflateSettings::Role::Client),
+      _closing_down(false),
+      _connection_failed(false),
+      _send_queue_limit(DefaultSendQueueLimit)
+  {
+    // Do nothing
+  }
+
+  bool configure_endpoint(
+      const RequiredTypes& /*types*/,
+      const YAML::Node& configuration) override
+  {
+    const int32_t port = parse_port(configuration);
+    if(port < 0)
       return false;
+
+    const std::string hostname = parse_hostname(configuration);
+
+    if(!_thread_settings.parse(
+         configuration[YamlThreadKey], "websocket client"))
+      return false;
+
+    if(!parse_permessage_deflate(configuration, _deflate))
+      return false;
+
+    if(!parse_connection_layout(configuration, _layout))
+      return false;
+
+    if(!parse_tls(configuration, _tls))
+      return false;
+
+    if(const YAML::Node buffer_node = configuration[YamlReconnectBufferKey])
+    {
+      const int64_t limit = buffer_node.as<int64_t>();
+      if(limit < 0)
+      {
+        std::cerr << "[soss::websocket::Client] The [" << YamlReconnectBufferKey
+                  << "] setting must not be negative, but it is [" << limit
+                  << "]" << std::endl;
+        return false;
+      }
+
+      this->set_reconnect_buffer(static_cast<std::size_t>(limit));
+    }
+
+    const YAML::Node auth_node = configuration[YamlAuthKey];
+    if (auth_node)
+      _load_auth_config(auth_node);
+
+    if(const YAML::Node limit_node = configuration[YamlSendQueueLimitKey])
+    {
+      const int64_t limit = limit_node.as<int64_t>();
+      if(limit < 0)
+      {
+        std::cerr << "[soss::websocket::Client] The [" << YamlSendQueueLimitKey
+                  << "] setting must not be negative, but it is [" << limit
+                  << "]" << std::endl;
+        return false;
+      }
+
+      _send_queue_limit = static_cast<std::size_t>(limit);
     }
 
+    const std::vector<std::string> extra_ca = [&]()
+    {
+      std::vector<std::string> extra_ca;
+      const YAML::Node cert_authorities_node =
+          configuration[YamlCertAuthoritiesKey];
+      for(const auto node : cert_authorities_node)
+        extra_ca.push_back(node.as<std::string>());
+
+      return extra_ca;
+    }();
+
+    return configure_client(hostname, static_cast<uint16_t>(port), extra_ca);
+  }
+
+  bool configure_client(
+      const std::string& hostname,
+      const uint16_t port,
+      const std::vector<std::string>& extra_certificate_authorities)
+  {
+    _host_uri = ClientSecurity<Config>::uri_prefix()
+        + hostname + ":" + std::to_string(port);
+    _slots = std::vector<Slot>(_layout.count);
+
+    const std::string metrics_prefix =
+        "websocket_client:" + hostname + ":" + std::to_string(port) + "/";
+    if(!ClientSecurity<Config>::configure(
+         _client, hostname, extra_certificate_authorities, _tls,
+         metrics_prefix))
+      return false;
+
+    this->set_fragment_metrics(
+          soss::Metrics::connection(metrics_prefix + "fragments"));
+
+
     _client.clear_access_channels(
           websocketpp::log::alevel::frame_header |
           websocketpp::log::alevel::frame_payload);
@@ -200,51 +492,48 @@ public:
       this->_handle_failed_connection(std::move(handle));
     });
 
-    _client.set_tls_init_handler(
-          [&](WsCppWeakConnectPtr /*handle*/) -> WsCppSslContextPtr
-    {
-      return this->_context;
-    });
-
     _client.set_socket_init_handler(
-          [&](WsCppWeakConnectPtr handle, auto& /*sock*/)
+          [&](WsCppWeakConnectPtr handle, auto& socket)
     {
+      ClientSecurity<Config>::init_socket(socket);
       this->_handle_socket_init(std::move(handle));
     });
 
-    _client_thread = std::thread([&](){ this->_client.run(); });
+    _client_thread = std::thread([&]()
+    {
+      this->_thread_settings.apply("soss-ws-client");
+      const DeflateSettings::Binding deflate(this->_deflate);
+      this->_client.run();
+    });
 
     return true;
   }
 
-  ~Client() override
+  ~ClientT() override
   {
     _closing_down = true;
 
-    if(_connection && _connection->get_state() == websocketpp::session::state::open)
-    {
-      _connection->close(websocketpp::close::status::normal, "shutdown");
+    // Stop interpreting inbound messages before any connection goes away
+    this->stop_workers();
 
-      // TODO(MXG) Make these timeout parameters something that can be
-      // configured by users
-      using namespace std::chrono_literals;
-      const auto start_time = std::chrono::steady_clock::now();
-      while(_connection->get_state() != websocketpp::session::state::closed)
+    std::vector<ConnectionPtr> closing;
+    for(std::size_t i=0; i < _slots.size(); ++i)
+    {
+      const ConnectionPtr connection = _connection(i);
+      if(connection
+         && connection->get_state() == websocketpp::session::state::open)
       {
-        // Check for an update every 1/5 of a second
-        std::this_thread::sleep_for(200ms);
-
-        // Wait no more than 10 seconds total.
-        if(std::chrono::steady_clock::now() - start_time > 10s)
-        {
-          std::cerr << "[soss::websocket::Client] Timed out while waiting for "
-                    << "the remote server to acknowledge the connection "
-                    << "shutdown request" << std::endl;
-          break;
-        }
+        closing.push_back(connection);
       }
     }
 
+    if(!this->close_and_wait(closing))
+    {
+      std::cerr << "[soss::websocket::Client] Timed out while waiting for "
+                << "the remote server to acknowledge the connection "
+                << "shutdown request" << std::endl;
+    }
+
     if(_client_thread.joinable())
     {
       _client.stop();
@@ -254,21 +543,33 @@ public:
 
   bool okay() const override
   {
-    return static_cast<bool>(_connection);
+    for(std::size_t i=0; i < _slots.size(); ++i)
+    {
+      if(_connection(i))
+        return true;
+    }
+
+    return false;
   }
 
   bool spin_once() override
   {
-    const bool attempt_reconnect = (!_connection ||
-        _connection->get_state() == websocketpp::session::state::closed)
-         && (std::chrono::steady_clock::now() - _last_connection_attempt > 2s);
-
-    if(!_has_spun_once || attempt_reconnect)
+    const auto now = std::chrono::steady_clock::now();
+    for(std::size_t i=0; i < _slots.size(); ++i)
     {
-      _has_spun_once = true;
+      Slot& slot = _slots[i];
+      const bool reconnect_now = slot.reconnect_now.exchange(false);
+      const bool attempt_reconnect = _needs_connection(i)
+          && (reconnect_now
+              || now - slot.last_connection_attempt > ReconnectPeriod);
+
+      if(slot.attempted && !attempt_reconnect)
+        continue;
+
+      slot.attempted = true;
 
       websocketpp::lib::error_code ec;
-      _connection = _client.get_connection(_host_uri, ec);
+      const ConnectionPtr connection = _client.get_connection(_host_uri, ec);
       if(ec)
       {
         std::cerr << "[soss::websocket::Client] Error creating connection "
@@ -276,15 +577,44 @@ public:
       }
       else
       {
-        _client.connect(_connection);
+        std::atomic_store(&slot.connection, connection);
+        _client.connect(connection);
       }
 
-      _last_connection_attempt = std::chrono::steady_clock::now();
+      slot.last_connection_attempt = now;
     }
 
-    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    return okay();
+  }
+
+  void wait_for_work(std::chrono::nanoseconds max_wait) override
+  {
+    // The only work that spin_once() does is reconnecting, so we sleep until
+    // the connection drops or until it is time for the next reconnect attempt.
+    std::chrono::steady_clock::time_point deadline =
+        std::chrono::steady_clock::now() + max_wait;
+    for(std::size_t i=0; i < _slots.size(); ++i)
+    {
+      if(!_needs_connection(i))
+        continue;
 
-    return static_cast<bool>(_connection);
+      const std::chrono::steady_clock::time_point next_attempt =
+          _slots[i].last_connection_attempt + ReconnectPeriod;
+      deadline = std::min(deadline, next_attempt);
+    }
+
+    std::unique_lock<std::mutex> lock(_wakeup_mutex);
+    _wakeup.wait_until(lock, deadline, [&]() { return _wakeup_requested; });
+    _wakeup_requested = false;
+  }
+
+  void wake_up() override
+  {
+    {
+      std::unique_lock<std::mutex> lock(_wakeup_mutex);
+      _wakeup_requested = true;
+    }
+    _wakeup.notify_all();
   }
 
   void runtime_advertisement(
@@ -293,31 +623,208 @@ public:
       const std::string& id,
       const YAML::Node& configuration) override
   {
-    if(_connection)
+    if(const ConnectionPtr connection =
+       _connection(_layout.connection_of(topic)))
     {
-      _connection->send(
-            get_encoding().encode_advertise_msg(
+      this->send_payload(
+            connection,
+            this->get_encoding().encode_advertise_msg(
               topic, message_type, id, configuration));
     }
   }
 
+protected:
+
+  typename TransportEndpoint<Config>::WsEndpoint& ws_endpoint() override
+  {
+    return _client;
+  }
+
+  bool carries(
+      const std::shared_ptr<void>& connection_handle,
+      const std::string& topic) const override
+  {
+    const std::size_t index = _slot_of(connection_handle);
+    if(index == NoSlot)
+      return true;
+
+    if(topic.empty())
+      return !_layout.dedicated_services || index == 0;
+
+    return index == _layout.connection_of(topic);
+  }
+
+  bool awaiting_connection(const std::string& topic) const override
+  {
+    if(_closing_down || _slots.empty())
+      return false;
+
+    const Slot& slot = _slots[_layout.connection_of(topic)];
+    const int64_t opened_at = slot.opened_at;
+    if(opened_at == 0)
+      return true;
+
+    const auto since_opened = std::chrono::steady_clock::now().time_since_epoch()
+        - std::chrono::steady_clock::duration(opened_at);
+    return since_opened < ResubscribeWindow;
+  }
+
+  /// Messages are not sent from the thread that is publishing them. They wait
+  /// in an outbound queue that gets drained on the io thread of the client,
+  /// so publishers never contend for the lock of the connection, and every
+  /// message that piled up in the meantime is handed to websocketpp at once,
+  /// which gathers them into a single write.
+  websocketpp::lib::error_code send_message(
+      const std::shared_ptr<void>& connection_handle,
+      const WsCppMessagePtr& message) override
+  {
+    const std::size_t size = message->get_payload().size();
+    bool post_drain = false;
+    {
+      std::unique_lock<std::mutex> lock(_outbound_mutex);
+      if(_send_queue_limit > 0 && !_outbound.empty()
+         && _outbound_bytes + size > _send_queue_limit)
+      {
+        // Only complain once each time the queue overflows
+        if(!_outbound_overflowed)
+        {
+          _outbound_overflowed = true;
+          std::cerr << "[soss::websocket::Client] The outbound queue is "
+                    << "holding more than [" << _send_queue_limit << "] "
+                    << "bytes, so messages to the server are being dropped. "
+                    << "Consider increasing [" << YamlSendQueueLimitKey
+                    << "]." << std::endl;
+        }
+
+        return websocketpp::error::make_error_code(
+              websocketpp::error::send_queue_full);
+      }
+
+      _outbound.push_back(Outbound{connection_handle, message});
+      _outbound_bytes += size;
+      post_drain = !_drain_posted;
+      _drain_posted = true;
+    }
+
+    if(post_drain)
+      _client.get_io_service().post([this]() { this->_drain_outbound(); });
+
+    return websocketpp::lib::error_code();
+  }
+
+  std::size_t get_buffered_amount(
+      const std::shared_ptr<void>& connection_handle) override
+  {
+    std::size_t queued = 0;
+    {
+      std::unique_lock<std::mutex> lock(_outbound_mutex);
+      queued = _outbound_bytes;
+    }
+
+    return queued
+        + TransportEndpoint<Config>::get_buffered_amount(connection_handle);
+  }
+
+  /// Everything that the client sends has to go through its outbound queue,
+  /// so publications never write to the connection directly.
+  Endpoint::ResolvedConnectionPtr resolve_connection(
+      const std::shared_ptr<void>& /*connection_handle*/) override
+  {
+    return nullptr;
+  }
+
 private:
 
+  struct Outbound
+  {
+    std::shared_ptr<void> connection_handle;
+    WsCppMessagePtr message;
+  };
+
+  void _drain_outbound()
+  {
+    std::vector<Outbound> outbound;
+    {
+      std::unique_lock<std::mutex> lock(_outbound_mutex);
+      outbound.swap(_outbound);
+      _outbound_bytes = 0;
+      _outbound_overflowed = false;
+      _drain_posted = false;
+    }
+
+    for(const Outbound& entry : outbound)
+    {
+      const websocketpp::lib::error_code ec =
+          TransportEndpoint<Config>::send_message(
+            entry.connection_handle, entry.message);
+
+      // A closed connection simply drops whatever was queued for it
+      if(ec && ec != websocketpp::error::bad_connection)
+      {
+        std::cerr << "[soss::websocket::Client] Failed to send a message to "
+                  << "the server: " << ec.message() << std::endl;
+      }
+    }
+
+    // Hand the buffer back so that its capacity gets reused
+    outbound.clear();
+    std::unique_lock<std::mutex> lock(_outbound_mutex);
+    if(_outbound.empty())
+      _outbound.swap(outbound);
+  }
+
+  static constexpr std::size_t NoSlot = std::numeric_limits<std::size_t>::max();
+
+  /// The connection of a slot. The websocket thread looks at the connections
+  /// while spin_once() replaces them, so they are loaded atomically.
+  ConnectionPtr _connection(const std::size_t index) const
+  {
+    return std::atomic_load(&_slots[index].connection);
+  }
+
+  /// Find the slot of a connection, or NoSlot if it is not one of ours
+  std::size_t _slot_of(const std::shared_ptr<void>& connection_handle) const
+  {
+    for(std::size_t i=0; i < _slots.size(); ++i)
+    {
+      if(static_cast<void*>(_connection(i).get()) == connection_handle.get())
+        return i;
+    }
+
+    return NoSlot;
+  }
+
+  bool _needs_connection(const std::size_t index) const
+  {
+    const ConnectionPtr connection = _connection(index);
+    return !connection
+        || connection->get_state() == websocketpp::session::state::closed;
+  }
+
+  /// A name for a connection in the log, if there is more than one
+  std::string _describe(const std::size_t index) const
+  {
+    if(_slots.size() == 1)
+      return "";
+
+    return " (connection " + std::to_string(index + 1) + " of "
+        + std::to_string(_slots.size()) + ")";
+  }
+
   void _handle_message(
       const WsCppWeakConnectPtr& handle,
       const WsCppMessagePtr& message)
   {
-    auto incoming_handle = _client.get_con_from_hdl(handle);
-    if(incoming_handle != _connection)
+    const ConnectionPtr incoming_handle = _client.get_con_from_hdl(handle);
+    if(_slot_of(incoming_handle) == NoSlot)
     {
       std::cerr << "[soss::websocket::Client::_handle_message] Unexpected "
                 << "connection is sending messages: [" << incoming_handle.get()
-                << "] vs [" << _connection.get() << "]" << std::endl;
+                << "]" << std::endl;
       return;
     }
 
-    get_encoding().interpret_websocket_msg(
-          message->get_payload(), *this, _connection);
+    this->receive_message_ws(message, incoming_handle);
   }
 
   void _handle_close(const WsCppWeakConnectPtr& handle)
@@ -337,25 +844,41 @@ private:
                 << closing_connection->get_remote_close_reason() << std::endl;
     }
 
-    notify_connection_closed(closing_connection);
+    const std::size_t index = _slot_of(closing_connection);
+    if(index != NoSlot)
+    {
+      _slots[index].opened_at = 0;
+
+      // Do not wait for the next reconnect period after losing a connection
+      // that was working, e.g. during a cell handover
+      if(!_closing_down)
+        _slots[index].reconnect_now = true;
+    }
+
+    this->notify_connection_closed(closing_connection);
+    wake_up();
   }
 
   void _handle_opening(const WsCppWeakConnectPtr& handle)
   {
     auto opened_connection = _client.get_con_from_hdl(handle);
-    if(opened_connection != _connection)
+    const std::size_t index = _slot_of(opened_connection);
+    if(index == NoSlot)
     {
       std::cerr << "[soss::websocket::Client::_handle_opening] Unexpected "
                 << "connection opened: [" << opened_connection.get()
-                << "] vs [" << _connection.get() << "]" << std::endl;
+                << "]" << std::endl;
       return;
     }
 
     _connection_failed = false;
+    _slots[index].opened_at =
+        std::chrono::steady_clock::now().time_since_epoch().count();
+
     std::cout << "[soss::websocket::Client] Established connection to host ["
-              << _host_uri << "]." << std::endl;
+              << _host_uri << "]" << _describe(index) << "." << std::endl;
 
-    notify_connection_opened(opened_connection);
+    this->notify_connection_opened(opened_connection);
 
     if (_jwt_token)
     {
@@ -377,6 +900,8 @@ private:
                 << "to the host [" << _host_uri << "]. We will periodically "
                 << "attempt to reconnect." << std::endl;
     }
+
+    wake_up();
   }
 
   void _handle_socket_init(const WsCppWeakConnectPtr& handle)
@@ -395,20 +920,52 @@ private:
       _jwt_token = std::make_unique<std::string>(token_node.as<std::string>());
   }
 
+  // One connection to the server, which gets replaced whenever it has to
+  // reconnect
+  struct Slot
+  {
+    ConnectionPtr connection;
+    std::chrono::steady_clock::time_point last_connection_attempt;
+    bool attempted = false;
+
+    // Set by the websocket thread when the connection closes
+    std::atomic_bool reconnect_now{false};
+
+    // When the connection opened, in ticks of the steady clock, or 0 while
+    // it is not open
+    std::atomic<int64_t> opened_at{0};
+  };
+
   std::string _host_uri;
-  WsCppConnectionPtr _connection;
-  WsCppClient _client;
+  ConnectionLayout _layout;
+  TlsSettings _tls;
+  std::vector<Slot> _slots;
+  WsCppClientT<Config> _client;
   std::thread _client_thread;
-  std::chrono::steady_clock::time_point _last_connection_attempt;
-  bool _has_spun_once = false;
+  ThreadSettings _thread_settings;
+  DeflateSettings _deflate;
   std::atomic_bool _closing_down;
   std::atomic_bool _connection_failed;
-  WsCppSslContextPtr _context;
   std::unique_ptr<std::string> _jwt_token;
+  std::mutex _wakeup_mutex;
+  std::condition_variable _wakeup;
+  bool _wakeup_requested = false;
+
+  // The outbound queue is protected by this mutex
+  std::mutex _outbound_mutex;
+  std::vector<Outbound> _outbound;
+  std::size_t _outbound_bytes = 0;
+  std::size_t _send_queue_limit;
+  bool _outbound_overflowed = false;
+  bool _drain_posted = false;
 
 };
 
+using Client = ClientT<TlsConfig>;
+using PlainClient = ClientT<TcpConfig>;
+
 SOSS_REGISTER_SYSTEM("websocket_client", soss::websocket::Client)
+SOSS_REGISTER_SYSTEM("websocket_client_plain", soss::websocket::PlainClient)
 
 } // namespace websocket
 } // namespace soss
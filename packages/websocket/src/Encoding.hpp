@@ -22,6 +22,7 @@
 
 #include <yaml-cpp/yaml.h>
 
+#include <chrono>
 #include <memory>
 
 namespace soss {
@@ -29,21 +30,100 @@ namespace websocket {
 
 class Endpoint;
 
+//==============================================================================
+/// Options that a remote peer may request, with the rosbridge fields
+/// "fragment_size", "compression", "throttle_rate" and "queue_length", for the
+/// messages that we send to it. The last two only apply to subscriptions.
+struct TransferOptions
+{
+  /// Text messages that are larger than this many bytes get split into
+  /// fragments. A value of zero means that messages never get fragmented.
+  std::size_t fragment_size = 0;
+
+  /// Messages get sent in CBOR, regardless of the encoding of the endpoint
+  bool cbor = false;
+
+  /// The minimum time between two publications that get sent to a subscriber.
+  /// A value of zero means that publications are sent as fast as they arrive.
+  std::chrono::milliseconds throttle_rate = std::chrono::milliseconds(0);
+
+  /// How many publications may wait for a subscriber while it is throttled or
+  /// while its connection is still busy sending. The oldest publications get
+  /// dropped beyond this, so a value of zero or one keeps only the newest.
+  std::size_t queue_length = 0;
+
+  /// Publications get sent as the fields that changed since the previous
+  /// publication to the same subscriber, with a full publication (a keyframe)
+  /// every this many publications. A value of zero means that every
+  /// publication is sent in full.
+  std::size_t delta_keyframes = 0;
+};
+
+//==============================================================================
+/// The parts of the publications of one topic that stay the same from one
+/// message to the next, rendered once by the encoding when the topic is first
+/// used. Each encoding fills it in with whatever it needs.
+class PublicationEnvelope
+{
+public:
+
+  virtual ~PublicationEnvelope() = default;
+
+};
+
+using PublicationEnvelopePtr = std::shared_ptr<const PublicationEnvelope>;
+
 //==============================================================================
 class Encoding
 {
 public:
 
+  /// \brief True if the messages of this encoding must be sent as binary
+  /// websocket frames rather than text frames.
+  virtual bool binary() const { return false; }
+
   virtual void interpret_websocket_msg(
       const std::string& msg,
       Endpoint& endpoint,
       std::shared_ptr<void> connection_handle) const = 0;
 
+  /// \param[in] precision
+  ///   The most significant digits that floating point values should be
+  ///   written with. A precision of zero means that they are written exactly.
+  virtual std::string encode_publication_msg(
+      const std::string& topic_name,
+      const std::string& topic_type,
+      const std::string& id,
+      const soss::Message& msg,
+      int precision) const = 0;
+
+  /// \brief Render the envelope of the publications of a topic, so that
+  /// encode_publication_msg(envelope, ~) only has to serialize the message
+  /// itself. Encodings that cannot do this return nullptr, and their
+  /// publications go through the other encode_publication_msg(~).
+  virtual PublicationEnvelopePtr make_publication_envelope(
+      const std::string& /*topic_name*/) const
+  {
+    return nullptr;
+  }
+
+  /// \brief Encode a publication that has no id into an envelope that was
+  /// made by make_publication_envelope(~) of this same encoding.
   virtual std::string encode_publication_msg(
+      const PublicationEnvelope& envelope,
+      const soss::Message& msg,
+      int precision) const = 0;
+
+  /// \brief Encode a publication that only holds the fields which changed
+  /// since the previous publication that was sent to the same subscriber.
+  /// Nested messages in the changes only hold their own fields which changed,
+  /// so the receiver must merge them into its copy of the message.
+  virtual std::string encode_delta_publication_msg(
       const std::string& topic_name,
       const std::string& topic_type,
       const std::string& id,
-      const soss::Message& msg) const = 0;
+      const soss::Message& changes,
+      int precision) const = 0;
 
   virtual std::string encode_service_response_msg(
       const std::string& service_name,
@@ -71,6 +151,15 @@ public:
       const std::string& id,
       const YAML::Node& configuration) const = 0;
 
+  /// \brief Encode one piece of a message that is too large to be sent at
+  /// once. The receiver will join the data of every fragment with the same id,
+  /// in the order of num, and then interpret the result as a whole message.
+  virtual std::string encode_fragment_msg(
+      const std::string& id,
+      const std::string& data,
+      std::size_t num,
+      std::size_t total) const = 0;
+
   virtual std::string encode_advertise_service_msg(
       const std::string& service_name,
       const std::string& service_type,
@@ -83,6 +172,16 @@ using EncodingPtr = std::shared_ptr<Encoding>;
 //==============================================================================
 EncodingPtr make_rosbridge_v2_0();
 
+//==============================================================================
+/// The rosbridge v2.0 protocol, with every message serialized into CBOR
+/// instead of JSON text and sent as a binary frame.
+EncodingPtr make_rosbridge_v2_0_cbor();
+
+//==============================================================================
+/// The rosbridge v2.0 protocol, with every message serialized into MessagePack
+/// instead of JSON text and sent as a binary frame.
+EncodingPtr make_rosbridge_v2_0_msgpack();
+
 } // namespace websocket
 } // namespace soss
 
@@ -17,7 +17,13 @@
 
 #include "Endpoint.hpp"
 
+#include <soss/ThreadSettings.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
 #include <cstdlib>
+#include <limits>
 
 namespace soss {
 namespace websocket {
@@ -28,7 +34,12 @@ struct CallHandle
   std::string service_name;
   std::string service_type;
   std::string id;
+  TransferOptions options;
   std::shared_ptr<void> connection_handle;
+
+  // Whether the request counts against the service call limit of its
+  // connection until it has been answered
+  bool counted = false;
 };
 
 //==============================================================================
@@ -36,18 +47,147 @@ inline std::shared_ptr<CallHandle> make_call_handle(
     std::string service_name,
     std::string service_type,
     std::string id,
+    const TransferOptions& options,
     std::shared_ptr<void> connection_handle)
 {
   return std::make_shared<CallHandle>(
     CallHandle{std::move(service_name),
                std::move(service_type),
                std::move(id),
-               std::move(connection_handle)});
+               options,
+               std::move(connection_handle),
+               false});
+}
+
+//==============================================================================
+/// Parse the id that a remote connection sent back with a service response.
+/// \returns false if it is not one of the ids that we hand out.
+inline bool parse_service_call_id(const std::string& text, uint64_t& id)
+{
+  if(text.empty())
+    return false;
+
+  uint64_t value = 0;
+  for(const char c : text)
+  {
+    if(c < '0' || '9' < c)
+      return false;
+
+    const uint64_t digit = static_cast<uint64_t>(c - '0');
+    if(value > (std::numeric_limits<uint64_t>::max() - digit) / 10)
+      return false;
+
+    value = 10*value + digit;
+  }
+
+  id = value;
+  return true;
 }
 
+//==============================================================================
+/// Collect the fields of a message that differ from an earlier publication of
+/// the same topic. Nested messages only contribute their own fields which
+/// changed, and fields that cannot be compared always count as changed.
+/// \returns false if the message has to be sent in full instead, because it
+/// only carries its native representation.
+inline bool diff_message(
+    const soss::Message& base,
+    const soss::Message& current,
+    soss::Message& changes)
+{
+  if(current.data.empty() && current.native)
+    return false;
+
+  changes.type = current.type;
+  for(const auto& field : current.data)
+  {
+    const auto it = base.data.find(field.first);
+    if(it != base.data.end())
+    {
+      if(field.second.equals(it->second))
+        continue;
+
+      const soss::Message* const nested = field.second.cast<soss::Message>();
+      const soss::Message* const base_nested = it->second.cast<soss::Message>();
+      if(nested && base_nested)
+      {
+        soss::Message nested_changes;
+        if(!diff_message(*base_nested, *nested, nested_changes))
+          return false;
+
+        if(!nested_changes.data.empty())
+        {
+          changes.data.emplace(
+                field.first,
+                soss::make_field<soss::Message>(std::move(nested_changes)));
+        }
+
+        continue;
+      }
+    }
+
+    changes.data.emplace(field.first, field.second);
+  }
+
+  return true;
+}
+
+//==============================================================================
+/// Fragmented messages with more pieces than this are rejected, so that a
+/// misbehaving peer cannot make us reserve an absurd amount of memory.
+const std::size_t MaxFragments = 1 << 16;
+
+/// The most memory that the incomplete fragmented messages of one connection
+/// may hold on to
+const std::size_t MaxFragmentBytes = 64*1024*1024;
+
+/// The most fragmented messages that one connection may have in progress
+const std::size_t MaxFragmentedMessages = 64;
+
+/// Fragmented messages that are still incomplete after this long are dropped,
+/// since their missing pieces are not going to arrive anymore
+const std::chrono::seconds FragmentTimeout(30);
+
+//==============================================================================
+/// How often we check whether a congested connection has finished sending, so
+/// that the newest of its pending publications can be sent.
+const std::chrono::milliseconds CongestionPollPeriod(10);
+
+//==============================================================================
+/// We stop handing messages to websocketpp once this many bytes are waiting
+/// in its send buffer. The rest wait in the outbox of the connection, where a
+/// publication of a higher priority can still overtake them.
+const std::size_t OutboxWatermark = 256*1024;
+
+//==============================================================================
+/// How often we check whether a connection has room for the messages that are
+/// waiting in its outbox
+const std::chrono::milliseconds OutboxPollPeriod(2);
+
+//==============================================================================
+/// Makes the names of the connection metrics unique
+std::atomic_size_t next_outbox_id(1);
+
+//==============================================================================
+/// How long we wait for the response to a service request before forgetting
+/// about it. Responses are allowed to arrive after the provider reconnects,
+/// but requests whose provider has gone away for good must not pile up.
+const std::chrono::minutes ServiceRequestExpiry(5);
+
+//==============================================================================
+/// Topics may limit the significant digits of their floating point values
+const std::string YamlPrecisionKey = "precision";
+
+//==============================================================================
+/// Topics may be put in a priority class, e.g. so that control commands are
+/// not held up by bulk data
+const std::string YamlPriorityKey = "priority";
+
 //==============================================================================
 Endpoint::Endpoint()
-  : _next_service_call_id(1)
+  : _topic_publish_info(std::make_shared<TopicPublishMap>()),
+    _cbor_encoding(make_rosbridge_v2_0_cbor()),
+    _next_fragment_id(1)
 {
   // Do nothing
 }
@@ -71,17 +211,28 @@ bool Endpoint::configure(
     {
       _encoding = make_rosbridge_v2_0();
     }
+    else if(encoding_str == YamlEncoding_Rosbridge_v2_0_Cbor)
+    {
+      _encoding = make_rosbridge_v2_0_cbor();
+    }
+    else if(encoding_str == YamlEncoding_Rosbridge_v2_0_MessagePack)
+    {
+      _encoding = make_rosbridge_v2_0_msgpack();
+    }
     else
     {
       std::cerr << "[soss::websocket::SystemHnadle::configure] Unknown "
-                << "encoding type was requested: [" << _encoding
+                << "encoding type was requested: [" << encoding_str
                 << "]" << std::endl;
       return false;
     }
+
+    _encoding_name = encoding_str;
   }
   else
   {
     _encoding = make_rosbridge_v2_0();
+    _encoding_name = YamlEncoding_Rosbridge_v2_0;
   }
 
   if(!_encoding)
@@ -92,9 +243,305 @@ bool Endpoint::configure(
     return false;
   }
 
-  _endpoint = configure_endpoint(types, configuration);
+  if(!parse_slow_consumer(configuration, _slow_consumer))
+    return false;
+
+  if(!parse_inbound(configuration, _inbound))
+    return false;
+
+  if(!parse_workers(configuration, _workers))
+    return false;
+
+  if(!parse_batching(configuration, _batching))
+    return false;
+
+  if(const YAML::Node timeout_node = configuration[YamlShutdownTimeoutKey])
+  {
+    const double timeout = timeout_node.as<double>(-1.0);
+    if(timeout < 0.0)
+    {
+      std::cerr << "[soss::websocket::SystemHandle::configure] The ["
+                << YamlShutdownTimeoutKey << "] must be a number of seconds "
+                << "that is not negative, but it was given ["
+                << timeout_node.as<std::string>("") << "]" << std::endl;
+      return false;
+    }
+
+    _shutdown_timeout = std::chrono::milliseconds(
+          static_cast<long long>(timeout*1000.0));
+  }
+
+  // The workers decode whatever arrives, so incoming messages must wait in
+  // the inboxes for them
+  if(_workers.count > 0)
+    _inbound.enabled = true;
+
+  if(!configure_endpoint(types, configuration))
+    return false;
+
+  const std::size_t worker_count =
+      std::max<std::size_t>(_workers.count, _inbound.enabled? 1 : 0);
+  for(std::size_t i=0; i < worker_count; ++i)
+  {
+    _worker_threads.emplace_back([this]()
+    {
+      ThreadSettings().apply("soss-ws-worker");
+      this->_worker_loop();
+    });
+  }
+
+  return true;
+}
+
+//==============================================================================
+Endpoint::~Endpoint()
+{
+  stop_workers();
+}
+
+//==============================================================================
+void Endpoint::receive_message_ws(
+    const WsCppMessagePtr& message,
+    const std::shared_ptr<void>& connection_handle)
+{
+  if(!_inbound.enabled)
+  {
+    _interpret(message->get_payload(), connection_handle);
+    return;
+  }
+
+  std::shared_ptr<Inbox> inbox;
+  {
+    std::unique_lock<std::mutex> lock(_worker_mutex);
+    if(_workers_stopped)
+      return;
+
+    std::shared_ptr<Inbox>& entry = _inboxes[connection_handle];
+    if(!entry)
+    {
+      entry = std::make_shared<Inbox>();
+      entry->connection_handle = connection_handle;
+    }
+
+    inbox = entry;
+  }
+
+  std::unique_lock<std::mutex> inbox_lock(inbox->mutex);
+  inbox->bytes += message->get_payload().size();
+  inbox->messages.push_back(message);
+
+  // The pause is requested while holding the lock of the inbox, so that it
+  // cannot be overtaken by the worker resuming the connection
+  if(!inbox->paused
+     && (inbox->bytes > _inbound.max_bytes
+         || inbox->messages.size() > _inbound.max_messages
+         || soss::Metrics::over_memory_budget()))
+  {
+    inbox->paused = true;
+    set_reading(connection_handle, false);
+  }
+
+  if(inbox->scheduled)
+    return;
+
+  inbox->scheduled = true;
+  inbox_lock.unlock();
+
+  {
+    std::unique_lock<std::mutex> lock(_worker_mutex);
+    _ready_inboxes.push_back(std::move(inbox));
+  }
+  _worker_cv.notify_one();
+}
+
+//==============================================================================
+void Endpoint::_interpret(
+    const std::string& payload,
+    const std::shared_ptr<void>& connection_handle)
+{
+  // Anything that gets published from this message came into soss now,
+  // before it was decoded
+  const soss::Ingress::Scope ingress;
+  get_encoding().interpret_websocket_msg(payload, *this, connection_handle);
+}
+
+//==============================================================================
+bool Endpoint::_interpret_next(Inbox& inbox)
+{
+  std::unique_lock<std::mutex> inbox_lock(inbox.mutex);
+  if(!inbox.open || inbox.messages.empty())
+  {
+    inbox.scheduled = false;
+    return false;
+  }
+
+  const WsCppMessagePtr message = std::move(inbox.messages.front());
+  inbox.messages.pop_front();
+  inbox.bytes -= message->get_payload().size();
+
+  // Resume once the inbox has drained to half of its limits, so that a
+  // connection does not flip between paused and reading on every message
+  if(inbox.paused
+     && inbox.bytes <= _inbound.max_bytes/2
+     && inbox.messages.size() <= _inbound.max_messages/2)
+  {
+    inbox.paused = false;
+    set_reading(inbox.connection_handle, true);
+  }
+
+  inbox.interpreting = true;
+  inbox_lock.unlock();
+
+  _interpret(message->get_payload(), inbox.connection_handle);
+
+  inbox_lock.lock();
+  inbox.interpreting = false;
+  const bool more = inbox.open && !inbox.messages.empty();
+  inbox.scheduled = more;
+  inbox_lock.unlock();
+  inbox.interpreted.notify_all();
+
+  return more;
+}
+
+//==============================================================================
+void Endpoint::_queue_encode(
+    const std::string& topic,
+    const std::shared_ptr<TopicPublishInfo>& info,
+    std::shared_ptr<const soss::Message> message)
+{
+  std::unique_lock<std::mutex> encode_lock(info->encode_mutex);
+  if(info->encode_queue.size() >= std::max<std::size_t>(
+       1, _workers.queue_length))
+  {
+    info->encode_queue.pop_front();
+    if(info->metrics)
+      info->metrics->count_drop();
+  }
+
+  info->encode_queue.push_back(std::move(message));
+  if(info->encode_scheduled)
+    return;
+
+  info->encode_scheduled = true;
+  encode_lock.unlock();
+
+  {
+    std::unique_lock<std::mutex> lock(_worker_mutex);
+    if(_workers_stopped)
+      return;
+
+    _ready_topics.emplace_back(topic, info);
+  }
+  _worker_cv.notify_one();
+}
+
+//==============================================================================
+bool Endpoint::_encode_next(const std::string& topic, TopicPublishInfo& info)
+{
+  std::shared_ptr<const soss::Message> message;
+  {
+    std::unique_lock<std::mutex> encode_lock(info.encode_mutex);
+    if(info.encode_queue.empty())
+    {
+      info.encode_scheduled = false;
+      return false;
+    }
+
+    message = std::move(info.encode_queue.front());
+    info.encode_queue.pop_front();
+  }
+
+  // The listeners are loaded now rather than when the publication was queued,
+  // so that listeners which went away in the meantime are skipped
+  const auto listeners = std::atomic_load(&info.listeners);
+  if(!listeners->empty())
+  {
+    _send_publication(
+          topic, info, *listeners,
+          _encode_publication(topic, info, *message), *message);
+  }
+  else if(info.hold_limit > 0)
+  {
+    _hold(topic, info, message);
+  }
+
+  std::unique_lock<std::mutex> encode_lock(info.encode_mutex);
+  const bool more = !info.encode_queue.empty();
+  info.encode_scheduled = more;
+  return more;
+}
+
+//==============================================================================
+void Endpoint::_worker_loop()
+{
+  // Take turns between decoding and encoding while both have work waiting, so
+  // that neither can starve the other
+  bool inbound_turn = true;
+
+  std::unique_lock<std::mutex> lock(_worker_mutex);
+  while(true)
+  {
+    _worker_cv.wait(lock, [&]()
+    {
+      return _workers_stopped
+          || !_ready_inboxes.empty() || !_ready_topics.empty();
+    });
+
+    if(_workers_stopped)
+      return;
+
+    const bool inbound =
+        !_ready_inboxes.empty() && (inbound_turn || _ready_topics.empty());
+    inbound_turn = !inbound;
+
+    // Whatever still has messages waiting goes to the back of the line, so
+    // that a busy connection or topic cannot keep the others waiting
+    if(inbound)
+    {
+      const std::shared_ptr<Inbox> inbox = std::move(_ready_inboxes.front());
+      _ready_inboxes.pop_front();
+      lock.unlock();
+
+      const bool more = _interpret_next(*inbox);
+
+      lock.lock();
+      if(more)
+        _ready_inboxes.push_back(inbox);
+    }
+    else
+    {
+      const auto topic = std::move(_ready_topics.front());
+      _ready_topics.pop_front();
+      lock.unlock();
+
+      const bool more = _encode_next(topic.first, *topic.second);
+
+      lock.lock();
+      if(more)
+        _ready_topics.push_back(topic);
+    }
+  }
+}
+
+//==============================================================================
+void Endpoint::stop_workers()
+{
+  {
+    std::unique_lock<std::mutex> lock(_worker_mutex);
+    _workers_stopped = true;
+    _ready_inboxes.clear();
+    _ready_topics.clear();
+    _inboxes.clear();
+  }
+  _worker_cv.notify_all();
 
-  return static_cast<bool>(_endpoint);
+  for(std::thread& thread : _worker_threads)
+  {
+    if(thread.joinable())
+      thread.join();
+  }
+  _worker_threads.clear();
 }
 
 //==============================================================================
@@ -104,9 +551,13 @@ bool Endpoint::subscribe(
     SubscriptionCallback callback,
     const YAML::Node& configuration)
 {
-  _startup_messages.emplace_back(
-        _encoding->encode_subscribe_msg(
-          topic_name, message_type, "", configuration));
+  {
+    std::unique_lock<std::mutex> lock(_listener_mutex);
+    _add_startup_message(
+          topic_name,
+          _encoding->encode_subscribe_msg(
+            topic_name, message_type, "", configuration));
+  }
 
   TopicSubscribeInfo& info = _topic_subscribe_info[topic_name];
   info.type = message_type;
@@ -159,10 +610,64 @@ void Endpoint::startup_advertisement(
     const std::string& id,
     const YAML::Node& configuration)
 {
-  TopicPublishInfo& info = _topic_publish_info[topic];
+  std::unique_lock<std::mutex> lock(_listener_mutex);
+  TopicPublishInfo& info = _add_publish_info(topic);
   info.type = message_type;
+  info.metrics = &soss::Metrics::topic(topic);
+
+  if(const YAML::Node precision = configuration[YamlPrecisionKey])
+  {
+    const int value = precision.as<int>();
+    if(value < 0)
+    {
+      std::cerr << "[soss::websocket] The [" << YamlPrecisionKey << "] of "
+                << "the topic [" << topic << "] must not be negative, but it "
+                << "is [" << value << "]. Its values will be sent exactly."
+                << std::endl;
+    }
+    else
+    {
+      info.precision = value;
+    }
+  }
+
+  info.hold_limit = _reconnect_buffer;
+  if(const YAML::Node buffer = configuration[YamlReconnectBufferKey])
+  {
+    const int64_t value = buffer.as<int64_t>();
+    if(value < 0)
+    {
+      std::cerr << "[soss::websocket] The [" << YamlReconnectBufferKey
+                << "] of the topic [" << topic << "] must not be negative, "
+                << "but it is [" << value << "]. The default of ["
+                << _reconnect_buffer << "] will be used." << std::endl;
+    }
+    else
+    {
+      info.hold_limit = static_cast<std::size_t>(value);
+    }
+  }
+
+  if(const YAML::Node priority = configuration[YamlPriorityKey])
+  {
+    const std::string value = priority.as<std::string>("");
+    if(value == "high")
+      info.priority = HighPriority;
+    else if(value == "normal")
+      info.priority = NormalPriority;
+    else if(value == "low")
+      info.priority = LowPriority;
+    else
+    {
+      std::cerr << "[soss::websocket] The [" << YamlPriorityKey << "] of the "
+                << "topic [" << topic << "] must be [high], [normal] or [low], "
+                << "but it is [" << value << "]. It will be sent with normal "
+                << "priority." << std::endl;
+    }
+  }
 
-  _startup_messages.emplace_back(
+  _add_startup_message(
+        topic,
         _encoding->encode_advertise_msg(
           topic, message_type, id, configuration));
 }
@@ -172,91 +677,301 @@ bool Endpoint::publish(
     const std::string& topic,
     const soss::Message& message)
 {
-  const TopicPublishInfo& info = _topic_publish_info.at(topic);
+  const std::shared_ptr<TopicPublishInfo> info = _get_publish_info(topic);
+  const auto listeners = std::atomic_load(&info->listeners);
 
   // If no one is listening, then don't bother publishing
-  if(info.listeners.empty())
-    return true;
-
-  for(const auto& v_handle : info.listeners)
+  if(listeners->empty())
   {
-    auto connection_handle = _endpoint->get_con_from_hdl(v_handle.first);
+    if(info->hold_limit > 0)
+      _hold(topic, *info, std::make_shared<const soss::Message>(message));
 
-    auto ec = connection_handle->send(
-          _encoding->encode_publication_msg(topic, info.type, "", message));
+    return true;
+  }
 
-    if(ec)
-    {
-      std::cerr << "[soss::websocket::Endpoint] Failed to send publication on "
-                << "topic [" << topic << "]: " << ec.message() << std::endl;
-    }
+  if(info->has_held)
+    _release_held(topic, *info, *listeners);
+
+  if(_workers.count > 0)
+  {
+    _queue_encode(topic, info, std::make_shared<const soss::Message>(message));
+    return true;
   }
 
+  _send_publication(
+        topic, *info, *listeners,
+        _encode_publication(topic, *info, message), message);
+
   return true;
 }
 
 //==============================================================================
-void Endpoint::call_service(
-    const std::string& service,
-    const soss::Message& request,
-    ServiceClient& client,
-    std::shared_ptr<void> call_handle)
+bool Endpoint::publish(
+    const std::string& topic,
+    const soss::MessageEnvelope& envelope)
 {
-  const std::size_t id = _next_service_call_id++;
-  const std::string id_str = std::to_string(id);
-  _service_request_info[id_str] = {&client, std::move(call_handle)};
+  const std::shared_ptr<TopicPublishInfo> info = _get_publish_info(topic);
+  const auto listeners = std::atomic_load(&info->listeners);
 
-  ServiceProviderInfo& provider_info = _service_provider_info.at(service);
+  // If no one is listening, then don't bother publishing
+  if(listeners->empty())
+  {
+    if(info->hold_limit > 0)
+      _hold(topic, *info, envelope.retain());
 
-  const std::string payload = _encoding->encode_call_service_msg(
-        service, provider_info.type, request,
-        id_str, provider_info.configuration);
+    return true;
+  }
 
-  _endpoint->get_con_from_hdl(provider_info.connection_handle)->send(payload);
-}
+  if(info->has_held)
+    _release_held(topic, *info, *listeners);
 
-//==============================================================================
-void Endpoint::receive_response(
-    std::shared_ptr<void> v_call_handle,
-    const soss::Message& response)
-{
-  const auto& call_handle =
-      *static_cast<const CallHandle*>(v_call_handle.get());
+  // The workers encode the publication later, so it cannot be shared with
+  // the other systems that publish the same envelope
+  if(_workers.count > 0)
+  {
+    _queue_encode(topic, info, envelope.retain());
+    return true;
+  }
 
-  auto connection_handle = _endpoint->get_con_from_hdl(
-        call_handle.connection_handle);
+  // The topic name and type are part of the publication, so the cached
+  // encoding is only valid for other publications of the exact same topic.
+  const std::shared_ptr<const std::string> payload =
+      envelope.encoding<std::string>(
+        "websocket/" + _encoding_name + "/" + info->type + "/" + topic,
+        [&](const soss::Message& message)
+  {
+    return std::make_shared<const std::string>(
+          _encode_publication(topic, *info, message));
+  });
 
-  connection_handle->send(
-        _encoding->encode_service_response_msg(
-          call_handle.service_name,
-          call_handle.service_type,
-          call_handle.id,
-          response, true));
+  _send_publication(topic, *info, *listeners, *payload, envelope.message());
+  return true;
 }
 
 //==============================================================================
-void Endpoint::receive_topic_advertisement_ws(
-    const std::string& topic_name,
-    const std::string& message_type,
+bool Endpoint::publish_batch(
+    const std::string& topic,
+    const std::vector<std::shared_ptr<const soss::Message>>& messages)
+{
+  const std::shared_ptr<TopicPublishInfo> info = _get_publish_info(topic);
+  const auto listeners = std::atomic_load(&info->listeners);
+
+  // If no one is listening, then don't bother publishing
+  if(listeners->empty())
+  {
+    if(info->hold_limit > 0)
+    {
+      for(const std::shared_ptr<const soss::Message>& message : messages)
+        _hold(topic, *info, message);
+    }
+
+    return true;
+  }
+
+  if(info->has_held)
+    _release_held(topic, *info, *listeners);
+
+  if(_workers.count > 0)
+  {
+    for(const std::shared_ptr<const soss::Message>& message : messages)
+      _queue_encode(topic, info, message);
+
+    return true;
+  }
+
+  for(const std::shared_ptr<const soss::Message>& message : messages)
+  {
+    _send_publication(
+          topic, *info, *listeners,
+          _encode_publication(topic, *info, *message), *message);
+  }
+
+  return true;
+}
+
+//==============================================================================
+void Endpoint::call_service(
+    const std::string& service,
+    const soss::Message& request,
+    ServiceClient& client,
+    std::shared_ptr<void> call_handle)
+{
+  uint64_t id = 0;
+  ServiceProviderInfo provider_info;
+  std::vector<ServiceRequestInfo> expired;
+  {
+    std::unique_lock<std::mutex> lock(_state_mutex);
+    const auto provider = _service_provider_info.find(service);
+    if(provider == _service_provider_info.end()
+       || !provider->second.connection_handle)
+    {
+      lock.unlock();
+
+      // In a cluster, the process whose client provides the service will
+      // answer the request, so we must stay out of its way.
+      if(!clustered())
+      {
+        client.receive_error(
+              call_handle, "No websocket client provides the service ["
+              + service + "]");
+      }
+
+      return;
+    }
+
+    provider_info = provider->second;
+
+    const auto now = std::chrono::steady_clock::now();
+    _expire_service_requests(now, expired);
+
+    uint32_t index = 0;
+    if(_free_service_requests.empty())
+    {
+      index = static_cast<uint32_t>(_service_requests.size());
+      _service_requests.emplace_back();
+    }
+    else
+    {
+      index = _free_service_requests.back();
+      _free_service_requests.pop_back();
+    }
+
+    ServiceRequestSlot& slot = _service_requests[index];
+    ++slot.generation;
+    slot.in_use = true;
+    slot.info = ServiceRequestInfo{&client, std::move(call_handle)};
+
+    id = (static_cast<uint64_t>(slot.generation) << 32) | index;
+    _service_request_ids[slot.info.call_handle.get()] = id;
+    _service_request_expiry.emplace_back(now + ServiceRequestExpiry, id);
+  }
+
+  _fail_service_requests(expired);
+
+  const std::string id_str = std::to_string(id);
+
+  const std::string payload = _encoding->encode_call_service_msg(
+        service, provider_info.type, request,
+        id_str, provider_info.configuration);
+
+  send_payload(provider_info.connection_handle, payload);
+}
+
+//==============================================================================
+void Endpoint::receive_response(
+    std::shared_ptr<void> v_call_handle,
+    const soss::Message& response)
+{
+  _send_service_response(v_call_handle, response, true);
+}
+
+//==============================================================================
+void Endpoint::receive_error(
+    std::shared_ptr<void> v_call_handle,
+    const std::string& error)
+{
+  // rosbridge clients get the values of a failed response handed to their
+  // error callback, so we describe what went wrong in there.
+  soss::Message failure;
+  failure.data["error"] = soss::make_field<std::string>(error);
+  _send_service_response(v_call_handle, failure, false);
+}
+
+//==============================================================================
+void Endpoint::cancel_service_call(const std::shared_ptr<void>& call_handle)
+{
+  std::unique_lock<std::mutex> lock(_state_mutex);
+  const auto it = _service_request_ids.find(call_handle.get());
+  if(it == _service_request_ids.end())
+    return;
+
+  ServiceRequestInfo info{nullptr, nullptr};
+  _release_service_request(it->second, info);
+}
+
+//==============================================================================
+void Endpoint::_send_service_response(
+    const std::shared_ptr<void>& v_call_handle,
+    const soss::Message& response,
+    const bool result)
+{
+  const auto& call_handle =
+      *static_cast<const CallHandle*>(v_call_handle.get());
+
+  if(call_handle.counted)
+  {
+    std::unique_lock<std::mutex> lock(_state_mutex);
+    const auto index = _connection_index.find(call_handle.connection_handle);
+    if(index != _connection_index.end() && index->second.service_calls > 0)
+      --index->second.service_calls;
+  }
+
+  if(call_handle.options.cbor && !_encoding->binary())
+  {
+    send_message(
+          call_handle.connection_handle,
+          _make_message(
+            _cbor_encoding->encode_service_response_msg(
+              call_handle.service_name,
+              call_handle.service_type,
+              call_handle.id,
+              response, result),
+            websocketpp::frame::opcode::binary));
+    return;
+  }
+
+  _send(call_handle.connection_handle,
+        _encoding->encode_service_response_msg(
+          call_handle.service_name,
+          call_handle.service_type,
+          call_handle.id,
+          response, result),
+        call_handle.options);
+}
+
+//==============================================================================
+void Endpoint::receive_topic_advertisement_ws(
+    const std::string& topic_name,
+    const std::string& message_type,
     const std::string& /*id*/,
     std::shared_ptr<void> connection_handle)
 {
+  std::unique_lock<std::mutex> lock(_state_mutex);
   auto it = _topic_subscribe_info.find(topic_name);
   if(it != _topic_subscribe_info.end())
   {
     TopicSubscribeInfo& info = it->second;
+    const auto blacklist = std::atomic_load(&info.blacklist);
     if(message_type != info.type)
     {
-      info.blacklist.insert(connection_handle);
+      auto updated = std::make_shared<TopicSubscribeInfo::Blacklist>(
+            *blacklist);
+      updated->insert(connection_handle);
+      std::atomic_store(
+            &info.blacklist,
+            std::shared_ptr<const TopicSubscribeInfo::Blacklist>(
+              std::move(updated)));
+
+      _connection_index[connection_handle].blacklisted_topics.insert(
+            topic_name);
       std::cerr << "[soss::websocket] A remote connection advertised a topic "
                 << "we want to subscribe to [" << topic_name << "] but with "
                 << "the wrong message type [" << message_type << "]. The "
                 << "expected type is [" << info.type << "]. Messages from "
                 << "this connection will be ignored." << std::endl;
     }
-    else
+    else if(blacklist->count(connection_handle) > 0)
     {
-      info.blacklist.erase(connection_handle);
+      auto updated = std::make_shared<TopicSubscribeInfo::Blacklist>(
+            *blacklist);
+      updated->erase(connection_handle);
+      std::atomic_store(
+            &info.blacklist,
+            std::shared_ptr<const TopicSubscribeInfo::Blacklist>(
+              std::move(updated)));
+
+      _connection_index[connection_handle].blacklisted_topics.erase(
+            topic_name);
     }
   }
 }
@@ -273,18 +988,23 @@ void Endpoint::receive_topic_unadvertisement_ws(
 //==============================================================================
 void Endpoint::receive_publication_ws(
     const std::string& topic_name,
-    const soss::Message& message,
+    soss::Message&& message,
     std::shared_ptr<void> connection_handle)
 {
   auto it = _topic_subscribe_info.find(topic_name);
   if(it == _topic_subscribe_info.end())
     return;
 
+  // The topics that we subscribe to are only added while configuring, and
+  // their blacklists are immutable snapshots, so none of this needs a lock.
   TopicSubscribeInfo& info = it->second;
-  if(info.blacklist.count(connection_handle) > 0)
+  if(std::atomic_load(&info.blacklist)->count(connection_handle) > 0)
     return;
 
-  info.callback(message);
+  // The callbacks are only assigned while configuring, so we can call them
+  // without holding the lock. The message was decoded just for this call, so
+  // the route may take it over.
+  info.callback(std::move(message));
 }
 
 //==============================================================================
@@ -292,12 +1012,12 @@ void Endpoint::receive_subscribe_request_ws(
     const std::string& topic_name,
     const std::string& message_type,
     const std::string& id,
+    const TransferOptions& options,
     std::shared_ptr<void> connection_handle)
 {
-  auto insertion = _topic_publish_info.insert(
-        std::make_pair(topic_name, TopicPublishInfo{}));
-  const bool inserted = insertion.second;
-  TopicPublishInfo& info = insertion.first->second;
+  std::unique_lock<std::mutex> lock(_listener_mutex);
+  const bool inserted = _topic_publish_info->count(topic_name) == 0;
+  TopicPublishInfo& info = _add_publish_info(topic_name);
 
   if(inserted)
   {
@@ -317,7 +1037,40 @@ void Endpoint::receive_subscribe_request_ws(
     }
   }
 
-  info.listeners[connection_handle].insert(id);
+  _listened_topics[connection_handle].insert(topic_name);
+
+  const auto listeners = std::atomic_load(&info.listeners);
+  const auto lit = listeners->find(connection_handle);
+  if(lit != listeners->end())
+  {
+    Listener& listener = *lit->second;
+    std::unique_lock<std::mutex> listener_lock(listener.mutex);
+    listener.ids.insert(id);
+    listener.options = options;
+
+    // Every subscription starts with a full publication
+    listener.delta_base.reset();
+    return;
+  }
+
+  const auto listener = std::make_shared<Listener>();
+  listener->ids.insert(id);
+  listener->options = options;
+
+  listener->outbox = _get_outbox(connection_handle);
+
+  auto updated = std::make_shared<TopicPublishInfo::ListenerMap>(*listeners);
+  updated->emplace(connection_handle, listener);
+  std::shared_ptr<const TopicPublishInfo::ListenerMap> snapshot =
+      std::move(updated);
+  std::atomic_store(&info.listeners, snapshot);
+
+  // Catch the new listener up on what was published while the topic was
+  // waiting for its connection to come back. The info of a topic lives as
+  // long as the endpoint, so it is safe to use after unlocking.
+  lock.unlock();
+  if(info.has_held)
+    _release_held(topic_name, info, *snapshot);
 }
 
 //==============================================================================
@@ -326,8 +1079,9 @@ void Endpoint::receive_unsubscribe_request_ws(
     const std::string& id,
     std::shared_ptr<void> connection_handle)
 {
-  auto it = _topic_publish_info.find(topic_name);
-  if(it == _topic_publish_info.end())
+  std::unique_lock<std::mutex> lock(_listener_mutex);
+  auto it = _topic_publish_info->find(topic_name);
+  if(it == _topic_publish_info->end())
   {
     std::cerr << "[soss::websocket] Received an unsubscription request for a "
               << "topic that we are not advertising [" << topic_name << "]"
@@ -335,28 +1089,34 @@ void Endpoint::receive_unsubscribe_request_ws(
     return;
   }
 
-  TopicPublishInfo& info = it->second;
-  auto lit = info.listeners.find(connection_handle);
+  TopicPublishInfo& info = *it->second;
+  const auto listeners = std::atomic_load(&info.listeners);
+  auto lit = listeners->find(connection_handle);
 
-  if(lit == info.listeners.end())
+  if(lit == listeners->end())
     return;
 
-  if(id.empty())
+  if(!id.empty())
   {
-    // If id is empty, then we should erase this connection as a listener
-    // entirely.
-    info.listeners.erase(lit);
-    return;
+    Listener& listener = *lit->second;
+    std::unique_lock<std::mutex> listener_lock(listener.mutex);
+    listener.ids.erase(id);
+
+    // The connection keeps listening as long as any of its ids are left
+    if(!listener.ids.empty())
+      return;
   }
 
-  std::unordered_set<std::string>& listeners = lit->second;
-  listeners.erase(id);
+  // If id is empty, or no more unique ids are listening from this connection,
+  // then we should erase this connection as a listener entirely.
+  _remove_listener(info, connection_handle);
 
-  if(listeners.empty())
+  const auto topics = _listened_topics.find(connection_handle);
+  if(topics != _listened_topics.end())
   {
-    // If no more unique ids are listening from this connection, then
-    // erase it entirely.
-    info.listeners.erase(lit);
+    topics->second.erase(topic_name);
+    if(topics->second.empty())
+      _listened_topics.erase(topics);
   }
 }
 
@@ -365,9 +1125,9 @@ void Endpoint::receive_service_request_ws(
     const std::string& service_name,
     const soss::Message& request,
     const std::string& id,
+    const TransferOptions& options,
     std::shared_ptr<void> connection_handle)
 {
-
   auto it = _client_proxy_info.find(service_name);
   if(it == _client_proxy_info.end())
   {
@@ -378,9 +1138,156 @@ void Endpoint::receive_service_request_ws(
   }
 
   ClientProxyInfo& info = it->second;
-  info.callback(request, *this,
-                make_call_handle(service_name, info.type,
-                                 id, connection_handle));
+  const std::shared_ptr<CallHandle> call_handle =
+      make_call_handle(service_name, info.type, id, options, connection_handle);
+
+  if(_max_service_calls > 0)
+  {
+    std::unique_lock<std::mutex> lock(_state_mutex);
+    std::size_t& calls = _connection_index[connection_handle].service_calls;
+    if(calls >= _max_service_calls)
+    {
+      lock.unlock();
+      if(_throttled)
+        _throttled->count_drop();
+
+      receive_error(
+            call_handle, "Too many service requests are already waiting for "
+            "a response on this connection");
+      return;
+    }
+
+    ++calls;
+    call_handle->counted = true;
+  }
+
+  info.callback(request, *this, call_handle);
+}
+
+//==============================================================================
+void Endpoint::receive_fragment_ws(
+    const std::string& id,
+    const std::string& data,
+    const std::size_t num,
+    const std::size_t total,
+    std::shared_ptr<void> connection_handle)
+{
+  if(total == 0 || total > MaxFragments || num >= total)
+  {
+    std::cerr << "[soss::websocket] Received an invalid fragment [" << num
+              << "/" << total << "] of the message [" << id << "]"
+              << std::endl;
+    return;
+  }
+
+  const auto now = std::chrono::steady_clock::now();
+  std::size_t dropped = 0;
+  std::string whole;
+  bool complete = false;
+  bool over_limit = false;
+  {
+    std::unique_lock<std::mutex> lock(_state_mutex);
+    FragmentBuffers& buffers = _fragment_buffers[connection_handle];
+    const auto drop = [&](
+        const std::unordered_map<std::string, FragmentBuffer>::iterator it)
+    {
+      buffers.bytes -= it->second.bytes;
+      ++dropped;
+      return buffers.messages.erase(it);
+    };
+
+    for(auto it = buffers.messages.begin(); it != buffers.messages.end();)
+    {
+      if(now - it->second.started > FragmentTimeout)
+        it = drop(it);
+      else
+        ++it;
+    }
+
+    auto it = buffers.messages.find(id);
+    if(it != buffers.messages.end() && it->second.pieces.size() != total)
+    {
+      // The peer has reused the id for a new message, so we start over
+      drop(it);
+      it = buffers.messages.end();
+    }
+
+    if(it == buffers.messages.end())
+    {
+      // The table of pieces is counted too, since a peer could otherwise
+      // announce many large messages without sending any of their data
+      const std::size_t table = total*(sizeof(std::string) + 1);
+      if(buffers.messages.size() >= MaxFragmentedMessages
+         || buffers.bytes + table > MaxFragmentBytes)
+      {
+        ++dropped;
+        over_limit = true;
+      }
+      else
+      {
+        it = buffers.messages.emplace(id, FragmentBuffer()).first;
+        FragmentBuffer& buffer = it->second;
+        buffer.pieces.assign(total, std::string());
+        buffer.arrived.assign(total, false);
+        buffer.bytes = table;
+        buffer.started = now;
+        buffers.bytes += table;
+      }
+    }
+
+    if(!over_limit)
+    {
+      FragmentBuffer& buffer = it->second;
+      std::string& piece = buffer.pieces[num];
+      if(buffers.bytes - piece.size() + data.size() > MaxFragmentBytes)
+      {
+        drop(it);
+        over_limit = true;
+      }
+      else
+      {
+        buffers.bytes = buffers.bytes - piece.size() + data.size();
+        buffer.bytes = buffer.bytes - piece.size() + data.size();
+        piece = data;
+
+        if(!buffer.arrived[num])
+        {
+          buffer.arrived[num] = true;
+          ++buffer.received;
+        }
+
+        if(buffer.received == total)
+        {
+          for(const std::string& p : buffer.pieces)
+            whole += p;
+
+          buffers.bytes -= buffer.bytes;
+          buffers.messages.erase(it);
+          complete = true;
+        }
+      }
+    }
+
+    if(buffers.messages.empty())
+      _fragment_buffers.erase(connection_handle);
+  }
+
+  if(dropped > 0 && _dropped_fragments)
+  {
+    for(std::size_t i=0; i < dropped; ++i)
+      _dropped_fragments->count_drop();
+  }
+
+  if(over_limit && !_warned_fragments.exchange(true))
+  {
+    std::cerr << "[soss::websocket] Dropped the fragmented message [" << id
+              << "], because its connection has too many fragmented messages "
+              << "in progress, or they hold more than [" << MaxFragmentBytes
+              << "] bytes. Further drops are only counted." << std::endl;
+  }
+
+  if(complete)
+    _encoding->interpret_websocket_msg(whole, *this, connection_handle);
 }
 
 //==============================================================================
@@ -389,8 +1296,27 @@ void Endpoint::receive_service_advertisement_ws(
     const std::string& service_type,
     std::shared_ptr<void> connection_handle)
 {
-  _service_provider_info[service_name] =
-      ServiceProviderInfo{service_type, connection_handle, YAML::Node{}};
+  std::unique_lock<std::mutex> lock(_state_mutex);
+  ServiceProviderInfo& info = _service_provider_info[service_name];
+
+  // A peer that we reach over several connections may advertise its services
+  // on each of them, but they should be called over the connection that is
+  // meant for them
+  if(info.connection_handle && info.connection_handle != connection_handle
+     && !carries(connection_handle, "")
+     && carries(info.connection_handle, ""))
+    return;
+
+  // The service may be moving over from another connection
+  if(info.connection_handle && info.connection_handle != connection_handle)
+  {
+    const auto previous = _connection_index.find(info.connection_handle);
+    if(previous != _connection_index.end())
+      previous->second.provided_services.erase(service_name);
+  }
+
+  info = ServiceProviderInfo{service_type, connection_handle, YAML::Node{}};
+  _connection_index[connection_handle].provided_services.insert(service_name);
 }
 
 //==============================================================================
@@ -399,12 +1325,19 @@ void Endpoint::receive_service_unadvertisement_ws(
     const std::string& /*service_type*/,
     std::shared_ptr<void> connection_handle)
 {
+  std::unique_lock<std::mutex> lock(_state_mutex);
   auto it = _service_provider_info.find(service_name);
   if(it == _service_provider_info.end())
     return;
 
   if(it->second.connection_handle == connection_handle)
+  {
     _service_provider_info.erase(it);
+
+    const auto index = _connection_index.find(connection_handle);
+    if(index != _connection_index.end())
+      index->second.provided_services.erase(service_name);
+  }
 }
 
 //==============================================================================
@@ -414,22 +1347,26 @@ void Endpoint::receive_service_response_ws(
     const std::string& id,
     std::shared_ptr<void> /*connection_handle*/)
 {
-  auto it = _service_request_info.find(id);
-  if(it == _service_request_info.end())
-  {
-    std::cerr << "[soss::websocket] A remote connection provided a service "
-              << "response with an unrecognized id [" << id << "]"
-              << std::endl;
-    return;
-  }
-
   // TODO(MXG): We could use the service_name and connection_handle info to
   // verify that the service response is coming from the source that we were
   // expecting.
-  ServiceRequestInfo& info = it->second;
-  info.client->receive_response(info.call_handle, response);
+  // The id stays in _service_request_expiry until its time runs out, and is
+  // simply skipped then.
+  uint64_t call_id = 0;
+  ServiceRequestInfo info{nullptr, nullptr};
+  {
+    std::unique_lock<std::mutex> lock(_state_mutex);
+    if(!parse_service_call_id(id, call_id)
+       || !_release_service_request(call_id, info))
+    {
+      std::cerr << "[soss::websocket] A remote connection provided a service "
+                << "response with an unrecognized id [" << id << "]"
+                << std::endl;
+      return;
+    }
+  }
 
-  _service_request_info.erase(it);
+  info.client->receive_response(info.call_handle, response);
 }
 
 //==============================================================================
@@ -439,64 +1376,1583 @@ const Encoding& Endpoint::get_encoding() const
 }
 
 //==============================================================================
-void Endpoint::notify_connection_opened(
-    const WsCppConnectionPtr& connection_handle)
+std::string Endpoint::_encode_publication(
+    const std::string& topic,
+    const TopicPublishInfo& info,
+    const soss::Message& message) const
 {
-  for(const std::string& msg : _startup_messages)
-    connection_handle->send(msg);
+  const auto start = std::chrono::steady_clock::now();
+  SOSS_TRACE(encode_begin, topic.c_str(), &message);
+  std::string payload = info.envelope?
+        _encoding->encode_publication_msg(
+          *info.envelope, message, info.precision)
+      : _encoding->encode_publication_msg(
+          topic, info.type, "", message, info.precision);
+  SOSS_TRACE(encode_end, topic.c_str(), &message);
+
+  if(info.metrics)
+    info.metrics->record_conversion(std::chrono::steady_clock::now() - start);
+
+  return payload;
 }
 
 //==============================================================================
-void Endpoint::notify_connection_closed(
-    const std::shared_ptr<void>& connection_handle)
+websocketpp::frame::opcode::value Endpoint::get_opcode() const
+{
+  return _encoding->binary()?
+        websocketpp::frame::opcode::binary : websocketpp::frame::opcode::text;
+}
+
+//==============================================================================
+void Endpoint::_send_publication(
+    const std::string& topic,
+    const TopicPublishInfo& info,
+    const TopicPublishInfo::ListenerMap& listeners,
+    const std::string& payload,
+    const soss::Message& message)
 {
-  for(auto& entry : _topic_subscribe_info)
-    entry.second.blacklist.erase(connection_handle);
+  // Build the websocket message once and hand the same buffer to every
+  // listener instead of having each connection copy the payload by itself.
+  // Listeners that asked for a different representation get one that is also
+  // only created once for all of them.
+  WsCppMessagePtr shared_message;
+  WsCppMessagePtr cbor_message;
+  std::unordered_map<std::size_t, std::vector<WsCppMessagePtr>> fragments;
+
+  // Listeners that asked for deltas usually share the same base, so each
+  // delta only gets computed and encoded once. They all keep this copy of the
+  // message as the base of their next delta.
+  std::shared_ptr<const soss::Message> delta_base;
+  std::map<std::pair<const soss::Message*, bool>, WsCppMessagePtr> deltas;
+
+  std::size_t sent = 0;
+  for(const auto& entry : listeners)
+  {
+    Listener& listener = *entry.second;
+    std::unique_lock<std::mutex> listener_lock(listener.mutex);
+
+    // The listener went away after we took our snapshot of the listeners
+    if(!listener.active)
+      continue;
+
+    const TransferOptions& options = listener.options;
+
+    WsCppMessagePtr delta;
+    if(options.delta_keyframes > 0)
+    {
+      if(!delta_base)
+        delta_base = std::make_shared<const soss::Message>(message);
+
+      // The outbox dropped a publication that the peer needed to apply the
+      // deltas after it, so whatever still waits for the listener is useless
+      if(listener.keyframe_needed->exchange(false))
+      {
+        _drop_pending(info, listener);
+        listener.delta_base.reset();
+      }
+
+      delta = _delta_publication(topic, info, listener, message, deltas);
+      listener.deltas_since_keyframe =
+          delta? listener.deltas_since_keyframe + 1 : 0;
+      listener.delta_base = delta_base;
+    }
+
+    std::vector<WsCppMessagePtr> outgoing;
+    if(delta)
+    {
+      outgoing.push_back(std::move(delta));
+    }
+    else if(options.cbor && !_encoding->binary())
+    {
+      if(!cbor_message)
+      {
+        const std::string cbor_payload =
+            _cbor_encoding->encode_publication_msg(
+              topic, info.type, "", message, info.precision);
+
+        cbor_message = _make_message(
+              cbor_payload, websocketpp::frame::opcode::binary);
+      }
+
+      outgoing.push_back(cbor_message);
+    }
+    else if(options.fragment_size > 0 && !_encoding->binary()
+            && payload.size() > options.fragment_size)
+    {
+      std::vector<WsCppMessagePtr>& pieces = fragments[options.fragment_size];
+      if(pieces.empty())
+      {
+        for(const std::string& piece
+            : _fragment(payload, options.fragment_size))
+          pieces.push_back(_make_shared_message(piece));
+      }
+
+      outgoing = pieces;
+    }
+    else
+    {
+      if(!shared_message)
+        shared_message = _make_shared_message(payload);
+
+      outgoing.push_back(shared_message);
+    }
+
+    sent += _deliver(
+          topic, info, entry.first, listener, std::move(outgoing));
+  }
+
+  if(info.metrics)
+    info.metrics->count_bytes(sent);
+}
 
-  for(auto& entry : _topic_publish_info)
-    entry.second.listeners.erase(connection_handle);
+//==============================================================================
+WsCppMessagePtr Endpoint::_delta_publication(
+    const std::string& topic,
+    const TopicPublishInfo& info,
+    Listener& listener,
+    const soss::Message& message,
+    std::map<std::pair<const soss::Message*, bool>, WsCppMessagePtr>& deltas)
+{
+  const TransferOptions& options = listener.options;
 
-  std::vector<std::string> lost_services;
-  lost_services.reserve(_service_provider_info.size());
-  for(auto& entry : _service_provider_info)
+  // A delta would be dropped if the listener has as many publications waiting
+  // as it may hold, which would leave the listener unable to apply the deltas
+  // after it. Replace the waiting publications with a keyframe instead.
+  const std::size_t capacity = std::max<std::size_t>(1, options.queue_length);
+  if(listener.pending.size() >= capacity)
   {
-    if(entry.second.connection_handle == connection_handle)
-      lost_services.push_back(entry.first);
+    _drop_pending(info, listener);
+    return nullptr;
   }
 
-  for(const std::string& s : lost_services)
-    _service_provider_info.erase(s);
+  if(!listener.delta_base
+     || listener.deltas_since_keyframe + 1 >= options.delta_keyframes)
+    return nullptr;
 
-  // NOTE(MXG): We'll leave _service_request_info alone, because it's feasible
-  // that the service response might arrive later after the other side has
-  // reconnected. The downside is this could allow lost services to accumulate.
+  const bool cbor = options.cbor && !_encoding->binary();
+  const auto inserted = deltas.insert(
+        std::make_pair(
+          std::make_pair(listener.delta_base.get(), cbor), nullptr));
+  if(!inserted.second)
+    return inserted.first->second;
+
+  soss::Message changes;
+  if(!diff_message(*listener.delta_base, message, changes))
+    return nullptr;
+
+  const Encoding& encoding = cbor? *_cbor_encoding : *_encoding;
+  const std::string payload = encoding.encode_delta_publication_msg(
+        topic, info.type, "", changes, info.precision);
+
+  inserted.first->second = cbor?
+        _make_message(payload, websocketpp::frame::opcode::binary)
+      : _make_shared_message(payload);
+
+  return inserted.first->second;
 }
 
 //==============================================================================
-int32_t parse_port(const YAML::Node& configuration)
+void Endpoint::_drop_pending(const TopicPublishInfo& info, Listener& listener)
 {
-  if(const YAML::Node port_node = configuration[YamlPortKey])
+  if(info.metrics)
   {
-    try
-    {
-      return port_node.as<int>();
-    }
-    catch(const YAML::InvalidNode& v)
-    {
-      std::cerr << "[soss::websocket::SystemHandle::configure] Could not "
-                << "parse an integer value for the port setting ["
-                << port_node.as<std::string>("") << "]: "
-                << v.what() << std::endl;
-    }
+    for(std::size_t i=0; i < listener.pending.size(); ++i)
+      info.metrics->count_drop();
   }
-  else
+
+  listener.pending.clear();
+}
+
+//==============================================================================
+std::size_t Endpoint::_deliver(
+    const std::string& topic,
+    const TopicPublishInfo& info,
+    const std::shared_ptr<void>& connection_handle,
+    Listener& listener,
+    std::vector<WsCppMessagePtr> publication)
+{
+  const TransferOptions& options = listener.options;
+  const auto now = std::chrono::steady_clock::now();
+  const auto next_allowed = listener.last_sent + options.throttle_rate;
+
+  const bool throttled =
+      options.throttle_rate.count() > 0 && now < next_allowed;
+  const bool congested = _is_congested(listener, info.priority);
+
+  if(listener.pending.empty() && !throttled && !congested)
+    return _send_now(info, listener, publication);
+
+  // The listener cannot take this publication yet, so it has to wait. Only the
+  // newest publications are worth keeping, because a slow subscriber would
+  // otherwise fall further and further behind the source.
+  listener.pending.emplace_back(std::move(publication));
+  const std::size_t capacity = std::max<std::size_t>(1, options.queue_length);
+  while(listener.pending.size() > capacity)
   {
-    std::cerr << "[soss::websocket::SystemHandle::configure] You must specify "
-              << "a port setting in your soss-websocket configuration!"
-              << std::endl;
+    listener.pending.pop_front();
+    if(info.metrics)
+      info.metrics->count_drop();
   }
 
-  return -1;
+  if(!listener.flush_scheduled)
+  {
+    _schedule_flush(
+          topic, connection_handle, listener,
+          throttled?
+            std::chrono::duration_cast<std::chrono::milliseconds>(
+              next_allowed - now)
+            : CongestionPollPeriod);
+  }
+
+  return 0;
+}
+
+//==============================================================================
+void Endpoint::_flush_listener(
+    const std::string& topic,
+    const std::weak_ptr<void>& connection_handle)
+{
+  // The connection may have closed or unsubscribed while the timer was waiting
+  const std::shared_ptr<void> handle = connection_handle.lock();
+  if(!handle)
+    return;
+
+  const auto topics = std::atomic_load(&_topic_publish_info);
+  const auto it = topics->find(topic);
+  if(it == topics->end())
+    return;
+
+  const TopicPublishInfo& info = *it->second;
+  const auto listeners = std::atomic_load(&info.listeners);
+  const auto lit = listeners->find(handle);
+  if(lit == listeners->end())
+    return;
+
+  Listener& listener = *lit->second;
+  std::unique_lock<std::mutex> lock(listener.mutex);
+  if(!listener.active)
+    return;
+
+  listener.flush_scheduled = false;
+  if(listener.pending.empty())
+    return;
+
+  // The waiting deltas cannot be applied anymore, so they make way for a
+  // keyframe with the next publication
+  if(listener.keyframe_needed->exchange(false))
+  {
+    _drop_pending(info, listener);
+    listener.delta_base.reset();
+    return;
+  }
+
+  const TransferOptions& options = listener.options;
+  const auto now = std::chrono::steady_clock::now();
+  const auto next_allowed = listener.last_sent + options.throttle_rate;
+
+  if(options.throttle_rate.count() > 0 && now < next_allowed)
+  {
+    _schedule_flush(
+          topic, handle, listener,
+          std::chrono::duration_cast<std::chrono::milliseconds>(
+            next_allowed - now));
+    return;
+  }
+
+  if(_is_congested(listener, info.priority))
+  {
+    _schedule_flush(topic, handle, listener, CongestionPollPeriod);
+    return;
+  }
+
+  const std::vector<WsCppMessagePtr> publication =
+      std::move(listener.pending.front());
+  listener.pending.pop_front();
+
+  const std::size_t sent = _send_now(info, listener, publication);
+  if(info.metrics)
+    info.metrics->count_bytes(sent);
+
+  if(!listener.pending.empty())
+  {
+    _schedule_flush(
+          topic, handle, listener,
+          options.throttle_rate.count() > 0?
+            options.throttle_rate : CongestionPollPeriod);
+  }
+}
+
+//==============================================================================
+void Endpoint::_schedule_flush(
+    const std::string& topic,
+    const std::shared_ptr<void>& connection_handle,
+    Listener& listener,
+    const std::chrono::milliseconds delay)
+{
+  listener.flush_scheduled = true;
+
+  // The timer only holds a weak reference, so that it does not keep a closed
+  // connection alive.
+  const std::weak_ptr<void> weak_handle = connection_handle;
+  set_timer(
+        delay,
+        [this, topic, weak_handle](const websocketpp::lib::error_code& ec)
+  {
+    // The timer gets cancelled when the endpoint shuts down
+    if(ec)
+      return;
+
+    _flush_listener(topic, weak_handle);
+  });
+}
+
+//==============================================================================
+std::size_t Endpoint::_send_now(
+    const TopicPublishInfo& info,
+    Listener& listener,
+    const std::vector<WsCppMessagePtr>& publication)
+{
+  Outbox& outbox = *listener.outbox;
+  std::size_t sent = 0;
+  {
+    std::unique_lock<std::mutex> lock(outbox.mutex);
+
+    // The connection closed after we took our snapshot of the listeners
+    if(!outbox.open)
+      return 0;
+
+    // All the fragments of a publication get queued at once, so that they stay
+    // in order while more urgent publications get sent in between them.
+    for(const WsCppMessagePtr& message : publication)
+      sent += message->get_payload().size();
+
+    if(_batching.enabled)
+      _track_batch(outbox, sent);
+
+    outbox.lanes[info.priority].push_back(Outbox::Entry{&info, publication});
+    if(listener.options.delta_keyframes > 0)
+      outbox.lanes[info.priority].back().keyframe_needed =
+          listener.keyframe_needed;
+
+    outbox.queued_messages += publication.size();
+    outbox.queued_bytes += sent;
+  }
+
+  listener.last_sent = std::chrono::steady_clock::now();
+  _pump(listener.outbox);
+  return sent;
+}
+
+//==============================================================================
+bool Endpoint::_is_congested(const Listener& listener, const Priority priority)
+{
+  Outbox& outbox = *listener.outbox;
+  std::unique_lock<std::mutex> lock(outbox.mutex);
+  if(outbox.paused)
+    return true;
+
+  // Messages that are only held back to be batched do not hold it up either
+  if(outbox.batching)
+    return false;
+
+  // Lanes of a lower priority do not hold this listener up
+  for(std::size_t p = priority; p < NumPriorities; ++p)
+  {
+    if(!outbox.lanes[p].empty())
+      return true;
+  }
+
+  return false;
+}
+
+//==============================================================================
+std::shared_ptr<Endpoint::Outbox> Endpoint::_get_outbox(
+    const std::shared_ptr<void>& connection_handle)
+{
+  std::shared_ptr<Outbox>& outbox = _outboxes[connection_handle];
+  if(!outbox)
+  {
+    outbox = std::make_shared<Outbox>();
+    outbox->connection_handle = connection_handle;
+
+    // Resolve the connection once here instead of for every message
+    outbox->connection = resolve_connection(connection_handle);
+
+    // Several connections may come from the same peer over time, so the
+    // metrics of each one get a name of their own
+    outbox->name = (outbox->connection?
+          outbox->connection->remote_endpoint() : std::string("unresolved"))
+        + "#" + std::to_string(next_outbox_id++);
+    outbox->metrics = &soss::Metrics::connection(outbox->name);
+  }
+
+  return outbox;
+}
+
+//==============================================================================
+void Endpoint::_pump(const std::shared_ptr<Outbox>& outbox_ptr)
+{
+  Outbox& outbox = *outbox_ptr;
+  std::unique_lock<std::mutex> lock(outbox.mutex);
+  if(!outbox.open)
+    return;
+
+  if(_batching.enabled && !outbox.paused)
+  {
+    const std::chrono::milliseconds delay = _batch_delay(outbox);
+    outbox.batching = delay.count() > 0;
+    if(outbox.batching)
+    {
+      if(!outbox.pump_scheduled)
+        _schedule_pump(outbox_ptr, delay);
+
+      return;
+    }
+  }
+
+  std::size_t buffered = _get_buffered_amount(outbox);
+  while(buffered <= OutboxWatermark)
+  {
+    std::deque<Outbox::Entry>* lane = nullptr;
+    for(std::size_t p = NumPriorities; p > 0; --p)
+    {
+      if(!outbox.lanes[p-1].empty())
+      {
+        lane = &outbox.lanes[p-1];
+        break;
+      }
+    }
+
+    if(!lane)
+      break;
+
+    Outbox::Entry& entry = lane->front();
+    const WsCppMessagePtr message = entry.messages[entry.sent++];
+    if(entry.sent == entry.messages.size())
+      lane->pop_front();
+
+    outbox.queued_messages -= 1;
+    outbox.queued_bytes -= message->get_payload().size();
+
+    SOSS_TRACE(websocket_send, outbox.name.c_str(),
+               message->get_payload().size());
+    const auto ec = outbox.connection?
+          outbox.connection->send(message)
+        : send_message(outbox.connection_handle.lock(), message);
+    if(ec)
+    {
+      // The rest of the messages would fail the same way
+      std::cerr << "[soss::websocket::Endpoint] Failed to send a "
+                << "publication: " << ec.message() << std::endl;
+      for(auto& waiting : outbox.lanes)
+        waiting.clear();
+
+      outbox.queued_messages = 0;
+      outbox.queued_bytes = 0;
+      break;
+    }
+
+    outbox.metrics->count_bytes(message->get_payload().size());
+    buffered = _get_buffered_amount(outbox);
+  }
+
+  if(outbox.paused && outbox.queued_messages == 0
+     && buffered <= OutboxWatermark)
+  {
+    std::cerr << "[soss::websocket] The connection [" << outbox.name
+              << "] has caught up, so its subscriptions are resumed"
+              << std::endl;
+    outbox.paused = false;
+  }
+
+  // When soss as a whole is over its memory budget, every connection that
+  // still has publications waiting sheds its load, whatever its own limits
+  bool disconnect = false;
+  if(buffered + outbox.queued_bytes > _slow_consumer.max_bytes
+     || outbox.queued_messages > _slow_consumer.max_messages
+     || (outbox.queued_messages > 0 && soss::Metrics::over_memory_budget()))
+    disconnect = _shed_load(outbox, buffered);
+
+  outbox.metrics->set_queue_depth(outbox.queued_messages);
+  outbox.metrics->set_buffered_bytes(buffered + outbox.queued_bytes);
+
+  if(disconnect)
+  {
+    const ResolvedConnectionPtr connection = outbox.connection;
+    outbox.open = false;
+    for(auto& lane : outbox.lanes)
+      lane.clear();
+
+    lock.unlock();
+
+    // websocketpp tells us once the connection is closed, and then the outbox
+    // gets cleaned up
+    const auto ec = connection->close(
+          _slow_consumer.close_code, "slow consumer");
+    if(ec)
+    {
+      std::cerr << "[soss::websocket] Failed to close the slow connection: "
+                << ec.message() << std::endl;
+    }
+    return;
+  }
+
+  // A paused connection gets checked until it catches up
+  const bool idle = outbox.queued_messages == 0;
+  if(outbox.pump_scheduled || (idle && !outbox.paused))
+    return;
+
+  _schedule_pump(outbox_ptr, idle? CongestionPollPeriod : OutboxPollPeriod);
+}
+
+//==============================================================================
+void Endpoint::_schedule_pump(
+    const std::shared_ptr<Outbox>& outbox_ptr,
+    const std::chrono::milliseconds delay)
+{
+  // The timer only holds a weak reference, so that it does not keep the
+  // outbox of a closed connection alive.
+  outbox_ptr->pump_scheduled = true;
+  const std::weak_ptr<Outbox> weak_outbox = outbox_ptr;
+  set_timer(
+        delay,
+        [this, weak_outbox](const websocketpp::lib::error_code& ec)
+  {
+    // The timer gets cancelled when the endpoint shuts down
+    if(ec)
+      return;
+
+    const std::shared_ptr<Outbox> outbox = weak_outbox.lock();
+    if(!outbox)
+      return;
+
+    {
+      std::unique_lock<std::mutex> lock(outbox->mutex);
+      outbox->pump_scheduled = false;
+    }
+
+    _pump(outbox);
+  });
+}
+
+//==============================================================================
+void Endpoint::_track_batch(Outbox& outbox, const std::size_t bytes)
+{
+  // The averages follow the last eight or so publications, so that the batch
+  // window shrinks soon after the load gets lighter
+  const double weight = 1.0/8.0;
+
+  const auto now = std::chrono::steady_clock::now();
+  if(outbox.queued_messages == 0)
+    outbox.batch_start = now;
+
+  if(outbox.last_queued != std::chrono::steady_clock::time_point())
+  {
+    const double interval =
+        std::chrono::duration<double>(now - outbox.last_queued).count();
+    outbox.mean_interval = outbox.mean_interval < 0.0? interval
+        : outbox.mean_interval + weight*(interval - outbox.mean_interval);
+  }
+
+  outbox.mean_size += weight*(static_cast<double>(bytes) - outbox.mean_size);
+  outbox.last_queued = now;
+}
+
+//==============================================================================
+std::chrono::milliseconds Endpoint::_batch_delay(const Outbox& outbox) const
+{
+  const std::chrono::milliseconds now_please(0);
+  if(outbox.queued_messages == 0
+     || outbox.queued_bytes >= _batching.max_bytes
+     || !outbox.lanes[HighPriority].empty())
+    return now_please;
+
+  // When publications arrive further apart than the longest delay, hardly
+  // anything would join the batch, so holding it back would only add latency
+  const double max_delay =
+      std::chrono::duration<double>(_batching.max_delay).count();
+  if(outbox.mean_interval < 0.0 || outbox.mean_interval >= max_delay)
+    return now_please;
+
+  // Otherwise wait no longer than the batch is expected to take to fill up
+  const double remaining_bytes =
+      static_cast<double>(_batching.max_bytes - outbox.queued_bytes);
+  const double fill_time =
+      remaining_bytes / std::max(1.0, outbox.mean_size) * outbox.mean_interval;
+  const double window = std::min(max_delay, fill_time);
+
+  const double waited = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - outbox.batch_start).count();
+  if(waited >= window)
+    return now_please;
+
+  return std::chrono::milliseconds(
+        static_cast<long long>(std::ceil((window - waited)*1000.0)));
+}
+
+//==============================================================================
+bool Endpoint::_shed_load(Outbox& outbox, const std::size_t buffered)
+{
+  const auto over_limits = [&]()
+  {
+    return buffered + outbox.queued_bytes > _slow_consumer.max_bytes
+        || outbox.queued_messages > _slow_consumer.max_messages;
+  };
+
+  // A connection that is within its own limits only gets its older
+  // publications dropped when soss runs over its memory budget
+  if(_slow_consumer.policy == SlowConsumerLimits::Disconnect && over_limits())
+  {
+    std::cerr << "[soss::websocket] The connection [" << outbox.name << "] "
+              << "has [" << buffered + outbox.queued_bytes << "] bytes in ["
+              << outbox.queued_messages << "] messages waiting, which is over "
+              << "its limits, so it will be closed" << std::endl;
+    return outbox.connection != nullptr;
+  }
+
+  // Publications that have been partly sent are kept, because otherwise the
+  // remote peer would be left with a fragmented message that never completes.
+  const auto started = [](const Outbox::Entry& entry)
+  {
+    return entry.sent > 0;
+  };
+
+  if(_slow_consumer.policy == SlowConsumerLimits::Pause)
+  {
+    if(!outbox.paused)
+    {
+      std::cerr << "[soss::websocket] The connection [" << outbox.name << "] "
+                << "is over its limits, so its subscriptions are paused until "
+                << "it catches up" << std::endl;
+    }
+
+    for(auto& lane : outbox.lanes)
+    {
+      for(Outbox::Entry& entry : lane)
+      {
+        if(!started(entry))
+          _drop_entry(outbox, entry);
+      }
+
+      _erase_dropped(outbox, lane);
+    }
+
+    outbox.paused = true;
+    return false;
+  }
+
+  // Only the newest publication of each topic is worth keeping
+  std::unordered_set<const TopicPublishInfo*> newest;
+  for(auto& lane : outbox.lanes)
+  {
+    for(auto it = lane.rbegin(); it != lane.rend(); ++it)
+    {
+      if(!newest.insert(it->topic).second && !started(*it))
+        _drop_entry(outbox, *it);
+    }
+
+    _erase_dropped(outbox, lane);
+  }
+
+  // If that is not enough, the oldest publications of the lowest priority go
+  for(auto& lane : outbox.lanes)
+  {
+    for(Outbox::Entry& entry : lane)
+    {
+      if(!over_limits())
+        break;
+
+      if(!started(entry))
+        _drop_entry(outbox, entry);
+    }
+
+    _erase_dropped(outbox, lane);
+  }
+
+  return false;
+}
+
+//==============================================================================
+void Endpoint::_drop_entry(Outbox& outbox, Outbox::Entry& entry)
+{
+  for(const WsCppMessagePtr& message : entry.messages)
+    outbox.queued_bytes -= message->get_payload().size();
+
+  outbox.queued_messages -= entry.messages.size();
+  outbox.metrics->count_drop();
+  if(entry.topic->metrics)
+    entry.topic->metrics->count_drop();
+
+  entry.messages.clear();
+  if(entry.keyframe_needed)
+    entry.keyframe_needed->store(true);
+}
+
+//==============================================================================
+void Endpoint::_erase_dropped(Outbox& outbox, std::deque<Outbox::Entry>& lane)
+{
+  // The entries of a topic that wait behind one of its dropped entries are
+  // deltas, or the keyframes that they build on, of the same listener
+  std::unordered_set<const TopicPublishInfo*> broken;
+  for(Outbox::Entry& entry : lane)
+  {
+    if(entry.messages.empty())
+    {
+      if(entry.keyframe_needed)
+        broken.insert(entry.topic);
+    }
+    else if(broken.count(entry.topic) > 0 && entry.sent == 0)
+    {
+      _drop_entry(outbox, entry);
+    }
+  }
+
+  lane.erase(
+        std::remove_if(lane.begin(), lane.end(),
+                       [](const Outbox::Entry& e) { return e.messages.empty(); }),
+        lane.end());
+}
+
+//==============================================================================
+void Endpoint::expect_close(const std::shared_ptr<void>& connection_handle)
+{
+  std::unique_lock<std::mutex> lock(_closes_mutex);
+  _expected_closes.insert(connection_handle);
+}
+
+//==============================================================================
+void Endpoint::close_finished(const std::shared_ptr<void>& connection_handle)
+{
+  {
+    std::unique_lock<std::mutex> lock(_closes_mutex);
+    if(_expected_closes.erase(connection_handle) == 0
+       || !_expected_closes.empty())
+      return;
+  }
+
+  _all_closed.notify_all();
+}
+
+//==============================================================================
+bool Endpoint::wait_for_closes()
+{
+  std::unique_lock<std::mutex> lock(_closes_mutex);
+  const bool closed = _all_closed.wait_for(
+        lock, _shutdown_timeout, [&]() { return _expected_closes.empty(); });
+
+  // Whatever did not close in time is not waited for again
+  _expected_closes.clear();
+  return closed;
+}
+
+//==============================================================================
+void Endpoint::set_reconnect_buffer(const std::size_t limit)
+{
+  _reconnect_buffer = limit;
+}
+
+//==============================================================================
+void Endpoint::set_max_service_calls(
+    const std::size_t limit,
+    soss::ChannelMetrics& throttled)
+{
+  _max_service_calls = limit;
+  _throttled = &throttled;
+}
+
+//==============================================================================
+void Endpoint::set_fragment_metrics(soss::ChannelMetrics& dropped)
+{
+  _dropped_fragments = &dropped;
+}
+
+//==============================================================================
+void Endpoint::_hold(
+    const std::string& topic,
+    TopicPublishInfo& info,
+    std::shared_ptr<const soss::Message> message)
+{
+  std::unique_lock<std::mutex> lock(info.held_mutex);
+  if(!awaiting_connection(topic))
+  {
+    info.held.clear();
+    info.has_held = false;
+    return;
+  }
+
+  info.held.push_back(std::move(message));
+  while(info.held.size() > info.hold_limit)
+  {
+    info.held.pop_front();
+    if(info.metrics)
+      info.metrics->count_drop();
+  }
+
+  info.has_held = true;
+}
+
+//==============================================================================
+void Endpoint::_release_held(
+    const std::string& topic,
+    TopicPublishInfo& info,
+    const TopicPublishInfo::ListenerMap& listeners)
+{
+  std::deque<std::shared_ptr<const soss::Message>> held;
+  {
+    std::unique_lock<std::mutex> lock(info.held_mutex);
+    held.swap(info.held);
+    info.has_held = false;
+  }
+
+  // The held publications go through the workers too, so that nothing that
+  // gets published after them can overtake them
+  if(_workers.count > 0)
+  {
+    const std::shared_ptr<TopicPublishInfo> shared_info =
+        _get_publish_info(topic);
+
+    for(std::shared_ptr<const soss::Message>& message : held)
+      _queue_encode(topic, shared_info, std::move(message));
+
+    return;
+  }
+
+  for(const std::shared_ptr<const soss::Message>& message : held)
+  {
+    _send_publication(
+          topic, info, listeners,
+          _encode_publication(topic, info, *message), *message);
+  }
+}
+
+//==============================================================================
+std::shared_ptr<Endpoint::TopicPublishInfo> Endpoint::_get_publish_info(
+    const std::string& topic) const
+{
+  return std::atomic_load(&_topic_publish_info)->at(topic);
+}
+
+//==============================================================================
+Endpoint::TopicPublishInfo& Endpoint::_add_publish_info(
+    const std::string& topic)
+{
+  const auto it = _topic_publish_info->find(topic);
+  if(it != _topic_publish_info->end())
+    return *it->second;
+
+  auto updated = std::make_shared<TopicPublishMap>(*_topic_publish_info);
+  const auto info = std::make_shared<TopicPublishInfo>();
+  info->envelope = _encoding->make_publication_envelope(topic);
+  updated->emplace(topic, info);
+  std::atomic_store(
+        &_topic_publish_info,
+        std::shared_ptr<const TopicPublishMap>(std::move(updated)));
+
+  return *info;
+}
+
+//==============================================================================
+void Endpoint::_remove_listener(
+    TopicPublishInfo& info,
+    const std::shared_ptr<void>& connection_handle)
+{
+  const auto listeners = std::atomic_load(&info.listeners);
+  const auto lit = listeners->find(connection_handle);
+  if(lit == listeners->end())
+    return;
+
+  {
+    // Publishers that still hold the old snapshot will skip this listener
+    Listener& listener = *lit->second;
+    std::unique_lock<std::mutex> listener_lock(listener.mutex);
+    listener.active = false;
+    listener.pending.clear();
+  }
+
+  auto updated = std::make_shared<TopicPublishInfo::ListenerMap>(*listeners);
+  updated->erase(connection_handle);
+  std::atomic_store(
+        &info.listeners,
+        std::shared_ptr<const TopicPublishInfo::ListenerMap>(
+          std::move(updated)));
+}
+
+//==============================================================================
+std::size_t Endpoint::_get_buffered_amount(Outbox& outbox)
+{
+  if(outbox.connection)
+    return outbox.connection->get_buffered_amount();
+
+  const std::shared_ptr<void> handle = outbox.connection_handle.lock();
+  return handle? get_buffered_amount(handle) : 0;
+}
+
+//==============================================================================
+void Endpoint::_send(
+    const std::shared_ptr<void>& connection_handle,
+    const std::string& payload,
+    const TransferOptions& options)
+{
+  if(options.fragment_size == 0 || _encoding->binary()
+     || payload.size() <= options.fragment_size)
+  {
+    send_payload(connection_handle, payload);
+    return;
+  }
+
+  for(const std::string& piece : _fragment(payload, options.fragment_size))
+    send_payload(connection_handle, piece);
+}
+
+//==============================================================================
+websocketpp::lib::error_code Endpoint::send_payload(
+    const std::shared_ptr<void>& connection_handle,
+    const std::string& payload)
+{
+  return send_message(connection_handle, _make_message(payload, get_opcode()));
+}
+
+//==============================================================================
+void Endpoint::broadcast_payload(
+    const std::vector<std::shared_ptr<void>>& connection_handles,
+    const std::string& payload)
+{
+  if(connection_handles.empty())
+    return;
+
+  const WsCppMessagePtr message = _make_shared_message(payload);
+  for(const std::shared_ptr<void>& connection_handle : connection_handles)
+    send_message(connection_handle, message);
+}
+
+//==============================================================================
+std::vector<std::string> Endpoint::_fragment(
+    const std::string& payload,
+    const std::size_t fragment_size)
+{
+  // Find the split points first, so that we know the total number of fragments
+  // before we encode any of them.
+  std::vector<std::size_t> splits;
+  std::size_t begin = 0;
+  while(begin < payload.size())
+  {
+    std::size_t end = std::min(begin + fragment_size, payload.size());
+
+    // Never split a multi-byte UTF-8 character, because each fragment needs
+    // to be valid text on its own. Continuation bytes look like 0b10xxxxxx.
+    while(end < payload.size() && end > begin + 1
+          && (static_cast<unsigned char>(payload[end]) & 0xC0) == 0x80)
+      --end;
+
+    splits.push_back(end);
+    begin = end;
+  }
+
+  const std::string id = "fragment_" + std::to_string(_next_fragment_id++);
+
+  std::vector<std::string> pieces;
+  pieces.reserve(splits.size());
+  begin = 0;
+  for(std::size_t i=0; i < splits.size(); ++i)
+  {
+    pieces.push_back(
+          _encoding->encode_fragment_msg(
+            id, payload.substr(begin, splits[i] - begin), i, splits.size()));
+    begin = splits[i];
+  }
+
+  return pieces;
+}
+
+//==============================================================================
+WsCppMessagePtr Endpoint::_make_message(
+    const std::string& payload,
+    const websocketpp::frame::opcode::value opcode) const
+{
+  WsCppMessagePtr message = std::make_shared<WsCppMessage>(
+        WsCppMessage::con_msg_man_ptr(), opcode, payload.size());
+  message->set_payload(payload);
+
+  // This only has an effect on connections that negotiated permessage-deflate
+  message->set_compressed(true);
+
+  return message;
+}
+
+//==============================================================================
+WsCppMessagePtr Endpoint::_make_shared_message(const std::string& payload) const
+{
+  const auto opcode = get_opcode();
+  WsCppMessagePtr message = _make_message(payload, opcode);
+
+  if(shares_prepared_frames())
+  {
+    // websocketpp sends a prepared message as-is, so the frame header only
+    // needs to be computed once for all of the connections. This is only
+    // valid when the frames do not get masked or compressed per connection.
+    const websocketpp::frame::basic_header header(
+          opcode, payload.size(), true, false);
+    message->set_header(
+          websocketpp::frame::prepare_header(
+            header, websocketpp::frame::extended_header(payload.size())));
+    message->set_prepared(true);
+  }
+
+  return message;
+}
+
+//==============================================================================
+void Endpoint::notify_connection_opened(
+    const std::shared_ptr<void>& connection_handle)
+{
+  std::unique_lock<std::mutex> lock(_listener_mutex);
+  if(_startup_messages.empty())
+    return;
+
+  bool carries_all = true;
+  for(const StartupMessage& msg : _startup_messages)
+  {
+    if(!carries(connection_handle, msg.topic))
+    {
+      carries_all = false;
+      break;
+    }
+  }
+
+  if(carries_all && shares_prepared_frames())
+  {
+    if(!_startup_bundle)
+      _startup_bundle = _make_startup_bundle();
+
+    send_message(connection_handle, _startup_bundle);
+    return;
+  }
+
+  // Frames that get masked or compressed per connection cannot be bundled, but
+  // they still go out without being encoded again
+  for(const StartupMessage& msg : _startup_messages)
+  {
+    if(carries(connection_handle, msg.topic))
+      send_message(connection_handle, msg.message);
+  }
+}
+
+//==============================================================================
+void Endpoint::_add_startup_message(
+    std::string topic,
+    const std::string& payload)
+{
+  _startup_messages.push_back(
+        StartupMessage{std::move(topic), _make_shared_message(payload)});
+  _startup_bundle.reset();
+}
+
+//==============================================================================
+WsCppMessagePtr Endpoint::_make_startup_bundle() const
+{
+  // The header of the first frame becomes the header of the bundle, and the
+  // complete frames of the other messages follow its payload. websocketpp
+  // writes a prepared message as it is, so the peer receives ordinary frames.
+  const WsCppMessagePtr& first = _startup_messages.front().message;
+
+  std::size_t size = first->get_payload().size();
+  for(std::size_t i=1; i < _startup_messages.size(); ++i)
+  {
+    const WsCppMessagePtr& message = _startup_messages[i].message;
+    size += message->get_header().size() + message->get_payload().size();
+  }
+
+  std::string bytes;
+  bytes.reserve(size);
+  bytes += first->get_payload();
+  for(std::size_t i=1; i < _startup_messages.size(); ++i)
+  {
+    const WsCppMessagePtr& message = _startup_messages[i].message;
+    bytes += message->get_header();
+    bytes += message->get_payload();
+  }
+
+  WsCppMessagePtr bundle = _make_message(bytes, get_opcode());
+  bundle->set_header(first->get_header());
+  bundle->set_prepared(true);
+  return bundle;
+}
+
+//==============================================================================
+void Endpoint::notify_connection_closed(
+    const std::shared_ptr<void>& connection_handle)
+{
+  close_finished(connection_handle);
+
+  std::shared_ptr<Inbox> inbox;
+  {
+    std::unique_lock<std::mutex> lock(_worker_mutex);
+    const auto it = _inboxes.find(connection_handle);
+    if(it != _inboxes.end())
+    {
+      inbox = std::move(it->second);
+      _inboxes.erase(it);
+    }
+  }
+
+  if(inbox)
+  {
+    // Whatever the connection still had waiting is discarded, and a message
+    // that is being interpreted has to finish first, or else it could leave
+    // state behind for the connection after we have cleaned it up below
+    std::unique_lock<std::mutex> inbox_lock(inbox->mutex);
+    inbox->open = false;
+    inbox->messages.clear();
+    inbox->bytes = 0;
+    inbox->interpreted.wait(
+          inbox_lock, [&]() { return !inbox->interpreting; });
+  }
+
+  {
+    std::unique_lock<std::mutex> lock(_listener_mutex);
+    const auto topics = _listened_topics.find(connection_handle);
+    if(topics != _listened_topics.end())
+    {
+      for(const std::string& topic : topics->second)
+      {
+        const auto it = _topic_publish_info->find(topic);
+        if(it != _topic_publish_info->end())
+          _remove_listener(*it->second, connection_handle);
+      }
+
+      _listened_topics.erase(topics);
+    }
+
+    const auto outbox = _outboxes.find(connection_handle);
+    if(outbox != _outboxes.end())
+    {
+      std::unique_lock<std::mutex> outbox_lock(outbox->second->mutex);
+      outbox->second->open = false;
+      for(auto& lane : outbox->second->lanes)
+        lane.clear();
+
+      // Nothing touches the metrics of a closed outbox anymore
+      soss::Metrics::release_connection(outbox->second->name);
+      outbox->second->metrics = nullptr;
+
+      outbox_lock.unlock();
+      _outboxes.erase(outbox);
+    }
+  }
+
+  std::unique_lock<std::mutex> lock(_state_mutex);
+  _fragment_buffers.erase(connection_handle);
+
+  const auto index = _connection_index.find(connection_handle);
+  if(index != _connection_index.end())
+  {
+    for(const std::string& topic : index->second.blacklisted_topics)
+    {
+      const auto it = _topic_subscribe_info.find(topic);
+      if(it == _topic_subscribe_info.end())
+        continue;
+
+      TopicSubscribeInfo& info = it->second;
+      auto updated = std::make_shared<TopicSubscribeInfo::Blacklist>(
+            *std::atomic_load(&info.blacklist));
+      updated->erase(connection_handle);
+      std::atomic_store(
+            &info.blacklist,
+            std::shared_ptr<const TopicSubscribeInfo::Blacklist>(
+              std::move(updated)));
+    }
+
+    for(const std::string& service : index->second.provided_services)
+    {
+      const auto it = _service_provider_info.find(service);
+      if(it != _service_provider_info.end()
+         && it->second.connection_handle == connection_handle)
+        _service_provider_info.erase(it);
+    }
+
+    _connection_index.erase(index);
+  }
+
+  // NOTE(MXG): We'll leave _service_requests alone, because it's feasible
+  // that the service response might arrive later after the other side has
+  // reconnected. Requests that never get a response expire eventually.
+  std::vector<ServiceRequestInfo> expired;
+  _expire_service_requests(std::chrono::steady_clock::now(), expired);
+  lock.unlock();
+
+  _fail_service_requests(expired);
+}
+
+//==============================================================================
+void Endpoint::_expire_service_requests(
+    const std::chrono::steady_clock::time_point now,
+    std::vector<ServiceRequestInfo>& expired)
+{
+  // Every request waits equally long, so the oldest ones expire first
+  while(!_service_request_expiry.empty()
+        && _service_request_expiry.front().first <= now)
+  {
+    const uint64_t id = _service_request_expiry.front().second;
+    ServiceRequestInfo info{nullptr, nullptr};
+    if(_release_service_request(id, info))
+    {
+      std::cerr << "[soss::websocket] Gave up on service request [" << id
+                << "] because no response arrived for it" << std::endl;
+      expired.push_back(std::move(info));
+    }
+
+    _service_request_expiry.pop_front();
+  }
+}
+
+//==============================================================================
+void Endpoint::_fail_service_requests(
+    const std::vector<ServiceRequestInfo>& expired)
+{
+  for(const ServiceRequestInfo& info : expired)
+  {
+    info.client->receive_error(
+          info.call_handle,
+          "no response arrived from the websocket client that provides the "
+          "service");
+  }
+}
+
+//==============================================================================
+bool Endpoint::_release_service_request(
+    const uint64_t id,
+    ServiceRequestInfo& info)
+{
+  const uint64_t index = id & std::numeric_limits<uint32_t>::max();
+  const uint64_t generation = id >> 32;
+  if(index >= _service_requests.size())
+    return false;
+
+  ServiceRequestSlot& slot = _service_requests[index];
+  if(!slot.in_use || slot.generation != generation)
+    return false;
+
+  _service_request_ids.erase(slot.info.call_handle.get());
+  info = std::move(slot.info);
+  slot.info = ServiceRequestInfo{nullptr, nullptr};
+  slot.in_use = false;
+  _free_service_requests.push_back(static_cast<uint32_t>(index));
+  return true;
+}
+
+//==============================================================================
+int32_t parse_port(const YAML::Node& configuration)
+{
+  if(const YAML::Node port_node = configuration[YamlPortKey])
+  {
+    try
+    {
+      return port_node.as<int>();
+    }
+    catch(const YAML::InvalidNode& v)
+    {
+      std::cerr << "[soss::websocket::SystemHandle::configure] Could not "
+                << "parse an integer value for the port setting ["
+                << port_node.as<std::string>("") << "]: "
+                << v.what() << std::endl;
+    }
+  }
+  else
+  {
+    std::cerr << "[soss::websocket::SystemHandle::configure] You must specify "
+              << "a port setting in your soss-websocket configuration!"
+              << std::endl;
+  }
+
+  return -1;
+}
+
+//==============================================================================
+bool parse_permessage_deflate(
+    const YAML::Node& configuration,
+    DeflateSettings& settings)
+{
+  const YAML::Node node = configuration[YamlPermessageDeflateKey];
+  if(!node)
+  {
+    settings.enabled = false;
+    return true;
+  }
+
+  if(node.IsScalar())
+  {
+    settings.enabled = node.as<bool>(false);
+    return true;
+  }
+
+  if(!node.IsMap())
+  {
+    std::cerr << "[soss::websocket::SystemHandle::configure] The ["
+              << YamlPermessageDeflateKey << "] setting must be a boolean or "
+              << "a map" << std::endl;
+    return false;
+  }
+
+  settings.enabled = true;
+  if(const YAML::Node bits_node = node[YamlWindowBitsKey])
+  {
+    const int bits = bits_node.as<int>(0);
+    if(bits < 9 || 15 < bits)
+    {
+      std::cerr << "[soss::websocket::SystemHandle::configure] The ["
+                << YamlWindowBitsKey << "] of [" << YamlPermessageDeflateKey
+                << "] must be between 9 and 15, but it was given ["
+                << bits_node.as<std::string>("") << "]" << std::endl;
+      return false;
+    }
+
+    settings.max_window_bits = static_cast<uint8_t>(bits);
+  }
+
+  return true;
+}
+
+//==============================================================================
+bool parse_slow_consumer(
+    const YAML::Node& configuration,
+    SlowConsumerLimits& limits)
+{
+  const YAML::Node node = configuration[YamlSlowConsumerKey];
+  if(!node)
+    return true;
+
+  if(!node.IsMap())
+  {
+    std::cerr << "[soss::websocket::SystemHandle::configure] The ["
+              << YamlSlowConsumerKey << "] setting must be a map" << std::endl;
+    return false;
+  }
+
+  const std::pair<const char*, std::size_t*> sizes[] = {
+    {"max_bytes", &limits.max_bytes},
+    {"max_messages", &limits.max_messages}
+  };
+
+  for(const auto& size : sizes)
+  {
+    const YAML::Node size_node = node[size.first];
+    if(!size_node)
+      continue;
+
+    const long long value = size_node.as<long long>(0);
+    if(value <= 0)
+    {
+      std::cerr << "[soss::websocket::SystemHandle::configure] The ["
+                << size.first << "] of [" << YamlSlowConsumerKey << "] must "
+                << "be positive, but it was given ["
+                << size_node.as<std::string>("") << "]" << std::endl;
+      return false;
+    }
+
+    *size.second = static_cast<std::size_t>(value);
+  }
+
+  if(const YAML::Node policy_node = node["policy"])
+  {
+    const std::string policy = policy_node.as<std::string>("");
+    if(policy == "drop")
+      limits.policy = SlowConsumerLimits::DropToLatest;
+    else if(policy == "pause")
+      limits.policy = SlowConsumerLimits::Pause;
+    else if(policy == "disconnect")
+      limits.policy = SlowConsumerLimits::Disconnect;
+    else
+    {
+      std::cerr << "[soss::websocket::SystemHandle::configure] The [policy] "
+                << "of [" << YamlSlowConsumerKey << "] must be [drop], "
+                << "[pause] or [disconnect], but it was given [" << policy
+                << "]" << std::endl;
+      return false;
+    }
+  }
+
+  if(const YAML::Node code_node = node["close_code"])
+  {
+    // Only the codes for applications, and the ones that the protocol allows
+    // an endpoint to send, make sense here
+    const int code = code_node.as<int>(0);
+    if(code < 1000 || 4999 < code
+       || websocketpp::close::status::reserved(
+            static_cast<websocketpp::close::status::value>(code))
+       || websocketpp::close::status::invalid(
+            static_cast<websocketpp::close::status::value>(code)))
+    {
+      std::cerr << "[soss::websocket::SystemHandle::configure] The "
+                << "[close_code] of [" << YamlSlowConsumerKey << "] is not a "
+                << "close code that may be sent: ["
+                << code_node.as<std::string>("") << "]" << std::endl;
+      return false;
+    }
+
+    limits.close_code = static_cast<websocketpp::close::status::value>(code);
+  }
+
+  return true;
+}
+
+//==============================================================================
+bool parse_inbound(
+    const YAML::Node& configuration,
+    InboundLimits& limits)
+{
+  const YAML::Node node = configuration[YamlInboundKey];
+  if(!node)
+    return true;
+
+  if(node.IsScalar())
+  {
+    limits.enabled = node.as<bool>(false);
+    return true;
+  }
+
+  if(!node.IsMap())
+  {
+    std::cerr << "[soss::websocket::SystemHandle::configure] The ["
+              << YamlInboundKey << "] setting must be true, false or a map"
+              << std::endl;
+    return false;
+  }
+
+  limits.enabled = true;
+
+  const std::pair<const char*, std::size_t*> sizes[] = {
+    {"max_bytes", &limits.max_bytes},
+    {"max_messages", &limits.max_messages}
+  };
+
+  for(const auto& size : sizes)
+  {
+    const YAML::Node size_node = node[size.first];
+    if(!size_node)
+      continue;
+
+    const long long value = size_node.as<long long>(0);
+    if(value <= 0)
+    {
+      std::cerr << "[soss::websocket::SystemHandle::configure] The ["
+                << size.first << "] of [" << YamlInboundKey << "] must be "
+                << "positive, but it was given ["
+                << size_node.as<std::string>("") << "]" << std::endl;
+      return false;
+    }
+
+    *size.second = static_cast<std::size_t>(value);
+  }
+
+  return true;
+}
+
+//==============================================================================
+bool parse_workers(
+    const YAML::Node& configuration,
+    WorkerSettings& workers)
+{
+  const YAML::Node node = configuration[YamlWorkersKey];
+  if(!node)
+    return true;
+
+  const YAML::Node count = node.IsMap()? node["count"] : node;
+  if(!count || !count.IsScalar())
+  {
+    std::cerr << "[soss::websocket::SystemHandle::configure] The ["
+              << YamlWorkersKey << "] setting must be a number of workers or "
+              << "a map with a [count]" << std::endl;
+    return false;
+  }
+
+  const long long value = count.as<long long>(-1);
+  if(value < 0)
+  {
+    std::cerr << "[soss::websocket::SystemHandle::configure] The number of ["
+              << YamlWorkersKey << "] must not be negative, but it was given ["
+              << count.as<std::string>("") << "]" << std::endl;
+    return false;
+  }
+
+  workers.count = static_cast<std::size_t>(value);
+
+  if(!node.IsMap())
+    return true;
+
+  if(const YAML::Node queue_length = node["queue_length"])
+  {
+    const long long length = queue_length.as<long long>(0);
+    if(length <= 0)
+    {
+      std::cerr << "[soss::websocket::SystemHandle::configure] The "
+                << "[queue_length] of [" << YamlWorkersKey << "] must be "
+                << "positive, but it was given ["
+                << queue_length.as<std::string>("") << "]" << std::endl;
+      return false;
+    }
+
+    workers.queue_length = static_cast<std::size_t>(length);
+  }
+
+  return true;
+}
+
+//==============================================================================
+bool parse_batching(
+    const YAML::Node& configuration,
+    BatchingLimits& limits)
+{
+  const YAML::Node node = configuration[YamlBatchingKey];
+  if(!node)
+    return true;
+
+  if(node.IsScalar())
+  {
+    limits.enabled = node.as<bool>(false);
+    return true;
+  }
+
+  if(!node.IsMap())
+  {
+    std::cerr << "[soss::websocket::SystemHandle::configure] The ["
+              << YamlBatchingKey << "] setting must be true, false or a map"
+              << std::endl;
+    return false;
+  }
+
+  limits.enabled = true;
+
+  if(const YAML::Node delay_node = node["max_delay"])
+  {
+    const long long delay = delay_node.as<long long>(0);
+    if(delay <= 0)
+    {
+      std::cerr << "[soss::websocket::SystemHandle::configure] The "
+                << "[max_delay] of [" << YamlBatchingKey << "] must be a "
+                << "positive number of milliseconds, but it was given ["
+                << delay_node.as<std::string>("") << "]" << std::endl;
+      return false;
+    }
+
+    limits.max_delay = std::chrono::milliseconds(delay);
+  }
+
+  if(const YAML::Node bytes_node = node["max_bytes"])
+  {
+    const long long bytes = bytes_node.as<long long>(0);
+    if(bytes <= 0)
+    {
+      std::cerr << "[soss::websocket::SystemHandle::configure] The "
+                << "[max_bytes] of [" << YamlBatchingKey << "] must be "
+                << "positive, but it was given ["
+                << bytes_node.as<std::string>("") << "]" << std::endl;
+      return false;
+    }
+
+    limits.max_bytes = static_cast<std::size_t>(bytes);
+  }
+
+  return true;
 }
 
 } // namespace websocket
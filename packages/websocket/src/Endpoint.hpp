@@ -21,19 +21,124 @@
 #include "Encoding.hpp"
 #include "websocket_types.hpp"
 
+#include <soss/Metrics.hpp>
 #include <soss/SystemHandle.hpp>
+#include <soss/Trace.hpp>
 
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <map>
 #include <memory>
+#include <mutex>
+#include <thread>
 #include <unordered_map>
 #include <unordered_set>
+#include <vector>
 
 namespace soss {
 namespace websocket {
 
 const std::string YamlEncodingKey = "encoding";
 const std::string YamlEncoding_Rosbridge_v2_0 = "rosbridge_v2.0";
+const std::string YamlEncoding_Rosbridge_v2_0_Cbor = "rosbridge_v2.0_cbor";
+const std::string YamlEncoding_Rosbridge_v2_0_MessagePack =
+    "rosbridge_v2.0_msgpack";
 const std::string YamlPortKey = "port";
 const std::string YamlHostKey = "host";
+const std::string YamlPermessageDeflateKey = "permessage_deflate";
+const std::string YamlWindowBitsKey = "window_bits";
+const std::string YamlSlowConsumerKey = "slow_consumer";
+const std::string YamlReconnectBufferKey = "reconnect_buffer";
+const std::string YamlInboundKey = "inbound";
+const std::string YamlWorkersKey = "workers";
+const std::string YamlBatchingKey = "batching";
+const std::string YamlShutdownTimeoutKey = "shutdown_timeout";
+
+//==============================================================================
+/// The limits on the outgoing data that may pile up for one connection, e.g.
+/// because it belongs to a browser tab that has stalled, and what happens to
+/// a connection that goes over them
+struct SlowConsumerLimits
+{
+  enum Policy
+  {
+    /// Discard the oldest publications that are waiting for the connection
+    DropToLatest,
+
+    /// Stop queuing publications for the connection until it catches up
+    Pause,
+
+    /// Close the connection
+    Disconnect
+  };
+
+  /// The most bytes that may wait to be written to the connection
+  std::size_t max_bytes = 64*1024*1024;
+
+  /// The most publication messages that may wait for the connection
+  std::size_t max_messages = 10000;
+
+  Policy policy = DropToLatest;
+
+  /// The close code that is sent to connections that get disconnected
+  websocketpp::close::status::value close_code =
+      websocketpp::close::status::policy_violation;
+};
+
+//==============================================================================
+/// The limits on the incoming messages that may wait to be interpreted for one
+/// connection. While a connection is over them, we stop reading from its
+/// socket, so TCP holds back the remote peer instead of us buffering whatever
+/// it sends.
+struct InboundLimits
+{
+  /// Whether incoming messages wait in a queue for a worker instead of being
+  /// interpreted on the websocket thread that read them
+  bool enabled = false;
+
+  /// The most bytes that may wait for one connection
+  std::size_t max_bytes = 8*1024*1024;
+
+  /// The most messages that may wait for one connection
+  std::size_t max_messages = 1000;
+};
+
+//==============================================================================
+/// How long the publications for a connection may be held back, so that many
+/// small ones can be handed to the socket together instead of each paying for
+/// a write and a TLS record of its own
+struct BatchingLimits
+{
+  /// Whether publications get held back at all
+  bool enabled = false;
+
+  /// The longest that a publication may be held back. The actual window is
+  /// shorter when publications arrive too slowly to fill a batch in time.
+  std::chrono::milliseconds max_delay = std::chrono::milliseconds(2);
+
+  /// Publications stop being held back once this many bytes are waiting
+  std::size_t max_bytes = 64*1024;
+};
+
+//==============================================================================
+/// The pool of workers that decode the incoming messages and encode the
+/// publications of an endpoint, so that converting large messages neither
+/// holds up the websocket thread nor the soss thread that publishes them
+struct WorkerSettings
+{
+  /// The number of workers. With none, publications get encoded by whichever
+  /// thread publishes them.
+  std::size_t count = 0;
+
+  /// The most publications of one topic that may wait to be encoded. The
+  /// oldest get dropped beyond this.
+  std::size_t queue_length = 100;
+};
 
 //==============================================================================
 class Endpoint : public soss::FullSystem, public ServiceClient
@@ -50,7 +155,7 @@ public:
 
   virtual bool spin_once() = 0;
 
-  virtual ~Endpoint() = default;
+  virtual ~Endpoint();
 
 
   // ----------- Functions for configuring -----------
@@ -99,6 +204,20 @@ public:
       const std::string& topic,
       const soss::Message& message);
 
+  /// Publish a message that is shared by several publishers of a route. The
+  /// encoded publication gets cached on the envelope so that other websocket
+  /// endpoints that publish the same topic can reuse it.
+  bool publish(
+      const std::string& topic,
+      const soss::MessageEnvelope& envelope);
+
+  /// Publish several messages of a topic while holding the listener lock only
+  /// once. The publications get queued on each connection back to back, so
+  /// websocketpp can gather them into a single write.
+  bool publish_batch(
+      const std::string& topic,
+      const std::vector<std::shared_ptr<const soss::Message>>& messages);
+
   void call_service(
       const std::string& service,
       const soss::Message& request,
@@ -112,9 +231,27 @@ public:
       std::shared_ptr<void> call_handle,
       const soss::Message& response) override final;
 
+  /// Tell the remote client that its request failed, by sending it a service
+  /// response whose result is false
+  void receive_error(
+      std::shared_ptr<void> call_handle,
+      const std::string& error) override final;
+
+  /// Forget about a request that soss has given up on, so that a late
+  /// response to it gets rejected
+  void cancel_service_call(const std::shared_ptr<void>& call_handle);
+
 
   // --------- Functions for reacting to websocket messages --------
 
+  /// Interpret a message that arrived on one of our connections. With the
+  /// inbound setting, the message waits in the inbox of its connection
+  /// instead, and reading from the connection is paused while the inbox is
+  /// over its limits.
+  void receive_message_ws(
+      const WsCppMessagePtr& message,
+      const std::shared_ptr<void>& connection_handle);
+
   void receive_topic_advertisement_ws(
       const std::string& topic_name,
       const std::string& message_type,
@@ -128,13 +265,14 @@ public:
 
   void receive_publication_ws(
       const std::string& topic_name,
-      const soss::Message& message,
+      soss::Message&& message,
       std::shared_ptr<void> connection_handle);
 
   void receive_subscribe_request_ws(
       const std::string& topic_name,
       const std::string& message_type,
       const std::string& id,
+      const TransferOptions& options,
       std::shared_ptr<void> connection_handle);
 
   void receive_unsubscribe_request_ws(
@@ -142,12 +280,21 @@ public:
       const std::string& id,
       std::shared_ptr<void> connection_handle);
 
-  // TODO(MXG): There are some fields in the rosbridge specification that are
-  // being ignored here, namely "fragment_size" and "compression"
   void receive_service_request_ws(
       const std::string& service_name,
       const soss::Message& request,
       const std::string& id,
+      const TransferOptions& options,
+      std::shared_ptr<void> connection_handle);
+
+  /// Collect one fragment of a message that was too large for the remote peer
+  /// to send at once. The whole message gets interpreted as soon as its last
+  /// fragment has arrived.
+  void receive_fragment_ws(
+      const std::string& id,
+      const std::string& data,
+      std::size_t num,
+      std::size_t total,
       std::shared_ptr<void> connection_handle);
 
   void receive_service_advertisement_ws(
@@ -171,41 +318,363 @@ protected:
 
   const Encoding& get_encoding() const;
 
+  /// The websocket opcode that every message of our encoding must be sent with
+  websocketpp::frame::opcode::value get_opcode() const;
+
   void notify_connection_opened(
-      const WsCppConnectionPtr& connection_handle);
+      const std::shared_ptr<void>& connection_handle);
 
   void notify_connection_closed(
       const std::shared_ptr<void>& connection_handle);
 
+  /// Whether the frames of an outgoing message can be prepared once and then
+  /// shared by all of the connections of this endpoint. This must be false for
+  /// endpoints whose frames get masked, like clients.
+  virtual bool shares_prepared_frames() const { return false; }
+
+  /// Whether other processes serve clients on the same port as this endpoint.
+  /// Those processes route the same services, so a request for a service that
+  /// none of our own connections provide is left for one of them to answer.
+  virtual bool clustered() const { return false; }
+
+  /// Whether a connection should carry a topic. Endpoints that spread their
+  /// topics over several connections to the same peer override this, so each
+  /// topic is advertised and subscribed on only one of them. An empty topic
+  /// stands for the services of the endpoint.
+  virtual bool carries(
+      const std::shared_ptr<void>& /*connection_handle*/,
+      const std::string& /*topic*/) const
+  {
+    return true;
+  }
+
+  /// Whether a topic that nobody listens to is only waiting for its connection
+  /// to come back, in which case its latest publications are held and sent
+  /// once it has been subscribed again. See set_reconnect_buffer(~).
+  virtual bool awaiting_connection(const std::string& /*topic*/) const
+  {
+    return false;
+  }
+
+  /// Set how many publications of each topic are held while the topic is
+  /// awaiting its connection. Topics can override this with their own
+  /// reconnect_buffer setting.
+  void set_reconnect_buffer(std::size_t limit);
+
+  /// Limit how many service requests of one connection may wait for their
+  /// responses at once, or 0 for no limit. Requests over the limit get an
+  /// error response right away and are counted as drops on the metrics.
+  void set_max_service_calls(
+      std::size_t limit,
+      soss::ChannelMetrics& throttled);
+
+  /// Count the fragmented messages of remote peers that get dropped, because
+  /// they exceed the limits of their connection or take too long to complete,
+  /// as drops on these metrics.
+  void set_fragment_metrics(soss::ChannelMetrics& dropped);
+
+  /// Expect a connection to close while we shut down, so that
+  /// wait_for_closes() waits for it. This must be called before the
+  /// connection is asked to close.
+  void expect_close(const std::shared_ptr<void>& connection_handle);
+
+  /// Stop expecting a connection to close, e.g. because it had already closed
+  /// by the time we asked it to. Connections that close normally are taken
+  /// off by notify_connection_closed().
+  void close_finished(const std::shared_ptr<void>& connection_handle);
+
+  /// Wait until every connection that we expect to close has closed, or until
+  /// the shutdown timeout of the endpoint has passed.
+  ///
+  /// \returns false if the timeout passed first
+  bool wait_for_closes();
+
+  /// Send a payload of our own encoding to one connection
+  websocketpp::lib::error_code send_payload(
+      const std::shared_ptr<void>& connection_handle,
+      const std::string& payload);
+
+  /// Send a payload of our own encoding to several connections. Its frame is
+  /// only prepared once if the connections can share it.
+  void broadcast_payload(
+      const std::vector<std::shared_ptr<void>>& connection_handles,
+      const std::string& payload);
+
+  // ------ Functions that depend on the transport of the endpoint -------
+
+  /// Send a websocket message to one of the connections of this endpoint
+  virtual websocketpp::lib::error_code send_message(
+      const std::shared_ptr<void>& connection_handle,
+      const WsCppMessagePtr& message) = 0;
+
+  /// The number of bytes that are still waiting to be written to a connection
+  virtual std::size_t get_buffered_amount(
+      const std::shared_ptr<void>& connection_handle) = 0;
+
+  /// Stop or resume reading from the socket of a connection. Messages that
+  /// websocketpp has already read still get handed to us.
+  virtual void set_reading(
+      const std::shared_ptr<void>& connection_handle,
+      bool reading) = 0;
+
+  /// Stop the workers and discard the messages that are waiting for them.
+  /// Derived endpoints must call this before they begin to tear down, since
+  /// the workers call back into them.
+  void stop_workers();
+
+  /// Call a function on the websocket threads once the delay has passed. The
+  /// function receives an error code if the timer was cancelled instead.
+  virtual void set_timer(
+      std::chrono::milliseconds delay,
+      std::function<void(const websocketpp::lib::error_code&)> callback) = 0;
+
+  /// A connection that has already been looked up from its handle, so that it
+  /// can be written to many times without resolving the handle again.
+  class ResolvedConnection
+  {
+  public:
+
+    virtual websocketpp::lib::error_code send(
+        const WsCppMessagePtr& message) = 0;
+
+    virtual std::size_t get_buffered_amount() const = 0;
+
+    virtual websocketpp::lib::error_code close(
+        websocketpp::close::status::value code,
+        const std::string& reason) = 0;
+
+    /// The address and port of the remote peer
+    virtual std::string remote_endpoint() const = 0;
+
+    virtual ~ResolvedConnection() = default;
+  };
+
+  using ResolvedConnectionPtr = std::shared_ptr<ResolvedConnection>;
+
+  /// Look up the connection of a handle. This may return nullptr if messages
+  /// for the connection must always go through send_message().
+  virtual ResolvedConnectionPtr resolve_connection(
+      const std::shared_ptr<void>& connection_handle) = 0;
+
 private:
 
-  virtual WsCppEndpoint* configure_endpoint(
+  virtual bool configure_endpoint(
       const RequiredTypes& types,
       const YAML::Node& configuration) = 0;
 
   EncodingPtr _encoding;
-  WsCppEndpoint* _endpoint;
+  std::string _encoding_name;
+
+  SlowConsumerLimits _slow_consumer;
+  InboundLimits _inbound;
+  WorkerSettings _workers;
+  BatchingLimits _batching;
+
+  // How long a shutdown waits for the remote peers to acknowledge that their
+  // connections are closing
+  std::chrono::milliseconds _shutdown_timeout = std::chrono::seconds(10);
+
+  // The connections that are expected to close before the shutdown can
+  // finish, protected by _closes_mutex
+  std::unordered_set<std::shared_ptr<void>> _expected_closes;
+  std::mutex _closes_mutex;
+  std::condition_variable _all_closed;
+
+  std::size_t _reconnect_buffer = 0;
+
+  std::size_t _max_service_calls = 0;
+  soss::ChannelMetrics* _throttled = nullptr;
+  soss::ChannelMetrics* _dropped_fragments = nullptr;
+  std::atomic_bool _warned_fragments{false};
 
   struct TopicSubscribeInfo
   {
     std::string type;
     SubscriptionCallback callback;
 
+    using Blacklist = std::unordered_set<std::shared_ptr<void>>;
+
     // Connections whose publications we will ignore because their message type
-    // does not match the one we expect.
-    std::unordered_set<std::shared_ptr<void>> blacklist;
+    // does not match the one we expect. This is an immutable snapshot which
+    // gets replaced while holding _state_mutex, so that every incoming
+    // publication can check it without locking.
+    std::shared_ptr<const Blacklist> blacklist =
+        std::make_shared<Blacklist>();
+  };
+
+  // Topics belong to one of these priority classes. When a connection is
+  // busy, its publications of a higher class get sent before those of lower
+  // classes, even in between the fragments of a large publication.
+  enum Priority : std::size_t
+  {
+    LowPriority = 0,
+    NormalPriority,
+    HighPriority,
+    NumPriorities
+  };
+
+  struct TopicPublishInfo;
+
+  // The websocket messages that are waiting to be handed to one connection,
+  // with one lane for each priority class. We only hand messages to
+  // websocketpp while its own send buffer is nearly empty, because anything
+  // that reaches that buffer can no longer be overtaken.
+  struct Outbox
+  {
+    // Listeners of several topics and the pump timer all feed the same
+    // connection, so the rest of the fields are protected by this mutex.
+    std::mutex mutex;
+
+    std::weak_ptr<void> connection_handle;
+
+    // The connection, resolved once when the outbox was created. This may be
+    // nullptr if messages must go through send_message().
+    ResolvedConnectionPtr connection;
+
+    // The websocket messages that make up one publication
+    struct Entry
+    {
+      // The topic of the publication, so that the backlog of a slow
+      // connection can be cut down to the newest publication of each topic
+      const TopicPublishInfo* topic;
+
+      std::vector<WsCppMessagePtr> messages;
+
+      // How many of the messages have been handed to websocketpp already
+      std::size_t sent = 0;
+
+      // If the listener asked for deltas, its Listener::keyframe_needed. The
+      // publications after this one cannot be applied once it gets dropped.
+      std::shared_ptr<std::atomic<bool>> keyframe_needed;
+    };
+
+    std::array<std::deque<Entry>, NumPriorities> lanes;
+
+    // The number and size of the messages that are waiting in the lanes
+    std::size_t queued_messages = 0;
+    std::size_t queued_bytes = 0;
+
+    // True while a timer is waiting to pump more messages to the connection
+    bool pump_scheduled = false;
+
+    // True while the pump holds the waiting messages back to gather more of
+    // them. They do not make the connection count as congested.
+    bool batching = false;
+
+    // With batching, when the waiting messages started to wait, when the
+    // latest publication was queued, and moving averages of the time between
+    // publications in seconds (negative until it is measured) and of their
+    // size, which decide how long it is worth waiting for more of them
+    std::chrono::steady_clock::time_point batch_start;
+    std::chrono::steady_clock::time_point last_queued;
+    double mean_interval = -1.0;
+    double mean_size = 0.0;
+
+    // True while the connection is not getting any more publications because
+    // it went over the limits of _slow_consumer
+    bool paused = false;
+
+    // False once the connection has closed
+    bool open = true;
+
+    // The name of the metrics of this connection, which are released once it
+    // closes
+    std::string name;
+    soss::ChannelMetrics* metrics = nullptr;
+  };
+
+  struct Listener
+  {
+    // Publications may be delivered to the same listener from several soss
+    // threads and from its flush timer, so the rest of its fields are
+    // protected by this mutex.
+    std::mutex mutex;
+
+    // False once the listener has been removed from its topic. Publications
+    // that still see it in an older snapshot of the listeners skip it then.
+    bool active = true;
+
+    // The ids of the subscriptions that the connection has made to a topic
+    std::unordered_set<std::string> ids;
+
+    // The options of the most recent subscription request from the connection
+    TransferOptions options;
+
+    // Publications that are waiting because the listener is throttled or its
+    // connection is still busy sending. Each entry holds every websocket
+    // message (e.g. fragments) that make up one publication.
+    std::deque<std::vector<WsCppMessagePtr>> pending;
+
+    // When the previous publication was sent to this listener
+    std::chrono::steady_clock::time_point last_sent;
+
+    // True while a timer is waiting to flush the pending publications
+    bool flush_scheduled = false;
+
+    // Where the publications for this listener get queued. It is shared by
+    // every listener of the same connection.
+    std::shared_ptr<Outbox> outbox;
+
+    // The previous publication that was handed to this listener, if it asked
+    // for deltas. The next delta holds the fields that differ from it.
+    std::shared_ptr<const soss::Message> delta_base;
+
+    // How many deltas have been sent since the previous full publication
+    std::size_t deltas_since_keyframe = 0;
+
+    // Set when the outbox drops one of the publications of this listener
+    // while it asks for deltas. Until its next keyframe, any delta would be
+    // applied on top of a publication that the peer never received. This is
+    // an atomic so that the outbox can set it without locking the listener.
+    const std::shared_ptr<std::atomic<bool>> keyframe_needed =
+        std::make_shared<std::atomic<bool>>(false);
   };
 
   struct TopicPublishInfo
   {
     std::string type;
 
-    using ListenerMap = std::unordered_map<
-        std::shared_ptr<void>,
-        std::unordered_set<std::string>>;
+    // The most significant digits of the floating point values that get
+    // published, or zero to publish them exactly
+    int precision = 0;
+
+    // The lane that the publications of this topic wait in
+    Priority priority = NormalPriority;
+
+    // The parts of the publications of this topic that never change, or
+    // nullptr if the encoding needs to render whole publications
+    PublicationEnvelopePtr envelope;
+
+    // With workers, the publications that wait to be encoded, oldest first,
+    // and whether a worker has the topic, so that its publications are
+    // encoded and sent one at a time. These are protected by encode_mutex.
+    std::mutex encode_mutex;
+    std::deque<std::shared_ptr<const soss::Message>> encode_queue;
+    bool encode_scheduled = false;
+
+    using ListenerMap =
+        std::unordered_map<std::shared_ptr<void>, std::shared_ptr<Listener>>;
 
-    // Map from connection handle to id of listeners
-    ListenerMap listeners;
+    // Map from connection handle to its listeners. Subscriptions change far
+    // less often than messages get published, so this is an immutable
+    // snapshot which gets copied and replaced while holding _listener_mutex.
+    // Publishers only need to load it atomically.
+    std::shared_ptr<const ListenerMap> listeners =
+        std::make_shared<ListenerMap>();
+
+    soss::ChannelMetrics* metrics = nullptr;
+
+    // The most publications that are held while the topic is awaiting its
+    // connection, or zero to drop them like any other publication that
+    // nobody listens to
+    std::size_t hold_limit = 0;
+
+    // The publications that are being held, oldest first. They are protected
+    // by held_mutex, and has_held lets publishers skip the mutex while there
+    // are none.
+    std::mutex held_mutex;
+    std::deque<std::shared_ptr<const soss::Message>> held;
+    std::atomic_bool has_held{false};
   };
 
   struct ClientProxyInfo
@@ -227,19 +696,525 @@ private:
     std::shared_ptr<void> call_handle;
   };
 
-  std::vector<std::string> _startup_messages;
+  // A slot of _service_requests. The generation of a slot changes each time it
+  // gets reused, so that a late response to an older request which had the
+  // same slot cannot be mistaken for the current one.
+  struct ServiceRequestSlot
+  {
+    ServiceRequestInfo info = ServiceRequestInfo{nullptr, nullptr};
+    uint32_t generation = 0;
+    bool in_use = false;
+  };
+
+  std::string _encode_publication(
+      const std::string& topic,
+      const TopicPublishInfo& info,
+      const soss::Message& message) const;
+
+  void _send_publication(
+      const std::string& topic,
+      const TopicPublishInfo& info,
+      const TopicPublishInfo::ListenerMap& listeners,
+      const std::string& payload,
+      const soss::Message& message);
+
+  /// Encode the changes of a publication for a listener that asked for
+  /// deltas. The deltas are cached by their base, so listeners that received
+  /// the same previous publication share them.
+  /// \returns nullptr if the listener should get the full publication.
+  WsCppMessagePtr _delta_publication(
+      const std::string& topic,
+      const TopicPublishInfo& info,
+      Listener& listener,
+      const soss::Message& message,
+      std::map<std::pair<const soss::Message*, bool>, WsCppMessagePtr>& deltas);
+
+  /// Discard the publications that wait for a listener. This must be called
+  /// while holding the mutex of the listener.
+  void _drop_pending(const TopicPublishInfo& info, Listener& listener);
+
+  /// Hold on to a publication that nobody is listening to, if its topic is
+  /// awaiting its connection. Otherwise any publications that were being held
+  /// get discarded, since nobody is coming back for them.
+  void _hold(
+      const std::string& topic,
+      TopicPublishInfo& info,
+      std::shared_ptr<const soss::Message> message);
+
+  /// Send the held publications of a topic to its listeners, oldest first
+  void _release_held(
+      const std::string& topic,
+      TopicPublishInfo& info,
+      const TopicPublishInfo::ListenerMap& listeners);
+
+  /// Find the publishing info of a topic that has been advertised. This never
+  /// blocks, and the info stays valid for as long as the endpoint exists.
+  /// \throws std::out_of_range if the topic is unknown.
+  std::shared_ptr<TopicPublishInfo> _get_publish_info(
+      const std::string& topic) const;
+
+  /// Find the publishing info of a topic, adding it if it does not exist yet.
+  /// This must be called while holding _listener_mutex.
+  TopicPublishInfo& _add_publish_info(const std::string& topic);
+
+  /// Stop delivering publications of a topic to a connection. This must be
+  /// called while holding _listener_mutex.
+  void _remove_listener(
+      TopicPublishInfo& info,
+      const std::shared_ptr<void>& connection_handle);
+
+  /// Send a publication to a listener right away if it is allowed to receive
+  /// one, otherwise conflate it into the pending publications of the listener.
+  /// \returns the number of bytes that were sent.
+  std::size_t _deliver(
+      const std::string& topic,
+      const TopicPublishInfo& info,
+      const std::shared_ptr<void>& connection_handle,
+      Listener& listener,
+      std::vector<WsCppMessagePtr> publication);
+
+  /// Send the oldest pending publication of a listener, if it is ready for it,
+  /// and schedule another flush if more publications are waiting.
+  void _flush_listener(
+      const std::string& topic,
+      const std::weak_ptr<void>& connection_handle);
+
+  void _schedule_flush(
+      const std::string& topic,
+      const std::shared_ptr<void>& connection_handle,
+      Listener& listener,
+      std::chrono::milliseconds delay);
+
+  /// Queue a publication in the outbox of a listener and pump the outbox.
+  /// \returns the number of bytes that were queued.
+  std::size_t _send_now(
+      const TopicPublishInfo& info,
+      Listener& listener,
+      const std::vector<WsCppMessagePtr>& publication);
+
+  /// Whether the connection of a listener is too busy to take another
+  /// publication of the given priority class
+  bool _is_congested(const Listener& listener, Priority priority);
+
+  /// Find the outbox of a connection, creating it if it does not exist yet.
+  /// This must be called while holding _listener_mutex.
+  std::shared_ptr<Outbox> _get_outbox(
+      const std::shared_ptr<void>& connection_handle);
+
+  /// Hand the queued messages of an outbox to websocketpp, highest priority
+  /// first, for as long as the connection has room for them. Another pump
+  /// gets scheduled if any messages are left waiting.
+  void _pump(const std::shared_ptr<Outbox>& outbox);
+
+  /// Schedule the next pump of an outbox. This must be called while holding
+  /// the mutex of the outbox.
+  void _schedule_pump(
+      const std::shared_ptr<Outbox>& outbox,
+      std::chrono::milliseconds delay);
+
+  /// Update the averages that batching relies on with a publication that is
+  /// being queued. This must be called while holding the mutex of the outbox.
+  void _track_batch(Outbox& outbox, std::size_t bytes);
+
+  /// How much longer the waiting messages of an outbox should be held back,
+  /// or zero if they should be sent now. This must be called while holding the
+  /// mutex of the outbox.
+  std::chrono::milliseconds _batch_delay(const Outbox& outbox) const;
+
+  /// This must be called while holding the mutex of the outbox.
+  std::size_t _get_buffered_amount(Outbox& outbox);
+
+  /// Apply the policy of _slow_consumer to a connection that has gone over
+  /// its limits. This must be called while holding the mutex of the outbox.
+  /// \returns true if the connection should be closed.
+  bool _shed_load(Outbox& outbox, std::size_t buffered);
+
+  /// Discard one publication that is waiting in an outbox, leaving an entry
+  /// without messages behind. This must be called while holding the mutex of
+  /// the outbox.
+  void _drop_entry(Outbox& outbox, Outbox::Entry& entry);
+
+  /// Discard the publications that wait behind a dropped publication of a
+  /// listener that asked for deltas, since its peer would not be able to
+  /// apply them, and erase the dropped entries from the lane. This must be
+  /// called while holding the mutex of the outbox.
+  void _erase_dropped(Outbox& outbox, std::deque<Outbox::Entry>& lane);
+
+  // The incoming messages of one connection that wait for a worker
+  struct Inbox
+  {
+    // The websocket thread of the connection and the workers all use the
+    // inbox, so the rest of the fields are protected by this mutex.
+    std::mutex mutex;
+
+    std::shared_ptr<void> connection_handle;
+
+    std::deque<WsCppMessagePtr> messages;
+    std::size_t bytes = 0;
+
+    // True while the inbox is waiting in _ready_inboxes or being worked on,
+    // so that only one worker ever interprets the messages of a connection
+    bool scheduled = false;
+
+    // True while a worker is interpreting a message of the inbox
+    bool interpreting = false;
+    std::condition_variable interpreted;
+
+    // True while reading from the connection is paused
+    bool paused = false;
+
+    // False once the connection has closed
+    bool open = true;
+  };
+
+  /// Interpret a message of our encoding that arrived on a connection
+  void _interpret(
+      const std::string& payload,
+      const std::shared_ptr<void>& connection_handle);
+
+  /// Interpret the next message of an inbox.
+  ///
+  /// \returns true if the inbox has more messages waiting
+  bool _interpret_next(Inbox& inbox);
+
+  /// Hand a publication to the workers, behind the publications of its topic
+  /// that are still waiting to be encoded
+  void _queue_encode(
+      const std::string& topic,
+      const std::shared_ptr<TopicPublishInfo>& info,
+      std::shared_ptr<const soss::Message> message);
+
+  /// Encode and send the next publication that waits for a topic.
+  ///
+  /// \returns true if the topic has more publications waiting
+  bool _encode_next(const std::string& topic, TopicPublishInfo& info);
+
+  /// Work on the inboxes and topics that are ready, one message at a time,
+  /// until stop_workers() gets called. Each inbox and topic is only worked on
+  /// by one worker at a time, so the order of their messages is kept.
+  void _worker_loop();
+
+  /// Forget the service requests that have been waiting too long for their
+  /// response, and add them to expired. This must be called while holding
+  /// _state_mutex.
+  void _expire_service_requests(
+      std::chrono::steady_clock::time_point now,
+      std::vector<ServiceRequestInfo>& expired);
+
+  /// Tell the clients of expired service requests that they failed. This must
+  /// be called without holding _state_mutex, because a client may call back
+  /// into the endpoint.
+  void _fail_service_requests(const std::vector<ServiceRequestInfo>& expired);
+
+  void _send_service_response(
+      const std::shared_ptr<void>& call_handle,
+      const soss::Message& response,
+      bool result);
+
+  /// Take a service request out of its slot so the slot can be reused. This
+  /// must be called while holding _state_mutex.
+  /// \returns false if no request with this id is waiting for a response.
+  bool _release_service_request(uint64_t id, ServiceRequestInfo& info);
+
+  /// Send a payload of our own encoding to one connection, splitting it into
+  /// fragments if the options of the connection ask for that.
+  void _send(
+      const std::shared_ptr<void>& connection_handle,
+      const std::string& payload,
+      const TransferOptions& options);
+
+  /// Split a text payload into encoded fragment messages
+  std::vector<std::string> _fragment(
+      const std::string& payload,
+      std::size_t fragment_size);
+
+  struct FragmentBuffer
+  {
+    std::vector<std::string> pieces;
+    std::vector<bool> arrived;
+    std::size_t received = 0;
+
+    /// The memory that this message holds on to, counted towards the limit of
+    /// its connection
+    std::size_t bytes = 0;
+    std::chrono::steady_clock::time_point started;
+  };
+
+  /// The fragmented messages of one connection
+  struct FragmentBuffers
+  {
+    /// key: the id of the message
+    std::unordered_map<std::string, FragmentBuffer> messages;
+    std::size_t bytes = 0;
+  };
+
+  WsCppMessagePtr _make_shared_message(const std::string& payload) const;
+
+  WsCppMessagePtr _make_message(
+      const std::string& payload,
+      websocketpp::frame::opcode::value opcode) const;
+
+  // A message that gets sent to each connection as soon as it opens, along
+  // with the topic that it is about, if any. It is framed once, when it gets
+  // added, and then shared by every connection.
+  struct StartupMessage
+  {
+    std::string topic;
+    WsCppMessagePtr message;
+  };
+
+  /// This must be called while holding _listener_mutex.
+  void _add_startup_message(std::string topic, const std::string& payload);
+
+  /// Put the frames of every startup message back to back into a single
+  /// prepared message, so that a new connection gets all of them with one
+  /// write. This must be called while holding _listener_mutex, and only if
+  /// shares_prepared_frames() is true.
+  WsCppMessagePtr _make_startup_bundle() const;
+
+  std::vector<StartupMessage> _startup_messages;
+
+  // The startup messages as one prepared message, which gets rebuilt by the
+  // next connection after the startup messages change
+  WsCppMessagePtr _startup_bundle;
   std::unordered_map<std::string, TopicSubscribeInfo> _topic_subscribe_info;
-  std::unordered_map<std::string, TopicPublishInfo> _topic_publish_info;
+
+  // Publishers look up their topic in here without locking, so this is an
+  // immutable snapshot as well. Topics are never removed from it.
+  using TopicPublishMap =
+      std::unordered_map<std::string, std::shared_ptr<TopicPublishInfo>>;
+  std::shared_ptr<const TopicPublishMap> _topic_publish_info;
+
+  // The topics that each connection is listening to, so that a connection can
+  // be removed from them without searching every topic when it closes.
+  std::unordered_map<
+      std::shared_ptr<void>,
+      std::unordered_set<std::string>> _listened_topics;
+
+  // The outbox of each connection that is listening to any topic
+  std::unordered_map<std::shared_ptr<void>, std::shared_ptr<Outbox>> _outboxes;
+
+  // Publications arrive from soss threads, while subscriptions and flush
+  // timers are handled on the websocket threads. Changes to the snapshots of
+  // _topic_publish_info and their listeners, as well as _startup_messages,
+  // _listened_topics and _outboxes, are protected by this mutex. Publishing
+  // never takes it.
+  std::mutex _listener_mutex;
   std::unordered_map<std::string, ClientProxyInfo> _client_proxy_info;
   std::unordered_map<std::string, ServiceProviderInfo> _service_provider_info;
-  std::unordered_map<std::string, ServiceRequestInfo> _service_request_info;
+  // The service requests that are waiting for a response. The id of a request
+  // is made of the generation of its slot in the upper 32 bits and the index
+  // of the slot in the lower 32 bits, so a response finds its request without
+  // any hashing.
+  std::vector<ServiceRequestSlot> _service_requests;
+  std::vector<uint32_t> _free_service_requests;
+
+  // The id of each waiting request, by the call handle that soss gave it, so
+  // that a call can be cancelled
+  std::unordered_map<const void*, uint64_t> _service_request_ids;
 
-  std::size_t _next_service_call_id;
+  // The ids of the service requests in the order that they were made, along
+  // with the time when each one should be given up on.
+  std::deque<std::pair<std::chrono::steady_clock::time_point, uint64_t>>
+      _service_request_expiry;
+
+  // Everything that refers to a remote connection, indexed by the connection,
+  // so that it can be cleaned up quickly once the connection closes.
+  struct ConnectionIndex
+  {
+    // Topics whose blacklist contains the connection
+    std::unordered_set<std::string> blacklisted_topics;
+
+    // Services that are provided by the connection
+    std::unordered_set<std::string> provided_services;
+
+    // Service requests from the connection that are waiting for soss to
+    // respond, if their number is limited
+    std::size_t service_calls = 0;
+  };
+
+  std::unordered_map<std::shared_ptr<void>, ConnectionIndex> _connection_index;
+
+  // The inbox of each connection that has sent us anything, and the inboxes
+  // and topics that have messages waiting for the workers, in the order that
+  // they became ready. These are protected by _worker_mutex.
+  std::unordered_map<std::shared_ptr<void>, std::shared_ptr<Inbox>> _inboxes;
+  std::deque<std::shared_ptr<Inbox>> _ready_inboxes;
+  std::deque<std::pair<std::string, std::shared_ptr<TopicPublishInfo>>>
+      _ready_topics;
+  std::mutex _worker_mutex;
+  std::condition_variable _worker_cv;
+  bool _workers_stopped = false;
+  std::vector<std::thread> _worker_threads;
+
+  // The messages of different connections may be handled by several websocket
+  // threads at once, so the state that they modify at runtime is protected by
+  // this mutex: the blacklists of _topic_subscribe_info, the service provider
+  // and request maps, _connection_index and _fragment_buffers. It is never
+  // held while calling back into soss.
+  std::mutex _state_mutex;
+
+  // Used for the connections that ask for "cbor" compression
+  EncodingPtr _cbor_encoding;
+
+  // Fragments that have arrived so far, for each connection
+  std::unordered_map<std::shared_ptr<void>, FragmentBuffers> _fragment_buffers;
+  std::atomic_size_t _next_fragment_id;
 
 };
 
 using EndpointPtr = std::unique_ptr<Endpoint>;
 
+//==============================================================================
+/// TransportEndpoint implements the functions of Endpoint that depend on the
+/// websocketpp configuration, so the same server and client logic can run
+/// with or without TLS.
+template<typename Config>
+class TransportEndpoint : public Endpoint
+{
+public:
+
+  using WsEndpoint = WsCppEndpointT<Config>;
+  using ConnectionPtr = WsCppConnectionPtrT<Config>;
+
+protected:
+
+  /// The websocketpp endpoint of the derived server or client
+  virtual WsEndpoint& ws_endpoint() = 0;
+
+  /// Ask connections to close, then wait until the remote peers have
+  /// acknowledged it, or until the shutdown timeout has passed.
+  ///
+  /// \returns false if the timeout passed first
+  bool close_and_wait(const std::vector<ConnectionPtr>& connections)
+  {
+    for(const ConnectionPtr& connection : connections)
+      this->expect_close(connection);
+
+    for(const ConnectionPtr& connection : connections)
+    {
+      websocketpp::lib::error_code ec;
+      connection->close(websocketpp::close::status::normal, "shutdown", ec);
+
+      // A connection that closed on its own before we expected it to will
+      // never tell us that it closed
+      if(connection->get_state() == websocketpp::session::state::closed)
+        this->close_finished(connection);
+    }
+
+    return this->wait_for_closes();
+  }
+
+  websocketpp::lib::error_code send_message(
+      const std::shared_ptr<void>& connection_handle,
+      const WsCppMessagePtr& message) override
+  {
+    websocketpp::lib::error_code ec;
+    const ConnectionPtr connection =
+        ws_endpoint().get_con_from_hdl(connection_handle, ec);
+    if(ec)
+      return ec;
+
+    return connection->send(message);
+  }
+
+  std::size_t get_buffered_amount(
+      const std::shared_ptr<void>& connection_handle) override
+  {
+    websocketpp::lib::error_code ec;
+    const ConnectionPtr connection =
+        ws_endpoint().get_con_from_hdl(connection_handle, ec);
+    if(ec)
+      return 0;
+
+    return connection->get_buffered_amount();
+  }
+
+  ResolvedConnectionPtr resolve_connection(
+      const std::shared_ptr<void>& connection_handle) override
+  {
+    websocketpp::lib::error_code ec;
+    ConnectionPtr connection =
+        ws_endpoint().get_con_from_hdl(connection_handle, ec);
+    if(ec)
+      return nullptr;
+
+    return std::make_shared<TransportConnection>(std::move(connection));
+  }
+
+  void set_timer(
+      const std::chrono::milliseconds delay,
+      std::function<void(const websocketpp::lib::error_code&)> callback)
+  override
+  {
+    ws_endpoint().set_timer(delay.count(), std::move(callback));
+  }
+
+  void set_reading(
+      const std::shared_ptr<void>& connection_handle,
+      const bool reading) override
+  {
+    websocketpp::lib::error_code ec;
+    const ConnectionPtr connection =
+        ws_endpoint().get_con_from_hdl(connection_handle, ec);
+    if(ec)
+      return;
+
+    // Both of these get dispatched to the strand of the connection
+    ec = reading? connection->resume_reading() : connection->pause_reading();
+    if(ec)
+    {
+      std::cerr << "[soss::websocket] Failed to "
+                << (reading? "resume" : "pause") << " reading from a "
+                << "connection: " << ec.message() << std::endl;
+    }
+  }
+
+private:
+
+  class TransportConnection : public ResolvedConnection
+  {
+  public:
+
+    explicit TransportConnection(ConnectionPtr connection)
+      : _connection(std::move(connection))
+    {
+      // Do nothing
+    }
+
+    websocketpp::lib::error_code send(
+        const WsCppMessagePtr& message) override
+    {
+      return _connection->send(message);
+    }
+
+    std::size_t get_buffered_amount() const override
+    {
+      return _connection->get_buffered_amount();
+    }
+
+    websocketpp::lib::error_code close(
+        const websocketpp::close::status::value code,
+        const std::string& reason) override
+    {
+      websocketpp::lib::error_code ec;
+      _connection->close(code, reason, ec);
+      return ec;
+    }
+
+    std::string remote_endpoint() const override
+    {
+      return _connection->get_remote_endpoint();
+    }
+
+  private:
+
+    ConnectionPtr _connection;
+
+  };
+
+};
+
 //==============================================================================
 std::shared_ptr<TopicPublisher> make_topic_publisher(
     const std::string& topic,
@@ -254,6 +1229,51 @@ std::shared_ptr<ServiceProvider> make_service_provider(
 //==============================================================================
 int32_t parse_port(const YAML::Node& configuration);
 
+//==============================================================================
+/// Parse the optional permessage_deflate setting, which may either be a
+/// boolean or a map with an optional window_bits entry.
+///
+/// \returns false if the setting is invalid.
+bool parse_permessage_deflate(
+    const YAML::Node& configuration,
+    DeflateSettings& settings);
+
+//==============================================================================
+/// Parse the optional slow_consumer setting, which is a map with the optional
+/// entries max_bytes, max_messages, policy and close_code.
+///
+/// \returns false if the setting is invalid.
+bool parse_slow_consumer(
+    const YAML::Node& configuration,
+    SlowConsumerLimits& limits);
+
+//==============================================================================
+/// Parse the optional inbound setting, which may either be a boolean or a map
+/// with the optional entries max_bytes and max_messages.
+///
+/// \returns false if the setting is invalid.
+bool parse_inbound(
+    const YAML::Node& configuration,
+    InboundLimits& limits);
+
+//==============================================================================
+/// Parse the optional batching setting, which may either be a boolean or a map
+/// with the optional entries max_delay (in milliseconds) and max_bytes.
+///
+/// \returns false if the setting is invalid.
+bool parse_batching(
+    const YAML::Node& configuration,
+    BatchingLimits& limits);
+
+//==============================================================================
+/// Parse the optional workers setting, which may either be a number of workers
+/// or a map with the entries count and queue_length.
+///
+/// \returns false if the setting is invalid.
+bool parse_workers(
+    const YAML::Node& configuration,
+    WorkerSettings& workers);
+
 } // namespace websocket
 } // namespace soss
 
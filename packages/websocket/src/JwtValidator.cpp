@@ -1,12 +1,148 @@
 #include "JwtValidator.hpp"
 
+#include <openssl/sha.h>
+
+#include <list>
+#include <mutex>
 #include <unordered_map>
 #include <regex>
 
 namespace soss {
 namespace websocket {
 
+//==============================================================================
+/// TokenCache is a bounded LRU cache of the tokens that have passed
+/// verification, keyed by the SHA-256 digest of each token. Using a
+/// cryptographic digest means that a forged token cannot collide with one
+/// that was verified before.
+class JwtValidator::TokenCache
+{
+public:
+
+  using Clock = std::chrono::system_clock;
+
+  TokenCache(const std::size_t capacity)
+    : _capacity(capacity)
+  {
+    // Do nothing
+  }
+
+  static std::string digest(const std::string& token)
+  {
+    unsigned char md[SHA256_DIGEST_LENGTH];
+    SHA256(reinterpret_cast<const unsigned char*>(token.data()),
+           token.size(), md);
+    return std::string(reinterpret_cast<const char*>(md), sizeof(md));
+  }
+
+  bool contains(const std::string& key)
+  {
+    std::unique_lock<std::mutex> lock(_mutex);
+    const auto it = _index.find(key);
+    if (it == _index.end())
+      return false;
+
+    if (it->second->expiry <= Clock::now())
+    {
+      _entries.erase(it->second);
+      _index.erase(it);
+      return false;
+    }
+
+    // Move the entry to the front, since it was just used
+    _entries.splice(_entries.begin(), _entries, it->second);
+    return true;
+  }
+
+  void insert(const std::string& key, const Clock::time_point expiry)
+  {
+    std::unique_lock<std::mutex> lock(_mutex);
+    if (_capacity == 0)
+      return;
+
+    const auto it = _index.find(key);
+    if (it != _index.end())
+    {
+      it->second->expiry = expiry;
+      _entries.splice(_entries.begin(), _entries, it->second);
+      return;
+    }
+
+    _entries.push_front(Entry{key, expiry});
+    _index[key] = _entries.begin();
+    _trim();
+  }
+
+  void clear()
+  {
+    std::unique_lock<std::mutex> lock(_mutex);
+    _entries.clear();
+    _index.clear();
+  }
+
+  void set_capacity(const std::size_t capacity)
+  {
+    std::unique_lock<std::mutex> lock(_mutex);
+    _capacity = capacity;
+    _trim();
+  }
+
+private:
+
+  void _trim()
+  {
+    while (_entries.size() > _capacity)
+    {
+      _index.erase(_entries.back().key);
+      _entries.pop_back();
+    }
+  }
+
+  struct Entry
+  {
+    std::string key;
+    Clock::time_point expiry;
+  };
+
+  std::size_t _capacity;
+  std::list<Entry> _entries;
+  std::unordered_map<std::string, std::list<Entry>::iterator> _index;
+  std::mutex _mutex;
+
+};
+
+//==============================================================================
+JwtValidator::JwtValidator(const std::size_t cache_size)
+  : _cache(new TokenCache(cache_size))
+{
+  // Do nothing
+}
+
+//==============================================================================
 bool JwtValidator::verify(const std::string& token)
+{
+  const std::string key = TokenCache::digest(token);
+  if (_cache->contains(key))
+    return true;
+
+  std::chrono::system_clock::time_point expiry;
+  if (!_verify_uncached(token, expiry))
+    return false;
+
+  _cache->insert(key, expiry);
+  return true;
+}
+
+//==============================================================================
+void JwtValidator::set_cache_size(const std::size_t cache_size)
+{
+  _cache->set_capacity(cache_size);
+}
+
+//==============================================================================
+bool JwtValidator::_verify_uncached(
+  const std::string& token,
+  std::chrono::system_clock::time_point& expiry) const
 {
   using namespace jwt::params;
 
@@ -33,35 +169,145 @@ bool JwtValidator::verify(const std::string& token)
 
   std::error_code ec;
   jwt::decode(token, algorithms({vs.algo}), ec, secret(vs.secret_or_pub));
-  return !static_cast<bool>(ec);
+  if (ec)
+    return false;
+
+  // jwt::decode(~) has already rejected the token if it is expired, so a
+  // verified token stays valid until its "exp" claim, if it has one.
+  expiry = std::chrono::system_clock::time_point::max();
+  const auto exp = payload.find("exp");
+  if (exp != payload.end() && exp->is_number())
+  {
+    expiry = std::chrono::system_clock::from_time_t(
+      static_cast<std::time_t>(exp->get<int64_t>()));
+  }
+
+  return true;
 }
 
+//==============================================================================
 void JwtValidator::add_verification_policy(const VerificationPolicy& policy)
 {
   _verification_policies.emplace_back(policy);
+
+  // The new policy might be chosen for tokens that were verified before
+  _cache->clear();
+}
+
+//==============================================================================
+JwtValidator::JwtValidator(JwtValidator&&) = default;
+JwtValidator& JwtValidator::operator=(JwtValidator&&) = default;
+JwtValidator::~JwtValidator() = default;
+
+namespace {
+
+//==============================================================================
+/// A rule of match_all(~) that has been prepared ahead of time. Most rules are
+/// plain strings or a single wildcard, which do not need a regex at all.
+struct RuleMatcher
+{
+  enum class Kind
+  {
+    Any,
+    Literal,
+    Regex
+  };
+
+  std::string key;
+  Kind kind;
+  std::string literal;
+  std::regex regex;
+
+  bool matches(const std::string& value) const
+  {
+    switch (kind)
+    {
+    case Kind::Any:
+      return true;
+    case Kind::Literal:
+      return value == literal;
+    case Kind::Regex:
+      return std::regex_match(value, regex);
+    }
+
+    return false;
+  }
+};
+
+//==============================================================================
+RuleMatcher make_rule_matcher(const VerificationPolicies::Rule& rule)
+{
+  RuleMatcher matcher;
+  matcher.key = rule.first;
+
+  const std::string& pattern = rule.second;
+  if (pattern == ".*")
+  {
+    matcher.kind = RuleMatcher::Kind::Any;
+    return matcher;
+  }
+
+  // A pattern without any special characters only matches one exact string.
+  // An escaped special character stands for itself, but other escapes like \d
+  // or \w are character classes, so they are left to the regex.
+  const std::string special = "^$.|?*+()[]{}\\";
+  std::string literal;
+  bool is_literal = true;
+  for (std::size_t i = 0; i < pattern.size() && is_literal; ++i)
+  {
+    const char c = pattern[i];
+    if (c == '\\' && i+1 < pattern.size()
+        && (special.find(pattern[i+1]) != std::string::npos
+            || pattern[i+1] == '/'))
+    {
+      literal.push_back(pattern[++i]);
+      continue;
+    }
+
+    if (special.find(c) != std::string::npos)
+      is_literal = false;
+    else
+      literal.push_back(c);
+  }
+
+  if (is_literal)
+  {
+    matcher.kind = RuleMatcher::Kind::Literal;
+    matcher.literal = std::move(literal);
+    return matcher;
+  }
+
+  matcher.kind = RuleMatcher::Kind::Regex;
+  matcher.regex = std::regex(
+        pattern, std::regex::ECMAScript | std::regex::optimize);
+  return matcher;
 }
 
+} // anonymous namespace
+
+//==============================================================================
 VerificationPolicy VerificationPolicies::match_all(
   const std::vector<std::pair<std::string, std::string>>& rules,
   const std::string& secret_or_pub,
   const std::string& algo)
 {
-  // This is so that we don't have to create the regexes everytime the policy is used.
-  std::unordered_map<std::string, std::regex> matchers;
+  // This is so that we don't have to create the regexes everytime the policy is
+  // used. The matchers are shared by every copy of the policy.
+  auto matchers = std::make_shared<std::vector<RuleMatcher>>();
+  matchers->reserve(rules.size());
   for (auto& r : rules)
-    matchers[r.first] = std::regex{r.second};
+    matchers->push_back(make_rule_matcher(r));
 
-  return [=](
+  return [matchers, secret_or_pub, algo](
     const json_t& /*header*/, const json_t& payload,
     VerificationStrategy& vs) -> bool
   {
-    for (auto& r : rules)
+    for (const RuleMatcher& matcher : *matchers)
     {
-      auto it = payload.find(r.first);
+      auto it = payload.find(matcher.key);
       if (it == payload.end() || !it->is_string())
         return false;
-      const std::string& s = it->get_ref<const std::string&>();
-      if (!std::regex_match(s, matchers.at(r.first)))
+      if (!matcher.matches(it->get_ref<const std::string&>()))
         return false;
     }
     vs.secret_or_pub = secret_or_pub;
@@ -18,7 +18,9 @@
 #ifndef SOSS__WEBSOCKET__SRC__JWTVALIDATOR_HPP
 #define SOSS__WEBSOCKET__SRC__JWTVALIDATOR_HPP
 
+#include <chrono>
 #include <functional>
+#include <memory>
 #include <jwt/jwt.hpp>
 
 namespace soss {
@@ -37,8 +39,20 @@ typedef std::function<
 class JwtValidator
 {
 public:
+  /// The number of verified tokens that are remembered by default
+  static const std::size_t DefaultCacheSize = 1024;
+
+  JwtValidator(std::size_t cache_size = DefaultCacheSize);
+
+  /// \brief Verifies a token, unless the same token has already been verified
+  /// recently and has not expired since then.
+  /// \remarks This may be called from several threads at once.
   bool verify(const std::string& token);
 
+  /// \brief Sets the number of verified tokens to remember. A cache size of
+  /// zero turns the cache off.
+  void set_cache_size(std::size_t cache_size);
+
   /// \brief Adds a policy to resolve the verification strategy to use
   /// \details The VerificationPolicy should set the VerificationStrategy and returns true if
   /// it is able to provide a strategy. If there are multiple policies that can process a token,
@@ -51,8 +65,20 @@ public:
   /// \param policy
   void add_verification_policy(const VerificationPolicy& policy);
 
+  JwtValidator(JwtValidator&&);
+  JwtValidator& operator=(JwtValidator&&);
+  ~JwtValidator();
+
+  class TokenCache;
 private:
+  /// \brief Runs the full verification of a token
+  /// \param[out] expiry The time when the token expires
+  bool _verify_uncached(
+    const std::string& token,
+    std::chrono::system_clock::time_point& expiry) const;
+
   std::vector<VerificationPolicy> _verification_policies;
+  std::unique_ptr<TokenCache> _cache;
 };
 
 class VerificationPolicies
@@ -17,13 +17,23 @@
 
 #include "Endpoint.hpp"
 #include "ServerConfig.hpp"
+#include "TlsSessions.hpp"
 #include "websocket_types.hpp"
 #include "JwtValidator.hpp"
 
 #include <soss/Search.hpp>
+#include <soss/ThreadSettings.hpp>
 #include <websocketpp/endpoint.hpp>
 #include <websocketpp/http/constants.hpp>
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
 namespace soss {
 namespace websocket {
 
@@ -38,6 +48,19 @@ const std::string YamlFormatAsn1Value = "asn.1";
 
 const std::string YamlAuthKey = "authentication";
 
+const std::string YamlIoThreadsKey = "io_threads";
+
+const std::string YamlReusePortKey = "reuse_port";
+
+// Limits on what each client may send us, so that one misbehaving client
+// cannot starve the others
+const std::string YamlAdmissionKey = "admission";
+const std::string YamlMaxConnectionsKey = "max_connections";
+const std::string YamlMessagesPerSecondKey = "messages_per_second";
+const std::string YamlBytesPerSecondKey = "bytes_per_second";
+const std::string YamlBurstKey = "burst";
+const std::string YamlMaxServiceCallsKey = "max_service_calls";
+
 //==============================================================================
 static std::string find_websocket_config_file(
     const YAML::Node& configuration,
@@ -118,108 +141,350 @@ static boost::asio::ssl::context::file_format parse_format(
 }
 
 //==============================================================================
-static bool all_closed(
-    const std::unordered_set<WsCppConnectionPtr>& connections)
+static std::size_t parse_io_threads(const YAML::Node& configuration)
 {
-  for(const auto& connection : connections)
+  const YAML::Node node = configuration[YamlIoThreadsKey];
+  if(!node)
+    return 1;
+
+  const int threads = node.as<int>(0);
+  if(threads < 1)
   {
-    if(connection->get_state() != websocketpp::session::state::closed)
-      return false;
+    std::cerr << "[soss::websocket::Server] The [" << YamlIoThreadsKey
+              << "] setting must be a positive integer, but it was given ["
+              << node.as<std::string>("") << "]" << std::endl;
+    return 0;
+  }
+
+  return static_cast<std::size_t>(threads);
+}
+
+//==============================================================================
+struct AdmissionLimits
+{
+  /// The most clients that may be connected at once, or 0 for no limit
+  std::size_t max_connections = 0;
+
+  /// The rates at which each client may send us messages and bytes, or 0 for
+  /// no limit
+  double messages_per_second = 0.0;
+  double bytes_per_second = 0.0;
+
+  /// How many seconds worth of each rate a client may send at once after it
+  /// has been quiet
+  double burst = 1.0;
+
+  /// The most service requests of each client that may wait for a response,
+  /// or 0 for no limit
+  std::size_t max_service_calls = 0;
+
+  bool limits_rates() const
+  {
+    return messages_per_second > 0.0 || bytes_per_second > 0.0;
   }
+};
+
+//==============================================================================
+/// Parse the optional admission setting, which is a map with the optional
+/// entries max_connections, messages_per_second, bytes_per_second, burst and
+/// max_service_calls.
+///
+/// \returns false if the setting is invalid.
+static bool parse_admission(
+    const YAML::Node& configuration,
+    AdmissionLimits& limits)
+{
+  const YAML::Node node = configuration[YamlAdmissionKey];
+  if(!node)
+    return true;
+
+  const auto parse = [&](const std::string& key, double& value) -> bool
+  {
+    if(const YAML::Node entry = node[key])
+    {
+      value = entry.as<double>();
+      if(value < 0.0)
+      {
+        std::cerr << "[soss::websocket::Server] The [" << key << "] of the ["
+                  << YamlAdmissionKey << "] setting must not be negative, but "
+                  << "it is [" << value << "]" << std::endl;
+        return false;
+      }
+    }
 
+    return true;
+  };
+
+  double max_connections = 0.0;
+  double max_service_calls = 0.0;
+  if(!parse(YamlMaxConnectionsKey, max_connections)
+     || !parse(YamlMessagesPerSecondKey, limits.messages_per_second)
+     || !parse(YamlBytesPerSecondKey, limits.bytes_per_second)
+     || !parse(YamlBurstKey, limits.burst)
+     || !parse(YamlMaxServiceCallsKey, max_service_calls))
+    return false;
+
+  limits.max_connections = static_cast<std::size_t>(max_connections);
+  limits.max_service_calls = static_cast<std::size_t>(max_service_calls);
   return true;
 }
 
 //==============================================================================
-class Server : public Endpoint
+/// A token bucket that refills at a steady rate. A message is let through as
+/// long as any tokens are left, even if it costs more than that, so that a
+/// message larger than the whole bucket is still let through once it is full.
+class TokenBucket
 {
 public:
 
-  Server()
+  TokenBucket(const double rate, const double burst)
+    : _rate(rate),
+      _capacity(rate * std::max(burst, 0.001)),
+      _tokens(_capacity),
+      _last(std::chrono::steady_clock::now())
   {
     // Do nothing
   }
 
-  WsCppEndpoint* configure_endpoint(
-      const RequiredTypes& /*types*/,
-      const YAML::Node& configuration) override
+  bool take(
+      const double cost,
+      const std::chrono::steady_clock::time_point now)
   {
-    const int32_t port = parse_port(configuration);
-    if(port < 0)
-      return nullptr;
-    const uint16_t uport = static_cast<uint16_t>(port);
+    if(_rate <= 0.0)
+      return true;
+
+    const std::chrono::duration<double> elapsed = now - _last;
+    _last = now;
+    _tokens = std::min(_capacity, _tokens + elapsed.count() * _rate);
+    if(_tokens <= 0.0)
+      return false;
+
+    _tokens -= cost;
+    return true;
+  }
+
+private:
+
+  double _rate;
+  double _capacity;
+  double _tokens;
+  std::chrono::steady_clock::time_point _last;
+
+};
+
+//==============================================================================
+/// ServerSecurity sets up whatever a server of the given configuration needs
+/// before it can accept connections.
+template<typename Config>
+struct ServerSecurity;
+
+//==============================================================================
+template<>
+struct ServerSecurity<TlsConfig>
+{
+  static bool configure(
+      WsCppServerT<TlsConfig>& server,
+      const YAML::Node& configuration,
+      const uint16_t port,
+      const std::string& metrics_prefix)
+  {
+    TlsSettings settings;
+    if(!parse_tls(configuration, settings))
+      return false;
 
     const std::string cert_file = find_certificate(configuration);
     if(cert_file.empty())
-      return nullptr;
+      return false;
 
     const std::string key_file = find_private_key(configuration);
     if(key_file.empty())
-      return nullptr;
+      return false;
 
     const boost::asio::ssl::context::file_format format =
         parse_format(configuration);
 
-    const YAML::Node auth_node = configuration[YamlAuthKey];
-    if (auth_node)
-    {
-      _jwt_validator = std::make_unique<JwtValidator>();
-      bool success = ServerConfig::load_auth_policy(*_jwt_validator, auth_node);
-      if (!success)
-      {
-        std::cerr << "error loading auth config" << std::endl;
-        return nullptr;
-      }
-    }
+    const WsCppSslContextPtr context =
+        make_context(cert_file, key_file, format);
+    if(!context)
+      return false;
 
-    if(!configure_server(uport, cert_file, key_file, format))
-      return nullptr;
+    // Clients that reconnect to this port may resume their sessions
+    if(!configure_server_tls(
+         context->native_handle(), settings,
+         "soss-websocket:" + std::to_string(port), metrics_prefix))
+      return false;
+
+    server.set_tls_init_handler(
+          [context](WsCppWeakConnectPtr /*handle*/) -> WsCppSslContextPtr
+    {
+      return context;
+    });
 
-    return &_server;
+    return true;
   }
 
-  bool configure_server(
-      const uint16_t port,
+  static WsCppSslContextPtr make_context(
       const std::string& cert_file,
       const std::string& key_file,
       const boost::asio::ssl::context::file_format format)
   {
     namespace asio = boost::asio;
 
-    _context = std::make_shared<WsCppSslContext>(asio::ssl::context::tls);
-    _context->set_options(
+    const WsCppSslContextPtr context =
+        std::make_shared<WsCppSslContext>(asio::ssl::context::tls);
+    context->set_options(
           asio::ssl::context::default_workarounds |
           asio::ssl::context::no_sslv2 |
           asio::ssl::context::no_sslv3);
 
     boost::system::error_code ec;
-    _context->use_certificate_file(cert_file, format, ec);
+    context->use_certificate_file(cert_file, format, ec);
     if(ec)
     {
       std::cerr << "[soss::websocket::Server] Failed to load certificate file ["
                 << cert_file << "]: " << ec.message() << std::endl;
-      return false;
+      return nullptr;
     }
 
-    // TODO(MXG): There is an alternative function
-    // _context->use_private_key(key_file, format, ec);
-    // which I guess is supposed to be used for keys that do not label
-    // themselves as rsa private keys? We're currently using rsa private
-    // keys, but this is probably something we should allow users to
-    // configure from the soss config file.
-    _context->use_rsa_private_key_file(key_file, format, ec);
+    // This takes RSA keys as well as the EC keys of ECDSA certificates
+    context->use_private_key_file(key_file, format, ec);
     if(ec)
     {
       std::cerr << "[soss::websocket::Server] Failed to load private key file ["
                 << key_file << "]: " << ec.message() << std::endl;
+      return nullptr;
+    }
+
+    return context;
+  }
+};
+
+//==============================================================================
+template<>
+struct ServerSecurity<TcpConfig>
+{
+  static bool configure(
+      WsCppServerT<TcpConfig>& /*server*/,
+      const YAML::Node& configuration,
+      const uint16_t /*port*/,
+      const std::string& /*metrics_prefix*/)
+  {
+    // Plain connections need neither a certificate nor a private key
+    if(configuration[YamlTlsKey])
+    {
+      std::cerr << "[soss::websocket::Server] The [" << YamlTlsKey
+                << "] setting is ignored, because plain connections do not "
+                << "use TLS" << std::endl;
+    }
+
+    return true;
+  }
+};
+
+//==============================================================================
+template<typename Config>
+class ServerT : public TransportEndpoint<Config>
+{
+public:
+
+  using ConnectionPtr = typename TransportEndpoint<Config>::ConnectionPtr;
+
+  ServerT()
+    : _deflate(DeflateSettings::Role::Server),
+      _closing_down(false)
+  {
+    // Do nothing
+  }
+
+  bool configure_endpoint(
+      const RequiredTypes& /*types*/,
+      const YAML::Node& configuration) override
+  {
+    const int32_t port = parse_port(configuration);
+    if(port < 0)
+      return false;
+    const uint16_t uport = static_cast<uint16_t>(port);
+
+    const std::string metrics_prefix =
+        "websocket_server:" + std::to_string(uport) + "/";
+
+    if(!ServerSecurity<Config>::configure(
+         _server, configuration, uport, metrics_prefix))
       return false;
+
+    const std::size_t io_threads = parse_io_threads(configuration);
+    if(io_threads == 0)
+      return false;
+
+    if(!_thread_settings.parse(
+         configuration[YamlThreadKey], "websocket server"))
+      return false;
+
+    if(!parse_permessage_deflate(configuration, _deflate))
+      return false;
+
+    _compressed = _deflate.enabled;
+
+    const bool reuse_port = configuration[YamlReusePortKey].as<bool>(false);
+
+    if(!parse_admission(configuration, _admission))
+      return false;
+
+    // Anything that a client is not allowed to send counts as a drop on these
+    _throttled = &soss::Metrics::connection(metrics_prefix + "throttled");
+    _rejected = &soss::Metrics::connection(metrics_prefix + "rejected");
+    this->set_fragment_metrics(
+          soss::Metrics::connection(metrics_prefix + "fragments"));
+    this->set_max_service_calls(_admission.max_service_calls, *_throttled);
+
+    const YAML::Node auth_node = configuration[YamlAuthKey];
+    if (auth_node)
+    {
+      _jwt_validator = std::make_unique<JwtValidator>();
+      bool success = ServerConfig::load_auth_policy(*_jwt_validator, auth_node);
+      if (!success)
+      {
+        std::cerr << "error loading auth config" << std::endl;
+        return false;
+      }
     }
 
+    return configure_server(uport, io_threads, reuse_port);
+  }
+
+  bool configure_server(
+      const uint16_t port,
+      const std::size_t io_threads = 1,
+      const bool reuse_port = false)
+  {
     // TODO(MXG): This helps to rerun soss more quickly if the server fell down
     // gracelessly. Is this something we really want? Are there any dangers to
     // using this?
     _server.set_reuse_addr(true);
 
+    _clustered = reuse_port;
+    if(reuse_port)
+    {
+      // Several soss processes may listen on the same port, and the kernel
+      // spreads the incoming connections across them.
+      _server.set_tcp_pre_bind_handler(
+            [](typename WsCppServerT<Config>::acceptor_ptr acceptor)
+            -> websocketpp::lib::error_code
+      {
+        boost::system::error_code ec;
+        acceptor->set_option(ReusePort(true), ec);
+        if(ec)
+        {
+          std::cerr << "[soss::websocket::Server] Failed to share the port "
+                    << "with other processes: " << ec.message() << std::endl;
+          return websocketpp::transport::asio::error::make_error_code(
+                websocketpp::transport::asio::error::pass_through);
+        }
+
+        return websocketpp::lib::error_code();
+      });
+    }
+
     _server.clear_access_channels(
           websocketpp::log::alevel::frame_header |
           websocketpp::log::alevel::frame_payload);
@@ -251,12 +516,6 @@ public:
       this->_handle_failed_connection(std::move(handle));
     });
 
-    _server.set_tls_init_handler(
-          [&](WsCppWeakConnectPtr /*handle*/) -> WsCppSslContextPtr
-    {
-      return _context;
-    });
-
     _server.set_validate_handler(
           [&](WsCppWeakConnectPtr handle) -> bool
     {
@@ -265,49 +524,54 @@ public:
 
     _server.listen(port);
 
-    _server_thread = std::thread([&](){ this->_server.run(); });
+    // The asio transport of websocketpp wraps the handlers of each connection
+    // in a strand, so the messages of one connection are always handled in
+    // order, while different connections get handled by the whole pool.
+    _server_threads.reserve(io_threads);
+    for(std::size_t i=0; i < io_threads; ++i)
+    {
+      _server_threads.emplace_back([&]()
+      {
+        this->_thread_settings.apply("soss-ws-server");
+        const DeflateSettings::Binding deflate(this->_deflate);
+        this->_server.run();
+      });
+    }
 
     return true;
   }
 
-  ~Server() override
+  ~ServerT() override
   {
     _closing_down = true;
 
+    // Stop interpreting inbound messages before any connection goes away
+    this->stop_workers();
+
     // NOTE(MXG): _open_connections can get modified in other threads so we'll
     // make a copy of it here before using it.
-    // TODO(MXG): We should probably be using mutexes to protect the operations
-    // on these connections.
-
-    // First instruct all connections to close
-    const auto connection_copies = _open_connections;
-    for(const auto& connection : connection_copies)
-      connection->close(websocketpp::close::status::normal, "shutdown");
 
-    // Then wait for all of them to close
-
-    using namespace std::chrono_literals;
-    const auto start_time = std::chrono::steady_clock::now();
-    // TODO(MXG): Make these timeout parameters something that can be
-    // configured by users.
-    while(!all_closed(connection_copies))
+    // Instruct all connections to close, and wait until the last of them has
+    const std::vector<ConnectionPtr> connection_copies = [&]()
     {
-      std::this_thread::sleep_for(200ms);
+      std::unique_lock<std::mutex> lock(_connection_mutex);
+      return std::vector<ConnectionPtr>(
+            _open_connections.begin(), _open_connections.end());
+    }();
 
-      if(std::chrono::steady_clock::now() - start_time > 10s)
-      {
-        std::cerr << "[soss::websocket::Server] Timed out while waiting for "
-                  << "the remote clients to acknowledge the connection "
-                  << "shutdown request" << std::endl;
-        break;
-      }
+    if(!this->close_and_wait(connection_copies))
+    {
+      std::cerr << "[soss::websocket::Server] Timed out while waiting for "
+                << "the remote clients to acknowledge the connection "
+                << "shutdown request" << std::endl;
     }
 
-    if(_server_thread.joinable())
+    if(!_server_threads.empty())
     {
       _server.stop();
 
-      _server_thread.join();
+      for(std::thread& thread : _server_threads)
+        thread.join();
     }
   }
 
@@ -325,12 +589,30 @@ public:
       _server.start_accept();
     }
 
-    std::this_thread::sleep_for(std::chrono::milliseconds(100));
-
     // TODO(MXG): How do we know if the server is okay?
     return true;
   }
 
+  bool shares_prepared_frames() const override
+  {
+    // Server frames are never masked, so every connection can send the exact
+    // same bytes, unless each connection compresses its frames with its own
+    // deflate stream.
+    return !_compressed;
+  }
+
+  bool clustered() const override
+  {
+    return _clustered;
+  }
+
+  bool self_driven() const override
+  {
+    // All the work of the server happens on _server_threads, so soss only needs
+    // to spin us once to start accepting connections.
+    return true;
+  }
+
   void runtime_advertisement(
       const std::string& topic,
       const std::string& message_type,
@@ -338,21 +620,80 @@ public:
       const YAML::Node& configuration) override
   {
     const std::string advertise_msg =
-        get_encoding().encode_advertise_msg(
+        this->get_encoding().encode_advertise_msg(
           topic, message_type, id, configuration);
 
-    for(const WsCppConnectionPtr& connection : _open_connections)
-      connection->send(advertise_msg);
+    std::vector<std::shared_ptr<void>> connections;
+    {
+      std::unique_lock<std::mutex> lock(_connection_mutex);
+      connections.assign(_open_connections.begin(), _open_connections.end());
+    }
+
+    this->broadcast_payload(connections, advertise_msg);
+  }
+
+protected:
+
+  typename TransportEndpoint<Config>::WsEndpoint& ws_endpoint() override
+  {
+    return _server;
   }
 
 private:
 
+  using ReusePort = boost::asio::detail::socket_option::boolean<
+      SOL_SOCKET, SO_REUSEPORT>;
+
   void _handle_message(
       const WsCppWeakConnectPtr& handle,
       const WsCppMessagePtr& message)
   {
-    get_encoding().interpret_websocket_msg(
-          message->get_payload(), *this, _server.get_con_from_hdl(handle));
+    if(_admission.limits_rates() && !_admit(handle, *message))
+      return;
+
+    this->receive_message_ws(message, _server.get_con_from_hdl(handle));
+  }
+
+  /// Check a message against the rate limits of its connection before we
+  /// spend any time on parsing it
+  bool _admit(const WsCppWeakConnectPtr& handle, const WsCppMessage& message)
+  {
+    const ConnectionPtr connection = _server.get_con_from_hdl(handle);
+    std::shared_ptr<Admission> admission;
+    {
+      std::unique_lock<std::mutex> lock(_connection_mutex);
+      const auto it = _admissions.find(connection.get());
+      if(it == _admissions.end())
+        return true;
+
+      admission = it->second;
+    }
+
+    // The messages of a connection are handled one at a time on its strand,
+    // so its buckets need no lock of their own
+    const std::size_t size = message.get_payload().size();
+    const auto now = std::chrono::steady_clock::now();
+    if(admission->messages.take(1.0, now)
+       && admission->bytes.take(static_cast<double>(size), now))
+    {
+      admission->throttling = false;
+      return true;
+    }
+
+    _throttled->count_drop();
+    _throttled->count_bytes(size);
+
+    // Complain once each time a connection starts to get throttled
+    if(!admission->throttling)
+    {
+      admission->throttling = true;
+      std::cerr << "[soss::websocket::Server] The client connection ["
+                << connection << "] is sending faster than the ["
+                << YamlAdmissionKey << "] limits allow. Its messages are "
+                << "being dropped." << std::endl;
+    }
+
+    return false;
   }
 
   void _handle_close(const WsCppWeakConnectPtr& handle)
@@ -360,9 +701,11 @@ private:
     const auto connection = _server.get_con_from_hdl(handle);
     std::cout << "[soss::websocket::Server] closed client connection ["
               << connection << "]" << std::endl;
-    notify_connection_closed(connection);
+    this->notify_connection_closed(connection);
 
+    std::unique_lock<std::mutex> lock(_connection_mutex);
     _open_connections.erase(connection);
+    _admissions.erase(connection.get());
   }
 
   void _handle_opening(const WsCppWeakConnectPtr& handle)
@@ -377,9 +720,18 @@ private:
 
     std::cout << "[soss::weboscket::Server] opened connection [" << connection
               << "]" << std::endl;
-    notify_connection_opened(connection);
+    this->notify_connection_opened(connection);
 
+    std::unique_lock<std::mutex> lock(_connection_mutex);
     _open_connections.insert(connection);
+    if(_admission.limits_rates())
+    {
+      _admissions[connection.get()] = std::make_shared<Admission>(
+            Admission{
+              TokenBucket(_admission.messages_per_second, _admission.burst),
+              TokenBucket(_admission.bytes_per_second, _admission.burst),
+              false});
+    }
   }
 
   void _handle_failed_connection(const WsCppWeakConnectPtr& /*handle*/)
@@ -390,10 +742,23 @@ private:
 
   bool _handle_validate(const WsCppWeakConnectPtr& handle)
   {
+    ConnectionPtr connection_ptr = _server.get_con_from_hdl(handle);
+    if(_admission.max_connections > 0)
+    {
+      std::unique_lock<std::mutex> lock(_connection_mutex);
+      if(_open_connections.size() >= _admission.max_connections)
+      {
+        lock.unlock();
+        _rejected->count_drop();
+        connection_ptr->set_status(
+              websocketpp::http::status_code::service_unavailable);
+        return false;
+      }
+    }
+
     if (!_jwt_validator)
       return true;
 
-    decltype(_server)::connection_ptr connection_ptr = _server.get_con_from_hdl(handle);
     std::vector<std::string> requested_sub_protos = connection_ptr->get_requested_subprotocols();
     if (requested_sub_protos.size() != 1)
     {
@@ -411,18 +776,42 @@ private:
     return true;
   }
 
-  WsCppServer _server;
-  std::thread _server_thread;
-  EncodingPtr _encoding;
-  WsCppSslContextPtr _context;
-  std::unordered_set<WsCppConnectionPtr> _open_connections;
+  // The rate limits of one connection
+  struct Admission
+  {
+    TokenBucket messages;
+    TokenBucket bytes;
+
+    // True while the messages of the connection are being dropped
+    bool throttling;
+  };
+
+  WsCppServerT<Config> _server;
+  std::vector<std::thread> _server_threads;
+  ThreadSettings _thread_settings;
+  DeflateSettings _deflate;
+  std::unordered_set<ConnectionPtr> _open_connections;
+  std::mutex _connection_mutex;
   bool _has_spun_once = false;
-  bool _closing_down = false;
+  bool _compressed = false;
+  bool _clustered = false;
+  std::atomic_bool _closing_down;
   std::unique_ptr<JwtValidator> _jwt_validator;
 
+  AdmissionLimits _admission;
+  soss::ChannelMetrics* _throttled = nullptr;
+  soss::ChannelMetrics* _rejected = nullptr;
+
+  // The rate limits of each open connection, protected by _connection_mutex
+  std::unordered_map<const void*, std::shared_ptr<Admission>> _admissions;
+
 };
 
+using Server = ServerT<TlsConfig>;
+using PlainServer = ServerT<TcpConfig>;
+
 SOSS_REGISTER_SYSTEM("websocket_server", soss::websocket::Server)
+SOSS_REGISTER_SYSTEM("websocket_server_plain", soss::websocket::PlainServer)
 
 } // namespace websocket
 } // namespace soss
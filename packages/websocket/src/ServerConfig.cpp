@@ -28,9 +28,15 @@ const std::string YamlRulesKey = "rules";
 const std::string YamlSecretKey = "secret";
 const std::string YamlPubkeyKey = "pubkey";
 const std::string YamlAlgoKey = "algo";
+const std::string YamlCacheSizeKey = "cache_size";
 
 bool ServerConfig::load_auth_policy(JwtValidator& jwt_validator, const YAML::Node& auth_node)
 {
+  if (const YAML::Node cache_size_node = auth_node[YamlCacheSizeKey])
+  {
+    jwt_validator.set_cache_size(cache_size_node.as<std::size_t>());
+  }
+
   const YAML::Node& policies_node = auth_node[YamlPoliciesKey];
   for (auto& policy_node : policies_node)
   {
@@ -42,6 +42,12 @@ public:
     _endpoint.call_service(_service, request, client, call_handle);
   }
 
+  void cancel_service_call(
+      const std::shared_ptr<void>& call_handle) override
+  {
+    _endpoint.cancel_service_call(call_handle);
+  }
+
   ~ServiceProvider() override = default;
 
 private:
@@ -0,0 +1,309 @@
+/*
+ * Copyright (C) 2019 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include "TlsSessions.hpp"
+
+#include <soss/Metrics.hpp>
+
+#include <openssl/err.h>
+
+#include <algorithm>
+#include <iostream>
+#include <mutex>
+
+namespace soss {
+namespace websocket {
+
+namespace {
+
+//==============================================================================
+/// What soss keeps alongside each TLS context that it configures
+struct TlsState
+{
+  soss::ChannelMetrics* full_handshakes;
+  soss::ChannelMetrics* resumed_handshakes;
+
+  /// The last session that a client context established
+  std::mutex mutex;
+  SSL_SESSION* last_session = nullptr;
+
+  ~TlsState()
+  {
+    if(last_session)
+      SSL_SESSION_free(last_session);
+  }
+};
+
+//==============================================================================
+void free_state(
+    void* /*parent*/,
+    void* ptr,
+    CRYPTO_EX_DATA* /*ad*/,
+    int /*idx*/,
+    long /*argl*/,
+    void* /*argp*/)
+{
+  delete static_cast<TlsState*>(ptr);
+}
+
+//==============================================================================
+int state_index()
+{
+  static const int index =
+      SSL_CTX_get_ex_new_index(0, nullptr, nullptr, nullptr, &free_state);
+  return index;
+}
+
+//==============================================================================
+/// Marks the connections whose handshake has been counted already, since
+/// OpenSSL also reports the messages that follow a TLS 1.3 handshake as
+/// handshakes of their own
+int counted_index()
+{
+  static const int index =
+      SSL_get_ex_new_index(0, nullptr, nullptr, nullptr, nullptr);
+  return index;
+}
+
+//==============================================================================
+TlsState* state_of(const SSL* ssl)
+{
+  return static_cast<TlsState*>(
+        SSL_CTX_get_ex_data(SSL_get_SSL_CTX(ssl), state_index()));
+}
+
+//==============================================================================
+void count_handshake(const SSL* ssl, const int where, const int /*ret*/)
+{
+  if(!(where & SSL_CB_HANDSHAKE_DONE))
+    return;
+
+  SSL* const connection = const_cast<SSL*>(ssl);
+  if(SSL_get_ex_data(connection, counted_index()))
+    return;
+
+  SSL_set_ex_data(connection, counted_index(), connection);
+
+  TlsState* const state = state_of(ssl);
+  if(!state)
+    return;
+
+  if(SSL_session_reused(connection))
+    state->resumed_handshakes->count_message();
+  else
+    state->full_handshakes->count_message();
+}
+
+//==============================================================================
+int remember_session(SSL* ssl, SSL_SESSION* session)
+{
+  TlsState* const state = state_of(ssl);
+  if(!state)
+    return 0;
+
+  std::unique_lock<std::mutex> lock(state->mutex);
+  if(state->last_session)
+    SSL_SESSION_free(state->last_session);
+
+  // Returning 1 tells OpenSSL that we keep the reference to the session
+  state->last_session = session;
+  return 1;
+}
+
+//==============================================================================
+std::string openssl_error()
+{
+  const unsigned long code = ERR_get_error();
+  if(code == 0)
+    return "unknown error";
+
+  char buffer[256];
+  ERR_error_string_n(code, buffer, sizeof(buffer));
+  return buffer;
+}
+
+//==============================================================================
+/// Set up what servers and clients have in common
+bool configure_common(
+    SSL_CTX* context,
+    const TlsSettings& settings,
+    const std::string& metrics_prefix)
+{
+  if(SSL_CTX_set_cipher_list(context, settings.ciphers.c_str()) != 1)
+  {
+    std::cerr << "[soss::websocket] None of the [ciphers] in the ["
+              << YamlTlsKey << "] setting can be used: " << openssl_error() << std::endl;
+    return false;
+  }
+
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
+  // Newer versions of OpenSSL always pick the curve of the ECDHE key exchange
+  // automatically
+  SSL_CTX_set_ecdh_auto(context, 1);
+#endif
+
+  if(!settings.session_tickets)
+    SSL_CTX_set_options(context, SSL_OP_NO_TICKET);
+
+  TlsState* const state = new TlsState;
+  state->full_handshakes =
+      &soss::Metrics::connection(metrics_prefix + "tls_full_handshakes");
+  state->resumed_handshakes =
+      &soss::Metrics::connection(metrics_prefix + "tls_resumed_handshakes");
+
+  if(SSL_CTX_set_ex_data(context, state_index(), state) != 1)
+  {
+    delete state;
+    std::cerr << "[soss::websocket] Failed to attach the session state to a "
+              << "TLS context: " << openssl_error() << std::endl;
+    return false;
+  }
+
+  SSL_CTX_set_info_callback(context, &count_handshake);
+  return true;
+}
+
+} // anonymous namespace
+
+//==============================================================================
+bool parse_tls(const YAML::Node& configuration, TlsSettings& settings)
+{
+  const YAML::Node node = configuration[YamlTlsKey];
+  if(!node)
+    return true;
+
+  if(!node.IsMap())
+  {
+    std::cerr << "[soss::websocket::SystemHandle::configure] The ["
+              << YamlTlsKey << "] setting must be a map" << std::endl;
+    return false;
+  }
+
+  if(const YAML::Node cache_node = node["session_cache"])
+  {
+    const long long size = cache_node.as<long long>(-1);
+    if(size < 0)
+    {
+      std::cerr << "[soss::websocket::SystemHandle::configure] The "
+                << "[session_cache] of [" << YamlTlsKey << "] must not be "
+                << "negative, but it was given ["
+                << cache_node.as<std::string>("") << "]" << std::endl;
+      return false;
+    }
+
+    settings.session_cache = static_cast<std::size_t>(size);
+  }
+
+  if(const YAML::Node lifetime_node = node["session_lifetime"])
+  {
+    const long long lifetime = lifetime_node.as<long long>(0);
+    if(lifetime <= 0)
+    {
+      std::cerr << "[soss::websocket::SystemHandle::configure] The "
+                << "[session_lifetime] of [" << YamlTlsKey << "] must be a "
+                << "positive number of seconds, but it was given ["
+                << lifetime_node.as<std::string>("") << "]" << std::endl;
+      return false;
+    }
+
+    settings.session_lifetime = std::chrono::seconds(lifetime);
+  }
+
+  if(const YAML::Node tickets_node = node["session_tickets"])
+    settings.session_tickets = tickets_node.as<bool>(true);
+
+  if(const YAML::Node ciphers_node = node["ciphers"])
+    settings.ciphers = ciphers_node.as<std::string>();
+
+  return true;
+}
+
+//==============================================================================
+bool configure_server_tls(
+    SSL_CTX* context,
+    const TlsSettings& settings,
+    const std::string& session_id_context,
+    const std::string& metrics_prefix)
+{
+  if(!configure_common(context, settings, metrics_prefix))
+    return false;
+
+  // Our order of ciphers wins, so that clients get the cheapest handshake
+  // that they support
+  SSL_CTX_set_options(context, SSL_OP_CIPHER_SERVER_PREFERENCE);
+
+  if(settings.session_cache == 0)
+  {
+    SSL_CTX_set_session_cache_mode(context, SSL_SESS_CACHE_OFF);
+  }
+  else
+  {
+    SSL_CTX_set_session_cache_mode(context, SSL_SESS_CACHE_SERVER);
+    SSL_CTX_sess_set_cache_size(
+          context, static_cast<long>(settings.session_cache));
+  }
+
+  // The lifetime also applies to the sessions in tickets
+  SSL_CTX_set_timeout(context, static_cast<long>(
+                        settings.session_lifetime.count()));
+
+  const std::size_t id_length = std::min<std::size_t>(
+        session_id_context.size(), SSL_MAX_SID_CTX_LENGTH);
+  if(SSL_CTX_set_session_id_context(
+       context,
+       reinterpret_cast<const unsigned char*>(session_id_context.data()),
+       static_cast<unsigned int>(id_length)) != 1)
+  {
+    std::cerr << "[soss::websocket::Server] Failed to set the TLS session id "
+              << "context: " << openssl_error() << std::endl;
+    return false;
+  }
+
+  return true;
+}
+
+//==============================================================================
+bool configure_client_tls(
+    SSL_CTX* context,
+    const TlsSettings& settings,
+    const std::string& metrics_prefix)
+{
+  if(!configure_common(context, settings, metrics_prefix))
+    return false;
+
+  // OpenSSL hands each new session to remember_session(~) instead of keeping
+  // them in a cache of its own, since a client only needs the latest one
+  SSL_CTX_set_session_cache_mode(
+        context, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+  SSL_CTX_sess_set_new_cb(context, &remember_session);
+  return true;
+}
+
+//==============================================================================
+void resume_tls_session(SSL* ssl)
+{
+  TlsState* const state = state_of(ssl);
+  if(!state)
+    return;
+
+  std::unique_lock<std::mutex> lock(state->mutex);
+  if(state->last_session)
+    SSL_set_session(ssl, state->last_session);
+}
+
+} // namespace websocket
+} // namespace soss
@@ -0,0 +1,109 @@
+/*
+ * Copyright (C) 2019 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#ifndef SOSS__WEBSOCKET__SRC__TLSSESSIONS_HPP
+#define SOSS__WEBSOCKET__SRC__TLSSESSIONS_HPP
+
+#include <openssl/ssl.h>
+
+#include <yaml-cpp/yaml.h>
+
+#include <chrono>
+#include <string>
+
+namespace soss {
+namespace websocket {
+
+//==============================================================================
+/// The key of the TlsSettings of a websocket server or client
+const std::string YamlTlsKey = "tls";
+
+//==============================================================================
+/// ECDHE key exchanges, with ECDSA certificates preferred over RSA ones, since
+/// their handshakes cost the server far less CPU. Only AEAD ciphers are used.
+const std::string DefaultTlsCiphers =
+    "ECDHE-ECDSA-AES128-GCM-SHA256:ECDHE-ECDSA-CHACHA20-POLY1305:"
+    "ECDHE-ECDSA-AES256-GCM-SHA384:ECDHE-RSA-AES128-GCM-SHA256:"
+    "ECDHE-RSA-CHACHA20-POLY1305:ECDHE-RSA-AES256-GCM-SHA384";
+
+//==============================================================================
+/// TlsSettings decide how expensive the TLS handshakes of a websocket server
+/// or client are. A peer that reconnects can resume its earlier TLS session,
+/// either from the session cache of the server or from a session ticket, which
+/// skips the certificate exchange and the public key operations.
+struct TlsSettings
+{
+  /// The most sessions that a server remembers for resumption. Zero turns the
+  /// session cache off. Clients keep the last session of each server instead.
+  std::size_t session_cache = 1024;
+
+  /// How long a session may be resumed after it was established
+  std::chrono::seconds session_lifetime = std::chrono::seconds(300);
+
+  /// Whether sessions may be resumed from tickets, which the server hands to
+  /// its clients instead of remembering the sessions itself
+  bool session_tickets = true;
+
+  /// The OpenSSL cipher list for TLS 1.2 and older, in order of preference
+  std::string ciphers = DefaultTlsCiphers;
+};
+
+//==============================================================================
+/// Parse the optional tls setting of a websocket server or client, which is a
+/// map with the optional entries session_cache, session_lifetime (in seconds),
+/// session_tickets and ciphers.
+///
+/// \returns false if the setting is invalid.
+bool parse_tls(const YAML::Node& configuration, TlsSettings& settings);
+
+//==============================================================================
+/// \brief Set up the session cache, session tickets and ciphers of the TLS
+/// context of a server, and count its full and resumed handshakes in the
+/// metrics of the connections named <metrics_prefix>tls_full_handshakes and
+/// <metrics_prefix>tls_resumed_handshakes.
+///
+/// \param[in] session_id_context
+///   Sessions only get resumed by servers with the same session id context
+///
+/// \returns false if the context could not be set up
+bool configure_server_tls(
+    SSL_CTX* context,
+    const TlsSettings& settings,
+    const std::string& session_id_context,
+    const std::string& metrics_prefix);
+
+//==============================================================================
+/// \brief Set up the ciphers and session tickets of the TLS context of a
+/// client, have it remember the last session that it established, and count
+/// its handshakes like configure_server_tls(~) does.
+///
+/// \returns false if the context could not be set up
+bool configure_client_tls(
+    SSL_CTX* context,
+    const TlsSettings& settings,
+    const std::string& metrics_prefix);
+
+//==============================================================================
+/// \brief Offer the last session that the client context of this connection
+/// established, so that reconnecting skips the full handshake when the server
+/// still knows the session. This must be called before the handshake starts.
+void resume_tls_session(SSL* ssl);
+
+} // namespace websocket
+} // namespace soss
+
+#endif // SOSS__WEBSOCKET__SRC__TLSSESSIONS_HPP
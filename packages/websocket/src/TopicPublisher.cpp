@@ -39,11 +39,23 @@ public:
     _endpoint.startup_advertisement(topic, message_type, id, configuration);
   }
 
-  bool publish(const soss::Message& message)
+  bool publish(const soss::Message& message) override
   {
     return _endpoint.publish(_topic, message);
   }
 
+  bool publish_envelope(const soss::MessageEnvelope& envelope) override
+  {
+    return _endpoint.publish(_topic, envelope);
+  }
+
+  bool publish_batch(
+      const std::vector<std::shared_ptr<const soss::Message>>& messages)
+      override
+  {
+    return _endpoint.publish_batch(_topic, messages);
+  }
+
 private:
 
   const std::string _topic;
@@ -78,27 +90,45 @@ public:
       _message_type(message_type),
       _id(id),
       _config(configuration),
-      _endpoint(endpoint)
+      _endpoint(endpoint),
+      _topics(_string_template)
   {
     // Do nothing
   }
 
-  bool publish(const soss::Message& message)
+  bool publish(const soss::Message& message) override
   {
-    const std::string& topic = _string_template.compute_string(message);
-    const bool inserted = _advertised_topics.insert(topic).second;
-
-    if(inserted)
-    {
-      _endpoint.startup_advertisement(topic, _message_type, _id, _config);
-      _endpoint.runtime_advertisement(topic, _message_type, _id, _config);
-    }
+    return _endpoint.publish(_advertise_if_needed(message), message);
+  }
 
-    return _endpoint.publish(topic, message);
+  bool publish_envelope(const soss::MessageEnvelope& envelope) override
+  {
+    return _endpoint.publish(
+          _advertise_if_needed(envelope.message()), envelope);
   }
 
 private:
 
+  std::string _advertise_if_needed(const soss::Message& message)
+  {
+    // Messages may be published from several threads at once, and the topic
+    // that the cache hands out is only valid until its next lookup, so it
+    // gets copied out while the cache is locked
+    std::unique_lock<std::mutex> lock(_topics_mutex);
+    return _topics.get(message, [&](const std::string& topic)
+    {
+      const bool inserted = _advertised_topics.insert(topic).second;
+
+      if(inserted)
+      {
+        _endpoint.startup_advertisement(topic, _message_type, _id, _config);
+        _endpoint.runtime_advertisement(topic, _message_type, _id, _config);
+      }
+
+      return topic;
+    });
+  }
+
   const soss::StringTemplate _string_template;
   const std::string _message_type;
   const std::string _id;
@@ -106,6 +136,11 @@ private:
   std::unordered_set<std::string> _advertised_topics;
   Endpoint& _endpoint;
 
+  // Finds the topic of a message without computing its name. This and the
+  // advertised topics are guarded by the mutex.
+  soss::StringTemplateCache<std::string> _topics;
+  std::mutex _topics_mutex;
+
 };
 
 //==============================================================================
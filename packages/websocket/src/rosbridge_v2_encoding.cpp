@@ -20,8 +20,14 @@
 
 #include <soss/json/conversion.hpp>
 #include <soss/json/json.hpp>
+#include <soss/json/sax.hpp>
 
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <unordered_map>
 #include <unordered_set>
+#include <vector>
 
 namespace soss {
 namespace websocket {
@@ -40,6 +46,14 @@ const std::string JsonServiceKey = "service";
 const std::string JsonArgsKey = "args";
 const std::string JsonValuesKey = "values";
 const std::string JsonResultKey = "result";
+const std::string JsonDataKey = "data";
+const std::string JsonNumKey = "num";
+const std::string JsonTotalKey = "total";
+const std::string JsonThrottleRateKey = "throttle_rate";
+const std::string JsonQueueLengthKey = "queue_length";
+const std::string JsonFragmentSizeKey = "fragment_size";
+const std::string JsonCompressionKey = "compression";
+const std::string JsonDeltaKey = "delta";
 
 
 // op codes
@@ -52,73 +66,409 @@ const std::string JsonOpServiceRequestKey = "call_service";
 const std::string JsonOpAdvertiseServiceKey = "advertise_service";
 const std::string JsonOpUnadvertiseServiceKey = "unadvertise_service";
 const std::string JsonOpServiceResponseKey = "service_response";
+const std::string JsonOpFragmentKey = "fragment";
+
+// compression types
+const std::string JsonCompressionNone = "none";
+const std::string JsonCompressionCbor = "cbor";
+const std::string JsonCompressionPng = "png";
+
+//==============================================================================
+/// IncomingMessage is a SAX handler that reads the top-level fields of an
+/// incoming rosbridge message. The message payloads get built directly into
+/// soss::Messages as they are parsed, so we never need to construct a Json
+/// tree for the incoming message.
+class IncomingMessage : public nlohmann::json_sax<Json>
+{
+public:
+
+  const std::string* find_string(const std::string& key) const
+  {
+    const auto it = _strings.find(key);
+    return it == _strings.end()? nullptr : &it->second;
+  }
+
+  soss::Message* find_msg(const std::string& key)
+  {
+    const auto it = _messages.find(key);
+    return it == _messages.end()? nullptr : &it->second;
+  }
+
+  bool null() override
+  {
+    if(_builder)
+      return _builder->null();
+
+    if(_skip == 0 && _tracked())
+    {
+      throw std::runtime_error(
+            "[soss::websocket::rosbridge_v2] Incoming message has a null value "
+            "for the field [" + _key + "]");
+    }
+
+    return true;
+  }
+
+  bool boolean(const bool val) override
+  {
+    if(_builder)
+      return _builder->boolean(val);
+
+    return _scalar(std::to_string(val));
+  }
+
+  bool number_integer(const number_integer_t val) override
+  {
+    if(_builder)
+      return _builder->number_integer(val);
+
+    return _scalar(std::to_string(val));
+  }
+
+  bool number_unsigned(const number_unsigned_t val) override
+  {
+    if(_builder)
+      return _builder->number_unsigned(val);
+
+    return _scalar(std::to_string(val));
+  }
+
+  bool number_float(const number_float_t val, const string_t& s) override
+  {
+    if(_builder)
+      return _builder->number_float(val, s);
+
+    return _scalar(std::to_string(val));
+  }
+
+  bool string(string_t& val) override
+  {
+    if(_builder)
+      return _builder->string(val);
+
+    return _scalar(std::move(val));
+  }
+
+  bool start_object(const std::size_t elements) override
+  {
+    if(_builder)
+      return _builder->start_object(elements);
+
+    if(_skip > 0 || (_depth == 1 && !_is_payload_key()))
+    {
+      ++_skip;
+      return true;
+    }
+
+    if(_depth == 1)
+    {
+      // The payload fields get built by a MessageBuilder, which will receive
+      // every event until the payload object is finished.
+      _builder = std::make_unique<json::MessageBuilder>();
+      return _builder->start_object(elements);
+    }
+
+    ++_depth;
+    return true;
+  }
+
+  bool key(string_t& val) override
+  {
+    if(_builder)
+      return _builder->key(val);
+
+    if(_skip == 0)
+      _key = std::move(val);
+
+    return true;
+  }
+
+  bool end_object() override
+  {
+    if(_builder)
+    {
+      _builder->end_object();
+      if(_builder->finished())
+      {
+        _messages[_key] = _builder->take();
+        _builder.reset();
+      }
+
+      return true;
+    }
+
+    if(_skip > 0)
+      --_skip;
+    else
+      --_depth;
+
+    return true;
+  }
+
+  bool start_array(const std::size_t elements) override
+  {
+    if(_builder)
+      return _builder->start_array(elements);
+
+    if(_depth == 0)
+      _throw_not_an_object();
+
+    ++_skip;
+    return true;
+  }
+
+  bool end_array() override
+  {
+    if(_builder)
+      return _builder->end_array();
+
+    --_skip;
+    return true;
+  }
+
+  bool parse_error(
+      const std::size_t /*position*/,
+      const std::string& /*last_token*/,
+      const nlohmann::detail::exception& ex) override
+  {
+    throw std::runtime_error(
+          std::string("[soss::websocket::rosbridge_v2] Failed to parse an "
+                      "incoming message: ") + ex.what());
+  }
+
+private:
+
+  bool _tracked() const
+  {
+    return _depth == 1 && !_is_payload_key();
+  }
+
+  bool _is_payload_key() const
+  {
+    return _key == JsonMsgKey || _key == JsonArgsKey || _key == JsonValuesKey;
+  }
+
+  bool _scalar(std::string value)
+  {
+    if(_depth == 0)
+      _throw_not_an_object();
+
+    if(_skip == 0 && _tracked())
+      _strings[_key] = std::move(value);
+
+    return true;
+  }
+
+  [[noreturn]] static void _throw_not_an_object()
+  {
+    throw std::runtime_error(
+          "[soss::websocket::rosbridge_v2] Incoming message is not an object");
+  }
+
+  std::unordered_map<std::string, std::string> _strings;
+  std::unordered_map<std::string, soss::Message> _messages;
+  std::unique_ptr<json::MessageBuilder> _builder;
+  std::string _key;
+  std::size_t _depth = 0;
+  std::size_t _skip = 0;
+
+};
 
 //==============================================================================
 static void throw_missing_key(
-    const Json& object,
+    const IncomingMessage& object,
     const std::string& key)
 {
-  const std::string op_code = object.at("op").get<std::string>();
+  const std::string* op_code = object.find_string(JsonOpKey);
   throw std::runtime_error(
         "[soss::websocket::rosbridge_v2] Incoming websocket message with op "
-        "code [" + op_code + "] is missing the required field [" + key
-        + "]:\n" + object.dump());
+        "code [" + *op_code + "] is missing the required field [" + key
+        + "]");
 }
 
 //==============================================================================
 static std::string get_optional_string(
-    const Json& object,
+    const IncomingMessage& object,
     const std::string& key)
 {
-  const auto it = object.find(key);
-  return it == object.end()? "" : soss::json::to_string(it.value());
+  const std::string* value = object.find_string(key);
+  return value? *value : "";
 }
 
 //==============================================================================
 static std::string get_required_string(
-    const Json& object,
+    const IncomingMessage& object,
     const std::string& key)
 {
-  const auto it = object.find(key);
-  if(it == object.end())
+  const std::string* value = object.find_string(key);
+  if(!value)
     throw_missing_key(object, key);
 
-  return soss::json::to_string(it.value());
+  return *value;
 }
 
 //==============================================================================
 static soss::Message get_required_msg(
-    const Json& object,
+    IncomingMessage& object,
     const std::string& key)
 {
-  const auto it = object.find(key);
-  if(it == object.end())
+  soss::Message* msg = object.find_msg(key);
+  if(!msg)
     throw_missing_key(object, key);
 
-  return json::convert("", it.value());
+  return std::move(*msg);
+}
+
+//==============================================================================
+static std::size_t get_size(
+    const IncomingMessage& object,
+    const std::string& key,
+    const std::string& value)
+{
+  try
+  {
+    std::size_t consumed = 0;
+    const unsigned long result = std::stoul(value, &consumed);
+    if(consumed == value.size())
+      return result;
+  }
+  catch(const std::logic_error&)
+  {
+    // Fall through to the error below
+  }
+
+  const std::string* op_code = object.find_string(JsonOpKey);
+  throw std::runtime_error(
+        "[soss::websocket::rosbridge_v2] Incoming websocket message with op "
+        "code [" + *op_code + "] has an invalid value [" + value
+        + "] for the field [" + key + "]");
+}
+
+//==============================================================================
+static std::size_t get_required_size(
+    const IncomingMessage& object,
+    const std::string& key)
+{
+  return get_size(object, key, get_required_string(object, key));
+}
+
+//==============================================================================
+static TransferOptions get_transfer_options(const IncomingMessage& object)
+{
+  TransferOptions options;
+
+  const std::string* fragment_size = object.find_string(JsonFragmentSizeKey);
+  if(fragment_size)
+  {
+    options.fragment_size =
+        get_size(object, JsonFragmentSizeKey, *fragment_size);
+  }
+
+  const std::string* throttle_rate = object.find_string(JsonThrottleRateKey);
+  if(throttle_rate)
+  {
+    options.throttle_rate = std::chrono::milliseconds(
+          get_size(object, JsonThrottleRateKey, *throttle_rate));
+  }
+
+  const std::string* queue_length = object.find_string(JsonQueueLengthKey);
+  if(queue_length)
+    options.queue_length = get_size(object, JsonQueueLengthKey, *queue_length);
+
+  const std::string* delta = object.find_string(JsonDeltaKey);
+  if(delta)
+    options.delta_keyframes = get_size(object, JsonDeltaKey, *delta);
+
+  const std::string* compression = object.find_string(JsonCompressionKey);
+  if(compression)
+  {
+    if(*compression == JsonCompressionCbor)
+    {
+      options.cbor = true;
+    }
+    else if(*compression == JsonCompressionPng)
+    {
+      std::cerr << "[soss::websocket::rosbridge_v2] The [" << JsonCompressionPng
+                << "] compression is not supported. Messages will be sent "
+                << "uncompressed instead." << std::endl;
+    }
+    else if(*compression != JsonCompressionNone)
+    {
+      std::cerr << "[soss::websocket::rosbridge_v2] Unknown compression ["
+                << *compression << "] was requested. Messages will be sent "
+                << "uncompressed instead." << std::endl;
+    }
+  }
+
+  return options;
 }
 
+//==============================================================================
+/// Copy the fields of a subscribe or call_service op from the YAML
+/// configuration of the topic or service, if they were given.
+static void copy_request_options(
+    const YAML::Node& configuration,
+    const std::vector<std::string>& keys,
+    Json& output)
+{
+  if(!configuration)
+    return;
+
+  for(const std::string& key : keys)
+  {
+    const YAML::Node value = configuration[key];
+    if(!value)
+      continue;
+
+    if(key == JsonCompressionKey)
+      output[key] = value.as<std::string>();
+    else
+      output[key] = value.as<uint64_t>();
+  }
+}
+
+//==============================================================================
+/// The wire formats that the rosbridge v2.0 protocol can be serialized into
+enum class Format
+{
+  Text,
+  Cbor,
+  MessagePack
+};
+
 //==============================================================================
 class RosbridgeV2_0 : public Encoding
 {
 public:
 
+  RosbridgeV2_0(const Format format)
+    : _format(format)
+  {
+    // Do nothing
+  }
+
+  bool binary() const override
+  {
+    return _format != Format::Text;
+  }
+
   void interpret_websocket_msg(
       const std::string& msg_str,
       Endpoint& endpoint,
       std::shared_ptr<void> connection_handle) const override
   {
-    const auto msg = Json::parse(msg_str);
+    IncomingMessage msg;
+    _parse(msg_str, msg);
 
-    const auto op_it = msg.find(JsonOpKey);
-    if(op_it == msg.end())
+    const std::string* const op_it = msg.find_string(JsonOpKey);
+    if(!op_it)
     {
       throw std::runtime_error(
             "[soss::websocket::rosbridge_v2] Incoming message was missing "
-            "the required op code: " + msg_str);
+            "the required op code");
     }
 
-    const std::string& op_str = op_it.value().get<std::string>();
+    const std::string& op_str = *op_it;
 
     // Publish is the most likely type of message to be received, so we'll check
     // for that type first.
@@ -139,6 +489,7 @@ public:
             get_required_string(msg, JsonServiceKey),
             get_required_msg(msg, JsonArgsKey),
             get_optional_string(msg, JsonIdKey),
+            get_transfer_options(msg),
             std::move(connection_handle));
       return;
     }
@@ -155,6 +506,19 @@ public:
       return;
     }
 
+    // Large messages may be broken into fragments, which get reassembled by
+    // the endpoint and then interpreted again as a whole message.
+    if(op_str == JsonOpFragmentKey)
+    {
+      endpoint.receive_fragment_ws(
+            get_required_string(msg, JsonIdKey),
+            get_required_string(msg, JsonDataKey),
+            get_required_size(msg, JsonNumKey),
+            get_required_size(msg, JsonTotalKey),
+            std::move(connection_handle));
+      return;
+    }
+
     if(op_str == JsonOpAdvertiseTopicKey)
     {
       endpoint.receive_topic_advertisement_ws(
@@ -180,6 +544,7 @@ public:
             get_required_string(msg, JsonTopicNameKey),
             get_optional_string(msg, JsonTypeNameKey),
             get_optional_string(msg, JsonIdKey),
+            get_transfer_options(msg),
             std::move(connection_handle));
       return;
     }
@@ -215,16 +580,77 @@ public:
       const std::string& topic_name,
       const std::string& /*topic_type*/,
       const std::string& id,
-      const soss::Message& msg) const override
+      const soss::Message& msg,
+      const int precision) const override
   {
     Json output;
     output[JsonOpKey] = JsonOpPublishKey;
     output[JsonTopicNameKey] = topic_name;
-    output[JsonMsgKey] = json::convert(msg);
+    output[JsonMsgKey] = json::convert(msg, precision);
     if(!id.empty())
       output[JsonIdKey] = id;
 
-    return output.dump();
+    return _serialize(output);
+  }
+
+  PublicationEnvelopePtr make_publication_envelope(
+      const std::string& topic_name) const override
+  {
+    // CBOR and MessagePack write the length of the map up front, so they are
+    // left to the Json object
+    if(_format != Format::Text)
+      return nullptr;
+
+    // The keys are written in the order that Json would sort them in, so the
+    // publications come out exactly as they would from the Json object
+    auto envelope = std::make_shared<Envelope>();
+    envelope->prefix = "{" + Json(JsonMsgKey).dump() + ":";
+    envelope->suffix =
+        "," + Json(JsonOpKey).dump() + ":" + Json(JsonOpPublishKey).dump()
+        + "," + Json(JsonTopicNameKey).dump() + ":" + Json(topic_name).dump()
+        + "}";
+
+    return envelope;
+  }
+
+  std::string encode_publication_msg(
+      const PublicationEnvelope& envelope,
+      const soss::Message& msg,
+      const int precision) const override
+  {
+    const Envelope& rendered = static_cast<const Envelope&>(envelope);
+
+    std::string output;
+    output.reserve(std::max(
+      rendered.last_size.load(std::memory_order_relaxed),
+      rendered.prefix.size() + rendered.suffix.size()));
+
+    output += rendered.prefix;
+    nlohmann::detail::serializer<Json> serializer(
+          nlohmann::detail::output_adapter<char>(output), ' ');
+    serializer.dump(json::convert(msg, precision), false, false, 0);
+    output += rendered.suffix;
+
+    rendered.last_size.store(output.size(), std::memory_order_relaxed);
+    return output;
+  }
+
+  std::string encode_delta_publication_msg(
+      const std::string& topic_name,
+      const std::string& /*topic_type*/,
+      const std::string& id,
+      const soss::Message& changes,
+      const int precision) const override
+  {
+    Json output;
+    output[JsonOpKey] = JsonOpPublishKey;
+    output[JsonTopicNameKey] = topic_name;
+    output[JsonMsgKey] = json::convert(changes, precision);
+    output[JsonDeltaKey] = true;
+    if(!id.empty())
+      output[JsonIdKey] = id;
+
+    return _serialize(output);
   }
 
   std::string encode_service_response_msg(
@@ -242,17 +668,15 @@ public:
     if(!id.empty())
       output[JsonIdKey] = id;
 
-    return output.dump();
+    return _serialize(output);
   }
 
   std::string encode_subscribe_msg(
       const std::string& topic_name,
       const std::string& message_type,
       const std::string& id,
-      const YAML::Node& /*configuration*/) const override
+      const YAML::Node& configuration) const override
   {
-    // TODO(MXG): Consider parsing the `configuration` for details like
-    // throttle_rate, queue_length, fragment_size, and compression
     Json output;
     output[JsonOpKey] = JsonOpSubscribeKey;
     output[JsonTopicNameKey] = topic_name;
@@ -260,7 +684,13 @@ public:
     if(!id.empty())
       output[JsonIdKey] = id;
 
-    return output.dump();
+    copy_request_options(
+          configuration,
+          {JsonThrottleRateKey, JsonQueueLengthKey,
+           JsonFragmentSizeKey, JsonCompressionKey},
+          output);
+
+    return _serialize(output);
   }
 
   std::string encode_advertise_msg(
@@ -276,7 +706,7 @@ public:
     if(!id.empty())
       output[JsonIdKey] = id;
 
-    return output.dump();
+    return _serialize(output);
   }
 
   std::string encode_call_service_msg(
@@ -284,10 +714,8 @@ public:
       const std::string& /*service_type*/,
       const soss::Message& service_request,
       const std::string& id,
-      const YAML::Node& /*configuration*/) const override
+      const YAML::Node& configuration) const override
   {
-    // TODO(MXG): Consider parsing the `configuration` for details like
-    // fragment_size and compression
     Json output;
     output[JsonOpKey] = JsonOpServiceRequestKey;
     output[JsonServiceKey] = service_name;
@@ -295,7 +723,28 @@ public:
     if(!id.empty())
       output[JsonIdKey] = id;
 
-    return output.dump();
+    copy_request_options(
+          configuration,
+          {JsonFragmentSizeKey, JsonCompressionKey},
+          output);
+
+    return _serialize(output);
+  }
+
+  std::string encode_fragment_msg(
+      const std::string& id,
+      const std::string& data,
+      const std::size_t num,
+      const std::size_t total) const override
+  {
+    Json output;
+    output[JsonOpKey] = JsonOpFragmentKey;
+    output[JsonIdKey] = id;
+    output[JsonDataKey] = data;
+    output[JsonNumKey] = num;
+    output[JsonTotalKey] = total;
+
+    return _serialize(output);
   }
 
   std::string encode_advertise_service_msg(
@@ -309,15 +758,80 @@ public:
     output[JsonTypeNameKey] = service_type;
     output[JsonServiceKey] = service_name;
 
-    return output.dump();
+    return _serialize(output);
+  }
+
+private:
+
+  /// The text of a publication around its message, and the size of the
+  /// latest publication, which is reserved up front for the next one so that
+  /// writing the message does not have to grow the output along the way
+  struct Envelope : PublicationEnvelope
+  {
+    std::string prefix;
+    std::string suffix;
+    mutable std::atomic_size_t last_size{0};
+  };
+
+  std::string _serialize(const Json& output) const
+  {
+    std::string result;
+    switch(_format)
+    {
+      case Format::Text:
+        return output.dump();
+
+      case Format::Cbor:
+        Json::to_cbor(output, result);
+        break;
+
+      case Format::MessagePack:
+        Json::to_msgpack(output, result);
+        break;
+    }
+
+    return result;
   }
 
+  void _parse(const std::string& msg_str, IncomingMessage& msg) const
+  {
+    // Peers that speak a binary format may still send us plain JSON text, for
+    // example while they are negotiating. A JSON object always begins with a
+    // '{', which is never a valid first byte for a CBOR or MessagePack map, so
+    // we can tell the formats apart without needing the websocket opcode.
+    const bool text =
+        _format == Format::Text || (!msg_str.empty() && msg_str.front() == '{');
+
+    const auto input_format =
+        text? Json::input_format_t::json
+            : _format == Format::Cbor? Json::input_format_t::cbor
+                                     : Json::input_format_t::msgpack;
+
+    Json::sax_parse(
+          nlohmann::detail::input_adapter(msg_str.data(), msg_str.size()),
+          &msg, input_format);
+  }
+
+  const Format _format;
+
 };
 
 //==============================================================================
 EncodingPtr make_rosbridge_v2_0()
 {
-  return std::make_shared<RosbridgeV2_0>();
+  return std::make_shared<RosbridgeV2_0>(Format::Text);
+}
+
+//==============================================================================
+EncodingPtr make_rosbridge_v2_0_cbor()
+{
+  return std::make_shared<RosbridgeV2_0>(Format::Cbor);
+}
+
+//==============================================================================
+EncodingPtr make_rosbridge_v2_0_msgpack()
+{
+  return std::make_shared<RosbridgeV2_0>(Format::MessagePack);
 }
 
 } // namespace websocket
@@ -19,28 +19,190 @@
 #define SOSS__WEBOSCKET__SRC__WEBSOCKET_TYPES_HPP
 
 #include <websocketpp/config/asio.hpp>
+#include <websocketpp/extensions/permessage_deflate/enabled.hpp>
 #include <websocketpp/server.hpp>
 #include <websocketpp/client.hpp>
 
+#include <cstdint>
+#include <type_traits>
+
 namespace soss {
 namespace websocket {
 
-using TlsConfig = websocketpp::config::asio_tls;
+//==============================================================================
+/// Settings for the permessage-deflate extension of one endpoint. The server
+/// side of the extension negotiates the offers of remote clients, while the
+/// client side makes the offers, so the settings also carry the role of their
+/// endpoint.
+///
+/// websocketpp constructs the extension of each connection on its own, without
+/// any way to hand it arguments, so every endpoint binds its settings to the
+/// threads that run its io. The handshakes of a connection always happen on
+/// one of those threads.
+struct DeflateSettings
+{
+  enum class Role
+  {
+    Server,
+    Client
+  };
+
+  DeflateSettings(const Role role_)
+    : role(role_)
+  {
+    // Do nothing
+  }
+
+  Role role;
+
+  /// Compression is opt-in, because it trades CPU for bandwidth
+  bool enabled = false;
+
+  /// The largest LZ77 window that the deflate streams may use, between 9 and
+  /// 15. Smaller windows use less memory per connection, but compress less.
+  uint8_t max_window_bits = 15;
+
+  /// The settings of the endpoint whose io is run by the current thread, or
+  /// nullptr on any other thread
+  static const DeflateSettings*& current()
+  {
+    static thread_local const DeflateSettings* settings = nullptr;
+    return settings;
+  }
+
+  /// Binds the settings of an endpoint to the current thread while it runs
+  /// the io of that endpoint
+  class Binding
+  {
+  public:
+
+    Binding(const DeflateSettings& settings)
+      : _previous(current())
+    {
+      current() = &settings;
+    }
+
+    ~Binding()
+    {
+      current() = _previous;
+    }
+
+  private:
+
+    const DeflateSettings* const _previous;
+
+  };
+};
+
+//==============================================================================
+/// The permessage-deflate extension of websocketpp always negotiates the
+/// extension whenever a peer offers it. This wrapper only makes an offer from
+/// a client endpoint, and only accepts one on a server endpoint, when
+/// compression has been enabled for that endpoint, and it applies the window
+/// size of the endpoint.
+template<typename Config>
+class DeflateExtension
+    : public websocketpp::extensions::permessage_deflate::enabled<Config>
+{
+public:
+
+  using Base = websocketpp::extensions::permessage_deflate::enabled<Config>;
+
+  std::string generate_offer() const
+  {
+    const DeflateSettings* const settings = DeflateSettings::current();
+    if(!settings || settings->role != DeflateSettings::Role::Client
+       || !settings->enabled)
+      return std::string();
+
+    return Base::generate_offer();
+  }
+
+  websocketpp::err_str_pair negotiate(
+      const websocketpp::http::attribute_list& offer)
+  {
+    namespace deflate = websocketpp::extensions::permessage_deflate;
+
+    const DeflateSettings* const settings = DeflateSettings::current();
+    if(!settings || settings->role != DeflateSettings::Role::Server
+       || !settings->enabled)
+    {
+      // Failing the negotiation only declines this extension, the connection
+      // itself will carry on without compression.
+      return websocketpp::err_str_pair(
+            deflate::error::make_error_code(deflate::error::general),
+            std::string());
+    }
+
+    this->set_server_max_window_bits(
+          settings->max_window_bits, deflate::mode::smallest);
+    this->set_client_max_window_bits(
+          settings->max_window_bits, deflate::mode::smallest);
+
+    return Base::negotiate(offer);
+  }
+};
+
+//==============================================================================
+/// Base configuration for websockets with TLS
+struct TlsConfig : public websocketpp::config::asio_tls
+{
+  using type = TlsConfig;
+
+  struct permessage_deflate_config { };
+
+  using permessage_deflate_type = DeflateExtension<permessage_deflate_config>;
+};
+
+//==============================================================================
+/// Base configuration for plain websockets over TCP, for trusted links where
+/// encryption would only cost CPU time
+struct TcpConfig : public websocketpp::config::asio
+{
+  using type = TcpConfig;
+
+  struct permessage_deflate_config { };
+
+  using permessage_deflate_type = DeflateExtension<permessage_deflate_config>;
+};
+
+template<typename Config>
+using WsCppServerT = websocketpp::server<Config>;
+
+template<typename Config>
+using WsCppClientT = websocketpp::client<Config>;
+
+template<typename Config>
+using WsCppEndpointT =
+    websocketpp::endpoint<websocketpp::connection<Config>, Config>;
+
+template<typename Config>
+using WsCppConnectionPtrT = typename WsCppEndpointT<Config>::connection_ptr;
+
 using Connection = websocketpp::connection<TlsConfig>;
 
-using WsCppServer = websocketpp::server<TlsConfig>;
-using WsCppClient = websocketpp::client<TlsConfig>;
+using WsCppServer = WsCppServerT<TlsConfig>;
+using WsCppClient = WsCppClientT<TlsConfig>;
 
-using WsCppEndpoint = websocketpp::endpoint<Connection, TlsConfig>;
+using WsCppEndpoint = WsCppEndpointT<TlsConfig>;
 using WsCppEndpointPtr = std::unique_ptr<WsCppEndpoint>;
 
 using WsCppWeakConnectPtr = websocketpp::connection_hdl;
-using WsCppMessagePtr = WsCppEndpoint::message_ptr;
+using WsCppMessage = TlsConfig::message_type;
+using WsCppMessagePtr = WsCppMessage::ptr;
+
+// The endpoints share their messages regardless of the transport, so every
+// configuration must use the same message type.
+static_assert(
+    std::is_same<WsCppMessage, TcpConfig::message_type>::value,
+    "The TLS and TCP configurations must use the same websocket messages");
 
 using WsCppConnectionPtr = WsCppEndpoint::connection_ptr;
 
 using WsCppSslContext = boost::asio::ssl::context;
 using WsCppSslContextPtr = std::shared_ptr<WsCppSslContext>;
+using WsCppSslSocket =
+    boost::asio::ssl::stream<boost::asio::ip::tcp::socket>;
 
 } // namespace websocket
 } // namespace soss
@@ -20,6 +20,8 @@
 #include <jwt/jwt.hpp>
 #include <yaml-cpp/yaml.h>
 
+#include <thread>
+
 #include <JwtValidator.hpp>
 #include <ServerConfig.hpp>
 
@@ -173,3 +175,89 @@ policies: [
   ServerConfig::load_auth_policy(jwt_validator, auth_node);
   CHECK(jwt_validator.verify(test_token));
 }
+
+TEST_CASE("cached tokens", "[Verification]")
+{
+  JwtValidator jwt_validator;
+  jwt_validator.add_verification_policy(VerificationPolicies::match_all(
+      {{ "iss", "test" }}, "test", "HS256"));
+
+  // The second verification is served from the cache
+  CHECK(jwt_validator.verify(test_token));
+  CHECK(jwt_validator.verify(test_token));
+
+  // A token that failed is never remembered
+  std::string tampered_token = test_token;
+  tampered_token.back() = 'X';
+  CHECK_FALSE(jwt_validator.verify(tampered_token));
+  CHECK_FALSE(jwt_validator.verify(tampered_token));
+
+  jwt_validator.set_cache_size(0);
+  CHECK(jwt_validator.verify(test_token));
+}
+
+TEST_CASE("cached tokens expire", "[Verification]")
+{
+  using namespace jwt::params;
+
+  JwtValidator jwt_validator;
+  jwt_validator.add_verification_policy(VerificationPolicies::match_all(
+      {}, "test", "HS256"));
+
+  jwt::jwt_object obj{
+    algorithm("HS256"), payload({{"iss", "test"}}), secret("test")};
+  obj.add_claim("exp", std::chrono::system_clock::now()
+                + std::chrono::seconds(1));
+  const std::string token = obj.signature();
+
+  CHECK(jwt_validator.verify(token));
+
+  std::this_thread::sleep_for(std::chrono::seconds(2));
+  CHECK_FALSE(jwt_validator.verify(token));
+}
+
+TEST_CASE("cache size", "[Load Config]")
+{
+  JwtValidator jwt_validator;
+  YAML::Node auth_node = YAML::Load(R"raw(
+cache_size: 1
+policies: [
+  {
+    secret: test,
+    algo: HS256
+  }
+]
+)raw");
+  CHECK(ServerConfig::load_auth_policy(jwt_validator, auth_node));
+  CHECK(jwt_validator.verify(test_token));
+  CHECK(jwt_validator.verify(test_token));
+}
+
+TEST_CASE("escaped rule patterns", "[Verification]")
+{
+  using namespace jwt::params;
+
+  jwt::jwt_object obj{
+    algorithm("HS256"), payload({{"sub", "robot42"}}), secret("test")};
+  const std::string token = obj.signature();
+
+  // \d is a character class, not the letter d
+  JwtValidator digits;
+  digits.add_verification_policy(VerificationPolicies::match_all(
+      {{ "sub", "robot\\d\\d" }}, "test", "HS256"));
+  CHECK(digits.verify(token));
+
+  JwtValidator letter;
+  letter.add_verification_policy(VerificationPolicies::match_all(
+      {{ "sub", "robot\\d" }}, "test", "HS256"));
+  CHECK_FALSE(letter.verify(token));
+
+  // An escaped special character stands for itself
+  jwt::jwt_object dotted{
+    algorithm("HS256"), payload({{"sub", "robot.42"}}), secret("test")};
+  JwtValidator dot;
+  dot.add_verification_policy(VerificationPolicies::match_all(
+      {{ "sub", "robot\\.42" }}, "test", "HS256"));
+  CHECK(dot.verify(dotted.signature()));
+  CHECK_FALSE(dot.verify(token));
+}